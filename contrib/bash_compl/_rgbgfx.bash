@@ -18,6 +18,7 @@ _rgbgfx_completions() {
 		[A]="auto-attr-map:normal"
 		[b]="base-tiles:unk"
 		[d]="depth:unk"
+		[j]="jobs:unk"
 		[L]="slice:unk"
 		[N]="nb-tiles:unk"
 		[n]="nb-palettes:unk"
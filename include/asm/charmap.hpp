@@ -16,7 +16,15 @@ void charmap_Push();
 void charmap_Pop();
 void charmap_Add(std::string const &mapping, uint8_t value);
 bool charmap_HasChar(std::string const &input);
-std::vector<uint8_t> charmap_Convert(std::string const &input);
+// The returned conversion is only valid until the next conversion or charmap modification
+std::vector<uint8_t> const &charmap_Convert(std::string const &input);
+size_t charmap_CharLen(std::string const &input);
 size_t charmap_ConvertNext(std::string_view &input, std::vector<uint8_t> *output);
 
+std::string const &charmap_GetCurrentName();
+// Calls `mapFunc` with each charmap's name, then `charFunc` with each of its mappings
+void charmap_ForEach(
+    void (*mapFunc)(std::string const &), void (*charFunc)(std::string const &, uint8_t)
+);
+
 #endif // RGBDS_ASM_CHARMAP_HPP
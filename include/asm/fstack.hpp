@@ -40,8 +40,7 @@ struct FileStackNode {
 	std::string &name();
 	std::string const &name() const;
 
-	FileStackNode(FileStackNodeType type_, std::variant<std::vector<uint32_t>, std::string> data_)
-	    : type(type_), data(data_){};
+	FileStackNode(FileStackNodeType type_, std::variant<std::vector<uint32_t>, std::string> data_);
 
 	std::string const &dump(uint32_t curLineNo) const;
 
@@ -56,11 +55,18 @@ struct MacroArgs;
 
 void fstk_DumpCurrent();
 std::shared_ptr<FileStackNode> fstk_GetFileStack();
+uint64_t fstk_GetNbNodes(); // How many nodes were ever created
+uint64_t fstk_GetNbMacroInvocations();
 std::shared_ptr<std::string> fstk_GetUniqueIDStr();
 MacroArgs *fstk_GetCurrentMacroArgs();
 
 void fstk_AddIncludePath(std::string const &path);
 void fstk_SetPreIncludeFile(std::string const &path);
+void fstk_SetPrecompiledHeader(std::string const &path);
+// Reads the precompiled header now, for the processes forked afterwards to share
+void fstk_PreloadPrecompiledHeader();
+// Returns where `path` is found in the include paths, without recording it as a dependency
+std::optional<std::string> const &fstk_ResolveFile(std::string const &path);
 std::optional<std::string> fstk_FindFile(std::string const &path);
 
 bool yywrap();
@@ -0,0 +1,55 @@
+/* SPDX-License-Identifier: MIT */
+
+// The include cache remembers what "header-only" INCLUDE files (ones that only define numeric and
+// string constants, macros and charmaps) did, so that later assemblies can replay those
+// definitions instead of lexing and parsing the files again.
+
+#ifndef RGBDS_ASM_INCCACHE_HPP
+#define RGBDS_ASM_INCCACHE_HPP
+
+#include <stdint.h>
+#include <string>
+
+#include "asm/lexer.hpp"
+
+struct Symbol;
+struct CachedInclude;
+
+enum CachedDirectiveType {
+	CACHED_EQU,
+	CACHED_REDEF_EQU,
+	CACHED_VAR,
+	CACHED_EQUS,
+	CACHED_REDEF_EQUS,
+	CACHED_MACRO,
+	CACHED_NEWCHARMAP,
+	CACHED_NEWCHARMAP_BASE,
+	CACHED_SETCHARMAP,
+	CACHED_PUSHC,
+	CACHED_POPC,
+	CACHED_CHARMAP,
+	CACHED_RSSET,
+
+	NB_CACHED_DIRECTIVES
+};
+
+void inccache_SetDirectory(std::string const &path);
+
+// Returns the cache entry for `path` if it can be replayed in the current state, or `nullptr`
+CachedInclude const *inccache_Find(std::string const &path);
+// `lineNo` is updated before each replayed directive, so that it gets its original line number
+void inccache_Replay(CachedInclude const &cached, uint32_t &lineNo);
+
+// Returns whether the effects of including `path` are being recorded
+bool inccache_StartRecording(std::string const &path);
+void inccache_StopRecording();
+// Marks the includes being recorded as not cacheable, e.g. because they emitted a diagnostic
+void inccache_Poison();
+
+void inccache_RecordLookup(std::string const &symName, Symbol const *sym);
+void inccache_RecordDirective(CachedDirectiveType type, std::string const &name, int32_t value);
+void inccache_RecordDirective(
+    CachedDirectiveType type, std::string const &name, std::string const &text, int32_t value = 0
+);
+
+#endif // RGBDS_ASM_INCCACHE_HPP
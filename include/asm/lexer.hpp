@@ -13,13 +13,18 @@
 
 #include "platform.hpp" // SSIZE_MAX
 
+struct MacroArgs;
+
 // This value is a compromise between `LexerState` allocation performance when `mmap` works, and
 // buffering performance when it doesn't/can't (e.g. when piping a file into RGBASM).
 #define LEXER_BUF_SIZE 64
+// The buffer grows up to this size while reads keep filling it, so that large inputs stream
+// efficiently (e.g. when a generated file is piped into RGBASM).
+#define LEXER_BUF_MAX_SIZE 0x10000
 // The buffer needs to be large enough for the maximum `lexerState->peek()` lookahead distance
 static_assert(LEXER_BUF_SIZE > 1, "Lexer buffer size is too small");
 // This caps the size of buffer reads, and according to POSIX, passing more than SSIZE_MAX is UB
-static_assert(LEXER_BUF_SIZE <= SSIZE_MAX, "Lexer buffer size is too large");
+static_assert(LEXER_BUF_MAX_SIZE <= SSIZE_MAX, "Lexer buffer size is too large");
 
 enum LexerMode {
 	LEXER_NORMAL,
@@ -30,11 +35,20 @@ enum LexerMode {
 	NB_LEXER_MODES
 };
 
+enum ExpansionType { EXPANSION_MACRO_ARG, EXPANSION_EQUS, EXPANSION_INTERPOLATION };
+
 struct Expansion {
-	std::optional<std::string> name;
+	ExpansionType type;
+	std::string symName; // The expanded symbol's name, only for `EXPANSION_EQUS`
 	std::shared_ptr<std::string> contents;
 	size_t offset; // Cursor into `contents`
 
+	// The name reported in "while expanding symbol" messages, if any
+	std::string const *name() const {
+		return type == EXPANSION_EQUS            ? &symName
+		       : type == EXPANSION_INTERPOLATION ? contents.get()
+		                                         : nullptr;
+	}
 	size_t size() const { return contents->size(); }
 	bool advance(); // Increment `offset`; return whether it then exceeds `contents`
 };
@@ -57,10 +71,11 @@ struct ViewedContent {
 };
 
 struct BufferedContent {
-	int fd;                        // File from which to read chars
-	char buf[LEXER_BUF_SIZE] = {}; // Circular buffer of chars
-	size_t offset = 0;             // Cursor into `buf`
-	size_t size = 0;               // Number of "fresh" chars in `buf`
+	int fd;                                                    // File from which to read chars
+	std::vector<char> buf = std::vector<char>(LEXER_BUF_SIZE); // Circular buffer of chars
+	size_t offset = 0;                                         // Cursor into `buf`
+	size_t size = 0;                                           // Number of "fresh" chars in `buf`
+	bool wasFilled = false;                                    // Whether the last read filled `buf`
 
 	BufferedContent(int fd_) : fd(fd_) {}
 	~BufferedContent();
@@ -91,29 +106,31 @@ struct LexerState {
 	bool capturing;     // Whether the text being lexed should be captured
 	size_t captureSize; // Amount of text captured
 	std::shared_ptr<std::vector<char>> captureBuf; // Buffer to send the captured text to if set
+	// Expansion whose contents the text is captured from in place, until it goes past their end
+	std::shared_ptr<std::string> captureExpansion;
+	size_t captureStart; // Offset of the captured text in `captureExpansion`
 
 	bool disableMacroArgs;
 	bool disableInterpolation;
 	size_t macroArgScanDistance; // Max distance already scanned for macro args
 	bool expandStrings;
-	std::deque<Expansion> expansions; // Front is the innermost current expansion
+	std::vector<Expansion> expansions; // Back is the innermost current expansion
 
 	std::variant<std::monostate, ViewedContent, BufferedContent> content;
+	bool cachesTokens; // Whether `content` is a macro or REPT/FOR body, which is lexed repeatedly
 
 	~LexerState();
 
 	int peekChar();
 	int peekCharAhead();
 
-	std::shared_ptr<char[]> makeSharedCaptureBufPtr() const {
-		return std::shared_ptr<char[]>(captureBuf, captureBuf->data());
-	}
-
 	void setAsCurrentState();
 	bool setFileAsNextState(std::string const &filePath, bool updateStateNow);
 	void setViewAsNextState(char const *name, ContentSpan const &span, uint32_t lineNo_);
 
 	void clear(uint32_t lineNo_);
+	// Lets go of the content and expansions, but keeps the allocations for the next one
+	void release();
 };
 
 extern char binDigits[2];
@@ -135,6 +152,14 @@ void lexer_RestartRept(uint32_t lineNo);
 void lexer_Init();
 void lexer_SetMode(LexerMode mode);
 void lexer_ToggleStringExpansion(bool enable);
+// Starts lexing a macro invocation's args, which may forward the current macro's `\#` as-is
+void lexer_StartMacroArgs();
+// Returns the args forwarded by `\#` since `lexer_StartMacroArgs`, if any
+std::shared_ptr<MacroArgs> lexer_TakeForwardedMacroArgs();
+// Starts lexing the new value of this EQUS, which may begin by interpolating its current one
+void lexer_StartEqusValue(std::string const &symName);
+// Returns the current value that the new one began with, if it was left out of the string token
+std::shared_ptr<std::string> lexer_TakeElidedEqusPrefix();
 
 uint32_t lexer_GetIFDepth();
 void lexer_IncIFDepth();
@@ -147,6 +172,13 @@ void lexer_ReachELSEBlock();
 void lexer_CheckRecursionDepth();
 uint32_t lexer_GetLineNo();
 uint32_t lexer_GetColNo();
+uint64_t lexer_GetNbTokens();
+uint64_t lexer_GetNbLines(); // Lines of input lexed, not counting those of expanded strings
+uint64_t lexer_GetNbExpansions();
+// Lexing is only timed once enabled, since reading the clock for each token is not free
+void lexer_EnableTiming();
+uint64_t lexer_GetLexingTime(); // In microseconds
+size_t lexer_GetPeakCaptureBytes();
 void lexer_DumpStringExpansions();
 
 struct Capture {
@@ -4,20 +4,30 @@
 #define RGBDS_ASM_MACRO_HPP
 
 #include <memory>
+#include <optional>
 #include <stdint.h>
 #include <string>
 #include <vector>
 
 struct MacroArgs {
-	unsigned int shift;
-	std::vector<std::shared_ptr<std::string>> args;
+	unsigned int shift = 0;
+	// Shared with the macros that these are forwarded to, so only appended to before that
+	std::shared_ptr<std::vector<std::shared_ptr<std::string>>> args =
+	    std::make_shared<std::vector<std::shared_ptr<std::string>>>();
 
-	uint32_t nbArgs() const { return args.size() - shift; }
+	uint32_t nbArgs() const { return args->size() - shift; }
 	std::shared_ptr<std::string> getArg(uint32_t i) const;
 	std::shared_ptr<std::string> getAllArgs() const;
+	// Returns the args that splitting `getAllArgs()` would give, if they can be shared as-is
+	std::shared_ptr<MacroArgs> forwardAllArgs() const;
 
 	void appendArg(std::shared_ptr<std::string> arg);
 	void shiftArgs(int32_t count);
+
+private:
+	mutable std::shared_ptr<std::string> allArgs; // Cached until the args change
+	// How many of the first args would not split back into themselves, once checked
+	mutable std::optional<size_t> nbUnforwardableArgs;
 };
 
 #endif // RGBDS_ASM_MACRO_HPP
@@ -14,5 +14,6 @@ extern std::string targetFileName;
 extern bool generatedMissingIncludes;
 extern bool failedOnMissingInclude;
 extern bool generatePhonyDeps;
+extern bool depsOnly; // Only follow the assembly to find its dependencies, without output
 
 #endif // RGBDS_ASM_MAIN_HPP
@@ -0,0 +1,30 @@
+/* SPDX-License-Identifier: MIT */
+
+// The object cache remembers the object files of whole assemblies, indexed by their main file and
+// the options that they were assembled with, along with the files that they depended on. Later
+// assemblies, possibly on other machines sharing the cache directory, can then write the same
+// object file and dependencies without assembling anything, if those files have not changed.
+
+#ifndef RGBDS_ASM_OBJCACHE_HPP
+#define RGBDS_ASM_OBJCACHE_HPP
+
+#include <span>
+#include <stdint.h>
+#include <string>
+
+void objcache_SetDirectory(std::string const &path);
+// The options are part of what identifies a cache entry, since they can change the object file
+void objcache_SetOptions(int argc, char const * const *argv);
+
+// Writes the object file and dependencies from the cache and returns true if it has them,
+// otherwise starts recording the assembly of `mainFileName` and returns false
+bool objcache_Restore(std::string const &mainFileName);
+// Marks the assembly being recorded as not cacheable, e.g. because it printed something
+void objcache_Poison();
+
+void objcache_RecordLookup(std::string const &path, std::string const &fullPath);
+void objcache_RecordDependency(std::string const &path);
+// Saves the assembly being recorded, if it is cacheable, along with its serialized object file
+void objcache_Store(std::span<std::span<uint8_t const> const> objectParts);
+
+#endif // RGBDS_ASM_OBJCACHE_HPP
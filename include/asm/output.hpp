@@ -6,6 +6,7 @@
 #include <memory>
 #include <stdint.h>
 #include <string>
+#include <vector>
 
 #include "linkdefs.hpp"
 
@@ -13,13 +14,18 @@ struct Expression;
 struct FileStackNode;
 
 extern std::string objectFileName;
+extern bool keepUnchangedObject; // Whether not to rewrite an identical object file
 
 void out_RegisterNode(std::shared_ptr<FileStackNode> node);
 void out_SetFileName(std::string const &name);
-void out_CreatePatch(uint32_t type, Expression const &expr, uint32_t ofs, uint32_t pcShift);
+void out_CreatePatch(
+    uint32_t type, Expression const &expr, uint32_t ofs, uint32_t pcShift, bool isJumpTarget
+);
 void out_CreateAssert(
     AssertionType type, Expression const &expr, std::string const &message, uint32_t ofs
 );
 void out_WriteObject();
+// Writes an object file that was already serialized, e.g. by a previous assembly
+void out_WriteCachedObject(std::vector<uint8_t> const &data);
 
 #endif // RGBDS_ASM_OUTPUT_HPP
@@ -0,0 +1,20 @@
+/* SPDX-License-Identifier: MIT */
+
+// Precompiled headers hold the symbols, charmaps and file stack nodes defined by assembling a
+// "header-only" file, so that other assemblies can start with them instead of including it.
+
+#ifndef RGBDS_ASM_PCH_HPP
+#define RGBDS_ASM_PCH_HPP
+
+#include <memory>
+#include <string>
+
+struct FileStackNode;
+
+void pch_Write(std::string const &path);
+// Reads the header ahead of time, so that `pch_Read` does not have to as long as it is unchanged
+void pch_Preload(std::string const &path);
+// The root node of the header is attached to `parent`, as if it had been pre-included
+void pch_Read(std::string const &path, std::shared_ptr<FileStackNode> const &parent);
+
+#endif // RGBDS_ASM_PCH_HPP
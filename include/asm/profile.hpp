@@ -0,0 +1,21 @@
+/* SPDX-License-Identifier: MIT */
+
+// The profiler attributes assembly time, lexed tokens and emitted bytes to each INCLUDE file,
+// macro and REPT/FOR block, nested the same way as the file stack.
+
+#ifndef RGBDS_ASM_PROFILE_HPP
+#define RGBDS_ASM_PROFILE_HPP
+
+#include <string>
+
+void prof_SetFileName(std::string const &path);
+
+// Starts attributing to a frame nested in the current one; there is one per file stack context,
+// which is also traced
+void prof_Enter(std::string const &name);
+// Stops attributing to the current frame, going back to its parent
+void prof_Exit();
+// Writes the profile, in the JSON format used by flame graph tools such as d3-flame-graph
+void prof_Write();
+
+#endif // RGBDS_ASM_PROFILE_HPP
@@ -12,14 +12,38 @@
 
 struct Symbol;
 
+// Fixed-point functions of a table's variable are kept in its body's RPN, after their args, as
+// `RPN_FIXED_POINT`, the function, and the precision; they never reach an object file, since
+// `makeWithValue` computes them once the variable has a value
+enum FixedPointFunc : uint8_t {
+	FIX_ROUND,
+	FIX_CEIL,
+	FIX_FLOOR,
+	FIX_DIV,
+	FIX_MUL,
+	FIX_MOD,
+	FIX_POW,
+	FIX_LOG,
+	FIX_SIN,
+	FIX_COS,
+	FIX_TAN,
+	FIX_ASIN,
+	FIX_ACOS,
+	FIX_ATAN,
+	FIX_ATAN2,
+};
+static constexpr uint8_t RPN_FIXED_POINT = 0xF0;
+
 struct Expression {
 	std::variant<
 		int32_t,    // If the expression's value is known, it's here
 		std::string // Why the expression is not known, if it isn't
 	> data = 0;
 	bool isSymbol = false; // Whether the expression represents a symbol suitable for const diffing
-	std::vector<uint8_t> rpn{}; // Bytes serializing the RPN expression
-	uint32_t rpnPatchSize = 0;  // Size the expression will take in the object file
+	std::vector<uint8_t> rpn{};  // Bytes serializing the RPN expression
+	uint32_t rpnPatchSize = 0;   // Size the expression will take in the object file
+	bool hasSymbolNames = false; // Whether `rpn` has symbol names, which are written as IDs
+	bool isPerEntry = false;     // Whether it depends on a table's variable or PC, per entry
 
 	Expression() = default;
 	Expression(Expression &&) = default;
@@ -51,6 +75,12 @@ struct Expression {
 	void makeNot();
 	void makeLogicNot();
 	void makeBinaryOp(RPNCommand op, Expression &&src1, Expression const &src2);
+	void makeFixedPointOp(FixedPointFunc func, Expression &&src, int32_t q);
+	void makeFixedPointOp(
+	    FixedPointFunc func, Expression &&src1, Expression const &src2, int32_t q
+	);
+	// Rebuilds `src`, as parsed for a table (e.g. `DB FOR`), with its variable taking this value
+	void makeWithValue(Expression const &src, int32_t value);
 
 	void makeCheckHRAM();
 	void makeCheckRST();
@@ -59,8 +89,15 @@ struct Expression {
 
 private:
 	void clear();
+	void mergeRPN(Expression &&src1, Expression const &src2);
 	uint8_t *reserveSpace(uint32_t size);
 	uint8_t *reserveSpace(uint32_t size, uint32_t patchSize);
 };
 
+// While a table's body is parsed, its variable and PC are left unknown, to be given a value
+// for each entry by `Expression::makeWithValue`
+void rpn_StartTableBody(std::string const &varName);
+void rpn_EndTableBody();
+bool rpn_IsTableVariable(std::string const &symName);
+
 #endif // RGBDS_ASM_RPN_HPP
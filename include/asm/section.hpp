@@ -20,12 +20,14 @@ struct Section;
 
 struct Patch {
 	std::shared_ptr<FileStackNode> src;
+	Section *pcSection;
 	uint32_t lineNo;
 	uint32_t offset;
-	Section *pcSection;
 	uint32_t pcOffset;
+	uint32_t rpnOffset; // Where the RPN expression starts in its arena (see `Section::rpnArena`)
+	uint32_t rpnSize;
 	uint8_t type;
-	std::vector<uint8_t> rpn;
+	bool isJumpTarget; // Whether it is the address that a `jp` or `call` goes to
 };
 
 struct Section {
@@ -40,6 +42,7 @@ struct Section {
 	uint8_t align; // Exactly as specified in `ALIGN[]`
 	uint16_t alignOfs;
 	std::deque<Patch> patches;
+	std::vector<uint8_t> rpnArena; // The patches' RPN expressions, end to end
 	std::vector<uint8_t> data;
 
 	bool isSizeKnown() const;
@@ -75,6 +78,7 @@ void sect_EndLoadSection();
 Section *sect_GetSymbolSection();
 uint32_t sect_GetSymbolOffset();
 uint32_t sect_GetOutputOffset();
+uint64_t sect_GetNbEmittedBytes();
 uint32_t sect_GetAlignBytes(uint8_t alignment, uint16_t offset);
 void sect_AlignPC(uint8_t alignment, uint16_t offset);
 
@@ -91,7 +95,16 @@ void sect_Skip(uint32_t skip, bool ds);
 void sect_RelByte(Expression &expr, uint32_t pcShift);
 void sect_RelBytes(uint32_t n, std::vector<Expression> &exprs);
 void sect_RelWord(Expression &expr, uint32_t pcShift);
+void sect_JumpTarget(Expression &expr);
 void sect_RelLong(Expression &expr, uint32_t pcShift);
+void sect_RelTable(
+    uint8_t width,
+    std::string const &varName,
+    int32_t start,
+    int32_t stop,
+    int32_t step,
+    Expression const &body
+);
 void sect_PCRelByte(Expression &expr, uint32_t pcShift);
 void sect_BinaryFile(std::string const &name, int32_t startPos);
 void sect_BinaryFileSlice(std::string const &name, int32_t startPos, int32_t length);
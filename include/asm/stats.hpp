@@ -0,0 +1,22 @@
+/* SPDX-License-Identifier: MIT */
+
+// The statistics report gives the time taken by each phase of assembly, the lines and tokens that
+// each input file took, counts of what was assembled, and the peak memory usage of its main data
+// structures, in the same JSON format as rgblink's.
+
+#ifndef RGBDS_ASM_STATS_HPP
+#define RGBDS_ASM_STATS_HPP
+
+#include <string>
+
+void stats_SetFileName(std::string const &path);
+
+// Ends the current phase, if any, and starts timing the next one; phases are also traced
+void stats_StartPhase(char const *name);
+// Attributes what is lexed from now on to this file, until it is exited or another is entered
+void stats_EnterFile(std::string const &name);
+void stats_ExitFile();
+// Writes the report, if a file was set; this ends the current phase
+void stats_Write();
+
+#endif // RGBDS_ASM_STATS_HPP
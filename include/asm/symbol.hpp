@@ -93,6 +93,10 @@ Symbol *sym_AddMacro(std::string const &symName, int32_t defLineNo, ContentSpan
 Symbol *sym_Ref(std::string const &symName);
 Symbol *sym_AddString(std::string const &symName, std::shared_ptr<std::string> value);
 Symbol *sym_RedefString(std::string const &symName, std::shared_ptr<std::string> value);
+// Redefines a string symbol as `prefix` followed by `suffix`, where `prefix` is usually its value
+Symbol *sym_AppendString(
+    std::string const &symName, std::shared_ptr<std::string> prefix, std::string const &suffix
+);
 void sym_Purge(std::string const &symName);
 void sym_Init(time_t now);
 
@@ -4,6 +4,7 @@
 #define RGBDS_ASM_WARNING_HPP
 
 extern unsigned int nbErrors, maxErrors;
+extern unsigned int nbDiagnostics; // Including warnings that were disabled
 
 enum WarningState { WARNING_DEFAULT, WARNING_DISABLED, WARNING_ENABLED, WARNING_ERROR };
 
@@ -0,0 +1,45 @@
+/* SPDX-License-Identifier: MIT */
+
+// Diagnostics are printed and counted through these, so that tasks run concurrently by
+// `diag_RunTasks` report them as if they had run one after the other: each task's diagnostics are
+// buffered, then printed in the order of the tasks, and only counted once the ones before it are.
+
+#ifndef RGBDS_DIAGNOSTICS_HPP
+#define RGBDS_DIAGNOSTICS_HPP
+
+#include <functional>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Like their `stdio` counterparts writing to `stderr`
+[[gnu::format(printf, 1, 2)]] void diag_Printf(char const *fmt, ...);
+void diag_VPrintf(char const *fmt, va_list ap);
+void diag_Puts(char const *str); // Like `fputs`, this does not append a newline
+void diag_Putc(char c);
+
+void diag_CountError();
+void diag_CountWarning();
+// Within a task, these include its own, but not those of the tasks that ran concurrently with it
+uint32_t diag_NbErrors();
+uint32_t diag_NbWarnings();
+
+// Calls `printSummary` (if given), then exits with status 1. Within a task, the tasks after it are
+// cancelled instead, and its thread stops; the abort is reported by the thread running the tasks.
+[[noreturn]] void diag_Abort(void (*printSummary)());
+
+// Calls `task(i)` for every `i` below `nbTasks`, spreading them across up to `nbThreads` threads
+// that take them in increasing order; so `task` must only write to the `i`th element of its output.
+// If a task aborts, once the tasks before it are finished, all diagnostics up to its own are
+// printed, then it exits like `diag_Abort`.
+void diag_RunTasks(size_t nbTasks, unsigned int nbThreads, std::function<void(size_t)> const &task);
+
+// Like `diag_RunTasks`, but if a task aborts, only the diagnostics of the tasks before it are
+// printed, and `diag_FinishAbort` must be called to report it; so they can be used beforehand.
+// @return How many tasks finished before the first one that aborted (`nbTasks` if none did)
+size_t diag_RunTasksUntilAbort(
+    size_t nbTasks, unsigned int nbThreads, std::function<void(size_t)> const &task
+);
+[[noreturn]] void diag_FinishAbort();
+
+#endif // RGBDS_DIAGNOSTICS_HPP
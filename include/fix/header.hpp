@@ -0,0 +1,115 @@
+/* SPDX-License-Identifier: MIT */
+
+#ifndef RGBDS_FIX_HEADER_HPP
+#define RGBDS_FIX_HEADER_HPP
+
+// What rgbfix knows about cartridge headers, which rgblink also uses to fix them as it links
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define UNSPECIFIED 0x200 // Should not be in byte range
+
+// Prints an error (whose message includes its "error: " prefix and newline), and counts it.
+// Each program using this module defines it.
+[[gnu::format(printf, 1, 2)]] void report(char const *fmt, ...);
+
+enum MbcType {
+	ROM = 0x00,
+	ROM_RAM = 0x08,
+	ROM_RAM_BATTERY = 0x09,
+
+	MBC1 = 0x01,
+	MBC1_RAM = 0x02,
+	MBC1_RAM_BATTERY = 0x03,
+
+	MBC2 = 0x05,
+	MBC2_BATTERY = 0x06,
+
+	MMM01 = 0x0B,
+	MMM01_RAM = 0x0C,
+	MMM01_RAM_BATTERY = 0x0D,
+
+	MBC3 = 0x11,
+	MBC3_TIMER_BATTERY = 0x0F,
+	MBC3_TIMER_RAM_BATTERY = 0x10,
+	MBC3_RAM = 0x12,
+	MBC3_RAM_BATTERY = 0x13,
+
+	MBC5 = 0x19,
+	MBC5_RAM = 0x1A,
+	MBC5_RAM_BATTERY = 0x1B,
+	MBC5_RUMBLE = 0x1C,
+	MBC5_RUMBLE_RAM = 0x1D,
+	MBC5_RUMBLE_RAM_BATTERY = 0x1E,
+
+	MBC6 = 0x20,
+
+	MBC7_SENSOR_RUMBLE_RAM_BATTERY = 0x22,
+
+	POCKET_CAMERA = 0xFC,
+
+	BANDAI_TAMA5 = 0xFD,
+
+	HUC3 = 0xFE,
+
+	HUC1_RAM_BATTERY = 0xFF,
+
+	// "Extended" values (still valid, but not directly actionable)
+
+	// A high byte of 0x01 means TPP1, the low byte is the requested features
+	// This does not include SRAM, which is instead implied by a non-zero SRAM size
+	// Note: Multiple rumble speeds imply rumble
+	TPP1 = 0x100,
+	TPP1_RUMBLE = 0x101,
+	TPP1_MULTIRUMBLE = 0x102, // Should not be possible
+	TPP1_MULTIRUMBLE_RUMBLE = 0x103,
+	TPP1_TIMER = 0x104,
+	TPP1_TIMER_RUMBLE = 0x105,
+	TPP1_TIMER_MULTIRUMBLE = 0x106, // Should not be possible
+	TPP1_TIMER_MULTIRUMBLE_RUMBLE = 0x107,
+	TPP1_BATTERY = 0x108,
+	TPP1_BATTERY_RUMBLE = 0x109,
+	TPP1_BATTERY_MULTIRUMBLE = 0x10A, // Should not be possible
+	TPP1_BATTERY_MULTIRUMBLE_RUMBLE = 0x10B,
+	TPP1_BATTERY_TIMER = 0x10C,
+	TPP1_BATTERY_TIMER_RUMBLE = 0x10D,
+	TPP1_BATTERY_TIMER_MULTIRUMBLE = 0x10E, // Should not be possible
+	TPP1_BATTERY_TIMER_MULTIRUMBLE_RUMBLE = 0x10F,
+
+	// Error values
+	MBC_NONE = UNSPECIFIED, // No MBC specified, do not act on it
+	MBC_BAD,                // Specified MBC does not exist / syntax error
+	MBC_WRONG_FEATURES,     // MBC incompatible with specified features
+	MBC_BAD_RANGE,          // MBC number out of range
+};
+
+// The TPP1 revision requested by the last MBC name that `parseMBC` accepted
+extern uint8_t tpp1Rev[2];
+
+extern uint8_t const nintendoLogo[48];
+
+/*
+ * Parses an MBC type given on the command line, reporting it if it is invalid
+ * @param arg The MBC's name or number, or "help" to list the accepted names and exit
+ * @return The MBC type, or one of the error values
+ */
+MbcType parseMBCOption(char const *arg);
+
+/*
+ * Warns if a RAM size byte does not make sense for an MBC
+ * @param cartridgeType The MBC type, possibly `MBC_NONE`
+ * @param ramSize The RAM size byte, possibly `UNSPECIFIED`
+ */
+void checkRAMSize(MbcType cartridgeType, uint16_t ramSize);
+
+/*
+ * Adds up bytes, eight at a time: each 16-bit lane of a word accumulates every other byte, and
+ * the lanes are folded together before they can overflow
+ * @param data The bytes to add up
+ * @param len How many bytes to add up
+ * @return The sum of the bytes, modulo 65536 (like the global checksum)
+ */
+uint16_t sumBytes(uint8_t const *data, size_t len);
+
+#endif // RGBDS_FIX_HEADER_HPP
@@ -0,0 +1,23 @@
+/* SPDX-License-Identifier: MIT */
+
+// The output cache remembers what converting an image produced, keyed on the image's contents and
+// on the options that affect the conversion, so that converting it again with the same options
+// only has to copy the outputs instead of decoding the image and packing its palettes.
+
+#ifndef RGBDS_GFX_CACHE_HPP
+#define RGBDS_GFX_CACHE_HPP
+
+/*
+ * Returns whether the current conversion can use the cache at all
+ */
+bool canUseCache();
+/*
+ * If the current conversion's outputs are cached, writes them and returns true
+ */
+bool replayCachedOutputs();
+/*
+ * Stores the outputs that the current conversion just wrote
+ */
+void cacheOutputs();
+
+#endif // RGBDS_GFX_CACHE_HPP
@@ -24,13 +24,15 @@ struct Options {
 
 	std::string attrmap{};                    // -a, -A
 	std::array<uint8_t, 2> baseTileIDs{0, 0}; // -b
+	std::string cacheDir{};                   // --cache-dir
 	enum {
 		NO_SPEC,
 		EXPLICIT,
 		EMBEDDED,
 	} palSpecType = NO_SPEC; // -c
 	std::vector<std::array<std::optional<Rgba>, 4>> palSpec{};
-	uint8_t bitDepth = 2; // -d
+	uint8_t bitDepth = 2;    // -d
+	unsigned int nbJobs = 1; // -j
 	struct {
 		uint16_t left;
 		uint16_t top;
@@ -39,9 +41,11 @@ struct Options {
 	} inputSlice{0, 0, 0, 0};                          // -L (margins in clockwise order, like CSS)
 	std::array<uint16_t, 2> maxNbTiles{UINT16_MAX, 0}; // -N
 	uint8_t nbPalettes = 8;                            // -n
+	uint32_t packTime = 0;                             // --pack-time, in ms; 0 means unlimited
 	std::string output{};                              // -o
 	std::string palettes{};                            // -p, -P
 	std::string palmap{};                              // -q, -Q
+	std::string seedPalmap{};                          // --seed-palette-map
 	uint8_t nbColorsPerPal = 0;                        // -s; 0 means "auto" = 1 << bitDepth;
 	std::string tilemap{};                             // -t, -T
 	uint64_t trim = 0;                                 // -x
@@ -19,6 +19,14 @@ namespace packing {
 std::tuple<DefaultInitVec<size_t>, size_t>
     overloadAndRemove(std::vector<ProtoPalette> const &protoPalettes);
 
+/*
+ * Same, but starting from the palette that `seed` maps each proto-palette to (unless `SIZE_MAX`),
+ * e.g. in a previous conversion; only the palettes that no longer fit are repaired
+ */
+std::tuple<DefaultInitVec<size_t>, size_t> repairSeeded(
+    std::vector<ProtoPalette> const &protoPalettes, std::vector<size_t> const &seed
+);
+
 } // namespace packing
 
 #endif // RGBDS_GFX_PAL_PACKING_HPP
@@ -3,8 +3,6 @@
 #ifndef RGBDS_GFX_PAL_SORTING_HPP
 #define RGBDS_GFX_PAL_SORTING_HPP
 
-#include <array>
-#include <optional>
 #include <png.h>
 #include <vector>
 
@@ -21,9 +19,7 @@ void indexed(
     int palAlphaSize,
     png_byte *palAlpha
 );
-void grayscale(
-    std::vector<Palette> &palettes, std::array<std::optional<Rgba>, 0x8001> const &colors
-);
+void grayscale(std::vector<Palette> &palettes, std::vector<Rgba> const &colors);
 void rgb(std::vector<Palette> &palettes);
 
 } // namespace sorting
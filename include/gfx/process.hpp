@@ -5,5 +5,11 @@
 
 void processPalettes();
 void process();
+/*
+ * Processes one of several images whose tiles are deduplicated together (`--shared-tiles`): their
+ * maps and palettes are output right away, but their tile data only by `outputSharedTiles`
+ */
+void processSharedImage();
+void outputSharedTiles();
 
 #endif // RGBDS_GFX_PROCESS_HPP
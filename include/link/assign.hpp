@@ -3,11 +3,18 @@
 #ifndef RGBDS_LINK_ASSIGN_HPP
 #define RGBDS_LINK_ASSIGN_HPP
 
+#include <atomic>
 #include <stdint.h>
 
-extern uint64_t nbSectionsToAssign;
+#include "linkdefs.hpp"
+#include "platform.hpp" // ssize_t
+
+extern std::atomic_uint64_t nbSectionsToAssign;
 
 // Assigns all sections a slice of the address space
 void assign_AssignSections();
 
+// Returns how many separate free spaces are left in a bank, or -1 if nothing was assigned to it
+ssize_t assign_GetNbFreeSpaces(SectionType type, uint32_t bank);
+
 #endif // RGBDS_LINK_ASSIGN_HPP
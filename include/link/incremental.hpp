@@ -0,0 +1,56 @@
+/* SPDX-License-Identifier: MIT */
+
+// Incremental linking remembers where each section was placed, so that the next link can put
+// them back at the same locations instead of searching for room again.
+// The placements can also be kept as text "hints", which are meant to be read and versioned.
+
+#ifndef RGBDS_LINK_INCREMENTAL_HPP
+#define RGBDS_LINK_INCREMENTAL_HPP
+
+#include <stdint.h>
+#include <string>
+
+#include "linkdefs.hpp"
+
+struct Section;
+
+struct Placement {
+	SectionType type;
+	uint32_t bank;
+	uint16_t org;
+};
+
+/*
+ * Reads the placements saved by a previous link.
+ * A missing or unusable state file is not an error, it only makes linking slower.
+ * @param fileName The path to the state file
+ */
+void incr_ReadState(char const *fileName);
+
+/*
+ * Finds where a section was placed during the previous link.
+ * @param name The name of the section
+ * @return A pointer to its previous placement, or `nullptr` if there was none
+ */
+Placement const *incr_GetPlacement(std::string const &name);
+
+/*
+ * Saves the placement of every section, for the next link to reuse.
+ * @param fileName The path to the state file
+ */
+void incr_WriteState(char const *fileName);
+
+/*
+ * Reads placement hints, overriding the placements read from the state file.
+ * Like the state file, a missing file is not an error, and nor are malformed hints.
+ * @param fileName The path to the hints file
+ */
+void incr_ReadHints(char const *fileName);
+
+/*
+ * Saves the placement of every section that was not fixed, as hints for the next link.
+ * @param fileName The path to the hints file
+ */
+void incr_WriteHints(char const *fileName);
+
+#endif // RGBDS_LINK_INCREMENTAL_HPP
@@ -9,10 +9,13 @@
 #include <variant>
 #include <vector>
 
+#include "diagnostics.hpp"
 #include "linkdefs.hpp"
 
 // Variables related to CLI options
 extern bool isDmgMode;
+extern char const *incrementalFileName;
+extern unsigned int nbJobs;
 extern char const *linkerScriptName;
 extern char const *mapFileName;
 extern bool noSymInMap;
@@ -28,12 +31,24 @@ extern bool is32kMode;
 extern bool beVerbose;
 extern bool isWRAM0Mode;
 extern bool disablePadding;
+extern char const *statsFileName;
+extern uint32_t packTime;
+extern bool gcSections;
+extern bool foldSections;
+extern bool lowMemory;
+extern char const *hintsFileName;
+extern char const *headerTitle;
+extern uint8_t headerTitleLen;
+extern uint16_t headerMBC;
+extern uint16_t headerRAMSize;
+extern bool fixHeaderSums;
+extern uint16_t headerPadValue;
 
 // Helper macro for printing verbose-mode messages
 #define verbosePrint(...) \
 	do { \
 		if (beVerbose) \
-			fprintf(stderr, __VA_ARGS__); \
+			diag_Printf(__VA_ARGS__); \
 	} while (0)
 
 struct FileStackNode {
@@ -49,7 +64,7 @@ struct FileStackNode {
 	// Line at which the parent context was exited; meaningless for the root level
 	uint32_t lineNo;
 
-	// REPT iteration counts since last named node, in reverse depth order
+	// REPT iteration counts since the parent node, by increasing depth
 	std::vector<uint32_t> &iters();
 	std::vector<uint32_t> const &iters() const;
 	// File name for files, file::macro name for macros
@@ -3,17 +3,28 @@
 #ifndef RGBDS_LINK_OBJECT_HPP
 #define RGBDS_LINK_OBJECT_HPP
 
+#include <span>
+#include <stdint.h>
+
+/*
+ * Read object (.o) files, and add their info to the data structures.
+ * The files are read concurrently if `nbJobs` allows, but added in the order they were given.
+ * @param fileNames Paths to the object files to be read
+ * @param nbFiles The number of object files
+ */
+void obj_ReadFiles(char const * const *fileNames, unsigned int nbFiles);
+
 /*
- * Read an object (.o) file, and add its info to the data structures.
- * @param fileName A path to the object file to be read
- * @param i The ID of the file
+ * Links up the files read so far with each other, once there are no more to read.
+ * (Several groups of files can be read first, e.g. for each variant to add its own.)
  */
-void obj_ReadFile(char const *fileName, unsigned int i);
+void obj_FinishReading();
 
 /*
- * Sets up object file reading
- * @param nbFiles The number of object files that will be read
+ * Decodes a section's data runs, as left in its object file by `--low-memory`.
+ * @param runs The section's `encodedData`
+ * @param dest Where to write the section's data; must be large enough for all of it
  */
-void obj_Setup(unsigned int nbFiles);
+void obj_DecodeData(std::span<uint8_t const> runs, uint8_t *dest);
 
 #endif // RGBDS_LINK_OBJECT_HPP
@@ -11,6 +11,12 @@
  */
 void out_AddSection(Section const &section);
 
+/*
+ * Unregisters a section, which must have been registered for output at its current location.
+ * @param section The section to remove
+ */
+void out_RemoveSection(Section const &section);
+
 /*
  * Finds an assigned section overlapping another one.
  * @param section The section that is being overlapped
@@ -3,6 +3,15 @@
 #ifndef RGBDS_LINK_PATCH_HPP
 #define RGBDS_LINK_PATCH_HPP
 
+#include <stdint.h>
+
+struct Section;
+
+/*
+ * Looks up the sections that patches and assertions refer to by name, once they are all known
+ */
+void patch_ResolveSectionRefs();
+
 /*
  * Checks all assertions
  * @return true if assertion failed
@@ -14,4 +23,11 @@ void patch_CheckAssertions();
  */
 void patch_ApplyPatches();
 
+/*
+ * Applies a SECTION's patches to a copy of its data, which `patch_ApplyPatches` left unpatched
+ * @param section The section to patch
+ * @param data Where the section's data is, e.g. in the bank being written out
+ */
+void patch_ApplySectionPatches(Section const &section, uint8_t *data);
+
 #endif // RGBDS_LINK_PATCH_HPP
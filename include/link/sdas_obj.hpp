@@ -3,12 +3,44 @@
 #ifndef RGBDS_LINK_SDAS_OBJ_HPP
 #define RGBDS_LINK_SDAS_OBJ_HPP
 
-#include <stdio.h>
+#include <deque>
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <utility>
 #include <vector>
 
 struct FileStackNode;
+struct Section;
 struct Symbol;
 
-void sdobj_ReadFile(FileStackNode const &where, FILE *file, std::vector<Symbol> &fileSymbols);
+// A reference to an area's start, which must be offset by the size of its previous fragments
+struct SdasAreaRef {
+	std::vector<uint8_t> *expression;
+	size_t baseValueOfs; // Where the little-endian constant added to the area's start is
+	std::string areaName;
+};
+
+// What is read from an SDCC object, before it is merged with the other files
+struct SdasObject {
+	std::vector<std::unique_ptr<Section>> sections;
+	std::deque<std::vector<uint8_t>> expressions; // Kept in a deque, since patches point to them
+	std::vector<SdasAreaRef> areaRefs;
+	std::vector<std::pair<uint32_t, std::string>> warnings; // Line numbers and messages
+};
+
+// Parses an object's contents; this does not touch any global state, so that it can be concurrent
+void sdobj_ReadFile(
+    FileStackNode const &where,
+    char const *contents,
+    size_t size,
+    std::vector<Symbol> &fileSymbols,
+    SdasObject &object
+);
+// Reports the object's warnings, and adds its sections and symbols to the link
+void sdobj_MergeFile(
+    FileStackNode const &where, std::vector<Symbol> &fileSymbols, SdasObject &object
+);
 
 #endif // RGBDS_LINK_SDAS_OBJ_HPP
@@ -7,6 +7,7 @@
 
 #include <deque>
 #include <memory>
+#include <span>
 #include <stdint.h>
 #include <string>
 #include <vector>
@@ -27,7 +28,10 @@ struct Patch {
 	uint32_t pcSectionID;
 	uint32_t pcOffset;
 	PatchType type;
-	std::vector<uint8_t> rpnExpression;
+	bool isJumpTarget; // Whether it is the address that a `jp` or `call` goes to
+	uint32_t firstSectionRef; // Where the sections that the expression names are resolved
+	// Points into the object file's contents, or into storage owned by the SDCC object reader
+	std::span<uint8_t const> rpnExpression;
 };
 
 struct Section {
@@ -47,11 +51,17 @@ struct Section {
 	uint16_t alignMask;
 	uint16_t alignOfs;
 	std::vector<uint8_t> data; // Array of size `size`, or 0 if `type` does not have data
+	// With `--low-memory`, `data` is left empty, and this points to the (unpatched) data runs
+	// in the object file instead; each component of a fragment keeps its own.
+	// Without it, fragments' components also only point to their runs until they are merged
+	// into the section's `data`
+	std::span<uint8_t const> encodedData;
 	std::vector<Patch> patches;
 	// Extra info computed during linking
 	std::vector<Symbol> *fileSymbols;
 	std::vector<Symbol *> symbols;
 	std::unique_ptr<Section> nextu; // The next "component" of this unionized sect
+	bool isPlacedByScript;
 };
 
 struct Assertion {
@@ -76,6 +86,11 @@ void sect_ForEach(void (*callback)(Section &));
  */
 void sect_AddSection(std::unique_ptr<Section> &&section);
 
+/*
+ * Lays out the data of fragments, once all of their sections have been registered.
+ */
+void sect_MergeFragments();
+
 /*
  * Finds a section by its name.
  * @param name The name of the section to look for
@@ -88,4 +103,16 @@ Section *sect_GetSection(std::string const &name);
  */
 void sect_DoSanityChecks();
 
+/*
+ * Removes the sections that no assertion, section at a fixed address, or section placed by the
+ * linker script refers to, even indirectly (`--gc-sections`)
+ */
+void sect_RemoveUnreferenced();
+
+/*
+ * Folds sections identical to one before them into it, unless an expression may compare their
+ * addresses; their symbols then label the section that is kept (`--fold-sections`)
+ */
+void sect_FoldIdentical();
+
 #endif // RGBDS_LINK_SECTION_HPP
@@ -0,0 +1,18 @@
+/* SPDX-License-Identifier: MIT */
+
+// The statistics report gives the time taken by each phase of linking, counts of what was
+// linked, and the peak memory usage, in a JSON format meant for tracking them across builds.
+
+#ifndef RGBDS_LINK_STATS_HPP
+#define RGBDS_LINK_STATS_HPP
+
+#include <stdint.h>
+
+// Ends the current phase, if any, and starts timing the next one; phases are also traced
+void stats_StartPhase(char const *name);
+// Adds to a counter, which starts at zero; counters are reported in order of first use
+void stats_Count(char const *name, uint64_t amount);
+// Writes the report to `statsFileName`, if any; this ends the current phase
+void stats_Write();
+
+#endif // RGBDS_LINK_STATS_HPP
@@ -33,6 +33,8 @@ struct Symbol {
 	    Label    // Label values refer to an offset within a specific section
 	    >
 	    data;
+	// Extra info computed during linking
+	Symbol const *definition = nullptr; // For imports, the exported symbol that they refer to
 
 	Label &label();
 	Label const &label() const;
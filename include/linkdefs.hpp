@@ -9,7 +9,11 @@
 #include "helpers.hpp" // assume
 
 #define RGBDS_OBJECT_VERSION_STRING "RGB9"
-#define RGBDS_OBJECT_REV            10U
+#define RGBDS_OBJECT_REV            13U
+
+// A section data run's header is its length shifted left by one, with this bit set if the run
+// repeats a single byte
+#define DATA_RUN_FILL 1U
 
 enum AssertionType { ASSERT_WARN, ASSERT_ERROR, ASSERT_FATAL };
 
@@ -36,6 +36,12 @@
 	#include <unistd.h> // IWYU pragma: export
 #endif
 
+// MSVC prefixes the name of `getpid` with an underscore
+#ifdef _MSC_VER
+	#include <process.h> // IWYU pragma: export
+	#define getpid _getpid
+#endif
+
 // MSVC uses a different name for O_RDWR, and needs an additional _O_BINARY flag
 #ifdef _MSC_VER
 	#include <fcntl.h> // IWYU pragma: export
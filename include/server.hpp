@@ -0,0 +1,28 @@
+/* SPDX-License-Identifier: MIT */
+
+// A server runs requests on behalf of other processes connecting to it, so that build systems and
+// editors running many of them do not pay for starting a new process each time. Each request runs
+// in a fork of the server, so it only shares what the server set up before serving; whatever it
+// looks up or loads by itself is gone once it is done.
+//
+// Programs other than the `--connect` client can send requests too. The protocol, over a Unix
+// domain socket, is: a little-endian 32-bit length, sent in the same `sendmsg` as the standard
+// input, output and error to use (as `SCM_RIGHTS`), then that many bytes: the working directory,
+// then each argument, all terminated by a NUL byte. Once the request has been handled, the server
+// replies with a single byte, its exit status, and closes the connection.
+
+#ifndef RGBDS_SERVER_HPP
+#define RGBDS_SERVER_HPP
+
+#include <string>
+
+// Each request is handled by a forked copy of the server, which passes it the request's arguments,
+// after `programName` as `argv[0]`
+[[noreturn]] void server_Serve(
+    std::string const &socketPath, char const *programName, int (*handler)(int, char *[])
+);
+// Sends the arguments to the server, which uses this process' standard streams and working
+// directory; exits with the request's exit status
+[[noreturn]] void server_Connect(char const *socketPath, int argc, char *argv[]);
+
+#endif // RGBDS_SERVER_HPP
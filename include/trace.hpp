@@ -0,0 +1,35 @@
+/* SPDX-License-Identifier: MIT */
+
+// Traces record how long each phase of a program takes, as "complete" events in the Chrome trace
+// event format, which Perfetto and `chrome://tracing` can display. Timestamps are microseconds
+// since the Unix epoch, so that the traces of separate invocations can be merged into a timeline.
+
+#ifndef RGBDS_TRACE_HPP
+#define RGBDS_TRACE_HPP
+
+#include <string>
+
+// Starts tracing to `path`, or if it is null, to the path in the `RGBDS_TRACE` environment
+// variable, if any; `%p` in the path is replaced by the process ID, e.g. to trace each job of a
+// batch separately. The trace is written when the program exits.
+void trace_Start(char const *programName, char const *path);
+// Writes the trace now, ending the phases still open on this thread, e.g. before exiting without
+// running `atexit` handlers
+void trace_Write();
+
+// Phases nest, and must end in the opposite order that they began in, on the thread that began them
+void trace_Begin(std::string const &name, std::string const &detail = {});
+void trace_End();
+
+// Traces a phase lasting for this object's lifetime
+class TracePhase {
+public:
+	TracePhase(std::string const &name, std::string const &detail = {}) {
+		trace_Begin(name, detail);
+	}
+	~TracePhase() { trace_End(); }
+
+	TracePhase(TracePhase const &) = delete;
+};
+
+#endif // RGBDS_TRACE_HPP
@@ -3,6 +3,7 @@
 #ifndef RGBDS_UTIL_HPP
 #define RGBDS_UTIL_HPP
 
+#include <optional>
 #include <stddef.h>
 #include <stdint.h>
 #include <vector>
@@ -13,5 +14,12 @@ char const *printChar(int c);
  * @return The number of bytes read, or 0 if invalid data was found
  */
 size_t readUTF8Char(std::vector<uint8_t> *dest, char const *src);
+// The number of ASCII characters, other than NUL, that the first `len` bytes of `str` start with
+size_t countASCIIPrefix(char const *str, size_t len);
+
+// 64-bit FNV-1a hash, used to fingerprint file contents (this is not a cryptographic hash!)
+uint64_t hashFNV1a(void const *data, size_t size, uint64_t hash = 0xCBF29CE484222325);
+// The `hashFNV1a` of a file's contents, or nothing if it cannot be read
+std::optional<uint64_t> hashFileFNV1a(char const *path);
 
 #endif // RGBDS_UTIL_HPP
@@ -2,6 +2,8 @@
 
 #include "asm/charmap.hpp"
 
+#include <array>
+#include <memory>
 #include <stack>
 #include <stdio.h>
 #include <stdlib.h>
@@ -10,21 +12,104 @@
 
 #include "util.hpp"
 
+#include "asm/inccache.hpp"
 #include "asm/warning.hpp"
 
 // Charmaps are stored using a structure known as "trie".
 // Essentially a tree, where each nodes stores a single character's worth of info:
 // whether there exists a mapping that ends at the current character,
+// and which characters can follow it.
+// Most nodes only have a few children, so they are kept in a sorted linked list of siblings;
+// only the nodes with many children (such as the root) also get a 256-entry table of them.
 struct CharmapNode {
 	bool isTerminal; // Whether there exists a mapping that ends here
 	uint8_t value;   // If the above is true, its corresponding value
-	// This MUST be indexes and not pointers, because pointers get invalidated by reallocation!
-	size_t next[256]; // Indexes of where to go next, 0 = nowhere
+	uint8_t c;       // The character that leads to this node from its parent
+	uint16_t nbChildren;
+	// These MUST be indexes and not pointers, because pointers get invalidated by reallocation!
+	uint32_t firstChild;  // Index of the child with the lowest character, 0 = none
+	uint32_t nextSibling; // Index of the sibling with the next higher character, 0 = none
+	uint32_t tableIdx;    // Index of the table of children plus 1, 0 = none
+};
+
+// Nodes with this many children get a table, since scanning them would get slow
+#define MIN_CHILDREN_FOR_TABLE 8
+// Past this many remembered conversions, a charmap forgets them all, to bound memory usage
+#define MAX_CACHED_CONVERSIONS 4096
+
+struct CharmapConversion {
+	std::vector<uint8_t> output;
+	size_t nbChars; // How many mappings or (unmapped) UTF-8 characters were consumed
+};
+
+struct CharmapTrie {
+	// First node is reserved for the root node, which always has a table
+	std::vector<CharmapNode> nodes{{
+	    .isTerminal = false,
+	    .value = 0,
+	    .c = 0,
+	    .nbChildren = 0,
+	    .firstChild = 0,
+	    .nextSibling = 0,
+	    .tableIdx = 1,
+	}};
+	std::vector<std::array<uint32_t, 256>> tables = std::vector<std::array<uint32_t, 256>>(1);
+
+	uint32_t next(uint32_t nodeIdx, uint8_t c) const {
+		CharmapNode const &node = nodes[nodeIdx];
+
+		if (node.tableIdx)
+			return tables[node.tableIdx - 1][c];
+
+		for (uint32_t idx = node.firstChild; idx; idx = nodes[idx].nextSibling) {
+			if (nodes[idx].c >= c)
+				return nodes[idx].c == c ? idx : 0;
+		}
+		return 0;
+	}
+
+	uint32_t addNext(uint32_t nodeIdx, uint8_t c) {
+		uint32_t newIdx = nodes.size();
+		CharmapNode &node = nodes[nodeIdx];
+
+		if (!node.tableIdx && node.nbChildren + 1 == MIN_CHILDREN_FOR_TABLE) {
+			std::array<uint32_t, 256> &table = tables.emplace_back();
+			table.fill(0);
+			for (uint32_t idx = node.firstChild; idx; idx = nodes[idx].nextSibling)
+				table[nodes[idx].c] = idx;
+			node.tableIdx = tables.size();
+		}
+		if (node.tableIdx)
+			tables[node.tableIdx - 1][c] = newIdx;
+		node.nbChildren++;
+
+		// Keep the siblings sorted, so that the mappings can be listed in order
+		uint32_t *linkPtr = &node.firstChild;
+		while (*linkPtr && nodes[*linkPtr].c < c)
+			linkPtr = &nodes[*linkPtr].nextSibling;
+		uint32_t nextSibling = *linkPtr;
+		*linkPtr = newIdx;
+
+		// This may reallocate `nodes` and invalidate `node` and `linkPtr`, so it goes last
+		nodes.push_back({
+		    .isTerminal = false,
+		    .value = 0,
+		    .c = c,
+		    .nbChildren = 0,
+		    .firstChild = 0,
+		    .nextSibling = nextSibling,
+		    .tableIdx = 0,
+		});
+		return newIdx;
+	}
 };
 
 struct Charmap {
 	std::string name;
-	std::vector<CharmapNode> nodes; // first node is reserved for the root node
+	// Charmaps derived from this one share its trie until either of them is modified
+	std::shared_ptr<CharmapTrie> trie;
+	// Conversions that did not report anything, so they can be looked up instead of redone
+	std::unordered_map<std::string, CharmapConversion> conversions;
 };
 
 static std::unordered_map<std::string, Charmap> charmaps;
@@ -53,12 +138,17 @@ void charmap_New(std::string const &name, std::string const *baseName) {
 	Charmap &charmap = charmaps[name];
 
 	if (base)
-		charmap.nodes = base->nodes; // Copies `base->nodes`
+		charmap.trie = base->trie; // Shares `base->trie`, see `charmap_Add`
 	else
-		charmap.nodes.emplace_back(); // Zero-init the root node
+		charmap.trie = std::make_shared<CharmapTrie>(); // Zero-init the root node
 	charmap.name = name;
 
 	currentCharmap = &charmap;
+
+	if (baseName != nullptr)
+		inccache_RecordDirective(CACHED_NEWCHARMAP_BASE, name, *baseName);
+	else
+		inccache_RecordDirective(CACHED_NEWCHARMAP, name, 0);
 }
 
 void charmap_Set(std::string const &name) {
@@ -68,10 +158,13 @@ void charmap_Set(std::string const &name) {
 		error("Charmap '%s' doesn't exist\n", name.c_str());
 	else
 		currentCharmap = &search->second;
+
+	inccache_RecordDirective(CACHED_SETCHARMAP, name, 0);
 }
 
 void charmap_Push() {
 	charmapStack.push(currentCharmap);
+	inccache_RecordDirective(CACHED_PUSHC, "", 0);
 }
 
 void charmap_Pop() {
@@ -82,77 +175,77 @@ void charmap_Pop() {
 
 	currentCharmap = charmapStack.top();
 	charmapStack.pop();
+	inccache_RecordDirective(CACHED_POPC, "", 0);
 }
 
 void charmap_Add(std::string const &mapping, uint8_t value) {
 	Charmap &charmap = *currentCharmap;
-	size_t nodeIdx = 0;
+
+	// Copy the trie if it is shared with other charmaps, so that they are not modified too
+	if (charmap.trie.use_count() > 1)
+		charmap.trie = std::make_shared<CharmapTrie>(*charmap.trie);
+
+	CharmapTrie &trie = *charmap.trie;
+	uint32_t nodeIdx = 0;
+
+	charmap.conversions.clear(); // They may not be valid anymore
 
 	for (char c : mapping) {
-		size_t &nextIdxRef = charmap.nodes[nodeIdx].next[(uint8_t)c];
-		size_t nextIdx = nextIdxRef;
-
-		if (!nextIdx) {
-			// Switch to and zero-init the new node
-			nextIdxRef = charmap.nodes.size();
-			nextIdx = nextIdxRef;
-			// This may reallocate `charmap.nodes` and invalidate `nextIdxRef`,
-			// which is why we keep the actual value in `nextIdx`
-			charmap.nodes.emplace_back();
-		}
+		uint32_t nextIdx = trie.next(nodeIdx, c);
+
+		if (!nextIdx)
+			nextIdx = trie.addNext(nodeIdx, c); // Switch to and zero-init the new node
 
 		nodeIdx = nextIdx;
 	}
 
-	CharmapNode &node = charmap.nodes[nodeIdx];
+	CharmapNode &node = trie.nodes[nodeIdx];
 
 	if (node.isTerminal)
 		warning(WARNING_CHARMAP_REDEF, "Overriding charmap mapping\n");
 
 	node.isTerminal = true;
 	node.value = value;
+	inccache_RecordDirective(CACHED_CHARMAP, "", mapping, value);
 }
 
 bool charmap_HasChar(std::string const &input) {
-	Charmap const &charmap = *currentCharmap;
-	size_t nodeIdx = 0;
+	inccache_Poison(); // The result depends on the charmaps, which are not snapshotted
+
+	CharmapTrie const &trie = *currentCharmap->trie;
+	uint32_t nodeIdx = 0;
 
 	for (char c : input) {
-		nodeIdx = charmap.nodes[nodeIdx].next[(uint8_t)c];
+		nodeIdx = trie.next(nodeIdx, c);
 
 		if (!nodeIdx)
 			return false;
 	}
 
-	return charmap.nodes[nodeIdx].isTerminal;
+	return trie.nodes[nodeIdx].isTerminal;
 }
 
-std::vector<uint8_t> charmap_Convert(std::string const &input) {
-	std::vector<uint8_t> output;
-	for (std::string_view inputView = input; charmap_ConvertNext(inputView, &output);)
-		;
-	return output;
-}
-
-size_t charmap_ConvertNext(std::string_view &input, std::vector<uint8_t> *output) {
+// Sets `reported` if this reports an error or a warning (regardless of whether it is enabled)
+static size_t convertNext(std::string_view &input, std::vector<uint8_t> *output, bool &reported) {
 	// The goal is to match the longest mapping possible.
 	// For that, advance through the trie with each character read.
 	// If that would lead to a dead end, rewind characters until the last match, and output.
 	// If no match, read a UTF-8 codepoint and output that.
 	Charmap const &charmap = *currentCharmap;
-	size_t matchIdx = 0;
+	CharmapTrie const &trie = *charmap.trie;
+	uint32_t matchIdx = 0;
 	size_t rewindDistance = 0;
 	size_t inputIdx = 0;
 
-	for (size_t nodeIdx = 0; inputIdx < input.length();) {
-		nodeIdx = charmap.nodes[nodeIdx].next[(uint8_t)input[inputIdx]];
+	for (uint32_t nodeIdx = 0; inputIdx < input.length();) {
+		nodeIdx = trie.next(nodeIdx, input[inputIdx]);
 
 		if (!nodeIdx)
 			break;
 
 		inputIdx++; // Consume that char
 
-		if (charmap.nodes[nodeIdx].isTerminal) {
+		if (trie.nodes[nodeIdx].isTerminal) {
 			matchIdx = nodeIdx; // This node matches, register it
 			rewindDistance = 0; // If no longer match is found, rewind here
 		} else {
@@ -167,7 +260,7 @@ size_t charmap_ConvertNext(std::string_view &input, std::vector<uint8_t> *output
 	size_t matchLen = 0;
 	if (matchIdx) { // A match was found, use it
 		if (output)
-			output->push_back(charmap.nodes[matchIdx].value);
+			output->push_back(trie.nodes[matchIdx].value);
 
 		matchLen = 1;
 
@@ -176,18 +269,23 @@ size_t charmap_ConvertNext(std::string_view &input, std::vector<uint8_t> *output
 		// This will write the codepoint's value to `output`, little-endian
 		size_t codepointLen = readUTF8Char(output, input.data() + inputIdx);
 
-		if (codepointLen == 0)
+		if (codepointLen == 0) {
 			error("Input string is not valid UTF-8\n");
+			reported = true;
+		}
 
 		// Warn if this character is not mapped but any others are
-		if (charmap.nodes.size() > 1)
+		if (trie.nodes.size() > 1) {
 			warning(WARNING_UNMAPPED_CHAR_1, "Unmapped character %s\n", printChar(firstChar));
-		else if (charmap.name != DEFAULT_CHARMAP_NAME)
+			reported = true;
+		} else if (charmap.name != DEFAULT_CHARMAP_NAME) {
 			warning(
 			    WARNING_UNMAPPED_CHAR_2,
 			    "Unmapped character %s not in " DEFAULT_CHARMAP_NAME " charmap\n",
 			    printChar(firstChar)
 			);
+			reported = true;
+		}
 
 		inputIdx += codepointLen;
 		matchLen = codepointLen;
@@ -196,3 +294,86 @@ size_t charmap_ConvertNext(std::string_view &input, std::vector<uint8_t> *output
 	input = input.substr(inputIdx);
 	return matchLen;
 }
+
+size_t charmap_ConvertNext(std::string_view &input, std::vector<uint8_t> *output) {
+	inccache_Poison(); // The result depends on the charmaps, which are not snapshotted
+
+	bool reported = false;
+	return convertNext(input, output, reported);
+}
+
+static CharmapConversion const &convert(std::string const &input) {
+	inccache_Poison(); // The result depends on the charmaps, which are not snapshotted
+
+	Charmap &charmap = *currentCharmap;
+	if (auto search = charmap.conversions.find(input); search != charmap.conversions.end())
+		return search->second;
+
+	static CharmapConversion conversion;
+	bool reported = false;
+
+	conversion.output.clear();
+	conversion.nbChars = 0;
+	// The default charmap without any mappings outputs ASCII characters as-is, without warnings
+	bool isPassthrough = charmap.trie->nodes.size() == 1 && charmap.name == DEFAULT_CHARMAP_NAME;
+	for (std::string_view inputView = input;; conversion.nbChars++) {
+		if (isPassthrough) {
+			size_t runLen = countASCIIPrefix(inputView.data(), inputView.length());
+			conversion.output.insert(
+			    conversion.output.end(), inputView.begin(), inputView.begin() + runLen
+			);
+			conversion.nbChars += runLen;
+			inputView.remove_prefix(runLen);
+		}
+		if (!convertNext(inputView, &conversion.output, reported))
+			break;
+	}
+
+	// Diagnostics must be reported again each time, so do not remember those conversions
+	if (reported)
+		return conversion;
+	if (charmap.conversions.size() == MAX_CACHED_CONVERSIONS)
+		charmap.conversions.clear();
+	return charmap.conversions.emplace(input, conversion).first->second;
+}
+
+std::vector<uint8_t> const &charmap_Convert(std::string const &input) {
+	return convert(input).output;
+}
+
+size_t charmap_CharLen(std::string const &input) {
+	return convert(input).nbChars;
+}
+
+std::string const &charmap_GetCurrentName() {
+	return currentCharmap->name;
+}
+
+static void forEachMapping(
+    CharmapTrie const &trie,
+    uint32_t nodeIdx,
+    std::string &mapping,
+    void (*charFunc)(std::string const &, uint8_t)
+) {
+	CharmapNode const &node = trie.nodes[nodeIdx];
+
+	if (node.isTerminal)
+		charFunc(mapping, node.value);
+
+	for (uint32_t nextIdx = node.firstChild; nextIdx; nextIdx = trie.nodes[nextIdx].nextSibling) {
+		mapping.push_back(trie.nodes[nextIdx].c);
+		forEachMapping(trie, nextIdx, mapping, charFunc);
+		mapping.pop_back();
+	}
+}
+
+void charmap_ForEach(
+    void (*mapFunc)(std::string const &), void (*charFunc)(std::string const &, uint8_t)
+) {
+	for (auto const &[name, charmap] : charmaps) {
+		std::string mapping;
+
+		mapFunc(name);
+		forEachMapping(*charmap.trie, 0, mapping, charFunc);
+	}
+}
@@ -2,12 +2,10 @@
 
 #include "asm/format.hpp"
 
-#include <algorithm>
-#include <inttypes.h>
+#include <charconv>
+#include <ctype.h>
+#include <iterator>
 #include <math.h>
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
 
 #include "asm/fixpoint.hpp"
 #include "asm/warning.hpp"
@@ -168,22 +166,10 @@ void FormatSpec::appendNumber(std::string &str, uint32_t value) const {
 	                  : useType == 'o' ? '&'
 	                                   : 0;
 
-	char valueBuf[262]; // Max 5 digits + decimal + 255 fraction digits + terminator
+	char valueBuf[262]; // Max 5 digits + decimal + 255 fraction digits
+	char *valueEnd;
 
-	if (useType == 'b') {
-		// Special case for binary
-		char *ptr = valueBuf;
-
-		do {
-			*ptr++ = (value & 1) + '0';
-			value >>= 1;
-		} while (value);
-
-		// Reverse the digits
-		std::reverse(valueBuf, ptr);
-
-		*ptr = '\0';
-	} else if (useType == 'f') {
+	if (useType == 'f') {
 		// Special case for fixed-point
 
 		// Default fractional width (C++'s is 6 for "%f"; here 5 is enough for Q16.16)
@@ -195,24 +181,25 @@ void FormatSpec::appendNumber(std::string &str, uint32_t value) const {
 		}
 
 		double fval = fabs(value / fix_PrecisionFactor());
-		snprintf(valueBuf, sizeof(valueBuf), "%.*f", (int)useFracWidth, fval);
-	} else if (useType == 'd') {
-		// Decimal numbers may be formatted with a '-' sign by `snprintf`, so `abs` prevents that,
-		// with a special case for `INT32_MIN` since `labs(INT32_MIN)` is UB. The sign will be
-		// printed later from `signChar`.
-		uint32_t uval = value != (uint32_t)INT32_MIN ? labs((int32_t)value) : value;
-		snprintf(valueBuf, sizeof(valueBuf), "%" PRIu32, uval);
+		valueEnd = std::to_chars(
+		    valueBuf, std::end(valueBuf), fval, std::chars_format::fixed, useFracWidth
+		).ptr;
 	} else {
-		char const *spec = useType == 'u'   ? "%" PRIu32
-		                   : useType == 'X' ? "%" PRIX32
-		                   : useType == 'x' ? "%" PRIx32
-		                   : useType == 'o' ? "%" PRIo32
-		                                    : "%" PRIu32;
-
-		snprintf(valueBuf, sizeof(valueBuf), spec, value);
+		// Negative decimal numbers have already been negated, including `INT32_MIN`, which is
+		// its own magnitude as a `uint32_t`; the sign will be printed later from `signChar`
+		int base = useType == 'X' || useType == 'x' ? 16
+		           : useType == 'b'                 ? 2
+		           : useType == 'o'                 ? 8
+		                                            : 10;
+
+		valueEnd = std::to_chars(valueBuf, std::end(valueBuf), value, base).ptr;
+		if (useType == 'X') {
+			for (char *ptr = valueBuf; ptr != valueEnd; ptr++)
+				*ptr = toupper(*ptr);
+		}
 	}
 
-	size_t valueLen = strlen(valueBuf);
+	size_t valueLen = valueEnd - valueBuf;
 	size_t numLen = (signChar != 0) + (prefixChar != 0) + valueLen;
 	size_t totalLen = width > numLen ? width : numLen;
 	size_t padLen = totalLen - numLen;
@@ -223,7 +210,7 @@ void FormatSpec::appendNumber(std::string &str, uint32_t value) const {
 			str += signChar;
 		if (prefixChar)
 			str += prefixChar;
-		str.append(valueBuf);
+		str.append(valueBuf, valueEnd);
 		str.append(padLen, ' ');
 	} else {
 		if (padZero) {
@@ -241,6 +228,6 @@ void FormatSpec::appendNumber(std::string &str, uint32_t value) const {
 			if (prefixChar)
 				str += prefixChar;
 		}
-		str.append(valueBuf);
+		str.append(valueBuf, valueEnd);
 	}
 }
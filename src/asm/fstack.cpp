@@ -3,21 +3,27 @@
 #include "asm/fstack.hpp"
 #include <sys/stat.h>
 
+#include <deque>
 #include <errno.h>
 #include <inttypes.h>
 #include <memory>
-#include <stack>
 #include <stdio.h>
 #include <stdlib.h>
+#include <unordered_map>
 
 #include "error.hpp"
 #include "helpers.hpp"
 #include "linkdefs.hpp"
 #include "platform.hpp" // S_ISDIR (stat macro)
 
+#include "asm/inccache.hpp"
 #include "asm/lexer.hpp"
 #include "asm/macro.hpp"
 #include "asm/main.hpp"
+#include "asm/objcache.hpp"
+#include "asm/pch.hpp"
+#include "asm/profile.hpp"
+#include "asm/stats.hpp"
 #include "asm/symbol.hpp"
 #include "asm/warning.hpp"
 
@@ -38,15 +44,121 @@ struct Context {
 	int32_t forValue = 0;
 	int32_t forStep = 0;
 	std::string forName{};
+	bool recordsInclude = false; // Whether the include cache is recording this context's effects
+	bool isFile = false;         // Whether this is an INCLUDE file or the main file
 };
 
-static std::stack<Context> contextStack;
+// Contexts are entered and exited very often (e.g. once per macro invocation), so the ones exited
+// are kept for the next ones entered at the same depth, along with their allocations.
+// Contexts are kept in a deque, since lexer states are referred to by pointer and must not move.
+class ContextStack {
+	std::deque<Context> contexts;
+	size_t depth = 0;
+
+public:
+	bool empty() const { return depth == 0; }
+	size_t size() const { return depth; }
+	Context &top() { return contexts[depth - 1]; }
+
+	// The context's `fileInfo` and `uniqueIDStr` may be left over from a previous one, to be
+	// reused through `renewNode` and `renewUniqueID`; the other members have their defaults
+	Context &push() {
+		if (depth == contexts.size())
+			contexts.emplace_back();
+		return contexts[depth++];
+	}
+
+	void pop() {
+		Context &context = contexts[--depth];
+
+		context.lexerState.release();
+		// The node and unique ID can only be reused if nothing else refers to them anymore
+		if (context.fileInfo.use_count() == 1)
+			context.fileInfo->parent = nullptr;
+		else
+			context.fileInfo = nullptr;
+		if (context.uniqueIDStr.use_count() != 1)
+			context.uniqueIDStr = nullptr;
+		context.macroArgs = nullptr;
+		context.nbReptIters = 0;
+		context.isForLoop = false;
+		context.forValue = 0;
+		context.forStep = 0;
+		context.forName.clear();
+		context.recordsInclude = false;
+		context.isFile = false;
+	}
+};
+
+static ContextStack contextStack;
 size_t maxRecursionDepth;
 
 // The first include path for `fstk_FindFile` to try is none at all
 static std::vector<std::string> includePaths = {""};
 
 static std::string preIncludeName;
+static std::string precompiledHeaderName;
+
+static uint64_t nbNodes = 0;
+static uint64_t nbMacroInvocations = 0;
+
+FileStackNode::FileStackNode(
+    FileStackNodeType type_, std::variant<std::vector<uint32_t>, std::string> data_
+)
+    : type(type_), data(data_) {
+	nbNodes++;
+}
+
+/*
+ * Makes a node a new one of the given type, whose name or iteration counts are yet to be set.
+ * @param node The node to renew; unless it is empty, it must not be referred to elsewhere, and
+ *             is then reused instead of allocating a new one
+ * @param type The type of the new node
+ * @param parent The parent of the new node
+ * @param lineNo The line at which the parent context was exited
+ * @return The new node
+ */
+static FileStackNode &renewNode(
+    std::shared_ptr<FileStackNode> &node,
+    FileStackNodeType type,
+    std::shared_ptr<FileStackNode> const &parent,
+    uint32_t lineNo
+) {
+	if (!node) {
+		if (type == NODE_REPT)
+			node = std::make_shared<FileStackNode>(type, std::vector<uint32_t>{});
+		else
+			node = std::make_shared<FileStackNode>(type, ""s);
+	} else {
+		assume(node.use_count() == 1);
+		nbNodes++; // This is as good as a new node
+		node->type = type;
+		if (type == NODE_REPT && !std::holds_alternative<std::vector<uint32_t>>(node->data))
+			node->data.emplace<std::vector<uint32_t>>();
+		else if (type != NODE_REPT && !std::holds_alternative<std::string>(node->data))
+			node->data.emplace<std::string>();
+		node->ID = -1;
+	}
+	node->parent = parent;
+	node->lineNo = lineNo;
+	return *node;
+}
+
+// Gives a context a new, not-yet-generated unique ID, reusing its previous one if possible
+static void renewUniqueID(Context &context) {
+	if (context.uniqueIDStr)
+		context.uniqueIDStr->clear();
+	else
+		context.uniqueIDStr = std::make_shared<std::string>();
+}
+
+uint64_t fstk_GetNbNodes() {
+	return nbNodes;
+}
+
+uint64_t fstk_GetNbMacroInvocations() {
+	return nbMacroInvocations;
+}
 
 std::vector<uint32_t> &FileStackNode::iters() {
 	assume(std::holds_alternative<std::vector<uint32_t>>(data));
@@ -107,6 +219,8 @@ std::shared_ptr<FileStackNode> fstk_GetFileStack() {
 std::shared_ptr<std::string> fstk_GetUniqueIDStr() {
 	static uint64_t nextUniqueID = 1;
 
+	inccache_Poison();
+
 	std::shared_ptr<std::string> &str = contextStack.top().uniqueIDStr;
 
 	// If a unique ID is allowed but has not been generated yet, generate one now.
@@ -119,6 +233,7 @@ std::shared_ptr<std::string> fstk_GetUniqueIDStr() {
 MacroArgs *fstk_GetCurrentMacroArgs() {
 	// This returns a raw pointer, *not* a shared pointer, so its returned value
 	// does *not* keep the current macro args alive!
+	inccache_Poison();
 	return contextStack.top().macroArgs.get();
 }
 
@@ -139,7 +254,19 @@ void fstk_SetPreIncludeFile(std::string const &path) {
 		printf("Pre-included filename %s\n", preIncludeName.c_str());
 }
 
+void fstk_SetPrecompiledHeader(std::string const &path) {
+	if (!precompiledHeaderName.empty())
+		warnx("Overriding precompiled header %s", precompiledHeaderName.c_str());
+	precompiledHeaderName = path;
+}
+
+void fstk_PreloadPrecompiledHeader() {
+	if (!precompiledHeaderName.empty())
+		pch_Preload(precompiledHeaderName);
+}
+
 static void printDep(std::string const &path) {
+	objcache_RecordDependency(path);
 	if (dependFile) {
 		fprintf(dependFile, "%s: %s\n", targetFileName.c_str(), path.c_str());
 		if (generatePhonyDeps)
@@ -152,12 +279,29 @@ static bool isValidFilePath(std::string const &path) {
 	return stat(path.c_str(), &statBuf) == 0 && !S_ISDIR(statBuf.st_mode); // Reject directories
 }
 
-std::optional<std::string> fstk_FindFile(std::string const &path) {
+// Where each path was found in the include paths, if it was; they do not change while assembling
+static std::unordered_map<std::string, std::optional<std::string>> foundFiles;
+
+static std::optional<std::string> findFile(std::string const &path) {
 	for (std::string &incPath : includePaths) {
-		if (std::string fullPath = incPath + path; isValidFilePath(fullPath)) {
-			printDep(fullPath);
+		if (std::string fullPath = incPath + path; isValidFilePath(fullPath))
 			return fullPath;
-		}
+	}
+	return std::nullopt;
+}
+
+std::optional<std::string> const &fstk_ResolveFile(std::string const &path) {
+	auto search = foundFiles.find(path);
+	if (search == foundFiles.end())
+		search = foundFiles.emplace(path, findFile(path)).first;
+	return search->second;
+}
+
+std::optional<std::string> fstk_FindFile(std::string const &path) {
+	if (std::optional<std::string> const &fullPath = fstk_ResolveFile(path); fullPath) {
+		objcache_RecordLookup(path, *fullPath);
+		printDep(*fullPath);
+		return fullPath;
 	}
 
 	errno = ENOENT;
@@ -182,6 +326,7 @@ bool yywrap() {
 		// If the node is referenced outside this context, we can't edit it, so duplicate it
 		if (context.fileInfo.use_count() > 1) {
 			context.fileInfo = std::make_shared<FileStackNode>(*context.fileInfo);
+			nbNodes++; // Copies do not go through the counting constructor
 			context.fileInfo->ID = -1; // The copy is not yet registered
 		}
 
@@ -210,6 +355,11 @@ bool yywrap() {
 		return true;
 	}
 
+	if (contextStack.top().recordsInclude)
+		inccache_StopRecording();
+	if (contextStack.top().isFile)
+		stats_ExitFile();
+	prof_Exit();
 	contextStack.pop();
 	contextStack.top().lexerState.setAsCurrentState();
 
@@ -224,24 +374,22 @@ static void checkRecursionDepth() {
 static bool newFileContext(std::string const &filePath, bool updateStateNow) {
 	checkRecursionDepth();
 
-	std::shared_ptr<std::string> uniqueIDStr = nullptr;
-	std::shared_ptr<MacroArgs> macroArgs = nullptr;
-
-	auto fileInfo =
-	    std::make_shared<FileStackNode>(NODE_MACRO, filePath == "-" ? "<stdin>" : filePath);
-	if (!contextStack.empty()) {
-		Context &oldContext = contextStack.top();
-		fileInfo->parent = oldContext.fileInfo;
-		fileInfo->lineNo = lexer_GetLineNo(); // Called before setting the lexer state
-		uniqueIDStr = oldContext.uniqueIDStr; // Make a copy of the ID
-		macroArgs = oldContext.macroArgs;
-	}
+	Context *oldContext = contextStack.empty() ? nullptr : &contextStack.top();
+	Context &context = contextStack.push();
 
-	Context &context = contextStack.emplace(Context{
-	    .fileInfo = fileInfo,
-	    .uniqueIDStr = uniqueIDStr,
-	    .macroArgs = macroArgs,
-	});
+	if (oldContext) {
+		// The line number is gotten before setting the lexer state
+		renewNode(context.fileInfo, NODE_MACRO, oldContext->fileInfo, lexer_GetLineNo());
+		context.uniqueIDStr = oldContext->uniqueIDStr; // Make a copy of the ID
+		context.macroArgs = oldContext->macroArgs;
+	} else {
+		renewNode(context.fileInfo, NODE_MACRO, nullptr, 0);
+		context.uniqueIDStr = nullptr;
+	}
+	context.fileInfo->name() = filePath == "-" ? "<stdin>" : filePath;
+	context.isFile = true;
+	prof_Enter(context.fileInfo->name());
+	stats_EnterFile(context.fileInfo->name());
 
 	return context.lexerState.setFileAsNextState(filePath, updateStateNow);
 }
@@ -249,9 +397,13 @@ static bool newFileContext(std::string const &filePath, bool updateStateNow) {
 static void newMacroContext(Symbol const &macro, std::shared_ptr<MacroArgs> macroArgs) {
 	checkRecursionDepth();
 
+	assume(!contextStack.empty()); // The top level context cannot be a MACRO
 	Context &oldContext = contextStack.top();
+	Context &context = contextStack.push();
 
-	std::string fileInfoName;
+	std::string &fileInfoName =
+	    renewNode(context.fileInfo, NODE_MACRO, oldContext.fileInfo, lexer_GetLineNo()).name();
+	fileInfoName.clear();
 	for (FileStackNode const *node = macro.src.get(); node; node = node->parent.get()) {
 		if (node->type != NODE_REPT) {
 			fileInfoName.append(node->name());
@@ -268,41 +420,34 @@ static void newMacroContext(Symbol const &macro, std::shared_ptr<MacroArgs> macr
 	fileInfoName.append("::");
 	fileInfoName.append(macro.name);
 
-	auto fileInfo = std::make_shared<FileStackNode>(NODE_MACRO, fileInfoName);
-	assume(!contextStack.empty()); // The top level context cannot be a MACRO
-	fileInfo->parent = oldContext.fileInfo;
-	fileInfo->lineNo = lexer_GetLineNo();
-
-	Context &context = contextStack.emplace(Context{
-	    .fileInfo = fileInfo,
-	    .uniqueIDStr = std::make_shared<std::string>(), // Create a new, not-yet-generated ID
-	    .macroArgs = macroArgs,
-	});
+	renewUniqueID(context);
+	context.macroArgs = macroArgs;
+	prof_Enter(fileInfoName);
 
 	context.lexerState.setViewAsNextState("MACRO", macro.getMacro(), macro.fileLine);
 }
 
-static Context &newReptContext(int32_t reptLineNo, ContentSpan const &span, uint32_t count) {
+static Context &newReptContext(
+    char const *keyword, int32_t reptLineNo, ContentSpan const &span, uint32_t count
+) {
 	checkRecursionDepth();
 
+	assume(!contextStack.empty()); // The top level context cannot be a REPT
 	Context &oldContext = contextStack.top();
+	Context &context = contextStack.push();
 
-	std::vector<uint32_t> fileInfoIters{1};
+	std::vector<uint32_t> &fileInfoIters =
+	    renewNode(context.fileInfo, NODE_REPT, oldContext.fileInfo, reptLineNo).iters();
+	fileInfoIters.assign(1, 1);
 	if (oldContext.fileInfo->type == NODE_REPT && !oldContext.fileInfo->iters().empty()) {
 		// Append all parent iter counts
 		fileInfoIters.insert(fileInfoIters.end(), RANGE(oldContext.fileInfo->iters()));
 	}
 
-	auto fileInfo = std::make_shared<FileStackNode>(NODE_REPT, fileInfoIters);
-	assume(!contextStack.empty()); // The top level context cannot be a REPT
-	fileInfo->parent = oldContext.fileInfo;
-	fileInfo->lineNo = reptLineNo;
-
-	Context &context = contextStack.emplace(Context{
-	    .fileInfo = fileInfo,
-	    .uniqueIDStr = std::make_shared<std::string>(), // Create a new, not-yet-generated ID
-	    .macroArgs = oldContext.macroArgs,
-	});
+	renewUniqueID(context);
+	context.macroArgs = oldContext.macroArgs;
+	// Each REPT or FOR block is profiled as a whole, not per iteration
+	prof_Enter(keyword + "("s + std::to_string(reptLineNo) + ")");
 
 	context.lexerState.setViewAsNextState("REPT", span, reptLineNo);
 
@@ -311,7 +456,33 @@ static Context &newReptContext(int32_t reptLineNo, ContentSpan const &span, uint
 	return context;
 }
 
+// Apply the cached effects of an INCLUDE file, in a context of its own for diagnostics
+static void replayCachedInclude(std::string const &filePath, CachedInclude const &cached) {
+	checkRecursionDepth();
+
+	Context &oldContext = contextStack.top();
+	Context &context = contextStack.push();
+
+	renewNode(context.fileInfo, NODE_MACRO, oldContext.fileInfo, lexer_GetLineNo()).name() =
+	    filePath;
+	context.uniqueIDStr = oldContext.uniqueIDStr;
+	context.macroArgs = oldContext.macroArgs;
+	context.lexerState.path = filePath;
+	context.lexerState.clear(0);
+	context.lexerState.setAsCurrentState();
+	prof_Enter(filePath);
+
+	inccache_Replay(cached, context.lexerState.lineNo);
+
+	prof_Exit();
+	contextStack.pop();
+	contextStack.top().lexerState.setAsCurrentState();
+}
+
 void fstk_RunInclude(std::string const &path, bool preInclude) {
+	// The enclosing INCLUDE files cannot be cached, since they are not "header-only"
+	inccache_Poison();
+
 	std::optional<std::string> fullPath = fstk_FindFile(path);
 
 	if (!fullPath) {
@@ -325,11 +496,19 @@ void fstk_RunInclude(std::string const &path, bool preInclude) {
 		return;
 	}
 
+	if (CachedInclude const *cached = inccache_Find(*fullPath); cached) {
+		replayCachedInclude(*fullPath, *cached);
+		return;
+	}
+
 	if (!newFileContext(*fullPath, false))
 		fatalerror("Failed to set up lexer for file include\n");
+	contextStack.top().recordsInclude = inccache_StartRecording(*fullPath);
 }
 
 void fstk_RunMacro(std::string const &macroName, std::shared_ptr<MacroArgs> macroArgs) {
+	inccache_Poison();
+
 	Symbol *macro = sym_FindExactSymbol(macroName);
 
 	if (!macro) {
@@ -341,14 +520,17 @@ void fstk_RunMacro(std::string const &macroName, std::shared_ptr<MacroArgs> macr
 		return;
 	}
 
+	nbMacroInvocations++;
 	newMacroContext(*macro, macroArgs);
 }
 
 void fstk_RunRept(uint32_t count, int32_t reptLineNo, ContentSpan const &span) {
+	inccache_Poison();
+
 	if (count == 0)
 		return;
 
-	newReptContext(reptLineNo, span, count);
+	newReptContext("REPT", reptLineNo, span, count);
 }
 
 void fstk_RunFor(
@@ -359,6 +541,8 @@ void fstk_RunFor(
     int32_t reptLineNo,
     ContentSpan const &span
 ) {
+	inccache_Poison();
+
 	if (Symbol *sym = sym_AddVar(symName, start); sym->type != SYM_VAR)
 		return;
 
@@ -378,7 +562,7 @@ void fstk_RunFor(
 	if (count == 0)
 		return;
 
-	Context &context = newReptContext(reptLineNo, span, count);
+	Context &context = newReptContext("FOR", reptLineNo, span, count);
 	context.isForLoop = true;
 	context.forValue = start;
 	context.forStep = step;
@@ -411,6 +595,11 @@ void fstk_Init(std::string const &mainPath, size_t maxDepth) {
 
 	maxRecursionDepth = maxDepth;
 
+	if (!precompiledHeaderName.empty()) {
+		printDep(precompiledHeaderName);
+		pch_Read(precompiledHeaderName, contextStack.top().fileInfo);
+	}
+
 	if (!preIncludeName.empty())
 		fstk_RunInclude(preIncludeName, true);
 }
@@ -0,0 +1,502 @@
+/* SPDX-License-Identifier: MIT */
+
+#include "asm/inccache.hpp"
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <inttypes.h>
+#include <memory>
+#include <optional>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unordered_map>
+#include <unordered_set>
+#include <variant>
+#include <vector>
+
+#include "error.hpp"
+#include "helpers.hpp"
+#include "platform.hpp" // S_ISDIR (stat macro), getpid
+#include "util.hpp"
+#include "version.hpp"
+
+#include "asm/charmap.hpp"
+#include "asm/fixpoint.hpp"
+#include "asm/main.hpp"
+#include "asm/section.hpp"
+#include "asm/symbol.hpp"
+
+// Each file in the cache holds up to this many variants, which differ by the symbols that the
+// INCLUDE file looked up (e.g. include guards make the first and subsequent inclusions differ)
+#define MAX_CACHED_VARIANTS 8
+
+// What a symbol looked like the first time that an INCLUDE file being recorded looked it up
+struct SymbolSnapshot {
+	std::string name;
+	bool exists;
+	SymbolType type;
+	bool isBuiltin;
+	int32_t value;    // For SYM_EQU and SYM_VAR
+	std::string text; // Contents of SYM_EQUS, or body of SYM_MACRO
+
+	bool operator==(SymbolSnapshot const &other) const {
+		if (exists != other.exists)
+			return false;
+		if (!exists)
+			return true;
+		if (type != other.type || isBuiltin != other.isBuiltin)
+			return false;
+		if (type == SYM_EQU || type == SYM_VAR)
+			return value == other.value;
+		return text == other.text;
+	}
+};
+
+struct CachedDirective {
+	CachedDirectiveType type;
+	uint32_t lineNo;
+	std::string name;
+	std::string text;
+	int32_t value;
+};
+
+struct CachedInclude {
+	// State that affects how the file is lexed, but is not stored in symbols
+	char binDigits[2];
+	char gfxDigits[4];
+	uint8_t fixPrecision;
+	std::optional<std::string> labelScope;
+
+	std::vector<SymbolSnapshot> lookups;
+	std::vector<CachedDirective> directives;
+};
+
+struct Recording {
+	uint64_t hash;
+	bool poisoned;
+	CachedInclude cached;
+	std::unordered_set<std::string> lookedUp; // Names already in `cached.lookups`
+};
+
+static std::string cacheDirectory;
+
+// Hashes of the INCLUDE files' contents; those do not change during assembly
+static std::unordered_map<std::string, uint64_t> contentHashes;
+// Variants of each cached file, loaded on first use and indexed by content hash
+static std::unordered_map<uint64_t, std::vector<CachedInclude>> cachedIncludes;
+// Nested INCLUDEs poison the enclosing recordings, so only the last one may still be unpoisoned
+static std::vector<Recording> recordings;
+
+void inccache_SetDirectory(std::string const &path) {
+	struct stat statBuf;
+	if (stat(path.c_str(), &statBuf) != 0 || !S_ISDIR(statBuf.st_mode))
+		errx("Include cache \"%s\" is not a directory", path.c_str());
+
+	cacheDirectory = path;
+	if (cacheDirectory.back() != '/')
+		cacheDirectory += '/';
+}
+
+static std::optional<uint64_t> getContentHash(std::string const &path) {
+	if (auto search = contentHashes.find(path); search != contentHashes.end())
+		return search->second;
+
+	std::optional<uint64_t> hash = hashFileFNV1a(path.c_str());
+	if (hash)
+		contentHashes[path] = *hash;
+	return hash;
+}
+
+static std::string getCacheFilePath(uint64_t hash) {
+	char name[sizeof("0123456789ABCDEF.rgbinc")];
+	snprintf(name, sizeof(name), "%016" PRIX64 ".rgbinc", hash);
+	return cacheDirectory + name;
+}
+
+// Helpers to read the cache files, which tolerate (and report) truncated data
+
+struct CacheReader {
+	std::vector<uint8_t> data;
+	size_t offset = 0;
+	bool failed = false;
+
+	uint8_t getByte() {
+		if (offset >= data.size()) {
+			failed = true;
+			return 0;
+		}
+		return data[offset++];
+	}
+
+	uint32_t getLong() {
+		uint32_t value = getByte();
+		value |= getByte() << 8;
+		value |= getByte() << 16;
+		value |= (uint32_t)getByte() << 24;
+		return value;
+	}
+
+	uint64_t getQuad() {
+		uint64_t value = getLong();
+		return value | (uint64_t)getLong() << 32;
+	}
+
+	std::string getString() {
+		size_t length = getLong();
+		if (length > data.size() - offset) {
+			failed = true;
+			return "";
+		}
+		std::string str((char const *)&data[offset], length);
+		offset += length;
+		return str;
+	}
+};
+
+static std::vector<CachedInclude> readCacheFile(uint64_t hash) {
+	std::vector<CachedInclude> variants;
+	std::string path = getCacheFilePath(hash);
+
+	FILE *file = fopen(path.c_str(), "rb");
+	if (!file)
+		return variants; // No cache entry yet
+	Defer closeFile{[&] { fclose(file); }};
+
+	CacheReader reader;
+	uint8_t buf[BUFSIZ];
+	for (size_t nbRead; (nbRead = fread(buf, 1, sizeof(buf), file)) != 0;)
+		reader.data.insert(reader.data.end(), buf, buf + nbRead);
+
+	// Cache files from other versions may not record the same state, so ignore them
+	if (reader.getString() != get_package_version_string() || reader.getQuad() != hash)
+		return variants;
+
+	for (uint32_t nbVariants = reader.getLong(); nbVariants-- && !reader.failed;) {
+		CachedInclude &cached = variants.emplace_back();
+
+		cached.binDigits[0] = reader.getByte();
+		cached.binDigits[1] = reader.getByte();
+		for (char &digit : cached.gfxDigits)
+			digit = reader.getByte();
+		cached.fixPrecision = reader.getByte();
+		if (reader.getByte())
+			cached.labelScope = reader.getString();
+
+		for (uint32_t nbLookups = reader.getLong(); nbLookups-- && !reader.failed;) {
+			SymbolSnapshot &snapshot = cached.lookups.emplace_back();
+
+			snapshot.name = reader.getString();
+			snapshot.exists = reader.getByte();
+			snapshot.type = (SymbolType)reader.getByte();
+			snapshot.isBuiltin = reader.getByte();
+			snapshot.value = reader.getLong();
+			snapshot.text = reader.getString();
+		}
+
+		for (uint32_t nbDirectives = reader.getLong(); nbDirectives-- && !reader.failed;) {
+			CachedDirective &directive = cached.directives.emplace_back();
+
+			directive.type = (CachedDirectiveType)reader.getByte();
+			if (directive.type >= NB_CACHED_DIRECTIVES)
+				reader.failed = true;
+			directive.lineNo = reader.getLong();
+			directive.name = reader.getString();
+			directive.text = reader.getString();
+			directive.value = reader.getLong();
+		}
+	}
+
+	if (reader.failed || reader.offset != reader.data.size()) {
+		if (verbose)
+			printf("Ignoring corrupted include cache file \"%s\"\n", path.c_str());
+		variants.clear();
+	}
+	return variants;
+}
+
+static void putbyte(std::string &buf, uint8_t value) {
+	buf += (char)value;
+}
+
+static void putlong(std::string &buf, uint32_t value) {
+	putbyte(buf, value);
+	putbyte(buf, value >> 8);
+	putbyte(buf, value >> 16);
+	putbyte(buf, value >> 24);
+}
+
+static void putquad(std::string &buf, uint64_t value) {
+	putlong(buf, value);
+	putlong(buf, value >> 32);
+}
+
+static void putstring(std::string &buf, std::string const &str) {
+	putlong(buf, str.length());
+	buf += str;
+}
+
+static void writeCacheFile(uint64_t hash, std::vector<CachedInclude> const &variants) {
+	std::string buf;
+
+	putstring(buf, get_package_version_string());
+	putquad(buf, hash);
+	putlong(buf, variants.size());
+	for (CachedInclude const &cached : variants) {
+		putbyte(buf, cached.binDigits[0]);
+		putbyte(buf, cached.binDigits[1]);
+		for (char digit : cached.gfxDigits)
+			putbyte(buf, digit);
+		putbyte(buf, cached.fixPrecision);
+		putbyte(buf, cached.labelScope.has_value());
+		if (cached.labelScope)
+			putstring(buf, *cached.labelScope);
+
+		putlong(buf, cached.lookups.size());
+		for (SymbolSnapshot const &snapshot : cached.lookups) {
+			putstring(buf, snapshot.name);
+			putbyte(buf, snapshot.exists);
+			putbyte(buf, snapshot.type);
+			putbyte(buf, snapshot.isBuiltin);
+			putlong(buf, snapshot.value);
+			putstring(buf, snapshot.text);
+		}
+
+		putlong(buf, cached.directives.size());
+		for (CachedDirective const &directive : cached.directives) {
+			putbyte(buf, directive.type);
+			putlong(buf, directive.lineNo);
+			putstring(buf, directive.name);
+			putstring(buf, directive.text);
+			putlong(buf, directive.value);
+		}
+	}
+
+	// Write to a temporary file first, so that concurrent assemblies never read a partial file
+	std::string path = getCacheFilePath(hash);
+	std::string tmpPath = path + "." + std::to_string(getpid()) + ".tmp";
+
+	FILE *file = fopen(tmpPath.c_str(), "wb");
+	if (!file) {
+		warn("Failed to create include cache file \"%s\"", tmpPath.c_str());
+		return;
+	}
+	bool failed = fwrite(buf.data(), 1, buf.size(), file) != buf.size();
+	failed |= fclose(file) != 0;
+
+	// Windows' `rename` does not replace existing files
+	if (!failed && rename(tmpPath.c_str(), path.c_str()) != 0) {
+		remove(path.c_str());
+		failed = rename(tmpPath.c_str(), path.c_str()) != 0;
+	}
+	if (failed) {
+		warn("Failed to write include cache file \"%s\"", path.c_str());
+		remove(tmpPath.c_str());
+	}
+}
+
+static std::vector<CachedInclude> &getCachedVariants(uint64_t hash) {
+	if (auto search = cachedIncludes.find(hash); search != cachedIncludes.end())
+		return search->second;
+	return cachedIncludes[hash] = readCacheFile(hash);
+}
+
+// Returns whether the symbol could be snapshotted
+static bool snapshotSymbol(SymbolSnapshot &snapshot, Symbol const *sym) {
+	snapshot.exists = sym != nullptr;
+	snapshot.type = SYM_REF;
+	snapshot.isBuiltin = false;
+	snapshot.value = 0;
+	snapshot.text.clear();
+	if (!sym)
+		return true;
+
+	snapshot.type = sym->type;
+	snapshot.isBuiltin = sym->isBuiltin;
+	switch (sym->type) {
+	case SYM_EQU:
+	case SYM_VAR:
+		if (auto *value = std::get_if<int32_t>(&sym->data); value) {
+			snapshot.value = *value;
+			return true;
+		}
+		return false; // Callbacks such as `_NARG` can change at any time
+	case SYM_EQUS:
+		snapshot.text = *sym->getEqus();
+		return true;
+	case SYM_MACRO: {
+		ContentSpan const &span = sym->getMacro();
+		snapshot.text.assign(span.ptr.get(), span.size);
+		return true;
+	}
+	case SYM_REF:
+		return true;
+	case SYM_LABEL:
+		break;
+	}
+	return false; // Labels depend on section state, which is not snapshotted
+}
+
+static bool canUseCache(std::string const &path) {
+	return !cacheDirectory.empty() && path != "-" && !sect_GetSymbolSection();
+}
+
+static bool isReplayable(CachedInclude const &cached) {
+	if (memcmp(cached.binDigits, binDigits, sizeof(binDigits))
+	    || memcmp(cached.gfxDigits, gfxDigits, sizeof(gfxDigits))
+	    || cached.fixPrecision != fixPrecision
+	    || cached.labelScope != sym_GetCurrentSymbolScope())
+		return false;
+
+	SymbolSnapshot current;
+	for (SymbolSnapshot const &snapshot : cached.lookups) {
+		if (!snapshotSymbol(current, sym_FindExactSymbol(snapshot.name)) || !(current == snapshot))
+			return false;
+	}
+	return true;
+}
+
+CachedInclude const *inccache_Find(std::string const &path) {
+	if (!canUseCache(path))
+		return nullptr;
+
+	std::optional<uint64_t> hash = getContentHash(path);
+	if (!hash)
+		return nullptr;
+
+	for (CachedInclude const &cached : getCachedVariants(*hash)) {
+		if (isReplayable(cached)) {
+			if (verbose)
+				printf("Replaying cached definitions from \"%s\"\n", path.c_str());
+			return &cached;
+		}
+	}
+	return nullptr;
+}
+
+void inccache_Replay(CachedInclude const &cached, uint32_t &lineNo) {
+	for (CachedDirective const &directive : cached.directives) {
+		lineNo = directive.lineNo;
+
+		switch (directive.type) {
+		case CACHED_EQU:
+			sym_AddEqu(directive.name, directive.value);
+			break;
+		case CACHED_REDEF_EQU:
+			sym_RedefEqu(directive.name, directive.value);
+			break;
+		case CACHED_VAR:
+			sym_AddVar(directive.name, directive.value);
+			break;
+		case CACHED_EQUS:
+			sym_AddString(directive.name, std::make_shared<std::string>(directive.text));
+			break;
+		case CACHED_REDEF_EQUS:
+			sym_RedefString(directive.name, std::make_shared<std::string>(directive.text));
+			break;
+		case CACHED_MACRO: {
+			// Each replay gets its own copy, just like the captured bodies of each assembly
+			std::shared_ptr<char[]> body(new char[directive.text.size()]);
+			memcpy(body.get(), directive.text.data(), directive.text.size());
+			sym_AddMacro(
+			    directive.name, directive.value, {.ptr = body, .size = directive.text.size()}
+			);
+			break;
+		}
+		case CACHED_NEWCHARMAP:
+			charmap_New(directive.name, nullptr);
+			break;
+		case CACHED_NEWCHARMAP_BASE:
+			charmap_New(directive.name, &directive.text);
+			break;
+		case CACHED_SETCHARMAP:
+			charmap_Set(directive.name);
+			break;
+		case CACHED_PUSHC:
+			charmap_Push();
+			break;
+		case CACHED_POPC:
+			charmap_Pop();
+			break;
+		case CACHED_CHARMAP:
+			charmap_Add(directive.text, (uint8_t)directive.value);
+			break;
+		case CACHED_RSSET:
+			sym_SetRSValue(directive.value);
+			break;
+		case NB_CACHED_DIRECTIVES:
+			unreachable_();
+		}
+	}
+}
+
+bool inccache_StartRecording(std::string const &path) {
+	if (!canUseCache(path))
+		return false;
+
+	std::optional<uint64_t> hash = getContentHash(path);
+	if (!hash)
+		return false;
+
+	Recording &recording = recordings.emplace_back();
+	recording.hash = *hash;
+	recording.poisoned = false;
+	memcpy(recording.cached.binDigits, binDigits, sizeof(binDigits));
+	memcpy(recording.cached.gfxDigits, gfxDigits, sizeof(gfxDigits));
+	recording.cached.fixPrecision = fixPrecision;
+	recording.cached.labelScope = sym_GetCurrentSymbolScope();
+	return true;
+}
+
+void inccache_StopRecording() {
+	assume(!recordings.empty());
+	Recording recording = std::move(recordings.back());
+	recordings.pop_back();
+
+	if (recording.poisoned)
+		return;
+
+	std::vector<CachedInclude> &variants = getCachedVariants(recording.hash);
+	variants.insert(variants.begin(), std::move(recording.cached));
+	if (variants.size() > MAX_CACHED_VARIANTS)
+		variants.resize(MAX_CACHED_VARIANTS);
+	writeCacheFile(recording.hash, variants);
+}
+
+void inccache_Poison() {
+	for (Recording &recording : recordings)
+		recording.poisoned = true;
+}
+
+void inccache_RecordLookup(std::string const &symName, Symbol const *sym) {
+	if (recordings.empty() || recordings.back().poisoned)
+		return;
+
+	Recording &recording = recordings.back();
+	if (!recording.lookedUp.insert(symName).second)
+		return; // Only the state before the INCLUDE file modified the symbol matters
+
+	SymbolSnapshot &snapshot = recording.cached.lookups.emplace_back();
+	snapshot.name = symName;
+	if (!snapshotSymbol(snapshot, sym))
+		recording.poisoned = true;
+}
+
+void inccache_RecordDirective(CachedDirectiveType type, std::string const &name, int32_t value) {
+	inccache_RecordDirective(type, name, "", value);
+}
+
+void inccache_RecordDirective(
+    CachedDirectiveType type, std::string const &name, std::string const &text, int32_t value
+) {
+	if (recordings.empty() || recordings.back().poisoned)
+		return;
+
+	recordings.back().cached.directives.push_back({
+	    .type = type,
+	    .lineNo = lexer_GetLineNo(),
+	    .name = name,
+	    .text = text,
+	    .value = value,
+	});
+}
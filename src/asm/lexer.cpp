@@ -5,6 +5,8 @@
 #include <sys/types.h>
 
 #include <algorithm>
+#include <array>
+#include <chrono>
 #include <ctype.h>
 #include <errno.h>
 #include <fcntl.h>
@@ -14,7 +16,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <string_view>
 #include <unordered_map>
+#include <unordered_set>
 #ifndef _MSC_VER
 	#include <unistd.h>
 #endif
@@ -112,25 +116,12 @@ struct Token {
 	Token(int type_) : type(type_), value(std::monostate{}) {}
 	Token(int type_, uint32_t value_) : type(type_), value(value_) {}
 	Token(int type_, std::string const &value_) : type(type_), value(value_) {}
-	Token(int type_, std::string &&value_) : type(type_), value(value_) {}
+	Token(int type_, std::string &&value_) : type(type_), value(std::move(value_)) {}
 };
 
-struct CaseInsensitive {
-	// FNV-1a hash of an uppercased string
-	size_t operator()(std::string const &str) const {
-		size_t hash = 0x811C9DC5;
-
-		for (char const &c : str)
-			hash = (hash ^ toupper(c)) * 16777619;
-		return hash;
-	}
-
-	// Compare two strings without case-sensitivity (by converting to uppercase)
-	bool operator()(std::string const &str1, std::string const &str2) const {
-		return std::equal(RANGE(str1), RANGE(str2), [](char c1, char c2) {
-			return toupper(c1) == toupper(c2);
-		});
-	}
+struct Keyword {
+	std::string_view name;
+	int type;
 };
 
 // Identifiers that are also keywords are listed here. This ONLY applies to ones
@@ -138,7 +129,7 @@ struct CaseInsensitive {
 // see how this is used.
 // Tokens / keywords not handled here are handled in `yylex_NORMAL`'s switch.
 // This assumes that no two keywords have the same name.
-static std::unordered_map<std::string, int, CaseInsensitive, CaseInsensitive> keywordDict = {
+static constexpr Keyword keywords[] = {
     {"ADC",           T_(Z80_ADC)          },
     {"ADD",           T_(Z80_ADD)          },
     {"AND",           T_(Z80_AND)          },
@@ -328,6 +319,66 @@ static std::unordered_map<std::string, int, CaseInsensitive, CaseInsensitive> ke
     {".",             T_(PERIOD)           },
 };
 
+// Keywords are looked up in a perfect hash table, computed at compile time: the hash function's
+// seed is chosen so that no two keywords land in the same slot.
+
+#define KEYWORD_TABLE_SIZE 0x1000
+static_assert((KEYWORD_TABLE_SIZE & (KEYWORD_TABLE_SIZE - 1)) == 0, "Must be a power of 2");
+static_assert(std::size(keywords) < UINT8_MAX, "Too many keywords for the table's slots");
+
+static constexpr char toUpper(char c) {
+	return c >= 'a' && c <= 'z' ? c - 'a' + 'A' : c;
+}
+
+// FNV-1a hash of an uppercased string, starting from `seed`
+static constexpr uint32_t hashKeyword(std::string_view name, uint32_t seed) {
+	uint32_t hash = seed;
+
+	for (char c : name)
+		hash = (hash ^ (uint8_t)toUpper(c)) * 16777619;
+	return (hash ^ hash >> 16) & (KEYWORD_TABLE_SIZE - 1);
+}
+
+struct KeywordTable {
+	uint32_t seed;
+	size_t maxLength;
+	// Index of each slot's keyword in `keywords`, plus 1; 0 for empty slots
+	std::array<uint8_t, KEYWORD_TABLE_SIZE> slots;
+};
+
+static constexpr KeywordTable makeKeywordTable() {
+	for (KeywordTable table{.seed = 0x811C9DC5, .maxLength = 0, .slots = {}};; table.seed++) {
+		bool collided = false;
+
+		for (size_t i = 0; i < std::size(keywords) && !collided; i++) {
+			uint8_t &slot = table.slots[hashKeyword(keywords[i].name, table.seed)];
+
+			collided = slot != 0;
+			slot = i + 1;
+			table.maxLength = std::max(table.maxLength, keywords[i].name.length());
+		}
+		if (!collided)
+			return table;
+		table.slots = {};
+	}
+}
+
+static constexpr KeywordTable keywordTable = makeKeywordTable();
+
+static Keyword const *findKeyword(std::string_view name) {
+	if (name.length() > keywordTable.maxLength)
+		return nullptr;
+
+	uint8_t slot = keywordTable.slots[hashKeyword(name, keywordTable.seed)];
+	if (slot == 0)
+		return nullptr;
+
+	Keyword const &keyword = keywords[slot - 1];
+	return std::equal(RANGE(name), RANGE(keyword.name), [](char c1, char c2) {
+		return toUpper(c1) == c2;
+	}) ? &keyword : nullptr;
+}
+
 static bool isWhitespace(int c) {
 	return c == ' ' || c == '\t';
 }
@@ -344,6 +395,7 @@ void LexerState::clear(uint32_t lineNo_) {
 
 	capturing = false;
 	captureBuf = nullptr;
+	captureExpansion = nullptr;
 
 	disableMacroArgs = false;
 	disableInterpolation = false;
@@ -355,7 +407,10 @@ void LexerState::clear(uint32_t lineNo_) {
 	lineNo = lineNo_; // Will be incremented at next line start
 }
 
+static uint64_t nbLexedLines = 0;
+
 static void nextLine() {
+	nbLexedLines++;
 	lexerState->lineNo++;
 	lexerState->colNo = 1;
 }
@@ -395,12 +450,20 @@ void LexerState::setAsCurrentState() {
 	lexerState = this;
 }
 
+// Files mapped so far, kept so that files included several times are only mapped once
+static std::unordered_map<std::string, ContentSpan> mappedFiles;
+
 bool LexerState::setFileAsNextState(std::string const &filePath, bool updateStateNow) {
 	if (filePath == "-") {
 		path = "<stdin>";
 		content.emplace<BufferedContent>(STDIN_FILENO);
 		if (verbose)
 			printf("Opening stdin\n");
+	} else if (auto search = mappedFiles.find(filePath); search != mappedFiles.end()) {
+		path = filePath;
+		content.emplace<ViewedContent>(search->second);
+		if (verbose)
+			printf("File \"%s\" is already mmap()ped\n", path.c_str());
 	} else {
 		struct stat statBuf;
 		if (stat(filePath.c_str(), &statBuf) != 0) {
@@ -421,9 +484,12 @@ bool LexerState::setFileAsNextState(std::string const &filePath, bool updateStat
 			// Try using `mmap` for better performance
 			if (char *mappingAddr = mapFile(fd, path, size); mappingAddr != nullptr) {
 				close(fd);
-				content.emplace<ViewedContent>(
-				    std::shared_ptr<char[]>(mappingAddr, FileUnmapDeleter(size)), size
-				);
+				ContentSpan &span = mappedFiles[path];
+				span = {
+				    .ptr = std::shared_ptr<char[]>(mappingAddr, FileUnmapDeleter(size)),
+				    .size = size,
+				};
+				content.emplace<ViewedContent>(span);
 				if (verbose)
 					printf("File \"%s\" is mmap()ped\n", path.c_str());
 				isMmapped = true;
@@ -445,6 +511,7 @@ bool LexerState::setFileAsNextState(std::string const &filePath, bool updateStat
 		}
 	}
 
+	cachesTokens = false;
 	clear(0);
 	if (updateStateNow)
 		lexerState = this;
@@ -456,6 +523,7 @@ bool LexerState::setFileAsNextState(std::string const &filePath, bool updateStat
 void LexerState::setViewAsNextState(char const *name, ContentSpan const &span, uint32_t lineNo_) {
 	path = name; // Used to report read errors in `.peek()`
 	content.emplace<ViewedContent>(span);
+	cachesTokens = true;
 	clear(lineNo_);
 	lexerStateEOL = this;
 }
@@ -467,6 +535,12 @@ void lexer_RestartRept(uint32_t lineNo) {
 	lexerState->clear(lineNo);
 }
 
+void LexerState::release() {
+	assume(this != lexerStateEOL); // See the destructor below
+	content.emplace<std::monostate>();
+	clear(0);
+}
+
 LexerState::~LexerState() {
 	// A big chunk of the lexer state soundness is the file stack ("fstack").
 	// Each context in the fstack has its own *unique* lexer state; thus, we always guarantee
@@ -493,27 +567,35 @@ BufferedContent::~BufferedContent() {
 }
 
 void BufferedContent::advance() {
-	assume(offset < LEXER_BUF_SIZE);
+	assume(offset < buf.size());
 	offset++;
-	if (offset == LEXER_BUF_SIZE)
+	if (offset == buf.size())
 		offset = 0; // Wrap around if necessary
 	assume(size > 0);
 	size--;
 }
 
 void BufferedContent::refill() {
-	size_t target = LEXER_BUF_SIZE - size; // Aim: making the buf full
+	if (size == 0) {
+		// If the last refill filled the whole buffer, more chars are probably ready to be read.
+		// Only growing an empty buffer avoids having to move its contents around.
+		if (wasFilled && buf.size() < LEXER_BUF_MAX_SIZE)
+			buf.resize(buf.size() * 2);
+		offset = 0;
+	}
+
+	size_t target = buf.size() - size; // Aim: making the buf full
 
 	// Compute the index we'll start writing to
-	size_t startIndex = (offset + size) % LEXER_BUF_SIZE;
+	size_t startIndex = (offset + size) % buf.size();
 
 	// If the range to fill passes over the buffer wrapping point, we need two reads
-	if (startIndex + target > LEXER_BUF_SIZE) {
-		size_t nbExpectedChars = LEXER_BUF_SIZE - startIndex;
+	if (startIndex + target > buf.size()) {
+		size_t nbExpectedChars = buf.size() - startIndex;
 		size_t nbReadChars = readMore(startIndex, nbExpectedChars);
 
 		startIndex += nbReadChars;
-		if (startIndex == LEXER_BUF_SIZE)
+		if (startIndex == buf.size())
 			startIndex = 0;
 
 		// If the read was incomplete, don't perform a second read
@@ -523,11 +605,13 @@ void BufferedContent::refill() {
 	}
 	if (target != 0)
 		readMore(startIndex, target);
+
+	wasFilled = size == buf.size();
 }
 
 size_t BufferedContent::readMore(size_t startIndex, size_t nbChars) {
 	// This buffer overflow made me lose WEEKS of my life. Never again.
-	assume(startIndex + nbChars <= LEXER_BUF_SIZE);
+	assume(startIndex + nbChars <= buf.size());
 	ssize_t nbReadChars = read(fd, &buf[startIndex], nbChars);
 
 	if (nbReadChars == -1)
@@ -547,17 +631,84 @@ void lexer_ToggleStringExpansion(bool enable) {
 	lexerState->expandStrings = enable;
 }
 
+// Whether a `\#` would make up all of the macro args being lexed
+static bool atMacroArgsStart = false;
+static std::shared_ptr<MacroArgs> forwardedMacroArgs;
+
+void lexer_StartMacroArgs() {
+	lexerState->mode = LEXER_RAW;
+	atMacroArgsStart = true;
+	forwardedMacroArgs = nullptr;
+}
+
+std::shared_ptr<MacroArgs> lexer_TakeForwardedMacroArgs() {
+	return std::move(forwardedMacroArgs);
+}
+
+// The value of the EQUS being redefined, which a string starting with it can leave out
+static std::shared_ptr<std::string> redefinedEqus;
+static std::shared_ptr<std::string> elidedEqusPrefix;
+
+void lexer_StartEqusValue(std::string const &symName) {
+	Symbol const *sym = sym_FindExactSymbol(symName);
+
+	redefinedEqus = sym && sym->type == SYM_EQUS && !sym->isBuiltin ? sym->getEqus() : nullptr;
+	elidedEqusPrefix = nullptr;
+}
+
+std::shared_ptr<std::string> lexer_TakeElidedEqusPrefix() {
+	return std::move(elidedEqusPrefix);
+}
+
 // Functions for the actual lexer to obtain characters
 
-static void beginExpansion(std::shared_ptr<std::string> str, std::optional<std::string> name) {
-	if (name)
+static uint64_t nbBegunExpansions = 0; // Lets the token cache tell if any expansion took place
+
+uint64_t lexer_GetNbExpansions() {
+	return nbBegunExpansions;
+}
+
+static void beginExpansion(
+    std::shared_ptr<std::string> &&str, ExpansionType type, std::string const *symName = nullptr
+) {
+	if (type != EXPANSION_MACRO_ARG)
 		lexer_CheckRecursionDepth();
 
 	// Do not expand empty strings
 	if (str->empty())
 		return;
 
-	lexerState->expansions.push_front({.name = name, .contents = str, .offset = 0});
+	nbBegunExpansions++;
+	// The expansion stack keeps its capacity, so this rarely allocates
+	Expansion &exp = lexerState->expansions.emplace_back();
+	exp.type = type;
+	if (symName)
+		exp.symName = *symName;
+	exp.contents = std::move(str);
+	exp.offset = 0;
+}
+
+// Buffers of finished interpolations, kept to be reused by the next ones
+static std::vector<std::shared_ptr<std::string>> interpolationBufs;
+
+static std::shared_ptr<std::string> newInterpolationBuf() {
+	if (interpolationBufs.empty())
+		return std::make_shared<std::string>();
+
+	std::shared_ptr<std::string> buf = std::move(interpolationBufs.back());
+	interpolationBufs.pop_back();
+	buf->clear();
+	return buf;
+}
+
+static void endExpansion() {
+	Expansion &exp = lexerState->expansions.back();
+
+	// Recycle the buffer if nothing else refers to it (EQUS bodies are shared with their symbol)
+	if (exp.type == EXPANSION_INTERPOLATION && exp.contents.use_count() == 1
+	    && interpolationBufs.size() < 64)
+		interpolationBufs.push_back(std::move(exp.contents));
+	lexerState->expansions.pop_back();
 }
 
 void lexer_CheckRecursionDepth() {
@@ -643,11 +794,19 @@ static std::shared_ptr<std::string> readMacroArg(char name) {
 		return str;
 	} else if (name == '#') {
 		MacroArgs *macroArgs = fstk_GetCurrentMacroArgs();
-		auto str = macroArgs ? macroArgs->getAllArgs() : nullptr;
-		if (!str) {
+		if (!macroArgs) {
 			error("'\\#' cannot be used outside of a macro\n");
+			return nullptr;
 		}
-		return str;
+		// Forwarding all args to another macro shares them instead of splitting them again
+		if (int c = lexerState->peekChar();
+		    atMacroArgsStart && (c == EOF || c == '\n' || c == '\r' || c == ';')) {
+			if (auto forwarded = macroArgs->forwardAllArgs(); forwarded) {
+				forwardedMacroArgs = std::move(forwarded);
+				return nullptr;
+			}
+		}
+		return macroArgs->getAllArgs();
 	} else if (name == '<') {
 		uint32_t num = readBracketedMacroArgNum();
 		if (num == 0) {
@@ -688,8 +847,8 @@ static std::shared_ptr<std::string> readMacroArg(char name) {
 
 int LexerState::peekChar() {
 	// This is `.peekCharAhead()` modified for zero lookahead distance
-	for (Expansion &exp : expansions) {
-		if (exp.offset < exp.size())
+	for (auto it = expansions.rbegin(); it != expansions.rend(); it++) {
+		if (Expansion &exp = *it; exp.offset < exp.size())
 			return (uint8_t)(*exp.contents)[exp.offset];
 	}
 
@@ -701,7 +860,7 @@ int LexerState::peekChar() {
 		auto &cbuf = std::get<BufferedContent>(content);
 		if (cbuf.size == 0)
 			cbuf.refill();
-		assume(cbuf.offset < LEXER_BUF_SIZE);
+		assume(cbuf.offset < cbuf.buf.size());
 		if (cbuf.size > 0)
 			return (uint8_t)cbuf.buf[cbuf.offset];
 	}
@@ -714,7 +873,8 @@ int LexerState::peekCharAhead() {
 	// We only need one character of lookahead, for macro arguments
 	uint8_t distance = 1;
 
-	for (Expansion &exp : expansions) {
+	for (auto it = expansions.rbegin(); it != expansions.rend(); it++) {
+		Expansion &exp = *it;
 		// An expansion that has reached its end will have `exp.offset` == `exp.size()`,
 		// and `.peekCharAhead()` will continue with its parent
 		assume(exp.offset <= exp.size());
@@ -733,7 +893,7 @@ int LexerState::peekCharAhead() {
 		if (cbuf.size <= distance)
 			cbuf.refill();
 		if (cbuf.size > distance)
-			return (uint8_t)cbuf.buf[(cbuf.offset + distance) % LEXER_BUF_SIZE];
+			return (uint8_t)cbuf.buf[(cbuf.offset + distance) % cbuf.buf.size()];
 	}
 
 	// If there aren't enough chars, give up
@@ -767,13 +927,12 @@ static int peek() {
 				return peek();
 			}
 
-			beginExpansion(str, std::nullopt);
-
 			// Assuming macro args can't be recursive (I'll be damned if a way
 			// is found...), then we mark the entire macro arg as scanned.
 			lexerState->macroArgScanDistance += str->length();
 
 			c = str->front();
+			beginExpansion(std::move(str), EXPANSION_MACRO_ARG);
 		} else {
 			c = '\\';
 		}
@@ -782,7 +941,7 @@ static int peek() {
 		shiftChar();
 
 		if (auto str = readInterpolation(0); str) {
-			beginExpansion(str, *str);
+			beginExpansion(std::move(str), EXPANSION_INTERPOLATION);
 		}
 
 		return peek();
@@ -791,8 +950,23 @@ static int peek() {
 	return c;
 }
 
+// Whether the next char comes from the expansion being captured from in place
+static bool isCapturingInPlace() {
+	if (lexerState->expansions.empty())
+		return false;
+	Expansion const &exp = lexerState->expansions.back();
+	return exp.contents == lexerState->captureExpansion && exp.offset < exp.size();
+}
+
 static void shiftChar() {
 	if (lexerState->capturing) {
+		if (lexerState->captureExpansion && !isCapturingInPlace()) {
+			// The capture continues past the expansion, so it has to be copied after all
+			auto start = lexerState->captureExpansion->begin() + lexerState->captureStart;
+			lexerState->captureBuf =
+			    std::make_shared<std::vector<char>>(start, start + lexerState->captureSize);
+			lexerState->captureExpansion = nullptr;
+		}
 		if (lexerState->captureBuf)
 			lexerState->captureBuf->push_back(peek());
 		lexerState->captureSize++;
@@ -803,10 +977,10 @@ static void shiftChar() {
 restart:
 	if (!lexerState->expansions.empty()) {
 		// Advance within the current expansion
-		if (Expansion &exp = lexerState->expansions.front(); exp.advance()) {
+		if (Expansion &exp = lexerState->expansions.back(); exp.advance()) {
 			// When advancing would go past an expansion's end,
 			// move up to its parent and try again to advance
-			lexerState->expansions.pop_front();
+			endExpansion();
 			goto restart;
 		}
 	} else {
@@ -836,6 +1010,38 @@ static void handleCRLF(int c) {
 		shiftChar();
 }
 
+// Fast path for scanning runs of "plain" chars: outside of any expansion, a viewed file's
+// contents can be scanned directly, instead of going through `peek()` and `shiftChar()`.
+// Callers must stop before any newline, and before any `\` or `{` that `peek()` would expand.
+
+static std::string_view viewedCharsAhead() {
+	if (!lexerState->expansions.empty())
+		return {};
+	auto *view = std::get_if<ViewedContent>(&lexerState->content);
+	if (!view)
+		return {};
+	return std::string_view(&view->span.ptr[view->offset], view->span.size - view->offset);
+}
+
+static void skipViewedChars(size_t n) {
+	auto &view = std::get<ViewedContent>(lexerState->content);
+
+	if (lexerState->capturing) {
+		if (lexerState->captureBuf) {
+			char const *ptr = &view.span.ptr[view.offset];
+			lexerState->captureBuf->insert(lexerState->captureBuf->end(), ptr, ptr + n);
+		}
+		lexerState->captureSize += n;
+	}
+
+	// Plain chars never start an expansion, so there is nothing more to scan for them
+	size_t &scanDistance = lexerState->macroArgScanDistance;
+	scanDistance = scanDistance > n ? scanDistance - n : 0;
+
+	view.offset += n;
+	lexerState->colNo += n;
+}
+
 static auto scopedDisableExpansions() {
 	lexerState->disableMacroArgs = true;
 	lexerState->disableInterpolation = true;
@@ -855,14 +1061,24 @@ uint32_t lexer_GetColNo() {
 	return lexerState->colNo;
 }
 
+static uint64_t nbLexedTokens = 0;
+
+uint64_t lexer_GetNbTokens() {
+	return nbLexedTokens;
+}
+
+uint64_t lexer_GetNbLines() {
+	return nbLexedLines;
+}
+
 void lexer_DumpStringExpansions() {
 	if (!lexerState)
 		return;
 
-	for (Expansion &exp : lexerState->expansions) {
+	for (auto it = lexerState->expansions.rbegin(); it != lexerState->expansions.rend(); it++) {
 		// Only register EQUS expansions, not string args
-		if (exp.name)
-			fprintf(stderr, "while expanding symbol \"%s\"\n", exp.name->c_str());
+		if (std::string const *name = it->name(); name)
+			fprintf(stderr, "while expanding symbol \"%s\"\n", name->c_str());
 	}
 }
 
@@ -871,6 +1087,9 @@ void lexer_DumpStringExpansions() {
 static void discardBlockComment() {
 	Defer reenableExpansions = scopedDisableExpansions();
 	for (;;) {
+		if (std::string_view ahead = viewedCharsAhead(); !ahead.empty())
+			skipViewedChars(std::min(ahead.find_first_of("*/\r\n"), ahead.size()));
+
 		int c = nextChar();
 
 		switch (c) {
@@ -904,6 +1123,15 @@ static void discardBlockComment() {
 
 static void discardComment() {
 	Defer reenableExpansions = scopedDisableExpansions();
+	if (std::string_view ahead = viewedCharsAhead(); !ahead.empty()) {
+		// `memchr` is typically vectorized, which makes this much faster than a char loop
+		size_t len = ahead.size();
+		if (void const *lf = memchr(ahead.data(), '\n', len); lf)
+			len = (char const *)lf - ahead.data();
+		if (void const *cr = memchr(ahead.data(), '\r', len); cr)
+			len = (char const *)cr - ahead.data();
+		skipViewedChars(len);
+	}
 	for (;; shiftChar()) {
 		int c = peek();
 
@@ -1142,6 +1370,17 @@ static Token readIdentifier(char firstChar) {
 	std::string identifier(1, firstChar);
 	int tokenType = firstChar == '.' ? T_(LOCAL_ID) : T_(ID);
 
+	// Most identifiers are read directly from the file contents
+	if (std::string_view ahead = viewedCharsAhead(); !ahead.empty()) {
+		size_t len = std::find_if_not(RANGE(ahead), continuesIdentifier) - ahead.begin();
+		std::string_view chars = ahead.substr(0, len);
+
+		identifier.append(chars);
+		if (chars.find('.') != chars.npos)
+			tokenType = T_(LOCAL_ID);
+		skipViewedChars(len);
+	}
+
 	// Continue reading while the char is in the symbol charset
 	for (int c = peek(); continuesIdentifier(c); c = peek()) {
 		shiftChar();
@@ -1155,8 +1394,8 @@ static Token readIdentifier(char firstChar) {
 	}
 
 	// Attempt to check for a keyword
-	auto search = keywordDict.find(identifier.c_str());
-	return search != keywordDict.end() ? Token(search->second) : Token(tokenType, identifier);
+	Keyword const *keyword = findKeyword(identifier);
+	return keyword ? Token(keyword->type) : Token(tokenType, std::move(identifier));
 }
 
 // Functions to read strings
@@ -1181,7 +1420,7 @@ static std::shared_ptr<std::string> readInterpolation(size_t depth) {
 			shiftChar();
 			auto str = readInterpolation(depth + 1);
 
-			beginExpansion(str, *str);
+			beginExpansion(std::move(str), EXPANSION_INTERPOLATION);
 			continue; // Restart, reading from the new buffer
 		} else if (c == EOF || c == '\r' || c == '\n' || c == '"') {
 			error("Missing }\n");
@@ -1211,11 +1450,14 @@ static std::shared_ptr<std::string> readInterpolation(size_t depth) {
 	if (!sym || !sym->isDefined()) {
 		error("Interpolated symbol \"%s\" does not exist\n", fmtBuf.c_str());
 	} else if (sym->type == SYM_EQUS) {
-		auto buf = std::make_shared<std::string>();
+		// Without a format, the EQUS body is used as-is, since it is never modified
+		if (fmt.isEmpty())
+			return sym->getEqus();
+		auto buf = newInterpolationBuf();
 		fmt.appendString(*buf, *sym->getEqus());
 		return buf;
 	} else if (sym->isNumeric()) {
-		auto buf = std::make_shared<std::string>();
+		auto buf = newInterpolationBuf();
 		fmt.appendNumber(*buf, sym->getConstantValue());
 		return buf;
 	} else {
@@ -1254,6 +1496,8 @@ static void appendEscapedString(std::string &str, std::string const &escape) {
 
 static std::string readString(bool raw) {
 	Defer reenableExpansions = scopedDisableExpansions();
+	// Only the token right after `lexer_StartEqusValue` may leave the EQUS out
+	std::shared_ptr<std::string> prefixCandidate = std::move(redefinedEqus);
 
 	// We reach this function after reading a single quote, but we also support triple quotes
 	bool multiline = false;
@@ -1378,8 +1622,15 @@ static std::string readString(bool raw) {
 			// (Not interpolations, since they're handled by the function itself...)
 			lexerState->disableMacroArgs = false;
 			if (auto interpolation = readInterpolation(0); interpolation) {
-				str.append(*interpolation);
+				// An EQUS being redefined as itself followed by more does not need copying
+				if (str.empty() && interpolation == prefixCandidate) {
+					elidedEqusPrefix = std::move(interpolation);
+					prefixCandidate = nullptr;
+				} else {
+					str.append(*interpolation);
+				}
 			}
+			prefixCandidate = nullptr;
 			lexerState->disableMacroArgs = true;
 			continue; // Do not copy an additional character
 
@@ -1387,6 +1638,7 @@ static std::string readString(bool raw) {
 		}
 
 		str += c;
+		prefixCandidate = nullptr;
 	}
 }
 
@@ -1539,6 +1791,8 @@ static Token yylex_NORMAL() {
 			[[fallthrough]];
 		case ' ':
 		case '\t':
+			if (std::string_view ahead = viewedCharsAhead(); !ahead.empty())
+				skipViewedChars(std::min(ahead.find_first_not_of(" \t"), ahead.size()));
 			break;
 
 			// Handle unambiguous single-char tokens
@@ -1684,8 +1938,7 @@ static Token yylex_NORMAL() {
 				return Token(T_(DOUBLE_COLON));
 			case '+':
 			case '-': {
-				std::string symName = readAnonLabelRef(c);
-				return Token(T_(ANON), symName);
+				return Token(T_(ANON), readAnonLabelRef(c));
 			}
 			default:
 				return Token(T_(COLON));
@@ -1801,7 +2054,7 @@ static Token yylex_NORMAL() {
 						std::shared_ptr<std::string> str = sym->getEqus();
 
 						assume(str);
-						beginExpansion(str, sym->name);
+						beginExpansion(std::move(str), EXPANSION_EQUS, &sym->name);
 						continue; // Restart, reading from the new buffer
 					}
 				}
@@ -1837,14 +2090,17 @@ static Token yylex_RAW() {
 			shiftChar();
 			c = peek();
 			// If not a line continuation, handle as a normal char
-			if (!isWhitespace(c) && c != '\n' && c != '\r')
+			if (!isWhitespace(c) && c != '\n' && c != '\r') {
+				atMacroArgsStart = false;
 				goto backslash;
+			}
 			// Line continuations count as "whitespace"
 			discardLineContinuation();
 		} else {
 			break;
 		}
 	}
+	atMacroArgsStart = false;
 
 	for (;;) {
 		c = peek();
@@ -1965,7 +2221,7 @@ finish:
 	// mode end the current macro argument but are not tokenized themselves.
 	if (c == ',') {
 		shiftChar();
-		return Token(T_(STRING), str);
+		return Token(T_(STRING), std::move(str));
 	}
 
 	// The last argument may end in a trailing comma, newline, or EOF.
@@ -1975,7 +2231,7 @@ finish:
 	// macro argument. To pass an empty last argument, use a second
 	// trailing comma.
 	if (!str.empty())
-		return Token(T_(STRING), str);
+		return Token(T_(STRING), std::move(str));
 	lexer_SetMode(LEXER_NORMAL);
 
 	if (c == '\r' || c == '\n') {
@@ -1987,6 +2243,138 @@ finish:
 	return Token(T_(YYEOF));
 }
 
+// Skipped blocks can be jumped over line by line within viewed contents, since the only lines
+// that matter to skipping are those which may start with a conditional or loop directive.
+
+struct DirectiveLine {
+	size_t offset;     // Where the line starts in the span
+	size_t nbNewlines; // How many newlines, including line continuations, precede it
+};
+
+struct SkipIndex {
+	ContentSpan span; // Kept alive, so that its address is not reused
+	std::vector<DirectiveLine> directiveLines;
+	size_t nbNewlines = 0; // How many newlines the whole span contains
+	size_t lastLineEnd = 0; // Offset just past the last newline
+};
+
+static std::unordered_map<char const *, SkipIndex> skipIndices;
+
+static bool mayStartDirective(char const *chars, size_t size) {
+	// A superset of all that matters to skipping: IF, ELIF, ELSE, ENDC, FOR, REPT, and ENDR
+	for (char const *prefix : {"IF", "EL", "EN", "FOR", "REPT"}) {
+		size_t len = strlen(prefix);
+		if (size >= len && !strncasecmp(chars, prefix, len))
+			return true;
+	}
+	return false;
+}
+
+// Returns the offset of the line following the one starting at `offset`, like skipping chars
+// one by one would; `nbNewlines` and `lastLineEnd` are updated for each newline skipped.
+static size_t skipLine(SkipIndex &index, size_t offset, size_t &nbNewlines, size_t &lastLineEnd) {
+	char const *chars = index.span.ptr.get();
+	size_t size = index.span.size;
+
+	while (offset < size) {
+		char c = chars[offset++];
+
+		// Unconditionally skip the next char, including line continuations
+		bool isContinuation = c == '\\';
+		if (isContinuation) {
+			if (offset == size)
+				break;
+			c = chars[offset++];
+		}
+
+		if (c == '\r' || c == '\n') {
+			if (c == '\r' && offset < size && chars[offset] == '\n')
+				offset++;
+			nbNewlines++;
+			lastLineEnd = offset;
+			if (!isContinuation)
+				break;
+		}
+	}
+	return offset;
+}
+
+static SkipIndex *getSkipIndex(ContentSpan const &span) {
+	auto [search, isNew] = skipIndices.try_emplace(span.ptr.get());
+	SkipIndex &index = search->second;
+
+	if (!isNew)
+		return index.span.size == span.size ? &index : nullptr;
+
+	index.span = span;
+	char const *chars = span.ptr.get();
+	for (size_t offset = 0; offset < span.size;) {
+		size_t firstChar = offset;
+		while (firstChar < span.size && isWhitespace(chars[firstChar]))
+			firstChar++;
+		if (mayStartDirective(&chars[firstChar], span.size - firstChar))
+			index.directiveLines.push_back({.offset = offset, .nbNewlines = index.nbNewlines});
+
+		offset = skipLine(index, offset, index.nbNewlines, index.lastLineEnd);
+	}
+	return &index;
+}
+
+// Jumps from the line starting at `lineStart`, which has been processed up to the current
+// position, to the next line that may start with a directive (or to the end of the contents).
+// Returns false if this is not possible, in which case chars must be skipped one by one.
+static bool skipToDirectiveLine(size_t lineStart) {
+	auto *view = std::get_if<ViewedContent>(&lexerState->content);
+	if (!view || !lexerState->expansions.empty() || lexerState->capturing
+	    || lineStart >= view->span.size)
+		return false;
+
+	SkipIndex *index = getSkipIndex(view->span);
+	if (!index)
+		return false;
+
+	auto const &lines = index->directiveLines;
+	auto next = std::upper_bound(
+	    RANGE(lines), lineStart, [](size_t offset, DirectiveLine const &line) {
+		    return offset < line.offset;
+	    }
+	);
+
+	// Count the newlines up to `lineStart` from the closest indexed line before it, checking
+	// that a line does start there (it may not if line continuations were lexed differently)
+	size_t offset = 0, nbNewlines = 0, lastLineEnd = 0;
+	if (next != lines.begin()) {
+		offset = next[-1].offset;
+		nbNewlines = next[-1].nbNewlines;
+	}
+	while (offset < lineStart)
+		offset = skipLine(*index, offset, nbNewlines, lastLineEnd);
+	if (offset != lineStart)
+		return false;
+
+	size_t target = next != lines.end() ? next->offset : view->span.size;
+	size_t targetNewlines = next != lines.end() ? next->nbNewlines : index->nbNewlines;
+	size_t distance = target - view->offset;
+
+	if (targetNewlines == nbNewlines)
+		lexerState->colNo += distance;
+	else if (next != lines.end())
+		lexerState->colNo = 1;
+	else
+		lexerState->colNo = 1 + target - index->lastLineEnd;
+	lexerState->lineNo += targetNewlines - nbNewlines;
+
+	size_t &scanDistance = lexerState->macroArgScanDistance;
+	scanDistance = scanDistance > distance ? scanDistance - distance : 0;
+	view->offset = target;
+	return true;
+}
+
+static size_t viewedOffset() {
+	auto *view = std::get_if<ViewedContent>(&lexerState->content);
+	return view && lexerState->expansions.empty() ? view->offset : SIZE_MAX;
+}
+
 // This function uses the fact that `if`, etc. constructs are only valid when
 // there's nothing before them on their lines. This enables filtering
 // "meaningful" (= at line start) vs. "meaningless" (everything else) tokens.
@@ -2003,6 +2391,7 @@ static Token skipIfBlock(bool toEndc) {
 
 	for (;;) {
 		if (atLineStart) {
+			size_t lineStart = viewedOffset();
 			int c;
 
 			for (;; shiftChar()) {
@@ -2044,6 +2433,11 @@ static Token skipIfBlock(bool toEndc) {
 				}
 			}
 			atLineStart = false;
+
+			if (lineStart != SIZE_MAX && skipToDirectiveLine(lineStart)) {
+				atLineStart = true;
+				continue;
+			}
 		}
 
 		// Read chars until EOL
@@ -2088,6 +2482,7 @@ static Token yylex_SKIP_TO_ENDR() {
 
 	for (;;) {
 		if (atLineStart) {
+			size_t lineStart = viewedOffset();
 			int c;
 
 			for (;;) {
@@ -2124,6 +2519,11 @@ static Token yylex_SKIP_TO_ENDR() {
 				}
 			}
 			atLineStart = false;
+
+			if (lineStart != SIZE_MAX && skipToDirectiveLine(lineStart)) {
+				atLineStart = true;
+				continue;
+			}
 		}
 
 		// Read chars until EOL
@@ -2149,6 +2549,102 @@ static Token yylex_SKIP_TO_ENDR() {
 	}
 }
 
+// Macro and REPT/FOR bodies are lexed again on every invocation or iteration, so the tokens lexed
+// from them are cached by address. A token is only cached if lexing it depended on nothing but
+// its chars (and the leading whitespace and comments), the lexer options, and being at the start
+// of a line: e.g. no macro arg, interpolation or EQUS expansion, no diagnostic, and no newline.
+
+struct CachedToken {
+	Token token;
+	size_t length; // Number of chars consumed by lexing the token
+	bool atLineStart;
+	char binDigits[2];
+	char gfxDigits[4];
+	uint8_t fixPrecision;
+};
+
+static std::unordered_map<char const *, CachedToken> tokenCache;
+// The bodies that tokens were cached from are kept alive, so that their addresses are not reused
+static std::unordered_set<std::shared_ptr<char[]>> cachedBodies;
+
+static bool matchesLexerOptions(CachedToken const &cached) {
+	return !memcmp(cached.binDigits, binDigits, sizeof(binDigits))
+	       && !memcmp(cached.gfxDigits, gfxDigits, sizeof(gfxDigits))
+	       && cached.fixPrecision == fixPrecision;
+}
+
+static Token yylex_NORMAL_CACHED() {
+	auto *view = std::get_if<ViewedContent>(&lexerState->content);
+	if (!view || !lexerState->cachesTokens || !lexerState->expansions.empty()
+	    || lexerState->capturing)
+		return yylex_NORMAL();
+
+	char const *start = &view->span.ptr[view->offset];
+
+	if (auto search = tokenCache.find(start); search != tokenCache.end()) {
+		CachedToken const &cached = search->second;
+		bool canReplay =
+		    cached.atLineStart == lexerState->atLineStart && matchesLexerOptions(cached);
+
+		// Identifiers may have been defined as EQUS since they were cached
+		if (canReplay && (cached.token.type == T_(ID) || cached.token.type == T_(LABEL))
+		    && lexerState->expandStrings) {
+			Symbol const *sym = sym_FindExactSymbol(std::get<std::string>(cached.token.value));
+			canReplay = !sym || sym->type != SYM_EQUS;
+		}
+		if (canReplay) {
+			skipViewedChars(cached.length);
+			return cached.token;
+		}
+	}
+
+	LexerState const *state = lexerState;
+	bool atLineStart = lexerState->atLineStart;
+	uint32_t lineNo = lexerState->lineNo;
+	uint64_t startExpansions = nbBegunExpansions;
+	unsigned int startDiagnostics = nbDiagnostics;
+	size_t startOffset = view->offset;
+
+	Token token = yylex_NORMAL();
+
+	// Anonymous label refs depend on how many were defined, an ELIF may skip its condition
+	if (token.type == T_(ANON) || token.type == T_(POP_ELIF) || token.type == T_(YYEOF)
+	    || lexerState != state || lexerState->lineNo != lineNo
+	    || nbBegunExpansions != startExpansions || nbDiagnostics != startDiagnostics
+	    || lexerState->mode != LEXER_NORMAL || !lexerState->expansions.empty())
+		return token;
+
+	assume(std::holds_alternative<ViewedContent>(lexerState->content));
+	std::string_view chars(start, view->offset - startOffset);
+	// Escapes, macro args and interpolations inside strings do not use expansions
+	if (chars.empty() || chars.find_first_of("\\{") != chars.npos)
+		return token;
+
+	CachedToken &cached = tokenCache[start];
+	cached.token = token;
+	cached.length = chars.length();
+	cached.atLineStart = atLineStart;
+	memcpy(cached.binDigits, binDigits, sizeof(binDigits));
+	memcpy(cached.gfxDigits, gfxDigits, sizeof(gfxDigits));
+	cached.fixPrecision = fixPrecision;
+	cachedBodies.insert(view->span.ptr);
+
+	return token;
+}
+
+using Clock = std::chrono::steady_clock;
+
+static bool isTimingLexing = false;
+static Clock::duration lexingTime{};
+
+void lexer_EnableTiming() {
+	isTimingLexing = true;
+}
+
+uint64_t lexer_GetLexingTime() {
+	return std::chrono::duration_cast<std::chrono::microseconds>(lexingTime).count();
+}
+
 yy::parser::symbol_type yylex() {
 	if (lexerState->atLineStart && lexerStateEOL) {
 		lexerState = lexerStateEOL;
@@ -2161,13 +2657,18 @@ yy::parser::symbol_type yylex() {
 		nextLine();
 
 	static Token (* const lexerModeFuncs[NB_LEXER_MODES])() = {
-	    yylex_NORMAL,
+	    yylex_NORMAL_CACHED,
 	    yylex_RAW,
 	    yylex_SKIP_TO_ELIF,
 	    yylex_SKIP_TO_ENDC,
 	    yylex_SKIP_TO_ENDR,
 	};
+	Clock::time_point lexingStart = isTimingLexing ? Clock::now() : Clock::time_point{};
 	Token token = lexerModeFuncs[lexerState->mode]();
+	if (isTimingLexing)
+		lexingTime += Clock::now() - lexingStart;
+	redefinedEqus = nullptr;
+	nbLexedTokens++;
 
 	// Captures end at their buffer's boundary no matter what
 	if (token.type == T_(YYEOF) && !lexerState->capturing)
@@ -2178,7 +2679,7 @@ yy::parser::symbol_type yylex() {
 	if (auto *numValue = std::get_if<uint32_t>(&token.value); numValue) {
 		return yy::parser::symbol_type(token.type, *numValue);
 	} else if (auto *strValue = std::get_if<std::string>(&token.value); strValue) {
-		return yy::parser::symbol_type(token.type, *strValue);
+		return yy::parser::symbol_type(token.type, std::move(*strValue));
 	} else {
 		assume(std::holds_alternative<std::monostate>(token.value));
 		return yy::parser::symbol_type(token.type);
@@ -2192,12 +2693,22 @@ static Capture startCapture() {
 	assume(lexerState->atLineStart);
 
 	assume(!lexerState->capturing && lexerState->captureBuf == nullptr);
+	assume(lexerState->captureExpansion == nullptr);
 	lexerState->capturing = true;
 	lexerState->captureSize = 0;
 
 	uint32_t lineNo = lexer_GetLineNo();
-	if (auto *view = std::get_if<ViewedContent>(&lexerState->content);
-	    view && lexerState->expansions.empty()) {
+	// Expansions cannot begin while capturing, so the text comes from the innermost one that has
+	// not ended yet, and then from its parents; it can be referenced in place until it goes past it
+	for (auto it = lexerState->expansions.rbegin(); it != lexerState->expansions.rend(); it++) {
+		if (it->offset < it->size()) {
+			lexerState->captureExpansion = it->contents;
+			lexerState->captureStart = it->offset;
+			// `.span.ptr == nullptr`; indicates to retrieve the captured text when done capturing
+			return {.lineNo = lineNo, .span = {.ptr = nullptr, .size = 0}};
+		}
+	}
+	if (auto *view = std::get_if<ViewedContent>(&lexerState->content); view) {
 		return {
 		    .lineNo = lineNo, .span = {.ptr = view->makeSharedContentPtr(), .size = 0}
         };
@@ -2211,11 +2722,29 @@ static Capture startCapture() {
 	}
 }
 
+static size_t liveCaptureBytes = 0;
+static size_t peakCaptureBytes = 0;
+
+size_t lexer_GetPeakCaptureBytes() {
+	return peakCaptureBytes;
+}
+
 static void endCapture(Capture &capture) {
-	// This being `nullptr` means we're capturing from the capture buffer, which is reallocated
-	// during the whole capture process, and so MUST be retrieved at the end
-	if (!capture.span.ptr)
-		capture.span.ptr = lexerState->makeSharedCaptureBufPtr();
+	// Captures from an expansion alias its contents; the capture buffer, on the other hand, is
+	// reallocated during the whole capture process, and so MUST be retrieved at the end
+	if (std::shared_ptr<std::string> &contents = lexerState->captureExpansion; contents) {
+		capture.span.ptr =
+		    std::shared_ptr<char[]>(contents, &(*contents)[lexerState->captureStart]);
+	} else if (!capture.span.ptr) {
+		// The buffer lives as long as the macro or loop that it holds, which counts it as freed
+		std::shared_ptr<std::vector<char>> &buf = lexerState->captureBuf;
+		size_t size = buf->capacity();
+		liveCaptureBytes += size;
+		peakCaptureBytes = std::max(peakCaptureBytes, liveCaptureBytes);
+		capture.span.ptr = std::shared_ptr<char[]>(buf->data(), [buf, size](char *) {
+			liveCaptureBytes -= size;
+		});
+	}
 	capture.span.size = lexerState->captureSize;
 
 	// ENDR/ENDM or EOF puts us past the start of the line
@@ -2223,6 +2752,7 @@ static void endCapture(Capture &capture) {
 
 	lexerState->capturing = false;
 	lexerState->captureBuf = nullptr;
+	lexerState->captureExpansion = nullptr;
 }
 
 Capture lexer_CaptureRept() {
@@ -15,46 +15,124 @@
 std::shared_ptr<std::string> MacroArgs::getArg(uint32_t i) const {
 	uint32_t realIndex = i + shift - 1;
 
-	return realIndex >= args.size() ? nullptr : args[realIndex];
+	return realIndex >= args->size() ? nullptr : (*args)[realIndex];
 }
 
 std::shared_ptr<std::string> MacroArgs::getAllArgs() const {
-	size_t nbArgs = args.size();
+	if (allArgs)
+		return allArgs;
 
-	if (shift >= nbArgs)
-		return std::make_shared<std::string>("");
+	size_t nbArgs = args->size();
+
+	if (shift >= nbArgs) {
+		allArgs = std::make_shared<std::string>("");
+		return allArgs;
+	}
 
 	size_t len = 0;
 
 	for (uint32_t i = shift; i < nbArgs; i++)
-		len += args[i]->length() + 1; // 1 for comma
+		len += (*args)[i]->length() + 1; // 1 for comma
 
-	auto str = std::make_shared<std::string>();
-	str->reserve(len + 1); // 1 for comma
+	allArgs = std::make_shared<std::string>();
+	allArgs->reserve(len + 1); // 1 for comma
 
 	for (uint32_t i = shift; i < nbArgs; i++) {
-		auto const &arg = args[i];
+		auto const &arg = (*args)[i];
 
-		str->append(*arg);
+		allArgs->append(*arg);
 
 		// Commas go between args and after a last empty arg
 		if (i < nbArgs - 1 || arg->empty())
-			str->push_back(','); // no space after comma
+			allArgs->push_back(','); // no space after comma
 	}
 
-	return str;
+	return allArgs;
+}
+
+// Whether lexing this arg in raw mode, followed by a comma or the end of the line, gives it back
+static bool splitsBackIntoItself(std::string const &arg) {
+	// Empty args would be warned about again, and surrounding whitespace would be trimmed
+	if (arg.empty() || arg.front() == ' ' || arg.front() == '\t' || arg.back() == ' '
+	    || arg.back() == '\t')
+		return false;
+
+	size_t parenDepth = 0;
+	for (size_t i = 0; i < arg.size(); i++) {
+		switch (arg[i]) {
+		case '"':
+			// Strings are only left alone if they have no escapes nor interpolations
+			if (i + 1 < arg.size() && arg[i + 1] == '"')
+				return false;
+			for (i++; i < arg.size() && arg[i] != '"'; i++) {
+				if (arg[i] == '\\' || arg[i] == '{' || arg[i] == '\n' || arg[i] == '\r')
+					return false;
+			}
+			if (i == arg.size())
+				return false;
+			break;
+		case '#':
+		case '/':
+			// Raw strings and block comments
+			if (i + 1 < arg.size() && arg[i + 1] == (arg[i] == '#' ? '"' : '*'))
+				return false;
+			break;
+		case '(':
+			parenDepth++;
+			break;
+		case ')':
+			if (parenDepth > 0)
+				parenDepth--;
+			break;
+		case ',':
+			if (parenDepth == 0)
+				return false;
+			break;
+		case '\\':
+		case ';':
+		case '\n':
+		case '\r':
+			return false;
+		}
+	}
+	// Unclosed parentheses would also take in the commas after the arg
+	return parenDepth == 0;
+}
+
+std::shared_ptr<MacroArgs> MacroArgs::forwardAllArgs() const {
+	if (!nbUnforwardableArgs) {
+		nbUnforwardableArgs = 0;
+		for (size_t i = args->size(); i--;) {
+			if (!splitsBackIntoItself(*(*args)[i])) {
+				nbUnforwardableArgs = i + 1;
+				break;
+			}
+		}
+	}
+	if (shift < *nbUnforwardableArgs)
+		return nullptr;
+
+	auto forwarded = std::make_shared<MacroArgs>();
+	forwarded->shift = shift;
+	forwarded->args = args;
+	forwarded->nbUnforwardableArgs = nbUnforwardableArgs;
+	return forwarded;
 }
 
 void MacroArgs::appendArg(std::shared_ptr<std::string> arg) {
 	if (arg->empty())
 		warning(WARNING_EMPTY_MACRO_ARG, "Empty macro argument\n");
-	if (args.size() == MAXMACROARGS)
+	if (args->size() == MAXMACROARGS)
 		error("A maximum of " EXPAND_AND_STR(MAXMACROARGS) " arguments is allowed\n");
-	args.push_back(arg);
+	args->push_back(arg);
+	allArgs = nullptr;
+	nbUnforwardableArgs = std::nullopt;
 }
 
 void MacroArgs::shiftArgs(int32_t count) {
-	if (size_t nbArgs = args.size();
+	allArgs = nullptr;
+
+	if (size_t nbArgs = args->size();
 	    count > 0 && ((uint32_t)count > nbArgs || shift > nbArgs - count)) {
 		warning(WARNING_MACRO_SHIFT, "Cannot shift macro arguments past their end\n");
 		shift = nbArgs;
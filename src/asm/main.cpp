@@ -7,17 +7,29 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <vector>
+#ifndef _WIN32
+	#include <sys/wait.h>
+#endif
 
 #include "error.hpp"
 #include "extern/getopt.hpp"
 #include "helpers.hpp"
 #include "parser.hpp"
+#include "platform.hpp"
+#include "server.hpp"
+#include "trace.hpp"
 #include "version.hpp"
 
 #include "asm/charmap.hpp"
 #include "asm/fstack.hpp"
+#include "asm/inccache.hpp"
+#include "asm/objcache.hpp"
 #include "asm/opt.hpp"
 #include "asm/output.hpp"
+#include "asm/pch.hpp"
+#include "asm/profile.hpp"
+#include "asm/stats.hpp"
 #include "asm/symbol.hpp"
 #include "asm/warning.hpp"
 
@@ -25,6 +37,7 @@ FILE *dependFile = nullptr;            // -M
 bool generatedMissingIncludes = false; // -MG
 bool generatePhonyDeps = false;        // -MP
 std::string targetFileName;            // -MQ, -MT
+bool depsOnly = false;                 // --deps-only
 bool failedOnMissingInclude = false;
 bool verbose = false; // -v
 bool warnings = true; // -w
@@ -46,11 +59,31 @@ static std::string make_escape(std::string &str) {
 	return escaped;
 }
 
+// In batch mode, a '%' in per-file option arguments stands for the input's path sans extension
+static std::string substituteStem(std::string const &pattern, std::string const &inputName) {
+	size_t percent = pattern.find('%');
+	if (percent == std::string::npos)
+		return pattern;
+
+	size_t dot = inputName.rfind('.');
+	size_t slash = inputName.find_last_of("/\\");
+	size_t stemLength = dot != std::string::npos && (slash == std::string::npos || dot > slash)
+	                        ? dot
+	                        : inputName.length();
+
+	std::string result = pattern;
+	for (; percent != std::string::npos; percent = result.find('%', percent + stemLength))
+		result.replace(percent, 1, inputName, 0, stemLength);
+	return result;
+}
+
 // Short options
-static char const *optstring = "b:D:Eg:I:M:o:P:p:Q:r:VvW:wX:";
+static char const *optstring = "b:D:Eg:I:j:M:o:P:p:Q:r:VvW:wX:";
 
 // Variables for the long-only options
-static int depType; // Variants of `-M`
+// `--cache-dir`, `--cache-includes`, `--keep-unchanged`, `--load-pch`, `--profile`, `--save-pch`,
+// `--serve`, `--stats`, `--trace` and variants of `-M`
+static int longOpt;
 
 // Equivalent long options
 // Please keep in the same order as short opts
@@ -62,21 +95,32 @@ static int depType; // Variants of `-M`
 // over short opt matching
 static option const longopts[] = {
     {"binary-digits",   required_argument, nullptr,  'b'},
+    {"cache-dir",       required_argument, &longOpt, 'C'},
+    {"cache-includes",  required_argument, &longOpt, 'c'},
     {"define",          required_argument, nullptr,  'D'},
+    {"deps-only",       no_argument,       &longOpt, 'd'},
     {"export-all",      no_argument,       nullptr,  'E'},
     {"gfx-chars",       required_argument, nullptr,  'g'},
     {"include",         required_argument, nullptr,  'I'},
+    {"jobs",            required_argument, nullptr,  'j'},
+    {"keep-unchanged",  no_argument,       &longOpt, 'k'},
+    {"load-pch",        required_argument, &longOpt, 'l'},
     {"dependfile",      required_argument, nullptr,  'M'},
-    {"MG",              no_argument,       &depType, 'G'},
-    {"MP",              no_argument,       &depType, 'P'},
-    {"MT",              required_argument, &depType, 'T'},
+    {"MG",              no_argument,       &longOpt, 'G'},
+    {"MP",              no_argument,       &longOpt, 'P'},
+    {"MT",              required_argument, &longOpt, 'T'},
     {"warning",         required_argument, nullptr,  'W'},
-    {"MQ",              required_argument, &depType, 'Q'},
+    {"MQ",              required_argument, &longOpt, 'Q'},
     {"output",          required_argument, nullptr,  'o'},
     {"preinclude",      required_argument, nullptr,  'P'},
     {"pad-value",       required_argument, nullptr,  'p'},
+    {"profile",         required_argument, &longOpt, 'f'},
     {"q-precision",     required_argument, nullptr,  'Q'},
     {"recursion-depth", required_argument, nullptr,  'r'},
+    {"save-pch",        required_argument, &longOpt, 's'},
+    {"serve",           required_argument, &longOpt, 'S'},
+    {"stats",           required_argument, &longOpt, 'a'},
+    {"trace",           required_argument, &longOpt, 't'},
     {"version",         no_argument,       nullptr,  'V'},
     {"verbose",         no_argument,       nullptr,  'v'},
     {"warning",         required_argument, nullptr,  'W'},
@@ -86,12 +130,18 @@ static option const longopts[] = {
 
 static void printUsage() {
 	fputs(
-	    "Usage: rgbasm [-EVvw] [-b chars] [-D name[=value]] [-g chars] [-I path]\n"
-	    "              [-M depend_file] [-MG] [-MP] [-MT target_file] [-MQ target_file]\n"
-	    "              [-o out_file] [-P include_file] [-p pad_value] [-Q precision]\n"
-	    "              [-r depth] [-W warning] [-X max_errors] <file>\n"
+	    "Usage: rgbasm [-EVvw] [-b chars] [--cache-dir dir] [--cache-includes dir]\n"
+	    "              [-D name[=value]] [--deps-only] [-g chars] [-I path] [-j jobs]\n"
+	    "              [--keep-unchanged] [--load-pch pch_file] [-M depend_file] [-MG] [-MP]\n"
+	    "              [-MT target_file] [-MQ target_file] [-o out_file]\n"
+	    "              [-P include_file] [-p pad_value]\n"
+	    "              [--profile prof_file] [-Q precision] [-r depth]\n"
+	    "              [--save-pch pch_file] [--serve socket] [--stats stats_file]\n"
+	    "              [--trace trace_file] [-W warning] [-X max_errors] <file> ...\n"
+	    "       rgbasm --connect socket [options] <file> ...\n"
 	    "Useful options:\n"
 	    "    -E, --export-all         export all labels\n"
+	    "    -j, --jobs <count>       assemble up to this many files in parallel\n"
 	    "    -M, --dependfile <path>  set the output dependency file\n"
 	    "    -o, --output <path>      set the output object file\n"
 	    "    -p, --pad-value <value>  set the value to use for `ds'\n"
@@ -103,33 +153,158 @@ static void printUsage() {
 	);
 }
 
-int main(int argc, char *argv[]) {
-	time_t now = time(nullptr);
-	// Support SOURCE_DATE_EPOCH for reproducible builds
-	// https://reproducible-builds.org/docs/source-date-epoch/
-	if (char const *sourceDateEpoch = getenv("SOURCE_DATE_EPOCH"); sourceDateEpoch)
-		now = (time_t)strtoul(sourceDateEpoch, nullptr, 0);
+// Per-file options, which may contain a '%' in batch mode
+static std::string dependFileName;  // -M
+static std::string profileFileName; // --profile
+static std::string pchFileName;     // --save-pch
+static std::string statsFileName;   // --stats
+static uint32_t maxDepth = DEFAULT_MAX_DEPTH;
+
+static int assembleFile(std::string const &mainFileName) {
+	if (targetFileName.empty() && !objectFileName.empty())
+		targetFileName = objectFileName;
+
+	if (verbose)
+		printf("Assembling %s\n", mainFileName.c_str());
+
+	if (depsOnly && dependFileName.empty())
+		errx("Option '--deps-only' requires a dependency file to be specified with -M");
+
+	if (!dependFileName.empty()) {
+		if (targetFileName.empty())
+			errx("Dependency files can only be created if a target file is specified with either "
+			     "-o, -MQ or -MT");
+
+		dependFile = dependFileName != "-" ? fopen(dependFileName.c_str(), "w") : stdout;
+		if (dependFile == nullptr)
+			err("Failed to open dependfile \"%s\"", dependFileName.c_str());
 
+		fprintf(dependFile, "%s: %s\n", targetFileName.c_str(), mainFileName.c_str());
+	}
 	Defer closeDependFile{[&] {
 		if (dependFile)
 			fclose(dependFile);
 	}};
 
-	// Perform some init for below
-	sym_Init(now);
+	// Profiles, stats and precompiled headers can only be written by actually assembling
+	if (profileFileName.empty() && statsFileName.empty() && pchFileName.empty() && !depsOnly
+	    && objcache_Restore(mainFileName))
+		return 0;
 
-	// Set defaults
-	opt_B("01");
-	opt_G("0123");
-	opt_P(0);
-	opt_Q(16);
-	sym_SetExportAll(false);
-	uint32_t maxDepth = DEFAULT_MAX_DEPTH;
-	char const *dependFileName = nullptr;
+	if (!profileFileName.empty())
+		prof_SetFileName(profileFileName);
+	if (!statsFileName.empty())
+		stats_SetFileName(statsFileName);
+
+	charmap_New(DEFAULT_CHARMAP_NAME, nullptr);
+
+	stats_StartPhase("parse");
+	// Init lexer and file stack, providing file info
+	fstk_Init(mainFileName, maxDepth);
+
+	// Perform parse (`yy::parser` is auto-generated from `parser.y`)
+	if (yy::parser parser; parser.parse() != 0 && nbErrors == 0)
+		nbErrors = 1;
+
+	sect_CheckUnionClosed();
+
+	prof_Write();
+
+	if (nbErrors != 0)
+		errx("Assembly aborted (%u error%s)!", nbErrors, nbErrors == 1 ? "" : "s");
+
+	// If parse aborted due to missing an include, and `-MG` was given, exit normally
+	if (failedOnMissingInclude) {
+		stats_Write();
+		return 0;
+	}
+
+	if (!depsOnly) {
+		stats_StartPhase("write_object");
+		out_WriteObject();
+	}
+
+	if (!pchFileName.empty()) {
+		stats_StartPhase("write_pch");
+		pch_Write(pchFileName);
+	}
+
+	stats_Write();
+	return 0;
+}
+
+// Each file is assembled by a forked copy of this process, which starts from the state set up
+// by the options (e.g. `-D` symbols), but whose own state does not leak into the other files'
+static int assembleBatch(std::vector<std::string> const &mainFileNames, unsigned long nbJobs) {
+	auto checkPattern = [](std::string const &pattern, char const *option) {
+		if (!pattern.empty() && pattern.find('%') == std::string::npos)
+			errx("Argument for option '%s' must contain a '%%' to assemble several files", option);
+	};
+	checkPattern(objectFileName, "o");
+	checkPattern(dependFileName, "M");
+	checkPattern(profileFileName, "profile");
+	checkPattern(statsFileName, "stats");
+	checkPattern(pchFileName, "save-pch");
+	for (std::string const &mainFileName : mainFileNames) {
+		if (mainFileName == "-")
+			errx("Standard input cannot be assembled along with other files");
+	}
+
+#ifdef _WIN32
+	(void)nbJobs;
+	errx("Assembling several files at once is not supported on this platform");
+#else
+	// Avoid the children also writing what was buffered so far
+	fflush(stdout);
+	fflush(stderr);
+
+	unsigned long nbRunning = 0;
+	bool failed = false;
+	auto waitForFile = [&] {
+		int status;
+		if (wait(&status) == -1)
+			err("Failed to wait for an assembly to finish");
+		nbRunning--;
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+			failed = true;
+	};
+
+	for (std::string const &mainFileName : mainFileNames) {
+		if (nbRunning == nbJobs)
+			waitForFile();
+
+		pid_t pid = fork();
+		if (pid == -1)
+			err("Failed to start assembling \"%s\"", mainFileName.c_str());
+		if (pid == 0) {
+			objectFileName = substituteStem(objectFileName, mainFileName);
+			targetFileName = substituteStem(targetFileName, mainFileName);
+			dependFileName = substituteStem(dependFileName, mainFileName);
+			profileFileName = substituteStem(profileFileName, mainFileName);
+			statsFileName = substituteStem(statsFileName, mainFileName);
+			pchFileName = substituteStem(pchFileName, mainFileName);
+			fastExit(assembleFile(mainFileName));
+		}
+		nbRunning++;
+	}
+	while (nbRunning != 0)
+		waitForFile();
+
+	return failed ? 1 : 0;
+#endif
+}
+
+static unsigned long nbJobs = 1;            // -j
+static std::string serverSocketName;        // --serve
+static char const *traceFileName = nullptr; // --trace
+static bool isMaxErrorsSet = false;         // -X
+
+static void parseOptions(int argc, char *argv[]) {
 	std::string newTarget;
+
 	// Maximum of 100 errors only applies if rgbasm is printing errors to a terminal.
-	if (isatty(STDERR_FILENO))
-		maxErrors = 100;
+	if (!isMaxErrorsSet)
+		maxErrors = isatty(STDERR_FILENO) ? 100 : 0;
 
 	for (int ch; (ch = musl_getopt_long_only(argc, argv, optstring, longopts, nullptr)) != -1;) {
 		switch (ch) {
@@ -168,18 +343,20 @@ int main(int argc, char *argv[]) {
 			fstk_AddIncludePath(musl_optarg);
 			break;
 
+		case 'j':
+			nbJobs = strtoul(musl_optarg, &endptr, 0);
+
+			if (musl_optarg[0] == '\0' || *endptr != '\0')
+				errx("Invalid argument for option 'j'");
+
+			if (nbJobs == 0)
+				errx("Argument for option 'j' must be at least 1");
+			break;
+
 		case 'M':
-			if (dependFile)
-				warnx("Overriding dependfile %s", dependFileName);
-			if (strcmp("-", musl_optarg)) {
-				dependFile = fopen(musl_optarg, "w");
-				dependFileName = musl_optarg;
-			} else {
-				dependFile = stdout;
-				dependFileName = "<stdout>";
-			}
-			if (dependFile == nullptr)
-				err("Failed to open dependfile \"%s\"", dependFileName);
+			if (!dependFileName.empty())
+				warnx("Overriding dependfile %s", dependFileName.c_str());
+			dependFileName = musl_optarg;
 			break;
 
 		case 'o':
@@ -254,11 +431,56 @@ int main(int argc, char *argv[]) {
 				errx("Argument for option 'X' must be between 0 and %u", UINT_MAX);
 
 			maxErrors = maxValue;
+			isMaxErrorsSet = true;
 			break;
 
 		// Long-only options
 		case 0:
-			switch (depType) {
+			switch (longOpt) {
+			case 'C':
+				objcache_SetDirectory(musl_optarg);
+				break;
+
+			case 'c':
+				inccache_SetDirectory(musl_optarg);
+				break;
+
+			case 'd':
+				depsOnly = true;
+				break;
+
+			case 'k':
+				keepUnchangedObject = true;
+				break;
+
+			case 'l':
+				fstk_SetPrecompiledHeader(musl_optarg);
+				break;
+
+			case 'f':
+				if (!profileFileName.empty())
+					warnx("Overriding profile file %s", profileFileName.c_str());
+				profileFileName = musl_optarg;
+				break;
+
+			case 's':
+				pchFileName = musl_optarg;
+				break;
+
+			case 'S':
+				serverSocketName = musl_optarg;
+				break;
+
+			case 'a':
+				if (!statsFileName.empty())
+					warnx("Overriding stats file %s", statsFileName.c_str());
+				statsFileName = musl_optarg;
+				break;
+
+			case 't':
+				traceFileName = musl_optarg;
+				break;
+
 			case 'G':
 				generatedMissingIncludes = true;
 				break;
@@ -270,7 +492,7 @@ int main(int argc, char *argv[]) {
 			case 'Q':
 			case 'T':
 				newTarget = musl_optarg;
-				if (depType == 'Q')
+				if (longOpt == 'Q')
 					newTarget = make_escape(newTarget);
 				if (!targetFileName.empty())
 					targetFileName += ' ';
@@ -287,9 +509,11 @@ int main(int argc, char *argv[]) {
 		}
 	}
 
-	if (targetFileName.empty() && !objectFileName.empty())
-		targetFileName = objectFileName;
+	// The options are all before the input files once they are parsed
+	objcache_SetOptions(musl_optind - 1, &argv[1]);
+}
 
+static int assembleInputs(int argc, char *argv[]) {
 	if (argc == musl_optind) {
 		fputs(
 		    "FATAL: Please specify an input file (pass `-` to read from standard input)\n", stderr
@@ -297,43 +521,59 @@ int main(int argc, char *argv[]) {
 		printUsage();
 		exit(1);
 	} else if (argc != musl_optind + 1) {
-		fputs("FATAL: More than one input file specified\n", stderr);
-		printUsage();
-		exit(1);
+		return assembleBatch({&argv[musl_optind], &argv[argc]}, nbJobs);
 	}
 
-	std::string mainFileName = argv[musl_optind];
+	return assembleFile(argv[musl_optind]);
+}
 
-	if (verbose)
-		printf("Assembling %s\n", mainFileName.c_str());
+// Requests are handled by a copy of the server, so they start from the state of its options
+static int handleRequest(int argc, char *argv[]) {
+	serverSocketName.clear();
+	musl_optreset = 1;
+	parseOptions(argc, argv);
+	if (!serverSocketName.empty())
+		errx("Option '--serve' cannot be passed to a server");
+	trace_Start("rgbasm", traceFileName);
 
-	if (dependFile) {
-		if (targetFileName.empty())
-			errx("Dependency files can only be created if a target file is specified with either "
-			     "-o, -MQ or -MT");
+	return assembleInputs(argc, argv);
+}
 
-		fprintf(dependFile, "%s: %s\n", targetFileName.c_str(), mainFileName.c_str());
+int main(int argc, char *argv[]) {
+	// Connecting to a server does not need anything else to be set up
+	if (argc > 1 && strncmp(argv[1], "--connect", QUOTEDSTRLEN("--connect")) == 0) {
+		if (argv[1][QUOTEDSTRLEN("--connect")] == '=')
+			server_Connect(&argv[1][QUOTEDSTRLEN("--connect=")], argc - 2, &argv[2]);
+		else if (argv[1][QUOTEDSTRLEN("--connect")] == '\0' && argc > 2)
+			server_Connect(argv[2], argc - 3, &argv[3]);
 	}
 
-	charmap_New(DEFAULT_CHARMAP_NAME, nullptr);
-
-	// Init lexer and file stack, providing file info
-	fstk_Init(mainFileName, maxDepth);
-
-	// Perform parse (`yy::parser` is auto-generated from `parser.y`)
-	if (yy::parser parser; parser.parse() != 0 && nbErrors == 0)
-		nbErrors = 1;
+	time_t now = time(nullptr);
+	// Support SOURCE_DATE_EPOCH for reproducible builds
+	// https://reproducible-builds.org/docs/source-date-epoch/
+	if (char const *sourceDateEpoch = getenv("SOURCE_DATE_EPOCH"); sourceDateEpoch)
+		now = (time_t)strtoul(sourceDateEpoch, nullptr, 0);
 
-	sect_CheckUnionClosed();
+	// Perform some init for below
+	sym_Init(now);
 
-	if (nbErrors != 0)
-		errx("Assembly aborted (%u error%s)!", nbErrors, nbErrors == 1 ? "" : "s");
+	// Set defaults
+	opt_B("01");
+	opt_G("0123");
+	opt_P(0);
+	opt_Q(16);
+	sym_SetExportAll(false);
 
-	// If parse aborted due to missing an include, and `-MG` was given, exit normally
-	if (failedOnMissingInclude)
-		return 0;
+	parseOptions(argc, argv);
+	trace_Start("rgbasm", traceFileName);
 
-	out_WriteObject();
+	if (!serverSocketName.empty()) {
+		if (argc != musl_optind)
+			errx("Input files must be passed to the server's requests, not to the server");
+		// Requests run in forks of the server, so this is all they share besides the options
+		fstk_PreloadPrecompiledHeader();
+		server_Serve(serverSocketName, "rgbasm", handleRequest);
+	}
 
-	return 0;
+	fastExit(assembleInputs(argc, argv));
 }
@@ -0,0 +1,311 @@
+/* SPDX-License-Identifier: MIT */
+
+#include "asm/objcache.hpp"
+#include <sys/stat.h>
+
+#include <inttypes.h>
+#include <optional>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "error.hpp"
+#include "helpers.hpp"
+#include "platform.hpp" // S_ISDIR (stat macro), getpid
+#include "util.hpp"
+#include "version.hpp"
+
+#include "asm/fstack.hpp"
+#include "asm/main.hpp"
+#include "asm/output.hpp"
+
+// Each cache entry holds up to this many variants, which differ by the contents of the files that
+// the assembly depended on (e.g. when switching between branches); each holds a whole object file
+#define MAX_CACHED_VARIANTS 4
+
+struct CachedDependency {
+	std::string path;
+	uint64_t hash;
+};
+
+struct CachedObject {
+	// Paths that were searched for in the include paths, and where they were found
+	std::vector<std::pair<std::string, std::string>> lookups;
+	std::vector<CachedDependency> dependencies; // In the order that they were printed
+	std::vector<uint8_t> data;
+};
+
+static std::string cacheDirectory;
+static uint64_t optionsHash = hashFNV1a(nullptr, 0);
+
+static std::optional<uint64_t> recordingHash; // The entry to store the assembly in, if cacheable
+static CachedObject recording;
+static std::unordered_set<std::string> recordedLookups; // Paths already in `recording.lookups`
+
+// Hashes of the dependencies' contents; those do not change during assembly
+static std::unordered_map<std::string, std::optional<uint64_t>> contentHashes;
+
+void objcache_SetDirectory(std::string const &path) {
+	struct stat statBuf;
+	if (stat(path.c_str(), &statBuf) != 0 || !S_ISDIR(statBuf.st_mode))
+		errx("Object cache \"%s\" is not a directory", path.c_str());
+
+	cacheDirectory = path;
+	if (cacheDirectory.back() != '/')
+		cacheDirectory += '/';
+}
+
+void objcache_SetOptions(int argc, char const * const *argv) {
+	char const *version = get_package_version_string();
+
+	optionsHash = hashFNV1a(version, strlen(version) + 1);
+	for (int i = 0; i < argc; i++)
+		optionsHash = hashFNV1a(argv[i], strlen(argv[i]) + 1, optionsHash);
+}
+
+static std::optional<uint64_t> getContentHash(std::string const &path) {
+	if (auto search = contentHashes.find(path); search != contentHashes.end())
+		return search->second;
+	return contentHashes[path] = hashFileFNV1a(path.c_str());
+}
+
+static std::string getCacheFilePath(uint64_t hash) {
+	char name[sizeof("0123456789ABCDEF.rgbobj")];
+	snprintf(name, sizeof(name), "%016" PRIX64 ".rgbobj", hash);
+	return cacheDirectory + name;
+}
+
+// Helpers to read the cache files, which tolerate (and report) truncated data
+
+struct CacheReader {
+	std::vector<uint8_t> data;
+	size_t offset = 0;
+	bool failed = false;
+
+	uint32_t getLong() {
+		if (data.size() - offset < 4) {
+			failed = true;
+			return 0;
+		}
+		uint8_t const *bytes = &data[offset];
+		offset += 4;
+		return bytes[0] | bytes[1] << 8 | bytes[2] << 16 | (uint32_t)bytes[3] << 24;
+	}
+
+	uint64_t getQuad() {
+		uint64_t value = getLong();
+		return value | (uint64_t)getLong() << 32;
+	}
+
+	std::string getString() {
+		size_t length = getLong();
+		if (length > data.size() - offset) {
+			failed = true;
+			return "";
+		}
+		std::string str((char const *)&data[offset], length);
+		offset += length;
+		return str;
+	}
+};
+
+static std::vector<CachedObject> readCacheFile(uint64_t hash) {
+	std::vector<CachedObject> variants;
+	std::string path = getCacheFilePath(hash);
+
+	FILE *file = fopen(path.c_str(), "rb");
+	if (!file)
+		return variants; // No cache entry yet
+	Defer closeFile{[&] { fclose(file); }};
+
+	CacheReader reader;
+	uint8_t buf[BUFSIZ];
+	for (size_t nbRead; (nbRead = fread(buf, 1, sizeof(buf), file)) != 0;)
+		reader.data.insert(reader.data.end(), buf, buf + nbRead);
+
+	// The version is part of the hash, but hashes can collide
+	if (reader.getString() != get_package_version_string() || reader.getQuad() != hash)
+		return variants;
+
+	for (uint32_t nbVariants = reader.getLong(); nbVariants-- && !reader.failed;) {
+		CachedObject &cached = variants.emplace_back();
+
+		for (uint32_t nbLookups = reader.getLong(); nbLookups-- && !reader.failed;) {
+			std::string lookupPath = reader.getString();
+			cached.lookups.emplace_back(std::move(lookupPath), reader.getString());
+		}
+		for (uint32_t nbDependencies = reader.getLong(); nbDependencies-- && !reader.failed;) {
+			std::string depPath = reader.getString();
+			cached.dependencies.push_back({.path = std::move(depPath), .hash = reader.getQuad()});
+		}
+		std::string data = reader.getString();
+		cached.data.assign(RANGE(data));
+	}
+
+	if (reader.failed || reader.offset != reader.data.size()) {
+		if (verbose)
+			printf("Ignoring corrupted object cache file \"%s\"\n", path.c_str());
+		variants.clear();
+	}
+	return variants;
+}
+
+static void putlong(std::string &buf, uint32_t value) {
+	buf += (char)value;
+	buf += (char)(value >> 8);
+	buf += (char)(value >> 16);
+	buf += (char)(value >> 24);
+}
+
+static void putquad(std::string &buf, uint64_t value) {
+	putlong(buf, value);
+	putlong(buf, value >> 32);
+}
+
+static void putstring(std::string &buf, std::string const &str) {
+	putlong(buf, str.length());
+	buf += str;
+}
+
+static void writeCacheFile(uint64_t hash, std::vector<CachedObject> const &variants) {
+	std::string buf;
+
+	putstring(buf, get_package_version_string());
+	putquad(buf, hash);
+	putlong(buf, variants.size());
+	for (CachedObject const &cached : variants) {
+		putlong(buf, cached.lookups.size());
+		for (auto const &[lookupPath, fullPath] : cached.lookups) {
+			putstring(buf, lookupPath);
+			putstring(buf, fullPath);
+		}
+		putlong(buf, cached.dependencies.size());
+		for (CachedDependency const &dep : cached.dependencies) {
+			putstring(buf, dep.path);
+			putquad(buf, dep.hash);
+		}
+		putlong(buf, cached.data.size());
+		buf.append((char const *)cached.data.data(), cached.data.size());
+	}
+
+	// Write to a temporary file first, so that concurrent assemblies never read a partial file
+	std::string path = getCacheFilePath(hash);
+	std::string tmpPath = path + "." + std::to_string(getpid()) + ".tmp";
+
+	FILE *file = fopen(tmpPath.c_str(), "wb");
+	if (!file) {
+		warn("Failed to create object cache file \"%s\"", tmpPath.c_str());
+		return;
+	}
+	bool failed = fwrite(buf.data(), 1, buf.size(), file) != buf.size();
+	failed |= fclose(file) != 0;
+
+	// Windows' `rename` does not replace existing files
+	if (!failed && rename(tmpPath.c_str(), path.c_str()) != 0) {
+		remove(path.c_str());
+		failed = rename(tmpPath.c_str(), path.c_str()) != 0;
+	}
+	if (failed) {
+		warn("Failed to write object cache file \"%s\"", path.c_str());
+		remove(tmpPath.c_str());
+	}
+}
+
+static bool isUpToDate(CachedObject const &cached) {
+	// A file added earlier in the include paths would be found instead of the cached one
+	for (auto const &[lookupPath, fullPath] : cached.lookups) {
+		if (std::optional<std::string> const &found = fstk_ResolveFile(lookupPath);
+		    !found || *found != fullPath)
+			return false;
+	}
+	for (CachedDependency const &dep : cached.dependencies) {
+		if (getContentHash(dep.path) != dep.hash)
+			return false;
+	}
+	return true;
+}
+
+bool objcache_Restore(std::string const &mainFileName) {
+	if (cacheDirectory.empty() || mainFileName == "-" || objectFileName.empty())
+		return false;
+
+	std::optional<uint64_t> mainHash = getContentHash(mainFileName);
+	if (!mainHash)
+		return false;
+
+	uint64_t hash = hashFNV1a(mainFileName.c_str(), mainFileName.length() + 1, optionsHash);
+	for (unsigned shift = 0; shift < 64; shift += 8) {
+		uint8_t byte = *mainHash >> shift;
+		hash = hashFNV1a(&byte, 1, hash);
+	}
+
+	for (CachedObject const &cached : readCacheFile(hash)) {
+		if (!isUpToDate(cached))
+			continue;
+
+		if (verbose)
+			printf("Restoring %s from the object cache\n", objectFileName.c_str());
+		if (dependFile) {
+			for (CachedDependency const &dep : cached.dependencies) {
+				fprintf(dependFile, "%s: %s\n", targetFileName.c_str(), dep.path.c_str());
+				if (generatePhonyDeps)
+					fprintf(dependFile, "%s:\n", dep.path.c_str());
+			}
+		}
+		out_WriteCachedObject(cached.data);
+		return true;
+	}
+
+	recordingHash = hash;
+	return false;
+}
+
+void objcache_Poison() {
+	recordingHash.reset();
+}
+
+void objcache_RecordLookup(std::string const &path, std::string const &fullPath) {
+	if (recordingHash && recordedLookups.insert(path).second)
+		recording.lookups.emplace_back(path, fullPath);
+}
+
+void objcache_RecordDependency(std::string const &path) {
+	if (!recordingHash)
+		return;
+
+	// Missing dependencies (with `-MG`) cannot be hashed, but do not get an object file anyway
+	if (std::optional<uint64_t> hash = getContentHash(path); hash)
+		recording.dependencies.push_back({.path = path, .hash = *hash});
+	else
+		recordingHash.reset();
+}
+
+void objcache_Store(std::span<std::span<uint8_t const> const> objectParts) {
+	if (!recordingHash)
+		return;
+
+	for (std::span<uint8_t const> part : objectParts)
+		recording.data.insert(recording.data.end(), RANGE(part));
+
+	// A variant with the same dependencies did not match, so it must have found other files
+	std::vector<CachedObject> variants = readCacheFile(*recordingHash);
+	std::erase_if(variants, [](CachedObject const &cached) {
+		if (cached.dependencies.size() != recording.dependencies.size())
+			return false;
+		for (size_t i = 0; i < cached.dependencies.size(); i++) {
+			if (cached.dependencies[i].path != recording.dependencies[i].path
+			    || cached.dependencies[i].hash != recording.dependencies[i].hash)
+				return false;
+		}
+		return true;
+	});
+	variants.insert(variants.begin(), std::move(recording));
+	if (variants.size() > MAX_CACHED_VARIANTS)
+		variants.resize(MAX_CACHED_VARIANTS);
+	writeCacheFile(*recordingHash, variants);
+	recordingHash.reset();
+}
@@ -9,6 +9,7 @@
 
 #include "asm/fixpoint.hpp"
 #include "asm/fstack.hpp"
+#include "asm/inccache.hpp"
 #include "asm/lexer.hpp"
 #include "asm/main.hpp"
 #include "asm/section.hpp"
@@ -54,6 +55,8 @@ void opt_W(char const *flag) {
 }
 
 void opt_Parse(char const *s) {
+	inccache_Poison();
+
 	switch (s[0]) {
 	case 'b':
 		if (strlen(&s[1]) == 2)
@@ -144,6 +147,8 @@ void opt_Parse(char const *s) {
 }
 
 void opt_Push() {
+	inccache_Poison();
+
 	OptStackEntry entry;
 
 	// Both of these are pulled from lexer.hpp
@@ -169,6 +174,8 @@ void opt_Push() {
 }
 
 void opt_Pop() {
+	inccache_Poison();
+
 	if (stack.empty()) {
 		error("No entries in the option stack\n");
 		return;
@@ -4,51 +4,84 @@
 
 #include <deque>
 #include <inttypes.h>
+#include <optional>
+#include <span>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "error.hpp"
 #include "helpers.hpp" // assume, Defer
+#include "opmath.hpp"
+#include "util.hpp"
 
 #include "asm/fstack.hpp"
+#include "asm/inccache.hpp"
 #include "asm/lexer.hpp"
 #include "asm/main.hpp"
+#include "asm/objcache.hpp"
 #include "asm/rpn.hpp"
 #include "asm/section.hpp"
 #include "asm/symbol.hpp"
 #include "asm/warning.hpp"
 
 struct Assertion {
-	Patch patch;
+	Patch patch; // Its RPN expression is in `assertionRPNArena`
 	Section *section;
 	std::string message;
 };
 
 std::string objectFileName;
+bool keepUnchangedObject = false;
 
 // List of symbols to put in the object file
 static std::vector<Symbol *> objectSymbols;
 
 static std::deque<Assertion> assertions;
+static std::vector<uint8_t> assertionRPNArena;
 
 static std::deque<std::shared_ptr<FileStackNode>> fileStackNodes;
 
-static void putlong(uint32_t n, FILE *file) {
+// The object file is serialized here, then written all at once
+static std::vector<uint8_t> objectBuffer;
+
+static void putbyte(uint8_t b) {
+	objectBuffer.push_back(b);
+}
+
+static void putlong(uint32_t n) {
 	uint8_t bytes[] = {
 	    (uint8_t)n,
 	    (uint8_t)(n >> 8),
 	    (uint8_t)(n >> 16),
 	    (uint8_t)(n >> 24),
 	};
-	fwrite(bytes, 1, sizeof(bytes), file);
+	objectBuffer.insert(objectBuffer.end(), bytes, bytes + sizeof(bytes));
+}
+
+// Most numbers are small, so they are stored as LEB128 varints: 7 bits per byte, low bits first
+static void putvarint(uint32_t n) {
+	for (; n >= 0x80; n >>= 7)
+		putbyte(n | 0x80);
+	putbyte(n);
+}
+
+static void putbytes(uint8_t const *data, size_t size) {
+	objectBuffer.insert(objectBuffer.end(), data, data + size);
 }
 
-static void putstring(std::string const &s, FILE *file) {
-	fputs(s.c_str(), file);
-	putc('\0', file);
+// Strings are only stored once, in the string table; they are referred to by their index in it
+static std::unordered_map<std::string, uint32_t> stringIDs;
+static std::vector<std::string const *> stringTable;
+
+static void putstring(std::string const &s) {
+	auto [search, isNew] = stringIDs.try_emplace(s, stringTable.size());
+	if (isNew)
+		stringTable.push_back(&search->first);
+	putvarint(search->second);
 }
 
 void out_RegisterNode(std::shared_ptr<FileStackNode> node) {
@@ -70,54 +103,84 @@ static uint32_t getSectIDIfAny(Section *sect) {
 	fatalerror("Unknown section '%s'\n", sect->name.c_str());
 }
 
-static void writepatch(Patch const &patch, FILE *file) {
+static void writepatch(Patch const &patch, std::vector<uint8_t> const &rpnArena) {
 	assume(patch.src->ID != (uint32_t)-1);
-	putlong(patch.src->ID, file);
-	putlong(patch.lineNo, file);
-	putlong(patch.offset, file);
-	putlong(getSectIDIfAny(patch.pcSection), file);
-	putlong(patch.pcOffset, file);
-	putc(patch.type, file);
-	putlong(patch.rpn.size(), file);
-	fwrite(patch.rpn.data(), 1, patch.rpn.size(), file);
+	putvarint(patch.src->ID);
+	putvarint(patch.lineNo);
+	putvarint(patch.offset);
+	putvarint(getSectIDIfAny(patch.pcSection));
+	putvarint(patch.pcOffset);
+	putbyte(patch.type | patch.isJumpTarget << 7);
+	putvarint(patch.rpnSize);
+	putbytes(&rpnArena[patch.rpnOffset], patch.rpnSize);
 }
 
-static void writesection(Section const &sect, FILE *file) {
-	putstring(sect.name, file);
+// Runs of identical bytes at least this long are stored as fills instead of literally
+static constexpr uint32_t MIN_FILL_RUN_LENGTH = 16;
+
+static void putliteralrun(uint8_t const *data, uint32_t length) {
+	if (length == 0)
+		return;
+	putvarint(length << 1);
+	putbytes(data, length);
+}
 
-	putlong(sect.size, file);
+// Store data as runs, so that large padded regions (e.g. from `DS`) take up almost no space
+static void writesectiondata(uint8_t const *data, uint32_t size) {
+	uint32_t literalStart = 0;
+
+	for (uint32_t i = 0; i < size;) {
+		uint32_t runEnd = i + 1;
+		while (runEnd < size && data[runEnd] == data[i])
+			runEnd++;
+
+		if (runEnd - i >= MIN_FILL_RUN_LENGTH) {
+			putliteralrun(&data[literalStart], i - literalStart);
+			putvarint((runEnd - i) << 1 | DATA_RUN_FILL);
+			putbyte(data[i]);
+			literalStart = runEnd;
+		}
+		i = runEnd;
+	}
+	putliteralrun(&data[literalStart], size - literalStart);
+}
+
+static void writesection(Section const &sect) {
+	putstring(sect.name);
+
+	putvarint(sect.size);
 
 	bool isUnion = sect.modifier == SECTION_UNION;
 	bool isFragment = sect.modifier == SECTION_FRAGMENT;
 
-	putc(sect.type | isUnion << 7 | isFragment << 6, file);
+	putbyte(sect.type | isUnion << 7 | isFragment << 6);
 
-	putlong(sect.org, file);
-	putlong(sect.bank, file);
-	putc(sect.align, file);
-	putlong(sect.alignOfs, file);
+	putvarint(sect.org);
+	putvarint(sect.bank);
+	putbyte(sect.align);
+	putvarint(sect.alignOfs);
 
 	if (sect_HasData(sect.type)) {
-		fwrite(sect.data.data(), 1, sect.size, file);
-		putlong(sect.patches.size(), file);
+		writesectiondata(sect.data.data(), sect.size);
+		putvarint(sect.patches.size());
 
 		for (Patch const &patch : sect.patches)
-			writepatch(patch, file);
+			writepatch(patch, sect.rpnArena);
 	}
 }
 
-static void writesymbol(Symbol const &sym, FILE *file) {
-	putstring(sym.name, file);
+static void writesymbol(Symbol const &sym) {
+	putstring(sym.name);
 	if (!sym.isDefined()) {
-		putc(SYMTYPE_IMPORT, file);
+		putbyte(SYMTYPE_IMPORT);
 	} else {
 		assume(sym.src->ID != (uint32_t)-1);
 
-		putc(sym.isExported ? SYMTYPE_EXPORT : SYMTYPE_LOCAL, file);
-		putlong(sym.src->ID, file);
-		putlong(sym.fileLine, file);
-		putlong(getSectIDIfAny(sym.getSection()), file);
-		putlong(sym.getOutputValue(), file);
+		putbyte(sym.isExported ? SYMTYPE_EXPORT : SYMTYPE_LOCAL);
+		putvarint(sym.src->ID);
+		putvarint(sym.fileLine);
+		putvarint(getSectIDIfAny(sym.getSection()));
+		putvarint(sym.getOutputValue());
 	}
 }
 
@@ -130,7 +193,7 @@ static void registerUnregisteredSymbol(Symbol &sym) {
 	}
 }
 
-static void writerpn(std::vector<uint8_t> &rpnexpr, std::vector<uint8_t> const &rpn) {
+static void writerpn(uint8_t *rpnexpr, std::vector<uint8_t> const &rpn) {
 	std::string symName;
 	size_t rpnptr = 0;
 
@@ -228,8 +291,15 @@ static void writerpn(std::vector<uint8_t> &rpnexpr, std::vector<uint8_t> const &
 	}
 }
 
-static void initpatch(Patch &patch, uint32_t type, Expression const &expr, uint32_t ofs) {
+static void initpatch(
+    Patch &patch,
+    std::vector<uint8_t> &rpnArena,
+    uint32_t type,
+    Expression const &expr,
+    uint32_t ofs
+) {
 	patch.type = type;
+	patch.isJumpTarget = false;
 	patch.src = fstk_GetFileStack();
 	// All patches are assumed to eventually be written, so the file stack node is registered
 	out_RegisterNode(patch.src);
@@ -238,26 +308,36 @@ static void initpatch(Patch &patch, uint32_t type, Expression const &expr, uint3
 	patch.pcSection = sect_GetSymbolSection();
 	patch.pcOffset = sect_GetSymbolOffset();
 
+	patch.rpnOffset = rpnArena.size();
 	if (expr.isKnown()) {
 		// If the RPN expr's value is known, output a constant directly
 		uint32_t val = expr.value();
-		patch.rpn.resize(5);
-		patch.rpn[0] = RPN_CONST;
-		patch.rpn[1] = val & 0xFF;
-		patch.rpn[2] = val >> 8;
-		patch.rpn[3] = val >> 16;
-		patch.rpn[4] = val >> 24;
+		uint8_t bytes[] = {
+		    RPN_CONST,
+		    (uint8_t)val,
+		    (uint8_t)(val >> 8),
+		    (uint8_t)(val >> 16),
+		    (uint8_t)(val >> 24),
+		};
+		rpnArena.insert(rpnArena.end(), bytes, bytes + sizeof(bytes));
+	} else if (!expr.hasSymbolNames) {
+		// Without symbol names to turn into IDs, the RPN is already in its final form
+		rpnArena.insert(rpnArena.end(), expr.rpn.begin(), expr.rpn.end());
 	} else {
-		patch.rpn.resize(expr.rpnPatchSize);
-		writerpn(patch.rpn, expr.rpn);
+		rpnArena.resize(rpnArena.size() + expr.rpnPatchSize);
+		writerpn(&rpnArena[patch.rpnOffset], expr.rpn);
 	}
+	patch.rpnSize = rpnArena.size() - patch.rpnOffset;
 }
 
-void out_CreatePatch(uint32_t type, Expression const &expr, uint32_t ofs, uint32_t pcShift) {
+void out_CreatePatch(
+    uint32_t type, Expression const &expr, uint32_t ofs, uint32_t pcShift, bool isJumpTarget
+) {
 	// Add the patch to the list
 	Patch &patch = currentSection->patches.emplace_front();
 
-	initpatch(patch, type, expr, ofs);
+	initpatch(patch, currentSection->rpnArena, type, expr, ofs);
+	patch.isJumpTarget = isJumpTarget;
 
 	// If the patch had a quantity of bytes output before it,
 	// PC is not at the patch's location, but at the location
@@ -268,62 +348,391 @@ void out_CreatePatch(uint32_t type, Expression const &expr, uint32_t ofs, uint32
 void out_CreateAssert(
     AssertionType type, Expression const &expr, std::string const &message, uint32_t ofs
 ) {
+	inccache_Poison();
+	if (depsOnly) // Assertions that could not be evaluated yet end up in the object file
+		return;
+
 	Assertion &assertion = assertions.emplace_front();
 
-	initpatch(assertion.patch, type, expr, ofs);
+	initpatch(assertion.patch, assertionRPNArena, type, expr, ofs);
 	assertion.message = message;
 }
 
-static void writeassert(Assertion &assert, FILE *file) {
-	writepatch(assert.patch, file);
-	putstring(assert.message, file);
+static void writeassert(Assertion &assert) {
+	writepatch(assert.patch, assertionRPNArena);
+	putstring(assert.message);
 }
 
-static void writeFileStackNode(FileStackNode const &node, FILE *file) {
-	putlong(node.parent ? node.parent->ID : (uint32_t)-1, file);
-	putlong(node.lineNo, file);
-	putc(node.type, file);
+static void writeFileStackNode(FileStackNode const &node) {
+	putvarint(node.parent ? node.parent->ID : (uint32_t)-1);
+	putvarint(node.lineNo);
+	putbyte(node.type);
 	if (node.type != NODE_REPT) {
-		putstring(node.name(), file);
+		putstring(node.name());
 	} else {
 		std::vector<uint32_t> const &nodeIters = node.iters();
+		// A parent REPT node already has the outer iters, so only write this node's own
+		uint32_t nbOwnIters = nodeIters.size();
+		if (node.parent->type == NODE_REPT) {
+			assume(node.parent->iters().size() <= nbOwnIters);
+			nbOwnIters -= node.parent->iters().size();
+		}
 
-		putlong(nodeIters.size(), file);
+		putvarint(nbOwnIters);
 		// Iters are stored by decreasing depth, so reverse the order for output
-		for (uint32_t i = nodeIters.size(); i--;)
-			putlong(nodeIters[i], file);
+		for (uint32_t i = nbOwnIters; i--;)
+			putvarint(nodeIters[i]);
 	}
 }
 
-void out_WriteObject() {
-	if (objectFileName.empty())
-		return;
+// A value computed without linking: a constant, or an offset from the start of a floating section
+struct LinkTimeValue {
+	Section const *section; // `nullptr` for constants
+	uint32_t value;
+};
 
-	FILE *file;
-	if (objectFileName != "-") {
-		file = fopen(objectFileName.c_str(), "wb");
-	} else {
-		objectFileName = "<stdout>";
-		file = fdopen(STDOUT_FILENO, "wb");
+static LinkTimeValue labelValue(Section const *sect, uint32_t offset) {
+	if (sect->org != (uint32_t)-1)
+		return {.section = nullptr, .value = sect->org + offset};
+	return {.section = sect, .value = offset};
+}
+
+static uint32_t getRPNLong(uint8_t const *rpn) {
+	return rpn[0] | rpn[1] << 8 | rpn[2] << 16 | (uint32_t)rpn[3] << 24;
+}
+
+/*
+ * Computes a binary operation as rgblink would, if possible without knowing where floating
+ * sections will be placed. Like `Expression::makeBinaryOp`, but also for forward references.
+ */
+static std::optional<LinkTimeValue>
+    tryComputeBinaryOp(uint8_t op, LinkTimeValue const &lhs, LinkTimeValue const &rhs) {
+	if (lhs.section || rhs.section) {
+		if (op == RPN_ADD && (!lhs.section || !rhs.section))
+			// Adding to a label only moves it within its section
+			return LinkTimeValue{
+			    .section = lhs.section ? lhs.section : rhs.section, .value = lhs.value + rhs.value
+			};
+		if (op == RPN_SUB && !rhs.section)
+			return LinkTimeValue{.section = lhs.section, .value = lhs.value - rhs.value};
+		if (op == RPN_SUB && lhs.section == rhs.section)
+			// The difference between two labels in the same section does not depend on its address
+			return LinkTimeValue{.section = nullptr, .value = lhs.value - rhs.value};
+		if (op == RPN_AND && (!lhs.section || !rhs.section)) {
+			// Masking a label may only keep bits known from its section's alignment (see
+			// `tryConstMask`)
+			LinkTimeValue const &label = lhs.section ? lhs : rhs;
+			uint32_t mask = lhs.section ? rhs.value : lhs.value;
+			uint32_t knownBits = (1u << label.section->align) - 1;
+
+			if ((mask & ~knownBits) != 0)
+				return std::nullopt;
+			return LinkTimeValue{
+			    .section = nullptr, .value = (label.section->alignOfs + label.value) & mask
+			};
+		}
+		return std::nullopt;
+	}
+
+	int32_t lval = lhs.value, rval = rhs.value;
+	uint32_t value;
+
+	switch (op) {
+	case RPN_ADD:
+		value = lhs.value + rhs.value;
+		break;
+	case RPN_SUB:
+		value = lhs.value - rhs.value;
+		break;
+	case RPN_MUL:
+		value = lhs.value * rhs.value;
+		break;
+	// Errors are left for rgblink to report
+	case RPN_DIV:
+		if (rval == 0)
+			return std::nullopt;
+		value = op_divide(lval, rval);
+		break;
+	case RPN_MOD:
+		if (rval == 0)
+			return std::nullopt;
+		value = op_modulo(lval, rval);
+		break;
+	case RPN_EXP:
+		if (rval < 0)
+			return std::nullopt;
+		value = op_exponent(lval, rval);
+		break;
+	case RPN_OR:
+		value = lval | rval;
+		break;
+	case RPN_AND:
+		value = lval & rval;
+		break;
+	case RPN_XOR:
+		value = lval ^ rval;
+		break;
+	case RPN_LOGAND:
+		value = lval && rval;
+		break;
+	case RPN_LOGOR:
+		value = lval || rval;
+		break;
+	case RPN_LOGEQ:
+		value = lval == rval;
+		break;
+	case RPN_LOGNE:
+		value = lval != rval;
+		break;
+	case RPN_LOGGT:
+		value = lval > rval;
+		break;
+	case RPN_LOGLT:
+		value = lval < rval;
+		break;
+	case RPN_LOGGE:
+		value = lval >= rval;
+		break;
+	case RPN_LOGLE:
+		value = lval <= rval;
+		break;
+	case RPN_SHL:
+		value = op_shift_left(lval, rval);
+		break;
+	case RPN_SHR:
+		value = op_shift_right(lval, rval);
+		break;
+	case RPN_USHR:
+		value = op_shift_right_unsigned(lval, rval);
+		break;
+	default:
+		return std::nullopt;
+	}
+	return LinkTimeValue{.section = nullptr, .value = value};
+}
+
+/*
+ * Evaluates a patch's RPN expression (in its final form) if possible without linking.
+ * Other floating sections must not be referred to, since a patch referring to one is what keeps
+ * it from being removed by rgblink's `--gc-sections`; even if the patch's value does not depend
+ * on where that section is placed.
+ */
+static std::optional<LinkTimeValue> tryComputeRPN(Section const &sect, Patch const &patch) {
+	uint8_t const *rpn = &sect.rpnArena[patch.rpnOffset];
+	uint8_t const *rpnEnd = rpn + patch.rpnSize;
+	std::vector<LinkTimeValue> stack;
+
+	while (rpn != rpnEnd) {
+		uint8_t command = *rpn++;
+
+		switch (command) {
+			uint32_t id;
+			Symbol const *sym;
+
+		case RPN_CONST:
+			stack.push_back({.section = nullptr, .value = getRPNLong(rpn)});
+			rpn += 4;
+			break;
+
+		case RPN_SYM:
+			id = getRPNLong(rpn);
+			rpn += 4;
+			if (id == (uint32_t)-1) { // PC
+				if (!patch.pcSection)
+					return std::nullopt;
+				stack.push_back(labelValue(patch.pcSection, patch.pcOffset));
+			} else if (sym = objectSymbols[id]; !sym->isDefined() || !sym->isNumeric()) {
+				return std::nullopt;
+			} else if (sym->type == SYM_LABEL) {
+				stack.push_back(labelValue(sym->getSection(), sym->getOutputValue()));
+			} else {
+				stack.push_back({.section = nullptr, .value = (uint32_t)sym->getOutputValue()});
+			}
+			if (stack.back().section && stack.back().section != &sect)
+				return std::nullopt;
+			break;
+
+		case RPN_NEG:
+		case RPN_NOT:
+		case RPN_LOGNOT:
+		case RPN_HRAM:
+		case RPN_RST: {
+			LinkTimeValue &operand = stack.back();
+
+			if (operand.section)
+				return std::nullopt;
+			int32_t value = operand.value;
+			if (command == RPN_NEG) {
+				operand.value = -operand.value;
+			} else if (command == RPN_NOT) {
+				operand.value = ~operand.value;
+			} else if (command == RPN_LOGNOT) {
+				operand.value = !value;
+			} else if (command == RPN_HRAM) {
+				if (value < 0 || (value > 0xFF && value < 0xFF00) || value > 0xFFFF)
+					return std::nullopt;
+				operand.value &= 0xFF;
+			} else {
+				if (value & ~0x38)
+					return std::nullopt;
+				operand.value |= 0xC7;
+			}
+			break;
+		}
+
+		case RPN_BANK_SYM:
+		case RPN_BANK_SECT:
+		case RPN_BANK_SELF:
+		case RPN_SIZEOF_SECT:
+		case RPN_STARTOF_SECT:
+		case RPN_SIZEOF_SECTTYPE:
+		case RPN_STARTOF_SECTTYPE:
+			return std::nullopt;
+
+		default: {
+			LinkTimeValue rhs = stack.back();
+			stack.pop_back();
+			std::optional<LinkTimeValue> result = tryComputeBinaryOp(command, stack.back(), rhs);
+
+			if (!result)
+				return std::nullopt;
+			stack.back() = *result;
+			break;
+		}
+		}
 	}
+	assume(stack.size() == 1);
+	return stack.back();
+}
+
+// Applies a patch to its section's data if it does not need linking, and returns whether it did
+static bool tryApplyPatch(Section &sect, Patch const &patch) {
+	std::optional<LinkTimeValue> result = tryComputeRPN(sect, patch);
+	if (!result)
+		return false;
+
+	if (patch.type == PATCHTYPE_JR) {
+		// Offset is relative to the byte *after* the operand
+		// PC as operand to `jr` is lower than reference PC by 2
+		std::optional<LinkTimeValue> jumpOffset = tryComputeBinaryOp(
+		    RPN_SUB, *result, labelValue(patch.pcSection, patch.pcOffset + 2)
+		);
+
+		if (!jumpOffset || jumpOffset->section)
+			return false;
+		int16_t offset = jumpOffset->value;
+		if (offset < -128 || offset > 127)
+			return false; // Let rgblink report the error
+		sect.data[patch.offset] = offset & 0xFF;
+		return true;
+	}
+
+	if (result->section)
+		return false;
+
+	// Same checks as rgblink's, leaving it to report any error
+	struct {
+		uint8_t size;
+		int32_t min;
+		int32_t max;
+	} const types[PATCHTYPE_INVALID] = {
+	    {1, -128,      255      }, // PATCHTYPE_BYTE
+	    {2, -32768,    65536    }, // PATCHTYPE_WORD
+	    {4, INT32_MIN, INT32_MAX}, // PATCHTYPE_LONG
+	};
+	int32_t value = result->value;
+
+	if (value < types[patch.type].min || value > types[patch.type].max)
+		return false;
+	for (uint8_t i = 0; i < types[patch.type].size; i++) {
+		sect.data[patch.offset + i] = value & 0xFF;
+		value >>= 8;
+	}
+	return true;
+}
+
+// Applies the patches that only depend on the section they are in, e.g. forward `jr`s
+static void applyLocalPatches() {
+	for (Section &sect : sectionList) {
+		if (sect_HasData(sect.type))
+			std::erase_if(sect.patches, [&sect](Patch const &patch) {
+				return tryApplyPatch(sect, patch);
+			});
+	}
+}
+
+// Estimates the object file's size from its bulk, i.e. the sections' data and patches
+static size_t estimateObjectSize() {
+	size_t size = 0;
+	for (Section const &sect : sectionList) {
+		size += sect.name.length() + 24; // Name and header fields
+		if (sect_HasData(sect.type)) {
+			size += sect.size;
+			for (Patch const &patch : sect.patches)
+				size += patch.rpnSize + 25; // RPN and header fields
+		}
+	}
+	return size;
+}
+
+// Checks whether the object file already contains exactly these bytes
+static bool isObjectUnchanged(std::span<std::span<uint8_t const> const> parts) {
+	FILE *file = fopen(objectFileName.c_str(), "rb");
+	if (!file)
+		return false;
+	Defer closeFile{[&] { fclose(file); }};
+
+	// The header comes first, so a different fingerprint is found without reading the rest
+	std::vector<uint8_t> buf;
+	for (std::span<uint8_t const> part : parts) {
+		buf.resize(part.size());
+		if (fread(buf.data(), 1, buf.size(), file) != buf.size()
+		    || memcmp(buf.data(), part.data(), buf.size()))
+			return false;
+	}
+	return getc(file) == EOF && !ferror(file);
+}
+
+static void writeObjectFile(FILE *file, std::span<std::span<uint8_t const> const> parts) {
 	if (!file)
 		err("Failed to open object file '%s'", objectFileName.c_str());
 	Defer closeFile{[&] { fclose(file); }};
 
+	for (std::span<uint8_t const> part : parts) {
+		if (fwrite(part.data(), 1, part.size(), file) != part.size())
+			err("Failed to write object file '%s'", objectFileName.c_str());
+	}
+}
+
+static void writeObject(std::span<std::span<uint8_t const> const> parts) {
+	if (objectFileName == "-") {
+		objectFileName = "<stdout>";
+		writeObjectFile(fdopen(STDOUT_FILENO, "wb"), parts);
+	} else if (!keepUnchangedObject || !isObjectUnchanged(parts)) {
+		writeObjectFile(fopen(objectFileName.c_str(), "wb"), parts);
+	} else if (verbose) {
+		printf("Object file %s is unchanged, not rewriting it\n", objectFileName.c_str());
+	}
+}
+
+void out_WriteObject() {
+	if (objectFileName.empty())
+		return;
+
 	// Also write symbols that weren't written above
 	sym_ForEach(registerUnregisteredSymbol);
 
-	fprintf(file, RGBDS_OBJECT_VERSION_STRING);
-	putlong(RGBDS_OBJECT_REV, file);
+	applyLocalPatches();
 
-	putlong(objectSymbols.size(), file);
-	putlong(sectionList.size(), file);
+	// The string table comes first, but is only complete once everything else is serialized
+	objectBuffer.clear();
+	objectBuffer.reserve(estimateObjectSize());
 
-	putlong(fileStackNodes.size(), file);
+	putvarint(fileStackNodes.size());
 	for (auto it = fileStackNodes.begin(); it != fileStackNodes.end(); it++) {
 		FileStackNode const &node = **it;
 
-		writeFileStackNode(node, file);
+		writeFileStackNode(node);
 
 		// The list is supposed to have decrementing IDs
 		if (it + 1 != fileStackNodes.end() && it[1]->ID != node.ID - 1)
@@ -336,15 +745,50 @@ void out_WriteObject() {
 	}
 
 	for (Symbol const *sym : objectSymbols)
-		writesymbol(*sym, file);
+		writesymbol(*sym);
 
 	for (auto it = sectionList.rbegin(); it != sectionList.rend(); it++)
-		writesection(*it, file);
+		writesection(*it);
 
-	putlong(assertions.size(), file);
+	putvarint(assertions.size());
 
 	for (Assertion &assert : assertions)
-		writeassert(assert, file);
+		writeassert(assert);
+
+	std::vector<uint8_t> body = std::move(objectBuffer);
+	objectBuffer.clear();
+
+	putvarint(objectSymbols.size());
+	putvarint(sectionList.size());
+
+	putvarint(stringTable.size());
+	for (std::string const *str : stringTable)
+		putbytes((uint8_t const *)str->c_str(), str->size() + 1);
+
+	std::vector<uint8_t> tables = std::move(objectBuffer);
+	objectBuffer.clear();
+
+	// The fingerprint covers everything after it
+	uint64_t fingerprint = hashFNV1a(tables.data(), tables.size());
+	fingerprint = hashFNV1a(body.data(), body.size(), fingerprint);
+
+	putbytes(
+	    (uint8_t const *)RGBDS_OBJECT_VERSION_STRING, QUOTEDSTRLEN(RGBDS_OBJECT_VERSION_STRING)
+	);
+	putlong(RGBDS_OBJECT_REV);
+	putlong(fingerprint);
+	putlong(fingerprint >> 32);
+
+	std::span<uint8_t const> parts[] = {objectBuffer, tables, body};
+
+	objcache_Store(parts);
+	writeObject(parts);
+}
+
+void out_WriteCachedObject(std::vector<uint8_t> const &data) {
+	std::span<uint8_t const> parts[] = {data};
+
+	writeObject(parts);
 }
 
 void out_SetFileName(std::string const &name) {
@@ -28,6 +28,12 @@
 		int32_t step;
 	};
 
+	struct TableArgs {
+		std::string varName;
+		ForArgs range;
+		Expression body;
+	};
+
 	struct StrFmtArgList {
 		std::string format;
 		std::vector<std::variant<uint32_t, std::string>> args;
@@ -55,7 +61,9 @@
 	#include "asm/fixpoint.hpp"
 	#include "asm/format.hpp"
 	#include "asm/fstack.hpp"
+	#include "asm/inccache.hpp"
 	#include "asm/main.hpp"
+	#include "asm/objcache.hpp"
 	#include "asm/opt.hpp"
 	#include "asm/output.hpp"
 	#include "asm/section.hpp"
@@ -65,6 +73,7 @@
 	#include "extern/utf8decoder.hpp"
 
 	#include "helpers.hpp"
+	#include "util.hpp"
 
 	using namespace std::literals;
 
@@ -74,7 +83,6 @@
 	static void errorInvalidUTF8Byte(uint8_t byte, char const *functionName);
 	static size_t strlenUTF8(std::string const &str);
 	static std::string strsubUTF8(std::string const &str, uint32_t pos, uint32_t len);
-	static size_t charlenUTF8(std::string const &str);
 	static std::string charsubUTF8(std::string const &str, uint32_t pos);
 	static uint32_t adjustNegativePos(int32_t pos, size_t len, char const *functionName);
 	static std::string strrpl(
@@ -265,6 +273,8 @@
 %type <std::vector<Expression>> ds_args
 %type <std::vector<std::string>> purge_args
 %type <ForArgs> for_args
+%type <TableArgs> table
+%type <TableArgs> table_args
 
 %token Z80_ADC "adc" Z80_ADD "add" Z80_AND "and"
 %token Z80_BIT "bit"
@@ -350,6 +360,7 @@ line:
 	| error {
 		lexer_SetMode(LEXER_NORMAL);
 		lexer_ToggleStringExpansion(true);
+		rpn_EndTableBody();
 	} endofline {
 		fstk_StopRept();
 		yyerrok;
@@ -358,6 +369,7 @@ line:
 	| LABEL error {
 		lexer_SetMode(LEXER_NORMAL);
 		lexer_ToggleStringExpansion(true);
+		rpn_EndTableBody();
 	} endofline {
 		Symbol *macro = sym_FindExactSymbol($1);
 
@@ -517,9 +529,10 @@ label:
 macro:
 	ID {
 		// Parsing 'macroargs' will restore the lexer's normal mode
-		lexer_SetMode(LEXER_RAW);
+		lexer_StartMacroArgs();
 	} macro_args {
-		fstk_RunMacro($1, $3);
+		std::shared_ptr<MacroArgs> forwarded = lexer_TakeForwardedMacroArgs();
+		fstk_RunMacro($1, forwarded ? forwarded : $3);
 	}
 ;
 
@@ -927,6 +940,9 @@ db:
 		sect_Skip(1, false);
 	}
 	| POP_DB constlist_8bit trailing_comma
+	| POP_DB table {
+		sect_RelTable(1, $2.varName, $2.range.start, $2.range.stop, $2.range.step, $2.body);
+	}
 ;
 
 dw:
@@ -934,6 +950,9 @@ dw:
 		sect_Skip(2, false);
 	}
 	| POP_DW constlist_16bit trailing_comma
+	| POP_DW table {
+		sect_RelTable(2, $2.varName, $2.range.start, $2.range.stop, $2.range.step, $2.body);
+	}
 ;
 
 dl:
@@ -941,6 +960,38 @@ dl:
 		sect_Skip(4, false);
 	}
 	| POP_DL constlist_32bit trailing_comma
+	| POP_DL table {
+		sect_RelTable(4, $2.varName, $2.range.start, $2.range.stop, $2.range.step, $2.body);
+	}
+;
+
+// A `FOR` loop over the values of a data directive's expression, which is only parsed once
+table:
+	POP_FOR {
+		lexer_ToggleStringExpansion(false);
+	} ID {
+		lexer_ToggleStringExpansion(true);
+		rpn_StartTableBody($3);
+	} COMMA table_args {
+		rpn_EndTableBody();
+		$$ = std::move($6);
+		$$.varName = std::move($3);
+	}
+;
+
+table_args:
+	const COMMA relocexpr {
+		$$.range = {.start = 0, .stop = $1, .step = 1};
+		$$.body = std::move($3);
+	}
+	| const COMMA const COMMA relocexpr {
+		$$.range = {.start = $1, .stop = $3, .step = 1};
+		$$.body = std::move($5);
+	}
+	| const COMMA const COMMA const COMMA relocexpr {
+		$$.range = {.start = $1, .stop = $3, .step = $5};
+		$$.body = std::move($7);
+	}
 ;
 
 def_equ:
@@ -1006,14 +1057,19 @@ def_rl:
 def_equs:
 	def_id POP_EQUS string {
 		$$ = std::move($1);
-		sym_AddString($$, std::make_shared<std::string>($3));
+		sym_AddString($$, std::make_shared<std::string>(std::move($3)));
 	}
 ;
 
 redef_equs:
-	redef_id POP_EQUS string {
+	redef_id POP_EQUS {
+		lexer_StartEqusValue($1);
+	} string {
 		$$ = std::move($1);
-		sym_RedefString($$, std::make_shared<std::string>($3));
+		if (std::shared_ptr<std::string> prefix = lexer_TakeElidedEqusPrefix(); prefix)
+			sym_AppendString($$, std::move(prefix), $4);
+		else
+			sym_RedefString($$, std::make_shared<std::string>(std::move($4)));
 	}
 ;
 
@@ -1126,6 +1182,8 @@ print: POP_PRINT print_exprs trailing_comma;
 
 println:
 	POP_PRINTLN {
+		inccache_Poison();
+		objcache_Poison();
 		putchar('\n');
 		fflush(stdout);
 	}
@@ -1142,9 +1200,13 @@ print_exprs:
 
 print_expr:
 	const_no_str {
+		inccache_Poison();
+		objcache_Poison();
 		printf("$%" PRIX32, $1);
 	}
 	| string {
+		inccache_Poison();
+		objcache_Poison();
 		// Allow printing NUL characters
 		fwrite($1.data(), 1, $1.length(), stdout);
 	}
@@ -1170,8 +1232,7 @@ constlist_8bit_entry:
 		sect_RelByte($1, 0);
 	}
 	| string {
-		std::vector<uint8_t> output = charmap_Convert($1);
-		sect_AbsByteString(output);
+		sect_AbsByteString(charmap_Convert($1));
 	}
 ;
 
@@ -1185,8 +1246,7 @@ constlist_16bit_entry:
 		sect_RelWord($1, 0);
 	}
 	| string {
-		std::vector<uint8_t> output = charmap_Convert($1);
-		sect_AbsWordString(output);
+		sect_AbsWordString(charmap_Convert($1));
 	}
 ;
 
@@ -1200,8 +1260,7 @@ constlist_32bit_entry:
 		sect_RelLong($1, 0);
 	}
 	| string {
-		std::vector<uint8_t> output = charmap_Convert($1);
-		sect_AbsLongString(output);
+		sect_AbsLongString(charmap_Convert($1));
 	}
 ;
 
@@ -1250,8 +1309,7 @@ relocexpr:
 		$$ = std::move($1);
 	}
 	| string {
-		std::vector<uint8_t> output = charmap_Convert($1);
-		$$.makeNumber(str2int2(output));
+		$$.makeNumber(str2int2(charmap_Convert($1)));
 	}
 ;
 
@@ -1346,6 +1404,8 @@ relocexpr_no_str:
 		$$.makeLow();
 	}
 	| OP_ISCONST LPAREN relocexpr RPAREN {
+		if (!$3.isKnown() && $3.isPerEntry)
+			::error("ISCONST cannot check a table's variable or PC, which vary with each entry\n");
 		$$.makeNumber($3.isKnown());
 	}
 	| OP_BANK LPAREN scoped_anon_id RPAREN {
@@ -1370,53 +1430,55 @@ relocexpr_no_str:
 	| OP_DEF {
 		lexer_ToggleStringExpansion(false);
 	} LPAREN scoped_anon_id RPAREN {
+		if (rpn_IsTableVariable($4))
+			::error("DEF cannot check a table's variable, which is only defined for each entry\n");
 		$$.makeNumber(sym_FindScopedValidSymbol($4) != nullptr);
 		lexer_ToggleStringExpansion(true);
 	}
-	| OP_ROUND LPAREN const opt_q_arg RPAREN {
-		$$.makeNumber(fix_Round($3, $4));
+	| OP_ROUND LPAREN relocexpr opt_q_arg RPAREN {
+		$$.makeFixedPointOp(FIX_ROUND, std::move($3), $4);
 	}
-	| OP_CEIL LPAREN const opt_q_arg RPAREN {
-		$$.makeNumber(fix_Ceil($3, $4));
+	| OP_CEIL LPAREN relocexpr opt_q_arg RPAREN {
+		$$.makeFixedPointOp(FIX_CEIL, std::move($3), $4);
 	}
-	| OP_FLOOR LPAREN const opt_q_arg RPAREN {
-		$$.makeNumber(fix_Floor($3, $4));
+	| OP_FLOOR LPAREN relocexpr opt_q_arg RPAREN {
+		$$.makeFixedPointOp(FIX_FLOOR, std::move($3), $4);
 	}
-	| OP_FDIV LPAREN const COMMA const opt_q_arg RPAREN {
-		$$.makeNumber(fix_Div($3, $5, $6));
+	| OP_FDIV LPAREN relocexpr COMMA relocexpr opt_q_arg RPAREN {
+		$$.makeFixedPointOp(FIX_DIV, std::move($3), $5, $6);
 	}
-	| OP_FMUL LPAREN const COMMA const opt_q_arg RPAREN {
-		$$.makeNumber(fix_Mul($3, $5, $6));
+	| OP_FMUL LPAREN relocexpr COMMA relocexpr opt_q_arg RPAREN {
+		$$.makeFixedPointOp(FIX_MUL, std::move($3), $5, $6);
 	}
-	| OP_FMOD LPAREN const COMMA const opt_q_arg RPAREN {
-		$$.makeNumber(fix_Mod($3, $5, $6));
+	| OP_FMOD LPAREN relocexpr COMMA relocexpr opt_q_arg RPAREN {
+		$$.makeFixedPointOp(FIX_MOD, std::move($3), $5, $6);
 	}
-	| OP_POW LPAREN const COMMA const opt_q_arg RPAREN {
-		$$.makeNumber(fix_Pow($3, $5, $6));
+	| OP_POW LPAREN relocexpr COMMA relocexpr opt_q_arg RPAREN {
+		$$.makeFixedPointOp(FIX_POW, std::move($3), $5, $6);
 	}
-	| OP_LOG LPAREN const COMMA const opt_q_arg RPAREN {
-		$$.makeNumber(fix_Log($3, $5, $6));
+	| OP_LOG LPAREN relocexpr COMMA relocexpr opt_q_arg RPAREN {
+		$$.makeFixedPointOp(FIX_LOG, std::move($3), $5, $6);
 	}
-	| OP_SIN LPAREN const opt_q_arg RPAREN {
-		$$.makeNumber(fix_Sin($3, $4));
+	| OP_SIN LPAREN relocexpr opt_q_arg RPAREN {
+		$$.makeFixedPointOp(FIX_SIN, std::move($3), $4);
 	}
-	| OP_COS LPAREN const opt_q_arg RPAREN {
-		$$.makeNumber(fix_Cos($3, $4));
+	| OP_COS LPAREN relocexpr opt_q_arg RPAREN {
+		$$.makeFixedPointOp(FIX_COS, std::move($3), $4);
 	}
-	| OP_TAN LPAREN const opt_q_arg RPAREN {
-		$$.makeNumber(fix_Tan($3, $4));
+	| OP_TAN LPAREN relocexpr opt_q_arg RPAREN {
+		$$.makeFixedPointOp(FIX_TAN, std::move($3), $4);
 	}
-	| OP_ASIN LPAREN const opt_q_arg RPAREN {
-		$$.makeNumber(fix_ASin($3, $4));
+	| OP_ASIN LPAREN relocexpr opt_q_arg RPAREN {
+		$$.makeFixedPointOp(FIX_ASIN, std::move($3), $4);
 	}
-	| OP_ACOS LPAREN const opt_q_arg RPAREN {
-		$$.makeNumber(fix_ACos($3, $4));
+	| OP_ACOS LPAREN relocexpr opt_q_arg RPAREN {
+		$$.makeFixedPointOp(FIX_ACOS, std::move($3), $4);
 	}
-	| OP_ATAN LPAREN const opt_q_arg RPAREN {
-		$$.makeNumber(fix_ATan($3, $4));
+	| OP_ATAN LPAREN relocexpr opt_q_arg RPAREN {
+		$$.makeFixedPointOp(FIX_ATAN, std::move($3), $4);
 	}
-	| OP_ATAN2 LPAREN const COMMA const opt_q_arg RPAREN {
-		$$.makeNumber(fix_ATan2($3, $5, $6));
+	| OP_ATAN2 LPAREN relocexpr COMMA relocexpr opt_q_arg RPAREN {
+		$$.makeFixedPointOp(FIX_ATAN2, std::move($3), $5, $6);
 	}
 	| OP_STRCMP LPAREN string COMMA string RPAREN {
 		$$.makeNumber($3.compare($5));
@@ -1435,7 +1497,7 @@ relocexpr_no_str:
 		$$.makeNumber(strlenUTF8($3));
 	}
 	| OP_CHARLEN LPAREN string RPAREN {
-		$$.makeNumber(charlenUTF8($3));
+		$$.makeNumber(charmap_CharLen($3));
 	}
 	| OP_INCHARMAP LPAREN string RPAREN {
 		$$.makeNumber(charmap_HasChar($3));
@@ -1501,7 +1563,7 @@ string:
 		$$ = strsubUTF8($3, pos, pos > len ? 0 : len + 1 - pos);
 	}
 	| OP_CHARSUB LPAREN string COMMA const RPAREN {
-		size_t len = charlenUTF8($3);
+		size_t len = charmap_CharLen($3);
 		uint32_t pos = adjustNegativePos($5, len, "CHARSUB");
 
 		$$ = charsubUTF8($3, pos);
@@ -1756,11 +1818,11 @@ z80_bit:
 z80_call:
 	Z80_CALL reloc_16bit {
 		sect_AbsByte(0xCD);
-		sect_RelWord($2, 1);
+		sect_JumpTarget($2);
 	}
 	| Z80_CALL ccode_expr COMMA reloc_16bit {
 		sect_AbsByte(0xC4 | ($2 << 3));
-		sect_RelWord($4, 1);
+		sect_JumpTarget($4);
 	}
 ;
 
@@ -1831,11 +1893,11 @@ z80_inc:
 z80_jp:
 	Z80_JP reloc_16bit {
 		sect_AbsByte(0xC3);
-		sect_RelWord($2, 1);
+		sect_JumpTarget($2);
 	}
 	| Z80_JP ccode_expr COMMA reloc_16bit {
 		sect_AbsByte(0xC2 | ($2 << 3));
-		sect_RelWord($4, 1);
+		sect_JumpTarget($4);
 	}
 	| Z80_JP MODE_HL {
 		sect_AbsByte(0xE9);
@@ -2405,10 +2467,20 @@ static void errorInvalidUTF8Byte(uint8_t byte, char const *functionName) {
 
 static size_t strlenUTF8(std::string const &str) {
 	char const *ptr = str.c_str();
+	char const *end = ptr + str.length();
 	size_t len = 0;
 	uint32_t state = 0;
 
 	for (uint32_t codep = 0; *ptr; ptr++) {
+		// Count runs of ASCII characters all at once
+		if (state == 0) {
+			size_t runLen = countASCIIPrefix(ptr, end - ptr);
+			len += runLen;
+			ptr += runLen;
+			if (!*ptr)
+				break;
+		}
+
 		uint8_t byte = *ptr;
 
 		switch (decode(&state, &codep, byte)) {
@@ -2431,6 +2503,7 @@ static size_t strlenUTF8(std::string const &str) {
 
 static std::string strsubUTF8(std::string const &str, uint32_t pos, uint32_t len) {
 	char const *ptr = str.c_str();
+	size_t end = str.length();
 	size_t index = 0;
 	uint32_t state = 0;
 	uint32_t codep = 0;
@@ -2438,6 +2511,16 @@ static std::string strsubUTF8(std::string const &str, uint32_t pos, uint32_t len
 
 	// Advance to starting position in source string.
 	while (ptr[index] && curPos < pos) {
+		// Skip runs of ASCII characters all at once
+		if (state == 0) {
+			size_t runLen =
+			    countASCIIPrefix(&ptr[index], std::min<size_t>(pos - curPos, end - index));
+			index += runLen;
+			curPos += runLen;
+			if (!ptr[index] || curPos == pos)
+				break;
+		}
+
 		switch (decode(&state, &codep, ptr[index])) {
 		case 1:
 			errorInvalidUTF8Byte(ptr[index], "STRSUB");
@@ -2462,6 +2545,15 @@ static std::string strsubUTF8(std::string const &str, uint32_t pos, uint32_t len
 
 	// Compute the result length in bytes.
 	while (ptr[index] && curLen < len) {
+		if (state == 0) {
+			size_t runLen =
+			    countASCIIPrefix(&ptr[index], std::min<size_t>(len - curLen, end - index));
+			index += runLen;
+			curLen += runLen;
+			if (!ptr[index] || curLen == len)
+				break;
+		}
+
 		switch (decode(&state, &codep, ptr[index])) {
 		case 1:
 			errorInvalidUTF8Byte(ptr[index], "STRSUB");
@@ -2484,16 +2576,6 @@ static std::string strsubUTF8(std::string const &str, uint32_t pos, uint32_t len
 	return std::string(ptr + startIndex, ptr + index);
 }
 
-static size_t charlenUTF8(std::string const &str) {
-	std::string_view view = str;
-	size_t len;
-
-	for (len = 0; charmap_ConvertNext(view, nullptr); len++)
-		;
-
-	return len;
-}
-
 static std::string charsubUTF8(std::string const &str, uint32_t pos) {
 	std::string_view view = str;
 	size_t charLen = 1;
@@ -0,0 +1,366 @@
+/* SPDX-License-Identifier: MIT */
+
+#include "asm/pch.hpp"
+#include <sys/stat.h>
+
+#include <memory>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "error.hpp"
+#include "helpers.hpp"
+#include "linkdefs.hpp"
+#include "version.hpp"
+
+#include "asm/charmap.hpp"
+#include "asm/fstack.hpp"
+#include "asm/main.hpp"
+#include "asm/section.hpp"
+#include "asm/symbol.hpp"
+
+static char const pchMagic[] = "RGBPCH";
+
+struct PchCharmap {
+	std::string name;
+	std::vector<std::pair<std::string, uint8_t>> mappings;
+};
+
+static std::unordered_map<FileStackNode const *, uint32_t> nodeIDs;
+static std::vector<FileStackNode const *> pchNodes; // Parents come before their children
+static std::vector<Symbol const *> pchSymbols;
+static std::vector<PchCharmap> pchCharmaps;
+
+static void putlong(uint32_t n, FILE *file) {
+	uint8_t bytes[] = {
+	    (uint8_t)n,
+	    (uint8_t)(n >> 8),
+	    (uint8_t)(n >> 16),
+	    (uint8_t)(n >> 24),
+	};
+	fwrite(bytes, 1, sizeof(bytes), file);
+}
+
+// Unlike in object files, strings are length-prefixed, since EQUS and macros may contain NULs
+static void putstring(std::string_view s, FILE *file) {
+	putlong(s.length(), file);
+	fwrite(s.data(), 1, s.length(), file);
+}
+
+static uint32_t registerNode(FileStackNode const *node) {
+	if (!node)
+		return (uint32_t)-1;
+	if (auto search = nodeIDs.find(node); search != nodeIDs.end())
+		return search->second;
+
+	registerNode(node->parent.get());
+	uint32_t id = pchNodes.size();
+	nodeIDs[node] = id;
+	pchNodes.push_back(node);
+	return id;
+}
+
+static void registerSymbol(Symbol &sym) {
+	// Skip any built-in symbol (except for the RS counter, which headers commonly set),
+	// and the ones defined on the command line, which are not part of the header
+	if (!sym.src || (sym.isBuiltin && sym.name != "_RS"))
+		return;
+
+	if (!sym.isDefined())
+		errx(
+		    "Cannot precompile a header that references undefined symbol \"%s\"", sym.name.c_str()
+		);
+	assume(!sym.isLabel()); // Labels require sections, which were rejected earlier
+
+	registerNode(sym.src.get());
+	pchSymbols.push_back(&sym);
+}
+
+static void registerCharmap(std::string const &name) {
+	pchCharmaps.push_back({.name = name, .mappings = {}});
+}
+
+static void registerMapping(std::string const &mapping, uint8_t value) {
+	pchCharmaps.back().mappings.emplace_back(mapping, value);
+}
+
+static void writeNode(FileStackNode const &node, FILE *file) {
+	putc(node.type, file);
+	putlong(node.parent ? nodeIDs[node.parent.get()] : (uint32_t)-1, file);
+	putlong(node.lineNo, file);
+	if (node.type == NODE_REPT) {
+		std::vector<uint32_t> const &nodeIters = node.iters();
+
+		putlong(nodeIters.size(), file);
+		for (uint32_t iter : nodeIters)
+			putlong(iter, file);
+	} else {
+		putstring(node.name(), file);
+	}
+}
+
+static void writeSymbol(Symbol const &sym, FILE *file) {
+	putstring(sym.name, file);
+	putc(sym.type, file);
+	putc(sym.isExported, file);
+	putlong(nodeIDs[sym.src.get()], file);
+	putlong(sym.fileLine, file);
+	switch (sym.type) {
+	case SYM_EQU:
+	case SYM_VAR:
+		putlong(sym.getOutputValue(), file);
+		break;
+	case SYM_EQUS:
+		putstring(*sym.getEqus(), file);
+		break;
+	case SYM_MACRO: {
+		ContentSpan const &span = sym.getMacro();
+		putstring(std::string_view(span.ptr.get(), span.size), file);
+		break;
+	}
+	case SYM_LABEL:
+	case SYM_REF:
+		unreachable_();
+	}
+}
+
+void pch_Write(std::string const &path) {
+	if (!sectionList.empty())
+		errx("Cannot precompile a header that defines sections");
+
+	sym_ForEach(registerSymbol);
+	charmap_ForEach(registerCharmap, registerMapping);
+
+	FILE *file = fopen(path.c_str(), "wb");
+	if (!file)
+		err("Failed to open precompiled header '%s'", path.c_str());
+	Defer closeFile{[&] { fclose(file); }};
+
+	fwrite(pchMagic, 1, QUOTEDSTRLEN(pchMagic), file);
+	// Symbols' semantics may change between versions, so only the exact same one may read this
+	putstring(get_package_version_string(), file);
+
+	putlong(pchNodes.size(), file);
+	for (FileStackNode const *node : pchNodes)
+		writeNode(*node, file);
+
+	putlong(pchSymbols.size(), file);
+	for (Symbol const *sym : pchSymbols)
+		writeSymbol(*sym, file);
+
+	putlong(pchCharmaps.size(), file);
+	for (PchCharmap const &charmap : pchCharmaps) {
+		putstring(charmap.name, file);
+		putlong(charmap.mappings.size(), file);
+		for (auto const &[mapping, value] : charmap.mappings) {
+			putstring(mapping, file);
+			putc(value, file);
+		}
+	}
+	putstring(charmap_GetCurrentName(), file);
+
+	if (ferror(file))
+		err("Failed to write precompiled header '%s'", path.c_str());
+}
+
+// The whole file is read at once, so that macro bodies can point into it instead of being copied
+struct PchReader {
+	std::string const &path;
+	std::shared_ptr<char[]> image;
+	size_t size;
+	size_t offset = 0;
+
+	void checkSize(size_t length) {
+		if (length > size - offset)
+			errx("Precompiled header '%s' is truncated", path.c_str());
+	}
+
+	uint8_t getByte() {
+		checkSize(1);
+		return image[offset++];
+	}
+
+	uint32_t getLong() {
+		uint32_t value = getByte();
+		value |= getByte() << 8;
+		value |= getByte() << 16;
+		value |= (uint32_t)getByte() << 24;
+		return value;
+	}
+
+	// Returns a view into the image, valid for as long as `image` is
+	std::string_view getString() {
+		size_t length = getLong();
+		checkSize(length);
+		std::string_view str(&image[offset], length);
+		offset += length;
+		return str;
+	}
+};
+
+static void readNodes(PchReader &reader, std::vector<std::shared_ptr<FileStackNode>> &nodes) {
+	for (uint32_t nbNodes = reader.getLong(); nbNodes--;) {
+		FileStackNodeType type = (FileStackNodeType)reader.getByte();
+		uint32_t parentID = reader.getLong();
+		uint32_t lineNo = reader.getLong();
+		std::shared_ptr<FileStackNode> node;
+
+		if (type == NODE_REPT) {
+			std::vector<uint32_t> nodeIters(reader.getLong());
+			for (uint32_t &iter : nodeIters)
+				iter = reader.getLong();
+			node = std::make_shared<FileStackNode>(type, nodeIters);
+		} else if (type == NODE_FILE || type == NODE_MACRO) {
+			node = std::make_shared<FileStackNode>(type, std::string(reader.getString()));
+		} else {
+			errx("Precompiled header '%s' is corrupted (bad node type)", reader.path.c_str());
+		}
+
+		if (parentID != (uint32_t)-1 && parentID >= nodes.size())
+			errx("Precompiled header '%s' is corrupted (bad parent node)", reader.path.c_str());
+		node->lineNo = lineNo;
+		node->parent = parentID != (uint32_t)-1 ? nodes[parentID] : nullptr;
+		nodes.push_back(node);
+	}
+}
+
+static void readSymbols(PchReader &reader, std::vector<std::shared_ptr<FileStackNode>> &nodes) {
+	for (uint32_t nbSymbols = reader.getLong(); nbSymbols--;) {
+		std::string name(reader.getString());
+		SymbolType type = (SymbolType)reader.getByte();
+		bool isExported = reader.getByte();
+		uint32_t nodeID = reader.getLong();
+		uint32_t fileLine = reader.getLong();
+		Symbol *sym;
+
+		if (nodeID >= nodes.size())
+			errx("Precompiled header '%s' is corrupted (bad symbol node)", reader.path.c_str());
+
+		switch (type) {
+		case SYM_EQU:
+			sym = sym_AddEqu(name, reader.getLong());
+			break;
+		case SYM_VAR:
+			if (name == "_RS") {
+				sym_SetRSValue(reader.getLong());
+				sym = sym_FindExactSymbol(name);
+			} else {
+				sym = sym_AddVar(name, reader.getLong());
+			}
+			break;
+		case SYM_EQUS:
+			sym = sym_AddString(name, std::make_shared<std::string>(reader.getString()));
+			break;
+		case SYM_MACRO: {
+			std::string_view body = reader.getString();
+			// Alias the image, so that it stays alive for as long as the macro needs it
+			std::shared_ptr<char[]> ptr(
+			    reader.image, &reader.image[body.data() - reader.image.get()]
+			);
+			sym = sym_AddMacro(name, fileLine, {.ptr = ptr, .size = body.size()});
+			break;
+		}
+		default:
+			errx("Precompiled header '%s' is corrupted (bad symbol type)", reader.path.c_str());
+		}
+
+		// If the symbol conflicted with an existing one, an error has already been reported
+		if (sym) {
+			sym->src = nodes[nodeID];
+			sym->fileLine = fileLine;
+			sym->isExported = isExported;
+		}
+	}
+}
+
+static void readCharmaps(PchReader &reader) {
+	for (uint32_t nbCharmaps = reader.getLong(); nbCharmaps--;) {
+		std::string name(reader.getString());
+
+		if (name == DEFAULT_CHARMAP_NAME)
+			charmap_Set(name);
+		else
+			charmap_New(name, nullptr);
+
+		for (uint32_t nbMappings = reader.getLong(); nbMappings--;) {
+			std::string mapping(reader.getString());
+			charmap_Add(mapping, reader.getByte());
+		}
+	}
+	charmap_Set(std::string(reader.getString()));
+}
+
+static std::shared_ptr<std::vector<char>> readImage(std::string const &path) {
+	FILE *file = fopen(path.c_str(), "rb");
+	if (!file)
+		err("Failed to open precompiled header '%s'", path.c_str());
+	Defer closeFile{[&] { fclose(file); }};
+
+	if (verbose)
+		printf("Reading precompiled header %s\n", path.c_str());
+
+	auto data = std::make_shared<std::vector<char>>();
+	char buf[BUFSIZ];
+	for (size_t nbRead; (nbRead = fread(buf, 1, sizeof(buf), file)) != 0;)
+		data->insert(data->end(), buf, buf + nbRead);
+	if (ferror(file))
+		err("Failed to read precompiled header '%s'", path.c_str());
+	return data;
+}
+
+// The image read by `pch_Preload`, and what its file was like before that
+static std::shared_ptr<std::vector<char>> preloadedData;
+static struct stat preloadedStat;
+
+void pch_Preload(std::string const &path) {
+	// The header may not have been generated yet; then, reading it is left to each assembly
+	if (stat(path.c_str(), &preloadedStat) == 0)
+		preloadedData = readImage(path);
+}
+
+static bool isPreloaded(std::string const &path) {
+	struct stat statBuf;
+
+	// The file is identified regardless of its path, which may be relative to another directory
+	return preloadedData && stat(path.c_str(), &statBuf) == 0
+	       && statBuf.st_dev == preloadedStat.st_dev && statBuf.st_ino == preloadedStat.st_ino
+	       && statBuf.st_size == preloadedStat.st_size
+	       && statBuf.st_mtime == preloadedStat.st_mtime;
+}
+
+void pch_Read(std::string const &path, std::shared_ptr<FileStackNode> const &parent) {
+	std::shared_ptr<std::vector<char>> data = isPreloaded(path) ? preloadedData : readImage(path);
+	PchReader reader{
+	    .path = path, .image = std::shared_ptr<char[]>(data, data->data()), .size = data->size()
+	};
+
+	reader.checkSize(QUOTEDSTRLEN(pchMagic));
+	if (memcmp(&reader.image[0], pchMagic, QUOTEDSTRLEN(pchMagic)))
+		errx("'%s' is not a precompiled header", path.c_str());
+	reader.offset += QUOTEDSTRLEN(pchMagic);
+	if (std::string_view version = reader.getString(); version != get_package_version_string())
+		errx(
+		    "Precompiled header '%s' was made by a different version (%.*s)",
+		    path.c_str(),
+		    (int)version.length(),
+		    version.data()
+		);
+
+	std::vector<std::shared_ptr<FileStackNode>> nodes;
+	readNodes(reader, nodes);
+	// The header's root node is attached to the current one, as if it had been pre-included
+	for (std::shared_ptr<FileStackNode> &node : nodes) {
+		if (!node->parent)
+			node->parent = parent;
+	}
+
+	readSymbols(reader, nodes);
+	readCharmaps(reader);
+
+	if (reader.offset != reader.size)
+		errx("Precompiled header '%s' is corrupted (trailing data)", path.c_str());
+}
@@ -0,0 +1,151 @@
+/* SPDX-License-Identifier: MIT */
+
+#include "asm/profile.hpp"
+
+#include <chrono>
+#include <deque>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <unordered_map>
+#include <vector>
+
+#include "error.hpp"
+#include "helpers.hpp"
+#include "trace.hpp"
+
+#include "asm/lexer.hpp"
+#include "asm/section.hpp"
+
+using Clock = std::chrono::steady_clock;
+
+struct ProfileNode {
+	std::string name;
+	uint64_t nbCalls = 0;
+	Clock::duration time{}; // All the following are inclusive of the children's
+	uint64_t nbTokens = 0;
+	uint64_t nbBytes = 0;
+	std::vector<size_t> children; // Indices into `nodes`, in order of first entry
+	std::unordered_map<std::string, size_t> childIndices;
+};
+
+// A frame is an active invocation of a node
+struct ProfileFrame {
+	size_t nodeIdx;
+	Clock::time_point startTime;
+	uint64_t startTokens;
+	uint64_t startBytes;
+};
+
+static std::string profileFileName;
+static std::deque<ProfileNode> nodes; // The first one is the root, i.e. the main file
+static std::vector<ProfileFrame> frames;
+static size_t nbOpenContexts = 0; // Contexts are traced even without a profile
+
+void prof_SetFileName(std::string const &path) {
+	profileFileName = path;
+}
+
+void prof_Enter(std::string const &name) {
+	trace_Begin(name);
+	nbOpenContexts++;
+
+	if (profileFileName.empty())
+		return;
+
+	size_t nodeIdx = 0;
+	if (nodes.empty()) {
+		nodes.emplace_back().name = name;
+	} else {
+		assume(!frames.empty()); // Only the main file can be entered at top level
+		size_t parentIdx = frames.back().nodeIdx;
+		auto [search, isNew] = nodes[parentIdx].childIndices.emplace(name, nodes.size());
+		nodeIdx = search->second;
+		if (isNew) {
+			nodes.emplace_back().name = name;
+			nodes[parentIdx].children.push_back(nodeIdx);
+		}
+	}
+	nodes[nodeIdx].nbCalls++;
+
+	frames.push_back({
+	    .nodeIdx = nodeIdx,
+	    .startTime = Clock::now(),
+	    .startTokens = lexer_GetNbTokens(),
+	    .startBytes = sect_GetNbEmittedBytes(),
+	});
+}
+
+void prof_Exit() {
+	trace_End();
+	nbOpenContexts--;
+
+	if (profileFileName.empty())
+		return;
+
+	assume(!frames.empty());
+	ProfileFrame const &frame = frames.back();
+	ProfileNode &node = nodes[frame.nodeIdx];
+
+	node.time += Clock::now() - frame.startTime;
+	node.nbTokens += lexer_GetNbTokens() - frame.startTokens;
+	node.nbBytes += sect_GetNbEmittedBytes() - frame.startBytes;
+	frames.pop_back();
+}
+
+static void putJSONString(std::string const &str, FILE *file) {
+	putc('"', file);
+	for (char c : str) {
+		if (c == '"' || c == '\\')
+			fprintf(file, "\\%c", c);
+		else if ((uint8_t)c < ' ')
+			fprintf(file, "\\u%04x", c);
+		else
+			putc(c, file);
+	}
+	putc('"', file);
+}
+
+static void writeNode(ProfileNode const &node, size_t depth, FILE *file) {
+	auto microseconds = std::chrono::duration_cast<std::chrono::microseconds>(node.time);
+
+	fprintf(file, "%*s{\"name\": ", (int)depth * 2, "");
+	putJSONString(node.name, file);
+	fprintf(
+	    file,
+	    ", \"value\": %" PRIu64 ", \"calls\": %" PRIu64 ", \"tokens\": %" PRIu64
+	    ", \"bytes\": %" PRIu64 ", \"children\": [",
+	    (uint64_t)microseconds.count(),
+	    node.nbCalls,
+	    node.nbTokens,
+	    node.nbBytes
+	);
+	for (size_t i = 0; i < node.children.size(); i++) {
+		fputs(i == 0 ? "\n" : ",\n", file);
+		writeNode(nodes[node.children[i]], depth + 1, file);
+	}
+	if (!node.children.empty())
+		fprintf(file, "\n%*s", (int)depth * 2, "");
+	fputs("]}", file);
+}
+
+void prof_Write() {
+	// Close the contexts still open, at least the main file's
+	while (nbOpenContexts != 0)
+		prof_Exit();
+
+	if (profileFileName.empty())
+		return;
+
+	FILE *file = fopen(profileFileName.c_str(), "w");
+	if (!file)
+		err("Failed to open profile file '%s'", profileFileName.c_str());
+	Defer closeFile{[&] { fclose(file); }};
+
+	if (!nodes.empty())
+		writeNode(nodes[0], 0, file);
+	putc('\n', file);
+
+	if (ferror(file))
+		err("Failed to write profile file '%s'", profileFileName.c_str());
+}
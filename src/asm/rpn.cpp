@@ -12,6 +12,7 @@
 #include "helpers.hpp" // assume
 #include "opmath.hpp"
 
+#include "asm/fixpoint.hpp"
 #include "asm/output.hpp"
 #include "asm/section.hpp"
 #include "asm/symbol.hpp"
@@ -19,6 +20,22 @@
 
 using namespace std::literals;
 
+static bool isParsingTableBody = false;
+static std::string tableVarName;
+
+void rpn_StartTableBody(std::string const &varName) {
+	isParsingTableBody = true;
+	tableVarName = varName;
+}
+
+void rpn_EndTableBody() {
+	isParsingTableBody = false;
+}
+
+bool rpn_IsTableVariable(std::string const &symName) {
+	return isParsingTableBody && symName == tableVarName;
+}
+
 int32_t Expression::value() const {
 	assume(std::holds_alternative<int32_t>(data));
 	return std::get<int32_t>(data);
@@ -29,6 +46,8 @@ void Expression::clear() {
 	isSymbol = false;
 	rpn.clear();
 	rpnPatchSize = 0;
+	hasSymbolNames = false;
+	isPerEntry = false;
 }
 
 uint8_t *Expression::reserveSpace(uint32_t size) {
@@ -75,22 +94,28 @@ void Expression::makeNumber(uint32_t value) {
 
 void Expression::makeSymbol(std::string const &symName) {
 	clear();
-	if (Symbol *sym = sym_FindScopedSymbol(symName); sym_IsPC(sym) && !sect_GetSymbolSection()) {
+	Symbol *sym = sym_FindScopedSymbol(symName);
+	// A table's variable and PC are given their value for each entry
+	bool isTableSymbol = isParsingTableBody && (symName == tableVarName || sym_IsPC(sym));
+
+	if (sym_IsPC(sym) && !sect_GetSymbolSection()) {
 		error("PC has no value outside a section\n");
 		data = 0;
-	} else if (!sym || !sym->isConstant()) {
-		isSymbol = true;
+	} else if (isTableSymbol || !sym || !sym->isConstant()) {
+		isSymbol = !isTableSymbol;
+		isPerEntry = isTableSymbol;
 
 		data = sym_IsPC(sym) ? "PC is not constant at assembly time"
 		                     : "'"s + symName + "' is not constant at assembly time";
-		sym = sym_Ref(symName);
+		std::string const &name = isTableSymbol ? symName : sym_Ref(symName)->name;
 
-		size_t nameLen = sym->name.length() + 1; // Don't forget NUL!
+		size_t nameLen = name.length() + 1; // Don't forget NUL!
 
 		// 1-byte opcode + 4-byte symbol ID
 		uint8_t *ptr = reserveSpace(nameLen + 1, 5);
+		hasSymbolNames = true;
 		*ptr++ = RPN_SYM;
-		memcpy(ptr, sym->name.c_str(), nameLen);
+		memcpy(ptr, name.c_str(), nameLen);
 	} else {
 		data = (int32_t)sym_GetConstantValue(symName);
 	}
@@ -128,6 +153,7 @@ void Expression::makeBankSymbol(std::string const &symName) {
 
 			// 1-byte opcode + 4-byte sect ID
 			uint8_t *ptr = reserveSpace(nameLen + 1, 5);
+			hasSymbolNames = true;
 			*ptr++ = RPN_BANK_SYM;
 			memcpy(ptr, sym->name.c_str(), nameLen);
 		}
@@ -440,54 +466,233 @@ void Expression::makeBinaryOp(RPNCommand op, Expression &&src1, Expression const
 		data = constVal;
 	} else {
 		// If it's not known, start computing the RPN expression
+		mergeRPN(std::move(src1), src2);
+		*reserveSpace(1, 1) = op;
+	}
+}
 
-		// Convert the left-hand expression if it's constant
-		if (src1.isKnown()) {
-			uint32_t lval = src1.value();
-			uint8_t bytes[] = {
-			    RPN_CONST,
-			    (uint8_t)lval,
-			    (uint8_t)(lval >> 8),
-			    (uint8_t)(lval >> 16),
-			    (uint8_t)(lval >> 24),
-			};
-			rpn.clear();
-			rpnPatchSize = 0;
-			memcpy(reserveSpace(sizeof(bytes)), bytes, sizeof(bytes));
-
-			// Use the other expression's un-const reason
-			data = std::move(src2.data);
-		} else {
-			// Otherwise just reuse its RPN buffer
-			rpnPatchSize = src1.rpnPatchSize;
-			std::swap(rpn, src1.rpn);
-			data = std::move(src1.data);
+// Makes this expression's RPN `src1`'s followed by `src2`'s, ready for an operator
+void Expression::mergeRPN(Expression &&src1, Expression const &src2) {
+	// Convert the left-hand expression if it's constant
+	if (src1.isKnown()) {
+		uint32_t lval = src1.value();
+		uint8_t bytes[] = {
+		    RPN_CONST,
+		    (uint8_t)lval,
+		    (uint8_t)(lval >> 8),
+		    (uint8_t)(lval >> 16),
+		    (uint8_t)(lval >> 24),
+		};
+		rpn.clear();
+		rpnPatchSize = 0;
+		memcpy(reserveSpace(sizeof(bytes)), bytes, sizeof(bytes));
+
+		// Use the other expression's un-const reason
+		data = std::move(src2.data);
+	} else {
+		// Otherwise just reuse its RPN buffer
+		rpnPatchSize = src1.rpnPatchSize;
+		hasSymbolNames = src1.hasSymbolNames;
+		isPerEntry = src1.isPerEntry;
+		std::swap(rpn, src1.rpn);
+		data = std::move(src1.data);
+	}
+
+	// Now, merge the right expression into the left one
+	if (src2.isKnown()) {
+		// If the right expression is constant, append a shim instead
+		uint32_t rval = src2.value();
+		uint8_t bytes[] = {
+		    RPN_CONST,
+		    (uint8_t)rval,
+		    (uint8_t)(rval >> 8),
+		    (uint8_t)(rval >> 16),
+		    (uint8_t)(rval >> 24),
+		};
+		memcpy(reserveSpace(sizeof(bytes), sizeof(bytes)), bytes, sizeof(bytes));
+	} else {
+		// Copy the right RPN
+		uint32_t rightRpnSize = src2.rpn.size();
+		uint8_t *ptr = reserveSpace(rightRpnSize, src2.rpnPatchSize);
+		hasSymbolNames |= src2.hasSymbolNames;
+		isPerEntry |= src2.isPerEntry;
+		if (rightRpnSize > 0)
+			// If `rightRpnSize == 0`, then `memcpy(ptr, nullptr, rightRpnSize)` would be UB
+			memcpy(ptr, src2.rpn.data(), rightRpnSize);
+	}
+}
+
+static int32_t computeFixedPoint(FixedPointFunc func, int32_t i, int32_t j, int32_t q) {
+	switch (func) {
+	case FIX_ROUND:
+		return fix_Round(i, q);
+	case FIX_CEIL:
+		return fix_Ceil(i, q);
+	case FIX_FLOOR:
+		return fix_Floor(i, q);
+	case FIX_DIV:
+		return fix_Div(i, j, q);
+	case FIX_MUL:
+		return fix_Mul(i, j, q);
+	case FIX_MOD:
+		return fix_Mod(i, j, q);
+	case FIX_POW:
+		return fix_Pow(i, j, q);
+	case FIX_LOG:
+		return fix_Log(i, j, q);
+	case FIX_SIN:
+		return fix_Sin(i, q);
+	case FIX_COS:
+		return fix_Cos(i, q);
+	case FIX_TAN:
+		return fix_Tan(i, q);
+	case FIX_ASIN:
+		return fix_ASin(i, q);
+	case FIX_ACOS:
+		return fix_ACos(i, q);
+	case FIX_ATAN:
+		return fix_ATan(i, q);
+	case FIX_ATAN2:
+		return fix_ATan2(i, j, q);
+	}
+	unreachable_(); // LCOV_EXCL_LINE
+}
+
+static bool isBinaryFixedPoint(FixedPointFunc func) {
+	return func == FIX_DIV || func == FIX_MUL || func == FIX_MOD || func == FIX_POW
+	       || func == FIX_LOG || func == FIX_ATAN2;
+}
+
+void Expression::makeFixedPointOp(FixedPointFunc func, Expression &&src, int32_t q) {
+	assume(!isBinaryFixedPoint(func));
+	if (src.isKnown() || !isParsingTableBody) {
+		// Outside of a table, fixed-point functions only take constants
+		makeNumber(computeFixedPoint(func, src.getConstVal(), 0, q));
+		return;
+	}
+
+	*this = std::move(src);
+	isSymbol = false;
+	uint8_t *ptr = reserveSpace(3);
+	*ptr++ = RPN_FIXED_POINT;
+	*ptr++ = func;
+	*ptr = q;
+}
+
+void Expression::makeFixedPointOp(
+    FixedPointFunc func, Expression &&src1, Expression const &src2, int32_t q
+) {
+	assume(isBinaryFixedPoint(func));
+	if ((src1.isKnown() && src2.isKnown()) || !isParsingTableBody) {
+		int32_t i = src1.getConstVal();
+		int32_t j = src2.getConstVal();
+
+		makeNumber(computeFixedPoint(func, i, j, q));
+		return;
+	}
+
+	clear();
+	mergeRPN(std::move(src1), src2);
+	uint8_t *ptr = reserveSpace(3);
+	*ptr++ = RPN_FIXED_POINT;
+	*ptr++ = func;
+	*ptr = q;
+}
+
+void Expression::makeWithValue(Expression const &src, int32_t value) {
+	if (src.isKnown()) {
+		makeNumber(src.value());
+		return;
+	}
+
+	// Evaluating each command as it would have been parsed gives the same values and diagnostics
+	static std::vector<Expression> stack; // Kept between calls, which are made for every entry
+	std::vector<uint8_t> const &cmds = src.rpn;
+	auto readName = [&](size_t &i) {
+		std::string name(reinterpret_cast<char const *>(&cmds[i]));
+		i += name.length() + 1;
+		return name;
+	};
+
+	stack.clear();
+	for (size_t i = 0; i < cmds.size();) {
+		switch (uint8_t cmd = cmds[i++]; cmd) {
+		case RPN_CONST:
+			stack.emplace_back().makeNumber(
+			    cmds[i] | cmds[i + 1] << 8 | cmds[i + 2] << 16 | (uint32_t)cmds[i + 3] << 24
+			);
+			i += 4;
+			break;
+		case RPN_SYM:
+			if (std::string name = readName(i); name == tableVarName)
+				stack.emplace_back().makeNumber(value);
+			else
+				stack.emplace_back().makeSymbol(name);
+			break;
+		case RPN_BANK_SYM:
+			stack.emplace_back().makeBankSymbol(readName(i));
+			break;
+		case RPN_BANK_SECT:
+			stack.emplace_back().makeBankSection(readName(i));
+			break;
+		case RPN_BANK_SELF:
+			stack.emplace_back().makeBankSymbol("@");
+			break;
+		case RPN_SIZEOF_SECT:
+			stack.emplace_back().makeSizeOfSection(readName(i));
+			break;
+		case RPN_STARTOF_SECT:
+			stack.emplace_back().makeStartOfSection(readName(i));
+			break;
+		case RPN_SIZEOF_SECTTYPE:
+			stack.emplace_back().makeSizeOfSectionType((SectionType)cmds[i++]);
+			break;
+		case RPN_STARTOF_SECTTYPE:
+			stack.emplace_back().makeStartOfSectionType((SectionType)cmds[i++]);
+			break;
+		case RPN_HRAM:
+			stack.back().makeCheckHRAM();
+			break;
+		case RPN_RST:
+			stack.back().makeCheckRST();
+			break;
+		case RPN_NEG:
+			stack.back().makeNeg();
+			break;
+		case RPN_NOT:
+			stack.back().makeNot();
+			break;
+		case RPN_LOGNOT:
+			stack.back().makeLogicNot();
+			break;
+		case RPN_FIXED_POINT: {
+			FixedPointFunc func = (FixedPointFunc)cmds[i++];
+			int32_t q = cmds[i++];
+			Expression result;
+
+			if (isBinaryFixedPoint(func)) {
+				Expression rhs = std::move(stack.back());
+				stack.pop_back();
+				result.makeFixedPointOp(func, std::move(stack.back()), rhs, q);
+			} else {
+				result.makeFixedPointOp(func, std::move(stack.back()), q);
+			}
+			stack.back() = std::move(result);
+			break;
 		}
+		default: {
+			Expression rhs = std::move(stack.back());
+			stack.pop_back();
+			Expression result;
 
-		// Now, merge the right expression into the left one
-		if (src2.isKnown()) {
-			// If the right expression is constant, append a shim instead
-			uint32_t rval = src2.value();
-			uint8_t bytes[] = {
-			    RPN_CONST,
-			    (uint8_t)rval,
-			    (uint8_t)(rval >> 8),
-			    (uint8_t)(rval >> 16),
-			    (uint8_t)(rval >> 24),
-			};
-			uint8_t *ptr = reserveSpace(sizeof(bytes) + 1, sizeof(bytes) + 1);
-			memcpy(ptr, bytes, sizeof(bytes));
-			ptr[sizeof(bytes)] = op;
-		} else {
-			// Copy the right RPN and append the operator
-			uint32_t rightRpnSize = src2.rpn.size();
-			uint8_t *ptr = reserveSpace(rightRpnSize + 1, src2.rpnPatchSize + 1);
-			if (rightRpnSize > 0)
-				// If `rightRpnSize == 0`, then `memcpy(ptr, nullptr, rightRpnSize)` would be UB
-				memcpy(ptr, src2.rpn.data(), rightRpnSize);
-			ptr[rightRpnSize] = op;
+			result.makeBinaryOp((RPNCommand)cmd, std::move(stack.back()), rhs);
+			stack.back() = std::move(result);
+			break;
+		}
 		}
 	}
+	assume(stack.size() == 1);
+	*this = std::move(stack.back());
 }
 
 void Expression::makeCheckHRAM() {
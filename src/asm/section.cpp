@@ -10,10 +10,13 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unordered_map>
+#include <vector>
 
 #include "helpers.hpp"
 
 #include "asm/fstack.hpp"
+#include "asm/inccache.hpp"
 #include "asm/lexer.hpp"
 #include "asm/main.hpp"
 #include "asm/output.hpp"
@@ -110,6 +113,8 @@ int32_t loadOffset; // Offset into the LOAD section's parent (see sect_GetOutput
 }
 
 Section *sect_FindSectionByName(std::string const &name) {
+	inccache_Poison();
+
 	auto search = sectionMap.find(name);
 	return search != sectionMap.end() ? &sectionList[search->second] : nullptr;
 }
@@ -312,8 +317,8 @@ static Section *createSection(
 	sect.align = alignment;
 	sect.alignOfs = alignOffset;
 
-	// It is only needed to allocate memory for ROM sections.
-	if (sect_HasData(type))
+	// It is only needed to allocate memory for ROM sections, and only if they will be output.
+	if (sect_HasData(type) && !depsOnly)
 		sect.data.resize(sectionTypeInfo[type].size);
 
 	return &sect;
@@ -446,6 +451,8 @@ void sect_NewSection(
     SectionSpec const &attrs,
     SectionModifier mod
 ) {
+	inccache_Poison();
+
 	if (currentLoadSection)
 		fatalerror("Cannot change the section within a `LOAD` block\n");
 
@@ -470,6 +477,8 @@ void sect_SetLoadSection(
     SectionSpec const &attrs,
     SectionModifier mod
 ) {
+	inccache_Poison();
+
 	// Important info: currently, UNION and LOAD cannot interact, since UNION is prohibited in
 	// "code" sections, whereas LOAD is restricted to them.
 	// Therefore, any interactions are NOT TESTED, so lift either of those restrictions at
@@ -503,6 +512,8 @@ void sect_SetLoadSection(
 }
 
 void sect_EndLoadSection() {
+	inccache_Poison();
+
 	if (!currentLoadSection) {
 		error("Found `ENDL` outside of a `LOAD` block\n");
 		return;
@@ -582,7 +593,14 @@ void sect_AlignPC(uint8_t alignment, uint16_t offset) {
 	}
 }
 
+static uint64_t nbEmittedBytes = 0;
+
+uint64_t sect_GetNbEmittedBytes() {
+	return nbEmittedBytes;
+}
+
 static void growSection(uint32_t growth) {
+	nbEmittedBytes += growth;
 	curOffset += growth;
 	if (curOffset + loadOffset > currentSection->size)
 		currentSection->size = curOffset + loadOffset;
@@ -590,11 +608,41 @@ static void growSection(uint32_t growth) {
 		currentLoadSection->size = curOffset;
 }
 
+// With `--deps-only`, sections have no data to write to, but still grow, so that labels' values
+// (which conditionals may depend on) stay the same as in a full assembly
+
 static void writebyte(uint8_t byte) {
-	currentSection->data[sect_GetOutputOffset()] = byte;
+	if (!depsOnly)
+		currentSection->data[sect_GetOutputOffset()] = byte;
 	growSection(1);
 }
 
+// The following write whole runs of bytes at once, for which space must already have been reserved
+
+static void writeBytes(uint8_t const *data, size_t size) {
+	if (!depsOnly)
+		memcpy(currentSection->data.data() + sect_GetOutputOffset(), data, size);
+	growSection(size);
+}
+
+static void fillBytes(uint8_t byte, size_t size) {
+	if (!depsOnly)
+		memset(currentSection->data.data() + sect_GetOutputOffset(), byte, size);
+	growSection(size);
+}
+
+// Writes each byte as a little-endian value `width` bytes wide
+static void writeWidenedBytes(std::vector<uint8_t> const &s, size_t width) {
+	if (!depsOnly) {
+		uint8_t *dest = currentSection->data.data() + sect_GetOutputOffset();
+
+		memset(dest, 0, s.size() * width);
+		for (size_t i = 0; i < s.size(); i++)
+			dest[i * width] = s[i];
+	}
+	growSection(s.size() * width);
+}
+
 static void writeword(uint16_t b) {
 	writebyte(b & 0xFF);
 	writebyte(b >> 8);
@@ -607,8 +655,11 @@ static void writelong(uint32_t b) {
 	writebyte(b >> 24);
 }
 
-static void createPatch(PatchType type, Expression const &expr, uint32_t pcShift) {
-	out_CreatePatch(type, expr, sect_GetOutputOffset(), pcShift);
+static void createPatch(
+    PatchType type, Expression const &expr, uint32_t pcShift, bool isJumpTarget
+) {
+	if (!depsOnly) // Patches are only needed to output the object file
+		out_CreatePatch(type, expr, sect_GetOutputOffset(), pcShift, isJumpTarget);
 }
 
 void sect_StartUnion() {
@@ -677,8 +728,7 @@ void sect_AbsByteString(std::vector<uint8_t> const &s) {
 	if (!reserveSpace(s.size()))
 		return;
 
-	for (uint8_t v : s)
-		writebyte(v);
+	writeBytes(s.data(), s.size());
 }
 
 void sect_AbsWordString(std::vector<uint8_t> const &s) {
@@ -687,8 +737,7 @@ void sect_AbsWordString(std::vector<uint8_t> const &s) {
 	if (!reserveSpace(s.size() * 2))
 		return;
 
-	for (uint8_t v : s)
-		writeword(v);
+	writeWidenedBytes(s, 2);
 }
 
 void sect_AbsLongString(std::vector<uint8_t> const &s) {
@@ -697,8 +746,7 @@ void sect_AbsLongString(std::vector<uint8_t> const &s) {
 	if (!reserveSpace(s.size() * 4))
 		return;
 
-	for (uint8_t v : s)
-		writelong(v);
+	writeWidenedBytes(s, 4);
 }
 
 // Skip this many bytes
@@ -720,8 +768,7 @@ void sect_Skip(uint32_t skip, bool ds) {
 			                  : "DB"
 			);
 		// We know we're in a code SECTION
-		while (skip--)
-			writebyte(fillByte);
+		fillBytes(fillByte, skip);
 	}
 }
 
@@ -734,7 +781,7 @@ void sect_RelByte(Expression &expr, uint32_t pcShift) {
 		return;
 
 	if (!expr.isKnown()) {
-		createPatch(PATCHTYPE_BYTE, expr, pcShift);
+		createPatch(PATCHTYPE_BYTE, expr, pcShift, false);
 		writebyte(0);
 	} else {
 		writebyte(expr.value());
@@ -749,11 +796,16 @@ void sect_RelBytes(uint32_t n, std::vector<Expression> &exprs) {
 	if (!reserveSpace(n))
 		return;
 
+	if (exprs.size() == 1 && exprs[0].isKnown()) {
+		fillBytes(exprs[0].value(), n);
+		return;
+	}
+
 	for (uint32_t i = 0; i < n; i++) {
 		Expression &expr = exprs[i % exprs.size()];
 
 		if (!expr.isKnown()) {
-			createPatch(PATCHTYPE_BYTE, expr, i);
+			createPatch(PATCHTYPE_BYTE, expr, i, false);
 			writebyte(0);
 		} else {
 			writebyte(expr.value());
@@ -761,22 +813,32 @@ void sect_RelBytes(uint32_t n, std::vector<Expression> &exprs) {
 	}
 }
 
-// Output a relocatable word. Checking will be done to see if
-// it's an absolute value in disguise.
-void sect_RelWord(Expression &expr, uint32_t pcShift) {
+static void relWord(Expression &expr, uint32_t pcShift, bool isJumpTarget) {
 	if (!checkcodesection())
 		return;
 	if (!reserveSpace(2))
 		return;
 
 	if (!expr.isKnown()) {
-		createPatch(PATCHTYPE_WORD, expr, pcShift);
+		createPatch(PATCHTYPE_WORD, expr, pcShift, isJumpTarget);
 		writeword(0);
 	} else {
 		writeword(expr.value());
 	}
 }
 
+// Output a relocatable word. Checking will be done to see if
+// it's an absolute value in disguise.
+void sect_RelWord(Expression &expr, uint32_t pcShift) {
+	relWord(expr, pcShift, false);
+}
+
+// Output the address that a `jp` or `call` goes to, which the patch marks as such, so that
+// rgblink knows that the instruction does not store or compare it
+void sect_JumpTarget(Expression &expr) {
+	relWord(expr, 1, true);
+}
+
 // Output a relocatable longword. Checking will be done to see if
 // is an absolute value in disguise.
 void sect_RelLong(Expression &expr, uint32_t pcShift) {
@@ -786,13 +848,73 @@ void sect_RelLong(Expression &expr, uint32_t pcShift) {
 		return;
 
 	if (!expr.isKnown()) {
-		createPatch(PATCHTYPE_LONG, expr, pcShift);
+		createPatch(PATCHTYPE_LONG, expr, pcShift, false);
 		writelong(0);
 	} else {
 		writelong(expr.value());
 	}
 }
 
+// Output a table of relocatable values (e.g. `DB FOR`), one for each value of the variable from
+// `start` to `stop` by `step` like a `FOR` loop, whose body was parsed once
+void sect_RelTable(
+    uint8_t width,
+    std::string const &varName,
+    int32_t start,
+    int32_t stop,
+    int32_t step,
+    Expression const &body
+) {
+	if (Symbol *sym = sym_AddVar(varName, start); sym->type != SYM_VAR)
+		return;
+
+	uint32_t count = 0;
+	if (step > 0 && start < stop)
+		count = ((int64_t)stop - start - 1) / step + 1;
+	else if (step < 0 && stop < start)
+		count = ((int64_t)start - stop - 1) / -(int64_t)step + 1;
+	else if (step == 0)
+		error("FOR cannot have a step value of 0\n");
+
+	if ((step > 0 && start > stop) || (step < 0 && start < stop))
+		warning(
+		    WARNING_BACKWARDS_FOR, "FOR goes backwards from %d to %d by %d\n", start, stop, step
+		);
+
+	if (count == 0 || !checkcodesection())
+		return;
+
+	PatchType type = width == 1 ? PATCHTYPE_BYTE : width == 2 ? PATCHTYPE_WORD : PATCHTYPE_LONG;
+	Expression entry;
+	int32_t value = start;
+
+	for (uint32_t i = 0; i < count; i++) {
+		entry.makeWithValue(body, value);
+		if (width != 4)
+			entry.checkNBit(width * 8);
+		if (!reserveSpace(width))
+			return;
+
+		if (!entry.isKnown()) {
+			createPatch(type, entry, 0, false);
+			fillBytes(0, width);
+		} else if (width == 1) {
+			writebyte(entry.value());
+		} else if (width == 2) {
+			writeword(entry.value());
+		} else {
+			writelong(entry.value());
+		}
+
+		// Avoid arithmetic overflow runtime error
+		uint32_t nextValue = (uint32_t)value + (uint32_t)step;
+		value = nextValue <= INT32_MAX ? nextValue : -(int32_t)~nextValue - 1;
+	}
+
+	// Like after a `FOR` loop, the variable is left with the value that ended it
+	sym_AddVar(varName, value);
+}
+
 // Output a PC-relative relocatable byte. Checking will be done to see if it
 // is an absolute value in disguise.
 void sect_PCRelByte(Expression &expr, uint32_t pcShift) {
@@ -803,7 +925,7 @@ void sect_PCRelByte(Expression &expr, uint32_t pcShift) {
 	Symbol const *pc = sym_GetPC();
 
 	if (!expr.isDiffConstant(pc)) {
-		createPatch(PATCHTYPE_JR, expr, pcShift);
+		createPatch(PATCHTYPE_JR, expr, pcShift, false);
 		writebyte(0);
 	} else {
 		Symbol const *sym = expr.symbolOf();
@@ -829,18 +951,29 @@ void sect_PCRelByte(Expression &expr, uint32_t pcShift) {
 	}
 }
 
-// Output a binary file
-void sect_BinaryFile(std::string const &name, int32_t startPos) {
-	if (startPos < 0) {
-		error("Start position cannot be negative (%" PRId32 ")\n", startPos);
-		startPos = 0;
+// Contents of the INCBIN'd files, so that each is only read once however many times it's included
+static std::unordered_map<std::string, std::vector<uint8_t>> binaryFiles;
+
+// The contents of an INCBIN'd file; with `--deps-only`, only its size is known, and `data` is null
+struct BinaryFile {
+	uint8_t const *data;
+	size_t size;
+};
+
+/*
+ * Returns the contents of an INCBIN'd file, reading the whole file at once the first time.
+ * Files that cannot be seeked (e.g. pipes) cannot be read ahead of time, so they are instead
+ * returned as a `stream` for the caller to read from and close.
+ * If the file cannot be opened, the error is reported, and both return values are empty.
+ */
+static std::optional<BinaryFile> openBinaryFile(std::string const &name, FILE *&stream) {
+	std::optional<std::string> fullPath = fstk_FindFile(name);
+	if (fullPath) {
+		if (auto search = binaryFiles.find(*fullPath); search != binaryFiles.end())
+			return BinaryFile{.data = search->second.data(), .size = search->second.size()};
 	}
-	if (!checkcodesection())
-		return;
 
-	FILE *file = nullptr;
-	if (std::optional<std::string> fullPath = fstk_FindFile(name); fullPath)
-		file = fopen(fullPath->c_str(), "rb");
+	FILE *file = fullPath ? fopen(fullPath->c_str(), "rb") : nullptr;
 	if (!file) {
 		if (generatedMissingIncludes) {
 			if (verbose)
@@ -849,38 +982,80 @@ void sect_BinaryFile(std::string const &name, int32_t startPos) {
 		} else {
 			error("Error opening INCBIN file '%s': %s\n", name.c_str(), strerror(errno));
 		}
-		return;
+		return std::nullopt;
+	}
+
+	long fsize;
+	if (fseek(file, 0, SEEK_END) == -1 || (fsize = ftell(file)) == -1) {
+		if (errno != ESPIPE)
+			error(
+			    "Error determining size of INCBIN file '%s': %s\n", name.c_str(), strerror(errno)
+			);
+		stream = file;
+		return std::nullopt;
 	}
 	Defer closeFile{[&] { fclose(file); }};
 
-	int32_t fsize = -1;
+	if (depsOnly)
+		return BinaryFile{.data = nullptr, .size = (size_t)fsize};
+
+	std::vector<uint8_t> contents(fsize);
+	rewind(file);
+	if (fread(contents.data(), 1, contents.size(), file) != contents.size()) {
+		if (ferror(file))
+			error("Error reading INCBIN file '%s': %s\n", name.c_str(), strerror(errno));
+		else
+			error("Premature end of INCBIN file '%s'\n", name.c_str());
+		return std::nullopt;
+	}
+	std::vector<uint8_t> const &cached =
+	    binaryFiles.emplace(*fullPath, std::move(contents)).first->second;
+	return BinaryFile{.data = cached.data(), .size = cached.size()};
+}
 
-	if (fseek(file, 0, SEEK_END) != -1) {
-		fsize = ftell(file);
+static void writeBinaryFile(BinaryFile const &contents, size_t startPos, size_t length) {
+	if (contents.data)
+		writeBytes(contents.data + startPos, length);
+	else
+		growSection(length);
+}
 
-		if (startPos > fsize) {
+// Output a binary file
+void sect_BinaryFile(std::string const &name, int32_t startPos) {
+	if (startPos < 0) {
+		error("Start position cannot be negative (%" PRId32 ")\n", startPos);
+		startPos = 0;
+	}
+	if (!checkcodesection())
+		return;
+
+	FILE *file = nullptr;
+	std::optional<BinaryFile> contents = openBinaryFile(name, file);
+
+	if (contents) {
+		if ((size_t)startPos > contents->size) {
 			error("Specified start position is greater than length of file\n");
 			return;
 		}
-
-		fseek(file, startPos, SEEK_SET);
-
-		if (!reserveSpace(fsize - startPos))
+		if (!reserveSpace(contents->size - startPos))
 			return;
-	} else {
-		if (errno != ESPIPE)
-			error(
-			    "Error determining size of INCBIN file '%s': %s\n", name.c_str(), strerror(errno)
-			);
-		// The file isn't seekable, so we'll just skip bytes
-		while (startPos--)
-			(void)fgetc(file);
+		writeBinaryFile(*contents, startPos, contents->size - startPos);
+		return;
 	}
 
-	for (int byte; (byte = fgetc(file)) != EOF;) {
-		if (fsize == -1)
-			growSection(1);
-		writebyte(byte);
+	if (!file)
+		return;
+	Defer closeFile{[&] { fclose(file); }};
+
+	// The file isn't seekable, so we'll just skip bytes
+	while (startPos--)
+		(void)fgetc(file);
+
+	uint8_t buf[BUFSIZ];
+	for (size_t nbRead; (nbRead = fread(buf, 1, sizeof(buf), file)) != 0;) {
+		if (!reserveSpace(nbRead))
+			return;
+		writeBytes(buf, nbRead);
 	}
 
 	if (ferror(file))
@@ -907,22 +1082,10 @@ void sect_BinaryFileSlice(std::string const &name, int32_t startPos, int32_t len
 		return;
 
 	FILE *file = nullptr;
-	if (std::optional<std::string> fullPath = fstk_FindFile(name); fullPath)
-		file = fopen(fullPath->c_str(), "rb");
-	if (!file) {
-		if (generatedMissingIncludes) {
-			if (verbose)
-				printf("Aborting (-MG) on INCBIN file '%s' (%s)\n", name.c_str(), strerror(errno));
-			failedOnMissingInclude = true;
-		} else {
-			error("Error opening INCBIN file '%s': %s\n", name.c_str(), strerror(errno));
-		}
-		return;
-	}
-	Defer closeFile{[&] { fclose(file); }};
+	std::optional<BinaryFile> contents = openBinaryFile(name, file);
 
-	if (fseek(file, 0, SEEK_END) != -1) {
-		int32_t fsize = ftell(file);
+	if (contents) {
+		int32_t fsize = contents->size;
 
 		if (startPos > fsize) {
 			error("Specified start position is greater than length of file\n");
@@ -940,32 +1103,38 @@ void sect_BinaryFileSlice(std::string const &name, int32_t startPos, int32_t len
 			return;
 		}
 
-		fseek(file, startPos, SEEK_SET);
-	} else {
-		if (errno != ESPIPE)
-			error(
-			    "Error determining size of INCBIN file '%s': %s\n", name.c_str(), strerror(errno)
-			);
-		// The file isn't seekable, so we'll just skip bytes
-		while (startPos--)
-			(void)fgetc(file);
+		writeBinaryFile(*contents, startPos, length);
+		return;
 	}
 
-	while (length--) {
-		int byte = fgetc(file);
+	if (!file)
+		return;
+	Defer closeFile{[&] { fclose(file); }};
 
-		if (byte != EOF) {
-			writebyte(byte);
-		} else if (ferror(file)) {
-			error("Error reading INCBIN file '%s': %s\n", name.c_str(), strerror(errno));
-		} else {
-			error("Premature end of file (%" PRId32 " bytes left to read)\n", length + 1);
+	// The file isn't seekable, so we'll just skip bytes
+	while (startPos--)
+		(void)fgetc(file);
+
+	uint8_t buf[BUFSIZ];
+	while (length) {
+		size_t nbRead = fread(buf, 1, length < (int32_t)sizeof(buf) ? length : sizeof(buf), file);
+
+		writeBytes(buf, nbRead);
+		length -= nbRead;
+		if (nbRead == 0) {
+			if (ferror(file))
+				error("Error reading INCBIN file '%s': %s\n", name.c_str(), strerror(errno));
+			else
+				error("Premature end of file (%" PRId32 " bytes left to read)\n", length);
+			return;
 		}
 	}
 }
 
 // Section stack routines
 void sect_PushSection() {
+	inccache_Poison();
+
 	sectionStack.push_front({
 	    .section = currentSection,
 	    .loadSection = currentLoadSection,
@@ -983,6 +1152,8 @@ void sect_PushSection() {
 }
 
 void sect_PopSection() {
+	inccache_Poison();
+
 	if (sectionStack.empty())
 		fatalerror("No entries in the section stack\n");
 
@@ -1002,6 +1173,8 @@ void sect_PopSection() {
 }
 
 void sect_EndSection() {
+	inccache_Poison();
+
 	if (!currentSection)
 		fatalerror("Cannot end the section outside of a SECTION\n");
 
@@ -0,0 +1,247 @@
+/* SPDX-License-Identifier: MIT */
+
+#include "asm/stats.hpp"
+
+#include <array>
+#include <chrono>
+#include <inttypes.h>
+#include <optional>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#ifndef _WIN32
+	#include <sys/resource.h>
+#endif
+
+#include "error.hpp"
+#include "helpers.hpp"
+#include "trace.hpp"
+
+#include "asm/fstack.hpp"
+#include "asm/lexer.hpp"
+#include "asm/section.hpp"
+#include "asm/symbol.hpp"
+
+using Clock = std::chrono::steady_clock;
+
+struct Phase {
+	char const *name;
+	Clock::duration time;
+};
+
+struct FileStats {
+	std::string name;
+	uint64_t nbLines = 0;
+	uint64_t nbTokens = 0;
+};
+
+static std::string statsFileName;
+static std::vector<Phase> phases;
+static std::optional<Clock::time_point> phaseStart; // Empty if no phase is being timed
+static uint64_t phaseStartLexingTime;
+static uint64_t lexingTime = 0; // Taken out of the phases that it happened in
+static bool isTracingPhase = false; // Phases are traced even without a report
+
+static std::vector<FileStats> files; // In order of first entry
+static std::unordered_map<std::string, size_t> fileIndices;
+static std::vector<size_t> openFiles; // Indices into `files`, the back one being lexed
+static uint64_t attributedLines;
+static uint64_t attributedTokens;
+
+void stats_SetFileName(std::string const &path) {
+	statsFileName = path;
+	lexer_EnableTiming();
+}
+
+static void endPhase() {
+	if (phaseStart) {
+		uint64_t phaseLexingTime = lexer_GetLexingTime() - phaseStartLexingTime;
+		phases.back().time = Clock::now() - *phaseStart;
+		phases.back().time -= std::chrono::microseconds(phaseLexingTime);
+		lexingTime += phaseLexingTime;
+		phaseStart.reset();
+	}
+}
+
+void stats_StartPhase(char const *name) {
+	if (isTracingPhase)
+		trace_End();
+	trace_Begin(name);
+	isTracingPhase = true;
+
+	if (statsFileName.empty())
+		return;
+
+	endPhase();
+	phases.push_back({.name = name, .time = {}});
+	phaseStart = Clock::now();
+	phaseStartLexingTime = lexer_GetLexingTime();
+}
+
+// Attributes what was lexed since the last file change to the file being lexed until now
+static void attributeLexing() {
+	uint64_t nbLines = lexer_GetNbLines();
+	uint64_t nbTokens = lexer_GetNbTokens();
+
+	if (!openFiles.empty()) {
+		FileStats &file = files[openFiles.back()];
+		file.nbLines += nbLines - attributedLines;
+		file.nbTokens += nbTokens - attributedTokens;
+	}
+	attributedLines = nbLines;
+	attributedTokens = nbTokens;
+}
+
+void stats_EnterFile(std::string const &name) {
+	if (statsFileName.empty())
+		return;
+
+	attributeLexing();
+	auto [search, isNew] = fileIndices.emplace(name, files.size());
+	if (isNew)
+		files.push_back({.name = name});
+	openFiles.push_back(search->second);
+}
+
+void stats_ExitFile() {
+	if (statsFileName.empty())
+		return;
+
+	assume(!openFiles.empty());
+	attributeLexing();
+	openFiles.pop_back();
+}
+
+static void putJSONString(std::string const &str, FILE *file) {
+	putc('"', file);
+	for (char c : str) {
+		if (c == '"' || c == '\\')
+			fprintf(file, "\\%c", c);
+		else if ((uint8_t)c < ' ')
+			fprintf(file, "\\u%04x", c);
+		else
+			putc(c, file);
+	}
+	putc('"', file);
+}
+
+static std::array<uint64_t, SYM_REF + 1> nbSymbols;
+static uint64_t symbolBytes;
+
+static void countSymbol(Symbol &sym) {
+	if (sym.isBuiltin)
+		return;
+
+	nbSymbols[sym.type]++;
+	symbolBytes += sizeof(sym) + sym.name.capacity();
+	if (sym.type == SYM_EQUS)
+		symbolBytes += sym.getEqus()->capacity();
+}
+
+void stats_Write() {
+	if (isTracingPhase) {
+		trace_End();
+		isTracingPhase = false;
+	}
+
+	if (statsFileName.empty())
+		return;
+
+	endPhase();
+	attributeLexing();
+
+	FILE *file = fopen(statsFileName.c_str(), "w");
+	if (!file)
+		err("Failed to open stats file '%s'", statsFileName.c_str());
+	Defer closeFile{[&] { fclose(file); }};
+
+	fputs("{\n  \"phases\": [\n", file);
+	fprintf(file, "    {\"name\": \"lex\", \"microseconds\": %" PRIu64 "}", lexingTime);
+	for (Phase const &phase : phases) {
+		auto microseconds = std::chrono::duration_cast<std::chrono::microseconds>(phase.time);
+
+		fprintf(
+		    file,
+		    ",\n    {\"name\": \"%s\", \"microseconds\": %" PRIu64 "}",
+		    phase.name,
+		    (uint64_t)microseconds.count()
+		);
+	}
+	fputs("\n  ],\n  \"files\": [", file);
+	for (size_t i = 0; i < files.size(); i++) {
+		fputs(i == 0 ? "\n    {\"name\": " : ",\n    {\"name\": ", file);
+		putJSONString(files[i].name, file);
+		fprintf(
+		    file,
+		    ", \"lines\": %" PRIu64 ", \"tokens\": %" PRIu64 "}",
+		    files[i].nbLines,
+		    files[i].nbTokens
+		);
+	}
+
+	nbSymbols = {};
+	symbolBytes = 0;
+	sym_ForEach(countSymbol);
+	uint64_t nbPatches = 0;
+	size_t dataBytes = 0, rpnBytes = 0;
+	for (Section const &sect : sectionList) {
+		nbPatches += sect.patches.size();
+		dataBytes += sect.data.capacity();
+		rpnBytes += sect.rpnArena.capacity();
+	}
+
+	fprintf(
+	    file,
+	    "\n  ],\n  \"counts\": {\n    \"symbols\": {\"label\": %" PRIu64 ", \"equ\": %" PRIu64
+	    ", \"var\": %" PRIu64 ", \"macro\": %" PRIu64 ", \"equs\": %" PRIu64 ", \"ref\": %" PRIu64
+	    "},\n",
+	    nbSymbols[SYM_LABEL],
+	    nbSymbols[SYM_EQU],
+	    nbSymbols[SYM_VAR],
+	    nbSymbols[SYM_MACRO],
+	    nbSymbols[SYM_EQUS],
+	    nbSymbols[SYM_REF]
+	);
+	fprintf(
+	    file,
+	    "    \"sections\": %zu,\n    \"patches\": %" PRIu64 ",\n    \"fstack_nodes\": %" PRIu64
+	    ",\n    \"expansions\": %" PRIu64 ",\n    \"macro_invocations\": %" PRIu64 "\n  },\n",
+	    sectionList.size(),
+	    nbPatches,
+	    fstk_GetNbNodes(),
+	    lexer_GetNbExpansions(),
+	    fstk_GetNbMacroInvocations()
+	);
+	// Sections and their patches only grow, and symbols are rarely purged, so their final sizes
+	// are their peaks
+	fprintf(
+	    file,
+	    "  \"peak_bytes\": {\n    \"section_data\": %zu,\n    \"rpn_buffers\": %zu,\n"
+	    "    \"capture_buffers\": %zu,\n    \"symbol_storage\": %" PRIu64 "\n  },\n",
+	    dataBytes,
+	    rpnBytes,
+	    lexer_GetPeakCaptureBytes(),
+	    symbolBytes
+	);
+	fputs("  \"peak_rss_kib\": ", file);
+
+	long peakRSS = -1; // Reported as `null` where it cannot be measured
+#ifndef _WIN32
+	if (rusage usage; getrusage(RUSAGE_SELF, &usage) == 0) {
+		peakRSS = usage.ru_maxrss;
+	#ifdef __APPLE__
+		peakRSS /= 1024; // macOS reports it in bytes instead of kibibytes
+	#endif
+	}
+#endif
+	if (peakRSS < 0)
+		fputs("null", file);
+	else
+		fprintf(file, "%ld", peakRSS);
+	fputs("\n}\n", file);
+
+	if (ferror(file))
+		err("Failed to write stats file '%s'", statsFileName.c_str());
+}
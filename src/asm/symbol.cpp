@@ -2,23 +2,34 @@
 
 #include "asm/symbol.hpp"
 
+#include <algorithm>
+#include <array>
+#include <deque>
 #include <inttypes.h>
 #include <stdio.h>
 #include <unordered_map>
+#include <vector>
 
 #include "error.hpp"
 #include "helpers.hpp" // assume
 #include "version.hpp"
 
 #include "asm/fstack.hpp"
+#include "asm/inccache.hpp"
 #include "asm/lexer.hpp"
 #include "asm/macro.hpp"
+#include "asm/objcache.hpp"
 #include "asm/output.hpp"
 #include "asm/warning.hpp"
 
 using namespace std::literals;
 
-std::unordered_map<std::string, Symbol> symbols;
+// Symbols are allocated in an arena, so they never move and their names can serve as keys;
+// the slots of purged symbols are reused by the next ones to be created
+static std::deque<Symbol> symbolArena;
+static std::vector<Symbol *> purgedSymbols;
+// Keys are views of the symbols' own names, so that each name is only stored once
+static std::unordered_map<std::string_view, Symbol *> symbols;
 
 static std::optional<std::string> labelScope = std::nullopt; // Current section's label scope
 static Symbol *PCSymbol;
@@ -28,6 +39,7 @@ static char savedTIME[256];
 static char savedDATE[256];
 static char savedTIMESTAMP_ISO8601_LOCAL[256];
 static char savedTIMESTAMP_ISO8601_UTC[256];
+static std::array<Symbol *, 10> timeSymbols; // The ones whose values depend on the current time
 static bool exportAll;
 
 bool sym_IsPC(Symbol const *sym) {
@@ -36,7 +48,7 @@ bool sym_IsPC(Symbol const *sym) {
 
 void sym_ForEach(void (*callback)(Symbol &)) {
 	for (auto &it : symbols)
-		callback(it.second);
+		callback(*it.second);
 }
 
 static int32_t Callback_NARG() {
@@ -106,7 +118,14 @@ static void updateSymbolFilename(Symbol &sym) {
 
 // Create a new symbol by name
 static Symbol &createSymbol(std::string const &symName) {
-	Symbol &sym = symbols[symName];
+	Symbol *slot;
+	if (purgedSymbols.empty()) {
+		slot = &symbolArena.emplace_back();
+	} else {
+		slot = purgedSymbols.back();
+		purgedSymbols.pop_back();
+	}
+	Symbol &sym = *slot;
 
 	sym.name = symName;
 	sym.isExported = false;
@@ -116,12 +135,28 @@ static Symbol &createSymbol(std::string const &symName) {
 	sym.fileLine = sym.src ? lexer_GetLineNo() : 0;
 	sym.ID = -1;
 
+	symbols.emplace(sym.name, &sym);
 	return sym;
 }
 
+// Builds the full name of a local symbol in the current scope.
+// A single buffer is reused, so that looking up local symbols does not allocate.
+static std::string const &scopedName(std::string const &localName) {
+	static std::string fullName;
+
+	assume(labelScope.has_value());
+	fullName.assign(*labelScope).append(localName);
+	return fullName;
+}
+
 Symbol *sym_FindExactSymbol(std::string const &symName) {
 	auto search = symbols.find(symName);
-	return search != symbols.end() ? &search->second : nullptr;
+	Symbol *sym = search != symbols.end() ? search->second : nullptr;
+
+	inccache_RecordLookup(symName, sym);
+	if (sym && sym->isBuiltin && std::find(RANGE(timeSymbols), sym) != timeSymbols.end())
+		objcache_Poison(); // Another assembly would get another time
+	return sym;
 }
 
 Symbol *sym_FindScopedSymbol(std::string const &symName) {
@@ -132,7 +167,7 @@ Symbol *sym_FindScopedSymbol(std::string const &symName) {
 			);
 		// If auto-scoped local label, expand the name
 		if (dotPos == 0 && labelScope)
-			return sym_FindExactSymbol(*labelScope + symName);
+			return sym_FindExactSymbol(scopedName(symName));
 	}
 	return sym_FindExactSymbol(symName);
 }
@@ -157,6 +192,8 @@ Symbol const *sym_GetPC() {
 
 // Purge a symbol
 void sym_Purge(std::string const &symName) {
+	inccache_Poison();
+
 	Symbol *sym = sym_FindScopedValidSymbol(symName);
 
 	if (!sym) {
@@ -170,6 +207,9 @@ void sym_Purge(std::string const &symName) {
 		if (sym->name == labelScope)
 			labelScope = std::nullopt;
 		symbols.erase(sym->name);
+		// Release what the symbol held, and keep its slot for the next symbol
+		*sym = Symbol{};
+		purgedSymbols.push_back(sym);
 	}
 }
 
@@ -186,12 +226,14 @@ uint32_t sym_GetPCValue() {
 }
 
 int32_t sym_GetRSValue() {
+	inccache_RecordLookup(_RSSymbol->name, _RSSymbol);
 	return _RSSymbol->getOutputValue();
 }
 
 void sym_SetRSValue(int32_t value) {
 	updateSymbolFilename(*_RSSymbol);
 	_RSSymbol->data = value;
+	inccache_RecordDirective(CACHED_RSSET, _RSSymbol->name, value);
 }
 
 // Return a constant symbol's value, assuming it's defined
@@ -220,6 +262,7 @@ std::optional<std::string> const &sym_GetCurrentSymbolScope() {
 }
 
 void sym_SetCurrentSymbolScope(std::optional<std::string> const &newScope) {
+	inccache_Poison();
 	labelScope = newScope;
 }
 
@@ -258,6 +301,7 @@ Symbol *sym_AddEqu(std::string const &symName, int32_t value) {
 
 	sym->type = SYM_EQU;
 	sym->data = value;
+	inccache_RecordDirective(CACHED_EQU, symName, value);
 
 	return sym;
 }
@@ -280,6 +324,7 @@ Symbol *sym_RedefEqu(std::string const &symName, int32_t value) {
 	updateSymbolFilename(*sym);
 	sym->type = SYM_EQU;
 	sym->data = value;
+	inccache_RecordDirective(CACHED_REDEF_EQU, symName, value);
 
 	return sym;
 }
@@ -304,6 +349,7 @@ Symbol *sym_AddString(std::string const &symName, std::shared_ptr<std::string> s
 
 	sym->type = SYM_EQUS;
 	sym->data = str;
+	inccache_RecordDirective(CACHED_EQUS, symName, *str);
 	return sym;
 }
 
@@ -327,10 +373,38 @@ Symbol *sym_RedefString(std::string const &symName, std::shared_ptr<std::string>
 
 	updateSymbolFilename(*sym);
 	sym->data = str;
+	inccache_RecordDirective(CACHED_REDEF_EQUS, symName, *str);
 
 	return sym;
 }
 
+Symbol *sym_AppendString(
+    std::string const &symName, std::shared_ptr<std::string> prefix, std::string const &suffix
+) {
+	if (Symbol *sym = sym_FindExactSymbol(symName);
+	    sym && sym->type == SYM_EQUS && !sym->isBuiltin) {
+		std::shared_ptr<std::string> &value = std::get<std::shared_ptr<std::string>>(sym->data);
+
+		// If nothing else refers to the current value, e.g. an expansion of it, nothing can
+		// notice it being appended to, which makes accumulating into a string linear
+		if (value == prefix) {
+			prefix = nullptr;
+			if (value.use_count() == 1) {
+				updateSymbolFilename(*sym);
+				value->append(suffix);
+				inccache_RecordDirective(CACHED_REDEF_EQUS, symName, *value);
+				return sym;
+			}
+			prefix = value;
+		}
+	}
+
+	auto str = std::make_shared<std::string>();
+	str->reserve(prefix->length() + suffix.length());
+	str->append(*prefix).append(suffix);
+	return sym_RedefString(symName, str);
+}
+
 // Alter a mutable symbol's value
 Symbol *sym_AddVar(std::string const &symName, int32_t value) {
 	Symbol *sym = sym_FindExactSymbol(symName);
@@ -351,6 +425,7 @@ Symbol *sym_AddVar(std::string const &symName, int32_t value) {
 
 	sym->type = SYM_VAR;
 	sym->data = value;
+	inccache_RecordDirective(CACHED_VAR, symName, value);
 
 	return sym;
 }
@@ -362,6 +437,8 @@ Symbol *sym_AddVar(std::string const &symName, int32_t value) {
  */
 static Symbol *addLabel(std::string const &symName) {
 	assume(!symName.starts_with('.')); // The symbol name must have been expanded prior
+	inccache_Poison();
+
 	Symbol *sym = sym_FindExactSymbol(symName);
 
 	if (!sym) {
@@ -409,7 +486,7 @@ Symbol *sym_AddLocalLabel(std::string const &symName) {
 			error("Unqualified local label '%s' in main scope\n", symName.c_str());
 			return nullptr;
 		}
-		return addLabel(*labelScope + symName);
+		return addLabel(scopedName(symName));
 	}
 	return addLabel(symName);
 }
@@ -473,6 +550,8 @@ std::string sym_MakeAnonLabelName(uint32_t ofs, bool neg) {
 
 // Export a symbol
 void sym_Export(std::string const &symName) {
+	inccache_Poison();
+
 	if (symName.starts_with('!')) {
 		error("Anonymous labels cannot be exported\n");
 		return;
@@ -501,21 +580,25 @@ Symbol *sym_AddMacro(std::string const &symName, int32_t defLineNo, ContentSpan
 	// override this with the actual definition line
 	sym->fileLine = defLineNo;
 
+	inccache_RecordDirective(
+	    CACHED_MACRO, symName, std::string(span.ptr.get(), span.size), defLineNo
+	);
+
 	return sym;
 }
 
 // Flag that a symbol is referenced in an RPN expression
 // and create it if it doesn't exist yet
 Symbol *sym_Ref(std::string const &symName) {
+	inccache_Poison();
+
 	Symbol *sym = sym_FindScopedSymbol(symName);
 
 	if (!sym) {
 		if (symName.starts_with('.')) {
 			if (!labelScope.has_value())
 				fatalerror("Local label reference '%s' in main scope\n", symName.c_str());
-			std::string fullName = *labelScope + symName;
-
-			sym = &createSymbol(fullName);
+			sym = &createSymbol(scopedName(symName));
 		} else {
 			sym = &createSymbol(symName);
 		}
@@ -581,19 +664,22 @@ void sym_Init(time_t now) {
 	    time_utc
 	);
 
-	sym_AddString("__TIME__"s, std::make_shared<std::string>(savedTIME))->isBuiltin = true;
-	sym_AddString("__DATE__"s, std::make_shared<std::string>(savedDATE))->isBuiltin = true;
-	sym_AddString(
-	    "__ISO_8601_LOCAL__"s, std::make_shared<std::string>(savedTIMESTAMP_ISO8601_LOCAL)
-	)
-	    ->isBuiltin = true;
-	sym_AddString("__ISO_8601_UTC__"s, std::make_shared<std::string>(savedTIMESTAMP_ISO8601_UTC))
-	    ->isBuiltin = true;
-
-	sym_AddEqu("__UTC_YEAR__"s, time_utc->tm_year + 1900)->isBuiltin = true;
-	sym_AddEqu("__UTC_MONTH__"s, time_utc->tm_mon + 1)->isBuiltin = true;
-	sym_AddEqu("__UTC_DAY__"s, time_utc->tm_mday)->isBuiltin = true;
-	sym_AddEqu("__UTC_HOUR__"s, time_utc->tm_hour)->isBuiltin = true;
-	sym_AddEqu("__UTC_MINUTE__"s, time_utc->tm_min)->isBuiltin = true;
-	sym_AddEqu("__UTC_SECOND__"s, time_utc->tm_sec)->isBuiltin = true;
+	timeSymbols = {
+	    sym_AddString("__TIME__"s, std::make_shared<std::string>(savedTIME)),
+	    sym_AddString("__DATE__"s, std::make_shared<std::string>(savedDATE)),
+	    sym_AddString(
+	        "__ISO_8601_LOCAL__"s, std::make_shared<std::string>(savedTIMESTAMP_ISO8601_LOCAL)
+	    ),
+	    sym_AddString(
+	        "__ISO_8601_UTC__"s, std::make_shared<std::string>(savedTIMESTAMP_ISO8601_UTC)
+	    ),
+	    sym_AddEqu("__UTC_YEAR__"s, time_utc->tm_year + 1900),
+	    sym_AddEqu("__UTC_MONTH__"s, time_utc->tm_mon + 1),
+	    sym_AddEqu("__UTC_DAY__"s, time_utc->tm_mday),
+	    sym_AddEqu("__UTC_HOUR__"s, time_utc->tm_hour),
+	    sym_AddEqu("__UTC_MINUTE__"s, time_utc->tm_min),
+	    sym_AddEqu("__UTC_SECOND__"s, time_utc->tm_sec),
+	};
+	for (Symbol *sym : timeSymbols)
+		sym->isBuiltin = true;
 }
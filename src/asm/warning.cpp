@@ -14,11 +14,14 @@
 #include "itertools.hpp"
 
 #include "asm/fstack.hpp"
+#include "asm/inccache.hpp"
 #include "asm/lexer.hpp"
 #include "asm/main.hpp"
+#include "asm/objcache.hpp"
 
 unsigned int nbErrors = 0;
 unsigned int maxErrors = 0;
+unsigned int nbDiagnostics = 0;
 
 static WarningState const defaultWarnings[ARRAY_SIZE(warningStates)] = {
     WARNING_ENABLED,  // WARNING_ASSERT
@@ -328,6 +331,9 @@ void processWarningFlag(char const *flag) {
 void printDiag(
     char const *fmt, va_list args, char const *type, char const *flagfmt, char const *flag
 ) {
+	inccache_Poison(); // Replaying a cached INCLUDE file would not reproduce the diagnostic
+	objcache_Poison(); // Nor would restoring a cached object file
+
 	fputs(type, stderr);
 	fputs(": ", stderr);
 	fstk_DumpCurrent();
@@ -340,6 +346,8 @@ void printDiag(
 void error(char const *fmt, ...) {
 	va_list args;
 
+	nbDiagnostics++;
+
 	va_start(args, fmt);
 	printDiag(fmt, args, "error", ":", nullptr);
 	va_end(args);
@@ -369,10 +377,14 @@ void warning(WarningID id, char const *fmt, ...) {
 	char const *flag = warningFlags[id];
 	va_list args;
 
+	nbDiagnostics++;
+
 	va_start(args, fmt);
 
 	switch (warningState(id)) {
 	case WARNING_DISABLED:
+		// The warning may be enabled when a cached INCLUDE file is replayed
+		inccache_Poison();
 		break;
 
 	case WARNING_ENABLED:
@@ -0,0 +1,203 @@
+/* SPDX-License-Identifier: MIT */
+
+#include "diagnostics.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "error.hpp" // fastExit
+#include "helpers.hpp" // assume
+
+struct TaskReport {
+	std::string text;
+	uint32_t nbErrors = 0;
+	uint32_t nbWarnings = 0;
+	bool isAborted = false;
+	void (*printSummary)() = nullptr; // What the task aborted with, if it did
+};
+
+// Only modified outside of tasks, or when their reports are printed
+static uint32_t nbErrors = 0;
+static uint32_t nbWarnings = 0;
+
+static std::mutex tasksMutex;
+static std::condition_variable workerStopped;
+static std::vector<TaskReport> reports;
+static std::atomic_size_t firstAbortedTask; // The tasks after this one are cancelled
+// Guarded by `tasksMutex`
+static unsigned int nbBusyWorkers;
+static std::vector<bool> isParked; // Whether each worker thread is stopped in an aborted task
+
+static thread_local TaskReport *report = nullptr; // The one of the task that this thread runs
+static thread_local size_t taskIndex;
+static thread_local unsigned int workerIndex;
+
+static uint32_t addCounts(uint32_t count, uint32_t extra) {
+	return extra > UINT32_MAX - count ? UINT32_MAX : count + extra;
+}
+
+void diag_VPrintf(char const *fmt, va_list ap) {
+	if (!report) {
+		vfprintf(stderr, fmt, ap);
+		return;
+	}
+
+	va_list apCopy;
+	va_copy(apCopy, ap);
+	int len = vsnprintf(nullptr, 0, fmt, apCopy);
+	va_end(apCopy);
+
+	std::string &text = report->text;
+	size_t start = text.size();
+	text.resize(start + len + 1); // `vsnprintf` also writes a terminator
+	vsnprintf(&text[start], len + 1, fmt, ap);
+	text.pop_back();
+}
+
+void diag_Printf(char const *fmt, ...) {
+	va_list ap;
+
+	va_start(ap, fmt);
+	diag_VPrintf(fmt, ap);
+	va_end(ap);
+}
+
+void diag_Puts(char const *str) {
+	if (report)
+		report->text += str;
+	else
+		fputs(str, stderr);
+}
+
+void diag_Putc(char c) {
+	if (report)
+		report->text += c;
+	else
+		putc(c, stderr);
+}
+
+void diag_CountError() {
+	uint32_t &count = report ? report->nbErrors : nbErrors;
+	count = addCounts(count, 1);
+}
+
+void diag_CountWarning() {
+	uint32_t &count = report ? report->nbWarnings : nbWarnings;
+	count = addCounts(count, 1);
+}
+
+uint32_t diag_NbErrors() {
+	return addCounts(nbErrors, report ? report->nbErrors : 0);
+}
+
+uint32_t diag_NbWarnings() {
+	return addCounts(nbWarnings, report ? report->nbWarnings : 0);
+}
+
+static void printReport(TaskReport const &taskReport) {
+	fwrite(taskReport.text.data(), 1, taskReport.text.size(), stderr);
+	nbErrors = addCounts(nbErrors, taskReport.nbErrors);
+	nbWarnings = addCounts(nbWarnings, taskReport.nbWarnings);
+}
+
+void diag_Abort(void (*printSummary)()) {
+	if (!report) {
+		if (printSummary)
+			printSummary();
+		exit(1);
+	}
+
+	// Without exceptions, the task cannot be unwound; so its thread stops here, and the thread
+	// which runs the tasks reports the abort once all the others have stopped too
+	std::unique_lock lock(tasksMutex);
+	if (taskIndex < firstAbortedTask)
+		firstAbortedTask = taskIndex;
+	report->isAborted = true;
+	report->printSummary = printSummary;
+	report = nullptr;
+	isParked[workerIndex] = true;
+	nbBusyWorkers--;
+	workerStopped.notify_all();
+	lock.unlock();
+
+	for (;;)
+		std::this_thread::sleep_for(std::chrono::hours(1));
+}
+
+size_t diag_RunTasksUntilAbort(
+    size_t nbTasks, unsigned int nbThreads, std::function<void(size_t)> const &task
+) {
+	if (nbThreads <= 1 || nbTasks <= 1) {
+		for (size_t i = 0; i < nbTasks; i++)
+			task(i);
+		return nbTasks;
+	}
+
+	unsigned int nbWorkers = nbThreads < nbTasks ? nbThreads : nbTasks;
+	reports.assign(nbTasks, {});
+	firstAbortedTask = SIZE_MAX;
+	isParked.assign(nbWorkers, false);
+	nbBusyWorkers = nbWorkers;
+	std::atomic_size_t nextTask = 0;
+	std::vector<std::thread> workers;
+
+	for (unsigned int i = 0; i < nbWorkers; i++) {
+		workers.emplace_back([&, i] {
+			workerIndex = i;
+			for (size_t j; (j = nextTask++) < nbTasks && j < firstAbortedTask;) {
+				report = &reports[j];
+				taskIndex = j;
+				task(j);
+				report = nullptr;
+			}
+
+			std::lock_guard lock(tasksMutex);
+			nbBusyWorkers--;
+			workerStopped.notify_all();
+		});
+	}
+	{
+		std::unique_lock lock(tasksMutex);
+		workerStopped.wait(lock, [] { return nbBusyWorkers == 0; });
+	}
+	for (unsigned int i = 0; i < nbWorkers; i++) {
+		if (isParked[i])
+			workers[i].detach();
+		else
+			workers[i].join();
+	}
+
+	// All the tasks before the first aborted one have finished, whichever ones ran after it
+	size_t nbFinished = firstAbortedTask < nbTasks ? firstAbortedTask.load() : nbTasks;
+	for (size_t i = 0; i < nbFinished; i++)
+		printReport(reports[i]);
+	if (nbFinished == nbTasks)
+		reports.clear();
+	return nbFinished;
+}
+
+void diag_FinishAbort() {
+	TaskReport const &taskReport = reports[firstAbortedTask];
+
+	assume(taskReport.isAborted);
+	printReport(taskReport);
+	if (taskReport.printSummary)
+		taskReport.printSummary();
+	// The aborted tasks' threads are stopped in the middle of them, so global state must not be
+	// destroyed
+	fastExit(1);
+}
+
+void diag_RunTasks(
+    size_t nbTasks, unsigned int nbThreads, std::function<void(size_t)> const &task
+) {
+	if (diag_RunTasksUntilAbort(nbTasks, nbThreads, task) != nbTasks)
+		diag_FinishAbort();
+}
@@ -8,36 +8,48 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "diagnostics.hpp"
+#include "platform.hpp" // _exit
+#include "trace.hpp"
+
+#if defined(__SANITIZE_ADDRESS__)
+	#define CHECKING_LEAKS 1
+#elif defined(__has_feature)
+	#if __has_feature(address_sanitizer) || __has_feature(leak_sanitizer)
+		#define CHECKING_LEAKS 1
+	#endif
+#endif
+
 static void vwarn(char const *fmt, va_list ap) {
 	char const *error = strerror(errno);
 
-	fprintf(stderr, "warning: ");
-	vfprintf(stderr, fmt, ap);
-	fprintf(stderr, ": %s\n", error);
+	diag_Puts("warning: ");
+	diag_VPrintf(fmt, ap);
+	diag_Printf(": %s\n", error);
 }
 
 static void vwarnx(char const *fmt, va_list ap) {
-	fprintf(stderr, "warning: ");
-	vfprintf(stderr, fmt, ap);
-	putc('\n', stderr);
+	diag_Puts("warning: ");
+	diag_VPrintf(fmt, ap);
+	diag_Putc('\n');
 }
 
 [[noreturn]] static void verr(char const *fmt, va_list ap) {
 	char const *error = strerror(errno);
 
-	fprintf(stderr, "error: ");
-	vfprintf(stderr, fmt, ap);
-	fprintf(stderr, ": %s\n", error);
+	diag_Puts("error: ");
+	diag_VPrintf(fmt, ap);
+	diag_Printf(": %s\n", error);
 	va_end(ap);
-	exit(1);
+	diag_Abort(nullptr);
 }
 
 [[noreturn]] static void verrx(char const *fmt, va_list ap) {
-	fprintf(stderr, "error: ");
-	vfprintf(stderr, fmt, ap);
-	putc('\n', stderr);
+	diag_Puts("error: ");
+	diag_VPrintf(fmt, ap);
+	diag_Putc('\n');
 	va_end(ap);
-	exit(1);
+	diag_Abort(nullptr);
 }
 
 void warn(char const *fmt, ...) {
@@ -69,3 +81,13 @@ void warnx(char const *fmt, ...) {
 	va_start(ap, fmt);
 	verrx(fmt, ap);
 }
+
+[[noreturn]] void fastExit(int status) {
+#ifdef CHECKING_LEAKS
+	exit(status);
+#else
+	trace_Write();
+	fflush(nullptr); // Like `exit` does
+	_exit(status);
+#endif
+}
@@ -0,0 +1,669 @@
+/* SPDX-License-Identifier: MIT */
+
+#include "fix/header.hpp"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "helpers.hpp"
+#include "platform.hpp"
+
+static void printAcceptedMBCNames() {
+	fputs("\tROM ($00) [aka ROM_ONLY]\n", stderr);
+	fputs("\tMBC1 ($01), MBC1+RAM ($02), MBC1+RAM+BATTERY ($03)\n", stderr);
+	fputs("\tMBC2 ($05), MBC2+BATTERY ($06)\n", stderr);
+	fputs("\tROM+RAM ($08) [deprecated], ROM+RAM+BATTERY ($09) [deprecated]\n", stderr);
+	fputs("\tMMM01 ($0B), MMM01+RAM ($0C), MMM01+RAM+BATTERY ($0D)\n", stderr);
+	fputs("\tMBC3+TIMER+BATTERY ($0F), MBC3+TIMER+RAM+BATTERY ($10)\n", stderr);
+	fputs("\tMBC3 ($11), MBC3+RAM ($12), MBC3+RAM+BATTERY ($13)\n", stderr);
+	fputs("\tMBC5 ($19), MBC5+RAM ($1A), MBC5+RAM+BATTERY ($1B)\n", stderr);
+	fputs("\tMBC5+RUMBLE ($1C), MBC5+RUMBLE+RAM ($1D), MBC5+RUMBLE+RAM+BATTERY ($1E)\n", stderr);
+	fputs("\tMBC6 ($20)\n", stderr);
+	fputs("\tMBC7+SENSOR+RUMBLE+RAM+BATTERY ($22)\n", stderr);
+	fputs("\tPOCKET_CAMERA ($FC)\n", stderr);
+	fputs("\tBANDAI_TAMA5 ($FD)\n", stderr);
+	fputs("\tHUC3 ($FE)\n", stderr);
+	fputs("\tHUC1+RAM+BATTERY ($FF)\n", stderr);
+
+	fputs("\n\tTPP1_1.0, TPP1_1.0+RUMBLE, TPP1_1.0+MULTIRUMBLE, TPP1_1.0+TIMER,\n", stderr);
+	fputs("\tTPP1_1.0+TIMER+RUMBLE, TPP1_1.0+TIMER+MULTIRUMBLE, TPP1_1.0+BATTERY,\n", stderr);
+	fputs("\tTPP1_1.0+BATTERY+RUMBLE, TPP1_1.0+BATTERY+MULTIRUMBLE,\n", stderr);
+	fputs("\tTPP1_1.0+BATTERY+TIMER, TPP1_1.0+BATTERY+TIMER+RUMBLE,\n", stderr);
+	fputs("\tTPP1_1.0+BATTERY+TIMER+MULTIRUMBLE\n", stderr);
+}
+
+uint8_t tpp1Rev[2];
+
+/*
+ * @return False on failure
+ */
+static bool readMBCSlice(char const *&name, char const *expected) {
+	while (*expected) {
+		char c = *name++;
+
+		if (c == '\0') // Name too short
+			return false;
+
+		if (c >= 'a' && c <= 'z') // Perform the comparison case-insensitive
+			c = c - 'a' + 'A';
+		else if (c == '_') // Treat underscores as spaces
+			c = ' ';
+
+		if (c != *expected++)
+			return false;
+	}
+	return true;
+}
+
+static MbcType parseMBC(char const *name) {
+	if (!strcasecmp(name, "help")) {
+		fputs("Accepted MBC names:\n", stderr);
+		printAcceptedMBCNames();
+		exit(0);
+	}
+
+	if ((name[0] >= '0' && name[0] <= '9') || name[0] == '$') {
+		int base = 0;
+
+		if (name[0] == '$') {
+			name++;
+			base = 16;
+		}
+		// Parse number, and return it as-is (unless it's too large)
+		char *endptr;
+		unsigned long mbc = strtoul(name, &endptr, base);
+
+		if (*endptr)
+			return MBC_BAD;
+		if (mbc > 0xFF)
+			return MBC_BAD_RANGE;
+		return (MbcType)mbc;
+
+	} else {
+		// Begin by reading the MBC type:
+		uint16_t mbc;
+		char const *ptr = name;
+
+		// Trim off leading whitespace
+		while (*ptr == ' ' || *ptr == '\t')
+			ptr++;
+
+#define tryReadSlice(expected) \
+	do { \
+		if (!readMBCSlice(ptr, expected)) \
+			return MBC_BAD; \
+	} while (0)
+
+		switch (*ptr++) {
+		case 'R': // ROM / ROM_ONLY
+		case 'r':
+			tryReadSlice("OM");
+			// Handle optional " ONLY"
+			while (*ptr == ' ' || *ptr == '\t' || *ptr == '_')
+				ptr++;
+			if (*ptr == 'O' || *ptr == 'o') {
+				ptr++;
+				tryReadSlice("NLY");
+			}
+			mbc = ROM;
+			break;
+
+		case 'M': // MBC{1, 2, 3, 5, 6, 7} / MMM01
+		case 'm':
+			switch (*ptr++) {
+			case 'B':
+			case 'b':
+				switch (*ptr++) {
+				case 'C':
+				case 'c':
+					break;
+				default:
+					return MBC_BAD;
+				}
+				switch (*ptr++) {
+				case '1':
+					mbc = MBC1;
+					break;
+				case '2':
+					mbc = MBC2;
+					break;
+				case '3':
+					mbc = MBC3;
+					break;
+				case '5':
+					mbc = MBC5;
+					break;
+				case '6':
+					mbc = MBC6;
+					break;
+				case '7':
+					mbc = MBC7_SENSOR_RUMBLE_RAM_BATTERY;
+					break;
+				default:
+					return MBC_BAD;
+				}
+				break;
+			case 'M':
+			case 'm':
+				tryReadSlice("M01");
+				mbc = MMM01;
+				break;
+			default:
+				return MBC_BAD;
+			}
+			break;
+
+		case 'P': // POCKET_CAMERA
+		case 'p':
+			tryReadSlice("OCKET CAMERA");
+			mbc = POCKET_CAMERA;
+			break;
+
+		case 'B': // BANDAI_TAMA5
+		case 'b':
+			tryReadSlice("ANDAI TAMA5");
+			mbc = BANDAI_TAMA5;
+			break;
+
+		case 'T': // TAMA5 / TPP1
+		case 't':
+			switch (*ptr++) {
+			case 'A':
+				tryReadSlice("MA5");
+				mbc = BANDAI_TAMA5;
+				break;
+			case 'P': {
+				tryReadSlice("P1");
+				// Parse version
+				while (*ptr == ' ' || *ptr == '_')
+					ptr++;
+				// Major
+				char *endptr;
+				unsigned long val = strtoul(ptr, &endptr, 10);
+
+				if (endptr == ptr) {
+					report("error: Failed to parse TPP1 major revision number\n");
+					return MBC_BAD;
+				}
+				ptr = endptr;
+				if (val != 1) {
+					report("error: RGBFIX only supports TPP1 versions 1.0\n");
+					return MBC_BAD;
+				}
+				tpp1Rev[0] = val;
+				tryReadSlice(".");
+				// Minor
+				val = strtoul(ptr, &endptr, 10);
+				if (endptr == ptr) {
+					report("error: Failed to parse TPP1 minor revision number\n");
+					return MBC_BAD;
+				}
+				ptr = endptr;
+				if (val > 0xFF) {
+					report("error: TPP1 minor revision number must be 8-bit\n");
+					return MBC_BAD;
+				}
+				tpp1Rev[1] = val;
+				mbc = TPP1;
+				break;
+			}
+			default:
+				return MBC_BAD;
+			}
+			break;
+
+		case 'H': // HuC{1, 3}
+		case 'h':
+			tryReadSlice("UC");
+			switch (*ptr++) {
+			case '1':
+				mbc = HUC1_RAM_BATTERY;
+				break;
+			case '3':
+				mbc = HUC3;
+				break;
+			default:
+				return MBC_BAD;
+			}
+			break;
+
+		default:
+			return MBC_BAD;
+		}
+
+		// Read "additional features"
+		uint8_t features = 0;
+#define RAM         (1 << 7)
+#define BATTERY     (1 << 6)
+#define TIMER       (1 << 5)
+#define RUMBLE      (1 << 4)
+#define SENSOR      (1 << 3)
+#define MULTIRUMBLE (1 << 2)
+
+		for (;;) {
+			// Trim off trailing whitespace
+			while (*ptr == ' ' || *ptr == '\t' || *ptr == '_')
+				ptr++;
+
+			// If done, start processing "features"
+			if (!*ptr)
+				break;
+			// We expect a '+' at this point
+			if (*ptr++ != '+')
+				return MBC_BAD;
+			// Trim off leading whitespace
+			while (*ptr == ' ' || *ptr == '\t' || *ptr == '_')
+				ptr++;
+
+			switch (*ptr++) {
+			case 'B': // BATTERY
+			case 'b':
+				tryReadSlice("ATTERY");
+				features |= BATTERY;
+				break;
+
+			case 'M':
+			case 'm':
+				tryReadSlice("ULTIRUMBLE");
+				features |= MULTIRUMBLE;
+				break;
+
+			case 'R': // RAM or RUMBLE
+			case 'r':
+				switch (*ptr++) {
+				case 'U':
+				case 'u':
+					tryReadSlice("MBLE");
+					features |= RUMBLE;
+					break;
+				case 'A':
+				case 'a':
+					if (*ptr != 'M' && *ptr != 'm')
+						return MBC_BAD;
+					ptr++;
+					features |= RAM;
+					break;
+				default:
+					return MBC_BAD;
+				}
+				break;
+
+			case 'S': // SENSOR
+			case 's':
+				tryReadSlice("ENSOR");
+				features |= SENSOR;
+				break;
+
+			case 'T': // TIMER
+			case 't':
+				tryReadSlice("IMER");
+				features |= TIMER;
+				break;
+
+			default:
+				return MBC_BAD;
+			}
+		}
+#undef tryReadSlice
+
+		switch (mbc) {
+		case ROM:
+			if (!features)
+				break;
+			mbc = ROM_RAM - 1;
+			static_assert(ROM_RAM + 1 == ROM_RAM_BATTERY, "Enum sanity check failed!");
+			static_assert(MBC1 + 1 == MBC1_RAM, "Enum sanity check failed!");
+			static_assert(MBC1 + 2 == MBC1_RAM_BATTERY, "Enum sanity check failed!");
+			static_assert(MMM01 + 1 == MMM01_RAM, "Enum sanity check failed!");
+			static_assert(MMM01 + 2 == MMM01_RAM_BATTERY, "Enum sanity check failed!");
+			[[fallthrough]];
+		case MBC1:
+		case MMM01:
+			if (features == RAM)
+				mbc++;
+			else if (features == (RAM | BATTERY))
+				mbc += 2;
+			else if (features)
+				return MBC_WRONG_FEATURES;
+			break;
+
+		case MBC2:
+			if (features == BATTERY)
+				mbc = MBC2_BATTERY;
+			else if (features)
+				return MBC_WRONG_FEATURES;
+			break;
+
+		case MBC3:
+			// Handle timer, which also requires battery
+			if (features & TIMER) {
+				if (!(features & BATTERY))
+					fprintf(stderr, "warning: MBC3+TIMER implies BATTERY\n");
+				features &= ~(TIMER | BATTERY); // Reset those bits
+				mbc = MBC3_TIMER_BATTERY;
+				// RAM is handled below
+			}
+			static_assert(MBC3 + 1 == MBC3_RAM, "Enum sanity check failed!");
+			static_assert(MBC3 + 2 == MBC3_RAM_BATTERY, "Enum sanity check failed!");
+			static_assert(
+			    MBC3_TIMER_BATTERY + 1 == MBC3_TIMER_RAM_BATTERY, "Enum sanity check failed!"
+			);
+			if (features == RAM)
+				mbc++;
+			else if (features == (RAM | BATTERY))
+				mbc += 2;
+			else if (features)
+				return MBC_WRONG_FEATURES;
+			break;
+
+		case MBC5:
+			if (features & RUMBLE) {
+				features &= ~RUMBLE;
+				mbc = MBC5_RUMBLE;
+			}
+			static_assert(MBC5 + 1 == MBC5_RAM, "Enum sanity check failed!");
+			static_assert(MBC5 + 2 == MBC5_RAM_BATTERY, "Enum sanity check failed!");
+			static_assert(MBC5_RUMBLE + 1 == MBC5_RUMBLE_RAM, "Enum sanity check failed!");
+			static_assert(MBC5_RUMBLE + 2 == MBC5_RUMBLE_RAM_BATTERY, "Enum sanity check failed!");
+			if (features == RAM)
+				mbc++;
+			else if (features == (RAM | BATTERY))
+				mbc += 2;
+			else if (features)
+				return MBC_WRONG_FEATURES;
+			break;
+
+		case MBC6:
+		case POCKET_CAMERA:
+		case BANDAI_TAMA5:
+		case HUC3:
+			// No extra features accepted
+			if (features)
+				return MBC_WRONG_FEATURES;
+			break;
+
+		case MBC7_SENSOR_RUMBLE_RAM_BATTERY:
+			if (features != (SENSOR | RUMBLE | RAM | BATTERY))
+				return MBC_WRONG_FEATURES;
+			break;
+
+		case HUC1_RAM_BATTERY:
+			if (features != (RAM | BATTERY)) // HuC1 expects RAM+BATTERY
+				return MBC_WRONG_FEATURES;
+			break;
+
+		case TPP1:
+			if (features & RAM)
+				fprintf(
+				    stderr, "warning: TPP1 requests RAM implicitly if given a non-zero RAM size"
+				);
+			if (features & BATTERY)
+				mbc |= 0x08;
+			if (features & TIMER)
+				mbc |= 0x04;
+			if (features & MULTIRUMBLE)
+				mbc |= 0x03; // Also set the rumble flag
+			if (features & RUMBLE)
+				mbc |= 0x01;
+			if (features & SENSOR)
+				return MBC_WRONG_FEATURES;
+			break;
+		}
+
+		// Trim off trailing whitespace
+		while (*ptr == ' ' || *ptr == '\t')
+			ptr++;
+
+		// If there is still something past the whitespace, error out
+		if (*ptr)
+			return MBC_BAD;
+
+		return (MbcType)mbc;
+	}
+}
+
+static char const *mbcName(MbcType type) {
+	switch (type) {
+	case ROM:
+		return "ROM";
+	case ROM_RAM:
+		return "ROM+RAM";
+	case ROM_RAM_BATTERY:
+		return "ROM+RAM+BATTERY";
+	case MBC1:
+		return "MBC1";
+	case MBC1_RAM:
+		return "MBC1+RAM";
+	case MBC1_RAM_BATTERY:
+		return "MBC1+RAM+BATTERY";
+	case MBC2:
+		return "MBC2";
+	case MBC2_BATTERY:
+		return "MBC2+BATTERY";
+	case MMM01:
+		return "MMM01";
+	case MMM01_RAM:
+		return "MMM01+RAM";
+	case MMM01_RAM_BATTERY:
+		return "MMM01+RAM+BATTERY";
+	case MBC3:
+		return "MBC3";
+	case MBC3_TIMER_BATTERY:
+		return "MBC3+TIMER+BATTERY";
+	case MBC3_TIMER_RAM_BATTERY:
+		return "MBC3+TIMER+RAM+BATTERY";
+	case MBC3_RAM:
+		return "MBC3+RAM";
+	case MBC3_RAM_BATTERY:
+		return "MBC3+RAM+BATTERY";
+	case MBC5:
+		return "MBC5";
+	case MBC5_RAM:
+		return "MBC5+RAM";
+	case MBC5_RAM_BATTERY:
+		return "MBC5+RAM+BATTERY";
+	case MBC5_RUMBLE:
+		return "MBC5+RUMBLE";
+	case MBC5_RUMBLE_RAM:
+		return "MBC5+RUMBLE+RAM";
+	case MBC5_RUMBLE_RAM_BATTERY:
+		return "MBC5+RUMBLE+RAM+BATTERY";
+	case MBC6:
+		return "MBC6";
+	case MBC7_SENSOR_RUMBLE_RAM_BATTERY:
+		return "MBC7+SENSOR+RUMBLE+RAM+BATTERY";
+	case POCKET_CAMERA:
+		return "POCKET CAMERA";
+	case BANDAI_TAMA5:
+		return "BANDAI TAMA5";
+	case HUC3:
+		return "HUC3";
+	case HUC1_RAM_BATTERY:
+		return "HUC1+RAM+BATTERY";
+	case TPP1:
+		return "TPP1";
+	case TPP1_RUMBLE:
+		return "TPP1+RUMBLE";
+	case TPP1_MULTIRUMBLE:
+	case TPP1_MULTIRUMBLE_RUMBLE:
+		return "TPP1+MULTIRUMBLE";
+	case TPP1_TIMER:
+		return "TPP1+TIMER";
+	case TPP1_TIMER_RUMBLE:
+		return "TPP1+TIMER+RUMBLE";
+	case TPP1_TIMER_MULTIRUMBLE:
+	case TPP1_TIMER_MULTIRUMBLE_RUMBLE:
+		return "TPP1+TIMER+MULTIRUMBLE";
+	case TPP1_BATTERY:
+		return "TPP1+BATTERY";
+	case TPP1_BATTERY_RUMBLE:
+		return "TPP1+BATTERY+RUMBLE";
+	case TPP1_BATTERY_MULTIRUMBLE:
+	case TPP1_BATTERY_MULTIRUMBLE_RUMBLE:
+		return "TPP1+BATTERY+MULTIRUMBLE";
+	case TPP1_BATTERY_TIMER:
+		return "TPP1+BATTERY+TIMER";
+	case TPP1_BATTERY_TIMER_RUMBLE:
+		return "TPP1+BATTERY+TIMER+RUMBLE";
+	case TPP1_BATTERY_TIMER_MULTIRUMBLE:
+	case TPP1_BATTERY_TIMER_MULTIRUMBLE_RUMBLE:
+		return "TPP1+BATTERY+TIMER+MULTIRUMBLE";
+
+	// Error values
+	case MBC_NONE:
+	case MBC_BAD:
+	case MBC_WRONG_FEATURES:
+	case MBC_BAD_RANGE:
+		unreachable_();
+	}
+
+	unreachable_();
+}
+
+static bool hasRAM(MbcType type) {
+	switch (type) {
+	case ROM:
+	case MBC1:
+	case MBC2: // Technically has RAM, but not marked as such
+	case MBC2_BATTERY:
+	case MMM01:
+	case MBC3:
+	case MBC3_TIMER_BATTERY:
+	case MBC5:
+	case MBC5_RUMBLE:
+	case MBC6:         // TODO: not sure
+	case BANDAI_TAMA5: // TODO: not sure
+	case MBC_NONE:
+	case MBC_BAD:
+	case MBC_WRONG_FEATURES:
+	case MBC_BAD_RANGE:
+		return false;
+
+	case ROM_RAM:
+	case ROM_RAM_BATTERY:
+	case MBC1_RAM:
+	case MBC1_RAM_BATTERY:
+	case MMM01_RAM:
+	case MMM01_RAM_BATTERY:
+	case MBC3_TIMER_RAM_BATTERY:
+	case MBC3_RAM:
+	case MBC3_RAM_BATTERY:
+	case MBC5_RAM:
+	case MBC5_RAM_BATTERY:
+	case MBC5_RUMBLE_RAM:
+	case MBC5_RUMBLE_RAM_BATTERY:
+	case MBC7_SENSOR_RUMBLE_RAM_BATTERY:
+	case POCKET_CAMERA:
+	case HUC3:
+	case HUC1_RAM_BATTERY:
+		return true;
+
+	// TPP1 may or may not have RAM, don't call this function for it
+	case TPP1:
+	case TPP1_RUMBLE:
+	case TPP1_MULTIRUMBLE:
+	case TPP1_MULTIRUMBLE_RUMBLE:
+	case TPP1_TIMER:
+	case TPP1_TIMER_RUMBLE:
+	case TPP1_TIMER_MULTIRUMBLE:
+	case TPP1_TIMER_MULTIRUMBLE_RUMBLE:
+	case TPP1_BATTERY:
+	case TPP1_BATTERY_RUMBLE:
+	case TPP1_BATTERY_MULTIRUMBLE:
+	case TPP1_BATTERY_MULTIRUMBLE_RUMBLE:
+	case TPP1_BATTERY_TIMER:
+	case TPP1_BATTERY_TIMER_RUMBLE:
+	case TPP1_BATTERY_TIMER_MULTIRUMBLE:
+	case TPP1_BATTERY_TIMER_MULTIRUMBLE_RUMBLE:
+		break;
+	}
+
+	unreachable_();
+}
+
+MbcType parseMBCOption(char const *arg) {
+	MbcType type = parseMBC(arg);
+
+	if (type == MBC_BAD) {
+		report("error: Unknown MBC \"%s\"\nAccepted MBC names:\n", arg);
+		printAcceptedMBCNames();
+	} else if (type == MBC_WRONG_FEATURES) {
+		report("error: Features incompatible with MBC (\"%s\")\nAccepted combinations:\n", arg);
+		printAcceptedMBCNames();
+	} else if (type == MBC_BAD_RANGE) {
+		report("error: Specified MBC ID out of range 0-255: %s\n", arg);
+	} else if (type == ROM_RAM || type == ROM_RAM_BATTERY) {
+		fprintf(
+		    stderr, "warning: ROM+RAM / ROM+RAM+BATTERY are under-specified and poorly supported\n"
+		);
+	}
+	return type;
+}
+
+void checkRAMSize(MbcType cartridgeType, uint16_t ramSize) {
+	// Check that RAM size is correct for "standard" mappers
+	if (ramSize != UNSPECIFIED && (cartridgeType & 0xFF00) == 0) {
+		if (cartridgeType == ROM_RAM || cartridgeType == ROM_RAM_BATTERY) {
+			if (ramSize != 1)
+				fprintf(
+				    stderr,
+				    "warning: MBC \"%s\" should have 2 KiB of RAM (-r 1)\n",
+				    mbcName(cartridgeType)
+				);
+		} else if (hasRAM(cartridgeType)) {
+			if (!ramSize) {
+				fprintf(
+				    stderr,
+				    "warning: MBC \"%s\" has RAM, but RAM size was set to 0\n",
+				    mbcName(cartridgeType)
+				);
+			} else if (ramSize == 1) {
+				fprintf(
+				    stderr,
+				    "warning: RAM size 1 (2 KiB) was specified for MBC \"%s\"\n",
+				    mbcName(cartridgeType)
+				);
+			} // TODO: check possible values?
+		} else if (ramSize) {
+			fprintf(
+			    stderr,
+			    "warning: MBC \"%s\" has no RAM, but RAM size was set to %u\n",
+			    mbcName(cartridgeType),
+			    ramSize
+			);
+		}
+	}
+}
+
+uint8_t const nintendoLogo[48] = {
+    0xCE, 0xED, 0x66, 0x66, 0xCC, 0x0D, 0x00, 0x0B, 0x03, 0x73, 0x00, 0x83, 0x00, 0x0C, 0x00, 0x0D,
+    0x00, 0x08, 0x11, 0x1F, 0x88, 0x89, 0x00, 0x0E, 0xDC, 0xCC, 0x6E, 0xE6, 0xDD, 0xDD, 0xD9, 0x99,
+    0xBB, 0xBB, 0x67, 0x63, 0x6E, 0x0E, 0xEC, 0xCC, 0xDD, 0xDC, 0x99, 0x9F, 0xBB, 0xB9, 0x33, 0x3E,
+};
+
+uint16_t sumBytes(uint8_t const *data, size_t len) {
+	uint16_t sum = 0;
+
+	while (len >= 8) {
+		// 128 words add at most 128 * 2 * 255 = 65280 to each lane
+		size_t nbWords = len / 8 > 128 ? 128 : len / 8;
+		uint64_t lanes = 0;
+
+		for (size_t i = 0; i < nbWords; i++) {
+			uint64_t word;
+
+			memcpy(&word, &data[i * 8], sizeof(word));
+			lanes += word & 0x00FF'00FF'00FF'00FF;
+			lanes += word >> 8 & 0x00FF'00FF'00FF'00FF;
+		}
+		sum += lanes + (lanes >> 16) + (lanes >> 32) + (lanes >> 48);
+		data += nbWords * 8;
+		len -= nbWords * 8;
+	}
+	for (size_t i = 0; i < len; i++)
+		sum += data[i];
+
+	return sum;
+}
@@ -3,6 +3,7 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 
+#include <algorithm>
 #include <errno.h>
 #include <limits.h>
 #include <stdarg.h>
@@ -10,20 +11,33 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <string>
 #include <vector>
 
+#include "diagnostics.hpp"
 #include "extern/getopt.hpp"
 #include "helpers.hpp"
 #include "platform.hpp"
+#include "trace.hpp"
 #include "version.hpp"
 
-#define UNSPECIFIED 0x200 // Should not be in byte range
+#include "fix/header.hpp"
+
+// Neither MSVC nor MinGW provide `mmap`
+#if !defined(_MSC_VER) && !defined(__MINGW32__)
+	#include <sys/mman.h>
+	#define HAS_MMAP
+#endif
 
 #define BANK_SIZE 0x4000
 
 // Short options
 static char const *optstring = "Ccf:i:jk:L:l:m:n:Op:r:st:Vv";
 
+// Variables for the long-only options
+static int longOpt; // `--jobs` and `--trace`
+static char const *traceFileName = nullptr;
+
 /*
  * Equivalent long options
  * Please keep in the same order as short opts
@@ -35,32 +49,34 @@ static char const *optstring = "Ccf:i:jk:L:l:m:n:Op:r:st:Vv";
  * over short opt matching
  */
 static option const longopts[] = {
-    {"color-only",       no_argument,       nullptr, 'C'},
-    {"color-compatible", no_argument,       nullptr, 'c'},
-    {"fix-spec",         required_argument, nullptr, 'f'},
-    {"game-id",          required_argument, nullptr, 'i'},
-    {"non-japanese",     no_argument,       nullptr, 'j'},
-    {"new-licensee",     required_argument, nullptr, 'k'},
-    {"logo",             required_argument, nullptr, 'L'},
-    {"old-licensee",     required_argument, nullptr, 'l'},
-    {"mbc-type",         required_argument, nullptr, 'm'},
-    {"rom-version",      required_argument, nullptr, 'n'},
-    {"overwrite",        no_argument,       nullptr, 'O'},
-    {"pad-value",        required_argument, nullptr, 'p'},
-    {"ram-size",         required_argument, nullptr, 'r'},
-    {"sgb-compatible",   no_argument,       nullptr, 's'},
-    {"title",            required_argument, nullptr, 't'},
-    {"version",          no_argument,       nullptr, 'V'},
-    {"validate",         no_argument,       nullptr, 'v'},
-    {nullptr,            no_argument,       nullptr, 0  }
+    {"color-only",       no_argument,       nullptr,  'C'},
+    {"color-compatible", no_argument,       nullptr,  'c'},
+    {"fix-spec",         required_argument, nullptr,  'f'},
+    {"game-id",          required_argument, nullptr,  'i'},
+    {"non-japanese",     no_argument,       nullptr,  'j'},
+    {"jobs",             required_argument, &longOpt, 'j'},
+    {"new-licensee",     required_argument, nullptr,  'k'},
+    {"logo",             required_argument, nullptr,  'L'},
+    {"old-licensee",     required_argument, nullptr,  'l'},
+    {"mbc-type",         required_argument, nullptr,  'm'},
+    {"rom-version",      required_argument, nullptr,  'n'},
+    {"overwrite",        no_argument,       nullptr,  'O'},
+    {"pad-value",        required_argument, nullptr,  'p'},
+    {"ram-size",         required_argument, nullptr,  'r'},
+    {"sgb-compatible",   no_argument,       nullptr,  's'},
+    {"title",            required_argument, nullptr,  't'},
+    {"trace",            required_argument, &longOpt, 't'},
+    {"version",          no_argument,       nullptr,  'V'},
+    {"validate",         no_argument,       nullptr,  'v'},
+    {nullptr,            no_argument,       nullptr,  0  }
 };
 
 static void printUsage() {
 	fputs(
-	    "Usage: rgbfix [-jOsVv] [-C | -c] [-f <fix_spec>] [-i <game_id>] [-k <licensee>]\n"
-	    "              [-L <logo_file>] [-l <licensee_byte>] [-m <mbc_type>]\n"
+	    "Usage: rgbfix [-jOsVv] [-C | -c] [-f <fix_spec>] [-i <game_id>] [--jobs <jobs>]\n"
+	    "              [-k <licensee>] [-L <logo_file>] [-l <licensee_byte>] [-m <mbc_type>]\n"
 	    "              [-n <rom_version>] [-p <pad_value>] [-r <ram_size>] [-t <title_str>]\n"
-	    "              <file> ...\n"
+	    "              [--trace <file>] <file> ...\n"
 	    "Useful options:\n"
 	    "    -m, --mbc-type <value>      set the MBC type byte to this value; refer\n"
 	    "                                  to the man page for a list of values\n"
@@ -74,668 +90,20 @@ static void printUsage() {
 	);
 }
 
-static uint8_t nbErrors;
-
-[[gnu::format(printf, 1, 2)]] static void report(char const *fmt, ...) {
+// Each file's errors are counted separately, even when several files are fixed concurrently
+static thread_local uint8_t nbErrors;
+void report(char const *fmt, ...) {
 	va_list ap;
 
 	va_start(ap, fmt);
-	vfprintf(stderr, fmt, ap);
+	diag_VPrintf(fmt, ap);
 	va_end(ap);
 
 	if (nbErrors != UINT8_MAX)
 		nbErrors++;
 }
 
-enum MbcType {
-	ROM = 0x00,
-	ROM_RAM = 0x08,
-	ROM_RAM_BATTERY = 0x09,
-
-	MBC1 = 0x01,
-	MBC1_RAM = 0x02,
-	MBC1_RAM_BATTERY = 0x03,
-
-	MBC2 = 0x05,
-	MBC2_BATTERY = 0x06,
-
-	MMM01 = 0x0B,
-	MMM01_RAM = 0x0C,
-	MMM01_RAM_BATTERY = 0x0D,
-
-	MBC3 = 0x11,
-	MBC3_TIMER_BATTERY = 0x0F,
-	MBC3_TIMER_RAM_BATTERY = 0x10,
-	MBC3_RAM = 0x12,
-	MBC3_RAM_BATTERY = 0x13,
-
-	MBC5 = 0x19,
-	MBC5_RAM = 0x1A,
-	MBC5_RAM_BATTERY = 0x1B,
-	MBC5_RUMBLE = 0x1C,
-	MBC5_RUMBLE_RAM = 0x1D,
-	MBC5_RUMBLE_RAM_BATTERY = 0x1E,
-
-	MBC6 = 0x20,
-
-	MBC7_SENSOR_RUMBLE_RAM_BATTERY = 0x22,
-
-	POCKET_CAMERA = 0xFC,
-
-	BANDAI_TAMA5 = 0xFD,
-
-	HUC3 = 0xFE,
-
-	HUC1_RAM_BATTERY = 0xFF,
-
-	// "Extended" values (still valid, but not directly actionable)
-
-	// A high byte of 0x01 means TPP1, the low byte is the requested features
-	// This does not include SRAM, which is instead implied by a non-zero SRAM size
-	// Note: Multiple rumble speeds imply rumble
-	TPP1 = 0x100,
-	TPP1_RUMBLE = 0x101,
-	TPP1_MULTIRUMBLE = 0x102, // Should not be possible
-	TPP1_MULTIRUMBLE_RUMBLE = 0x103,
-	TPP1_TIMER = 0x104,
-	TPP1_TIMER_RUMBLE = 0x105,
-	TPP1_TIMER_MULTIRUMBLE = 0x106, // Should not be possible
-	TPP1_TIMER_MULTIRUMBLE_RUMBLE = 0x107,
-	TPP1_BATTERY = 0x108,
-	TPP1_BATTERY_RUMBLE = 0x109,
-	TPP1_BATTERY_MULTIRUMBLE = 0x10A, // Should not be possible
-	TPP1_BATTERY_MULTIRUMBLE_RUMBLE = 0x10B,
-	TPP1_BATTERY_TIMER = 0x10C,
-	TPP1_BATTERY_TIMER_RUMBLE = 0x10D,
-	TPP1_BATTERY_TIMER_MULTIRUMBLE = 0x10E, // Should not be possible
-	TPP1_BATTERY_TIMER_MULTIRUMBLE_RUMBLE = 0x10F,
-
-	// Error values
-	MBC_NONE = UNSPECIFIED, // No MBC specified, do not act on it
-	MBC_BAD,                // Specified MBC does not exist / syntax error
-	MBC_WRONG_FEATURES,     // MBC incompatible with specified features
-	MBC_BAD_RANGE,          // MBC number out of range
-};
-
-static void printAcceptedMBCNames() {
-	fputs("\tROM ($00) [aka ROM_ONLY]\n", stderr);
-	fputs("\tMBC1 ($01), MBC1+RAM ($02), MBC1+RAM+BATTERY ($03)\n", stderr);
-	fputs("\tMBC2 ($05), MBC2+BATTERY ($06)\n", stderr);
-	fputs("\tROM+RAM ($08) [deprecated], ROM+RAM+BATTERY ($09) [deprecated]\n", stderr);
-	fputs("\tMMM01 ($0B), MMM01+RAM ($0C), MMM01+RAM+BATTERY ($0D)\n", stderr);
-	fputs("\tMBC3+TIMER+BATTERY ($0F), MBC3+TIMER+RAM+BATTERY ($10)\n", stderr);
-	fputs("\tMBC3 ($11), MBC3+RAM ($12), MBC3+RAM+BATTERY ($13)\n", stderr);
-	fputs("\tMBC5 ($19), MBC5+RAM ($1A), MBC5+RAM+BATTERY ($1B)\n", stderr);
-	fputs("\tMBC5+RUMBLE ($1C), MBC5+RUMBLE+RAM ($1D), MBC5+RUMBLE+RAM+BATTERY ($1E)\n", stderr);
-	fputs("\tMBC6 ($20)\n", stderr);
-	fputs("\tMBC7+SENSOR+RUMBLE+RAM+BATTERY ($22)\n", stderr);
-	fputs("\tPOCKET_CAMERA ($FC)\n", stderr);
-	fputs("\tBANDAI_TAMA5 ($FD)\n", stderr);
-	fputs("\tHUC3 ($FE)\n", stderr);
-	fputs("\tHUC1+RAM+BATTERY ($FF)\n", stderr);
-
-	fputs("\n\tTPP1_1.0, TPP1_1.0+RUMBLE, TPP1_1.0+MULTIRUMBLE, TPP1_1.0+TIMER,\n", stderr);
-	fputs("\tTPP1_1.0+TIMER+RUMBLE, TPP1_1.0+TIMER+MULTIRUMBLE, TPP1_1.0+BATTERY,\n", stderr);
-	fputs("\tTPP1_1.0+BATTERY+RUMBLE, TPP1_1.0+BATTERY+MULTIRUMBLE,\n", stderr);
-	fputs("\tTPP1_1.0+BATTERY+TIMER, TPP1_1.0+BATTERY+TIMER+RUMBLE,\n", stderr);
-	fputs("\tTPP1_1.0+BATTERY+TIMER+MULTIRUMBLE\n", stderr);
-}
-
-static uint8_t tpp1Rev[2];
-
-/*
- * @return False on failure
- */
-static bool readMBCSlice(char const *&name, char const *expected) {
-	while (*expected) {
-		char c = *name++;
-
-		if (c == '\0') // Name too short
-			return false;
-
-		if (c >= 'a' && c <= 'z') // Perform the comparison case-insensitive
-			c = c - 'a' + 'A';
-		else if (c == '_') // Treat underscores as spaces
-			c = ' ';
-
-		if (c != *expected++)
-			return false;
-	}
-	return true;
-}
-
-static MbcType parseMBC(char const *name) {
-	if (!strcasecmp(name, "help")) {
-		fputs("Accepted MBC names:\n", stderr);
-		printAcceptedMBCNames();
-		exit(0);
-	}
-
-	if ((name[0] >= '0' && name[0] <= '9') || name[0] == '$') {
-		int base = 0;
-
-		if (name[0] == '$') {
-			name++;
-			base = 16;
-		}
-		// Parse number, and return it as-is (unless it's too large)
-		char *endptr;
-		unsigned long mbc = strtoul(name, &endptr, base);
-
-		if (*endptr)
-			return MBC_BAD;
-		if (mbc > 0xFF)
-			return MBC_BAD_RANGE;
-		return (MbcType)mbc;
-
-	} else {
-		// Begin by reading the MBC type:
-		uint16_t mbc;
-		char const *ptr = name;
-
-		// Trim off leading whitespace
-		while (*ptr == ' ' || *ptr == '\t')
-			ptr++;
-
-#define tryReadSlice(expected) \
-	do { \
-		if (!readMBCSlice(ptr, expected)) \
-			return MBC_BAD; \
-	} while (0)
-
-		switch (*ptr++) {
-		case 'R': // ROM / ROM_ONLY
-		case 'r':
-			tryReadSlice("OM");
-			// Handle optional " ONLY"
-			while (*ptr == ' ' || *ptr == '\t' || *ptr == '_')
-				ptr++;
-			if (*ptr == 'O' || *ptr == 'o') {
-				ptr++;
-				tryReadSlice("NLY");
-			}
-			mbc = ROM;
-			break;
-
-		case 'M': // MBC{1, 2, 3, 5, 6, 7} / MMM01
-		case 'm':
-			switch (*ptr++) {
-			case 'B':
-			case 'b':
-				switch (*ptr++) {
-				case 'C':
-				case 'c':
-					break;
-				default:
-					return MBC_BAD;
-				}
-				switch (*ptr++) {
-				case '1':
-					mbc = MBC1;
-					break;
-				case '2':
-					mbc = MBC2;
-					break;
-				case '3':
-					mbc = MBC3;
-					break;
-				case '5':
-					mbc = MBC5;
-					break;
-				case '6':
-					mbc = MBC6;
-					break;
-				case '7':
-					mbc = MBC7_SENSOR_RUMBLE_RAM_BATTERY;
-					break;
-				default:
-					return MBC_BAD;
-				}
-				break;
-			case 'M':
-			case 'm':
-				tryReadSlice("M01");
-				mbc = MMM01;
-				break;
-			default:
-				return MBC_BAD;
-			}
-			break;
-
-		case 'P': // POCKET_CAMERA
-		case 'p':
-			tryReadSlice("OCKET CAMERA");
-			mbc = POCKET_CAMERA;
-			break;
-
-		case 'B': // BANDAI_TAMA5
-		case 'b':
-			tryReadSlice("ANDAI TAMA5");
-			mbc = BANDAI_TAMA5;
-			break;
-
-		case 'T': // TAMA5 / TPP1
-		case 't':
-			switch (*ptr++) {
-			case 'A':
-				tryReadSlice("MA5");
-				mbc = BANDAI_TAMA5;
-				break;
-			case 'P': {
-				tryReadSlice("P1");
-				// Parse version
-				while (*ptr == ' ' || *ptr == '_')
-					ptr++;
-				// Major
-				char *endptr;
-				unsigned long val = strtoul(ptr, &endptr, 10);
-
-				if (endptr == ptr) {
-					report("error: Failed to parse TPP1 major revision number\n");
-					return MBC_BAD;
-				}
-				ptr = endptr;
-				if (val != 1) {
-					report("error: RGBFIX only supports TPP1 versions 1.0\n");
-					return MBC_BAD;
-				}
-				tpp1Rev[0] = val;
-				tryReadSlice(".");
-				// Minor
-				val = strtoul(ptr, &endptr, 10);
-				if (endptr == ptr) {
-					report("error: Failed to parse TPP1 minor revision number\n");
-					return MBC_BAD;
-				}
-				ptr = endptr;
-				if (val > 0xFF) {
-					report("error: TPP1 minor revision number must be 8-bit\n");
-					return MBC_BAD;
-				}
-				tpp1Rev[1] = val;
-				mbc = TPP1;
-				break;
-			}
-			default:
-				return MBC_BAD;
-			}
-			break;
-
-		case 'H': // HuC{1, 3}
-		case 'h':
-			tryReadSlice("UC");
-			switch (*ptr++) {
-			case '1':
-				mbc = HUC1_RAM_BATTERY;
-				break;
-			case '3':
-				mbc = HUC3;
-				break;
-			default:
-				return MBC_BAD;
-			}
-			break;
-
-		default:
-			return MBC_BAD;
-		}
-
-		// Read "additional features"
-		uint8_t features = 0;
-#define RAM         (1 << 7)
-#define BATTERY     (1 << 6)
-#define TIMER       (1 << 5)
-#define RUMBLE      (1 << 4)
-#define SENSOR      (1 << 3)
-#define MULTIRUMBLE (1 << 2)
-
-		for (;;) {
-			// Trim off trailing whitespace
-			while (*ptr == ' ' || *ptr == '\t' || *ptr == '_')
-				ptr++;
-
-			// If done, start processing "features"
-			if (!*ptr)
-				break;
-			// We expect a '+' at this point
-			if (*ptr++ != '+')
-				return MBC_BAD;
-			// Trim off leading whitespace
-			while (*ptr == ' ' || *ptr == '\t' || *ptr == '_')
-				ptr++;
-
-			switch (*ptr++) {
-			case 'B': // BATTERY
-			case 'b':
-				tryReadSlice("ATTERY");
-				features |= BATTERY;
-				break;
-
-			case 'M':
-			case 'm':
-				tryReadSlice("ULTIRUMBLE");
-				features |= MULTIRUMBLE;
-				break;
-
-			case 'R': // RAM or RUMBLE
-			case 'r':
-				switch (*ptr++) {
-				case 'U':
-				case 'u':
-					tryReadSlice("MBLE");
-					features |= RUMBLE;
-					break;
-				case 'A':
-				case 'a':
-					if (*ptr != 'M' && *ptr != 'm')
-						return MBC_BAD;
-					ptr++;
-					features |= RAM;
-					break;
-				default:
-					return MBC_BAD;
-				}
-				break;
-
-			case 'S': // SENSOR
-			case 's':
-				tryReadSlice("ENSOR");
-				features |= SENSOR;
-				break;
-
-			case 'T': // TIMER
-			case 't':
-				tryReadSlice("IMER");
-				features |= TIMER;
-				break;
-
-			default:
-				return MBC_BAD;
-			}
-		}
-#undef tryReadSlice
-
-		switch (mbc) {
-		case ROM:
-			if (!features)
-				break;
-			mbc = ROM_RAM - 1;
-			static_assert(ROM_RAM + 1 == ROM_RAM_BATTERY, "Enum sanity check failed!");
-			static_assert(MBC1 + 1 == MBC1_RAM, "Enum sanity check failed!");
-			static_assert(MBC1 + 2 == MBC1_RAM_BATTERY, "Enum sanity check failed!");
-			static_assert(MMM01 + 1 == MMM01_RAM, "Enum sanity check failed!");
-			static_assert(MMM01 + 2 == MMM01_RAM_BATTERY, "Enum sanity check failed!");
-			[[fallthrough]];
-		case MBC1:
-		case MMM01:
-			if (features == RAM)
-				mbc++;
-			else if (features == (RAM | BATTERY))
-				mbc += 2;
-			else if (features)
-				return MBC_WRONG_FEATURES;
-			break;
-
-		case MBC2:
-			if (features == BATTERY)
-				mbc = MBC2_BATTERY;
-			else if (features)
-				return MBC_WRONG_FEATURES;
-			break;
-
-		case MBC3:
-			// Handle timer, which also requires battery
-			if (features & TIMER) {
-				if (!(features & BATTERY))
-					fprintf(stderr, "warning: MBC3+TIMER implies BATTERY\n");
-				features &= ~(TIMER | BATTERY); // Reset those bits
-				mbc = MBC3_TIMER_BATTERY;
-				// RAM is handled below
-			}
-			static_assert(MBC3 + 1 == MBC3_RAM, "Enum sanity check failed!");
-			static_assert(MBC3 + 2 == MBC3_RAM_BATTERY, "Enum sanity check failed!");
-			static_assert(
-			    MBC3_TIMER_BATTERY + 1 == MBC3_TIMER_RAM_BATTERY, "Enum sanity check failed!"
-			);
-			if (features == RAM)
-				mbc++;
-			else if (features == (RAM | BATTERY))
-				mbc += 2;
-			else if (features)
-				return MBC_WRONG_FEATURES;
-			break;
-
-		case MBC5:
-			if (features & RUMBLE) {
-				features &= ~RUMBLE;
-				mbc = MBC5_RUMBLE;
-			}
-			static_assert(MBC5 + 1 == MBC5_RAM, "Enum sanity check failed!");
-			static_assert(MBC5 + 2 == MBC5_RAM_BATTERY, "Enum sanity check failed!");
-			static_assert(MBC5_RUMBLE + 1 == MBC5_RUMBLE_RAM, "Enum sanity check failed!");
-			static_assert(MBC5_RUMBLE + 2 == MBC5_RUMBLE_RAM_BATTERY, "Enum sanity check failed!");
-			if (features == RAM)
-				mbc++;
-			else if (features == (RAM | BATTERY))
-				mbc += 2;
-			else if (features)
-				return MBC_WRONG_FEATURES;
-			break;
-
-		case MBC6:
-		case POCKET_CAMERA:
-		case BANDAI_TAMA5:
-		case HUC3:
-			// No extra features accepted
-			if (features)
-				return MBC_WRONG_FEATURES;
-			break;
-
-		case MBC7_SENSOR_RUMBLE_RAM_BATTERY:
-			if (features != (SENSOR | RUMBLE | RAM | BATTERY))
-				return MBC_WRONG_FEATURES;
-			break;
-
-		case HUC1_RAM_BATTERY:
-			if (features != (RAM | BATTERY)) // HuC1 expects RAM+BATTERY
-				return MBC_WRONG_FEATURES;
-			break;
-
-		case TPP1:
-			if (features & RAM)
-				fprintf(
-				    stderr, "warning: TPP1 requests RAM implicitly if given a non-zero RAM size"
-				);
-			if (features & BATTERY)
-				mbc |= 0x08;
-			if (features & TIMER)
-				mbc |= 0x04;
-			if (features & MULTIRUMBLE)
-				mbc |= 0x03; // Also set the rumble flag
-			if (features & RUMBLE)
-				mbc |= 0x01;
-			if (features & SENSOR)
-				return MBC_WRONG_FEATURES;
-			break;
-		}
-
-		// Trim off trailing whitespace
-		while (*ptr == ' ' || *ptr == '\t')
-			ptr++;
-
-		// If there is still something past the whitespace, error out
-		if (*ptr)
-			return MBC_BAD;
-
-		return (MbcType)mbc;
-	}
-}
-
-static char const *mbcName(MbcType type) {
-	switch (type) {
-	case ROM:
-		return "ROM";
-	case ROM_RAM:
-		return "ROM+RAM";
-	case ROM_RAM_BATTERY:
-		return "ROM+RAM+BATTERY";
-	case MBC1:
-		return "MBC1";
-	case MBC1_RAM:
-		return "MBC1+RAM";
-	case MBC1_RAM_BATTERY:
-		return "MBC1+RAM+BATTERY";
-	case MBC2:
-		return "MBC2";
-	case MBC2_BATTERY:
-		return "MBC2+BATTERY";
-	case MMM01:
-		return "MMM01";
-	case MMM01_RAM:
-		return "MMM01+RAM";
-	case MMM01_RAM_BATTERY:
-		return "MMM01+RAM+BATTERY";
-	case MBC3:
-		return "MBC3";
-	case MBC3_TIMER_BATTERY:
-		return "MBC3+TIMER+BATTERY";
-	case MBC3_TIMER_RAM_BATTERY:
-		return "MBC3+TIMER+RAM+BATTERY";
-	case MBC3_RAM:
-		return "MBC3+RAM";
-	case MBC3_RAM_BATTERY:
-		return "MBC3+RAM+BATTERY";
-	case MBC5:
-		return "MBC5";
-	case MBC5_RAM:
-		return "MBC5+RAM";
-	case MBC5_RAM_BATTERY:
-		return "MBC5+RAM+BATTERY";
-	case MBC5_RUMBLE:
-		return "MBC5+RUMBLE";
-	case MBC5_RUMBLE_RAM:
-		return "MBC5+RUMBLE+RAM";
-	case MBC5_RUMBLE_RAM_BATTERY:
-		return "MBC5+RUMBLE+RAM+BATTERY";
-	case MBC6:
-		return "MBC6";
-	case MBC7_SENSOR_RUMBLE_RAM_BATTERY:
-		return "MBC7+SENSOR+RUMBLE+RAM+BATTERY";
-	case POCKET_CAMERA:
-		return "POCKET CAMERA";
-	case BANDAI_TAMA5:
-		return "BANDAI TAMA5";
-	case HUC3:
-		return "HUC3";
-	case HUC1_RAM_BATTERY:
-		return "HUC1+RAM+BATTERY";
-	case TPP1:
-		return "TPP1";
-	case TPP1_RUMBLE:
-		return "TPP1+RUMBLE";
-	case TPP1_MULTIRUMBLE:
-	case TPP1_MULTIRUMBLE_RUMBLE:
-		return "TPP1+MULTIRUMBLE";
-	case TPP1_TIMER:
-		return "TPP1+TIMER";
-	case TPP1_TIMER_RUMBLE:
-		return "TPP1+TIMER+RUMBLE";
-	case TPP1_TIMER_MULTIRUMBLE:
-	case TPP1_TIMER_MULTIRUMBLE_RUMBLE:
-		return "TPP1+TIMER+MULTIRUMBLE";
-	case TPP1_BATTERY:
-		return "TPP1+BATTERY";
-	case TPP1_BATTERY_RUMBLE:
-		return "TPP1+BATTERY+RUMBLE";
-	case TPP1_BATTERY_MULTIRUMBLE:
-	case TPP1_BATTERY_MULTIRUMBLE_RUMBLE:
-		return "TPP1+BATTERY+MULTIRUMBLE";
-	case TPP1_BATTERY_TIMER:
-		return "TPP1+BATTERY+TIMER";
-	case TPP1_BATTERY_TIMER_RUMBLE:
-		return "TPP1+BATTERY+TIMER+RUMBLE";
-	case TPP1_BATTERY_TIMER_MULTIRUMBLE:
-	case TPP1_BATTERY_TIMER_MULTIRUMBLE_RUMBLE:
-		return "TPP1+BATTERY+TIMER+MULTIRUMBLE";
-
-	// Error values
-	case MBC_NONE:
-	case MBC_BAD:
-	case MBC_WRONG_FEATURES:
-	case MBC_BAD_RANGE:
-		unreachable_();
-	}
-
-	unreachable_();
-}
-
-static bool hasRAM(MbcType type) {
-	switch (type) {
-	case ROM:
-	case MBC1:
-	case MBC2: // Technically has RAM, but not marked as such
-	case MBC2_BATTERY:
-	case MMM01:
-	case MBC3:
-	case MBC3_TIMER_BATTERY:
-	case MBC5:
-	case MBC5_RUMBLE:
-	case MBC6:         // TODO: not sure
-	case BANDAI_TAMA5: // TODO: not sure
-	case MBC_NONE:
-	case MBC_BAD:
-	case MBC_WRONG_FEATURES:
-	case MBC_BAD_RANGE:
-		return false;
-
-	case ROM_RAM:
-	case ROM_RAM_BATTERY:
-	case MBC1_RAM:
-	case MBC1_RAM_BATTERY:
-	case MMM01_RAM:
-	case MMM01_RAM_BATTERY:
-	case MBC3_TIMER_RAM_BATTERY:
-	case MBC3_RAM:
-	case MBC3_RAM_BATTERY:
-	case MBC5_RAM:
-	case MBC5_RAM_BATTERY:
-	case MBC5_RUMBLE_RAM:
-	case MBC5_RUMBLE_RAM_BATTERY:
-	case MBC7_SENSOR_RUMBLE_RAM_BATTERY:
-	case POCKET_CAMERA:
-	case HUC3:
-	case HUC1_RAM_BATTERY:
-		return true;
-
-	// TPP1 may or may not have RAM, don't call this function for it
-	case TPP1:
-	case TPP1_RUMBLE:
-	case TPP1_MULTIRUMBLE:
-	case TPP1_MULTIRUMBLE_RUMBLE:
-	case TPP1_TIMER:
-	case TPP1_TIMER_RUMBLE:
-	case TPP1_TIMER_MULTIRUMBLE:
-	case TPP1_TIMER_MULTIRUMBLE_RUMBLE:
-	case TPP1_BATTERY:
-	case TPP1_BATTERY_RUMBLE:
-	case TPP1_BATTERY_MULTIRUMBLE:
-	case TPP1_BATTERY_MULTIRUMBLE_RUMBLE:
-	case TPP1_BATTERY_TIMER:
-	case TPP1_BATTERY_TIMER_RUMBLE:
-	case TPP1_BATTERY_TIMER_MULTIRUMBLE:
-	case TPP1_BATTERY_TIMER_MULTIRUMBLE_RUMBLE:
-		break;
-	}
-
-	unreachable_();
-}
-
-static uint8_t const nintendoLogo[] = {
-    0xCE, 0xED, 0x66, 0x66, 0xCC, 0x0D, 0x00, 0x0B, 0x03, 0x73, 0x00, 0x83, 0x00, 0x0C, 0x00, 0x0D,
-    0x00, 0x08, 0x11, 0x1F, 0x88, 0x89, 0x00, 0x0E, 0xDC, 0xCC, 0x6E, 0xE6, 0xDD, 0xDD, 0xD9, 0x99,
-    0xBB, 0xBB, 0x67, 0x63, 0x6E, 0x0E, 0xEC, 0xCC, 0xDD, 0xDC, 0x99, 0x9F, 0xBB, 0xB9, 0x33, 0x3E,
-};
-
+static unsigned long nbJobs = 1; // --jobs
 static uint8_t fixSpec = 0;
 #define FIX_LOGO         (1 << 7)
 #define TRASH_LOGO       (1 << 6)
@@ -815,6 +183,46 @@ static ssize_t writeBytes(int fd, uint8_t *buf, size_t len) {
 	return total;
 }
 
+/*
+ * Adds up the bytes of a regular file from its current position to its end
+ * @param input File descriptor to be read from
+ * @param offset The current position in the file
+ * @param fileSize The file's size
+ * @return The sum of the bytes, modulo 65536
+ */
+static uint16_t sumRestOfFile(int input, off_t offset, off_t fileSize) {
+#ifdef HAS_MMAP
+	// Mapping the file avoids copying all of it through a buffer
+	if (offset < fileSize) {
+		if (void *mappingAddr = mmap(nullptr, fileSize, PROT_READ, MAP_SHARED, input, 0);
+		    mappingAddr != MAP_FAILED) {
+			uint16_t sum = sumBytes((uint8_t const *)mappingAddr + offset, fileSize - offset);
+
+			munmap(mappingAddr, fileSize);
+			return sum;
+		}
+	}
+#else
+	(void)offset;
+	(void)fileSize;
+#endif
+
+	// Sometimes mmap() fails or isn't available, so have a fallback
+	uint16_t sum = 0;
+	uint8_t bank[BANK_SIZE];
+
+	for (;;) {
+		ssize_t bankLen = readBytes(input, bank, sizeof(bank));
+
+		if (bankLen > 0)
+			sum += sumBytes(bank, bankLen);
+		if (bankLen != sizeof(bank))
+			break;
+	}
+
+	return sum;
+}
+
 /*
  * @param rom0 A pointer to rom0
  * @param addr What address to check
@@ -825,7 +233,7 @@ static void overwriteByte(uint8_t *rom0, uint16_t addr, uint8_t fixedByte, char
 	uint8_t origByte = rom0[addr];
 
 	if (!overwriteRom && origByte != 0 && origByte != fixedByte)
-		fprintf(stderr, "warning: Overwrote a non-zero byte in the %s\n", areaName);
+		diag_Printf("warning: Overwrote a non-zero byte in the %s\n", areaName);
 
 	rom0[addr] = fixedByte;
 }
@@ -845,7 +253,7 @@ static void overwriteBytes(
 			uint8_t origByte = rom0[i + startAddr];
 
 			if (origByte != 0 && origByte != fixed[i]) {
-				fprintf(stderr, "warning: Overwrote a non-zero byte in the %s\n", areaName);
+				diag_Printf("warning: Overwrote a non-zero byte in the %s\n", areaName);
 				break;
 			}
 		}
@@ -1000,8 +408,7 @@ static void processFile(int input, int output, char const *name, off_t fileSize)
 				nbBanks++;
 
 				// Update global checksum, too
-				for (uint16_t i = 0; i < bankLen; i++)
-					globalSum += romx[totalRomxLen + i];
+				globalSum += sumBytes(&romx[totalRomxLen], bankLen);
 				totalRomxLen += bankLen;
 			}
 			// Stop when an incomplete bank has been read
@@ -1054,21 +461,11 @@ static void processFile(int input, int output, char const *name, off_t fileSize)
 	if (fixSpec & (FIX_GLOBAL_SUM | TRASH_GLOBAL_SUM)) {
 		// Computation of the global checksum does not include the checksum bytes
 		assume(rom0Len >= 0x14E);
-		for (uint16_t i = 0; i < 0x14E; i++)
-			globalSum += rom0[i];
-		for (uint16_t i = 0x150; i < rom0Len; i++)
-			globalSum += rom0[i];
+		globalSum += sumBytes(rom0, 0x14E);
+		globalSum += sumBytes(&rom0[0x150], rom0Len - 0x150);
 		// Pipes have already read ROMX and updated globalSum, but not regular files
-		if (input == output) {
-			for (;;) {
-				ssize_t bankLen = readBytes(input, bank, sizeof(bank));
-
-				for (uint16_t i = 0; i < bankLen; i++)
-					globalSum += bank[i];
-				if (bankLen != sizeof(bank))
-					break;
-			}
-		}
+		if (input == output)
+			globalSum += sumRestOfFile(input, rom0Len, fileSize);
 
 		if (fixSpec & TRASH_GLOBAL_SUM)
 			globalSum = ~globalSum;
@@ -1154,6 +551,7 @@ static void processFile(int input, int output, char const *name, off_t fileSize)
 }
 
 static bool processFilename(char const *name) {
+	TracePhase phase("fix_rom", name);
 	nbErrors = 0;
 
 	if (!strcmp(name, "-")) {
@@ -1194,8 +592,7 @@ static bool processFilename(char const *name) {
 	}
 
 	if (nbErrors)
-		fprintf(
-		    stderr,
+		diag_Printf(
 		    "Fixing \"%s\" failed with %u error%s\n",
 		    name,
 		    nbErrors,
@@ -1204,6 +601,20 @@ static bool processFilename(char const *name) {
 	return nbErrors;
 }
 
+/*
+ * Fixes several files concurrently, their diagnostics being printed in order
+ * @param names The files' names
+ * @return Whether any of them failed
+ */
+static bool processFilenames(std::vector<char const *> const &names) {
+	std::vector<uint8_t> hasFailed(names.size(), false);
+
+	diag_RunTasks(names.size(), nbJobs, [&](size_t i) {
+		hasFailed[i] = processFilename(names[i]);
+	});
+	return std::find(RANGE(hasFailed), true) != hasFailed.end();
+}
+
 static void parseByte(uint16_t &output, char name) {
 	if (musl_optarg[0] == 0) {
 		report("error: Argument to option '%c' may not be empty\n", name);
@@ -1309,25 +720,7 @@ int main(int argc, char *argv[]) {
 			break;
 
 		case 'm':
-			cartridgeType = parseMBC(musl_optarg);
-			if (cartridgeType == MBC_BAD) {
-				report("error: Unknown MBC \"%s\"\nAccepted MBC names:\n", musl_optarg);
-				printAcceptedMBCNames();
-			} else if (cartridgeType == MBC_WRONG_FEATURES) {
-				report(
-				    "error: Features incompatible with MBC (\"%s\")\nAccepted combinations:\n",
-				    musl_optarg
-				);
-				printAcceptedMBCNames();
-			} else if (cartridgeType == MBC_BAD_RANGE) {
-				report("error: Specified MBC ID out of range 0-255: %s\n", musl_optarg);
-			} else if (cartridgeType == ROM_RAM || cartridgeType == ROM_RAM_BATTERY) {
-				fprintf(
-				    stderr,
-				    "warning: ROM+RAM / ROM+RAM+BATTERY are under-specified and poorly "
-				    "supported\n"
-				);
-			}
+			cartridgeType = parseMBCOption(musl_optarg);
 			break;
 
 		case 'n':
@@ -1371,6 +764,28 @@ int main(int argc, char *argv[]) {
 			fixSpec = FIX_LOGO | FIX_HEADER_SUM | FIX_GLOBAL_SUM;
 			break;
 
+		// Long-only options
+		case 0:
+			switch (longOpt) {
+				char *endptr;
+
+			case 'j':
+				nbJobs = strtoul(musl_optarg, &endptr, 0);
+				if (musl_optarg[0] == '\0' || *endptr != '\0') {
+					report("error: Invalid argument for option '--jobs'\n");
+					nbJobs = 1;
+				} else if (nbJobs == 0) {
+					report("error: Argument for option '--jobs' must be at least 1\n");
+					nbJobs = 1;
+				}
+				break;
+
+			case 't':
+				traceFileName = musl_optarg;
+				break;
+			}
+			break;
+
 		default:
 			fprintf(stderr, "FATAL: unknown option '%c'\n", ch);
 			printUsage();
@@ -1384,38 +799,7 @@ int main(int argc, char *argv[]) {
 		    "warning: TPP1 overwrites region flag for its identification code, ignoring `-j`\n"
 		);
 
-	// Check that RAM size is correct for "standard" mappers
-	if (ramSize != UNSPECIFIED && (cartridgeType & 0xFF00) == 0) {
-		if (cartridgeType == ROM_RAM || cartridgeType == ROM_RAM_BATTERY) {
-			if (ramSize != 1)
-				fprintf(
-				    stderr,
-				    "warning: MBC \"%s\" should have 2 KiB of RAM (-r 1)\n",
-				    mbcName(cartridgeType)
-				);
-		} else if (hasRAM(cartridgeType)) {
-			if (!ramSize) {
-				fprintf(
-				    stderr,
-				    "warning: MBC \"%s\" has RAM, but RAM size was set to 0\n",
-				    mbcName(cartridgeType)
-				);
-			} else if (ramSize == 1) {
-				fprintf(
-				    stderr,
-				    "warning: RAM size 1 (2 KiB) was specified for MBC \"%s\"\n",
-				    mbcName(cartridgeType)
-				);
-			} // TODO: check possible values?
-		} else if (ramSize) {
-			fprintf(
-			    stderr,
-			    "warning: MBC \"%s\" has no RAM, but RAM size was set to %u\n",
-			    mbcName(cartridgeType),
-			    ramSize
-			);
-		}
-	}
+	checkRAMSize(cartridgeType, ramSize);
 
 	if (sgb && oldLicensee != UNSPECIFIED && oldLicensee != 0x33)
 		fprintf(
@@ -1476,6 +860,8 @@ int main(int argc, char *argv[]) {
 			logo[i] = 0xFF ^ logo[i];
 	}
 
+	trace_Start("rgbfix", traceFileName);
+
 	if (!*argv) {
 		fputs(
 		    "FATAL: Please specify an input file (pass `-` to read from standard input)\n", stderr
@@ -1484,6 +870,13 @@ int main(int argc, char *argv[]) {
 		exit(1);
 	}
 
+	if (nbJobs > 1 && argv[1]) {
+		std::vector<char const *> names;
+		for (; *argv; argv++)
+			names.push_back(*argv);
+		return processFilenames(names) || failed;
+	}
+
 	do {
 		failed |= processFilename(*argv);
 	} while (*++argv);
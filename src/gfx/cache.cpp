@@ -0,0 +1,264 @@
+/* SPDX-License-Identifier: MIT */
+
+#include "gfx/cache.hpp"
+#include <sys/stat.h>
+
+#include <array>
+#include <errno.h>
+#include <inttypes.h>
+#include <optional>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "helpers.hpp"
+#include "platform.hpp" // S_ISDIR (stat macro), getpid
+#include "util.hpp"
+#include "version.hpp"
+
+#include "gfx/main.hpp"
+
+// The outputs, in the order that they are stored in cache files
+static std::array<std::string const *, 5> outputPaths() {
+	return {
+	    &options.output, &options.tilemap, &options.attrmap, &options.palettes, &options.palmap
+	};
+}
+
+static void putByte(std::string &buf, uint8_t byte) {
+	buf.push_back(byte);
+}
+
+static void putLong(std::string &buf, uint32_t value) {
+	for (unsigned shift = 0; shift < 32; shift += 8) {
+		putByte(buf, value >> shift);
+	}
+}
+
+static void putQuad(std::string &buf, uint64_t value) {
+	putLong(buf, value);
+	putLong(buf, value >> 32);
+}
+
+static void putString(std::string &buf, std::string const &str) {
+	putLong(buf, str.size());
+	buf.append(str);
+}
+
+static std::optional<std::string> readFile(std::string const &path) {
+	FILE *file = fopen(path.c_str(), "rb");
+	if (!file) {
+		return std::nullopt;
+	}
+	Defer closeFile{[&] { fclose(file); }};
+
+	std::string contents;
+	char buf[BUFSIZ];
+	for (size_t nbRead; (nbRead = fread(buf, 1, sizeof(buf), file)) != 0;) {
+		contents.append(buf, nbRead);
+	}
+	if (ferror(file)) {
+		return std::nullopt;
+	}
+	return contents;
+}
+
+/*
+ * Serializes everything that the outputs depend on: the options (but not where the outputs go),
+ * and the input image's contents. Returns nothing if the image cannot be read.
+ */
+static std::optional<std::string> getCacheKey() {
+	std::string key;
+
+	// Other versions may convert images differently
+	putString(key, get_package_version_string());
+
+	putByte(key, options.useColorCurve);
+	putByte(key, options.allowMirroring);
+	putByte(key, options.allowDedup);
+	putByte(key, options.columnMajor);
+	putByte(key, options.baseTileIDs[0]);
+	putByte(key, options.baseTileIDs[1]);
+	putByte(key, options.palSpecType);
+	putLong(key, options.palSpec.size());
+	for (auto const &pal : options.palSpec) {
+		for (auto const &color : pal) {
+			putByte(key, color.has_value());
+			putLong(key, color ? color->toCSS() : 0);
+		}
+	}
+	putByte(key, options.bitDepth);
+	putLong(key, options.inputSlice.left);
+	putLong(key, options.inputSlice.top);
+	putLong(key, options.inputSlice.width);
+	putLong(key, options.inputSlice.height);
+	putLong(key, options.maxNbTiles[0]);
+	putLong(key, options.maxNbTiles[1]);
+	putByte(key, options.nbPalettes);
+	putByte(key, options.nbColorsPerPal);
+	putQuad(key, options.trim);
+	for (std::string const *path : outputPaths()) {
+		putByte(key, !path->empty());
+	}
+
+	FILE *file = fopen(options.input.c_str(), "rb");
+	if (!file) {
+		return std::nullopt;
+	}
+	Defer closeFile{[&] { fclose(file); }};
+
+	uint64_t hash = hashFNV1a(nullptr, 0);
+	char buf[BUFSIZ];
+	for (size_t nbRead; (nbRead = fread(buf, 1, sizeof(buf), file)) != 0;) {
+		hash = hashFNV1a(buf, nbRead, hash);
+	}
+	if (ferror(file)) {
+		return std::nullopt;
+	}
+	putQuad(key, hash);
+
+	return key;
+}
+
+static std::string getCacheFilePath(std::string const &key) {
+	char name[sizeof("0123456789ABCDEF.rgbgfx")];
+	snprintf(name, sizeof(name), "%016" PRIX64 ".rgbgfx", hashFNV1a(key.data(), key.size()));
+
+	std::string path = options.cacheDir;
+	if (path.back() != '/') {
+		path += '/';
+	}
+	return path + name;
+}
+
+bool canUseCache() {
+	if (options.cacheDir.empty() || options.reverse() || options.input == "-") {
+		return false;
+	}
+	// Time-limited packing may not give the same result twice, and seeded packing depends on a
+	// file that is usually one of the outputs
+	if (options.packTime != 0 || !options.seedPalmap.empty()) {
+		return false;
+	}
+	// Outputs written to stdout cannot be read back to be stored
+	for (std::string const *path : outputPaths()) {
+		if (*path == "-") {
+			return false;
+		}
+	}
+
+	struct stat statBuf;
+	if (stat(options.cacheDir.c_str(), &statBuf) != 0 || !S_ISDIR(statBuf.st_mode)) {
+		fatal("Output cache \"%s\" is not a directory", options.cacheDir.c_str());
+	}
+	return true;
+}
+
+bool replayCachedOutputs() {
+	std::optional<std::string> key = getCacheKey();
+	if (!key) {
+		return false; // Let the conversion report the error
+	}
+	std::string cachePath = getCacheFilePath(*key);
+	std::optional<std::string> contents = readFile(cachePath);
+	if (!contents) {
+		return false; // No cache entry yet
+	}
+
+	// Check the whole entry before writing anything, since it may be truncated or collide
+	size_t offset = 0;
+	auto getLength = [&]() -> std::optional<size_t> {
+		if (contents->size() - offset < 4) {
+			return std::nullopt;
+		}
+		uint32_t length = 0;
+		for (unsigned shift = 0; shift < 32; shift += 8) {
+			length |= static_cast<uint32_t>(static_cast<uint8_t>((*contents)[offset++])) << shift;
+		}
+		if (length > contents->size() - offset) {
+			return std::nullopt;
+		}
+		return length;
+	};
+	std::optional<size_t> keyLength = getLength();
+	if (!keyLength || contents->compare(offset, *keyLength, *key) != 0) {
+		return false;
+	}
+	offset += *keyLength;
+
+	std::vector<std::pair<std::string const *, std::string_view>> outputs;
+	for (std::string const *path : outputPaths()) {
+		if (path->empty()) {
+			continue;
+		}
+		std::optional<size_t> length = getLength();
+		if (!length) {
+			return false;
+		}
+		outputs.emplace_back(path, std::string_view(*contents).substr(offset, *length));
+		offset += *length;
+	}
+	if (offset != contents->size()) {
+		return false;
+	}
+
+	options.verbosePrint(Options::VERB_LOG_ACT, "Copying outputs from %s\n", cachePath.c_str());
+	for (auto [path, data] : outputs) {
+		FILE *file = fopen(path->c_str(), "wb");
+		if (!file) {
+			fatal("Failed to create \"%s\": %s", path->c_str(), strerror(errno));
+		}
+		bool failed = fwrite(data.data(), 1, data.size(), file) != data.size();
+		if (fclose(file) != 0 || failed) {
+			fatal("Failed to write \"%s\": %s", path->c_str(), strerror(errno));
+		}
+	}
+	return true;
+}
+
+void cacheOutputs() {
+	std::optional<std::string> key = getCacheKey();
+	if (!key) {
+		return;
+	}
+
+	std::string buf;
+	putString(buf, *key);
+	for (std::string const *path : outputPaths()) {
+		if (path->empty()) {
+			continue;
+		}
+		std::optional<std::string> contents = readFile(*path);
+		if (!contents) {
+			warning("Failed to read back \"%s\" to cache it", path->c_str());
+			return;
+		}
+		putString(buf, *contents);
+	}
+
+	// Write to a temporary file first, so that concurrent conversions never read a partial file
+	std::string path = getCacheFilePath(*key);
+	std::string tmpPath = path + "." + std::to_string(getpid()) + ".tmp";
+
+	FILE *file = fopen(tmpPath.c_str(), "wb");
+	if (!file) {
+		warning("Failed to create output cache file \"%s\"", tmpPath.c_str());
+		return;
+	}
+	bool failed = fwrite(buf.data(), 1, buf.size(), file) != buf.size();
+	failed |= fclose(file) != 0;
+
+	// Windows' `rename` does not replace existing files
+	if (!failed && rename(tmpPath.c_str(), path.c_str()) != 0) {
+		remove(path.c_str());
+		failed = rename(tmpPath.c_str(), path.c_str()) != 0;
+	}
+	if (failed) {
+		warning("Failed to write output cache file \"%s\"", path.c_str());
+		remove(tmpPath.c_str());
+	}
+}
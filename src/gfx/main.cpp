@@ -4,23 +4,30 @@
 
 #include <algorithm>
 #include <ctype.h>
+#include <errno.h>
 #include <inttypes.h>
 #include <ios>
-#include <limits>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <string>
 #include <string_view>
 #include <type_traits>
 #include <vector>
+#ifndef _WIN32
+	#include <sys/wait.h>
+#endif
 
+#include "diagnostics.hpp"
 #include "extern/getopt.hpp"
 #include "file.hpp"
 #include "helpers.hpp" // assume
 #include "platform.hpp"
+#include "trace.hpp"
 #include "version.hpp"
 
+#include "gfx/cache.hpp"
 #include "gfx/pal_spec.hpp"
 #include "gfx/process.hpp"
 #include "gfx/reverse.hpp"
@@ -36,56 +43,63 @@ static struct LocalOptions {
 	bool autoPalettes;
 	bool autoPalmap;
 	bool groupOutputs;
+	bool sharedTiles;
 } localOptions;
 
-static uintmax_t nbErrors;
+// With `--shared-tiles`, the input images after the first one
+static std::vector<std::string> extraInputs;
+
+static void printAbortedSummary() {
+	uint32_t nbErrors = diag_NbErrors();
+	diag_Printf(
+	    "Conversion aborted after %" PRIu32 " error%s\n", nbErrors, nbErrors == 1 ? "" : "s"
+	);
+}
 
 [[noreturn]] void giveUp() {
-	fprintf(stderr, "Conversion aborted after %ju error%s\n", nbErrors, nbErrors == 1 ? "" : "s");
-	exit(1);
+	diag_Abort(printAbortedSummary);
 }
 
 void warning(char const *fmt, ...) {
 	va_list ap;
 
-	fputs("warning: ", stderr);
+	diag_Puts("warning: ");
 	va_start(ap, fmt);
-	vfprintf(stderr, fmt, ap);
+	diag_VPrintf(fmt, ap);
 	va_end(ap);
-	putc('\n', stderr);
+	diag_Putc('\n');
+
+	diag_CountWarning();
 }
 
 void error(char const *fmt, ...) {
 	va_list ap;
 
-	fputs("error: ", stderr);
+	diag_Puts("error: ");
 	va_start(ap, fmt);
-	vfprintf(stderr, fmt, ap);
+	diag_VPrintf(fmt, ap);
 	va_end(ap);
-	putc('\n', stderr);
+	diag_Putc('\n');
 
-	if (nbErrors != std::numeric_limits<decltype(nbErrors)>::max())
-		nbErrors++;
+	diag_CountError();
 }
 
 void errorMessage(char const *msg) {
-	fprintf(stderr, "error: %s\n", msg);
+	diag_Printf("error: %s\n", msg);
 
-	if (nbErrors != std::numeric_limits<decltype(nbErrors)>::max())
-		nbErrors++;
+	diag_CountError();
 }
 
 [[noreturn]] void fatal(char const *fmt, ...) {
 	va_list ap;
 
-	fputs("FATAL: ", stderr);
+	diag_Puts("FATAL: ");
 	va_start(ap, fmt);
-	vfprintf(stderr, fmt, ap);
+	diag_VPrintf(fmt, ap);
 	va_end(ap);
-	putc('\n', stderr);
+	diag_Putc('\n');
 
-	if (nbErrors != std::numeric_limits<decltype(nbErrors)>::max())
-		nbErrors++;
+	diag_CountError();
 
 	giveUp();
 }
@@ -95,13 +109,19 @@ void Options::verbosePrint(uint8_t level, char const *fmt, ...) const {
 		va_list ap;
 
 		va_start(ap, fmt);
-		vfprintf(stderr, fmt, ap);
+		diag_VPrintf(fmt, ap);
 		va_end(ap);
 	}
 }
 
 // Short options
-static char const *optstring = "-Aa:b:Cc:Dd:FfhL:mN:n:Oo:Pp:Qq:r:s:Tt:U:uVvx:Z";
+static char const *optstring = "-Aa:b:Cc:Dd:Ffhj:L:mN:n:Oo:Pp:Qq:r:s:Tt:U:uVvx:Z";
+
+// Variables for the long-only options `--batch`, `--cache-dir`, `--pack-time`,
+// `--seed-palette-map`, `--shared-tiles` and `--trace`
+static int longOpt;
+static char const *batchFileName = nullptr;
+static char const *traceFileName = nullptr;
 
 /*
  * Equivalent long options
@@ -115,24 +135,31 @@ static char const *optstring = "-Aa:b:Cc:Dd:FfhL:mN:n:Oo:Pp:Qq:r:s:Tt:U:uVvx:Z";
  */
 static option const longopts[] = {
     {"auto-attr-map",    no_argument,       nullptr, 'A'},
+    {"batch",            required_argument, &longOpt, 'b'},
     {"attr-map",         required_argument, nullptr, 'a'},
     {"base-tiles",       required_argument, nullptr, 'b'},
+    {"cache-dir",        required_argument, &longOpt, 'c'},
     {"color-curve",      no_argument,       nullptr, 'C'},
     {"colors",           required_argument, nullptr, 'c'},
     {"depth",            required_argument, nullptr, 'd'},
+    {"jobs",             required_argument, nullptr, 'j'},
     {"slice",            required_argument, nullptr, 'L'},
     {"mirror-tiles",     no_argument,       nullptr, 'm'},
     {"nb-tiles",         required_argument, nullptr, 'N'},
     {"nb-palettes",      required_argument, nullptr, 'n'},
     {"group-outputs",    no_argument,       nullptr, 'O'},
     {"output",           required_argument, nullptr, 'o'},
+    {"pack-time",        required_argument, &longOpt, 'p'},
     {"auto-palette",     no_argument,       nullptr, 'P'},
     {"palette",          required_argument, nullptr, 'p'},
     {"auto-palette-map", no_argument,       nullptr, 'Q'},
     {"palette-map",      required_argument, nullptr, 'q'},
+    {"seed-palette-map", required_argument, &longOpt, 'q'},
     {"reverse",          required_argument, nullptr, 'r'},
+    {"shared-tiles",     no_argument,       &longOpt, 's'},
     {"auto-tilemap",     no_argument,       nullptr, 'T'},
     {"tilemap",          required_argument, nullptr, 't'},
+    {"trace",            required_argument, &longOpt, 't'},
     {"unit-size",        required_argument, nullptr, 'U'},
     {"unique-tiles",     no_argument,       nullptr, 'u'},
     {"version",          no_argument,       nullptr, 'V'},
@@ -145,9 +172,11 @@ static option const longopts[] = {
 static void printUsage() {
 	fputs(
 	    "Usage: rgbgfx [-r stride] [-CmOuVZ] [-v [-v ...]] [-a <attr_map> | -A]\n"
-	    "       [-b <base_ids>] [-c <colors>] [-d <depth>] [-L <slice>] [-N <nb_tiles>]\n"
-	    "       [-n <nb_pals>] [-o <out_file>] [-p <pal_file> | -P] [-q <pal_map> | -Q]\n"
-	    "       [-s <nb_colors>] [-t <tile_map> | -T] [-x <nb_tiles>] <file>\n"
+	    "       [-b <base_ids>] [-c <colors>] [-d <depth>] [-j <jobs>] [-L <slice>]\n"
+	    "       [-N <nb_tiles>] [-n <nb_pals>] [-o <out_file>] [-p <pal_file> | -P]\n"
+	    "       [-q <pal_map> | -Q] [-s <nb_colors>] [-t <tile_map> | -T] [-x <nb_tiles>]\n"
+	    "       [--batch <manifest>] [--pack-time <ms>] [--seed-palette-map <pal_map>]\n"
+	    "       [--shared-tiles] [--trace <file>] <file>...\n"
 	    "Useful options:\n"
 	    "    -m, --mirror-tiles    optimize out mirrored tiles\n"
 	    "    -o, --output <path>   output the tile data to this path\n"
@@ -240,20 +269,13 @@ static void skipWhitespace(char *&arg) {
 }
 
 static void registerInput(char const *arg) {
-	if (!options.input.empty()) {
-		fprintf(
-		    stderr,
-		    "FATAL: input image specified more than once! (first \"%s\", then "
-		    "\"%s\")\n",
-		    options.input.c_str(),
-		    arg
-		);
-		printUsage();
-		exit(1);
-	} else if (arg[0] == '\0') { // Empty input path
+	if (arg[0] == '\0') { // Empty input path
 		fprintf(stderr, "FATAL: input image path cannot be empty\n");
 		printUsage();
 		exit(1);
+	} else if (!options.input.empty()) {
+		// Whether several images are allowed is only known once all options are parsed
+		extraInputs.push_back(arg);
 	} else {
 		options.input = arg;
 	}
@@ -262,8 +284,11 @@ static void registerInput(char const *arg) {
 /*
  * Turn an "at-file"'s contents into an argv that `getopt` can handle
  * @param argPool Argument characters will be appended to this vector, for storage purposes.
+ * @param lineStarts If provided, the index of each line's first argument is appended to it.
  */
-static std::vector<size_t> readAtFile(std::string const &path, std::vector<char> &argPool) {
+static std::vector<size_t> readAtFile(
+    std::string const &path, std::vector<char> &argPool, std::vector<size_t> *lineStarts = nullptr
+) {
 	File file;
 	if (!file.open(path, std::ios_base::in)) {
 		fatal("Error reading @%s: %s", file.c_str(path), strerror(errno));
@@ -304,6 +329,9 @@ static std::vector<size_t> readAtFile(std::string const &path, std::vector<char>
 		}
 
 		// Alright, now we can parse the line
+		if (lineStarts) {
+			lineStarts->push_back(argvOfs.size());
+		}
 		do {
 			// Read one argument (until the next whitespace char).
 			// We know there is one because we already have its first character in `c`.
@@ -418,6 +446,16 @@ static char *parseArgv(int argc, char *argv[]) {
 				options.bitDepth = 2;
 			}
 			break;
+		case 'j':
+			number = parseNumber(arg, "Number of jobs", 0);
+			if (*arg != '\0') {
+				error("Number of jobs (-j) must be a valid number, not \"%s\"", musl_optarg);
+			} else if (number == 0) {
+				error("Number of jobs (-j) may not be 0!");
+			} else {
+				options.nbJobs = number;
+			}
+			break;
 		case 'L':
 			options.inputSlice.left = parseNumber(arg, "Input slice left coordinate");
 			if (options.inputSlice.left > INT16_MAX) {
@@ -580,6 +618,44 @@ static char *parseArgv(int argc, char *argv[]) {
 		case 'Z':
 			options.columnMajor = true;
 			break;
+		// Long-only options
+		case 0:
+			switch (longOpt) {
+			case 'b':
+				if (batchFileName) {
+					warning("Overriding batch manifest %s", batchFileName);
+				}
+				batchFileName = musl_optarg;
+				break;
+			case 'c':
+				if (!options.cacheDir.empty()) {
+					warning("Overriding output cache %s", options.cacheDir.c_str());
+				}
+				options.cacheDir = musl_optarg;
+				break;
+			case 'p':
+				number = parseNumber(arg, "Packing time");
+				if (*arg != '\0') {
+					error("Packing time must be a valid number, not \"%s\"", musl_optarg);
+				} else {
+					options.packTime = number;
+				}
+				break;
+			case 'q':
+				if (!options.seedPalmap.empty()) {
+					warning("Overriding seed palette map %s", options.seedPalmap.c_str());
+				}
+				options.seedPalmap = musl_optarg;
+				break;
+			case 's':
+				localOptions.sharedTiles = true;
+				options.allowDedup = true; // Sharing tiles is pointless without deduplicating them
+				break;
+			case 't':
+				traceFileName = musl_optarg;
+				break;
+			}
+			break;
 		case 1: // Positional argument, requested by leading `-` in opt string
 			if (musl_optarg[0] == '@') {
 				// Instruct the caller to process that at-file
@@ -598,7 +674,10 @@ static char *parseArgv(int argc, char *argv[]) {
 	return nullptr; // Done processing this argv
 }
 
-int main(int argc, char *argv[]) {
+/*
+ * Parses an arg vector, and any at-files it refers to
+ */
+static void parseArgs(int argc, char *argv[]) {
 	struct AtFileStackEntry {
 		int parentInd;            // Saved offset into parent argv
 		std::vector<char *> argv; // This context's arg pointer vec
@@ -610,7 +689,8 @@ int main(int argc, char *argv[]) {
 
 	int curArgc = argc;
 	char **curArgv = argv;
-	std::vector<std::vector<char>> argPools;
+	// Options may point into the arg pools, so they must outlive the parsing
+	static std::vector<std::vector<char>> argPools;
 	for (;;) {
 		char *atFileName = parseArgv(curArgc, curArgv);
 		if (atFileName) {
@@ -662,18 +742,13 @@ int main(int argc, char *argv[]) {
 			curArgv = vec.data();
 		}
 	}
+}
 
-	if (options.nbColorsPerPal == 0) {
-		options.nbColorsPerPal = 1u << options.bitDepth;
-	} else if (options.nbColorsPerPal > 1u << options.bitDepth) {
-		error(
-		    "%" PRIu8 "bpp palettes can only contain %u colors, not %" PRIu8,
-		    options.bitDepth,
-		    1u << options.bitDepth,
-		    options.nbColorsPerPal
-		);
-	}
-
+/*
+ * Derives the paths of the outputs requested with -A, -P, -Q and -T from the input image's, or
+ * from the output tile data's with -O
+ */
+static void setAutoOutPaths() {
 	auto autoOutPath = [](bool autoOptEnabled, std::string &path, char const *extension) {
 		if (autoOptEnabled) {
 			auto &image = localOptions.groupOutputs ? options.output : options.input;
@@ -713,6 +788,48 @@ int main(int argc, char *argv[]) {
 	autoOutPath(localOptions.autoTilemap, options.tilemap, ".tilemap");
 	autoOutPath(localOptions.autoPalettes, options.palettes, ".pal");
 	autoOutPath(localOptions.autoPalmap, options.palmap, ".palmap");
+}
+
+/*
+ * Completes the options that depend on others, once they have all been parsed
+ */
+static void finishOptions() {
+	if (options.nbColorsPerPal == 0) {
+		options.nbColorsPerPal = 1u << options.bitDepth;
+	} else if (options.nbColorsPerPal > 1u << options.bitDepth) {
+		error(
+		    "%" PRIu8 "bpp palettes can only contain %u colors, not %" PRIu8,
+		    options.bitDepth,
+		    1u << options.bitDepth,
+		    options.nbColorsPerPal
+		);
+	}
+
+	if (!extraInputs.empty()) {
+		if (!localOptions.sharedTiles) {
+			fprintf(
+			    stderr,
+			    "FATAL: input image specified more than once! (first \"%s\", then "
+			    "\"%s\")\n",
+			    options.input.c_str(),
+			    extraInputs[0].c_str()
+			);
+			printUsage();
+			exit(1);
+		}
+		if (options.reverse()) {
+			fatal("Several input images cannot be generated from one tile data file");
+		}
+		// Each image gets its own maps and palettes, named after it
+		if (localOptions.groupOutputs || (!options.attrmap.empty() && !localOptions.autoAttrmap)
+		    || (!options.tilemap.empty() && !localOptions.autoTilemap)
+		    || (!options.palettes.empty() && !localOptions.autoPalettes)
+		    || (!options.palmap.empty() && !localOptions.autoPalmap)) {
+			fatal("With several input images, only -A, -P, -Q and -T can name their outputs");
+		}
+	}
+
+	setAutoOutPaths();
 
 	// Execute deferred external pal spec parsing, now that all other params are known
 	if (localOptions.externalPalSpec) {
@@ -760,9 +877,15 @@ int main(int argc, char *argv[]) {
 		if (options.useColorCurve)
 			fputs("\tUse color curve\n", stderr);
 		fprintf(stderr, "\tBit depth: %" PRIu8 "bpp\n", options.bitDepth);
+		if (options.nbJobs > 1)
+			fprintf(stderr, "\tUse %u threads\n", options.nbJobs);
 		if (options.trim != 0)
 			fprintf(stderr, "\tTrim the last %" PRIu64 " tiles\n", options.trim);
 		fprintf(stderr, "\tMaximum %" PRIu8 " palettes\n", options.nbPalettes);
+		if (options.packTime != 0)
+			fprintf(stderr, "\tPack palettes for at most %" PRIu32 " ms\n", options.packTime);
+		if (!options.seedPalmap.empty())
+			fprintf(stderr, "\tSeed palette packing with %s\n", options.seedPalmap.c_str());
 		fprintf(stderr, "\tPalettes contain %" PRIu8 " colors\n", options.nbColorsPerPal);
 		fprintf(stderr, "\t%s palette spec\n", [] {
 			switch (options.palSpecType) {
@@ -817,23 +940,45 @@ int main(int argc, char *argv[]) {
 			}
 		};
 		printPath("Input image", options.input);
+		printPath("Output cache", options.cacheDir);
 		printPath("Output tile data", options.output);
 		printPath("Output tilemap", options.tilemap);
 		printPath("Output attrmap", options.attrmap);
 		printPath("Output palettes", options.palettes);
 		fputs("Ready.\n", stderr);
 	}
+}
 
+/*
+ * Performs the conversion requested by the options, and returns the exit status
+ */
+static int convert() {
 	// Do not do anything if option parsing went wrong
-	if (nbErrors) {
+	if (diag_NbErrors() != 0) {
 		giveUp();
 	}
 
 	if (!options.input.empty()) {
 		if (options.reverse()) {
 			reverse();
-		} else {
+		} else if (localOptions.sharedTiles) {
+			// The tile data output depends on all the images, so it is not cached
+			extraInputs.insert(extraInputs.begin(), options.input);
+			for (std::string const &input : extraInputs) {
+				options.input = input;
+				setAutoOutPaths();
+				processSharedImage();
+			}
+			outputSharedTiles();
+		} else if (!canUseCache()) {
+			process();
+		} else if (!replayCachedOutputs()) {
+			// Replaying would not repeat the warnings, so only cache conversions without any
+			uint32_t nbWarnings = diag_NbWarnings();
 			process();
+			if (diag_NbWarnings() == nbWarnings) {
+				cacheOutputs();
+			}
 		}
 	} else if (!options.palettes.empty() && options.palSpecType == Options::EXPLICIT && !options.reverse()) {
 		processPalettes();
@@ -843,12 +988,118 @@ int main(int argc, char *argv[]) {
 		exit(1);
 	}
 
-	if (nbErrors) {
+	if (diag_NbErrors() != 0) {
 		giveUp();
 	}
 	return 0;
 }
 
+
+/*
+ * Converts each image listed in a manifest, one per line, with the options on its line applied on
+ * top of the ones given on the command line; and returns the exit status
+ */
+static int convertBatch(char const *manifestName) {
+	if (!options.input.empty()) {
+		fatal("Input images must be listed in the batch manifest, not given on the command line");
+	}
+
+	std::vector<char> argPool;
+	std::vector<size_t> lineStarts;
+	std::vector<size_t> offsets = readAtFile(manifestName, argPool, &lineStarts);
+	lineStarts.push_back(offsets.size());
+
+#ifdef _WIN32
+	fatal("Batch mode is not supported on this platform");
+#else
+	// Jobs inherit the options given so far, so the palette spec shared by all of them is parsed
+	// only once, unless a job overrides an option that it depends on
+	char const *sharedPalSpec = localOptions.externalPalSpec;
+	uint8_t sharedBitDepth = options.bitDepth;
+	uint8_t sharedNbColorsPerPal = options.nbColorsPerPal;
+	uint8_t sharedNbPalettes = options.nbPalettes;
+	if (sharedPalSpec) {
+		if (options.nbColorsPerPal == 0) {
+			options.nbColorsPerPal = 1u << options.bitDepth;
+		}
+		parseExternalPalSpec(sharedPalSpec);
+		options.nbColorsPerPal = sharedNbColorsPerPal;
+		localOptions.externalPalSpec = nullptr;
+		if (diag_NbErrors() != 0) {
+			giveUp();
+		}
+	}
+
+	// Each job runs in its own process, so `-j` sets how many of them run at once instead
+	unsigned int maxNbRunning = options.nbJobs;
+	options.nbJobs = 1;
+
+	// Avoid the children also writing what was buffered so far
+	fflush(stdout);
+	fflush(stderr);
+
+	unsigned int nbRunning = 0;
+	bool failed = false;
+	auto waitForJob = [&] {
+		int status;
+		if (wait(&status) == -1) {
+			fatal("Failed to wait for a conversion to finish: %s", strerror(errno));
+		}
+		--nbRunning;
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+			failed = true;
+		}
+	};
+
+	for (size_t i = 0; i + 1 < lineStarts.size(); ++i) {
+		if (nbRunning == maxNbRunning) {
+			waitForJob();
+		}
+
+		pid_t pid = fork();
+		if (pid == -1) {
+			fatal("Failed to start converting line %zu of the batch: %s", i + 1, strerror(errno));
+		}
+		if (pid == 0) {
+			// Copy the manifest's name as `argv[0]`, for error reporting
+			std::vector<char *> jobArgv{const_cast<char *>(manifestName)};
+			for (size_t j = lineStarts[i]; j < lineStarts[i + 1]; ++j) {
+				jobArgv.push_back(&argPool[offsets[j]]);
+			}
+			jobArgv.push_back(nullptr);
+
+			musl_optind = 1;
+			parseArgs(jobArgv.size() - 1, jobArgv.data());
+			if (sharedPalSpec && !localOptions.externalPalSpec
+			    && (options.bitDepth != sharedBitDepth
+			        || options.nbColorsPerPal != sharedNbColorsPerPal
+			        || options.nbPalettes != sharedNbPalettes)) {
+				options.palSpec.clear(); // Not all formats' parsers start from scratch
+				localOptions.externalPalSpec = sharedPalSpec;
+			}
+			finishOptions();
+			exit(convert());
+		}
+		++nbRunning;
+	}
+	while (nbRunning != 0) {
+		waitForJob();
+	}
+
+	return failed ? 1 : 0;
+#endif
+}
+
+int main(int argc, char *argv[]) {
+	parseArgs(argc, argv);
+	trace_Start("rgbgfx", traceFileName);
+	if (batchFileName) {
+		return convertBatch(batchFileName);
+	}
+	finishOptions();
+	return convert();
+}
+
 void Palette::addColor(uint16_t color) {
 	for (size_t i = 0; true; ++i) {
 		assume(i < colors.size()); // The packing should guarantee this
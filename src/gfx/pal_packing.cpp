@@ -3,12 +3,15 @@
 #include "gfx/pal_packing.hpp"
 
 #include <algorithm>
+#include <bit>
+#include <chrono>
 #include <deque>
 #include <inttypes.h>
 #include <optional>
 #include <queue>
+#include <stdint.h>
 #include <type_traits>
-#include <unordered_set>
+#include <unordered_map>
 
 #include "helpers.hpp"
 
@@ -19,6 +22,17 @@ using std::swap;
 
 namespace packing {
 
+using Clock = std::chrono::steady_clock;
+
+static Clock::time_point deadline; // Only used if `options.packTime` is set
+
+/*
+ * Returns whether packing should stop being refined and settle for what it has (`--pack-time`)
+ */
+static bool isOutOfTime() {
+	return options.packTime != 0 && Clock::now() >= deadline;
+}
+
 // The solvers here are picked from the paper at https://arxiv.org/abs/1605.00558:
 // "Algorithms for the Pagination Problem, a Bin Packing with Overlapping Items"
 // Their formulation of the problem consists in packing "tiles" into "pages"; here is a
@@ -28,6 +42,52 @@ namespace packing {
 //  Tile | Proto-palette
 //  Page | Palette
 
+/*
+ * A set of colors, identified by their dense IDs (see `overloadAndRemove`), as a bitset
+ * This makes computing the number of colors in a union a matter of OR-ing and counting bits
+ */
+class ColorSet {
+	std::vector<uint64_t> _words; // Grown as needed
+
+public:
+	void clear() { std::fill(RANGE(_words), 0); }
+	void add(uint16_t id) {
+		if (id / 64 >= _words.size()) {
+			_words.resize(id / 64 + 1, 0);
+		}
+		_words[id / 64] |= uint64_t(1) << (id % 64);
+	}
+	void add(ProtoPalette const &protoPal) {
+		for (uint16_t id : protoPal) {
+			add(id);
+		}
+	}
+	void remove(uint16_t id) { _words[id / 64] &= ~(uint64_t(1) << (id % 64)); }
+	bool contains(uint16_t id) const {
+		return id / 64 < _words.size() && _words[id / 64] & uint64_t(1) << (id % 64);
+	}
+	bool containsAnyOf(ProtoPalette const &protoPal) const {
+		return std::any_of(RANGE(protoPal), [this](uint16_t id) { return contains(id); });
+	}
+
+	size_t size() const {
+		size_t count = 0;
+		for (uint64_t word : _words) {
+			count += std::popcount(word);
+		}
+		return count;
+	}
+	size_t sizeOfUnion(ColorSet const &other) const {
+		size_t count = 0;
+		for (size_t i = 0; i < std::max(_words.size(), other._words.size()); ++i) {
+			uint64_t ours = i < _words.size() ? _words[i] : 0;
+			uint64_t theirs = i < other._words.size() ? other._words[i] : 0;
+			count += std::popcount(ours | theirs);
+		}
+		return count;
+	}
+};
+
 /*
  * A reference to a proto-palette, and attached attributes for sorting purposes
  */
@@ -60,11 +120,45 @@ class AssignedProtos {
 	std::vector<std::optional<ProtoPalAttrs>> _assigned;
 	// For resolving proto-palette indices
 	std::vector<ProtoPalette> const *_protoPals;
+	// The distinct colors of the proto-palettes, kept up to date along with how many of them
+	// contain each color (sorted by color), so that no operation has to collect them again
+	ColorSet _colors;
+	std::vector<std::pair<uint16_t, size_t>> _colorCounts;
+
+	void addColors(ProtoPalAttrs const &attrs) {
+		for (uint16_t id : (*_protoPals)[attrs.protoPalIndex]) {
+			auto count = std::lower_bound(RANGE(_colorCounts), std::pair{id, size_t(0)});
+			if (count == _colorCounts.end() || count->first != id) {
+				_colorCounts.emplace(count, id, 1);
+				_colors.add(id);
+			} else {
+				++count->second;
+			}
+		}
+	}
+	void removeColors(ProtoPalAttrs const &attrs) {
+		for (uint16_t id : (*_protoPals)[attrs.protoPalIndex]) {
+			auto count = std::lower_bound(RANGE(_colorCounts), std::pair{id, size_t(0)});
+			assume(count != _colorCounts.end() && count->first == id);
+			if (--count->second == 0) {
+				_colorCounts.erase(count);
+				_colors.remove(id);
+			}
+		}
+	}
+	size_t nbProtoPalsWith(uint16_t id) const {
+		auto count = std::lower_bound(RANGE(_colorCounts), std::pair{id, size_t(0)});
+		return count != _colorCounts.end() && count->first == id ? count->second : 0;
+	}
 
 public:
 	template<typename... Ts>
 	AssignedProtos(std::vector<ProtoPalette> const &protoPals, Ts &&...elems)
-	    : _assigned{std::forward<Ts>(elems)...}, _protoPals{&protoPals} {}
+	    : _assigned{std::forward<Ts>(elems)...}, _protoPals{&protoPals} {
+		for (ProtoPalAttrs const &attrs : *this) {
+			addColors(attrs);
+		}
+	}
 
 private:
 	template<typename Inner, template<typename> typename Constness>
@@ -140,15 +234,20 @@ public:
 		    });
 
 		if (freeSlot == _assigned.end()) { // We are full, use a new slot
-			_assigned.emplace_back(std::forward<Ts>(args)...);
+			addColors(_assigned.emplace_back(std::in_place, std::forward<Ts>(args)...).value());
 		} else { // Reuse a free slot
-			freeSlot->emplace(std::forward<Ts>(args)...);
+			addColors(freeSlot->emplace(std::forward<Ts>(args)...));
 		}
 	}
 	void remove(iterator const &iter) {
+		removeColors(**iter._iter);
 		iter._iter->reset(); // This time, we want to access the `optional` itself
 	}
-	void clear() { _assigned.clear(); }
+	void clear() {
+		_assigned.clear();
+		_colors.clear();
+		_colorCounts.clear();
+	}
 
 	bool empty() const {
 		return std::find_if(
@@ -159,87 +258,42 @@ public:
 	}
 	size_t nbProtoPals() const { return std::distance(RANGE(*this)); }
 
-private:
-	template<typename Iter>
-	static void addUniqueColors(
-	    std::unordered_set<uint16_t> &colors,
-	    Iter iter,
-	    Iter const &end,
-	    std::vector<ProtoPalette> const &protoPals
-	) {
-		for (; iter != end; ++iter) {
-			ProtoPalette const &protoPal = protoPals[iter->protoPalIndex];
-			colors.insert(RANGE(protoPal));
-		}
-	}
-	// This function should stay private because it returns a reference to a unique object
-	std::unordered_set<uint16_t> &uniqueColors() const {
-		// We check for *distinct* colors by stuffing them into a `set`; this should be
-		// faster than "back-checking" on every element (O(n²))
-		//
-		// TODO: calc84maniac suggested another approach; try implementing it, see if it
-		// performs better:
-		// > So basically you make a priority queue that takes iterators into each of your sets
-		// > (paired with end iterators so you'll know where to stop), and the comparator tests the
-		// > values pointed to by each iterator
-		// > Then each iteration you pop from the queue,
-		// > optionally add one to your count, increment the iterator and push it back into the
-		// > queue if it didn't reach the end
-		// > And you do this until the priority queue is empty
-		static std::unordered_set<uint16_t> colors;
-
-		colors.clear();
-		addUniqueColors(colors, RANGE(*this), *_protoPals);
-		return colors;
-	}
-public:
 	/*
 	 * Returns the number of distinct colors
 	 */
-	size_t volume() const { return uniqueColors().size(); }
+	size_t volume() const { return _colorCounts.size(); }
 	bool canFit(ProtoPalette const &protoPal) const {
-		auto &colors = uniqueColors();
-		colors.insert(RANGE(protoPal));
-		return colors.size() <= options.maxOpaqueColors();
+		size_t nbNewColors = std::count_if(RANGE(protoPal), [this](uint16_t id) {
+			return !_colors.contains(id);
+		});
+		return volume() + nbNewColors <= options.maxOpaqueColors();
 	}
 
 	/*
 	 * Computes the "relative size" of a proto-palette on this palette
 	 */
 	double relSizeOf(ProtoPalette const &protoPal) const {
-		// NOTE: this function must not call `uniqueColors`, or one of its callers will break!
 		double relSize = 0.;
 		for (uint16_t color : protoPal) {
-			auto n = std::count_if(RANGE(*this), [this, &color](ProtoPalAttrs const &attrs) {
-				ProtoPalette const &pal = (*_protoPals)[attrs.protoPalIndex];
-				return std::find(RANGE(pal), color) != pal.end();
-			});
 			// NOTE: The paper and the associated code disagree on this: the code has
 			// this `1 +`, whereas the paper does not; its lack causes a division by 0
 			// if the symbol is not found anywhere, so I'm assuming the paper is wrong.
-			relSize += 1. / (1 + n);
+			relSize += 1. / (1 + nbProtoPalsWith(color));
 		}
 		return relSize;
 	}
 
 	/*
-	 * Computes the "relative size" of a set of proto-palettes on this palette
+	 * Computes the number of distinct colors of this palette plus another
 	 */
-	template<typename Iter>
-	auto combinedVolume(Iter &&begin, Iter const &end, std::vector<ProtoPalette> const &protoPals)
-	    const {
-		auto &colors = uniqueColors();
-		addUniqueColors(colors, std::forward<Iter>(begin), end, protoPals);
-		return colors.size();
+	size_t combinedVolume(AssignedProtos const &other) const {
+		return _colors.sizeOfUnion(other._colors);
 	}
 	/*
-	 * Computes the "relative size" of a set of colors on this palette
+	 * Computes the number of distinct colors of this palette plus a set of colors
 	 */
-	template<typename Iter>
-	auto combinedVolume(Iter &&begin, Iter &&end) const {
-		auto &colors = uniqueColors();
-		colors.insert(std::forward<Iter>(begin), std::forward<Iter>(end));
-		return colors.size();
+	size_t combinedVolume(ColorSet const &otherColors) const {
+		return _colors.sizeOfUnion(otherColors);
 	}
 };
 
@@ -250,6 +304,10 @@ static void decant(
 	auto decantOn = [&assignments](auto const &tryDecanting) {
 		// No need to attempt decanting on palette #0, as there are no palettes to decant to
 		for (size_t from = assignments.size(); --from;) {
+			if (isOutOfTime()) {
+				return;
+			}
+
 			// Scan all palettes before this one
 			for (size_t to = 0; to < from; ++to) {
 				tryDecanting(assignments[to], assignments[from]);
@@ -276,7 +334,7 @@ static void decant(
 	// Decant on palettes
 	decantOn([&protoPalettes](AssignedProtos &to, AssignedProtos &from) {
 		// If the entire palettes can be merged, move all of `from`'s proto-palettes
-		if (to.combinedVolume(RANGE(from), protoPalettes) <= options.maxOpaqueColors()) {
+		if (to.combinedVolume(from) <= options.maxOpaqueColors()) {
 			for (ProtoPalAttrs &attrs : from) {
 				to.assign(attrs.protoPalIndex);
 			}
@@ -294,7 +352,7 @@ static void decant(
 		// We do this by adding the first available proto-palette, and then looking for palettes
 		// with common colors. (As an optimization, we know we can skip palettes already scanned.)
 		std::vector<bool> processed(from.nbProtoPals(), false);
-		std::unordered_set<uint16_t> colors;
+		ColorSet colors;
 		std::vector<size_t> members;
 		while (true) {
 			auto iter = std::find(RANGE(processed), true);
@@ -311,9 +369,8 @@ static void decant(
 			do {
 				ProtoPalette const &protoPal = protoPalettes[attrs->protoPalIndex];
 				// If this is the first proto-pal, or if at least one color matches, add it
-				if (members.empty()
-				    || std::find_first_of(RANGE(colors), RANGE(protoPal)) != colors.end()) {
-					colors.insert(RANGE(protoPal));
+				if (members.empty() || colors.containsAnyOf(protoPal)) {
+					colors.add(protoPal);
 					members.push_back(iter - processed.begin());
 					*iter = true; // Mark that proto-pal as processed
 				}
@@ -321,7 +378,7 @@ static void decant(
 				++attrs;
 			} while (iter != processed.end());
 
-			if (to.combinedVolume(RANGE(colors)) <= options.maxOpaqueColors()) {
+			if (to.combinedVolume(colors) <= options.maxOpaqueColors()) {
 				// Iterate through the component's proto-palettes, and transfer them
 				auto member = from.begin();
 				size_t curIndex = 0;
@@ -352,12 +409,38 @@ static void decant(
 	);
 }
 
+/*
+ * Returns a copy of the proto-palettes, with their colors replaced by dense IDs
+ * Since the IDs are in the same order as the colors, the proto-palettes are still sorted
+ */
+static std::vector<ProtoPalette>
+    denseProtoPalettes(std::vector<ProtoPalette> const &protoPalettes) {
+	std::vector<uint16_t> colors;
+	for (ProtoPalette const &protoPal : protoPalettes) {
+		colors.insert(colors.end(), RANGE(protoPal));
+	}
+	std::sort(RANGE(colors));
+	colors.erase(std::unique(RANGE(colors)), colors.end());
+
+	std::vector<ProtoPalette> denseProtoPals(protoPalettes.size());
+	for (size_t i = 0; i < protoPalettes.size(); ++i) {
+		for (uint16_t color : protoPalettes[i]) {
+			denseProtoPals[i].add(std::lower_bound(RANGE(colors), color) - colors.begin());
+		}
+	}
+	return denseProtoPals;
+}
+
 std::tuple<DefaultInitVec<size_t>, size_t>
-    overloadAndRemove(std::vector<ProtoPalette> const &protoPalettes) {
+    overloadAndRemove(std::vector<ProtoPalette> const &originalProtoPalettes) {
 	options.verbosePrint(
 	    Options::VERB_LOG_ACT, "Paginating palettes using \"overload-and-remove\" strategy...\n"
 	);
 
+	// The palettes are packed using dense color IDs, but reported with the original colors
+	std::vector<ProtoPalette> const protoPalettes = denseProtoPalettes(originalProtoPalettes);
+	deadline = Clock::now() + std::chrono::milliseconds(options.packTime);
+
 	// Sort the proto-palettes by size, which improves the packing algorithm's efficiency
 	DefaultInitVec<size_t> sortedProtoPalIDs(protoPalettes.size());
 	sortedProtoPalIDs.clear();
@@ -370,6 +453,16 @@ std::tuple<DefaultInitVec<size_t>, size_t>
 	std::vector<AssignedProtos> assignments{};
 
 	for (; !queue.empty(); queue.pop()) {
+		if (isOutOfTime()) {
+			// The remaining proto-palettes will be placed via first-fit below
+			options.verbosePrint(
+			    Options::VERB_LOG_ACT,
+			    "Packing time is up, placing the %zu remaining proto-palettes directly\n",
+			    queue.size()
+			);
+			break;
+		}
+
 		ProtoPalAttrs const &attrs = queue.front(); // Valid until the `queue.pop()`
 		options.verbosePrint(Options::VERB_DEBUG, "Handling proto-pal %zu\n", attrs.protoPalIndex);
 
@@ -487,7 +580,7 @@ std::tuple<DefaultInitVec<size_t>, size_t>
 			fprintf(stderr, "{ ");
 			for (auto &&attrs : assignment) {
 				fprintf(stderr, "[%zu] ", attrs.protoPalIndex);
-				for (auto &&colorIndex : protoPalettes[attrs.protoPalIndex]) {
+				for (auto &&colorIndex : originalProtoPalettes[attrs.protoPalIndex]) {
 					fprintf(stderr, "%04" PRIx16 ", ", colorIndex);
 				}
 			}
@@ -504,7 +597,7 @@ std::tuple<DefaultInitVec<size_t>, size_t>
 			fprintf(stderr, "{ ");
 			for (auto &&attrs : assignment) {
 				fprintf(stderr, "[%zu] ", attrs.protoPalIndex);
-				for (auto &&colorIndex : protoPalettes[attrs.protoPalIndex]) {
+				for (auto &&colorIndex : originalProtoPalettes[attrs.protoPalIndex]) {
 					fprintf(stderr, "%04" PRIx16 ", ", colorIndex);
 				}
 			}
@@ -521,4 +614,100 @@ std::tuple<DefaultInitVec<size_t>, size_t>
 	return {mappings, assignments.size()};
 }
 
+std::tuple<DefaultInitVec<size_t>, size_t> repairSeeded(
+    std::vector<ProtoPalette> const &originalProtoPalettes, std::vector<size_t> const &seed
+) {
+	options.verbosePrint(Options::VERB_LOG_ACT, "Repairing the seeded palettes...\n");
+
+	std::vector<ProtoPalette> const protoPalettes = denseProtoPalettes(originalProtoPalettes);
+	std::queue<ProtoPalAttrs> queue;
+	std::vector<AssignedProtos> assignments{};
+
+	for (size_t i = 0; i < protoPalettes.size(); ++i) {
+		if (seed[i] == SIZE_MAX) {
+			queue.emplace(i);
+			continue;
+		}
+		while (assignments.size() <= seed[i]) {
+			assignments.emplace_back(protoPalettes);
+		}
+		assignments[seed[i]].assign(i);
+	}
+
+	// Tiles whose colors changed may overload their palette; evict the proto-pals that share the
+	// fewest colors with the others, like "overload-and-remove" does
+	for (size_t i = 0; i < assignments.size(); ++i) {
+		AssignedProtos &pal = assignments[i];
+		while (pal.volume() > options.maxOpaqueColors()) {
+			auto efficiency = [&pal](ProtoPalette const &protoPal) {
+				return protoPal.size() / pal.relSizeOf(protoPal);
+			};
+			auto minEfficiencyIter = std::min_element(
+			    RANGE(pal),
+			    [&efficiency, &protoPalettes](ProtoPalAttrs const &lhs, ProtoPalAttrs const &rhs) {
+				    return efficiency(protoPalettes[lhs.protoPalIndex])
+				           < efficiency(protoPalettes[rhs.protoPalIndex]);
+			    }
+			);
+			options.verbosePrint(
+			    Options::VERB_DEBUG,
+			    "Evicting proto-pal %zu from overloaded palette %zu\n",
+			    minEfficiencyIter->protoPalIndex,
+			    i
+			);
+			queue.emplace(std::move(*minEfficiencyIter));
+			pal.remove(minEfficiencyIter);
+		}
+	}
+
+	// Place the other proto-pals where they add the fewest colors, leaving the rest untouched
+	for (; !queue.empty(); queue.pop()) {
+		ProtoPalAttrs &attrs = queue.front();
+		ProtoPalette const &protoPal = protoPalettes[attrs.protoPalIndex];
+		ColorSet colors;
+		colors.add(protoPal);
+
+		auto bestPal = assignments.end();
+		size_t bestVolume = SIZE_MAX;
+		for (auto iter = assignments.begin(); iter != assignments.end(); ++iter) {
+			if (!iter->empty() && iter->canFit(protoPal)
+			    && iter->combinedVolume(colors) - iter->volume() < bestVolume) {
+				bestPal = iter;
+				bestVolume = iter->combinedVolume(colors) - iter->volume();
+			}
+		}
+		if (bestPal == assignments.end()) {
+			// Prefer reusing a palette that was emptied, over adding one
+			bestPal = std::find_if(RANGE(assignments), [](AssignedProtos const &pal) {
+				return pal.empty();
+			});
+		}
+		if (bestPal == assignments.end()) {
+			options.verbosePrint(
+			    Options::VERB_DEBUG,
+			    "Adding new palette (%zu) for proto-pal %zu\n",
+			    assignments.size(),
+			    attrs.protoPalIndex
+			);
+			assignments.emplace_back(protoPalettes, std::move(attrs));
+		} else {
+			bestPal->assign(std::move(attrs));
+		}
+	}
+
+	// Palettes that ended up empty are removed, which shifts the ones after them
+	DefaultInitVec<size_t> mappings(protoPalettes.size());
+	size_t nbPalettes = 0;
+	for (AssignedProtos const &assignment : assignments) {
+		if (assignment.empty()) {
+			continue;
+		}
+		for (ProtoPalAttrs const &attrs : assignment) {
+			mappings[attrs.protoPalIndex] = nbPalettes;
+		}
+		++nbPalettes;
+	}
+	return {mappings, nbPalettes};
+}
+
 } // namespace packing
@@ -47,9 +47,7 @@ void indexed(
 	}
 }
 
-void grayscale(
-    std::vector<Palette> &palettes, std::array<std::optional<Rgba>, 0x8001> const &colors
-) {
+void grayscale(std::vector<Palette> &palettes, std::vector<Rgba> const &colors) {
 	options.verbosePrint(Options::VERB_LOG_ACT, "Sorting grayscale-only palette...\n");
 
 	// This method is only applicable if there are at most as many colors as colors per palette, so
@@ -58,11 +56,11 @@ void grayscale(
 
 	Palette &palette = palettes[0];
 	std::fill(RANGE(palette.colors), Rgba::transparent);
-	for (auto const &slot : colors) {
-		if (!slot.has_value() || slot->isTransparent()) {
+	for (Rgba const &color : colors) {
+		if (color.isTransparent()) {
 			continue;
 		}
-		palette[slot->grayIndex()] = slot->cgbColor();
+		palette[color.grayIndex()] = color.cgbColor();
 	}
 }
 
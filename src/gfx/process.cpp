@@ -3,6 +3,7 @@
 #include "gfx/process.hpp"
 
 #include <algorithm>
+#include <deque>
 #include <errno.h>
 #include <inttypes.h>
 #include <optional>
@@ -10,15 +11,18 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include <string>
 #include <tuple>
-#include <unordered_set>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
 #include "defaultinitalloc.hpp"
+#include "diagnostics.hpp"
 #include "file.hpp"
 #include "helpers.hpp"
 #include "itertools.hpp"
+#include "trace.hpp"
 
 #include "gfx/main.hpp"
 #include "gfx/pal_packing.hpp"
@@ -26,39 +30,42 @@
 #include "gfx/proto_palette.hpp"
 
 class ImagePalette {
-	// Use as many slots as there are CGB colors (plus transparency)
-	std::array<std::optional<Rgba>, 0x8001> _colors;
+	// The distinct colors, in the order that they were first seen
+	std::vector<Rgba> _colors;
+	// For each CGB color (plus transparency), the index of its color in `_colors` plus one, or 0
+	// if it has not been seen; this is much smaller than storing the colors at those indices
+	std::array<uint16_t, 0x8001> _indices{};
+	size_t _nbOpaqueColors = 0;
 
 public:
 	ImagePalette() = default;
 
 	/*
-	 * Registers a color in the palette.
+	 * Registers a color in the palette, given its CGB color.
 	 * If the newly inserted color "conflicts" with another one (different color, but same CGB
 	 * color), then the other color is returned. Otherwise, `nullptr` is returned.
 	 */
-	[[nodiscard]] Rgba const *registerColor(Rgba const &rgba) {
-		decltype(_colors)::value_type &slot = _colors[rgba.cgbColor()];
+	[[nodiscard]] Rgba const *registerColor(Rgba const &rgba, uint16_t cgbColor) {
+		uint16_t &index = _indices[cgbColor];
 
-		if (rgba.cgbColor() == Rgba::transparent) {
+		if (cgbColor == Rgba::transparent) {
 			options.hasTransparentPixels = true;
 		}
 
-		if (!slot.has_value()) {
-			slot.emplace(rgba);
-		} else if (*slot != rgba) {
-			assume(slot->cgbColor() != UINT16_MAX);
-			return &*slot;
+		if (index == 0) {
+			_colors.push_back(rgba);
+			index = _colors.size();
+			if (!rgba.isTransparent()) {
+				++_nbOpaqueColors;
+			}
+		} else if (Rgba const &other = _colors[index - 1]; other != rgba) {
+			return &other;
 		}
 		return nullptr;
 	}
 
-	size_t size() const {
-		return std::count_if(RANGE(_colors), [](decltype(_colors)::value_type const &slot) {
-			return slot.has_value() && !slot->isTransparent();
-		});
-	}
-	decltype(_colors) const &raw() const { return _colors; }
+	size_t size() const { return _nbOpaqueColors; }
+	std::vector<Rgba> const &raw() const { return _colors; }
 
 	auto begin() const { return _colors.begin(); }
 	auto end() const { return _colors.end(); }
@@ -72,7 +79,9 @@ class Png {
 
 	// These are cached for speed
 	uint32_t width, height;
-	DefaultInitVec<Rgba> pixels;
+	// Only the input slice's pixels are kept, and only their CGB colors matter once read
+	uint32_t sliceLeft, sliceTop, sliceWidth, sliceHeight;
+	DefaultInitVec<uint16_t> pixels;
 	ImagePalette colors;
 	int colorType;
 	int nbColors;
@@ -118,13 +127,19 @@ public:
 		return {nbColors, embeddedPal, nbTransparentEntries, transparencyPal};
 	}
 
-	uint32_t getWidth() const { return width; }
+	// The dimensions of the input slice, which is the whole image by default
+	uint32_t getWidth() const { return sliceWidth; }
 
-	uint32_t getHeight() const { return height; }
+	uint32_t getHeight() const { return sliceHeight; }
 
-	Rgba &pixel(uint32_t x, uint32_t y) { return pixels[y * width + x]; }
+	// The coordinates are relative to the whole image, but must be within the input slice
+	uint16_t &pixel(uint32_t x, uint32_t y) {
+		return pixels[(y - sliceTop) * sliceWidth + (x - sliceLeft)];
+	}
 
-	Rgba const &pixel(uint32_t x, uint32_t y) const { return pixels[y * width + x]; }
+	uint16_t pixel(uint32_t x, uint32_t y) const {
+		return pixels[(y - sliceTop) * sliceWidth + (x - sliceLeft)];
+	}
 
 	char const *c_str() const { return file.c_str(path); }
 
@@ -140,24 +155,24 @@ public:
 			return false;
 		}
 		uint8_t bins = 0;
-		for (auto const &color : colors) {
-			if (!color.has_value() || color->isTransparent()) {
+		for (Rgba const &color : colors) {
+			if (color.isTransparent()) {
 				continue;
 			}
-			if (!color->isGray()) {
+			if (!color.isGray()) {
 				options.verbosePrint(
 				    Options::VERB_DEBUG,
 				    "Found non-gray color #%08x, not using grayscale sorting\n",
-				    color->toCSS()
+				    color.toCSS()
 				);
 				return false;
 			}
-			uint8_t mask = 1 << color->grayIndex();
+			uint8_t mask = 1 << color.grayIndex();
 			if (bins & mask) { // Two in the same bin!
 				options.verbosePrint(
 				    Options::VERB_DEBUG,
 				    "Color #%08x conflicts with another one, not using grayscale sorting\n",
-				    color->toCSS()
+				    color.toCSS()
 				);
 				return false;
 			}
@@ -174,6 +189,9 @@ public:
 	 * so we use the "lower-level" one instead.
 	 * We also use that occasion to only read the PNG one line at a time, since we store all of
 	 * the pixel data in `pixels`, which saves on memory allocations.
+	 * Only each pixel's CGB color is kept, which takes half the memory of its RGBA value; and
+	 * indexed images are read as indices, whose colors only need to be checked once.
+	 * Likewise, only the pixels in the input slice are kept, and rows past it are not decoded.
 	 */
 	explicit Png(std::string const &filePath) : path(filePath), colors() {
 		if (file.open(path, std::ios_base::in | std::ios_base::binary) == nullptr) {
@@ -229,7 +247,24 @@ public:
 			fatal("Image height (%" PRIu32 " pixels) is not a multiple of 8!", height);
 		}
 
-		pixels.resize(static_cast<size_t>(width) * static_cast<size_t>(height));
+		sliceLeft = options.inputSlice.left;
+		sliceTop = options.inputSlice.top;
+		sliceWidth = options.inputSlice.width ? options.inputSlice.width * 8 : width;
+		sliceHeight = options.inputSlice.height ? options.inputSlice.height * 8 : height;
+		if (sliceLeft + sliceWidth > width || sliceTop + sliceHeight > height) {
+			fatal(
+			    "Input slice (%" PRIu32 "x%" PRIu32 " pixels starting at (%" PRIu32 ", %" PRIu32
+			    ")) extends past the image (%" PRIu32 "x%" PRIu32 " pixels)",
+			    sliceWidth,
+			    sliceHeight,
+			    sliceLeft,
+			    sliceTop,
+			    width,
+			    height
+			);
+		}
+
+		pixels.resize(static_cast<size_t>(sliceWidth) * static_cast<size_t>(sliceHeight));
 
 		auto colorTypeName = [this]() {
 			switch (colorType) {
@@ -295,17 +330,21 @@ public:
 		// TODO: it's not necessary to uniformize the pixel data (in theory), and not doing
 		// so *might* improve performance, and should reduce memory usage.
 
+		// Indexed images are kept as indices, and their palette is looked up instead
+		bool isIndexed = colorType == PNG_COLOR_TYPE_PALETTE;
+
 		// Convert grayscale to RGB
-		switch (colorType & ~PNG_COLOR_MASK_ALPHA) {
-		case PNG_COLOR_TYPE_GRAY:
+		if ((colorType & ~PNG_COLOR_MASK_ALPHA) == PNG_COLOR_TYPE_GRAY) {
 			png_set_gray_to_rgb(png); // This also converts tRNS to alpha
-			break;
-		case PNG_COLOR_TYPE_PALETTE:
-			png_set_palette_to_rgb(png);
-			break;
 		}
 
-		if (png_get_valid(png, info, PNG_INFO_tRNS)) {
+		// Indexed images' transparency is looked up along with their palette
+		if (isIndexed) {
+#ifdef PNG_CHECK_FOR_INVALID_INDEX_SUPPORTED
+			// Out-of-range indices are handled the same as when expanding the palette, silently
+			png_set_check_for_invalid_index(png, 0);
+#endif
+		} else if (png_get_valid(png, info, PNG_INFO_tRNS)) {
 			// If we read a tRNS chunk, convert it to alpha
 			png_set_tRNS_to_alpha(png);
 		} else if (!(colorType & PNG_COLOR_MASK_ALPHA)) {
@@ -328,8 +367,12 @@ public:
 		assume(png_get_image_width(png, info) == width);
 		assume(png_get_image_height(png, info) == height);
 		// These should have changed, however
-		assume(png_get_color_type(png, info) == PNG_COLOR_TYPE_RGBA);
+		assume(
+		    png_get_color_type(png, info)
+		    == (isIndexed ? PNG_COLOR_TYPE_PALETTE : PNG_COLOR_TYPE_RGBA)
+		);
 		assume(png_get_bit_depth(png, info) == 8);
+		uint8_t nbPixelBytes = isIndexed ? 1 : 4;
 
 		// Now that metadata has been read, we can process the image data
 
@@ -344,9 +387,10 @@ public:
 		// Holds colors whose alpha value is ambiguous
 		std::vector<uint32_t> indeterminates;
 
-		// Assign a color to the given position, and register it in the image palette as well
-		auto assignColor =
-		    [this, &conflicts, &indeterminates](png_uint_32 x, png_uint_32 y, Rgba &&color) {
+		// Register a color first seen at the given position in the image palette, and return the
+		// CGB color to assign to it
+		auto registerColor =
+		    [this, &conflicts, &indeterminates](png_uint_32 x, png_uint_32 y, Rgba color) {
 			    if (!color.isTransparent() && !color.isOpaque()) {
 				    uint32_t css = color.toCSS();
 				    if (std::find(RANGE(indeterminates), css) == indeterminates.end()) {
@@ -361,7 +405,12 @@ public:
 					    );
 					    indeterminates.push_back(css);
 				    }
-			    } else if (Rgba const *other = colors.registerColor(color); other) {
+				    // The conversion will fail anyway, so just treat the color as opaque
+				    color.alpha = 0xFF;
+				    return color.cgbColor();
+			    }
+			    uint16_t cgbColor = color.cgbColor();
+			    if (Rgba const *other = colors.registerColor(color, cgbColor); other) {
 				    std::tuple conflicting{color.toCSS(), other->toCSS()};
 				    // Do not report combinations twice
 				    if (std::find(RANGE(conflicts), conflicting) == conflicts.end()) {
@@ -370,7 +419,7 @@ public:
 					        "at x: %" PRIu32 ", y: %" PRIu32 "]",
 					        std::get<0>(conflicting),
 					        std::get<1>(conflicting),
-					        color.cgbColor(),
+					        cgbColor,
 					        x,
 					        y
 					    );
@@ -378,21 +427,65 @@ public:
 					    conflicts.emplace_back(conflicting);
 				    }
 			    }
-
-			    pixel(x, y) = color;
+			    return cgbColor;
 		    };
 
-		if (interlaceType == PNG_INTERLACE_NONE) {
-			for (png_uint_32 y = 0; y < height; ++y) {
-				png_read_row(png, row.data(), nullptr);
+		// Each palette index's color only needs to be registered the first time that it is seen;
+		// like libpng, treat indices past the end of the palette as opaque black
+		std::array<std::optional<uint16_t>, 256> indexColors;
+		auto assignIndexedColor = [&](png_uint_32 x, png_uint_32 y, png_const_bytep ptr) {
+			std::optional<uint16_t> &cgbColor = indexColors[*ptr];
+			if (!cgbColor) {
+				Rgba color(0, 0, 0, 0xFF);
+				if (*ptr < nbColors) {
+					png_color const &entry = embeddedPal[*ptr];
+					color = Rgba(entry.red, entry.green, entry.blue, 0xFF);
+					if (transparencyPal && *ptr < nbTransparentEntries) {
+						color.alpha = transparencyPal[*ptr];
+					}
+				}
+				cgbColor = registerColor(x, y, color);
+			}
+			pixel(x, y) = *cgbColor;
+		};
+		// Likewise, other colors only need to be registered once; registering a color again has no
+		// effect, since each (conflicting) color is only reported once. The recently seen ones are
+		// cached by their raw RGBA bytes, so that most pixels only take a lookup.
+		struct CachedColor {
+			uint32_t rgba;
+			uint32_t cgbColor; // Past UINT16_MAX if the entry is empty
+		};
+		std::array<CachedColor, 1024> colorCache;
+		colorCache.fill({.rgba = 0, .cgbColor = UINT32_MAX});
+		auto assignRgbaColor = [&](png_uint_32 x, png_uint_32 y, png_const_bytep ptr) {
+			uint32_t rgba;
+			memcpy(&rgba, ptr, sizeof(rgba));
+			// Fibonacci hashing spreads the colors' high bits, which differ the most
+			CachedColor &cached = colorCache[(rgba * UINT32_C(2654435769)) >> 22];
+			if (cached.rgba != rgba || cached.cgbColor > UINT16_MAX) {
+				cached.rgba = rgba;
+				cached.cgbColor = registerColor(x, y, Rgba(ptr[0], ptr[1], ptr[2], ptr[3]));
+			}
+			pixel(x, y) = cached.cgbColor;
+		};
 
-				for (png_uint_32 x = 0; x < width; ++x) {
-					assignColor(
-					    x, y, Rgba(row[x * 4], row[x * 4 + 1], row[x * 4 + 2], row[x * 4 + 3])
-					);
+		// Each pixel format gets its own copy of the loops, keeping them free of other formats
+		png_uint_32 sliceRight = sliceLeft + sliceWidth, sliceBottom = sliceTop + sliceHeight;
+		auto readPixels = [&](auto assignColor) {
+			if (interlaceType == PNG_INTERLACE_NONE) {
+				// Rows above the slice must still be decoded, but not the ones below it
+				for (png_uint_32 y = 0; y < sliceBottom; ++y) {
+					png_read_row(png, row.data(), nullptr);
+					if (y < sliceTop) {
+						continue;
+					}
+
+					for (png_uint_32 x = sliceLeft; x < sliceRight; ++x) {
+						assignColor(x, y, &row[x * nbPixelBytes]);
+					}
 				}
+				return;
 			}
-		} else {
 			assume(interlaceType == PNG_INTERLACE_ADAM7);
 
 			// For interlace to work properly, we must read the image `nbPasses` times
@@ -408,17 +501,30 @@ public:
 				for (png_uint_32 y = PNG_PASS_START_ROW(pass); y < height; y += yStep) {
 					png_bytep ptr = row.data();
 					png_read_row(png, ptr, nullptr);
+					if (y < sliceTop || y >= sliceBottom) {
+						continue;
+					}
 
 					for (png_uint_32 x = PNG_PASS_START_COL(pass); x < width; x += xStep) {
-						assignColor(x, y, Rgba(ptr[0], ptr[1], ptr[2], ptr[3]));
-						ptr += 4;
+						if (x >= sliceLeft && x < sliceRight) {
+							assignColor(x, y, ptr);
+						}
+						ptr += nbPixelBytes;
 					}
 				}
 			}
+		};
+		if (isIndexed) {
+			readPixels(assignIndexedColor);
+		} else {
+			readPixels(assignRgbaColor);
 		}
 
-		// We don't care about chunks after the image data (comments, etc.)
-		png_read_end(png, nullptr);
+		// We don't care about chunks after the image data (comments, etc.), nor about its last rows
+		// if they were not needed
+		if (interlaceType != PNG_INTERLACE_NONE || sliceBottom == height) {
+			png_read_end(png, nullptr);
+		}
 	}
 
 	~Png() { png_destroy_read_struct(&png, &info, nullptr); }
@@ -440,7 +546,7 @@ public:
 
 			Tile(Png const &png, uint32_t x_, uint32_t y_) : _png(png), x(x_), y(y_) {}
 
-			Rgba pixel(uint32_t xOfs, uint32_t yOfs) const {
+			uint16_t pixel(uint32_t xOfs, uint32_t yOfs) const {
 				return _png.pixel(x + xOfs, y + yOfs);
 			}
 		};
@@ -478,6 +584,9 @@ public:
 		};
 
 	public:
+		// The number of tiles visited before moving on to the next row (or column)
+		uint32_t rowLength() const { return _limit / 8; }
+
 		iterator begin() const { return {*this, _limit, 0, 0}; }
 		iterator end() const {
 			iterator it{*this, _limit, _width - 8, _height - 8}; // Last valid one...
@@ -489,12 +598,28 @@ public:
 		return {
 		    *this,
 		    options.columnMajor,
-		    options.inputSlice.width ? options.inputSlice.width * 8 : width,
-		    options.inputSlice.height ? options.inputSlice.height * 8 : height,
+		    sliceWidth,
+		    sliceHeight,
 		};
 	}
 };
 
+using ImageTiles = std::vector<Png::TilesVisitor::Tile>; // In visiting order
+
+/*
+ * Calls `func(i)` for every tile index `i` below `nbTiles`, spreading the work across
+ * `options.nbJobs` threads, which take rows of `rowLength` tiles in increasing order.
+ * So `func` must only write to the `i`th element of whatever it outputs.
+ */
+template<typename F>
+static void forEachTile(size_t nbTiles, size_t rowLength, F const &func) {
+	diag_RunTasks((nbTiles + rowLength - 1) / rowLength, options.nbJobs, [&](size_t row) {
+		for (size_t i = row * rowLength; i < (row + 1) * rowLength && i < nbTiles; ++i) {
+			func(i);
+		}
+	});
+}
+
 class RawTiles {
 	/*
 	 * A tile which only contains indices into the image's global palette
@@ -563,11 +688,86 @@ static void generatePalSpec(Png const &png) {
 	}
 }
 
-static std::tuple<DefaultInitVec<size_t>, std::vector<Palette>>
-    generatePalettes(std::vector<ProtoPalette> const &protoPalettes, Png const &png) {
+/*
+ * Returns the palette that the palette map of a previous conversion put each proto-palette in
+ * (`SIZE_MAX` for those that are only in new tiles), or nothing if it cannot be used
+ */
+static std::optional<std::vector<size_t>> readSeedPalmap(
+    DefaultInitVec<AttrmapEntry> const &attrmap, size_t nbProtoPalettes
+) {
+	File file;
+	if (!file.open(options.seedPalmap, std::ios_base::in | std::ios_base::binary)) {
+		// The palette map is usually an output of the conversion, so it may not exist yet
+		options.verbosePrint(
+		    Options::VERB_LOG_ACT,
+		    "Not seeding palette packing, failed to open \"%s\": %s\n",
+		    file.c_str(options.seedPalmap),
+		    strerror(errno)
+		);
+		return std::nullopt;
+	}
+	// Read one extra byte, to detect palette maps that are too long
+	std::vector<uint8_t> palmap(attrmap.size() + 1);
+	palmap.resize(file->sgetn(reinterpret_cast<char *>(palmap.data()), palmap.size()));
+	if (palmap.size() != attrmap.size()) {
+		warning(
+		    "Seed palette map \"%s\" is not for an image of %zu tiles, ignoring it",
+		    file.c_str(options.seedPalmap),
+		    attrmap.size()
+		);
+		return std::nullopt;
+	}
+
+	// A proto-palette's tiles may have been in several palettes, e.g. if it absorbed one whose
+	// colors it now includes; it is seeded with the one that most of them were in
+	std::vector<std::pair<size_t, uint8_t>> tilePalIDs;
+	for (auto [attrs, palID] : zip(attrmap, palmap)) {
+		if (attrs.protoPaletteID != AttrmapEntry::transparent) {
+			tilePalIDs.emplace_back(attrs.protoPaletteID, palID);
+		}
+	}
+	std::sort(RANGE(tilePalIDs));
+
+	std::vector<size_t> seed(nbProtoPalettes, SIZE_MAX);
+	std::vector<size_t> nbSeedTiles(nbProtoPalettes, 0);
+	for (auto run = tilePalIDs.begin(); run != tilePalIDs.end();) {
+		auto runEnd = std::find_if(run, tilePalIDs.end(), [&run](auto const &tilePalID) {
+			return tilePalID != *run;
+		});
+		if (size_t nbTiles = runEnd - run; nbTiles > nbSeedTiles[run->first]) {
+			seed[run->first] = run->second;
+			nbSeedTiles[run->first] = nbTiles;
+		}
+		run = runEnd;
+	}
+	return seed;
+}
+
+static std::tuple<DefaultInitVec<size_t>, std::vector<Palette>> generatePalettes(
+    std::vector<ProtoPalette> const &protoPalettes,
+    DefaultInitVec<AttrmapEntry> const &attrmap,
+    Png const &png
+) {
 	// Run a "pagination" problem solver
 	// TODO: allow picking one of several solvers?
-	auto [mappings, nbPalettes] = packing::overloadAndRemove(protoPalettes);
+	auto [mappings, nbPalettes] = [&] {
+		std::optional<std::vector<size_t>> seed;
+		if (!options.seedPalmap.empty()) {
+			seed = readSeedPalmap(attrmap, protoPalettes.size());
+		}
+		if (seed) {
+			auto result = packing::repairSeeded(protoPalettes, *seed);
+			if (std::get<1>(result) <= options.nbPalettes) {
+				return result;
+			}
+			options.verbosePrint(
+			    Options::VERB_LOG_ACT,
+			    "Repairing the seeded palettes needs %zu of them, packing from scratch\n",
+			    std::get<1>(result)
+			);
+		}
+		return packing::overloadAndRemove(protoPalettes);
+	}();
 	assume(mappings.size() == protoPalettes.size());
 
 	if (options.verbosity >= Options::VERB_INTERM) {
@@ -668,7 +868,45 @@ static std::tuple<DefaultInitVec<size_t>, std::vector<Palette>>
 	return {mappings, palettes};
 }
 
-static void outputPalettes(std::vector<Palette> const &palettes) {
+// An output file's contents, assembled in memory to be written in one go
+struct Output {
+	std::string const *path;
+	std::vector<uint8_t> data;
+};
+
+/*
+ * Writes the outputs; they are all opened first, so that failing to open any of them is reported
+ * before writing anything, and then they are written concurrently, since they are independent
+ */
+static void writeOutputs(std::vector<Output> const &outputs) {
+	TracePhase phase("write_outputs");
+	std::vector<File> files(outputs.size());
+	bool anyToStdout = false;
+	for (auto [output, file] : zip(outputs, files)) {
+		if (!file.open(*output.path, std::ios_base::out | std::ios_base::binary)) {
+			fatal("Failed to create \"%s\": %s", file.c_str(*output.path), strerror(errno));
+		}
+		anyToStdout |= *output.path == "-";
+	}
+
+	std::vector<uint8_t> failed(outputs.size(), false); // Not `vector<bool>`, to write concurrently
+	auto writeOutput = [&](size_t i) {
+		std::vector<uint8_t> const &data = outputs[i].data;
+		failed[i] = files[i]->sputn(reinterpret_cast<char const *>(data.data()), data.size())
+		                != static_cast<std::streamsize>(data.size())
+		            || files[i]->pubsync() != 0;
+	};
+	// Several outputs to stdout must be written in order
+	diag_RunTasks(outputs.size(), anyToStdout ? 1 : options.nbJobs, writeOutput);
+
+	for (auto [output, file, writeFailed] : zip(outputs, files, failed)) {
+		if (writeFailed) {
+			fatal("Failed to write \"%s\"", file.c_str(*output.path));
+		}
+	}
+}
+
+static void outputPalettes(std::vector<Palette> const &palettes, std::vector<Output> &outputs) {
 	if (options.verbosity >= Options::VERB_INTERM) {
 		for (auto &&palette : palettes) {
 			fputs("{ ", stderr);
@@ -690,53 +928,66 @@ static void outputPalettes(std::vector<Palette> const &palettes) {
 	}
 
 	if (!options.palettes.empty()) {
-		File output;
-		if (!output.open(options.palettes, std::ios_base::out | std::ios_base::binary)) {
-			fatal("Failed to open \"%s\": %s", output.c_str(options.palettes), strerror(errno));
-		}
-
+		std::vector<uint8_t> &data = outputs.emplace_back(&options.palettes).data;
+		data.reserve(palettes.size() * options.nbColorsPerPal * 2);
 		for (Palette const &palette : palettes) {
 			for (uint8_t i = 0; i < options.nbColorsPerPal; ++i) {
 				// Will output `UINT16_MAX` for unused slots
 				uint16_t color = palette.colors[i];
-				output->sputc(color & 0xFF);
-				output->sputc(color >> 8);
+				data.push_back(color & 0xFF);
+				data.push_back(color >> 8);
 			}
 		}
 	}
 }
 
 class TileData {
-	std::array<uint8_t, 16> _data;
-	// The hash is a bit lax: it's the XOR of all lines, and every other nibble is identical
-	// if horizontal mirroring is in effect. It should still be a reasonable tie-breaker in
-	// non-pathological cases.
-	uint16_t _hash;
+	std::array<uint8_t, 16> _data{}; // Only the first `options.bitDepth * 8` bytes are used
+	// The hash is computed from the tile's canonical orientation, i.e. the smallest of its
+	// flipped variants, so that all tiles which can be matched through mirroring hash alike.
+	uint64_t _hash;
 public:
 	// This is an index within the "global" pool; no bank info is encoded here
-	// It's marked as `mutable` so that it can be modified even on a `const` object;
-	// this is necessary because the `set` in which it's inserted refuses any modification for fear
-	// of altering the element's hash, but the tile ID is not part of it.
-	mutable uint16_t tileID;
+	uint16_t tileID;
+
+	enum MatchType {
+		NOPE,
+		EXACT,
+		HFLIP,
+		VFLIP,
+		VHFLIP,
+	};
+
+	// Packs a row of 8 palette indices, one per byte with the leftmost pixel in the lowest byte,
+	// into its two bitplanes. Each multiplication gathers one bit of every byte into the top byte
+	// at once, without any carries, since all the partial products land on distinct bits.
+	static uint16_t packRow(uint64_t indices) {
+		constexpr uint64_t lowBits = 0x0101010101010101, gather = 0x8040201008040201;
+		uint8_t plane0 = (indices & lowBits) * gather >> 56;
+		uint8_t plane1 = (indices >> 1 & lowBits) * gather >> 56;
+		return plane0 | plane1 << 8;
+	}
 
 	static uint16_t
 	    rowBitplanes(Png::TilesVisitor::Tile const &tile, Palette const &palette, uint32_t y) {
-		uint16_t row = 0;
+		// Looking the colors up in a copy of the palette, instead of through `Palette::indexOf`,
+		// makes the loop branchless, so that it can be vectorized
+		std::array<uint16_t, 4> colors = palette.colors;
+		uint8_t firstIndex = options.hasTransparentPixels;
+		uint64_t indices = 0;
 		for (uint32_t x = 0; x < 8; ++x) {
-			row <<= 1;
-			uint8_t index = palette.indexOf(tile.pixel(x, y).cgbColor());
-			assume(index < palette.size()); // The color should be in the palette
-			if (index & 1) {
-				row |= 1;
-			}
-			if (index & 2) {
-				row |= 0x100;
+			uint16_t color = tile.pixel(x, y);
+			uint8_t index = color == Rgba::transparent ? 0 : 4;
+			for (uint8_t i = 4; i-- > firstIndex;) {
+				index = colors[i] == color && color != Rgba::transparent ? i : index;
 			}
+			assume(index < palette.size()); // The color should be in the palette
+			indices |= (uint64_t)index << (x * 8);
 		}
-		return row;
+		return packRow(indices);
 	}
 
-	TileData(Png::TilesVisitor::Tile const &tile, Palette const &palette) : _hash(0) {
+	TileData(Png::TilesVisitor::Tile const &tile, Palette const &palette) {
 		size_t writeIndex = 0;
 		for (uint32_t y = 0; y < 8; ++y) {
 			uint16_t bitplanes = rowBitplanes(tile, palette, y);
@@ -744,28 +995,85 @@ public:
 			if (options.bitDepth == 2) {
 				_data[writeIndex++] = bitplanes >> 8;
 			}
+		}
 
-			// Update the hash
-			_hash ^= bitplanes;
-			if (options.allowMirroring) {
-				// Count the line itself as mirrorred; vertical mirroring is
-				// already taken care of because the symmetric line will be XOR'd
-				// the same way. (...which is a problem, but probably benign.)
-				_hash ^= flipTable[bitplanes >> 8] << 8 | flipTable[bitplanes & 0xFF];
+		std::array<uint8_t, 16> canonical = _data;
+		if (options.allowMirroring) {
+			for (MatchType flip : {HFLIP, VFLIP, VHFLIP}) {
+				std::array<uint8_t, 16> variant = flipped(flip);
+				if (variant < canonical) {
+					canonical = variant;
+				}
 			}
 		}
+		uint64_t lo, hi;
+		memcpy(&lo, &canonical[0], sizeof(lo));
+		memcpy(&hi, &canonical[8], sizeof(hi));
+		_hash = mix(lo ^ mix(hi));
+	}
+
+	// A 64-bit finalizer (from MurmurHash3), so that all bits of the data affect all bits of the
+	// hash, including the low ones used to index the dedup table
+	static uint64_t mix(uint64_t h) {
+		h ^= h >> 33;
+		h *= 0xFF51AFD7ED558CCDu;
+		h ^= h >> 33;
+		h *= 0xC4CEB9FE1A85EC53u;
+		h ^= h >> 33;
+		return h;
+	}
+
+	// Mirrors all the bytes of a word at once
+	static uint64_t flipBytes(uint64_t word) {
+		word = (word & 0x0F0F0F0F0F0F0F0F) << 4 | (word >> 4 & 0x0F0F0F0F0F0F0F0F);
+		word = (word & 0x3333333333333333) << 2 | (word >> 2 & 0x3333333333333333);
+		word = (word & 0x5555555555555555) << 1 | (word >> 1 & 0x5555555555555555);
+		return word;
+	}
+
+	// Reverses the order of a word's `size`-byte units
+	static uint64_t reverseUnits(uint64_t word, uint8_t size) {
+		word = word << 32 | word >> 32;
+		word = (word & 0x0000FFFF0000FFFF) << 16 | (word >> 16 & 0x0000FFFF0000FFFF);
+		if (size == 1) {
+			word = (word & 0x00FF00FF00FF00FF) << 8 | (word >> 8 & 0x00FF00FF00FF00FF);
+		}
+		return word;
+	}
+
+	std::array<uint8_t, 16> flipped(MatchType flip) const {
+		// Work on the tile as two little-endian words, each holding 8 rows of one byte (at 1bpp)
+		// or 4 rows of two bytes (at 2bpp); this is done byte by byte to be endianness-agnostic,
+		// which compilers turn back into single loads and stores
+		uint64_t lo = 0, hi = 0;
+		for (uint8_t i = 0; i < 8; ++i) {
+			lo |= (uint64_t)_data[i] << (i * 8);
+			hi |= (uint64_t)_data[i + 8] << (i * 8);
+		}
+
+		if (flip == HFLIP || flip == VHFLIP) {
+			lo = flipBytes(lo);
+			hi = flipBytes(hi);
+		}
+		if (flip == VFLIP || flip == VHFLIP) {
+			if (options.bitDepth == 1) {
+				lo = reverseUnits(lo, 1); // `hi` is unused
+			} else {
+				std::tie(lo, hi) = std::pair{reverseUnits(hi, 2), reverseUnits(lo, 2)};
+			}
+		}
+
+		std::array<uint8_t, 16> variant;
+		for (uint8_t i = 0; i < 8; ++i) {
+			variant[i] = lo >> (i * 8);
+			variant[i + 8] = hi >> (i * 8);
+		}
+		return variant;
 	}
 
 	auto const &data() const { return _data; }
-	uint16_t hash() const { return _hash; }
+	uint64_t hash() const { return _hash; }
 
-	enum MatchType {
-		NOPE,
-		EXACT,
-		HFLIP,
-		VFLIP,
-		VHFLIP,
-	};
 	MatchType tryMatching(TileData const &other) const {
 		// Check for strict equality first, as that can typically be optimized, and it allows
 		// hoisting the mirroring check out of the loop
@@ -777,101 +1085,70 @@ public:
 			return MatchType::NOPE;
 		}
 
-		// Check if we have horizontal mirroring, which scans the array forward again
-		if (std::equal(RANGE(_data), other._data.begin(), [](uint8_t lhs, uint8_t rhs) {
-			    return lhs == flipTable[rhs];
-		    })) {
-			return MatchType::HFLIP;
-		}
-
-		// Check if we have vertical or vertical+horizontal mirroring, for which we have to read
-		// bitplane *pairs*  backwards
-		bool hasVFlip = true, hasVHFlip = true;
-		for (uint8_t i = 0; i < _data.size(); ++i) {
-			// Flip the bottom bit to get the corresponding row's bitplane 0/1
-			// (This works because the array size is even)
-			uint8_t lhs = _data[i], rhs = other._data[(15 - i) ^ 1];
-			if (lhs != rhs) {
-				hasVFlip = false;
-			}
-			if (lhs != flipTable[rhs]) {
-				hasVHFlip = false;
-			}
-			if (!hasVFlip && !hasVHFlip) {
-				return MatchType::NOPE; // If both have been eliminated, all hope is lost!
+		// If the tile is symmetric, default to vflip only
+		for (MatchType flip : {HFLIP, VFLIP, VHFLIP}) {
+			if (other.flipped(flip) == _data) {
+				return flip;
 			}
 		}
-
-		// If we have both (i.e. we have symmetry), default to vflip only
-		assume(hasVFlip || hasVHFlip);
-		return hasVFlip ? MatchType::VFLIP : MatchType::VHFLIP;
-	}
-	friend bool operator==(TileData const &lhs, TileData const &rhs) {
-		return lhs.tryMatching(rhs) != MatchType::NOPE;
+		return MatchType::NOPE;
 	}
 };
 
-template<>
-struct std::hash<TileData> {
-	std::size_t operator()(TileData const &tile) const { return tile.hash(); }
-};
-
 namespace unoptimized {
 
 static void outputTileData(
     Png const &png,
+    ImageTiles const &imageTiles,
+    uint32_t rowLength,
     DefaultInitVec<AttrmapEntry> const &attrmap,
     std::vector<Palette> const &palettes,
-    DefaultInitVec<size_t> const &mappings
+    DefaultInitVec<size_t> const &mappings,
+    std::vector<Output> &outputs
 ) {
-	File output;
-	if (!output.open(options.output, std::ios_base::out | std::ios_base::binary)) {
-		fatal("Failed to open \"%s\": %s", output.c_str(options.output), strerror(errno));
-	}
+	std::vector<uint8_t> &data = outputs.emplace_back(&options.output).data;
 
-	uint16_t widthTiles = options.inputSlice.width ? options.inputSlice.width : png.getWidth() / 8;
-	uint16_t heightTiles =
-	    options.inputSlice.height ? options.inputSlice.height : png.getHeight() / 8;
+	uint16_t widthTiles = png.getWidth() / 8;
+	uint16_t heightTiles = png.getHeight() / 8;
 	uint64_t remainingTiles = widthTiles * heightTiles;
 	if (remainingTiles <= options.trim) {
 		return;
 	}
 	remainingTiles -= options.trim;
 
-	for (auto [tile, attr] : zip(png.visitAsTiles(), attrmap)) {
+	size_t tileSize = options.bitDepth * 8;
+	data.resize(remainingTiles * tileSize);
+	forEachTile(remainingTiles, rowLength, [&](size_t i) {
 		// If the tile is fully transparent, default to palette 0
-		Palette const &palette = palettes[attr.getPalID(mappings)];
+		Palette const &palette = palettes[attrmap[i].getPalID(mappings)];
+		uint8_t *ptr = &data[i * tileSize];
 		for (uint32_t y = 0; y < 8; ++y) {
-			uint16_t bitplanes = TileData::rowBitplanes(tile, palette, y);
-			output->sputc(bitplanes & 0xFF);
+			uint16_t bitplanes = TileData::rowBitplanes(imageTiles[i], palette, y);
+			*ptr++ = bitplanes & 0xFF;
 			if (options.bitDepth == 2) {
-				output->sputc(bitplanes >> 8);
+				*ptr++ = bitplanes >> 8;
 			}
 		}
-
-		--remainingTiles;
-		if (remainingTiles == 0) {
-			break;
-		}
-	}
-	assume(remainingTiles == 0);
+	});
 }
 
 static void outputMaps(
-    DefaultInitVec<AttrmapEntry> const &attrmap, DefaultInitVec<size_t> const &mappings
+    DefaultInitVec<AttrmapEntry> const &attrmap,
+    DefaultInitVec<size_t> const &mappings,
+    std::vector<Output> &outputs
 ) {
-	std::optional<File> tilemapOutput, attrmapOutput, palmapOutput;
-	auto autoOpenPath = [](std::string const &path, std::optional<File> &file) {
+	std::vector<uint8_t> *tilemapOutput = nullptr, *attrmapOutput = nullptr,
+	                     *palmapOutput = nullptr;
+	outputs.reserve(outputs.size() + 3); // Do not move the outputs while pointing to them
+	auto addOutput = [&](std::string const &path, std::vector<uint8_t> *&data) {
 		if (!path.empty()) {
-			file.emplace();
-			if (!file->open(path, std::ios_base::out | std::ios_base::binary)) {
-				fatal("Failed to open \"%s\": %s", file->c_str(options.tilemap), strerror(errno));
-			}
+			data = &outputs.emplace_back(&path).data;
+			data->reserve(attrmap.size());
 		}
 	};
-	autoOpenPath(options.tilemap, tilemapOutput);
-	autoOpenPath(options.attrmap, attrmapOutput);
-	autoOpenPath(options.palmap, palmapOutput);
+	addOutput(options.tilemap, tilemapOutput);
+	addOutput(options.attrmap, attrmapOutput);
+	addOutput(options.palmap, palmapOutput);
 
 	uint8_t tileID = 0;
 	uint8_t bank = 0;
@@ -882,15 +1159,15 @@ static void outputMaps(
 			tileID = 0;
 		}
 
-		if (tilemapOutput.has_value()) {
-			(*tilemapOutput)->sputc(tileID + options.baseTileIDs[bank]);
+		if (tilemapOutput) {
+			tilemapOutput->push_back(tileID + options.baseTileIDs[bank]);
 		}
-		if (attrmapOutput.has_value()) {
+		if (attrmapOutput) {
 			uint8_t palID = attr.getPalID(mappings) & 7;
-			(*attrmapOutput)->sputc(palID | bank << 3); // The other flags are all 0
+			attrmapOutput->push_back(palID | bank << 3); // The other flags are all 0
 		}
-		if (palmapOutput.has_value()) {
-			(*palmapOutput)->sputc(attr.getPalID(mappings));
+		if (palmapOutput) {
+			palmapOutput->push_back(attr.getPalID(mappings));
 		}
 		++tileID;
 	}
@@ -901,8 +1178,11 @@ static void outputMaps(
 namespace optimized {
 
 struct UniqueTiles {
-	std::unordered_set<TileData> tileset;
+	std::deque<TileData> tileset; // In order of tile ID
 	std::vector<TileData const *> tiles;
+	// Open-addressing table of indices into `tileset`, plus one so that 0 marks an empty slot;
+	// its size is a power of 2, and it is kept at most half full
+	std::vector<uint32_t> slots = std::vector<uint32_t>(256, 0);
 
 	UniqueTiles() = default;
 	// Copies are likely to break pointers, so we really don't want those.
@@ -910,26 +1190,49 @@ struct UniqueTiles {
 	UniqueTiles(UniqueTiles const &) = delete;
 	UniqueTiles(UniqueTiles &&) = default;
 
+	// Returns the slot holding a tile matching this one, or else the empty slot where it would go
+	uint32_t &findSlot(TileData const &tile) {
+		size_t mask = slots.size() - 1;
+		for (size_t i = tile.hash() & mask;; i = (i + 1) & mask) {
+			if (slots[i] == 0) {
+				return slots[i];
+			}
+			TileData const &other = tileset[slots[i] - 1];
+			if (other.hash() == tile.hash() && other.tryMatching(tile) != TileData::NOPE) {
+				return slots[i];
+			}
+		}
+	}
+
+	void grow() {
+		std::vector<uint32_t> oldSlots = std::move(slots);
+		slots.assign(oldSlots.size() * 2, 0);
+		for (uint32_t idx : oldSlots) {
+			if (idx != 0) {
+				findSlot(tileset[idx - 1]) = idx;
+			}
+		}
+	}
+
 	/*
 	 * Adds a tile to the collection, and returns its ID
 	 */
-	std::tuple<uint16_t, TileData::MatchType>
-	    addTile(Png::TilesVisitor::Tile const &tile, Palette const &palette) {
-		TileData newTile(tile, palette);
-		auto [tileData, inserted] = tileset.insert(newTile);
-
-		TileData::MatchType matchType = TileData::EXACT;
-		if (inserted) {
-			// Give the new tile the next available unique ID
-			tileData->tileID = static_cast<uint16_t>(tiles.size());
-			// Pointers are never invalidated!
-			tiles.emplace_back(&*tileData);
-		} else {
-			matchType = tileData->tryMatching(newTile);
+	std::tuple<uint16_t, TileData::MatchType> addTile(TileData newTile) {
+		if (uint32_t slot = findSlot(newTile); slot != 0) {
+			TileData const &tileData = tileset[slot - 1];
+			return {tileData.tileID, tileData.tryMatching(newTile)};
 		}
-		return {tileData->tileID, matchType};
-	}
 
+		// Give the new tile the next available unique ID
+		newTile.tileID = static_cast<uint16_t>(tiles.size());
+		// Pointers are never invalidated!
+		tiles.emplace_back(&tileset.emplace_back(newTile));
+		if (tileset.size() * 2 > slots.size()) {
+			grow();
+		}
+		findSlot(newTile) = tileset.size();
+		return {newTile.tileID, TileData::EXACT};
+	}
 	auto size() const { return tiles.size(); }
 
 	auto begin() const { return tiles.begin(); }
@@ -942,8 +1245,10 @@ struct UniqueTiles {
  * 8-bit tile IDs + the bank bit; this will save the work when we output the data later (potentially
  * twice)
  */
-static UniqueTiles dedupTiles(
-    Png const &png,
+static void dedupTiles(
+    UniqueTiles &tiles,
+    ImageTiles const &imageTiles,
+    uint32_t rowLength,
     DefaultInitVec<AttrmapEntry> &attrmap,
     std::vector<Palette> const &palettes,
     DefaultInitVec<size_t> const &mappings
@@ -951,10 +1256,16 @@ static UniqueTiles dedupTiles(
 	// Iterate throughout the image, generating tile data as we go
 	// (We don't need the full tile data to be able to dedup tiles, but we don't lose anything
 	// by caching the full tile data anyway, so we might as well.)
-	UniqueTiles tiles;
+	// The tiles may already contain other images', to share them with this one.
+
+	// Encoding the tiles is independent, but IDs must be assigned in order
+	DefaultInitVec<std::optional<TileData>> tileData(imageTiles.size());
+	forEachTile(imageTiles.size(), rowLength, [&](size_t i) {
+		tileData[i].emplace(imageTiles[i], palettes[mappings[attrmap[i].protoPaletteID]]);
+	});
 
-	for (auto [tile, attr] : zip(png.visitAsTiles(), attrmap)) {
-		auto [tileID, matchType] = tiles.addTile(tile, palettes[mappings[attr.protoPaletteID]]);
+	for (auto [data, attr] : zip(tileData, attrmap)) {
+		auto [tileID, matchType] = tiles.addTile(*data);
 
 		attr.xFlip = matchType == TileData::HFLIP || matchType == TileData::VHFLIP;
 		attr.yFlip = matchType == TileData::VFLIP || matchType == TileData::VHFLIP;
@@ -962,15 +1273,13 @@ static UniqueTiles dedupTiles(
 		attr.tileID =
 		    (attr.bank ? tileID - options.maxNbTiles[0] : tileID) + options.baseTileIDs[attr.bank];
 	}
-
-	// Copy elision should prevent the contained `unordered_set` from being re-constructed
-	return tiles;
 }
 
-static void outputTileData(UniqueTiles const &tiles) {
-	File output;
-	if (!output.open(options.output, std::ios_base::out | std::ios_base::binary)) {
-		fatal("Failed to create \"%s\": %s", output.c_str(options.output), strerror(errno));
+static void outputTileData(UniqueTiles const &tiles, std::vector<Output> &outputs) {
+	std::vector<uint8_t> &data = outputs.emplace_back(&options.output).data;
+	size_t tileSize = options.bitDepth * 8;
+	if (tiles.size() > options.trim) {
+		data.reserve((tiles.size() - options.trim) * tileSize);
 	}
 
 	uint16_t tileID = 0;
@@ -978,52 +1287,121 @@ static void outputTileData(UniqueTiles const &tiles) {
 		TileData const *tile = *iter;
 		assume(tile->tileID == tileID);
 		++tileID;
-		output->sputn(reinterpret_cast<char const *>(tile->data().data()), options.bitDepth * 8);
+		data.insert(data.end(), tile->data().begin(), tile->data().begin() + tileSize);
 	}
 }
 
-static void outputTilemap(DefaultInitVec<AttrmapEntry> const &attrmap) {
-	File output;
-	if (!output.open(options.tilemap, std::ios_base::out | std::ios_base::binary)) {
-		fatal("Failed to create \"%s\": %s", output.c_str(options.tilemap), strerror(errno));
-	}
-
+static void
+    outputTilemap(DefaultInitVec<AttrmapEntry> const &attrmap, std::vector<Output> &outputs) {
+	std::vector<uint8_t> &data = outputs.emplace_back(&options.tilemap).data;
+	data.reserve(attrmap.size());
 	for (AttrmapEntry const &entry : attrmap) {
-		output->sputc(entry.tileID); // The tile ID has already been converted
+		data.push_back(entry.tileID); // The tile ID has already been converted
 	}
 }
 
 static void outputAttrmap(
-    DefaultInitVec<AttrmapEntry> const &attrmap, DefaultInitVec<size_t> const &mappings
+    DefaultInitVec<AttrmapEntry> const &attrmap,
+    DefaultInitVec<size_t> const &mappings,
+    std::vector<Output> &outputs
 ) {
-	File output;
-	if (!output.open(options.attrmap, std::ios_base::out | std::ios_base::binary)) {
-		fatal("Failed to create \"%s\": %s", output.c_str(options.attrmap), strerror(errno));
-	}
-
+	std::vector<uint8_t> &data = outputs.emplace_back(&options.attrmap).data;
+	data.reserve(attrmap.size());
 	for (AttrmapEntry const &entry : attrmap) {
 		uint8_t attr = entry.xFlip << 5 | entry.yFlip << 6;
 		attr |= entry.bank << 3;
 		attr |= entry.getPalID(mappings) & 7;
-		output->sputc(attr);
+		data.push_back(attr);
 	}
 }
 
 static void outputPalmap(
-    DefaultInitVec<AttrmapEntry> const &attrmap, DefaultInitVec<size_t> const &mappings
+    DefaultInitVec<AttrmapEntry> const &attrmap,
+    DefaultInitVec<size_t> const &mappings,
+    std::vector<Output> &outputs
 ) {
-	File output;
-	if (!output.open(options.palmap, std::ios_base::out | std::ios_base::binary)) {
-		fatal("Failed to create \"%s\": %s", output.c_str(options.palmap), strerror(errno));
-	}
-
+	std::vector<uint8_t> &data = outputs.emplace_back(&options.palmap).data;
+	data.reserve(attrmap.size());
 	for (AttrmapEntry const &entry : attrmap) {
-		output->sputc(entry.getPalID(mappings));
+		data.push_back(entry.getPalID(mappings));
 	}
 }
 
 } // namespace optimized
 
+/*
+ * Indexes proto-palettes by their sets of colors, so that the ones containing a tile's colors, or
+ * contained in them, can be found without comparing the tile against every proto-palette
+ */
+class ProtoPaletteIndex {
+	// Both map packed color sets to the sorted IDs of the proto-palettes...
+	std::unordered_map<uint64_t, std::vector<size_t>> _withColors;  // ...with exactly these colors
+	std::unordered_map<uint64_t, std::vector<size_t>> _withSubsets; // ...containing these colors
+
+	static uint64_t key(ProtoPalette const &protoPal) {
+		uint64_t packed = UINT64_MAX;
+		for (uint16_t color : protoPal) {
+			packed = packed << 16 | color;
+		}
+		return packed;
+	}
+
+	// Calls `func` with the keys of all the non-empty subsets of a proto-palette, including itself
+	template<typename F>
+	static void forEachSubset(ProtoPalette const &protoPal, F const &func) {
+		std::vector<uint16_t> colors(RANGE(protoPal));
+		for (unsigned mask = 1; mask < 1u << colors.size(); ++mask) {
+			ProtoPalette subset;
+			for (size_t i = 0; i < colors.size(); ++i) {
+				if (mask & 1u << i) {
+					subset.add(colors[i]);
+				}
+			}
+			func(key(subset));
+		}
+	}
+
+	static void insertSorted(std::vector<size_t> &ids, size_t id) {
+		if (auto pos = std::lower_bound(RANGE(ids), id); pos == ids.end() || *pos != id) {
+			ids.insert(pos, id);
+		}
+	}
+
+public:
+	void add(size_t id, ProtoPalette const &protoPal) {
+		insertSorted(_withColors[key(protoPal)], id);
+		forEachSubset(protoPal, [&](uint64_t subsetKey) {
+			insertSorted(_withSubsets[subsetKey], id);
+		});
+	}
+
+	// A proto-palette may only be replaced by one containing it, so it keeps all its subsets
+	void replace(size_t id, ProtoPalette const &oldProtoPal, ProtoPalette const &newProtoPal) {
+		std::vector<size_t> &ids = _withColors[key(oldProtoPal)];
+		ids.erase(std::find(RANGE(ids), id));
+		add(id, newProtoPal);
+	}
+
+	/*
+	 * Returns the IDs of all the proto-palettes which contain, or are contained in, the given one,
+	 * in increasing order
+	 */
+	std::vector<size_t> candidates(ProtoPalette const &protoPal) const {
+		std::vector<size_t> ids;
+		if (auto supersets = _withSubsets.find(key(protoPal)); supersets != _withSubsets.end()) {
+			ids = supersets->second;
+		}
+		forEachSubset(protoPal, [&](uint64_t subsetKey) {
+			if (auto subsets = _withColors.find(subsetKey); subsets != _withColors.end()) {
+				ids.insert(ids.end(), RANGE(subsets->second));
+			}
+		});
+		std::sort(RANGE(ids));
+		ids.erase(std::unique(RANGE(ids)), ids.end());
+		return ids;
+	}
+};
+
 void processPalettes() {
 	options.verbosePrint(Options::VERB_CFG, "Using libpng %s\n", png_get_libpng_ver(nullptr));
 
@@ -1031,14 +1409,22 @@ void processPalettes() {
 	std::vector<Palette> palettes;
 	std::tie(std::ignore, palettes) = makePalsAsSpecified(protoPalettes);
 
-	outputPalettes(palettes);
+	std::vector<Output> outputs;
+	outputPalettes(palettes, outputs);
+	writeOutputs(outputs);
 }
 
-void process() {
+// With `--shared-tiles`, the tiles of all the images processed so far
+static optimized::UniqueTiles sharedTiles;
+
+static void processImage(bool shareTiles) {
+	TracePhase phase("convert", options.input);
 	options.verbosePrint(Options::VERB_CFG, "Using libpng %s\n", png_get_libpng_ver(nullptr));
 
 	options.verbosePrint(Options::VERB_LOG_ACT, "Reading tiles...\n");
+	trace_Begin("read_png");
 	Png png(options.input); // This also sets `hasTransparentPixels` as a side effect
+	trace_End();
 	ImagePalette const &colors = png.getColors();
 
 	// Now, we have all the image's colors in `colors`
@@ -1046,11 +1432,8 @@ void process() {
 
 	if (options.verbosity >= Options::VERB_INTERM) {
 		fputs("Image colors: [ ", stderr);
-		for (auto const &slot : colors) {
-			if (!slot.has_value()) {
-				continue;
-			}
-			fprintf(stderr, "#%08x, ", slot->toCSS());
+		for (Rgba const &color : colors) {
+			fprintf(stderr, "#%08x, ", color.toCSS());
 		}
 		fputs("]\n", stderr);
 	}
@@ -1059,25 +1442,39 @@ void process() {
 	// We do this unconditionally because this performs the image validation (which we want to
 	// perform even if no output is requested), and because it's necessary to generate any
 	// output (with the exception of an un-duplicated tilemap, but that's an acceptable loss.)
+	trace_Begin("proto_palettes");
 	std::vector<ProtoPalette> protoPalettes;
+	ProtoPaletteIndex protoPalIndex;
 	DefaultInitVec<AttrmapEntry> attrmap{};
 
+	ImageTiles imageTiles;
 	for (auto tile : png.visitAsTiles()) {
-		ProtoPalette tileColors;
-		AttrmapEntry &attrs = attrmap.emplace_back();
-		uint8_t nbColorsInTile = 0;
-
+		imageTiles.push_back(tile);
+	}
+	uint32_t rowLength = png.visitAsTiles().rowLength();
+
+	// Collecting each tile's colors is independent, but the proto-palettes must be inserted in
+	// order, for the output to be the same regardless of the number of threads
+	std::vector<std::pair<ProtoPalette, uint8_t>> colorsInTiles(imageTiles.size());
+	forEachTile(imageTiles.size(), rowLength, [&](size_t i) {
+		auto &[tileColors, nbColorsInTile] = colorsInTiles[i];
+		nbColorsInTile = 0;
 		for (uint32_t y = 0; y < 8; ++y) {
 			for (uint32_t x = 0; x < 8; ++x) {
-				Rgba color = tile.pixel(x, y);
-				if (!color.isTransparent()) { // Do not count transparency in for packing
+				uint16_t color = imageTiles[i].pixel(x, y);
+				if (color != Rgba::transparent) { // Do not count transparency in for packing
 					// Add the color to the proto-pal (if not full), and count it if it was unique.
-					if (tileColors.add(color.cgbColor())) {
+					if (tileColors.add(color)) {
 						++nbColorsInTile;
 					}
 				}
 			}
 		}
+	});
+
+	for (auto [tile, colorsInTile] : zip(imageTiles, colorsInTiles)) {
+		auto const &[tileColors, nbColorsInTile] = colorsInTile;
+		AttrmapEntry &attrs = attrmap.emplace_back();
 
 		if (tileColors.empty()) {
 			// "Empty" proto-palettes screw with the packing process, so discard those
@@ -1086,9 +1483,10 @@ void process() {
 		}
 
 		// Insert the proto-palette, making sure to avoid overlaps
-		for (size_t n = 0; n < protoPalettes.size(); ++n) {
+		for (size_t n : protoPalIndex.candidates(tileColors)) {
 			switch (tileColors.compare(protoPalettes[n])) {
 			case ProtoPalette::WE_BIGGER:
+				protoPalIndex.replace(n, protoPalettes[n], tileColors);
 				protoPalettes[n] = tileColors; // Override them
 				// Remove any other proto-palettes that we encompass
 				// (Example [(0, 1), (0, 2)], inserting (0, 1, 2))
@@ -1134,10 +1532,13 @@ void process() {
 			    AttrmapEntry::transparent
 			);
 		}
+		protoPalIndex.add(protoPalettes.size(), tileColors);
 		protoPalettes.push_back(tileColors);
 continue_visiting_tiles:;
 	}
 
+	trace_End();
+
 	options.verbosePrint(
 	    Options::VERB_INTERM,
 	    "Image contains %zu proto-palette%s\n",
@@ -1154,13 +1555,17 @@ continue_visiting_tiles:;
 		}
 	}
 
+	trace_Begin("pack_palettes");
 	if (options.palSpecType == Options::EMBEDDED) {
 		generatePalSpec(png);
 	}
 	auto [mappings, palettes] = options.palSpecType == Options::NO_SPEC
-	                                ? generatePalettes(protoPalettes, png)
+	                                ? generatePalettes(protoPalettes, attrmap, png)
 	                                : makePalsAsSpecified(protoPalettes);
-	outputPalettes(palettes);
+	trace_End();
+	// The outputs are only written once they have all been generated
+	std::vector<Output> outputs;
+	outputPalettes(palettes, outputs);
 
 	// If deduplication is not happening, we just need to output the tile data and/or maps as-is
 	if (!options.allowDedup) {
@@ -1178,7 +1583,9 @@ continue_visiting_tiles:;
 
 		if (!options.output.empty()) {
 			options.verbosePrint(Options::VERB_LOG_ACT, "Generating unoptimized tile data...\n");
-			unoptimized::outputTileData(png, attrmap, palettes, mappings);
+			unoptimized::outputTileData(
+			    png, imageTiles, rowLength, attrmap, palettes, mappings, outputs
+			);
 		}
 
 		if (!options.tilemap.empty() || !options.attrmap.empty() || !options.palmap.empty()) {
@@ -1186,40 +1593,67 @@ continue_visiting_tiles:;
 			    Options::VERB_LOG_ACT,
 			    "Generating unoptimized tilemap and/or attrmap and/or palmap...\n"
 			);
-			unoptimized::outputMaps(attrmap, mappings);
+			unoptimized::outputMaps(attrmap, mappings, outputs);
 		}
 	} else {
 		// All of these require the deduplication process to be performed to be output
 		options.verbosePrint(Options::VERB_LOG_ACT, "Deduplicating tiles...\n");
-		optimized::UniqueTiles tiles = optimized::dedupTiles(png, attrmap, palettes, mappings);
+		optimized::UniqueTiles imageOnlyTiles;
+		optimized::UniqueTiles &tiles = shareTiles ? sharedTiles : imageOnlyTiles;
+		trace_Begin("dedup_tiles");
+		optimized::dedupTiles(tiles, imageTiles, rowLength, attrmap, palettes, mappings);
+		trace_End();
 
 		if (tiles.size() > options.maxNbTiles[0] + options.maxNbTiles[1]) {
 			fatal(
-			    "Image contains %zu tiles, exceeding the limit of %" PRIu16 " + %" PRIu16,
+			    "%s %zu tiles, exceeding the limit of %" PRIu16 " + %" PRIu16,
+			    shareTiles ? "Images contain" : "Image contains",
 			    tiles.size(),
 			    options.maxNbTiles[0],
 			    options.maxNbTiles[1]
 			);
 		}
 
-		if (!options.output.empty()) {
+		// Shared tiles are only output once all images have contributed theirs
+		if (!shareTiles && !options.output.empty()) {
 			options.verbosePrint(Options::VERB_LOG_ACT, "Generating optimized tile data...\n");
-			optimized::outputTileData(tiles);
+			optimized::outputTileData(tiles, outputs);
 		}
 
 		if (!options.tilemap.empty()) {
 			options.verbosePrint(Options::VERB_LOG_ACT, "Generating optimized tilemap...\n");
-			optimized::outputTilemap(attrmap);
+			optimized::outputTilemap(attrmap, outputs);
 		}
 
 		if (!options.attrmap.empty()) {
 			options.verbosePrint(Options::VERB_LOG_ACT, "Generating optimized attrmap...\n");
-			optimized::outputAttrmap(attrmap, mappings);
+			optimized::outputAttrmap(attrmap, mappings, outputs);
 		}
 
 		if (!options.palmap.empty()) {
 			options.verbosePrint(Options::VERB_LOG_ACT, "Generating optimized palmap...\n");
-			optimized::outputPalmap(attrmap, mappings);
+			optimized::outputPalmap(attrmap, mappings, outputs);
 		}
 	}
+
+	writeOutputs(outputs);
+}
+
+void process() {
+	processImage(false);
+}
+
+void processSharedImage() {
+	// Each image has its own palettes, so whether they reserve a color for transparency too
+	options.hasTransparentPixels = false;
+	processImage(true);
+}
+
+void outputSharedTiles() {
+	if (!options.output.empty()) {
+		options.verbosePrint(Options::VERB_LOG_ACT, "Generating shared tile data...\n");
+		std::vector<Output> outputs;
+		optimized::outputTileData(sharedTiles, outputs);
+		writeOutputs(outputs);
+	}
 }
@@ -4,17 +4,22 @@
 
 #include <algorithm>
 #include <array>
+#include <condition_variable>
 #include <errno.h>
 #include <inttypes.h>
+#include <mutex>
 #include <optional>
 #include <png.h>
+#include <stdint.h>
 #include <string.h>
+#include <thread>
 #include <vector>
 
 #include "defaultinitalloc.hpp"
 #include "file.hpp"
 #include "helpers.hpp" // assume
 #include "itertools.hpp"
+#include "trace.hpp"
 
 #include "gfx/main.hpp"
 
@@ -23,7 +28,14 @@ static DefaultInitVec<uint8_t> readInto(std::string const &path) {
 	if (!file.open(path, std::ios::in | std::ios::binary)) {
 		fatal("Failed to open \"%s\": %s", file.c_str(path), strerror(errno));
 	}
-	DefaultInitVec<uint8_t> data(128 * 16); // Begin with some room pre-allocated
+	// If the file's size can be known, read it all at once (the extra byte detects the end of the
+	// file without growing the buffer); otherwise, begin with some room pre-allocated
+	size_t initialSize = 128 * 16;
+	if (std::streamoff size = file->pubseekoff(0, std::ios_base::end, std::ios_base::in);
+	    size != -1 && file->pubseekpos(0, std::ios_base::in) == 0) {
+		initialSize = size + 1;
+	}
+	DefaultInitVec<uint8_t> data(initialSize);
 
 	size_t curSize = 0;
 	for (;;) {
@@ -75,7 +87,21 @@ void flushPng(png_structp png) {
 	pngFile->pubsync();
 }
 
+// Interleaving a pair of bitplane bytes' bits gives their 8 pixels' 2-bit color indices at once
+static constexpr auto spreadTable = [] {
+	std::array<uint16_t, 256> table{};
+	for (unsigned int byte = 0; byte < table.size(); ++byte) {
+		for (unsigned int bit = 0; bit < 8; ++bit) {
+			if (byte & 1 << bit) {
+				table[byte] |= 1 << bit * 2;
+			}
+		}
+	}
+	return table;
+}();
+
 void reverse() {
+	TracePhase phase("reverse", options.output);
 	options.verbosePrint(Options::VERB_CFG, "Using libpng %s\n", png_get_libpng_ver(nullptr));
 
 	// Check for weird flag combinations
@@ -308,6 +334,8 @@ void reverse() {
 	    PNG_COMPRESSION_TYPE_DEFAULT,
 	    PNG_FILTER_TYPE_DEFAULT
 	);
+	// Tiles' few colors and sharp edges compress best without filtering, which is also faster
+	png_set_filter(png, PNG_FILTER_TYPE_BASE, PNG_FILTER_NONE);
 	png_write_info(png, pngInfo);
 
 	png_color_8 sbitChunk;
@@ -319,19 +347,18 @@ void reverse() {
 
 	constexpr uint8_t SIZEOF_PIXEL = 4; // Each pixel is 4 bytes (RGBA @ 8 bits/component)
 	size_t const SIZEOF_ROW = options.reversedWidth * 8 * SIZEOF_PIXEL;
-	std::vector<uint8_t> tileRow(8 * SIZEOF_ROW, 0xFF); // Data for 8 rows of pixels
-	uint8_t * const rowPtrs[8] = {
-	    &tileRow.data()[0 * SIZEOF_ROW],
-	    &tileRow.data()[1 * SIZEOF_ROW],
-	    &tileRow.data()[2 * SIZEOF_ROW],
-	    &tileRow.data()[3 * SIZEOF_ROW],
-	    &tileRow.data()[4 * SIZEOF_ROW],
-	    &tileRow.data()[5 * SIZEOF_ROW],
-	    &tileRow.data()[6 * SIZEOF_ROW],
-	    &tileRow.data()[7 * SIZEOF_ROW],
-	};
 
-	for (size_t ty = 0; ty < height; ++ty) {
+	// Each palette's colors, as the bytes that their pixels are made of
+	std::vector<std::array<std::array<uint8_t, SIZEOF_PIXEL>, 4>> paletteBytes(palettes.size());
+	for (auto [palette, bytes] : zip(palettes, paletteBytes)) {
+		for (auto [color, pixel] : zip(palette, bytes)) {
+			Rgba rgba = color.value_or(Rgba(0)); // Missing colors should not be used anyway
+			pixel = {rgba.red, rgba.green, rgba.blue, rgba.alpha};
+		}
+	}
+
+	// Renders a row of tiles, i.e. 8 rows of pixels
+	auto renderTileRow = [&](size_t ty, uint8_t *tileRow) {
 		for (size_t tx = 0; tx < width; ++tx) {
 			size_t index = options.columnMajor ? ty + tx * height : ty * width + tx;
 			// By default, a tile is unflipped, in bank 0, and uses palette #0
@@ -343,33 +370,16 @@ void reverse() {
 				tileID =
 				    (*tilemap)[index] - options.baseTileIDs[bank] + bank * options.maxNbTiles[0];
 			}
-			assume(tileID < nbTileInstances); // Should have been checked earlier
 			size_t palID = palmap ? (*palmap)[index] : attribute & 0b111;
 			assume(palID < palettes.size()); // Should be ensured on data read
 
 			// We do not have data for tiles trimmed with `-x`, so assume they are "blank"
-			static std::array<uint8_t, 16> const trimmedTile{
-			    0x00,
-			    0x00,
-			    0x00,
-			    0x00,
-			    0x00,
-			    0x00,
-			    0x00,
-			    0x00,
-			    0x00,
-			    0x00,
-			    0x00,
-			    0x00,
-			    0x00,
-			    0x00,
-			    0x00,
-			    0x00,
-			};
-			uint8_t const *tileData = tileID > nbTileInstances - options.trim
+			// (A tilemap may be smaller than the tile data, e.g. if it is shared with others)
+			static std::array<uint8_t, 16> const trimmedTile{};
+			uint8_t const *tileData = tileID >= tiles.size() / tileSize
 			                              ? trimmedTile.data()
 			                              : &tiles[tileID * tileSize];
-			auto const &palette = palettes[palID];
+			auto const &palette = paletteBytes[palID];
 			for (uint8_t y = 0; y < 8; ++y) {
 				// If vertically mirrored, fetch the bytes from the other end
 				uint8_t realY = (attribute & 0x40 ? 7 - y : y) * options.bitDepth;
@@ -379,26 +389,91 @@ void reverse() {
 					bitplane0 = flipTable[bitplane0];
 					bitplane1 = flipTable[bitplane1];
 				}
-				uint8_t *ptr = &rowPtrs[y][tx * 8 * SIZEOF_PIXEL];
+				// The row's 8 color indices, from the leftmost pixel in the top bits
+				uint16_t indices = spreadTable[bitplane0] | spreadTable[bitplane1] << 1;
+				uint8_t *ptr = &tileRow[y * SIZEOF_ROW + tx * 8 * SIZEOF_PIXEL];
 				for (uint8_t x = 0; x < 8; ++x) {
-					uint8_t bit0 = bitplane0 & 0x80, bit1 = bitplane1 & 0x80;
-					Rgba const &pixel = *palette[bit0 >> 7 | bit1 >> 6];
-					*ptr++ = pixel.red;
-					*ptr++ = pixel.green;
-					*ptr++ = pixel.blue;
-					*ptr++ = pixel.alpha;
-
-					// Shift the pixel out
-					bitplane0 <<= 1;
-					bitplane1 <<= 1;
+					memcpy(ptr, palette[indices >> 14].data(), SIZEOF_PIXEL);
+					ptr += SIZEOF_PIXEL;
+					indices <<= 2;
 				}
 			}
 		}
-		// We never modify the pointers, and neither should libpng, despite the overly lax function
-		// signature.
-		// (AIUI, casting away const-ness is okay as long as you don't actually modify the
-		// pointed-to data)
-		png_write_rows(png, const_cast<png_bytepp>(rowPtrs), 8);
+	};
+
+	// Bands of tile rows are rendered in parallel into a ring of buffers, and each is written as
+	// soon as it and all of the ones above it are ready; they are large enough for handing them
+	// over to be cheap, but small enough to keep their pixels in the cache
+	size_t const bandHeight = std::clamp<size_t>(0x10000 / (8 * SIZEOF_ROW), 1, height);
+	size_t const nbBands = (height + bandHeight - 1) / bandHeight;
+	size_t const SIZEOF_BAND = bandHeight * 8 * SIZEOF_ROW;
+	size_t nbBuffers = options.nbJobs > 1 && nbBands > 1 ? options.nbJobs * 2 : 1;
+	std::vector<uint8_t> bands(nbBuffers * SIZEOF_BAND);
+	auto renderBand = [&](size_t band) {
+		uint8_t *ptr = &bands[band % nbBuffers * SIZEOF_BAND];
+		for (size_t ty = band * bandHeight; ty < (band + 1) * bandHeight && ty < height; ++ty) {
+			renderTileRow(ty, ptr);
+			ptr += 8 * SIZEOF_ROW;
+		}
+	};
+	std::vector<png_bytep> rowPtrs(bandHeight * 8);
+	auto writeBand = [&](size_t band) {
+		size_t nbRows = (std::min((band + 1) * bandHeight, height) - band * bandHeight) * 8;
+		for (size_t y = 0; y < nbRows; ++y) {
+			rowPtrs[y] = &bands[band % nbBuffers * SIZEOF_BAND + y * SIZEOF_ROW];
+		}
+		png_write_rows(png, rowPtrs.data(), nbRows);
+	};
+
+	if (nbBuffers == 1) {
+		for (size_t band = 0; band < nbBands; ++band) {
+			renderBand(band);
+			writeBand(band);
+		}
+	} else {
+		std::mutex mutex;
+		std::condition_variable cond; // Signaled when a band is rendered, or a buffer freed
+		size_t nextBand = 0, nbWritten = 0;
+		std::vector<size_t> renderedBands(nbBuffers, SIZE_MAX); // The band in each buffer
+
+		std::vector<std::thread> workers;
+		for (unsigned int i = 0; i < options.nbJobs && i < nbBands; ++i) {
+			workers.emplace_back([&] {
+				for (;;) {
+					size_t band;
+					{
+						std::unique_lock lock(mutex);
+						if (nextBand == nbBands) {
+							return;
+						}
+						band = nextBand++;
+						// Wait for the band that was in this buffer to be written
+						cond.wait(lock, [&] { return band < nbWritten + nbBuffers; });
+					}
+					renderBand(band);
+					{
+						std::lock_guard lock(mutex);
+						renderedBands[band % nbBuffers] = band;
+					}
+					cond.notify_all();
+				}
+			});
+		}
+		for (size_t band = 0; band < nbBands; ++band) {
+			{
+				std::unique_lock lock(mutex);
+				cond.wait(lock, [&] { return renderedBands[band % nbBuffers] == band; });
+			}
+			writeBand(band);
+			{
+				std::lock_guard lock(mutex);
+				++nbWritten;
+			}
+			cond.notify_all();
+		}
+		for (std::thread &worker : workers) {
+			worker.join();
+		}
 	}
 
 	// Finalize the write
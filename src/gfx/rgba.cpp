@@ -3,6 +3,7 @@
 #include "gfx/rgba.hpp"
 
 #include <algorithm>
+#include <array>
 #include <math.h>
 #include <stdint.h>
 
@@ -34,6 +35,27 @@ static std::array<uint8_t, 256> reverse_curve{
     31, 31, 31, 31, 31, 31, 31, 31, 31, 31, 31, 31, 31, 31, 31, 31, // visualization!
 };
 
+/*
+ * The color curve adjusts green depending on blue, so the CGB green component is looked up from
+ * both; the table is only computed the first time that it is needed.
+ */
+static std::array<uint8_t, 256 * 256> const &curvedGreens() {
+	static std::array<uint8_t, 256 * 256> const table = [] {
+		std::array<uint8_t, 256 * 256> greens;
+		for (unsigned g = 0; g < 256; ++g) {
+			double g_linear = pow(g / 255.0, 2.2);
+			for (unsigned b = 0; b < 256; ++b) {
+				double b_linear = pow(b / 255.0, 2.2);
+				double g_adjusted = std::clamp((g_linear * 4 - b_linear) / 3, 0.0, 1.0);
+				uint8_t g_corrected = round(pow(g_adjusted, 1 / 2.2) * 255);
+				greens[g << 8 | b] = reverse_curve[g_corrected];
+			}
+		}
+		return greens;
+	}();
+	return table;
+}
+
 uint16_t Rgba::cgbColor() const {
 	if (isTransparent()) {
 		return transparent;
@@ -42,11 +64,8 @@ uint16_t Rgba::cgbColor() const {
 
 	uint8_t r = red, g = green, b = blue;
 	if (options.useColorCurve) {
-		double g_linear = pow(g / 255.0, 2.2), b_linear = pow(b / 255.0, 2.2);
-		double g_adjusted = std::clamp((g_linear * 4 - b_linear) / 3, 0.0, 1.0);
-		g = round(pow(g_adjusted, 1 / 2.2) * 255);
+		g = curvedGreens()[g << 8 | b];
 		r = reverse_curve[r];
-		g = reverse_curve[g];
 		b = reverse_curve[b];
 	} else {
 		r >>= 3;
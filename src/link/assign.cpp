@@ -2,11 +2,17 @@
 
 #include "link/assign.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <deque>
 #include <inttypes.h>
+#include <random>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <thread>
 #include <vector>
 
 #include "error.hpp"
@@ -15,6 +21,7 @@
 #include "linkdefs.hpp"
 #include "platform.hpp"
 
+#include "link/incremental.hpp"
 #include "link/main.hpp"
 #include "link/output.hpp"
 #include "link/section.hpp"
@@ -31,23 +38,87 @@ struct FreeSpace {
 };
 
 // Table of free space for each bank
-std::vector<std::deque<FreeSpace>> memory[SECTTYPE_INVALID];
+std::vector<std::vector<FreeSpace>> memory[SECTTYPE_INVALID];
+
+// Segment tree of the largest free space in each bank of a region, so that banks which cannot
+// fit a section can be skipped without looking at their free spaces
+struct LargestFreeSpaces {
+	size_t nbLeaves; // A power of 2, at least the number of banks
+	std::vector<uint16_t> sizes; // `sizes[1]` is the root, leaves start at `sizes[nbLeaves]`
+
+	void init(size_t nbBanks, uint16_t size) {
+		for (nbLeaves = 1; nbLeaves < nbBanks; nbLeaves *= 2)
+			;
+		sizes.assign(nbLeaves * 2, 0);
+		for (size_t bankIdx = 0; bankIdx < nbBanks; bankIdx++)
+			sizes[nbLeaves + bankIdx] = size;
+		for (size_t node = nbLeaves; --node;)
+			sizes[node] = std::max(sizes[node * 2], sizes[node * 2 + 1]);
+	}
+
+	uint16_t get(size_t bankIdx) const { return sizes[nbLeaves + bankIdx]; }
+
+	void update(size_t bankIdx, uint16_t size) {
+		size_t node = nbLeaves + bankIdx;
+
+		sizes[node] = size;
+		for (node /= 2; node; node /= 2)
+			sizes[node] = std::max(sizes[node * 2], sizes[node * 2 + 1]);
+	}
+
+	// Returns the index of the first bank from `bankIdx` on with room for `size` bytes, or -1
+	ssize_t findFrom(size_t bankIdx, uint16_t size) const {
+		if (bankIdx >= nbLeaves)
+			return -1;
+
+		size_t node = nbLeaves + bankIdx;
+
+		if (sizes[node] >= size)
+			return bankIdx;
+		// Go up until a subtree to the right of the starting bank has enough room...
+		for (;; node /= 2) {
+			if (node == 1)
+				return -1;
+			if (node % 2 == 0 && sizes[node + 1] >= size) {
+				node++;
+				break;
+			}
+		}
+		// ...then down to its leftmost bank which has enough room
+		while (node < nbLeaves)
+			node = sizes[node * 2] >= size ? node * 2 : node * 2 + 1;
+		return node - nbLeaves;
+	}
+};
 
-uint64_t nbSectionsToAssign;
+static LargestFreeSpaces largestFreeSpaces[SECTTYPE_INVALID];
+
+std::atomic_uint64_t nbSectionsToAssign;
 
 // Init the free space-modelling structs
 static void initFreeSpace() {
 	for (SectionType type : EnumSeq(SECTTYPE_INVALID)) {
 		memory[type].resize(nbbanks(type));
-		for (std::deque<FreeSpace> &bankMem : memory[type]) {
-			bankMem.push_back({
-			    .address = sectionTypeInfo[type].startAddr,
-			    .size = sectionTypeInfo[type].size,
-			});
-		}
+		largestFreeSpaces[type].init(nbbanks(type), sectionTypeInfo[type].size);
 	}
 }
 
+/*
+ * Gets a bank's free spaces. There can be tens of thousands of banks, most never used, so each
+ * one's list is only filled when first needed; until then, it is empty, but not full.
+ * @param type The bank's section type
+ * @param bankIdx The index of the bank, from the type's first bank
+ * @return The bank's free spaces
+ */
+static std::vector<FreeSpace> &getFreeSpaces(SectionType type, uint32_t bankIdx) {
+	SectionTypeInfo const &typeInfo = sectionTypeInfo[type];
+	std::vector<FreeSpace> &bankMem = memory[type][bankIdx];
+
+	if (bankMem.empty() && largestFreeSpaces[type].get(bankIdx) == typeInfo.size)
+		bankMem.push_back({.address = typeInfo.startAddr, .size = typeInfo.size});
+	return bankMem;
+}
+
 /*
  * Assigns a section to a given memory location
  * @param section The section to assign
@@ -90,6 +161,55 @@ static bool isLocationSuitable(
 	return location.address + section.size <= freeSpace.address + freeSpace.size;
 }
 
+/*
+ * Finds the first suitable location to place a section at in a given bank.
+ * @param section The section to be placed
+ * @param bankMem The bank's free spaces
+ * @param location The memory location whose address will be filled
+ * @return The index into `bankMem` of the free space encompassing the location,
+ *         or -1 if none was found
+ */
+static ssize_t getPlacementInBank(
+    Section const &section, std::vector<FreeSpace> const &bankMem, MemoryLocation &location
+) {
+	if (section.isAddressFixed) {
+		// Only the free space that starts at or before the address may contain the section
+		auto freeSpace = std::upper_bound(
+		    RANGE(bankMem),
+		    section.org,
+		    [](uint16_t org, FreeSpace const &space) { return org < space.address; }
+		);
+
+		if (freeSpace == bankMem.begin())
+			return -1;
+		--freeSpace;
+		location.address = section.org;
+		return isLocationSuitable(section, *freeSpace, location) ? freeSpace - bankMem.begin()
+		                                                         : -1;
+	}
+
+	for (size_t spaceIdx = 0; spaceIdx < bankMem.size(); spaceIdx++) {
+		FreeSpace const &freeSpace = bankMem[spaceIdx];
+		int32_t address = freeSpace.address;
+
+		if (freeSpace.size < section.size)
+			continue;
+		if (section.isAlignFixed) {
+			// Go to the first aligned location in that free space; if it does not fit, none of
+			// the next ones in that same free space will
+			address -= section.alignOfs;
+			address = ((address + section.alignMask) & ~(int32_t)section.alignMask)
+			          + section.alignOfs;
+			if (address + section.size > freeSpace.address + freeSpace.size)
+				continue;
+		}
+		location.address = address;
+		assume(isLocationSuitable(section, freeSpace, location));
+		return spaceIdx;
+	}
+	return -1;
+}
+
 /*
  * Finds a suitable location to place a section at.
  * @param section The section to be placed
@@ -124,50 +244,13 @@ static ssize_t getPlacement(Section const &section, MemoryLocation &location) {
 	}
 
 	for (;;) {
-		// Switch to the beginning of the next bank
-		std::deque<FreeSpace> &bankMem = memory[section.type][location.bank - typeInfo.firstBank];
-		size_t spaceIdx = 0;
+		// Skip banks that do not even have a free space large enough
+		uint32_t bankIdx = location.bank - typeInfo.firstBank;
+		if (largestFreeSpaces[section.type].get(bankIdx) >= section.size) {
+			std::vector<FreeSpace> const &bankMem = getFreeSpaces(section.type, bankIdx);
 
-		if (spaceIdx < bankMem.size())
-			location.address = bankMem[spaceIdx].address;
-
-		// Process locations in that bank
-		while (spaceIdx < bankMem.size()) {
-			// If that location is OK, return it
-			if (isLocationSuitable(section, bankMem[spaceIdx], location))
+			if (ssize_t spaceIdx = getPlacementInBank(section, bankMem, location); spaceIdx != -1)
 				return spaceIdx;
-
-			// Go to the next *possible* location
-			if (section.isAddressFixed) {
-				// If the address is fixed, there can be only
-				// one candidate block per bank; if we already
-				// reached it, give up.
-				if (location.address < section.org)
-					location.address = section.org;
-				else
-					break; // Try again in next bank
-			} else if (section.isAlignFixed) {
-				// Move to next aligned location
-				// Move back to alignment boundary
-				location.address -= section.alignOfs;
-				// Ensure we're there (e.g. on first check)
-				location.address &= ~section.alignMask;
-				// Go to next align boundary and add offset
-				location.address += section.alignMask + 1 + section.alignOfs;
-			} else {
-				// Any location is fine, so, next free block
-				spaceIdx++;
-				if (spaceIdx < bankMem.size())
-					location.address = bankMem[spaceIdx].address;
-			}
-
-			// If that location is past the current block's end,
-			// go forwards until that is no longer the case.
-			while (spaceIdx < bankMem.size()
-			       && location.address >= bankMem[spaceIdx].address + bankMem[spaceIdx].size)
-				spaceIdx++;
-
-			// Try again with the new location/free space combo
 		}
 
 		// Try again in the next bank, if one is available.
@@ -182,7 +265,8 @@ static ssize_t getPlacement(Section const &section, MemoryLocation &location) {
 				location.bank = scrambleROMX + 1;
 			else
 				return -1;
-		} else if (scrambleWRAMX && section.type == SECTTYPE_WRAMX && location.bank <= scrambleWRAMX) {
+		} else if (scrambleWRAMX && section.type == SECTTYPE_WRAMX
+		           && location.bank <= scrambleWRAMX) {
 			if (location.bank > typeInfo.firstBank)
 				location.bank--;
 			else if (scrambleWRAMX < typeInfo.lastBank)
@@ -196,8 +280,11 @@ static ssize_t getPlacement(Section const &section, MemoryLocation &location) {
 				location.bank = scrambleSRAM + 1;
 			else
 				return -1;
-		} else if (location.bank < typeInfo.lastBank) {
-			location.bank++;
+		} else if (ssize_t nextBankIdx =
+		               largestFreeSpaces[section.type].findFrom(bankIdx + 1, section.size);
+		           nextBankIdx != -1 && nextBankIdx + typeInfo.firstBank <= typeInfo.lastBank) {
+			// Go directly to the next bank which may have enough room
+			location.bank = nextBankIdx + typeInfo.firstBank;
 		} else {
 			return -1;
 		}
@@ -205,12 +292,111 @@ static ssize_t getPlacement(Section const &section, MemoryLocation &location) {
 }
 
 /*
- * Places a section in a suitable location, or error out if it fails to.
+ * Removes the space a section occupies from a bank's free space.
+ * @param bankMem The bank's free spaces
+ * @param spaceIdx The index of the free space encompassing the section
+ * @param address The section's address
+ * @param size The section's size
+ * @return The size of the bank's largest free space afterwards
+ */
+static uint16_t removeFreeSpace(
+    std::vector<FreeSpace> &bankMem, size_t spaceIdx, uint16_t address, uint16_t size
+) {
+	FreeSpace &freeSpace = bankMem[spaceIdx];
+
+	bool noLeftSpace = freeSpace.address == address;
+	bool noRightSpace = freeSpace.address + freeSpace.size == address + size;
+	if (noLeftSpace && noRightSpace) {
+		// The free space is entirely deleted
+		bankMem.erase(bankMem.begin() + spaceIdx);
+	} else if (!noLeftSpace && !noRightSpace) {
+		// The free space is split in two
+		// Append the new space after the original one
+		bankMem.insert(
+		    bankMem.begin() + spaceIdx + 1,
+		    {.address = (uint16_t)(address + size),
+		     .size = (uint16_t)(freeSpace.address + freeSpace.size - address - size)}
+		);
+		// **`freeSpace` cannot be reused from this point on**, because `bankMem.insert`
+		// invalidates all references to itself!
+
+		// Resize the original space (address is unmodified)
+		bankMem[spaceIdx].size = address - bankMem[spaceIdx].address;
+	} else {
+		// The amount of free spaces doesn't change: resize!
+		freeSpace.size -= size;
+		if (noLeftSpace)
+			// The free space is moved *and* resized
+			freeSpace.address += size;
+	}
+
+	uint16_t largestSize = 0;
+	for (FreeSpace const &space : bankMem)
+		largestSize = std::max(largestSize, space.size);
+	return largestSize;
+}
+
+/*
+ * Assigns a section to a location, and removes the space it occupies from the free space.
+ * @param section The section to assign
+ * @param location The location to assign the section to
+ * @param spaceIdx The index of the free space encompassing the location
+ */
+static void allocateSection(Section &section, MemoryLocation const &location, size_t spaceIdx) {
+	uint32_t bankIdx = location.bank - sectionTypeInfo[section.type].firstBank;
+
+	assignSection(section, location);
+	largestFreeSpaces[section.type].update(
+	    bankIdx,
+	    removeFreeSpace(getFreeSpaces(section.type, bankIdx), spaceIdx, section.org, section.size)
+	);
+}
+
+/*
+ * Places a section where it was during the previous incremental link, or where its placement
+ * hint says, if it still fits there.
+ * @param section The section to place
+ * @return True if the section was placed, false if it must be placed normally
+ */
+static bool placeSectionAsBefore(Section &section) {
+	Placement const *placement = incr_GetPlacement(section.name);
+	SectionTypeInfo const &typeInfo = sectionTypeInfo[section.type];
+
+	// 0-byte sections are trivial to place anyway
+	if (!placement || placement->type != section.type || section.size == 0)
+		return false;
+	if (placement->bank < typeInfo.firstBank || placement->bank > typeInfo.lastBank)
+		return false;
+	if (section.isBankFixed && placement->bank != section.bank)
+		return false;
+
+	MemoryLocation location{.address = placement->org, .bank = placement->bank};
+	std::vector<FreeSpace> &bankMem =
+	    getFreeSpaces(section.type, location.bank - typeInfo.firstBank);
+	// Only the free space that starts at or before the address may contain the section
+	auto freeSpace = std::upper_bound(
+	    RANGE(bankMem),
+	    location.address,
+	    [](uint16_t org, FreeSpace const &space) { return org < space.address; }
+	);
+
+	if (freeSpace == bankMem.begin())
+		return false;
+	--freeSpace;
+	if (!isLocationSuitable(section, *freeSpace, location))
+		return false;
+	allocateSection(section, location, freeSpace - bankMem.begin());
+	return true;
+}
+
+/*
+ * Places a section in a suitable location, if there is one.
  * @warning Due to the implemented algorithm, this should be called with
  *          sections of decreasing size.
  * @param section The section to place
+ * @return True if the section was placed, false otherwise
  */
-static void placeSection(Section &section) {
+static bool tryPlaceSection(Section &section) {
 	MemoryLocation location;
 
 	// Specially handle 0-byte SECTIONs, as they can't overlap anything
@@ -222,47 +408,25 @@ static void placeSection(Section &section) {
 		location.bank =
 		    section.isBankFixed ? section.bank : sectionTypeInfo[section.type].firstBank;
 		assignSection(section, location);
-		return;
+		return true;
 	}
 
 	// Place section using first-fit decreasing algorithm
 	// https://en.wikipedia.org/wiki/Bin_packing_problem#First-fit_algorithm
 	if (ssize_t spaceIdx = getPlacement(section, location); spaceIdx != -1) {
-		std::deque<FreeSpace> &bankMem =
-		    memory[section.type][location.bank - sectionTypeInfo[section.type].firstBank];
-		FreeSpace &freeSpace = bankMem[spaceIdx];
-
-		assignSection(section, location);
-
-		// Update the free space
-		bool noLeftSpace = freeSpace.address == section.org;
-		bool noRightSpace = freeSpace.address + freeSpace.size == section.org + section.size;
-		if (noLeftSpace && noRightSpace) {
-			// The free space is entirely deleted
-			bankMem.erase(bankMem.begin() + spaceIdx);
-		} else if (!noLeftSpace && !noRightSpace) {
-			// The free space is split in two
-			// Append the new space after the original one
-			bankMem.insert(
-			    bankMem.begin() + spaceIdx + 1,
-			    {.address = (uint16_t)(section.org + section.size),
-			     .size =
-			         (uint16_t)(freeSpace.address + freeSpace.size - section.org - section.size)}
-			);
-			// **`freeSpace` cannot be reused from this point on**, because `bankMem.insert`
-			// invalidates all references to itself!
+		allocateSection(section, location, spaceIdx);
+		return true;
+	}
+	return false;
+}
 
-			// Resize the original space (address is unmodified)
-			bankMem[spaceIdx].size = section.org - bankMem[spaceIdx].address;
-		} else {
-			// The amount of free spaces doesn't change: resize!
-			freeSpace.size -= section.size;
-			if (noLeftSpace)
-				// The free space is moved *and* resized
-				freeSpace.address += section.size;
-		}
+/*
+ * Places a section in a suitable location, or error out if it fails to.
+ * @param section The section to place
+ */
+static void placeSection(Section &section) {
+	if (tryPlaceSection(section))
 		return;
-	}
 
 	// Please adjust depending on longest message below
 	char where[64];
@@ -327,6 +491,259 @@ static void placeSection(Section &section) {
 		);
 }
 
+// The optimizing packer (`--pack-time`) searches for a better placement of each section type than
+// the one above, by trying other orders and best-fit placement, until its deadline passes.
+// Candidate placements are only simulated, on copies of the free space; the best one is then
+// replayed onto the real free space.
+
+using Clock = std::chrono::steady_clock;
+
+static Clock::time_point packDeadline;
+
+// How good a candidate placement is; greater is better
+struct Score {
+	uint64_t unplacedSize = UINT64_MAX; // The total size of the sections which did not fit
+	uint32_t nbBanks = UINT32_MAX;      // How many banks are needed, up to the last one in use
+	uint64_t fill = 0; // Sum of the squared used sizes of the banks, favoring fuller banks
+
+	bool operator>(Score const &other) const {
+		if (unplacedSize != other.unplacedSize)
+			return unplacedSize < other.unplacedSize;
+		if (nbBanks != other.nbBanks)
+			return nbBanks < other.nbBanks;
+		return fill > other.fill;
+	}
+};
+
+struct Candidate {
+	std::vector<Section *> order;
+	std::vector<uint32_t> bankIdxs; // The bank index of each section in `order`, or UINT32_MAX
+	Score score;
+};
+
+// The free space of a type's first banks, before any of the sections to pack are placed
+struct Region {
+	SectionType type;
+	std::vector<std::vector<FreeSpace>> banks;
+	uint32_t nbBanksInUse; // By the sections placed before packing
+};
+
+static uint16_t largestFreeSpace(std::vector<FreeSpace> const &bankMem) {
+	uint16_t largestSize = 0;
+	for (FreeSpace const &space : bankMem)
+		largestSize = std::max(largestSize, space.size);
+	return largestSize;
+}
+
+/*
+ * Simulates placing a candidate's sections in order, each either in the first bank with room for
+ * it (like `getPlacement`), or in the one that it fills the most.
+ * @param region The free space to place the sections in
+ * @param candidate The candidate whose `order` to evaluate
+ * @param bestFit Whether to use best-fit instead of first-fit
+ * @param nbBanks How many of the region's first banks may be used
+ */
+static void evaluate(Region const &region, Candidate &candidate, bool bestFit, uint32_t nbBanks) {
+	SectionTypeInfo const &typeInfo = sectionTypeInfo[region.type];
+	std::vector<std::vector<FreeSpace>> banks(
+	    region.banks.begin(), region.banks.begin() + std::min<size_t>(nbBanks, region.banks.size())
+	);
+	LargestFreeSpaces largest;
+
+	largest.init(banks.size(), 0);
+	for (size_t bankIdx = 0; bankIdx < banks.size(); bankIdx++)
+		largest.update(bankIdx, largestFreeSpace(banks[bankIdx]));
+
+	candidate.bankIdxs.clear();
+	candidate.score = {.unplacedSize = 0, .nbBanks = region.nbBanksInUse, .fill = 0};
+	for (Section const *section : candidate.order) {
+		MemoryLocation location;
+		ssize_t spaceIdx = -1;
+		uint32_t bankIdx = UINT32_MAX;
+
+		if (section->size == 0) {
+			// These are not put in the free space, but must be in a valid bank
+			bankIdx = section->isBankFixed ? section->bank - typeInfo.firstBank : 0;
+		} else if (section->isBankFixed) {
+			if (uint32_t idx = section->bank - typeInfo.firstBank; idx < banks.size()) {
+				spaceIdx = getPlacementInBank(*section, banks[idx], location);
+				if (spaceIdx != -1)
+					bankIdx = idx;
+			}
+		} else {
+			uint16_t bestLeft = UINT16_MAX;
+
+			for (ssize_t idx = largest.findFrom(0, section->size);
+			     idx != -1 && (size_t)idx < banks.size();
+			     idx = largest.findFrom(idx + 1, section->size)) {
+				if (ssize_t found = getPlacementInBank(*section, banks[idx], location);
+				    found != -1) {
+					// The bank's largest free space is an approximation of how much room is left
+					uint16_t left = largest.get(idx) - section->size;
+
+					if (bankIdx == UINT32_MAX || left < bestLeft) {
+						bankIdx = idx;
+						spaceIdx = found;
+						bestLeft = left;
+					}
+					if (!bestFit)
+						break;
+				}
+			}
+		}
+
+		candidate.bankIdxs.push_back(bankIdx);
+		if (bankIdx == UINT32_MAX) {
+			candidate.score.unplacedSize += section->size;
+			continue;
+		}
+		if (section->size != 0) {
+			if (bestFit) // Get the location back in the chosen bank
+				spaceIdx = getPlacementInBank(*section, banks[bankIdx], location);
+			largest.update(
+			    bankIdx, removeFreeSpace(banks[bankIdx], spaceIdx, location.address, section->size)
+			);
+		}
+		candidate.score.nbBanks = std::max(candidate.score.nbBanks, bankIdx + 1);
+	}
+
+	for (std::vector<FreeSpace> const &bankMem : banks) {
+		uint64_t used = typeInfo.size;
+		for (FreeSpace const &space : bankMem)
+			used -= space.size;
+		candidate.score.fill += used * used;
+	}
+}
+
+// Returns a slightly different order, giving priority to a section that did not fit, if any
+static std::vector<Section *> perturb(Candidate const &candidate, std::minstd_rand &rng) {
+	std::vector<Section *> order = candidate.order;
+	std::vector<size_t> unplaced;
+
+	for (size_t i = 0; i < order.size(); i++) {
+		if (candidate.bankIdxs[i] == UINT32_MAX)
+			unplaced.push_back(i);
+	}
+	if (!unplaced.empty() && rng() % 4 != 0) {
+		size_t from = unplaced[rng() % unplaced.size()];
+		size_t to = rng() % (from + 1);
+		std::rotate(order.begin() + to, order.begin() + from, order.begin() + from + 1);
+	} else {
+		std::swap(order[rng() % order.size()], order[rng() % order.size()]);
+	}
+	return order;
+}
+
+/*
+ * Searches for a better placement of a type's sections than the usual first-fit decreasing one,
+ * and places them there.
+ * @param type The section type whose sections to place
+ * @param sections The sections, in the order of the usual placement
+ * @return False if some sections could not be placed, and should go through the usual placement
+ */
+static bool packSections(SectionType type, std::vector<Section *> const &sections) {
+	if (sections.empty())
+		return true;
+
+	SectionTypeInfo const &typeInfo = sectionTypeInfo[type];
+	uint32_t nbTypeBanks = nbbanks(type);
+	Region region{.type = type, .banks = {}, .nbBanksInUse = 0};
+	uint64_t totalSize = 0;
+
+	for (uint32_t bankIdx = 0; bankIdx < nbTypeBanks; bankIdx++) {
+		if (largestFreeSpaces[type].get(bankIdx) != typeInfo.size)
+			region.nbBanksInUse = bankIdx + 1;
+	}
+	for (Section const *section : sections) {
+		totalSize += section->size;
+		if (section->isBankFixed)
+			region.nbBanksInUse =
+			    std::max(region.nbBanksInUse, section->bank - typeInfo.firstBank + 1);
+	}
+	// No placement ever needs more banks than one per section after those already in use
+	uint32_t nbRegionBanks = std::min<uint64_t>(nbTypeBanks, region.nbBanksInUse + sections.size());
+	for (uint32_t bankIdx = 0; bankIdx < nbRegionBanks; bankIdx++)
+		region.banks.push_back(getFreeSpaces(type, bankIdx));
+	// No placement can use fewer banks than needed to hold all the sections' bytes
+	uint64_t usedSize = 0;
+	for (std::vector<FreeSpace> const &bankMem : region.banks) {
+		usedSize += typeInfo.size;
+		for (FreeSpace const &space : bankMem)
+			usedSize -= space.size;
+	}
+	uint32_t minNbBanks = std::max<uint64_t>(
+	    {1, region.nbBanksInUse, (usedSize + totalSize + typeInfo.size - 1) / typeInfo.size}
+	);
+
+	Candidate best{.order = sections, .bankIdxs = {}, .score = {}};
+	evaluate(region, best, false, region.banks.size()); // This is the usual placement
+	uint32_t firstFitNbBanks = best.score.nbBanks;
+
+	// Look for a placement which fits in (at least) one bank less than the best one so far;
+	// or at all, if the best one does not
+	uint32_t nbBanks = best.score.unplacedSize == 0 ? best.score.nbBanks - 1 : region.banks.size();
+	Candidate current{.order = sections, .bankIdxs = {}, .score = {}};
+	std::minstd_rand rng;
+
+	evaluate(region, current, true, nbBanks);
+	for (unsigned iter = 1; nbBanks >= minNbBanks && Clock::now() < packDeadline; iter++) {
+		if (current.score.unplacedSize == 0) {
+			best = current;
+			nbBanks = best.score.nbBanks - 1;
+			evaluate(region, current, true, nbBanks);
+			continue;
+		}
+		Candidate candidate{.order = perturb(current, rng), .bankIdxs = {}, .score = {}};
+		evaluate(region, candidate, iter % 2 == 0, nbBanks);
+		// Accepting equally good candidates lets the search move around
+		if (!(current.score > candidate.score))
+			current = std::move(candidate);
+	}
+
+	if (best.score.unplacedSize != 0)
+		return false;
+
+	// Replay the best candidate onto the real free space
+	for (size_t i = 0; i < best.order.size(); i++) {
+		Section &section = *best.order[i];
+		MemoryLocation location{.address = 0, .bank = best.bankIdxs[i] + typeInfo.firstBank};
+
+		if (section.size == 0) {
+			location.address = section.isAddressFixed ? section.org : typeInfo.startAddr;
+			assignSection(section, location);
+			continue;
+		}
+		ssize_t spaceIdx =
+		    getPlacementInBank(section, getFreeSpaces(type, best.bankIdxs[i]), location);
+		assume(spaceIdx != -1);
+		allocateSection(section, location, spaceIdx);
+	}
+
+	if (beVerbose) {
+		fprintf(
+		    stderr,
+		    "Packed %zu %s sections into %" PRIu32 " banks (first-fit: %" PRIu32 ")\n",
+		    sections.size(),
+		    typeInfo.name.c_str(),
+		    best.score.nbBanks,
+		    firstFitNbBanks
+		);
+		for (uint32_t bankIdx = 0; bankIdx < best.score.nbBanks; bankIdx++) {
+			uint32_t used = typeInfo.size;
+			for (FreeSpace const &space : getFreeSpaces(type, bankIdx))
+				used -= space.size;
+			fprintf(
+			    stderr,
+			    "\t%s bank %" PRIu32 ": %.1f%% full\n",
+			    typeInfo.name.c_str(),
+			    bankIdx + typeInfo.firstBank,
+			    used * 100.0 / typeInfo.size
+			);
+		}
+	}
+	return true;
+}
+
 #define BANK_CONSTRAINED  (1 << 2)
 #define ORG_CONSTRAINED   (1 << 1)
 #define ALIGN_CONSTRAINED (1 << 0)
@@ -348,17 +765,39 @@ static void categorizeSection(Section &section) {
 	else if (section.isAlignFixed)
 		constraints |= ALIGN_CONSTRAINED;
 
-	std::deque<Section *> &sections = unassignedSections[constraints];
-	auto pos = sections.begin();
-
-	// Insert section while keeping the list sorted by decreasing size
-	while (pos != sections.end() && (*pos)->size > section.size)
-		pos++;
-	sections.insert(pos, &section);
+	// Sections of equal size are placed in the reverse order they were registered in
+	unassignedSections[constraints].push_front(&section);
 
 	nbSectionsToAssign++;
 }
 
+/*
+ * Places sections of a given type, in the given order, unless the packer finds a better placement.
+ * @param type The sections' type
+ * @param sections The sections, each with its number in the overall placement order
+ * @return The index of the first section that could not be placed, or `sections.size()`; the
+ *         type's memory is left as it was when that section failed to be placed
+ */
+static size_t
+    placeSections(SectionType type, std::vector<std::pair<size_t, Section *>> const &sections) {
+	// Scrambling is a placement of its own, which the packer would undo
+	if (packTime != 0 && !(scrambleROMX && type == SECTTYPE_ROMX)
+	    && !(scrambleWRAMX && type == SECTTYPE_WRAMX)
+	    && !(scrambleSRAM && type == SECTTYPE_SRAM)) {
+		std::vector<Section *> sectionPtrs;
+		for (auto const &entry : sections)
+			sectionPtrs.push_back(entry.second);
+		if (packSections(type, sectionPtrs))
+			return sections.size();
+		// Let the usual placement report which section does not fit
+	}
+	for (size_t i = 0; i < sections.size(); i++) {
+		if (!tryPlaceSection(*sections[i].second))
+			return i;
+	}
+	return sections.size();
+}
+
 void assign_AssignSections() {
 	verbosePrint("Beginning assignment...\n");
 
@@ -369,6 +808,12 @@ void assign_AssignSections() {
 	// Generate linked lists of sections to assign
 	nbSectionsToAssign = 0;
 	sect_ForEach(categorizeSection);
+	// Sort the lists by decreasing size; sorting them all at once is much faster than keeping
+	// them sorted while inserting, and the sort is stable so the order of equal sizes is kept
+	for (std::deque<Section *> &sections : unassignedSections)
+		std::stable_sort(RANGE(sections), [](Section const *lhs, Section const *rhs) {
+			return lhs->size > rhs->size;
+		});
 
 	// Place sections, starting with the most constrained
 
@@ -403,15 +848,117 @@ max_out:
 		exit(1);
 	}
 
-	// Assign all remaining sections by decreasing constraint order
+	if (incrementalFileName || hintsFileName)
+		verbosePrint("Assigning sections to their previous locations first...\n");
+
+	// Assign all remaining sections by decreasing constraint order.
+	// Each type has its own memory, so they can be placed independently of each other; the
+	// sections are numbered in the order they would be placed in if they were not, though.
+	std::vector<std::pair<size_t, Section *>> sectionsOfType[SECTTYPE_INVALID];
+	size_t nbSections = 0;
+
 	for (int8_t constraints = BANK_CONSTRAINED | ALIGN_CONSTRAINED; constraints >= 0;
 	     constraints--) {
 		for (Section *section : unassignedSections[constraints])
-			placeSection(*section);
+			sectionsOfType[section->type].emplace_back(nbSections++, section);
+	}
 
-		if (!nbSectionsToAssign)
+	// The first section of each type that could not be placed, if any
+	std::pair<size_t, Section *> firstFailure[SECTTYPE_INVALID];
+	static constexpr std::pair<size_t, Section *> noFailure{SIZE_MAX, nullptr};
+	auto placeSectionsOfType = [&](SectionType type) {
+		std::vector<std::pair<size_t, Section *>> const &sections = sectionsOfType[type];
+
+		if (!incrementalFileName && !hintsFileName) {
+			size_t failedIdx = placeSections(type, sections);
+			firstFailure[type] = failedIdx != sections.size() ? sections[failedIdx] : noFailure;
 			return;
+		}
+
+		// Put back sections where they were during the previous link, if possible, which is much
+		// faster than searching for room, and keeps the output stable
+		std::vector<std::vector<FreeSpace>> prevMemory = memory[type];
+		LargestFreeSpaces prevLargestFreeSpaces = largestFreeSpaces[type];
+		std::vector<Section *> placed;
+		std::vector<std::pair<size_t, Section *>> remaining;
+
+		for (auto const &entry : sections) {
+			if (placeSectionAsBefore(*entry.second))
+				placed.push_back(entry.second);
+			else
+				remaining.push_back(entry);
+		}
+		size_t failedIdx = placeSections(type, remaining);
+		if (failedIdx == remaining.size()) {
+			firstFailure[type] = noFailure;
+			return;
+		}
+
+		// The sections put back may be taking the only room that a constrained one fits in, even
+		// though all of them fit when placed anew; so place them all anew
+		for (size_t i = 0; i < failedIdx; i++)
+			placed.push_back(remaining[i].second);
+		for (Section *section : placed)
+			out_RemoveSection(*section);
+		nbSectionsToAssign += placed.size();
+		memory[type] = std::move(prevMemory);
+		largestFreeSpaces[type] = std::move(prevLargestFreeSpaces);
+
+		failedIdx = placeSections(type, sections);
+		firstFailure[type] = failedIdx != sections.size() ? sections[failedIdx] : noFailure;
+	};
+
+	packDeadline = Clock::now() + std::chrono::milliseconds(packTime);
+	if (nbJobs <= 1) {
+		for (SectionType type : EnumSeq(SECTTYPE_INVALID))
+			placeSectionsOfType(type);
+	} else {
+		// ROMX usually has the most sections, so starting with it keeps the others in its shadow
+		static constexpr SectionType order[SECTTYPE_INVALID] = {
+		    SECTTYPE_ROMX,
+		    SECTTYPE_ROM0,
+		    SECTTYPE_WRAMX,
+		    SECTTYPE_SRAM,
+		    SECTTYPE_WRAM0,
+		    SECTTYPE_VRAM,
+		    SECTTYPE_HRAM,
+		    SECTTYPE_OAM,
+		};
+		std::atomic_uint nextType = 0;
+		std::vector<std::thread> workers;
+
+		verbosePrint("Assigning %zu sections using %u threads...\n", nbSections, nbJobs);
+		for (unsigned int i = 0; i < nbJobs && i < SECTTYPE_INVALID; i++) {
+			workers.emplace_back([&] {
+				for (unsigned int j; (j = nextType++) < SECTTYPE_INVALID;)
+					placeSectionsOfType(order[j]);
+			});
+		}
+		for (std::thread &worker : workers)
+			worker.join();
+	}
+
+	// Report the failure that would have happened first if the types had not been independent
+	Section *failedSection = std::min_element(RANGE(firstFailure))->second;
+	if (failedSection) {
+		placeSection(*failedSection); // This will error out
+		unreachable_();
 	}
 
-	unreachable_();
+	assume(nbSectionsToAssign == 0);
+}
+
+ssize_t assign_GetNbFreeSpaces(SectionType type, uint32_t bank) {
+	SectionTypeInfo const &typeInfo = sectionTypeInfo[type];
+	uint32_t bankIdx = bank - typeInfo.firstBank;
+
+	// Free space is only known once sections have been assigned
+	if (bankIdx >= memory[type].size())
+		return -1;
+
+	std::vector<FreeSpace> const &bankMem = getFreeSpaces(type, bankIdx);
+	if (bankMem.size() == 1 && bankMem[0].address == typeInfo.startAddr
+	    && bankMem[0].size == typeInfo.size)
+		return -1;
+	return bankMem.size();
 }
@@ -0,0 +1,286 @@
+/* SPDX-License-Identifier: MIT */
+
+#include "link/incremental.hpp"
+
+#include <algorithm>
+#include <ctype.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unordered_map>
+#include <vector>
+
+#include "error.hpp"
+#include "helpers.hpp"
+#include "itertools.hpp"
+#include "linkdefs.hpp"
+
+#include "link/main.hpp"
+#include "link/section.hpp"
+
+static char const stateMagic[] = "RGBLINKSTATE";
+// Bump this whenever the format below changes
+static constexpr uint32_t stateRevision = 1;
+
+static std::unordered_map<std::string, Placement> previousPlacements;
+
+struct StateReader {
+	std::vector<uint8_t> const &data;
+	size_t offset = 0;
+	bool isTruncated = false;
+
+	uint8_t getByte() {
+		if (offset == data.size()) {
+			isTruncated = true;
+			return 0;
+		}
+		return data[offset++];
+	}
+
+	uint32_t getLong() {
+		uint32_t value = getByte();
+		value |= getByte() << 8;
+		value |= getByte() << 16;
+		value |= (uint32_t)getByte() << 24;
+		return value;
+	}
+
+	std::string getString() {
+		std::string str;
+		for (uint8_t c; (c = getByte()) != '\0' && !isTruncated;)
+			str.push_back(c);
+		return str;
+	}
+};
+
+void incr_ReadState(char const *fileName) {
+	FILE *file = fopen(fileName, "rb");
+	if (!file) {
+		// The first incremental link has no state to start from
+		if (errno != ENOENT)
+			warn("Failed to open incremental state file \"%s\"", fileName);
+		return;
+	}
+	Defer closeFile{[&] { fclose(file); }};
+
+	std::vector<uint8_t> data;
+	uint8_t buf[BUFSIZ];
+	for (size_t nbRead; (nbRead = fread(buf, 1, sizeof(buf), file)) != 0;)
+		data.insert(data.end(), buf, buf + nbRead);
+	if (ferror(file)) {
+		warn("Failed to read incremental state file \"%s\"", fileName);
+		return;
+	}
+
+	StateReader reader{.data = data};
+
+	if (data.size() < QUOTEDSTRLEN(stateMagic)
+	    || memcmp(data.data(), stateMagic, QUOTEDSTRLEN(stateMagic))) {
+		warnx("\"%s\" is not an incremental state file, ignoring it", fileName);
+		return;
+	}
+	reader.offset = QUOTEDSTRLEN(stateMagic);
+	// Placements are only hints, but keep them from being misread by a different format
+	if (reader.getLong() != stateRevision) {
+		verbosePrint("Ignoring incremental state from a different revision\n");
+		return;
+	}
+
+	for (uint32_t nbPlacements = reader.getLong(); nbPlacements-- && !reader.isTruncated;) {
+		std::string name = reader.getString();
+		SectionType type = (SectionType)reader.getByte();
+		uint32_t bank = reader.getLong();
+		uint32_t org = reader.getLong();
+
+		if (type >= SECTTYPE_INVALID || org > UINT16_MAX) {
+			warnx("Incremental state file \"%s\" is corrupted, ignoring it", fileName);
+			previousPlacements.clear();
+			return;
+		}
+		previousPlacements[name] = {.type = type, .bank = bank, .org = (uint16_t)org};
+	}
+	if (reader.isTruncated) {
+		warnx("Incremental state file \"%s\" is truncated, ignoring it", fileName);
+		previousPlacements.clear();
+		return;
+	}
+
+	verbosePrint("Read %zu previous section placements\n", previousPlacements.size());
+}
+
+Placement const *incr_GetPlacement(std::string const &name) {
+	auto search = previousPlacements.find(name);
+	return search != previousPlacements.end() ? &search->second : nullptr;
+}
+
+static void putlong(uint32_t n, FILE *file) {
+	uint8_t bytes[] = {
+	    (uint8_t)n,
+	    (uint8_t)(n >> 8),
+	    (uint8_t)(n >> 16),
+	    (uint8_t)(n >> 24),
+	};
+	fwrite(bytes, 1, sizeof(bytes), file);
+}
+
+/*
+ * Parses one line of a placement hints file, `<type> <bank> $<address> <name>`.
+ * @param line The line, without its terminator
+ * @param name The string to store the section's name in
+ * @param placement The placement to fill
+ * @return True if the line was well-formed, false otherwise
+ */
+static bool parseHint(std::string const &line, std::string &name, Placement &placement) {
+	size_t typeEnd = line.find(' ');
+	if (typeEnd == std::string::npos)
+		return false;
+	auto typeInfo = std::find_if(RANGE(sectionTypeInfo), [&](SectionTypeInfo const &info) {
+		return line.compare(0, typeEnd, info.name) == 0;
+	});
+	if (typeInfo == std::end(sectionTypeInfo))
+		return false;
+
+	char const *ptr = &line[typeEnd + 1];
+	char *endptr;
+	if (*ptr < '0' || *ptr > '9')
+		return false;
+	unsigned long bank = strtoul(ptr, &endptr, 10);
+	if (endptr[0] != ' ' || endptr[1] != '$' || bank > UINT32_MAX)
+		return false;
+	ptr = &endptr[2];
+	if (!isxdigit((unsigned char)*ptr))
+		return false;
+	unsigned long org = strtoul(ptr, &endptr, 16);
+	if (endptr[0] != ' ' || endptr[1] == '\0' || org > UINT16_MAX)
+		return false;
+
+	name = &endptr[1];
+	placement = {
+	    .type = (SectionType)(typeInfo - std::begin(sectionTypeInfo)),
+	    .bank = (uint32_t)bank,
+	    .org = (uint16_t)org,
+	};
+	return true;
+}
+
+void incr_ReadHints(char const *fileName) {
+	FILE *file = fopen(fileName, "r");
+	if (!file) {
+		// Like the state file, the hints are written by the first link
+		if (errno != ENOENT)
+			warn("Failed to open placement hints file \"%s\"", fileName);
+		return;
+	}
+	Defer closeFile{[&] { fclose(file); }};
+
+	size_t nbHints = 0;
+	std::string line, name;
+	for (uint32_t lineNo = 1;; lineNo++) {
+		line.clear();
+		int c;
+		while ((c = getc(file)) != EOF && c != '\n')
+			line.push_back(c);
+		if (!line.empty() && line.back() == '\r')
+			line.pop_back();
+		if (c == EOF && line.empty())
+			break;
+
+		// Blank lines and comments are ignored, so that the file can be annotated
+		if (line.empty() || line[0] == ';')
+			continue;
+		if (Placement placement; parseHint(line, name, placement)) {
+			previousPlacements[name] = placement;
+			nbHints++;
+		} else {
+			warnx("%s(%" PRIu32 "): Malformed placement hint, ignoring it", fileName, lineNo);
+		}
+	}
+	if (ferror(file))
+		warn("Failed to read placement hints file \"%s\"", fileName);
+
+	verbosePrint("Read %zu placement hints\n", nbHints);
+}
+
+static std::vector<Section const *> placedSections;
+
+static void registerSection(Section &section) {
+	placedSections.push_back(&section);
+}
+
+void incr_WriteState(char const *fileName) {
+	sect_ForEach(registerSection);
+
+	FILE *file = fopen(fileName, "wb");
+	if (!file) {
+		warn("Failed to open incremental state file \"%s\"", fileName);
+		return;
+	}
+	Defer closeFile{[&] { fclose(file); }};
+
+	fwrite(stateMagic, 1, QUOTEDSTRLEN(stateMagic), file);
+	putlong(stateRevision, file);
+	putlong(placedSections.size(), file);
+	for (Section const *section : placedSections) {
+		fwrite(section->name.c_str(), 1, section->name.length() + 1, file);
+		putc(section->type, file);
+		putlong(section->bank, file);
+		putlong(section->org, file);
+	}
+
+	if (ferror(file))
+		warn("Failed to write incremental state file \"%s\"", fileName);
+}
+
+static std::vector<Section const *> floatingSections;
+
+static void registerFloatingSection(Section &section) {
+	SectionTypeInfo const &typeInfo = sectionTypeInfo[section.type];
+
+	// Sections that can only go in one place need no hint, and names spanning several lines
+	// cannot be written as one
+	if (section.isAddressFixed && (section.isBankFixed || typeInfo.firstBank == typeInfo.lastBank))
+		return;
+	if (section.name.find_first_of("\r\n") != std::string::npos)
+		return;
+	floatingSections.push_back(&section);
+}
+
+void incr_WriteHints(char const *fileName) {
+	sect_ForEach(registerFloatingSection);
+	// List the sections in address order, so that the file reads like a memory map, and placement
+	// changes show up as small diffs
+	std::sort(RANGE(floatingSections), [](Section const *lhs, Section const *rhs) {
+		if (lhs->type != rhs->type)
+			return lhs->type < rhs->type;
+		if (lhs->bank != rhs->bank)
+			return lhs->bank < rhs->bank;
+		if (lhs->org != rhs->org)
+			return lhs->org < rhs->org;
+		return lhs->name < rhs->name;
+	});
+
+	FILE *file = fopen(fileName, "w");
+	if (!file) {
+		warn("Failed to open placement hints file \"%s\"", fileName);
+		return;
+	}
+	Defer closeFile{[&] { fclose(file); }};
+
+	fputs("; Placement hints, written by rgblink\n", file);
+	for (Section const *section : floatingSections) {
+		fprintf(
+		    file,
+		    "%s %" PRIu32 " $%04" PRIx16 " %s\n",
+		    sectionTypeInfo[section->type].name.c_str(),
+		    section->bank,
+		    section->org,
+		    section->name.c_str()
+		);
+	}
+
+	if (ferror(file))
+		warn("Failed to write placement hints file \"%s\"", fileName);
+}
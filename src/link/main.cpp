@@ -8,44 +8,69 @@
 #include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
+#include <string>
+#include <vector>
+#ifndef _WIN32
+	#include <sys/wait.h>
+#endif
 
+#include "diagnostics.hpp"
 #include "error.hpp"
 #include "extern/getopt.hpp"
 #include "helpers.hpp" // assume
 #include "itertools.hpp"
 #include "platform.hpp"
 #include "script.hpp"
+#include "server.hpp"
+#include "trace.hpp"
 #include "version.hpp"
 
+#include "fix/header.hpp"
+
 #include "link/assign.hpp"
+#include "link/incremental.hpp"
 #include "link/object.hpp"
 #include "link/output.hpp"
 #include "link/patch.hpp"
 #include "link/section.hpp"
+#include "link/stats.hpp"
 #include "link/symbol.hpp"
 
-bool isDmgMode;               // -d
-char const *linkerScriptName; // -l
-char const *mapFileName;      // -m
-bool noSymInMap;              // -M
-char const *symFileName;      // -n
-char const *overlayFileName;  // -O
-char const *outputFileName;   // -o
-uint8_t padValue;             // -p
+bool isDmgMode;                  // -d
+char const *incrementalFileName; // -i
+unsigned int nbJobs = 1;         // -j
+char const *linkerScriptName;    // -l
+char const *mapFileName;         // -m
+bool noSymInMap;                 // -M
+char const *symFileName;         // -n
+char const *overlayFileName;     // -O
+char const *outputFileName;      // -o
+uint8_t padValue;                // -p
 bool hasPadValue = false;
 // Setting these three to 0 disables the functionality
 uint16_t scrambleROMX = 0; // -S
 uint8_t scrambleWRAMX = 0;
 uint8_t scrambleSRAM = 0;
-bool is32kMode;      // -t
-bool beVerbose;      // -v
-bool isWRAM0Mode;    // -w
-bool disablePadding; // -x
+bool is32kMode;            // -t
+bool beVerbose;            // -v
+bool isWRAM0Mode;          // -w
+bool disablePadding;       // -x
+char const *statsFileName; // --stats
+bool gcSections;           // --gc-sections
+bool foldSections;         // --fold-sections
+bool lowMemory;            // --low-memory
+char const *hintsFileName; // --placement-hints
+uint32_t packTime = 0;     // --pack-time, in ms; 0 means the optimizing packer is not used
+// Header fixing, like rgbfix's options of the same names; `UNSPECIFIED` values are left alone
+char const *headerTitle;               // --title
+uint8_t headerTitleLen;
+uint16_t headerMBC = UNSPECIFIED;      // --mbc-type
+uint16_t headerRAMSize = UNSPECIFIED;  // --ram-size
+bool fixHeaderSums;                    // --validate
+uint16_t headerPadValue = UNSPECIFIED; // --pad-value
 
 FILE *linkerScript;
 
-static uint32_t nbErrors = 0;
-
 std::vector<uint32_t> &FileStackNode::iters() {
 	assume(std::holds_alternative<std::vector<uint32_t>>(data));
 	return std::get<std::vector<uint32_t>>(data);
@@ -66,24 +91,31 @@ std::string const &FileStackNode::name() const {
 	return std::get<std::string>(data);
 }
 
+// REPT nodes only store their own iters, so the outer ones come from their REPT parents
+static void dumpIters(FileStackNode const &node) {
+	if (node.parent->type == NODE_REPT)
+		dumpIters(*node.parent);
+	for (uint32_t iter : node.iters())
+		diag_Printf("::REPT~%" PRIu32, iter);
+}
+
 std::string const &FileStackNode::dump(uint32_t curLineNo) const {
 	if (std::holds_alternative<std::vector<uint32_t>>(data)) {
 		assume(parent); // REPT nodes use their parent's name
 		std::string const &lastName = parent->dump(lineNo);
-		fputs(" -> ", stderr);
-		fputs(lastName.c_str(), stderr);
-		for (uint32_t iter : iters())
-			fprintf(stderr, "::REPT~%" PRIu32, iter);
-		fprintf(stderr, "(%" PRIu32 ")", curLineNo);
+		diag_Puts(" -> ");
+		diag_Puts(lastName.c_str());
+		dumpIters(*this);
+		diag_Printf("(%" PRIu32 ")", curLineNo);
 		return lastName;
 	} else {
 		if (parent) {
 			parent->dump(lineNo);
-			fputs(" -> ", stderr);
+			diag_Puts(" -> ");
 		}
 		std::string const &nodeName = name();
-		fputs(nodeName.c_str(), stderr);
-		fprintf(stderr, "(%" PRIu32 ")", curLineNo);
+		diag_Puts(nodeName.c_str());
+		diag_Printf("(%" PRIu32 ")", curLineNo);
 		return nodeName;
 	}
 }
@@ -91,14 +123,14 @@ std::string const &FileStackNode::dump(uint32_t curLineNo) const {
 void printDiag(
     char const *fmt, va_list args, char const *type, FileStackNode const *where, uint32_t lineNo
 ) {
-	fputs(type, stderr);
-	fputs(": ", stderr);
+	diag_Puts(type);
+	diag_Puts(": ");
 	if (where) {
 		where->dump(lineNo);
-		fputs(": ", stderr);
+		diag_Puts(": ");
 	}
-	vfprintf(stderr, fmt, args);
-	putc('\n', stderr);
+	diag_VPrintf(fmt, args);
+	diag_Putc('\n');
 }
 
 void warning(FileStackNode const *where, uint32_t lineNo, char const *fmt, ...) {
@@ -116,41 +148,57 @@ void error(FileStackNode const *where, uint32_t lineNo, char const *fmt, ...) {
 	printDiag(fmt, args, "error", where, lineNo);
 	va_end(args);
 
-	if (nbErrors != UINT32_MAX)
-		nbErrors++;
+	diag_CountError();
 }
 
-void argErr(char flag, char const *fmt, ...) {
+void report(char const *fmt, ...) {
 	va_list args;
 
-	fprintf(stderr, "error: Invalid argument for option '%c': ", flag);
 	va_start(args, fmt);
-	vfprintf(stderr, fmt, args);
+	diag_VPrintf(fmt, args);
 	va_end(args);
-	putc('\n', stderr);
 
-	if (nbErrors != UINT32_MAX)
-		nbErrors++;
+	diag_CountError();
 }
 
-[[noreturn]] void fatal(FileStackNode const *where, uint32_t lineNo, char const *fmt, ...) {
+void argErr(char flag, char const *fmt, ...) {
 	va_list args;
 
+	diag_Printf("error: Invalid argument for option '%c': ", flag);
 	va_start(args, fmt);
-	printDiag(fmt, args, "FATAL", where, lineNo);
+	diag_VPrintf(fmt, args);
 	va_end(args);
+	diag_Putc('\n');
 
-	if (nbErrors != UINT32_MAX)
-		nbErrors++;
+	diag_CountError();
+}
 
+static void printAbortedSummary() {
+	uint32_t nbErrors = diag_NbErrors();
 	fprintf(
 	    stderr, "Linking aborted after %" PRIu32 " error%s\n", nbErrors, nbErrors == 1 ? "" : "s"
 	);
-	exit(1);
+}
+
+[[noreturn]] void fatal(FileStackNode const *where, uint32_t lineNo, char const *fmt, ...) {
+	va_list args;
+
+	va_start(args, fmt);
+	printDiag(fmt, args, "FATAL", where, lineNo);
+	va_end(args);
+
+	diag_CountError();
+	diag_Abort(printAbortedSummary);
 }
 
 // Short options
-static char const *optstring = "dl:m:Mn:O:o:p:S:tVvWwx";
+static char const *optstring = "di:j:l:m:Mn:O:o:p:S:tVvWwx";
+
+// Variables for the long-only options
+// `--fold-sections`, `--gc-sections`, `--pack-time`, `--placement-hints`, `--stats`, `--trace`
+// and `--variants`
+static int longOpt;
+static char const *traceFileName = nullptr; // --trace
 
 /*
  * Equivalent long options
@@ -163,28 +211,49 @@ static char const *optstring = "dl:m:Mn:O:o:p:S:tVvWwx";
  * over short opt matching
  */
 static option const longopts[] = {
-    {"dmg",           no_argument,       nullptr, 'd'},
-    {"linkerscript",  required_argument, nullptr, 'l'},
-    {"map",           required_argument, nullptr, 'm'},
-    {"no-sym-in-map", no_argument,       nullptr, 'M'},
-    {"sym",           required_argument, nullptr, 'n'},
-    {"overlay",       required_argument, nullptr, 'O'},
-    {"output",        required_argument, nullptr, 'o'},
-    {"pad",           required_argument, nullptr, 'p'},
-    {"scramble",      required_argument, nullptr, 'S'},
-    {"tiny",          no_argument,       nullptr, 't'},
-    {"version",       no_argument,       nullptr, 'V'},
-    {"verbose",       no_argument,       nullptr, 'v'},
-    {"wramx",         no_argument,       nullptr, 'w'},
-    {"nopad",         no_argument,       nullptr, 'x'},
-    {nullptr,         no_argument,       nullptr, 0  }
+    {"dmg",             no_argument,       nullptr,  'd'},
+    {"fold-sections",   no_argument,       &longOpt, 'f'},
+    {"gc-sections",     no_argument,       &longOpt, 'g'},
+    {"incremental",     required_argument, nullptr,  'i'},
+    {"jobs",            required_argument, nullptr,  'j'},
+    {"linkerscript",    required_argument, nullptr,  'l'},
+    {"low-memory",      no_argument,       &longOpt, 'L'},
+    {"map",             required_argument, nullptr,  'm'},
+    {"mbc-type",        required_argument, &longOpt, 'm'},
+    {"no-sym-in-map",   no_argument,       nullptr,  'M'},
+    {"sym",             required_argument, nullptr,  'n'},
+    {"overlay",         required_argument, nullptr,  'O'},
+    {"output",          required_argument, nullptr,  'o'},
+    {"pad",             required_argument, nullptr,  'p'},
+    {"pack-time",       required_argument, &longOpt, 'P'},
+    {"pad-value",       required_argument, &longOpt, 'p'},
+    {"placement-hints", required_argument, &longOpt, 'h'},
+    {"ram-size",        required_argument, &longOpt, 'r'},
+    {"scramble",        required_argument, nullptr,  'S'},
+    {"serve",           required_argument, &longOpt, 'e'},
+    {"stats",           required_argument, &longOpt, 's'},
+    {"tiny",            no_argument,       nullptr,  't'},
+    {"title",           required_argument, &longOpt, 'T'},
+    {"trace",           required_argument, &longOpt, 't'},
+    {"version",         no_argument,       nullptr,  'V'},
+    {"verbose",         no_argument,       nullptr,  'v'},
+    {"validate",        no_argument,       &longOpt, 'v'},
+    {"variants",        required_argument, &longOpt, 'V'},
+    {"wramx",           no_argument,       nullptr,  'w'},
+    {"nopad",           no_argument,       nullptr,  'x'},
+    {nullptr,           no_argument,       nullptr,  0  }
 };
 
 static void printUsage() {
 	fputs(
-	    "Usage: rgblink [-dMtVvwx] [-l script] [-m map_file] [-n sym_file]\n"
-	    "               [-O overlay_file] [-o out_file] [-p pad_value]\n"
-	    "               [-S spec] <file> ...\n"
+	    "Usage: rgblink [-dMtVvwx] [--fold-sections] [--gc-sections] [-i state_file]\n"
+	    "               [-j jobs] [-l script] [--low-memory] [-m map_file] [--mbc-type value]\n"
+	    "               [-n sym_file] [-O overlay_file] [-o out_file] [-p pad_value]\n"
+	    "               [--pad-value value] [--placement-hints hints_file] [--ram-size value]\n"
+	    "               [-S spec] [--pack-time ms] [--serve socket] [--stats stats_file]\n"
+	    "               [--title title] [--trace trace_file] [--validate]\n"
+	    "               [--variants variants_file] <file> ...\n"
+	    "       rgblink --connect socket [options] <file> ...\n"
 	    "Useful options:\n"
 	    "    -l, --linkerscript <path>  set the input linker script\n"
 	    "    -m, --map <path>           set the output map file\n"
@@ -216,6 +285,20 @@ struct {
     {"wramx", 7    }, // SCRAMBLE_WRAMX
 };
 
+// Parses a header byte like rgbfix does, i.e. also accepting `$` for hexadecimal
+static void parseHeaderByte(uint16_t &output, char const *name) {
+	char const *arg = musl_optarg[0] == '$' ? &musl_optarg[1] : musl_optarg;
+	char *endptr;
+	unsigned long value = strtoul(arg, &endptr, arg != musl_optarg ? 16 : 0);
+
+	if (arg[0] == '\0' || *endptr != '\0')
+		error(nullptr, 0, "Argument for '%s' must be a number", name);
+	else if (value > 0xFF)
+		error(nullptr, 0, "Argument for '%s' must be a byte (between 0 and 0xFF)", name);
+	else
+		output = value;
+}
+
 static void parseScrambleSpec(char const *spec) {
 	// Skip any leading whitespace
 	spec += strspn(spec, " \t");
@@ -333,20 +416,38 @@ next: // Can't `continue` a `for` loop with this nontrivial iteration logic
 }
 
 [[noreturn]] void reportErrors() {
+	uint32_t nbErrors = diag_NbErrors();
 	fprintf(
 	    stderr, "Linking failed with %" PRIu32 " error%s\n", nbErrors, nbErrors == 1 ? "" : "s"
 	);
 	exit(1);
 }
 
-int main(int argc, char *argv[]) {
-	// Parse options
+static std::string serverSocketName;  // --serve
+static char const *variantsFileName; // --variants
+
+static void parseOptions(int argc, char *argv[]) {
 	for (int ch; (ch = musl_getopt_long_only(argc, argv, optstring, longopts, nullptr)) != -1;) {
 		switch (ch) {
 		case 'd':
 			isDmgMode = true;
 			isWRAM0Mode = true;
 			break;
+		case 'i':
+			if (incrementalFileName)
+				warnx("Overriding incremental state file %s", incrementalFileName);
+			incrementalFileName = musl_optarg;
+			break;
+		case 'j': {
+			char *endptr;
+			unsigned long value = strtoul(musl_optarg, &endptr, 0);
+
+			if (musl_optarg[0] == '\0' || *endptr != '\0' || value == 0 || value > UINT_MAX)
+				argErr('j', "Argument for 'j' must be a positive number of jobs");
+			else
+				nbJobs = value;
+			break;
+		}
 		case 'l':
 			if (linkerScriptName)
 				warnx("Overriding linker script %s", linkerScriptName);
@@ -411,59 +512,310 @@ int main(int argc, char *argv[]) {
 			// implies tiny mode
 			is32kMode = true;
 			break;
+		// Long-only options
+		case 0:
+			switch (longOpt) {
+			case 'f':
+				foldSections = true;
+				break;
+			case 'g':
+				gcSections = true;
+				break;
+			case 'e':
+				serverSocketName = musl_optarg;
+				break;
+			case 'L':
+				lowMemory = true;
+				break;
+			case 'm':
+				headerMBC = parseMBCOption(musl_optarg);
+				break;
+			case 'h':
+				hintsFileName = musl_optarg;
+				break;
+			case 'P': {
+				char *endptr;
+				unsigned long value = strtoul(musl_optarg, &endptr, 0);
+
+				if (musl_optarg[0] == '\0' || *endptr != '\0' || value > UINT32_MAX)
+					error(nullptr, 0, "Argument for 'pack-time' must be a number of milliseconds");
+				else
+					packTime = value;
+				break;
+			}
+			case 'p':
+				parseHeaderByte(headerPadValue, "pad-value");
+				break;
+			case 'r':
+				parseHeaderByte(headerRAMSize, "ram-size");
+				break;
+			case 's':
+				if (statsFileName)
+					warnx("Overriding stats file %s", statsFileName);
+				statsFileName = musl_optarg;
+				break;
+			case 'T': {
+				size_t len = strlen(musl_optarg);
+
+				headerTitle = musl_optarg;
+				if (len > 16) {
+					len = 16;
+					warnx("Truncating title \"%s\" to 16 chars", headerTitle);
+				}
+				headerTitleLen = len;
+				break;
+			}
+			case 't':
+				traceFileName = musl_optarg;
+				break;
+			case 'v':
+				fixHeaderSums = true;
+				break;
+			case 'V':
+				variantsFileName = musl_optarg;
+				break;
+			}
+			break;
 		default:
 			fprintf(stderr, "FATAL: unknown option '%c'\n", ch);
 			printUsage();
 			exit(1);
 		}
 	}
+}
 
-	int curArgIndex = musl_optind;
-
-	// If no input files were specified, the user must have screwed up
-	if (curArgIndex == argc) {
-		fputs(
-		    "FATAL: Please specify an input file (pass `-` to read from standard input)\n", stderr
-		);
-		printUsage();
-		exit(1);
-	}
-
-	// Patch the size array depending on command-line options
-	if (!is32kMode)
-		sectionTypeInfo[SECTTYPE_ROM0].size = 0x4000;
-	if (!isWRAM0Mode)
-		sectionTypeInfo[SECTTYPE_WRAM0].size = 0x1000;
-
-	// Patch the bank ranges array depending on command-line options
-	if (isDmgMode)
-		sectionTypeInfo[SECTTYPE_VRAM].lastBank = 0;
-
-	// Read all object files first,
-	for (obj_Setup(argc - curArgIndex); curArgIndex < argc; curArgIndex++)
-		obj_ReadFile(argv[curArgIndex], argc - curArgIndex - 1);
+// Patches the size and bank ranges arrays depending on command-line options
+static void patchSectionTypes() {
+	sectionTypeInfo[SECTTYPE_ROM0].size = is32kMode ? 0x8000 : 0x4000;
+	sectionTypeInfo[SECTTYPE_WRAM0].size = isWRAM0Mode ? 0x2000 : 0x1000;
+	sectionTypeInfo[SECTTYPE_VRAM].lastBank = isDmgMode ? 0 : 1;
+}
 
+// Processes the object files once they have all been read
+static int linkObjects() {
 	// apply the linker script's modifications,
 	if (linkerScriptName) {
 		verbosePrint("Reading linker script...\n");
 
+		stats_StartPhase("process_script");
 		script_ProcessScript(linkerScriptName);
 
 		// If the linker script produced any errors, some sections may be in an invalid state
-		if (nbErrors != 0)
+		if (diag_NbErrors() != 0)
 			reportErrors();
 	}
 
 	// then process them,
+	stats_StartPhase("sanity_checks");
 	sect_DoSanityChecks();
-	if (nbErrors != 0)
+	if (diag_NbErrors() != 0)
 		reportErrors();
+	if (gcSections) {
+		stats_StartPhase("remove_unreferenced_sections");
+		sect_RemoveUnreferenced();
+	}
+	if (foldSections) {
+		stats_StartPhase("fold_identical_sections");
+		sect_FoldIdentical();
+	}
+	if (incrementalFileName) {
+		stats_StartPhase("read_incremental_state");
+		incr_ReadState(incrementalFileName);
+	}
+	if (hintsFileName) {
+		stats_StartPhase("read_placement_hints");
+		incr_ReadHints(hintsFileName);
+	}
+	stats_StartPhase("assign_sections");
 	assign_AssignSections();
+	stats_StartPhase("check_assertions");
+	patch_ResolveSectionRefs();
 	patch_CheckAssertions();
 
 	// and finally output the result.
+	stats_StartPhase("apply_patches");
 	patch_ApplyPatches();
-	if (nbErrors != 0)
+	if (diag_NbErrors() != 0)
 		reportErrors();
+	stats_StartPhase("write_files");
 	out_WriteFiles();
+	if (incrementalFileName) {
+		stats_StartPhase("write_incremental_state");
+		incr_WriteState(incrementalFileName);
+	}
+	if (hintsFileName) {
+		stats_StartPhase("write_placement_hints");
+		incr_WriteHints(hintsFileName);
+	}
+	stats_Write();
+	return 0;
+}
+
+// Each line of the variants file holds one variant's options and object files, separated by
+// whitespace; blank lines and those starting with a `#` are ignored
+static std::vector<std::vector<std::string>> readVariants(char const *path) {
+	FILE *file = fopen(path, "r");
+	if (!file)
+		err("Failed to open variants file \"%s\"", path);
+	Defer closeFile{[&] { fclose(file); }};
+
+	std::vector<std::vector<std::string>> variants;
+	std::vector<std::string> args;
+	std::string arg;
+	bool isComment = false;
+	for (int c;;) {
+		c = getc(file);
+		if (c == EOF || c == '\n') {
+			if (!arg.empty())
+				args.push_back(std::move(arg));
+			if (!args.empty())
+				variants.push_back(std::move(args));
+			arg.clear();
+			args.clear();
+			isComment = false;
+			if (c == EOF)
+				break;
+		} else if (isComment || c == '\r') {
+			// Ignore the rest of this line
+		} else if (c == ' ' || c == '\t') {
+			if (!arg.empty())
+				args.push_back(std::move(arg));
+			arg.clear();
+		} else if (c == '#' && arg.empty() && args.empty()) {
+			isComment = true;
+		} else {
+			arg += c;
+		}
+	}
+	if (ferror(file))
+		err("Failed to read variants file \"%s\"", path);
+	return variants;
+}
+
+// Variants are linked by copies of this process, so they share the objects read before forking,
+// and start from the state of its options
+static int linkVariants() {
+	std::vector<std::vector<std::string>> variants = readVariants(variantsFileName);
+	if (variants.empty())
+		errx("Variants file \"%s\" does not contain any variants", variantsFileName);
+
+#ifdef _WIN32
+	errx("Linking several variants at once is not supported on this platform");
+#else
+	// Avoid the children also writing what was buffered so far
+	fflush(stdout);
+	fflush(stderr);
+
+	unsigned int nbRunning = 0;
+	bool failed = false;
+	auto waitForVariant = [&] {
+		int status;
+		if (wait(&status) == -1)
+			err("Failed to wait for a variant to finish linking");
+		nbRunning--;
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+			failed = true;
+	};
+
+	for (size_t i = 0; i < variants.size(); i++) {
+		if (nbRunning == nbJobs)
+			waitForVariant();
+
+		pid_t pid = fork();
+		if (pid == -1)
+			err("Failed to start linking variant #%zu", i + 1);
+		if (pid != 0) {
+			nbRunning++;
+			continue;
+		}
+
+		// `getopt` expects the program's name first
+		std::vector<char *> argv{const_cast<char *>("rgblink")};
+		for (std::string &arg : variants[i])
+			argv.push_back(arg.data());
+		argv.push_back(nullptr);
+		int argc = argv.size() - 1;
+
+		variantsFileName = nullptr;
+		musl_optreset = 1;
+		parseOptions(argc, argv.data());
+		if (variantsFileName)
+			errx("Option '--variants' cannot be passed to a variant");
+		if (!serverSocketName.empty())
+			errx("Option '--serve' cannot be passed to a variant");
+		checkRAMSize((MbcType)headerMBC, headerRAMSize);
+		if (diag_NbErrors() != 0)
+			reportErrors();
+		patchSectionTypes();
+
+		stats_StartPhase("read_objects");
+		obj_ReadFiles(&argv[musl_optind], argc - musl_optind);
+		obj_FinishReading();
+		fastExit(linkObjects());
+	}
+	while (nbRunning != 0)
+		waitForVariant();
+
+	return failed ? 1 : 0;
+#endif
+}
+
+static int link(int argc, char *argv[]) {
+	int curArgIndex = musl_optind;
+
+	// If no input files were specified, the user must have screwed up
+	if (curArgIndex == argc && !variantsFileName) {
+		fputs(
+		    "FATAL: Please specify an input file (pass `-` to read from standard input)\n", stderr
+		);
+		printUsage();
+		exit(1);
+	}
+
+	checkRAMSize((MbcType)headerMBC, headerRAMSize);
+	if (diag_NbErrors() != 0)
+		reportErrors();
+	patchSectionTypes();
+
+	// Read all object files first,
+	stats_StartPhase("read_objects");
+	obj_ReadFiles(&argv[curArgIndex], argc - curArgIndex);
+	if (variantsFileName)
+		return linkVariants();
+	obj_FinishReading();
+
+	return linkObjects();
+}
+
+// Requests are handled by a copy of the server, so they start from the state of its options
+static int handleRequest(int argc, char *argv[]) {
+	serverSocketName.clear();
+	musl_optreset = 1;
+	parseOptions(argc, argv);
+	if (!serverSocketName.empty())
+		errx("Option '--serve' cannot be passed to a server");
+	trace_Start("rgblink", traceFileName);
+
+	return link(argc, argv);
+}
+
+int main(int argc, char *argv[]) {
+	// Connecting to a server does not need anything else to be set up
+	if (argc > 1 && strncmp(argv[1], "--connect", QUOTEDSTRLEN("--connect")) == 0) {
+		if (argv[1][QUOTEDSTRLEN("--connect")] == '=')
+			server_Connect(&argv[1][QUOTEDSTRLEN("--connect=")], argc - 2, &argv[2]);
+		else if (argv[1][QUOTEDSTRLEN("--connect")] == '\0' && argc > 2)
+			server_Connect(argv[2], argc - 3, &argv[3]);
+	}
+
+	parseOptions(argc, argv);
+	trace_Start("rgblink", traceFileName);
+
+	if (!serverSocketName.empty()) {
+		if (argc != musl_optind)
+			errx("Input files must be passed to the server's requests, not to the server");
+		server_Serve(serverSocketName, "rgblink", handleRequest);
+	}
+
+	fastExit(link(argc, argv));
 }
@@ -1,85 +1,198 @@
 /* SPDX-License-Identifier: MIT */
 
 #include "link/object.hpp"
+#include <sys/stat.h>
 
 #include <deque>
 #include <errno.h>
 #include <inttypes.h>
 #include <limits.h>
 #include <memory>
+#include <span>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <string>
+#include <string_view>
 #include <vector>
 
+#include "diagnostics.hpp"
 #include "error.hpp"
 #include "helpers.hpp"
 #include "linkdefs.hpp"
 #include "platform.hpp"
+#include "trace.hpp"
 #include "version.hpp"
 
 #include "link/assign.hpp"
 #include "link/main.hpp"
 #include "link/sdas_obj.hpp"
 #include "link/section.hpp"
+#include "link/stats.hpp"
 #include "link/symbol.hpp"
 
+using namespace std::literals;
+
 static std::deque<std::vector<Symbol>> symbolLists;
 static std::vector<std::vector<FileStackNode>> nodes;
+// Patches point into these, so they must be kept for the entire link
+static std::deque<std::shared_ptr<uint8_t const[]>> fileImages;
 
 // Helper functions for reading object files
 
+// Neither MSVC nor MinGW provide `mmap`
+#if defined(_MSC_VER) || defined(__MINGW32__)
+// clang-format off
+	// (we need these `include`s in this order)
+	#define WIN32_LEAN_AND_MEAN // include less from windows.h
+	#include <windows.h>   // target architecture
+	#include <fileapi.h>   // CreateFileA
+	#include <winbase.h>   // CreateFileMappingA
+	#include <memoryapi.h> // MapViewOfFile
+	#include <handleapi.h> // CloseHandle
+// clang-format on
+
+static uint8_t const *mapFile(FILE *, char const *fileName, size_t) {
+	void *mappingAddr = nullptr;
+	if (HANDLE file = CreateFileA(
+	        fileName,
+	        GENERIC_READ,
+	        FILE_SHARE_READ,
+	        nullptr,
+	        OPEN_EXISTING,
+	        FILE_FLAG_POSIX_SEMANTICS | FILE_FLAG_SEQUENTIAL_SCAN,
+	        nullptr
+	    );
+	    file != INVALID_HANDLE_VALUE) {
+		if (HANDLE mappingObj = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		    mappingObj != INVALID_HANDLE_VALUE) {
+			mappingAddr = MapViewOfFile(mappingObj, FILE_MAP_READ, 0, 0, 0);
+			CloseHandle(mappingObj);
+		}
+		CloseHandle(file);
+	}
+	return (uint8_t const *)mappingAddr;
+}
+
+struct FileUnmapDeleter {
+	FileUnmapDeleter(size_t) {}
+
+	void operator()(uint8_t const *mappingAddr) { UnmapViewOfFile(mappingAddr); }
+};
+
+#else // defined(_MSC_VER) || defined(__MINGW32__)
+	#include <sys/mman.h>
+
+static uint8_t const *mapFile(FILE *file, char const *, size_t size) {
+	void *mappingAddr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fileno(file), 0);
+	if (mappingAddr == MAP_FAILED && errno == ENOTSUP)
+		// The implementation may not support MAP_PRIVATE; try again with MAP_SHARED
+		mappingAddr = mmap(nullptr, size, PROT_READ, MAP_SHARED, fileno(file), 0);
+	return mappingAddr != MAP_FAILED ? (uint8_t const *)mappingAddr : nullptr;
+}
+
+struct FileUnmapDeleter {
+	size_t mappingSize;
+
+	FileUnmapDeleter(size_t mappingSize_) : mappingSize(mappingSize_) {}
+
+	// The mapping is read-only, but `munmap` takes a non-`const` pointer
+	void operator()(uint8_t const *mappingAddr) {
+		munmap(const_cast<uint8_t *>(mappingAddr), mappingSize);
+	}
+};
+
+#endif // !( defined(_MSC_VER) || defined(__MINGW32__) )
+
+// The whole object file is in memory (mapped if possible), so that patches' RPN expressions can
+// point into it instead of being copied
+struct ObjectReader {
+	uint8_t const *ptr;
+	size_t size;
+	size_t offset = 0;
+	std::vector<std::string_view> strings; // The file's string table
+};
+
 // Internal, DO NOT USE.
 // For helper wrapper macros defined below, such as `tryReadlong`
 #define tryRead(func, type, errval, vartype, var, file, ...) \
 	do { \
-		FILE *tmpFile = file; \
-		type tmpVal = func(tmpFile); \
+		type tmpVal = func(file); \
 		/* TODO: maybe mark the condition as `unlikely`; how to do that portably? */ \
 		if (tmpVal == (errval)) { \
-			errx(__VA_ARGS__, feof(tmpFile) ? "Unexpected end of file" : strerror(errno)); \
+			errx(__VA_ARGS__, "Unexpected end of file"); \
 		} \
 		var = (vartype)tmpVal; \
 	} while (0)
 
 /*
- * Reads an unsigned long (32-bit) value from a file.
+ * Reads an unsigned long (32-bit) value from an object file.
  * @param file The file to read from. This will read 4 bytes from the file.
  * @return The value read, cast to a int64_t, or -1 on failure.
  */
-static int64_t readlong(FILE *file) {
-	uint32_t value = 0;
+static int64_t readlong(ObjectReader &file) {
+	if (file.size - file.offset < sizeof(uint32_t))
+		return INT64_MAX;
+
+	uint8_t const *bytes = &file.ptr[file.offset];
+	file.offset += sizeof(uint32_t);
+	// The bytes must be casted to `uint32_t`, otherwise integer promotion would make them `int`,
+	// and shifting values larger than 127 by 24 would trigger undefined behavior.
+	return (uint32_t)bytes[0] | (uint32_t)bytes[1] << 8 | (uint32_t)bytes[2] << 16
+	       | (uint32_t)bytes[3] << 24;
+}
+
+/*
+ * Helper macro for reading longs from a file, and errors out if it fails to.
+ * Not as a function to avoid overhead in the general case.
+ * @param var The variable to stash the number into
+ * @param file The file to read from. Its position will be advanced
+ * @param ... A format string and related arguments; note that an extra string
+ *            argument is provided, the reason for failure
+ */
+#define tryReadlong(var, file, ...) \
+	tryRead(readlong, int64_t, INT64_MAX, long, var, file, __VA_ARGS__)
 
-	// Read the little-endian value byte by byte
-	for (uint8_t shift = 0; shift < sizeof(value) * CHAR_BIT; shift += 8) {
-		int byte = getc(file);
+/*
+ * Reads an unsigned LEB128 value, which must fit in 32 bits, from an object file.
+ * @param file The file to read from. This will read 1 to 5 bytes from the file.
+ * @return The value read, cast to a int64_t, or INT64_MAX on failure.
+ */
+static int64_t readvarint(ObjectReader &file) {
+	uint32_t value = 0;
 
-		if (byte == EOF)
+	for (unsigned shift = 0; shift < 35; shift += 7) {
+		if (file.offset == file.size)
 			return INT64_MAX;
-		// This must be casted to `unsigned`, not `uint8_t`. Rationale:
-		// the type of the shift is the type of `byte` after undergoing
-		// integer promotion, which would be `int` if this was casted to
-		// `uint8_t`, because int is large enough to hold a byte. This
-		// however causes values larger than 127 to be too large when
-		// shifted, potentially triggering undefined behavior.
-		value |= (unsigned int)byte << shift;
+		uint8_t byte = file.ptr[file.offset++];
+
+		value |= (uint32_t)(byte & 0x7F) << shift;
+		if (!(byte & 0x80))
+			return value;
 	}
-	return value;
+	return INT64_MAX; // Too long to fit in 32 bits
 }
 
 /*
- * Helper macro for reading longs from a file, and errors out if it fails to.
+ * Helper macro for reading varints from a file, and errors out if it fails to.
  * Not as a function to avoid overhead in the general case.
  * @param var The variable to stash the number into
  * @param file The file to read from. Its position will be advanced
  * @param ... A format string and related arguments; note that an extra string
  *            argument is provided, the reason for failure
  */
-#define tryReadlong(var, file, ...) \
-	tryRead(readlong, int64_t, INT64_MAX, long, var, file, __VA_ARGS__)
+#define tryReadvarint(var, file, ...) \
+	tryRead(readvarint, int64_t, INT64_MAX, long, var, file, __VA_ARGS__)
 
-// There is no `readbyte`, just use `fgetc` or `getc`.
+/*
+ * Reads a byte from an object file.
+ * @param file The file to read from. Its position will be advanced
+ * @return The byte read, or EOF if the end of the file was reached.
+ */
+static int readbyte(ObjectReader &file) {
+	return file.offset < file.size ? file.ptr[file.offset++] : EOF;
+}
 
 /*
  * Helper macro for reading bytes from a file, and errors out if it fails to.
@@ -89,10 +202,26 @@ static int64_t readlong(FILE *file) {
  * @param ... A format string and related arguments; note that an extra string
  *            argument is provided, the reason for failure
  */
-#define tryGetc(type, var, file, ...) tryRead(getc, int, EOF, type, var, file, __VA_ARGS__)
+#define tryGetc(type, var, file, ...) tryRead(readbyte, int, EOF, type, var, file, __VA_ARGS__)
 
 /*
- * Helper macro for readings '\0'-terminated strings from a file, and errors out if it fails to.
+ * Reads a span of bytes from an object file, without copying them.
+ * @param file The file to read from. Its position will be advanced
+ * @param length How many bytes to read
+ * @return A pointer to the bytes, or `nullptr` if the end of the file was reached.
+ */
+static uint8_t const *readbytes(ObjectReader &file, size_t length) {
+	if (file.size - file.offset < length)
+		return nullptr;
+
+	uint8_t const *bytes = &file.ptr[file.offset];
+	file.offset += length;
+	return bytes;
+}
+
+/*
+ * Helper macro for reading strings (as their index in the string table) from a file, and errors
+ * out if it fails to.
  * Not as a function to avoid overhead in the general case.
  * @param var The variable to stash the string into
  * @param file The file to read from. Its position will be advanced
@@ -101,15 +230,15 @@ static int64_t readlong(FILE *file) {
  */
 #define tryReadstring(var, file, ...) \
 	do { \
-		FILE *tmpFile = file; \
-		std::string &tmpVal = var; \
-		for (int tmpByte = getc(tmpFile); tmpByte != '\0'; tmpByte = getc(tmpFile)) { \
-			if (tmpByte == EOF) { \
-				errx(__VA_ARGS__, feof(tmpFile) ? "Unexpected end of file" : strerror(errno)); \
-			} else { \
-				tmpVal.push_back(tmpByte); \
-			} \
-		}; \
+		ObjectReader &tmpFile = file; \
+		int64_t tmpID = readvarint(tmpFile); \
+		if (tmpID == INT64_MAX) { \
+			errx(__VA_ARGS__, "Unexpected end of file"); \
+		} \
+		if ((uint64_t)tmpID >= tmpFile.strings.size()) { \
+			errx(__VA_ARGS__, "Invalid string ID"); \
+		} \
+		var.assign(tmpFile.strings[tmpID]); \
 	} while (0)
 
 // Functions to parse object files
@@ -122,14 +251,14 @@ static int64_t readlong(FILE *file) {
  * @param fileName The filename to report in errors
  */
 static void readFileStackNode(
-    FILE *file, std::vector<FileStackNode> &fileNodes, uint32_t i, char const *fileName
+    ObjectReader &file, std::vector<FileStackNode> &fileNodes, uint32_t i, char const *fileName
 ) {
 	FileStackNode &node = fileNodes[i];
 	uint32_t parentID;
 
-	tryReadlong(parentID, file, "%s: Cannot read node #%" PRIu32 "'s parent ID: %s", fileName, i);
+	tryReadvarint(parentID, file, "%s: Cannot read node #%" PRIu32 "'s parent ID: %s", fileName, i);
 	node.parent = parentID != (uint32_t)-1 ? &fileNodes[parentID] : nullptr;
-	tryReadlong(
+	tryReadvarint(
 	    node.lineNo, file, "%s: Cannot read node #%" PRIu32 "'s line number: %s", fileName, i
 	);
 	tryGetc(
@@ -151,10 +280,12 @@ static void readFileStackNode(
 
 		uint32_t depth;
 	case NODE_REPT:
-		tryReadlong(depth, file, "%s: Cannot read node #%" PRIu32 "'s rept depth: %s", fileName, i);
+		tryReadvarint(
+		    depth, file, "%s: Cannot read node #%" PRIu32 "'s rept depth: %s", fileName, i
+		);
 		node.data = std::vector<uint32_t>(depth);
 		for (uint32_t k = 0; k < depth; k++)
-			tryReadlong(
+			tryReadvarint(
 			    node.iters()[k],
 			    file,
 			    "%s: Cannot read node #%" PRIu32 "'s iter #%" PRIu32 ": %s",
@@ -180,7 +311,10 @@ static void readFileStackNode(
  * @param fileName The filename to report in errors
  */
 static void readSymbol(
-    FILE *file, Symbol &symbol, char const *fileName, std::vector<FileStackNode> const &fileNodes
+    ObjectReader &file,
+    Symbol &symbol,
+    char const *fileName,
+    std::vector<FileStackNode> const &fileNodes
 ) {
 	tryReadstring(symbol.name, file, "%s: Cannot read symbol name: %s", fileName);
 	tryGetc(
@@ -195,11 +329,11 @@ static void readSymbol(
 	if (symbol.type != SYMTYPE_IMPORT) {
 		symbol.objFileName = fileName;
 		uint32_t nodeID;
-		tryReadlong(
+		tryReadvarint(
 		    nodeID, file, "%s: Cannot read \"%s\"'s node ID: %s", fileName, symbol.name.c_str()
 		);
 		symbol.src = &fileNodes[nodeID];
-		tryReadlong(
+		tryReadvarint(
 		    symbol.lineNo,
 		    file,
 		    "%s: Cannot read \"%s\"'s line number: %s",
@@ -207,14 +341,14 @@ static void readSymbol(
 		    symbol.name.c_str()
 		);
 		int32_t sectionID, value;
-		tryReadlong(
+		tryReadvarint(
 		    sectionID,
 		    file,
 		    "%s: Cannot read \"%s\"'s section ID: %s",
 		    fileName,
 		    symbol.name.c_str()
 		);
-		tryReadlong(
+		tryReadvarint(
 		    value, file, "%s: Cannot read \"%s\"'s value: %s", fileName, symbol.name.c_str()
 		);
 		if (sectionID == -1) {
@@ -240,7 +374,7 @@ static void readSymbol(
  * @param i The number of the patch to report in errors
  */
 static void readPatch(
-    FILE *file,
+    ObjectReader &file,
     Patch &patch,
     char const *fileName,
     std::string const &sectName,
@@ -248,9 +382,9 @@ static void readPatch(
     std::vector<FileStackNode> const &fileNodes
 ) {
 	uint32_t nodeID, rpnSize;
-	PatchType type;
+	uint8_t type;
 
-	tryReadlong(
+	tryReadvarint(
 	    nodeID,
 	    file,
 	    "%s: Unable to read \"%s\"'s patch #%" PRIu32 "'s node ID: %s",
@@ -259,7 +393,7 @@ static void readPatch(
 	    i
 	);
 	patch.src = &fileNodes[nodeID];
-	tryReadlong(
+	tryReadvarint(
 	    patch.lineNo,
 	    file,
 	    "%s: Unable to read \"%s\"'s patch #%" PRIu32 "'s line number: %s",
@@ -267,7 +401,7 @@ static void readPatch(
 	    sectName.c_str(),
 	    i
 	);
-	tryReadlong(
+	tryReadvarint(
 	    patch.offset,
 	    file,
 	    "%s: Unable to read \"%s\"'s patch #%" PRIu32 "'s offset: %s",
@@ -275,7 +409,7 @@ static void readPatch(
 	    sectName.c_str(),
 	    i
 	);
-	tryReadlong(
+	tryReadvarint(
 	    patch.pcSectionID,
 	    file,
 	    "%s: Unable to read \"%s\"'s patch #%" PRIu32 "'s PC offset: %s",
@@ -283,7 +417,7 @@ static void readPatch(
 	    sectName.c_str(),
 	    i
 	);
-	tryReadlong(
+	tryReadvarint(
 	    patch.pcOffset,
 	    file,
 	    "%s: Unable to read \"%s\"'s patch #%" PRIu32 "'s PC offset: %s",
@@ -292,7 +426,7 @@ static void readPatch(
 	    i
 	);
 	tryGetc(
-	    PatchType,
+	    uint8_t,
 	    type,
 	    file,
 	    "%s: Unable to read \"%s\"'s patch #%" PRIu32 "'s type: %s",
@@ -300,8 +434,9 @@ static void readPatch(
 	    sectName.c_str(),
 	    i
 	);
-	patch.type = type;
-	tryReadlong(
+	patch.type = (PatchType)(type & 0x7F);
+	patch.isJumpTarget = type >> 7;
+	tryReadvarint(
 	    rpnSize,
 	    file,
 	    "%s: Unable to read \"%s\"'s patch #%" PRIu32 "'s RPN size: %s",
@@ -310,17 +445,17 @@ static void readPatch(
 	    i
 	);
 
-	patch.rpnExpression.resize(rpnSize);
-	size_t nbElementsRead = fread(patch.rpnExpression.data(), 1, rpnSize, file);
+	uint8_t const *rpnExpression = readbytes(file, rpnSize);
 
-	if (nbElementsRead != rpnSize)
+	if (!rpnExpression)
 		errx(
-		    "%s: Cannot read \"%s\"'s patch #%" PRIu32 "'s RPN expression: %s",
+		    "%s: Cannot read \"%s\"'s patch #%" PRIu32
+		    "'s RPN expression: Unexpected end of file",
 		    fileName,
 		    sectName.c_str(),
-		    i,
-		    feof(file) ? "Unexpected end of file" : strerror(errno)
+		    i
 		);
+	patch.rpnExpression = std::span(rpnExpression, rpnSize);
 }
 
 /*
@@ -338,15 +473,20 @@ static void
  * @param file The file to read from
  * @param section The section to fill
  * @param fileName The filename to report in errors
+ * @param errors Where to store non-fatal errors, to be reported later
  */
 static void readSection(
-    FILE *file, Section &section, char const *fileName, std::vector<FileStackNode> const &fileNodes
+    ObjectReader &file,
+    Section &section,
+    char const *fileName,
+    std::vector<FileStackNode> const &fileNodes,
+    std::vector<std::string> &errors
 ) {
 	int32_t tmp;
 	uint8_t byte;
 
 	tryReadstring(section.name, file, "%s: Cannot read section name: %s", fileName);
-	tryReadlong(tmp, file, "%s: Cannot read \"%s\"'s' size: %s", fileName, section.name.c_str());
+	tryReadvarint(tmp, file, "%s: Cannot read \"%s\"'s' size: %s", fileName, section.name.c_str());
 	if (tmp < 0 || tmp > UINT16_MAX)
 		errx("\"%s\"'s section size (%" PRId32 ") is invalid", section.name.c_str(), tmp);
 	section.size = tmp;
@@ -361,14 +501,16 @@ static void readSection(
 		section.modifier = SECTION_FRAGMENT;
 	else
 		section.modifier = SECTION_NORMAL;
-	tryReadlong(tmp, file, "%s: Cannot read \"%s\"'s org: %s", fileName, section.name.c_str());
+	tryReadvarint(tmp, file, "%s: Cannot read \"%s\"'s org: %s", fileName, section.name.c_str());
 	section.isAddressFixed = tmp >= 0;
 	if (tmp > UINT16_MAX) {
-		error(nullptr, 0, "\"%s\"'s org is too large (%" PRId32 ")", section.name.c_str(), tmp);
+		errors.push_back(
+		    "\""s + section.name + "\"'s org is too large (" + std::to_string(tmp) + ")"
+		);
 		tmp = UINT16_MAX;
 	}
 	section.org = tmp;
-	tryReadlong(tmp, file, "%s: Cannot read \"%s\"'s bank: %s", fileName, section.name.c_str());
+	tryReadvarint(tmp, file, "%s: Cannot read \"%s\"'s bank: %s", fileName, section.name.c_str());
 	section.isBankFixed = tmp >= 0;
 	section.bank = tmp;
 	tryGetc(
@@ -383,37 +525,78 @@ static void readSection(
 		byte = 16;
 	section.isAlignFixed = byte != 0;
 	section.alignMask = (1 << byte) - 1;
-	tryReadlong(
+	tryReadvarint(
 	    tmp, file, "%s: Cannot read \"%s\"'s alignment offset: %s", fileName, section.name.c_str()
 	);
 	if (tmp > UINT16_MAX) {
-		error(
-		    nullptr,
-		    0,
-		    "\"%s\"'s alignment offset is too large (%" PRId32 ")",
-		    section.name.c_str(),
-		    tmp
+		errors.push_back(
+		    "\""s + section.name + "\"'s alignment offset is too large ("
+		    + std::to_string(tmp) + ")"
 		);
 		tmp = UINT16_MAX;
 	}
 	section.alignOfs = tmp;
 
 	if (sect_HasData(section.type)) {
-		if (section.size) {
+		// Section data gets patched later, so it must be copied out of the file...
+		// unless it is only to be read back from it when the output is written, or it is a
+		// fragment, which is copied straight into its whole section once all are merged
+		size_t dataStart = file.offset;
+		bool isCopied = !lowMemory && section.modifier != SECTION_FRAGMENT;
+
+		if (isCopied)
 			section.data.resize(section.size);
-			if (size_t nbRead = fread(section.data.data(), 1, section.size, file);
-			    nbRead != section.size)
+		for (uint32_t offset = 0; offset < section.size;) {
+			uint32_t runLength;
+
+			tryReadvarint(
+			    runLength,
+			    file,
+			    "%s: Cannot read \"%s\"'s data: %s",
+			    fileName,
+			    section.name.c_str()
+			);
+			bool isFill = runLength & DATA_RUN_FILL;
+			runLength >>= 1;
+			if (runLength == 0 || runLength > section.size - offset)
 				errx(
-				    "%s: Cannot read \"%s\"'s data: %s",
+				    "%s: \"%s\"'s data has an invalid run length (%" PRIu32 ")",
 				    fileName,
 				    section.name.c_str(),
-				    feof(file) ? "Unexpected end of file" : strerror(errno)
+				    runLength
+				);
+
+			if (isFill) {
+				tryGetc(
+				    uint8_t,
+				    byte,
+				    file,
+				    "%s: Cannot read \"%s\"'s data: %s",
+				    fileName,
+				    section.name.c_str()
 				);
+				if (isCopied)
+					memset(&section.data[offset], byte, runLength);
+			} else {
+				uint8_t const *data = readbytes(file, runLength);
+
+				if (!data)
+					errx(
+					    "%s: Cannot read \"%s\"'s data: Unexpected end of file",
+					    fileName,
+					    section.name.c_str()
+					);
+				if (isCopied)
+					memcpy(&section.data[offset], data, runLength);
+			}
+			offset += runLength;
 		}
+		if (!isCopied)
+			section.encodedData = std::span(&file.ptr[dataStart], file.offset - dataStart);
 
 		uint32_t nbPatches;
 
-		tryReadlong(
+		tryReadvarint(
 		    nbPatches,
 		    file,
 		    "%s: Cannot read \"%s\"'s number of patches: %s",
@@ -456,7 +639,7 @@ static void linkSymToSect(Symbol &symbol, Section &section) {
  * @param fileName The filename to report in errors
  */
 static void readAssertion(
-    FILE *file,
+    ObjectReader &file,
     Assertion &assert,
     char const *fileName,
     uint32_t i,
@@ -469,32 +652,67 @@ static void readAssertion(
 	tryReadstring(assert.message, file, "%s: Cannot read assertion's message: %s", fileName);
 }
 
-void obj_ReadFile(char const *fileName, unsigned int fileID) {
+// An object file's contents, read without touching any global state (except for its `nodes`),
+// so that several files can be read concurrently
+struct ObjectFile {
+	char const *fileName = nullptr;
+	bool isSdcc = false;
+	SdasObject sdas; // Only used by SDCC object files
+	std::shared_ptr<uint8_t const[]> image;
+	std::vector<Symbol> symbols;
+	std::vector<std::unique_ptr<Section>> sections;
+	std::vector<Assertion> assertions;
+	std::vector<std::string> errors; // Non-fatal errors, reported while merging
+};
+
+static void readObject(ObjectFile &object, unsigned int fileID) {
+	TracePhase phase("read_object", object.fileName);
+	char const *fileName = object.fileName;
 	FILE *file;
 	if (strcmp(fileName, "-")) {
 		file = fopen(fileName, "rb");
 	} else {
 		fileName = "<stdin>";
+		object.fileName = fileName;
 		file = fdopen(STDIN_FILENO, "rb"); // `stdin` is in text mode by default
 	}
 	if (!file)
 		err("Failed to open file \"%s\"", fileName);
-	Defer closeFile{[&] { fclose(file); }};
+	Defer closeFile{[&] {
+		if (file)
+			fclose(file);
+	}};
+
+	std::shared_ptr<uint8_t const[]> image;
+	size_t size = 0;
+
+	// Try mapping the file for better performance
+	if (struct stat statBuf;
+	    fstat(fileno(file), &statBuf) == 0 && S_ISREG(statBuf.st_mode) && statBuf.st_size > 0) {
+		size = statBuf.st_size;
+		if (uint8_t const *mappingAddr = mapFile(file, fileName, size); mappingAddr)
+			image = std::shared_ptr<uint8_t const[]>(mappingAddr, FileUnmapDeleter(size));
+	}
+
+	if (!image) {
+		// Sometimes mapping fails or isn't possible (e.g. pipes), so read the whole file instead
+		auto data = std::make_shared<std::vector<uint8_t>>();
+		uint8_t buf[BUFSIZ];
+
+		for (size_t nbRead; (nbRead = fread(buf, 1, sizeof(buf), file)) != 0;)
+			data->insert(data->end(), buf, buf + nbRead);
+		if (ferror(file))
+			err("Failed to read file \"%s\"", fileName);
+		size = data->size();
+		image = std::shared_ptr<uint8_t const[]>(data, data->data());
+	}
+	object.image = image;
 
 	// First, check if the object is a RGBDS object or a SDCC one. If the first byte is 'R',
 	// we'll assume it's a RGBDS object file, and otherwise, that it's a SDCC object file.
-	int c = getc(file);
-
-	ungetc(c, file); // Guaranteed to work
-	switch (c) {
-	case EOF:
+	if (size == 0)
 		fatal(nullptr, 0, "File \"%s\" is empty!", fileName);
-
-	case 'R':
-		break;
-
-	default:
-		// This is (probably) a SDCC object file, defer the rest of detection to it.
+	if (image[0] != 'R') {
 		// Since SDCC does not provide line info, everything will be reported as coming from the
 		// object file. It's better than nothing.
 		nodes[fileID].push_back({
@@ -504,24 +722,25 @@ void obj_ReadFile(char const *fileName, unsigned int fileID) {
 		    .lineNo = 0,
 		});
 
-		std::vector<Symbol> &fileSymbols = symbolLists.emplace_front();
-
-		sdobj_ReadFile(nodes[fileID].back(), file, fileSymbols);
+		// This is (probably) a SDCC object file, defer the rest of detection to it.
+		object.isSdcc = true;
+		sdobj_ReadFile(
+		    nodes[fileID].back(), (char const *)image.get(), size, object.symbols, object.sdas
+		);
 		return;
 	}
 
-	// Begin by reading the magic bytes
-	int matchedElems;
+	ObjectReader reader{.ptr = image.get(), .size = size, .strings = {}};
 
-	if (fscanf(file, RGBDS_OBJECT_VERSION_STRING "%n", &matchedElems) == 1
-	    && matchedElems != strlen(RGBDS_OBJECT_VERSION_STRING))
+	// Begin by reading the magic bytes
+	static constexpr size_t magicLen = QUOTEDSTRLEN(RGBDS_OBJECT_VERSION_STRING);
+	if (uint8_t const *magic = readbytes(reader, magicLen);
+	    !magic || memcmp(magic, RGBDS_OBJECT_VERSION_STRING, magicLen))
 		errx("%s: Not a RGBDS object file", fileName);
 
-	verbosePrint("Reading object file %s\n", fileName);
-
 	uint32_t revNum;
 
-	tryReadlong(revNum, file, "%s: Cannot read revision number: %s", fileName);
+	tryReadlong(revNum, reader, "%s: Cannot read revision number: %s", fileName);
 	if (revNum != RGBDS_OBJECT_REV)
 		errx(
 		    "%s: Unsupported object file for rgblink %s; try rebuilding \"%s\"%s"
@@ -534,61 +753,71 @@ void obj_ReadFile(char const *fileName, unsigned int fileID) {
 		    revNum
 		);
 
+	// The fingerprint only lets rgbasm tell whether an object changed, so it is not checked here
+	if (!readbytes(reader, 8))
+		errx("%s: Cannot read fingerprint: Unexpected end of file", fileName);
+
 	uint32_t nbNodes;
 	uint32_t nbSymbols;
 	uint32_t nbSections;
 
-	tryReadlong(nbSymbols, file, "%s: Cannot read number of symbols: %s", fileName);
-	tryReadlong(nbSections, file, "%s: Cannot read number of sections: %s", fileName);
+	tryReadvarint(nbSymbols, reader, "%s: Cannot read number of symbols: %s", fileName);
+	tryReadvarint(nbSections, reader, "%s: Cannot read number of sections: %s", fileName);
+
+	uint32_t nbStrings;
 
-	nbSectionsToAssign += nbSections;
+	tryReadvarint(nbStrings, reader, "%s: Cannot read number of strings: %s", fileName);
+	reader.strings.reserve(nbStrings);
+	for (uint32_t i = 0; i < nbStrings; i++) {
+		char const *str = (char const *)&reader.ptr[reader.offset];
+		void const *end = memchr(str, '\0', reader.size - reader.offset);
+		if (!end)
+			errx("%s: Cannot read string #%" PRIu32 ": Unexpected end of file", fileName, i);
+		reader.strings.emplace_back(str, (char const *)end);
+		reader.offset = (uint8_t const *)end - reader.ptr + 1;
+	}
 
-	tryReadlong(nbNodes, file, "%s: Cannot read number of nodes: %s", fileName);
+	tryReadvarint(nbNodes, reader, "%s: Cannot read number of nodes: %s", fileName);
 	nodes[fileID].resize(nbNodes);
-	verbosePrint("Reading %u nodes...\n", nbNodes);
 	for (uint32_t i = nbNodes; i--;)
-		readFileStackNode(file, nodes[fileID], i, fileName);
+		readFileStackNode(reader, nodes[fileID], i, fileName);
 
 	// This file's symbols, kept to link sections to them
-	std::vector<Symbol> &fileSymbols = symbolLists.emplace_front(nbSymbols);
+	std::vector<Symbol> &fileSymbols = object.symbols;
 	std::vector<uint32_t> nbSymPerSect(nbSections, 0);
 
-	verbosePrint("Reading %" PRIu32 " symbols...\n", nbSymbols);
+	fileSymbols.resize(nbSymbols);
 	for (uint32_t i = 0; i < nbSymbols; i++) {
 		// Read symbol
 		Symbol &symbol = fileSymbols[i];
 
-		readSymbol(file, symbol, fileName, nodes[fileID]);
+		readSymbol(reader, symbol, fileName, nodes[fileID]);
 
-		if (symbol.type == SYMTYPE_EXPORT)
-			sym_AddSymbol(symbol);
 		if (auto *label = std::get_if<Label>(&symbol.data); label)
 			nbSymPerSect[label->sectionID]++;
 	}
 
 	// This file's sections, stored in a table to link symbols to them
-	std::vector<std::unique_ptr<Section>> fileSections(nbSections);
+	std::vector<std::unique_ptr<Section>> &fileSections = object.sections;
 
-	verbosePrint("Reading %" PRIu32 " sections...\n", nbSections);
+	fileSections.resize(nbSections);
 	for (uint32_t i = 0; i < nbSections; i++) {
 		// Read section
 		fileSections[i] = std::make_unique<Section>();
 		fileSections[i]->nextu = nullptr;
-		readSection(file, *fileSections[i], fileName, nodes[fileID]);
-		fileSections[i]->fileSymbols = &fileSymbols;
+		readSection(reader, *fileSections[i], fileName, nodes[fileID], object.errors);
 		fileSections[i]->symbols.reserve(nbSymPerSect[i]);
 	}
 
 	uint32_t nbAsserts;
 
-	tryReadlong(nbAsserts, file, "%s: Cannot read number of assertions: %s", fileName);
-	verbosePrint("Reading %" PRIu32 " assertions...\n", nbAsserts);
+	tryReadvarint(nbAsserts, reader, "%s: Cannot read number of assertions: %s", fileName);
+	object.assertions.resize(nbAsserts);
 	for (uint32_t i = 0; i < nbAsserts; i++) {
-		Assertion &assertion = assertions.emplace_front();
+		Assertion &assertion = object.assertions[i];
 
-		readAssertion(file, assertion, fileName, i, nodes[fileID]);
+		readAssertion(reader, assertion, fileName, i, nodes[fileID]);
 		linkPatchToPCSect(assertion.patch, fileSections);
-		assertion.fileSymbols = &fileSymbols;
 	}
 
 	// Give patches' PC section pointers to their sections
@@ -609,16 +838,76 @@ void obj_ReadFile(char const *fileName, unsigned int fileID) {
 			linkSymToSect(fileSymbols[i], *section);
 		}
 	}
+}
+
+void obj_DecodeData(std::span<uint8_t const> runs, uint8_t *dest) {
+	// The runs were already checked when the section was read
+	ObjectReader reader{.ptr = runs.data(), .size = runs.size(), .strings = {}};
+
+	while (reader.offset < reader.size) {
+		uint32_t runLength = readvarint(reader);
+		bool isFill = runLength & DATA_RUN_FILL;
+
+		runLength >>= 1;
+		if (isFill)
+			memset(dest, readbyte(reader), runLength);
+		else
+			memcpy(dest, readbytes(reader, runLength), runLength);
+		dest += runLength;
+	}
+}
+
+// Adds an object file's contents to the global data structures; this must be done in order
+static void mergeObject(ObjectFile &object, unsigned int fileID) {
+	char const *fileName = object.fileName;
 
-	// Calling `sect_AddSection` invalidates the contents of `fileSections`!
-	for (uint32_t i = 0; i < nbSections; i++)
-		sect_AddSection(std::move(fileSections[i]));
+	if (object.isSdcc) {
+		// The file's contents are not needed anymore, they have all been parsed
+		std::vector<Symbol> &fileSymbols = symbolLists.emplace_front(std::move(object.symbols));
+
+		stats_Count("symbols", fileSymbols.size());
+		sdobj_MergeFile(nodes[fileID].back(), fileSymbols, object.sdas);
+		return;
+	}
+
+	verbosePrint("Reading object file %s\n", fileName);
+	verbosePrint("Reading %zu nodes...\n", nodes[fileID].size());
+
+	nbSectionsToAssign += object.sections.size();
+	fileImages.push_back(std::move(object.image));
+
+	// Moving the vector does not move its elements, so pointers to them remain valid
+	std::vector<Symbol> &fileSymbols = symbolLists.emplace_front(std::move(object.symbols));
+
+	verbosePrint("Reading %zu symbols...\n", fileSymbols.size());
+	stats_Count("symbols", fileSymbols.size());
+	for (Symbol &symbol : fileSymbols) {
+		if (symbol.type == SYMTYPE_EXPORT)
+			sym_AddSymbol(symbol);
+	}
+
+	verbosePrint("Reading %zu sections...\n", object.sections.size());
+	for (std::unique_ptr<Section> &section : object.sections)
+		section->fileSymbols = &fileSymbols;
+	for (std::string const &message : object.errors)
+		error(nullptr, 0, "%s", message.c_str());
+
+	verbosePrint("Reading %zu assertions...\n", object.assertions.size());
+	stats_Count("assertions", object.assertions.size());
+	for (Assertion &assertion : object.assertions) {
+		assertion.fileSymbols = &fileSymbols;
+		assertions.push_front(std::move(assertion));
+	}
+
+	// Calling `sect_AddSection` invalidates the contents of `object.sections`!
+	for (std::unique_ptr<Section> &section : object.sections)
+		sect_AddSection(std::move(section));
 
 	// Fix symbols' section pointers to component sections
 	// This has to run **after** all the `sect_AddSection()` calls,
 	// so that `sect_GetSection()` will work
-	for (uint32_t i = 0; i < nbSymbols; i++) {
-		if (auto *label = std::get_if<Label>(&fileSymbols[i].data); label) {
+	for (Symbol &symbol : fileSymbols) {
+		if (auto *label = std::get_if<Label>(&symbol.data); label) {
 			if (Section *section = label->section; section->modifier != SECTION_NORMAL) {
 				if (section->modifier == SECTION_FRAGMENT)
 					// Add the fragment's offset to the symbol's
@@ -630,6 +919,53 @@ void obj_ReadFile(char const *fileName, unsigned int fileID) {
 	}
 }
 
-void obj_Setup(unsigned int nbFiles) {
-	nodes.resize(nbFiles);
+// Resolves imports to their definitions once all files are merged, so that patches referring to
+// them need not look them up by name
+static void resolveImports() {
+	for (std::vector<Symbol> &fileSymbols : symbolLists) {
+		for (Symbol &symbol : fileSymbols) {
+			if (symbol.type == SYMTYPE_IMPORT)
+				symbol.definition = sym_GetSymbol(symbol.name);
+		}
+	}
+}
+
+void obj_ReadFiles(char const * const *fileNames, unsigned int nbFiles) {
+	unsigned int firstFileID = nodes.size();
+	nodes.resize(firstFileID + nbFiles);
+	stats_Count("object_files", nbFiles);
+
+	// File IDs are given in reverse order, after those of the files read previously
+	auto getFileID = [&](unsigned int i) { return firstFileID + nbFiles - i - 1; };
+
+	if (nbJobs <= 1 || nbFiles <= 1) {
+		for (unsigned int i = 0; i < nbFiles; i++) {
+			ObjectFile object;
+
+			object.fileName = fileNames[i];
+			readObject(object, getFileID(i));
+			mergeObject(object, getFileID(i));
+		}
+		return;
+	}
+
+	// Read the files concurrently, then merge them in the same order as if they had not been
+	std::vector<ObjectFile> objects(nbFiles);
+
+	for (unsigned int i = 0; i < nbFiles; i++)
+		objects[i].fileName = fileNames[i];
+	size_t nbRead = diag_RunTasksUntilAbort(nbFiles, nbJobs, [&](size_t i) {
+		readObject(objects[i], getFileID(i));
+	});
+
+	// If a file could not be read, the ones before it are still merged first, as they would be
+	for (unsigned int i = 0; i < nbRead; i++)
+		mergeObject(objects[i], getFileID(i));
+	if (nbRead != nbFiles)
+		diag_FinishAbort();
+}
+
+void obj_FinishReading() {
+	sect_MergeFragments();
+	resolveImports();
 }
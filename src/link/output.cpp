@@ -3,11 +3,19 @@
 #include "link/output.hpp"
 
 #include <algorithm>
+#include <atomic>
 #include <deque>
+#include <functional>
 #include <inttypes.h>
+#include <iterator>
+#include <limits.h>
+#include <set>
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <string>
+#include <thread>
 #include <vector>
 
 #include "error.hpp"
@@ -16,24 +24,37 @@
 #include "linkdefs.hpp"
 #include "platform.hpp"
 
+#include "fix/header.hpp"
+
 #include "link/main.hpp"
+#include "link/object.hpp"
+#include "link/patch.hpp"
 #include "link/symbol.hpp"
 
 #define BANK_SIZE 0x4000
 
 FILE *outputFile;
 FILE *overlayFile;
-FILE *symFile;
-FILE *mapFile;
 
 struct SortedSymbol {
 	Symbol const *sym;
 	uint16_t addr;
 };
 
+// Orders sections by address, which can also be looked up directly
+struct SectionOrgOrder {
+	using is_transparent = void;
+
+	bool operator()(Section const *lhs, Section const *rhs) const { return lhs->org < rhs->org; }
+	bool operator()(Section const *lhs, uint32_t rhs) const { return lhs->org < rhs; }
+	bool operator()(uint32_t lhs, Section const *rhs) const { return lhs < rhs->org; }
+};
+
+using SectionSet = std::multiset<Section const *, SectionOrgOrder>;
+
 struct SortedSections {
-	std::deque<Section const *> sections;
-	std::deque<Section const *> zeroLenSections;
+	SectionSet sections; // These never overlap, so they are also ordered by end address
+	SectionSet zeroLenSections;
 };
 
 static std::deque<SortedSections> sections[SECTTYPE_INVALID];
@@ -76,25 +97,36 @@ void out_AddSection(Section const &section) {
 	for (uint32_t i = sections[section.type].size(); i < minNbBanks; i++)
 		sections[section.type].emplace_back();
 
-	std::deque<Section const *> &bankSections =
-	    section.size ? sections[section.type][targetBank].sections
-	                 : sections[section.type][targetBank].zeroLenSections;
-	auto pos = bankSections.begin();
+	SectionSet &bankSections = section.size ? sections[section.type][targetBank].sections
+	                                        : sections[section.type][targetBank].zeroLenSections;
+
+	// Go before the sections at the same address, like the ones added after them used to
+	bankSections.emplace_hint(bankSections.lower_bound(section.org), &section);
+}
 
-	while (pos != bankSections.end() && (*pos)->org < section.org)
-		pos++;
+void out_RemoveSection(Section const &section) {
+	uint32_t targetBank = section.bank - sectionTypeInfo[section.type].firstBank;
+	SectionSet &bankSections = section.size ? sections[section.type][targetBank].sections
+	                                        : sections[section.type][targetBank].zeroLenSections;
+	auto [begin, end] = bankSections.equal_range(section.org);
 
-	bankSections.insert(pos, &section);
+	bankSections.erase(std::find(begin, end, &section));
 }
 
 Section const *out_OverlappingSection(Section const &section) {
 	uint32_t bank = section.bank - sectionTypeInfo[section.type].firstBank;
+	SectionSet const &bankSections = sections[section.type][bank].sections;
 
-	for (Section const *ptr : sections[section.type][bank].sections) {
-		if (ptr->org < section.org + section.size && section.org < ptr->org + ptr->size)
-			return ptr;
-	}
-	return nullptr;
+	auto overlaps = [&section](Section const *ptr) {
+		return ptr->org < section.org + section.size && section.org < ptr->org + ptr->size;
+	};
+
+	// The lowest overlapping section either starts at or before this one, and is then the last one
+	// to do so, or it is the first one to start after it
+	auto next = bankSections.upper_bound(section.org);
+	if (next != bankSections.begin() && overlaps(*std::prev(next)))
+		return *std::prev(next);
+	return next != bankSections.end() && overlaps(*next) ? *next : nullptr;
 }
 
 /*
@@ -145,58 +177,211 @@ static void coverOverlayBanks(uint32_t nbOverlayBanks) {
 	}
 }
 
-static uint8_t getNextFillByte() {
-	if (overlayFile) {
-		int c = getc(overlayFile);
-		if (c != EOF) {
-			return c;
-		}
+/*
+ * Fills a run of bytes with overlay data, or with the padding value past its end.
+ * @param dest Where to write the fill bytes
+ * @param size How many fill bytes to write
+ */
+static void fillBytes(uint8_t *dest, size_t size) {
+	size_t nbRead = 0;
 
-		if (static bool warned = false; !hasPadValue && !warned) {
+	if (overlayFile) {
+		nbRead = fread(dest, 1, size, overlayFile);
+		if (static bool warned = false; nbRead != size && !hasPadValue && !warned) {
 			warnx("Output is larger than overlay file, but no padding value was specified");
 			warned = true;
 		}
 	}
 
-	return padValue;
+	memset(dest + nbRead, padValue, size - nbRead);
+}
+
+// Fixing the header, as rgbfix would, requires summing up the whole ROM before writing ROM0's
+static bool isFixingHeader;
+static uint8_t rom0[BANK_SIZE];
+static size_t rom0Len;
+static uint16_t romxSum; // The ROMX banks' part of the global checksum
+static size_t romxLen;
+static std::vector<uint8_t> bufferedROM; // When the output cannot be rewound to fix the header
+static bool isBufferingROM;
+
+static uint16_t headerSize() {
+	return (headerMBC & 0xFF00) == TPP1 ? 0x154 : 0x150;
+}
+
+/*
+ * Writes a bank to the output file, keeping track of what fixing the header needs.
+ * @param data The bank's contents
+ * @param len The bank's size, which may be less than a full bank without padding
+ */
+static void outputBank(uint8_t const *data, size_t len) {
+	if (!isFixingHeader) {
+		fwrite(data, 1, len, outputFile);
+		return;
+	}
+
+	if (rom0Len == 0) {
+		if (len < headerSize())
+			errx(
+			    "Cannot fix the header of \"%s\": expected at least %" PRIu16
+			    " ($%" PRIx16 ") bytes, got only %zu",
+			    outputFileName,
+			    headerSize(),
+			    headerSize(),
+			    len
+			);
+		memcpy(rom0, data, len);
+		rom0Len = len;
+	} else {
+		romxSum += sumBytes(data, len);
+		romxLen += len;
+	}
+
+	if (isBufferingROM)
+		bufferedROM.insert(bufferedROM.end(), data, data + len);
+	else
+		fwrite(data, 1, len, outputFile);
+}
+
+/*
+ * Overwrites some of ROM0's bytes, warning if they were set to something else (like rgbfix)
+ * @param addr The address of the first byte to overwrite
+ * @param fixed The bytes to write there
+ * @param size How many bytes to write
+ * @param areaName The name of the overwritten header field, for the warning
+ */
+static void
+overwriteBytes(uint16_t addr, uint8_t const *fixed, uint8_t size, char const *areaName) {
+	for (uint8_t i = 0; i < size; i++) {
+		if (rom0[addr + i] != 0 && rom0[addr + i] != fixed[i]) {
+			warnx("Overwrote a non-zero byte in the %s", areaName);
+			break;
+		}
+	}
+	memcpy(&rom0[addr], fixed, size);
+}
+
+static void overwriteByte(uint16_t addr, uint8_t fixed, char const *areaName) {
+	overwriteBytes(addr, &fixed, 1, areaName);
+}
+
+// Fills in the header once the whole ROM has been output, then writes it over ROM0's
+static void fixHeader() {
+	if (fixHeaderSums)
+		overwriteBytes(0x104, nintendoLogo, sizeof(nintendoLogo), "Nintendo logo");
+	if (headerTitle)
+		overwriteBytes(0x134, (uint8_t const *)headerTitle, headerTitleLen, "title");
+	if (headerMBC < MBC_NONE)
+		overwriteByte(0x147, (headerMBC & 0xFF00) == TPP1 ? 0xBC : headerMBC, "cartridge type");
+	if ((headerMBC & 0xFF00) == TPP1) {
+		uint8_t const tpp1Code[2] = {0xC1, 0x65};
+
+		overwriteBytes(0x149, tpp1Code, sizeof(tpp1Code), "TPP1 identification code");
+		overwriteBytes(0x150, tpp1Rev, sizeof(tpp1Rev), "TPP1 revision number");
+		if (headerRAMSize != UNSPECIFIED)
+			overwriteByte(0x152, headerRAMSize, "RAM size");
+		overwriteByte(0x153, headerMBC & 0xFF, "TPP1 feature flags");
+	} else if (headerRAMSize != UNSPECIFIED) {
+		overwriteByte(0x149, headerRAMSize, "RAM size");
+	}
+
+	// Pad to the next power of 2 banks, but at least 2, like rgbfix
+	size_t padLen = 0;
+
+	if (headerPadValue != UNSPECIFIED) {
+		uint32_t nbBanks = 1 + (romxLen + BANK_SIZE - 1) / BANK_SIZE;
+
+		if (nbBanks == 1) {
+			memset(&rom0[rom0Len], headerPadValue, sizeof(rom0) - rom0Len);
+			padLen = sizeof(rom0) - rom0Len;
+			rom0Len = sizeof(rom0);
+			nbBanks = 2;
+		}
+		if (nbBanks & (nbBanks - 1))
+			nbBanks = 1 << (CHAR_BIT * sizeof(nbBanks) - clz(nbBanks));
+		rom0[0x148] = ctz(nbBanks / 2);
+		romxSum += headerPadValue * ((nbBanks - 1) * BANK_SIZE - romxLen);
+		padLen += (nbBanks - 1) * BANK_SIZE - romxLen;
+	}
+
+	if (fixHeaderSums) {
+		uint8_t headerSum = 0;
+
+		for (uint16_t i = 0x134; i < 0x14D; i++)
+			headerSum -= rom0[i] + 1;
+		overwriteByte(0x14D, headerSum, "header checksum");
+
+		uint16_t globalSum = sumBytes(rom0, 0x14E) + sumBytes(&rom0[0x150], rom0Len - 0x150)
+		                     + romxSum;
+		uint8_t bytes[2] = {(uint8_t)(globalSum >> 8), (uint8_t)(globalSum & 0xFF)};
+
+		overwriteBytes(0x14E, bytes, sizeof(bytes), "global checksum");
+	}
+
+	if (isBufferingROM) {
+		memcpy(bufferedROM.data(), rom0, headerSize());
+		bufferedROM.resize(bufferedROM.size() + padLen, headerPadValue);
+		fwrite(bufferedROM.data(), 1, bufferedROM.size(), outputFile);
+	} else {
+		for (uint8_t padding[BANK_SIZE]; padLen != 0;) {
+			size_t len = padLen < sizeof(padding) ? padLen : sizeof(padding);
+
+			memset(padding, headerPadValue, len);
+			fwrite(padding, 1, len, outputFile);
+			padLen -= len;
+		}
+		if (fseek(outputFile, 0, SEEK_SET) != 0)
+			err("Failed to rewind \"%s\" to fix its header", outputFileName);
+		fwrite(rom0, 1, headerSize(), outputFile);
+	}
 }
 
 /*
  * Write a ROM bank's sections to the output file.
+ * The whole bank is assembled in memory first, so that it can be written at once.
  * @param bankSections The bank's sections, ordered by increasing address
  * @param baseOffset The address of the bank's first byte in GB address space
  * @param size The size of the bank
  */
-static void
-    writeBank(std::deque<Section const *> *bankSections, uint16_t baseOffset, uint16_t size) {
+static void writeBank(SectionSet const *bankSections, uint16_t baseOffset, uint16_t size) {
+	static std::vector<uint8_t> bank;
 	uint16_t offset = 0;
 
+	bank.resize(size);
+
 	if (bankSections) {
 		for (Section const *section : *bankSections) {
 			assume(section->offset == 0);
 			// Output padding up to the next SECTION
-			while (offset + baseOffset < section->org) {
-				putc(getNextFillByte(), outputFile);
-				offset++;
+			if (uint16_t org = section->org - baseOffset; offset < org) {
+				fillBytes(&bank[offset], org - offset);
+				offset = org;
 			}
 
 			// Output the section itself
-			fwrite(section->data.data(), 1, section->size, outputFile);
 			if (overlayFile) {
-				// Skip bytes even with pipes
-				for (uint16_t i = 0; i < section->size; i++)
-					getc(overlayFile);
+				// Skip bytes even with pipes, by reading them where the section will go
+				fread(&bank[offset], 1, section->size, overlayFile);
+			}
+			if (!section->data.empty()) {
+				memcpy(&bank[offset], section->data.data(), section->size);
+			} else {
+				// With `--low-memory`, the data is only now read back from the object files
+				for (Section const *component = section; component;
+				     component = component->nextu.get())
+					obj_DecodeData(component->encodedData, &bank[offset + component->offset]);
+				patch_ApplySectionPatches(*section, &bank[offset]);
 			}
 			offset += section->size;
 		}
 	}
 
-	if (!disablePadding) {
-		while (offset < size) {
-			putc(getNextFillByte(), outputFile);
-			offset++;
-		}
+	if (!disablePadding && offset < size) {
+		fillBytes(&bank[offset], size - offset);
+		offset = size;
 	}
+
+	outputBank(bank.data(), offset);
 }
 
 // Writes a ROM file to the output.
@@ -237,6 +422,11 @@ static void writeROM() {
 		coverOverlayBanks(nbOverlayBanks);
 
 	if (outputFile) {
+		isFixingHeader = headerTitle || headerMBC != UNSPECIFIED || headerRAMSize != UNSPECIFIED
+		                 || fixHeaderSums || headerPadValue != UNSPECIFIED;
+		// Pipes cannot be rewound, so the ROM must be kept until its header is fixed
+		isBufferingROM = isFixingHeader && fseek(outputFile, 0, SEEK_CUR) != 0;
+
 		writeBank(
 		    !sections[SECTTYPE_ROM0].empty() ? &sections[SECTTYPE_ROM0][0].sections : nullptr,
 		    sectionTypeInfo[SECTTYPE_ROM0].startAddr,
@@ -249,6 +439,9 @@ static void writeROM() {
 			    sectionTypeInfo[SECTTYPE_ROMX].startAddr,
 			    sectionTypeInfo[SECTTYPE_ROMX].size
 			);
+
+		if (isFixingHeader)
+			fixHeader();
 	}
 }
 
@@ -263,37 +456,81 @@ static bool isLegalForSymName(char c) {
 	       || c == '@' || c == '#' || c == '$' || c == '.';
 }
 
-// Prints a symbol's name to `symFile`, assuming that the first character is legal.
+// Appends `value` in lowercase hexadecimal, zero-padded to at least `minDigits` digits
+static void putHex(std::string &buf, uint32_t value, unsigned minDigits) {
+	char digits[8];
+	unsigned nbDigits = 0;
+
+	do {
+		digits[nbDigits++] = "0123456789abcdef"[value & 0xF];
+		value >>= 4;
+	} while (value != 0);
+	buf.append(minDigits > nbDigits ? minDigits - nbDigits : 0, '0');
+	while (nbDigits != 0)
+		buf.push_back(digits[--nbDigits]);
+}
+
+// Appends formatted text, for the lines that are not worth formatting by hand
+[[gnu::format(printf, 2, 3)]] static void putFormatted(std::string &buf, char const *fmt, ...) {
+	char text[128];
+	va_list args;
+
+	va_start(args, fmt);
+	int len = vsnprintf(text, sizeof(text), fmt, args);
+	va_end(args);
+	assume(len >= 0);
+	if ((size_t)len < sizeof(text)) {
+		buf.append(text, len);
+		return;
+	}
+
+	// Section names can make the text as long as they are
+	size_t oldSize = buf.size();
+
+	buf.resize(oldSize + len + 1);
+	va_start(args, fmt);
+	vsnprintf(&buf[oldSize], len + 1, fmt, args);
+	va_end(args);
+	buf.resize(oldSize + len);
+}
+
+// Appends a symbol's name, assuming that the first character is legal.
 // Illegal characters are UTF-8-decoded (errors are replaced by U+FFFD) and emitted as `\u`/`\U`.
-static void printSymName(char const *name) {
+static void printSymName(std::string &buf, char const *name) {
 	for (char const *ptr = name; *ptr != '\0';) {
-		char c = *ptr;
-
-		if (isLegalForSymName(c)) {
-			// Output legal ASCII characters as-is
-			putc(c, symFile);
+		// Output legal ASCII characters as-is, as many at once as possible
+		char const *legalEnd = ptr;
+
+		while (isLegalForSymName(*legalEnd))
+			++legalEnd;
+		buf.append(ptr, legalEnd);
+		ptr = legalEnd;
+		if (*ptr == '\0')
+			break;
+
+		// Output illegal characters using Unicode escapes
+		// Decode the UTF-8 codepoint; or at least attempt to
+		uint32_t state = 0, codepoint;
+		char const *seqStart = ptr;
+
+		do {
+			decode(&state, &codepoint, *ptr);
+			if (state == 1) {
+				// This sequence was invalid; emit a U+FFFD, and recover
+				codepoint = 0xFFFD;
+				// Skip the invalid byte if it began the sequence (e.g. $FF), then continuation
+				// bytes; a NUL byte does not qualify, so we're good
+				if (ptr == seqStart)
+					++ptr;
+				while ((*ptr & 0xC0) == 0x80)
+					++ptr;
+				break;
+			}
 			++ptr;
-		} else {
-			// Output illegal characters using Unicode escapes
-			// Decode the UTF-8 codepoint; or at least attempt to
-			uint32_t state = 0, codepoint;
-
-			do {
-				decode(&state, &codepoint, *ptr);
-				if (state == 1) {
-					// This sequence was invalid; emit a U+FFFD, and recover
-					codepoint = 0xFFFD;
-					// Skip continuation bytes
-					// A NUL byte does not qualify, so we're good
-					while ((*ptr & 0xC0) == 0x80)
-						++ptr;
-					break;
-				}
-				++ptr;
-			} while (state != 0);
+		} while (state != 0);
 
-			fprintf(symFile, codepoint <= 0xFFFF ? "\\u%04" PRIx32 : "\\U%08" PRIx32, codepoint);
-		}
+		buf.append(codepoint <= 0xFFFF ? "\\u" : "\\U");
+		putHex(buf, codepoint, codepoint <= 0xFFFF ? 4 : 8);
 	}
 }
 
@@ -326,9 +563,12 @@ static bool compareSymbols(SortedSymbol const &sym1, SortedSymbol const &sym2) {
 
 /*
  * Write a bank's contents to the sym file
+ * @param buf Where to append the bank's lines of the sym file
  * @param bankSections The bank's sections
  */
-static void writeSymBank(SortedSections const &bankSections, SectionType type, uint32_t bank) {
+static void writeSymBank(
+    std::string &buf, SortedSections const &bankSections, SectionType type, uint32_t bank
+) {
 #define forEachSortedSection(sect, ...) \
 	do { \
 		for (auto it = bankSections.zeroLenSections.begin(); \
@@ -372,18 +612,21 @@ static void writeSymBank(SortedSections const &bankSections, SectionType type, u
 	uint32_t symBank = bank + sectionTypeInfo[type].firstBank;
 
 	for (SortedSymbol &sym : symList) {
-		fprintf(symFile, "%02" PRIx32 ":%04" PRIx16 " ", symBank, sym.addr);
-		printSymName(sym.sym->name.c_str());
-		putc('\n', symFile);
+		putHex(buf, symBank, 2);
+		buf.push_back(':');
+		putHex(buf, sym.addr, 4);
+		buf.push_back(' ');
+		printSymName(buf, sym.sym->name.c_str());
+		buf.push_back('\n');
 	}
 }
 
-static void writeEmptySpace(uint16_t begin, uint16_t end) {
+static void writeEmptySpace(std::string &buf, uint16_t begin, uint16_t end) {
 	if (begin < end) {
 		uint16_t len = end - begin;
 
-		fprintf(
-		    mapFile,
+		putFormatted(
+		    buf,
 		    "\tEMPTY: $%04x-$%04x ($%04" PRIx16 " byte%s)\n",
 		    begin,
 		    end - 1,
@@ -395,10 +638,13 @@ static void writeEmptySpace(uint16_t begin, uint16_t end) {
 
 /*
  * Write a bank's contents to the map file
+ * @param buf Where to append the bank's lines of the map file
  */
-static void writeMapBank(SortedSections const &sectList, SectionType type, uint32_t bank) {
-	fprintf(
-	    mapFile,
+static void writeMapBank(
+    std::string &buf, SortedSections const &sectList, SectionType type, uint32_t bank
+) {
+	putFormatted(
+	    buf,
 	    "\n%s bank #%" PRIu32 ":\n",
 	    sectionTypeInfo[type].name.c_str(),
 	    bank + sectionTypeInfo[type].firstBank
@@ -420,46 +666,42 @@ static void writeMapBank(SortedSections const &sectList, SectionType type, uint3
 		used += sect->size;
 		assume(sect->offset == 0);
 
-		writeEmptySpace(prevEndAddr, sect->org);
+		writeEmptySpace(buf, prevEndAddr, sect->org);
 
 		prevEndAddr = sect->org + sect->size;
 
-		if (sect->size != 0)
-			fprintf(
-			    mapFile,
-			    "\tSECTION: $%04" PRIx16 "-$%04x ($%04" PRIx16 " byte%s) [\"%s\"]\n",
-			    sect->org,
-			    prevEndAddr - 1,
-			    sect->size,
-			    sect->size == 1 ? "" : "s",
-			    sect->name.c_str()
-			);
-		else
-			fprintf(
-			    mapFile,
-			    "\tSECTION: $%04" PRIx16 " (0 bytes) [\"%s\"]\n",
-			    sect->org,
-			    sect->name.c_str()
-			);
+		buf.append("\tSECTION: $");
+		putHex(buf, sect->org, 4);
+		if (sect->size != 0) {
+			buf.append("-$");
+			putHex(buf, prevEndAddr - 1, 4);
+			buf.append(" ($");
+			putHex(buf, sect->size, 4);
+			buf.append(sect->size == 1 ? " byte) [\"" : " bytes) [\"");
+		} else {
+			buf.append(" (0 bytes) [\"");
+		}
+		buf.append(sect->name);
+		buf.append("\"]\n");
 
 		if (!noSymInMap) {
 			// Also print symbols in the following "pieces"
 			for (uint16_t org = sect->org; sect; sect = sect->nextu.get()) {
-				for (Symbol *sym : sect->symbols)
+				for (Symbol *sym : sect->symbols) {
 					// Space matches "\tSECTION: $xxxx ..."
-					fprintf(
-					    mapFile,
-					    "\t         $%04" PRIx32 " = %s\n",
-					    sym->label().offset + org,
-					    sym->name.c_str()
-					);
+					buf.append("\t         $");
+					putHex(buf, sym->label().offset + org, 4);
+					buf.append(" = ");
+					buf.append(sym->name);
+					buf.push_back('\n');
+				}
 
 				if (sect->nextu) {
 					// Announce the following "piece"
 					if (sect->nextu->modifier == SECTION_UNION)
-						fprintf(mapFile, "\t         ; Next union\n");
+						buf.append("\t         ; Next union\n");
 					else if (sect->nextu->modifier == SECTION_FRAGMENT)
-						fprintf(mapFile, "\t         ; Next fragment\n");
+						buf.append("\t         ; Next fragment\n");
 				}
 			}
 		}
@@ -468,23 +710,23 @@ static void writeMapBank(SortedSections const &sectList, SectionType type, uint3
 	}
 
 	if (used == 0) {
-		fputs("\tEMPTY\n", mapFile);
+		buf.append("\tEMPTY\n");
 	} else {
 		uint16_t bankEndAddr = sectionTypeInfo[type].startAddr + sectionTypeInfo[type].size;
 
-		writeEmptySpace(prevEndAddr, bankEndAddr);
+		writeEmptySpace(buf, prevEndAddr, bankEndAddr);
 
 		uint16_t slack = sectionTypeInfo[type].size - used;
 
-		fprintf(mapFile, "\tTOTAL EMPTY: $%04" PRIx16 " byte%s\n", slack, slack == 1 ? "" : "s");
+		putFormatted(buf, "\tTOTAL EMPTY: $%04" PRIx16 " byte%s\n", slack, slack == 1 ? "" : "s");
 	}
 }
 
 /*
  * Write the total used and free space by section type to the map file
  */
-static void writeMapSummary() {
-	fputs("SUMMARY:\n", mapFile);
+static void writeMapSummary(std::string &buf) {
+	buf.append("SUMMARY:\n");
 
 	for (uint8_t i = 0; i < SECTTYPE_INVALID; i++) {
 		SectionType type = typeMap[i];
@@ -521,8 +763,8 @@ static void writeMapSummary() {
 			usedTotal += used;
 		}
 
-		fprintf(
-		    mapFile,
+		putFormatted(
+		    buf,
 		    "\t%s: %" PRId32 " byte%s used / %" PRId32 " free",
 		    sectionTypeInfo[type].name.c_str(),
 		    usedTotal,
@@ -530,63 +772,112 @@ static void writeMapSummary() {
 		    nbBanks * sectionTypeInfo[type].size - usedTotal
 		);
 		if (sectionTypeInfo[type].firstBank != sectionTypeInfo[type].lastBank || nbBanks > 1)
-			fprintf(mapFile, " in %u bank%s", nbBanks, nbBanks == 1 ? "" : "s");
-		putc('\n', mapFile);
+			putFormatted(buf, " in %u bank%s", nbBanks, nbBanks == 1 ? "" : "s");
+		buf.push_back('\n');
 	}
 }
 
-// Writes the sym file, if applicable.
-static void writeSym() {
-	if (!symFileName)
-		return;
+// A bank's part of the sym or map file
+struct BankOutput {
+	bool isMap;
+	SectionType type;
+	uint32_t bank;
+	std::string contents;
+};
 
-	if (strcmp(symFileName, "-")) {
-		symFile = fopen(symFileName, "w");
-	} else {
-		symFileName = "<stdout>";
-		symFile = fdopen(STDOUT_FILENO, "w");
+/*
+ * Formats the sym and map files, if applicable.
+ * Each bank is formatted on its own, so that up to `nbThreads` threads can share them.
+ */
+static void
+    formatSymAndMap(std::string &symContents, std::string &mapContents, unsigned nbThreads) {
+	std::vector<BankOutput> bankOutputs;
+
+	for (bool isMap : {false, true}) {
+		if (!(isMap ? mapFileName : symFileName))
+			continue;
+		for (uint8_t i = 0; i < SECTTYPE_INVALID; i++) {
+			SectionType type = typeMap[i];
+
+			for (uint32_t bank = 0; bank < sections[type].size(); bank++)
+				bankOutputs.push_back({.isMap = isMap, .type = type, .bank = bank, .contents = {}});
+		}
 	}
-	if (!symFile)
-		err("Failed to open sym file \"%s\"", symFileName);
-	Defer closeSymFile{[&] { fclose(symFile); }};
 
-	fputs("; File generated by rgblink\n", symFile);
+	auto formatBank = [](BankOutput &output) {
+		SortedSections const &bankSections = sections[output.type][output.bank];
 
-	for (uint8_t i = 0; i < SECTTYPE_INVALID; i++) {
-		SectionType type = typeMap[i];
+		if (output.isMap)
+			writeMapBank(output.contents, bankSections, output.type, output.bank);
+		else
+			writeSymBank(output.contents, bankSections, output.type, output.bank);
+	};
 
-		for (uint32_t bank = 0; bank < sections[type].size(); bank++)
-			writeSymBank(sections[type][bank], type, bank);
+	if (nbThreads <= 1) {
+		for (BankOutput &output : bankOutputs)
+			formatBank(output);
+	} else {
+		std::atomic_size_t nextBank = 0;
+		std::vector<std::thread> workers;
+
+		for (unsigned i = 0; i < nbThreads && i < bankOutputs.size(); i++) {
+			workers.emplace_back([&] {
+				for (size_t j; (j = nextBank++) < bankOutputs.size();)
+					formatBank(bankOutputs[j]);
+			});
+		}
+		for (std::thread &worker : workers)
+			worker.join();
 	}
+
+	if (symFileName)
+		symContents = "; File generated by rgblink\n";
+	if (mapFileName)
+		writeMapSummary(mapContents);
+	for (BankOutput const &output : bankOutputs)
+		(output.isMap ? mapContents : symContents).append(output.contents);
 }
 
-// Writes the map file, if applicable.
-static void writeMap() {
-	if (!mapFileName)
+/*
+ * Writes a formatted text file, if applicable.
+ * @param fileName The file's path, or "-" for standard output
+ * @param what What the file is, for error messages
+ * @param contents What to write to the file
+ */
+static void writeTextFile(char const *&fileName, char const *what, std::string const &contents) {
+	if (!fileName)
 		return;
 
-	if (strcmp(mapFileName, "-")) {
-		mapFile = fopen(mapFileName, "w");
+	FILE *file;
+
+	if (strcmp(fileName, "-")) {
+		file = fopen(fileName, "w");
 	} else {
-		mapFileName = "<stdout>";
-		mapFile = fdopen(STDOUT_FILENO, "w");
+		fileName = "<stdout>";
+		file = fdopen(STDOUT_FILENO, "w");
 	}
-	if (!mapFile)
-		err("Failed to open map file \"%s\"", mapFileName);
-	Defer closeMapFile{[&] { fclose(mapFile); }};
-
-	writeMapSummary();
-
-	for (uint8_t i = 0; i < SECTTYPE_INVALID; i++) {
-		SectionType type = typeMap[i];
+	if (!file)
+		err("Failed to open %s file \"%s\"", what, fileName);
+	Defer closeFile{[&] { fclose(file); }};
 
-		for (uint32_t bank = 0; bank < sections[type].size(); bank++)
-			writeMapBank(sections[type][bank], type, bank);
-	}
+	fwrite(contents.data(), 1, contents.size(), file);
 }
 
 void out_WriteFiles() {
-	writeROM();
-	writeSym();
-	writeMap();
+	std::string symContents, mapContents;
+
+	if (nbJobs <= 1) {
+		writeROM();
+		formatSymAndMap(symContents, mapContents, 1);
+	} else {
+		// The sym and map files are formatted while the ROM is written
+		std::thread formatter(
+		    formatSymAndMap, std::ref(symContents), std::ref(mapContents), nbJobs - 1
+		);
+
+		writeROM();
+		formatter.join();
+	}
+	writeTextFile(symFileName, "sym", symContents);
+	writeTextFile(mapFileName, "map", mapContents);
 }
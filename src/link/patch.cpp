@@ -4,10 +4,15 @@
 
 #include <deque>
 #include <inttypes.h>
+#include <span>
 #include <stdint.h>
+#include <string.h>
+#include <string_view>
+#include <unordered_map>
 #include <variant>
 #include <vector>
 
+#include "diagnostics.hpp"
 #include "helpers.hpp" // assume
 #include "linkdefs.hpp"
 #include "opmath.hpp"
@@ -23,23 +28,41 @@ struct RPNStackEntry {
 	bool errorFlag; // Whether the value is a placeholder inserted for error recovery
 };
 
-std::deque<RPNStackEntry> rpnStack;
+// The top of the stack is at the back; the storage is reused by every expression
+static thread_local std::vector<RPNStackEntry> rpnStack;
 
 static void pushRPN(int32_t value, bool comesFromError) {
-	rpnStack.push_front({.value = value, .errorFlag = comesFromError});
+	rpnStack.push_back({.value = value, .errorFlag = comesFromError});
 }
 
 // This flag tracks whether the RPN op that is currently being evaluated
 // has popped any values with the error flag set.
-static bool isError = false;
+static thread_local bool isError = false;
+
+// Diagnostics are already reported when a section's patches are checked, and not again when they
+// are applied to its data, so this flag silences them then.
+static thread_local bool isQuiet = false;
+
+#define patchError(...) \
+	do { \
+		if (!isQuiet) \
+			error(__VA_ARGS__); \
+	} while (0)
+
+static void internalError(Patch const &patch, char const *message) {
+	if (!isQuiet)
+		fatal(patch.src, patch.lineNo, "Internal error, %s", message);
+}
 
 static int32_t popRPN(Patch const &patch) {
-	if (rpnStack.empty())
-		fatal(patch.src, patch.lineNo, "Internal error, RPN stack empty");
+	if (rpnStack.empty()) {
+		internalError(patch, "RPN stack empty");
+		return 0;
+	}
 
-	RPNStackEntry entry = rpnStack.front();
+	RPNStackEntry entry = rpnStack.back();
 
-	rpnStack.pop_front();
+	rpnStack.pop_back();
 	isError |= entry.errorFlag;
 	return entry.value;
 }
@@ -47,19 +70,57 @@ static int32_t popRPN(Patch const &patch) {
 // RPN operators
 
 static uint32_t getRPNByte(uint8_t const *&expression, int32_t &size, Patch const &patch) {
-	if (!size--)
-		fatal(patch.src, patch.lineNo, "Internal error, RPN expression overread");
+	if (!size--) {
+		internalError(patch, "RPN expression overread");
+		return 0;
+	}
 
 	return *expression++;
 }
 
+static int32_t getRPNLong(uint8_t const *&expression, int32_t &size, Patch const &patch) {
+	if (size < 4) {
+		internalError(patch, "RPN expression overread");
+		size = 0;
+		return 0;
+	}
+
+	uint32_t value = expression[0] | expression[1] << 8 | expression[2] << 16
+	                 | (uint32_t)expression[3] << 24;
+
+	expression += 4;
+	size -= 4;
+	return value;
+}
+
+static char const *getRPNString(uint8_t const *&expression, int32_t &size, Patch const &patch) {
+	// `expression` is not guaranteed to be '\0'-terminated
+	uint8_t const *end = (uint8_t const *)memchr(expression, '\0', size);
+
+	if (!end) {
+		internalError(patch, "RPN expression overread");
+		size = 0;
+		return "";
+	}
+
+	char const *str = (char const *)expression;
+
+	size -= end + 1 - expression;
+	expression = end + 1;
+	return str;
+}
+
+// The sections named by RPN expressions, in the order they appear, so that evaluating the
+// expressions does not need to look them up by name every time; see `patch_ResolveSectionRefs`
+static std::vector<Section const *> sectionRefs;
+
 static Symbol const *getSymbol(std::vector<Symbol> const &symbolList, uint32_t index) {
 	assume(index != (uint32_t)-1); // PC needs to be handled specially, not here
 	Symbol const &symbol = symbolList[index];
 
 	// If the symbol is defined elsewhere...
 	if (symbol.type == SYMTYPE_IMPORT)
-		return sym_GetSymbol(symbol.name);
+		return symbol.definition;
 
 	return &symbol;
 }
@@ -75,6 +136,7 @@ static Symbol const *getSymbol(std::vector<Symbol> const &symbolList, uint32_t i
 static int32_t computeRPNExpr(Patch const &patch, std::vector<Symbol> const &fileSymbols) {
 	uint8_t const *expression = patch.rpnExpression.data();
 	int32_t size = (int32_t)patch.rpnExpression.size();
+	uint32_t nextSectionRef = patch.firstSectionRef;
 
 	rpnStack.clear();
 
@@ -103,7 +165,7 @@ static int32_t computeRPNExpr(Patch const &patch, std::vector<Symbol> const &fil
 			value = popRPN(patch);
 			if (value == 0) {
 				if (!isError)
-					error(patch.src, patch.lineNo, "Division by 0");
+					patchError(patch.src, patch.lineNo, "Division by 0");
 				isError = true;
 				popRPN(patch);
 				value = INT32_MAX;
@@ -115,7 +177,7 @@ static int32_t computeRPNExpr(Patch const &patch, std::vector<Symbol> const &fil
 			value = popRPN(patch);
 			if (value == 0) {
 				if (!isError)
-					error(patch.src, patch.lineNo, "Modulo by 0");
+					patchError(patch.src, patch.lineNo, "Modulo by 0");
 				isError = true;
 				popRPN(patch);
 				value = 0;
@@ -130,7 +192,7 @@ static int32_t computeRPNExpr(Patch const &patch, std::vector<Symbol> const &fil
 			value = popRPN(patch);
 			if (value < 0) {
 				if (!isError)
-					error(patch.src, patch.lineNo, "Exponent by negative");
+					patchError(patch.src, patch.lineNo, "Exponent by negative");
 				isError = true;
 				popRPN(patch);
 				value = 0;
@@ -201,12 +263,10 @@ static int32_t computeRPNExpr(Patch const &patch, std::vector<Symbol> const &fil
 			break;
 
 		case RPN_BANK_SYM:
-			value = 0;
-			for (uint8_t shift = 0; shift < 32; shift += 8)
-				value |= getRPNByte(expression, size, patch) << shift;
+			value = getRPNLong(expression, size, patch);
 
 			if (Symbol const *symbol = getSymbol(fileSymbols, value); !symbol) {
-				error(
+				patchError(
 				    patch.src,
 				    patch.lineNo,
 				    "Requested BANK() of symbol \"%s\", which was not found",
@@ -217,7 +277,7 @@ static int32_t computeRPNExpr(Patch const &patch, std::vector<Symbol> const &fil
 			} else if (auto *label = std::get_if<Label>(&symbol->data); label) {
 				value = label->section->bank;
 			} else {
-				error(
+				patchError(
 				    patch.src,
 				    patch.lineNo,
 				    "Requested BANK() of non-label symbol \"%s\"",
@@ -229,14 +289,10 @@ static int32_t computeRPNExpr(Patch const &patch, std::vector<Symbol> const &fil
 			break;
 
 		case RPN_BANK_SECT: {
-			// `expression` is not guaranteed to be '\0'-terminated. If it is not,
-			// `getRPNByte` will have a fatal internal error.
-			char const *name = (char const *)expression;
-			while (getRPNByte(expression, size, patch))
-				;
+			char const *name = getRPNString(expression, size, patch);
 
-			if (Section const *sect = sect_GetSection(name); !sect) {
-				error(
+			if (Section const *sect = sectionRefs[nextSectionRef++]; !sect) {
+				patchError(
 				    patch.src,
 				    patch.lineNo,
 				    "Requested BANK() of section \"%s\", which was not found",
@@ -252,7 +308,7 @@ static int32_t computeRPNExpr(Patch const &patch, std::vector<Symbol> const &fil
 
 		case RPN_BANK_SELF:
 			if (!patch.pcSection) {
-				error(patch.src, patch.lineNo, "PC has no bank outside a section");
+				patchError(patch.src, patch.lineNo, "PC has no bank outside a section");
 				isError = true;
 				value = 1;
 			} else {
@@ -261,13 +317,10 @@ static int32_t computeRPNExpr(Patch const &patch, std::vector<Symbol> const &fil
 			break;
 
 		case RPN_SIZEOF_SECT: {
-			// This has assumptions commented in the `RPN_BANK_SECT` case above.
-			char const *name = (char const *)expression;
-			while (getRPNByte(expression, size, patch))
-				;
+			char const *name = getRPNString(expression, size, patch);
 
-			if (Section const *sect = sect_GetSection(name); !sect) {
-				error(
+			if (Section const *sect = sectionRefs[nextSectionRef++]; !sect) {
+				patchError(
 				    patch.src,
 				    patch.lineNo,
 				    "Requested SIZEOF() of section \"%s\", which was not found",
@@ -282,13 +335,10 @@ static int32_t computeRPNExpr(Patch const &patch, std::vector<Symbol> const &fil
 		}
 
 		case RPN_STARTOF_SECT: {
-			// This has assumptions commented in the `RPN_BANK_SECT` case above.
-			char const *name = (char const *)expression;
-			while (getRPNByte(expression, size, patch))
-				;
+			char const *name = getRPNString(expression, size, patch);
 
-			if (Section const *sect = sect_GetSection(name); !sect) {
-				error(
+			if (Section const *sect = sectionRefs[nextSectionRef++]; !sect) {
+				patchError(
 				    patch.src,
 				    patch.lineNo,
 				    "Requested STARTOF() of section \"%s\", which was not found",
@@ -306,7 +356,7 @@ static int32_t computeRPNExpr(Patch const &patch, std::vector<Symbol> const &fil
 		case RPN_SIZEOF_SECTTYPE:
 			value = getRPNByte(expression, size, patch);
 			if (value < 0 || value >= SECTTYPE_INVALID) {
-				error(patch.src, patch.lineNo, "Requested SIZEOF() an invalid section type");
+				patchError(patch.src, patch.lineNo, "Requested SIZEOF() an invalid section type");
 				isError = true;
 				value = 0;
 			} else {
@@ -317,7 +367,7 @@ static int32_t computeRPNExpr(Patch const &patch, std::vector<Symbol> const &fil
 		case RPN_STARTOF_SECTTYPE:
 			value = getRPNByte(expression, size, patch);
 			if (value < 0 || value >= SECTTYPE_INVALID) {
-				error(patch.src, patch.lineNo, "Requested STARTOF() an invalid section type");
+				patchError(patch.src, patch.lineNo, "Requested STARTOF() an invalid section type");
 				isError = true;
 				value = 0;
 			} else {
@@ -328,7 +378,9 @@ static int32_t computeRPNExpr(Patch const &patch, std::vector<Symbol> const &fil
 		case RPN_HRAM:
 			value = popRPN(patch);
 			if (!isError && (value < 0 || (value > 0xFF && value < 0xFF00) || value > 0xFFFF)) {
-				error(patch.src, patch.lineNo, "Value %" PRId32 " is not in HRAM range", value);
+				patchError(
+				    patch.src, patch.lineNo, "Value %" PRId32 " is not in HRAM range", value
+				);
 				isError = true;
 			}
 			value &= 0xFF;
@@ -340,26 +392,24 @@ static int32_t computeRPNExpr(Patch const &patch, std::vector<Symbol> const &fil
 			// They can be easily checked with a bitmask
 			if (value & ~0x38) {
 				if (!isError)
-					error(patch.src, patch.lineNo, "Value %" PRId32 " is not a RST vector", value);
+					patchError(
+					    patch.src, patch.lineNo, "Value %" PRId32 " is not a RST vector", value
+					);
 				isError = true;
 			}
 			value |= 0xC7;
 			break;
 
 		case RPN_CONST:
-			value = 0;
-			for (uint8_t shift = 0; shift < 32; shift += 8)
-				value |= getRPNByte(expression, size, patch) << shift;
+			value = getRPNLong(expression, size, patch);
 			break;
 
 		case RPN_SYM:
-			value = 0;
-			for (uint8_t shift = 0; shift < 32; shift += 8)
-				value |= getRPNByte(expression, size, patch) << shift;
+			value = getRPNLong(expression, size, patch);
 
 			if (value == -1) { // PC
 				if (!patch.pcSection) {
-					error(patch.src, patch.lineNo, "PC has no value outside a section");
+					patchError(patch.src, patch.lineNo, "PC has no value outside a section");
 					value = 0;
 					isError = true;
 				} else {
@@ -367,7 +417,7 @@ static int32_t computeRPNExpr(Patch const &patch, std::vector<Symbol> const &fil
 				}
 			} else {
 				if (Symbol const *symbol = getSymbol(fileSymbols, value); !symbol) {
-					error(
+					patchError(
 					    patch.src,
 					    patch.lineNo,
 					    "Unknown symbol \"%s\"",
@@ -388,12 +438,67 @@ static int32_t computeRPNExpr(Patch const &patch, std::vector<Symbol> const &fil
 	}
 
 	if (rpnStack.size() > 1)
-		error(patch.src, patch.lineNo, "RPN stack has %zu entries on exit, not 1", rpnStack.size());
+		patchError(
+		    patch.src, patch.lineNo, "RPN stack has %zu entries on exit, not 1", rpnStack.size()
+		);
 
 	isError = false;
 	return popRPN(patch);
 }
 
+// Names are memoized without copying them, since the same few are usually referred to many times
+static std::unordered_map<std::string_view, Section const *> resolvedNames;
+
+static void resolveSectionRefs(Patch &patch) {
+	std::span<uint8_t const> rpn = patch.rpnExpression;
+
+	patch.firstSectionRef = sectionRefs.size();
+	// This must read the expression exactly like `computeRPNExpr` does
+	for (size_t i = 0; i < rpn.size();) {
+		switch (rpn[i++]) {
+		case RPN_BANK_SECT:
+		case RPN_SIZEOF_SECT:
+		case RPN_STARTOF_SECT: {
+			char const *name = (char const *)&rpn.data()[i];
+			char const *end = (char const *)memchr(name, '\0', rpn.size() - i);
+
+			// Overreads are reported when evaluating, which then looks up an empty name
+			std::string_view nameView = end ? std::string_view(name, end - name) : "";
+			auto [search, isNew] = resolvedNames.emplace(nameView, nullptr);
+			if (isNew)
+				search->second = sect_GetSection(std::string(nameView));
+			sectionRefs.push_back(search->second);
+			i = end ? end + 1 - (char const *)rpn.data() : rpn.size();
+			break;
+		}
+		case RPN_SIZEOF_SECTTYPE:
+		case RPN_STARTOF_SECTTYPE:
+			i++;
+			break;
+		case RPN_CONST:
+		case RPN_SYM:
+		case RPN_BANK_SYM:
+			i += 4;
+			break;
+		}
+	}
+}
+
+static void resolveSectionPatchRefs(Section &section) {
+	for (Section *component = &section; component; component = component->nextu.get()) {
+		for (Patch &patch : component->patches)
+			resolveSectionRefs(patch);
+	}
+}
+
+void patch_ResolveSectionRefs() {
+	sectionRefs.clear();
+	for (Assertion &assert : assertions)
+		resolveSectionRefs(assert.patch);
+	sect_ForEach(resolveSectionPatchRefs);
+	resolvedNames.clear();
+}
+
 void patch_CheckAssertions() {
 	verbosePrint("Checking assertions...\n");
 
@@ -442,11 +547,12 @@ void patch_CheckAssertions() {
 /*
  * Applies all of a section's patches
  * @param section The section component to patch
- * @param dataSection The section to patch
+ * @param data The data of the section to patch, or `nullptr` to only check the patches
  */
-static void applyFilePatches(Section &section, Section &dataSection) {
-	verbosePrint("Patching section \"%s\"...\n", section.name.c_str());
-	for (Patch &patch : section.patches) {
+static void applyFilePatches(Section const &section, uint8_t *data) {
+	if (!isQuiet)
+		verbosePrint("Patching section \"%s\"...\n", section.name.c_str());
+	for (Patch const &patch : section.patches) {
 		int32_t value = computeRPNExpr(patch, *section.fileSymbols);
 		uint16_t offset = patch.offset + section.offset;
 
@@ -458,14 +564,15 @@ static void applyFilePatches(Section &section, Section &dataSection) {
 			int16_t jumpOffset = value - address;
 
 			if (!isError && (jumpOffset < -128 || jumpOffset > 127))
-				error(
+				patchError(
 				    patch.src,
 				    patch.lineNo,
 				    "jr target must be between -128 and 127 bytes away, not %" PRId16
 				    "; use jp instead\n",
 				    jumpOffset
 				);
-			dataSection.data[offset] = jumpOffset & 0xFF;
+			if (data)
+				data[offset] = jumpOffset & 0xFF;
 		} else {
 			// Patch a certain number of bytes
 			struct {
@@ -479,7 +586,7 @@ static void applyFilePatches(Section &section, Section &dataSection) {
 			};
 
 			if (!isError && (value < types[patch.type].min || value > types[patch.type].max))
-				error(
+				patchError(
 				    patch.src,
 				    patch.lineNo,
 				    "Value %" PRId32 "%s is not %u-bit",
@@ -487,8 +594,8 @@ static void applyFilePatches(Section &section, Section &dataSection) {
 				    value < 0 ? " (maybe negative?)" : "",
 				    types[patch.type].size * 8U
 				);
-			for (uint8_t i = 0; i < types[patch.type].size; i++) {
-				dataSection.data[offset + i] = value & 0xFF;
+			for (uint8_t i = 0; data && i < types[patch.type].size; i++) {
+				data[offset + i] = value & 0xFF;
 				value >>= 8;
 			}
 		}
@@ -503,10 +610,38 @@ static void applyPatches(Section &section) {
 	if (!sect_HasData(section.type))
 		return;
 
+	// With `--low-memory`, the data is only patched when written out, but errors are reported now
+	uint8_t *data = !section.data.empty() ? section.data.data() : nullptr;
+
 	for (Section *component = &section; component; component = component->nextu.get())
-		applyFilePatches(*component, section);
+		applyFilePatches(*component, data);
+}
+
+static std::vector<Section *> sectionsToPatch;
+
+static void registerSection(Section &section) {
+	sectionsToPatch.push_back(&section);
 }
 
 void patch_ApplyPatches() {
-	sect_ForEach(applyPatches);
+	if (nbJobs <= 1) {
+		sect_ForEach(applyPatches);
+		return;
+	}
+
+	// Sections only write to their own data, so they can be patched in any order
+	sect_ForEach(registerSection);
+	verbosePrint("Patching %zu sections using %u threads...\n", sectionsToPatch.size(), nbJobs);
+
+	diag_RunTasks(sectionsToPatch.size(), nbJobs, [](size_t i) {
+		applyPatches(*sectionsToPatch[i]);
+	});
+}
+
+void patch_ApplySectionPatches(Section const &section, uint8_t *data) {
+	// The patches were already checked, and their diagnostics reported
+	isQuiet = true;
+	for (Section const *component = &section; component; component = component->nextu.get())
+		applyFilePatches(*component, data);
+	isQuiet = false;
 }
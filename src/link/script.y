@@ -618,6 +618,7 @@ static void placeSection(std::string const &name, bool isOptional) {
 	}
 	section->isBankFixed = true;
 	section->bank = bank;
+	section->isPlacedByScript = true;
 
 	if (!isPcFloating) {
 		uint16_t &org = curAddr[activeType][activeBankIdx];
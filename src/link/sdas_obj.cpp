@@ -2,13 +2,21 @@
 
 #include "link/sdas_obj.hpp"
 
+#include <algorithm>
+#include <charconv>
 #include <ctype.h>
+#include <deque>
 #include <inttypes.h>
 #include <memory>
+#include <stdarg.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <string.h>
+#include <string>
+#include <string_view>
 #include <tuple>
 #include <variant>
+#include <vector>
 
 #include "helpers.hpp" // assume
 #include "linkdefs.hpp"
@@ -25,91 +33,93 @@ enum NumberType {
 	OCT = 8,  // Q
 };
 
-static void consumeLF(FileStackNode const &where, uint32_t lineNo, FILE *file) {
-	if (getc(file) != '\n')
-		fatal(&where, lineNo, "Bad line ending (CR without LF)");
-}
-
-static char const *delim = " \f\n\r\t\v"; // Whitespace according to the C and POSIX locales
+static constexpr std::string_view delim = " \f\n\r\t\v"; // Whitespace according to the C locale
 
-static int
-    nextLine(std::vector<char> &lineBuf, uint32_t &lineNo, FileStackNode const &where, FILE *file) {
-retry:
-	++lineNo;
-	int firstChar = getc(file);
+// A SDCC object file's lines, read from its contents in memory
+struct LineReader {
+	char const *ptr;
+	char const *end;
+	FileStackNode const &where;
+	uint32_t lineNo = 0;
 
-	switch (firstChar) {
-	case EOF:
-		return EOF;
-	case ';':
-		// Discard comment line
-		// TODO: if `;!FILE [...]` on the first line (`lineNo`), return it
-		do {
-			firstChar = getc(file);
-		} while (firstChar != EOF && firstChar != '\r' && firstChar != '\n');
-		[[fallthrough]];
-	case '\r':
-		if (firstChar == '\r' && getc(file) != '\n')
-			consumeLF(where, lineNo, file);
-		[[fallthrough]];
-	case '\n':
-		goto retry;
-	}
+	// Returns the next line's type (its first char), or EOF; `rest` is set to the rest of the line
+	int nextLine(std::string_view &rest);
+};
 
+int LineReader::nextLine(std::string_view &rest) {
 	for (;;) {
-		int c = getc(file);
-
-		switch (c) {
-		case '\r':
-			consumeLF(where, lineNo, file);
-			[[fallthrough]];
-		case '\n':
-		case EOF:
-			lineBuf.push_back('\0'); // Terminate the string (space was ensured above)
-			return firstChar;
-		}
-		lineBuf.push_back(c);
-	}
-}
+		++lineNo;
+		if (ptr == end)
+			return EOF;
 
-static uint32_t readNumber(char const *str, char const *&endptr, NumberType base) {
-	uint32_t res = 0;
+		char const *lineEnd = std::find_if(ptr, end, [](char c) { return c == '\r' || c == '\n'; });
+		std::string_view line(ptr, lineEnd - ptr);
 
-	for (;;) {
-		static char const *digits = "0123456789ABCDEF";
-		char const *ptr = strchr(digits, toupper(*str));
+		ptr = lineEnd;
+		if (ptr != end && *ptr++ == '\r' && (ptr == end || *ptr++ != '\n'))
+			fatal(&where, lineNo, "Bad line ending (CR without LF)");
 
-		if (!ptr || ptr - digits >= base) {
-			endptr = str;
-			return res;
+		// Discard empty lines and comment lines
+		// TODO: if `;!FILE [...]` on the first line (`lineNo`), return it
+		if (!line.empty() && line[0] != ';') {
+			rest = line.substr(1);
+			return (uint8_t)line[0];
 		}
-		++str;
-		res = res * base + (ptr - digits);
 	}
 }
 
-static uint32_t
-    parseNumber(FileStackNode const &where, uint32_t lineNo, char const *str, NumberType base) {
-	if (str[0] == '\0')
+// Splits the rest of a line into tokens, as they are requested
+static std::string_view nextToken(std::string_view &rest) {
+	size_t start = rest.find_first_not_of(delim);
+	if (start == rest.npos) {
+		rest = {};
+		return {};
+	}
+	size_t len = std::min(rest.find_first_of(delim, start), rest.size()) - start;
+	std::string_view token = rest.substr(start, len);
+	rest.remove_prefix(start + len);
+	return token;
+}
+
+static uint32_t parseNumber(
+    FileStackNode const &where, uint32_t lineNo, std::string_view str, NumberType base
+) {
+	if (str.empty())
 		fatal(&where, lineNo, "Expected number, got empty string");
 
-	char const *endptr;
-	uint32_t res = readNumber(str, endptr, base);
+	uint32_t res;
+	auto [endptr, ec] = std::from_chars(str.data(), str.data() + str.size(), res, base);
 
-	if (*endptr != '\0')
-		fatal(&where, lineNo, "Expected number, got \"%s\"", str);
+	if (ec != std::errc() || endptr != str.data() + str.size())
+		fatal(&where, lineNo, "Expected number, got \"%.*s\"", (int)str.size(), str.data());
 	return res;
 }
 
-static uint8_t
-    parseByte(FileStackNode const &where, uint32_t lineNo, char const *str, NumberType base) {
+static uint8_t parseByte(
+    FileStackNode const &where, uint32_t lineNo, std::string_view str, NumberType base
+) {
 	uint32_t num = parseNumber(where, lineNo, str, base);
 
 	if (num > UINT8_MAX)
-		fatal(&where, lineNo, "\"%s\" is not a byte", str);
+		fatal(&where, lineNo, "\"%.*s\" is not a byte", (int)str.size(), str.data());
 	return num;
 }
 
+// Warnings are reported while merging, so that concurrently read files report them in order
+[[gnu::format(printf, 3, 4)]] static void
+    deferWarning(SdasObject &object, uint32_t lineNo, char const *fmt, ...) {
+	va_list args;
+
+	va_start(args, fmt);
+	int len = vsnprintf(nullptr, 0, fmt, args);
+	va_end(args);
+
+	std::string &message = object.warnings.emplace_back(lineNo, std::string(len, '\0')).second;
+	va_start(args, fmt);
+	vsnprintf(message.data(), len + 1, fmt, args);
+	va_end(args);
+}
+
 enum AreaFlags {
 	AREA_TYPE = 2, // 0: Concatenate, 1: overlay
 	AREA_ISABS,    // 0: Relative (???) address, 1: absolute address
@@ -135,38 +145,45 @@ enum RelocFlags {
 	                  | 1 << RELOC_WHICHBYTE | 1 << RELOC_EXPR24 | 1 << RELOC_BANKBYTE,
 };
 
-void sdobj_ReadFile(FileStackNode const &where, FILE *file, std::vector<Symbol> &fileSymbols) {
-	std::vector<char> line(256);
-	char const *token;
-
-#define getToken(ptr, ...) \
+void sdobj_ReadFile(
+    FileStackNode const &where,
+    char const *contents,
+    size_t size,
+    std::vector<Symbol> &fileSymbols,
+    SdasObject &object
+) {
+	LineReader reader{.ptr = contents, .end = contents + size, .where = where};
+	uint32_t const &lineNo = reader.lineNo;
+	std::string_view line, token;
+
+#define getToken(...) \
 	do { \
-		token = strtok((ptr), delim); \
-		if (!token) \
+		token = nextToken(line); \
+		if (token.empty()) \
 			fatal(&where, lineNo, __VA_ARGS__); \
 	} while (0)
 #define expectEol(...) \
 	do { \
-		token = strtok(nullptr, delim); \
-		if (token) \
+		if (!nextToken(line).empty()) \
 			fatal(&where, lineNo, __VA_ARGS__); \
 	} while (0)
 #define expectToken(expected, lineType) \
 	do { \
-		getToken(nullptr, "'%c' line is too short", (lineType)); \
-		if (strcasecmp(token, (expected)) != 0) \
+		getToken("'%c' line is too short", (lineType)); \
+		if (token.size() != strlen(expected) \
+		    || strncasecmp(token.data(), (expected), token.size()) != 0) \
 			fatal( \
 			    &where, \
 			    lineNo, \
-			    "Malformed '%c' line: expected \"%s\", got \"%s\"", \
+			    "Malformed '%c' line: expected \"%s\", got \"%.*s\"", \
 			    (lineType), \
 			    (expected), \
-			    token \
+			    (int)token.size(), \
+			    token.data() \
 			); \
 	} while (0)
 
-	uint32_t lineNo = 0;
-	int lineType = nextLine(line, lineNo, where, file);
+	int lineType = reader.nextLine(line);
 	NumberType numberType;
 
 	// The first letter (thus, the line type) identifies the integer type
@@ -191,35 +208,46 @@ void sdobj_ReadFile(FileStackNode const &where, FILE *file, std::vector<Symbol>
 		);
 	}
 
-	switch (line[0]) {
+	switch (line.empty() ? '\0' : line[0]) {
 	case 'L':
 		break;
 	case 'H':
 		fatal(&where, lineNo, "Big-endian SDCC object files are not supported");
 	default:
-		fatal(&where, lineNo, "Unknown endianness type '%c'", line[0]);
+		fatal(&where, lineNo, "Unknown endianness type '%c'", line.empty() ? '\0' : line[0]);
 	}
 
 #define ADDR_SIZE 3
-	if (line[1] != '0' + ADDR_SIZE)
-		fatal(&where, lineNo, "Unknown or unsupported address size '%c'", line[1]);
+	if (line.size() < 2 || line[1] != '0' + ADDR_SIZE)
+		fatal(
+		    &where,
+		    lineNo,
+		    "Unknown or unsupported address size '%c'",
+		    line.size() < 2 ? '\0' : line[1]
+		);
 
-	if (line[2] != '\0')
-		warning(&where, lineNo, "Ignoring unknown characters (\"%s\") in first line", &line[2]);
+	if (line.size() > 2)
+		deferWarning(
+		    object,
+		    lineNo,
+		    "Ignoring unknown characters (\"%.*s\") in first line",
+		    (int)line.size() - 2,
+		    &line[2]
+		);
 
 	// Header line
 
-	lineType = nextLine(line, lineNo, where, file);
+	lineType = reader.nextLine(line);
 	if (lineType != 'H')
 		fatal(&where, lineNo, "Expected header line, got '%c' line", lineType);
 	// Expected format: "A areas S global symbols"
 
-	getToken(line.data(), "Empty 'H' line");
+	getToken("Empty 'H' line");
 	uint32_t expectedNbAreas = parseNumber(where, lineNo, token, numberType);
 
 	expectToken("areas", 'H');
 
-	getToken(nullptr, "'H' line is too short");
+	getToken("'H' line is too short");
 	uint32_t expectedNbSymbols = parseNumber(where, lineNo, token, numberType);
 
 	expectToken("global", 'H');
@@ -238,7 +266,7 @@ void sdobj_ReadFile(FileStackNode const &where, FILE *file, std::vector<Symbol>
 	std::vector<uint8_t> data;
 
 	for (;;) {
-		lineType = nextLine(line, lineNo, where, file);
+		lineType = reader.nextLine(line);
 		if (lineType == EOF)
 			break;
 		switch (lineType) {
@@ -249,23 +277,30 @@ void sdobj_ReadFile(FileStackNode const &where, FILE *file, std::vector<Symbol>
 
 		case 'A': {
 			if (fileSections.size() == expectedNbAreas)
-				warning(
-				    &where, lineNo, "Got more 'A' lines than the expected %" PRIu32, expectedNbAreas
+				deferWarning(
+				    object, lineNo, "Got more 'A' lines than the expected %" PRIu32, expectedNbAreas
 				);
 			std::unique_ptr<Section> curSection = std::make_unique<Section>();
 
-			getToken(line.data(), "'A' line is too short");
-			assume(strlen(token) != 0); // This should be impossible, tokens are non-empty
+			getToken("'A' line is too short");
+			assume(!token.empty()); // This should be impossible, tokens are non-empty
 			// The following is required for fragment offsets to be reliably predicted
 			for (FileSection &entry : fileSections) {
-				if (!strcmp(token, entry.section->name.c_str()))
-					fatal(&where, lineNo, "Area \"%s\" already defined earlier", token);
+				if (token == entry.section->name)
+					fatal(
+					    &where,
+					    lineNo,
+					    "Area \"%.*s\" already defined earlier",
+					    (int)token.size(),
+					    token.data()
+					);
 			}
-			char const *sectName = token; // We'll deal with the section's name depending on type
+			// We'll deal with the section's name depending on type
+			std::string_view sectName = token;
 
 			expectToken("size", 'A');
 
-			getToken(nullptr, "'A' line is too short");
+			getToken("'A' line is too short");
 
 			uint32_t tmp = parseNumber(where, lineNo, token, numberType);
 
@@ -280,7 +315,7 @@ void sdobj_ReadFile(FileStackNode const &where, FILE *file, std::vector<Symbol>
 
 			expectToken("flags", 'A');
 
-			getToken(nullptr, "'A' line is too short");
+			getToken("'A' line is too short");
 			tmp = parseNumber(where, lineNo, token, numberType);
 			if (tmp & (1 << AREA_PAGING))
 				fatal(&where, lineNo, "Internal error: paging is not supported");
@@ -298,7 +333,7 @@ void sdobj_ReadFile(FileStackNode const &where, FILE *file, std::vector<Symbol>
 
 			expectToken("addr", 'A');
 
-			getToken(nullptr, "'A' line is too short");
+			getToken("'A' line is too short");
 			tmp = parseNumber(where, lineNo, token, numberType);
 			curSection->org = tmp; // Truncation keeps the address portion only
 			curSection->bank = tmp >> 16;
@@ -332,8 +367,7 @@ void sdobj_ReadFile(FileStackNode const &where, FILE *file, std::vector<Symbol>
 			} else {
 				curSection->type = SECTTYPE_INVALID; // This means "indeterminate"
 			}
-			curSection->isAlignFixed = false;       // No such concept!
-			curSection->fileSymbols = &fileSymbols; // IDs are instead per-section
+			curSection->isAlignFixed = false; // No such concept!
 			curSection->nextu = nullptr;
 
 			fileSections.push_back({.section = std::move(curSection), .writeIndex = 0});
@@ -342,8 +376,8 @@ void sdobj_ReadFile(FileStackNode const &where, FILE *file, std::vector<Symbol>
 
 		case 'S': {
 			if (fileSymbols.size() == expectedNbSymbols)
-				warning(
-				    &where,
+				deferWarning(
+				    object,
 				    lineNo,
 				    "Got more 'S' lines than the expected %" PRIu32,
 				    expectedNbSymbols
@@ -355,12 +389,15 @@ void sdobj_ReadFile(FileStackNode const &where, FILE *file, std::vector<Symbol>
 			symbol.src = &where;
 			symbol.lineNo = lineNo;
 
-			getToken(line.data(), "'S' line is too short");
+			getToken("'S' line is too short");
 			symbol.name = token;
 
-			getToken(nullptr, "'S' line is too short");
+			getToken("'S' line is too short");
+			// Expected format: /[DR]ef[0-9A-F]+/i
+			if (token.size() < 3)
+				fatal(&where, lineNo, "'S' line is neither \"Def\" nor \"Ref\"");
 
-			if (int32_t value = parseNumber(where, lineNo, &token[3], numberType);
+			if (int32_t value = parseNumber(where, lineNo, token.substr(3), numberType);
 			    !fileSections.empty()) {
 				// Symbols in sections are labels; their value is an offset
 				Section *section = fileSections.back().section.get();
@@ -375,57 +412,18 @@ void sdobj_ReadFile(FileStackNode const &where, FILE *file, std::vector<Symbol>
 				symbol.data = value;
 			}
 
-			// Expected format: /[DR]ef[0-9A-F]+/i
 			if (token[0] == 'R' || token[0] == 'r') {
 				symbol.type = SYMTYPE_IMPORT;
 				// TODO: hard error if the rest is not zero
 			} else if (token[0] != 'D' && token[0] != 'd') {
 				fatal(&where, lineNo, "'S' line is neither \"Def\" nor \"Ref\"");
 			} else {
-				// All symbols are exported
+				// All symbols are exported; they are checked against others while merging
 				symbol.type = SYMTYPE_EXPORT;
-				Symbol const *other = sym_GetSymbol(symbol.name);
-
-				if (other) {
-					// The same symbol can only be defined twice if neither
-					// definition is in a floating section
-					auto checkSymbol = [](Symbol const &sym) -> std::tuple<Section *, int32_t> {
-						if (auto *label = std::get_if<Label>(&sym.data); label)
-							return {label->section, label->offset};
-						assume(std::holds_alternative<int32_t>(sym.data));
-						return {nullptr, std::get<int32_t>(sym.data)};
-					};
-					auto [symbolSection, symbolValue] = checkSymbol(symbol);
-					auto [otherSection, otherValue] = checkSymbol(*other);
-
-					if ((otherSection && !otherSection->isAddressFixed)
-					    || (symbolSection && !symbolSection->isAddressFixed)) {
-						sym_AddSymbol(symbol); // This will error out
-					} else if (otherValue != symbolValue) {
-						error(
-						    &where,
-						    lineNo,
-						    "Definition of \"%s\" conflicts with definition in %s (%" PRId32
-						    " != %" PRId32 ")",
-						    symbol.name.c_str(),
-						    other->objFileName,
-						    symbolValue,
-						    otherValue
-						);
-					}
-				} else {
-					// Add a new definition
-					sym_AddSymbol(symbol);
-				}
-				// It's fine to keep modifying the symbol after `AddSymbol`, only
-				// the name must not be modified
 			}
 			if (strncasecmp(&token[1], "ef", 2) != 0)
 				fatal(&where, lineNo, "'S' line is neither \"Def\" nor \"Ref\"");
 
-			if (!fileSections.empty())
-				fileSections.back().section->symbols.push_back(&symbol);
-
 			expectEol("'S' line is too long");
 			break;
 		}
@@ -433,10 +431,10 @@ void sdobj_ReadFile(FileStackNode const &where, FILE *file, std::vector<Symbol>
 		case 'T':
 			// Now, time to parse the data!
 			if (!data.empty())
-				warning(&where, lineNo, "Previous 'T' line had no 'R' line (ignored)");
+				deferWarning(object, lineNo, "Previous 'T' line had no 'R' line (ignored)");
 
 			data.clear();
-			for (token = strtok(line.data(), delim); token; token = strtok(nullptr, delim))
+			for (token = nextToken(line); !token.empty(); token = nextToken(line))
 				data.push_back(parseByte(where, lineNo, token, numberType));
 
 			if (data.size() < ADDR_SIZE)
@@ -447,18 +445,18 @@ void sdobj_ReadFile(FileStackNode const &where, FILE *file, std::vector<Symbol>
 		case 'R': {
 			// Supposed to directly follow `T`
 			if (data.empty()) {
-				warning(&where, lineNo, "'R' line with no 'T' line, ignoring");
+				deferWarning(object, lineNo, "'R' line with no 'T' line, ignoring");
 				break;
 			}
 
 			// First two bytes are ignored
-			getToken(line.data(), "'R' line is too short");
-			getToken(nullptr, "'R' line is too short");
+			getToken("'R' line is too short");
+			getToken("'R' line is too short");
 			uint16_t areaIdx;
 
-			getToken(nullptr, "'R' line is too short");
+			getToken("'R' line is too short");
 			areaIdx = parseByte(where, lineNo, token, numberType);
-			getToken(nullptr, "'R' line is too short");
+			getToken("'R' line is too short");
 			areaIdx |= (uint16_t)parseByte(where, lineNo, token, numberType) << 8;
 			if (areaIdx >= fileSections.size())
 				fatal(
@@ -518,16 +516,16 @@ void sdobj_ReadFile(FileStackNode const &where, FILE *file, std::vector<Symbol>
 			// This all can be "translated" to RGBDS parlance by generating the
 			// appropriate RPN expression (depending on flags), plus an addition for the
 			// bytes being patched over.
-			while ((token = strtok(nullptr, delim)) != nullptr) {
+			while (!(token = nextToken(line)).empty()) {
 				uint16_t flags = parseByte(where, lineNo, token, numberType);
 
 				if ((flags & 0xF0) == 0xF0) {
-					getToken(nullptr, "Incomplete relocation");
+					getToken("Incomplete relocation");
 					flags =
 					    (flags & 0x0F) | (uint16_t)parseByte(where, lineNo, token, numberType) << 4;
 				}
 
-				getToken(nullptr, "Incomplete relocation");
+				getToken("Incomplete relocation");
 				uint8_t offset = parseByte(where, lineNo, token, numberType);
 
 				if (offset < ADDR_SIZE)
@@ -547,17 +545,19 @@ void sdobj_ReadFile(FileStackNode const &where, FILE *file, std::vector<Symbol>
 					    data.size()
 					);
 
-				getToken(nullptr, "Incomplete relocation");
+				getToken("Incomplete relocation");
 				uint16_t idx = parseByte(where, lineNo, token, numberType);
 
-				getToken(nullptr, "Incomplete relocation");
+				getToken("Incomplete relocation");
 				idx |= (uint16_t)parseByte(where, lineNo, token, numberType);
 
 				// Loudly fail on unknown flags
 				if (flags & (1 << RELOC_ZPAGE | 1 << RELOC_NPAGE))
 					fatal(&where, lineNo, "Paging flags are not supported");
 				if (flags & ~RELOC_ALL_FLAGS)
-					warning(&where, lineNo, "Unknown reloc flags 0x%x", flags & ~RELOC_ALL_FLAGS);
+					deferWarning(
+					    object, lineNo, "Unknown reloc flags 0x%x", flags & ~RELOC_ALL_FLAGS
+					);
 
 				// Turn this into a Patch
 				Patch &patch = section->patches.emplace_back();
@@ -598,6 +598,8 @@ void sdobj_ReadFile(FileStackNode const &where, FILE *file, std::vector<Symbol>
 
 				// Bit 4 specifies signedness, but I don't think that matters?
 				// Generate a RPN expression from the info and flags
+				std::vector<uint8_t> &rpnExpression = object.expressions.emplace_back();
+
 				if (flags & 1 << RELOC_ISSYM) {
 					if (idx >= fileSymbols.size())
 						fatal(
@@ -627,35 +629,35 @@ void sdobj_ReadFile(FileStackNode const &where, FILE *file, std::vector<Symbol>
 							    sym.name.c_str(),
 							    &sym.name.c_str()[1]
 							);
-						patch.rpnExpression.resize(5);
-						patch.rpnExpression[0] = RPN_BANK_SYM;
-						patch.rpnExpression[1] = idx;
-						patch.rpnExpression[2] = idx >> 8;
-						patch.rpnExpression[3] = idx >> 16;
-						patch.rpnExpression[4] = idx >> 24;
+						rpnExpression.resize(5);
+						rpnExpression[0] = RPN_BANK_SYM;
+						rpnExpression[1] = idx;
+						rpnExpression[2] = idx >> 8;
+						rpnExpression[3] = idx >> 16;
+						rpnExpression[4] = idx >> 24;
 					} else if (sym.name.starts_with("l_")) {
-						patch.rpnExpression.resize(1 + sym.name.length() - 2 + 1);
-						patch.rpnExpression[0] = RPN_SIZEOF_SECT;
+						rpnExpression.resize(1 + sym.name.length() - 2 + 1);
+						rpnExpression[0] = RPN_SIZEOF_SECT;
 						memcpy(
-						    (char *)&patch.rpnExpression[1],
+						    (char *)&rpnExpression[1],
 						    &sym.name.c_str()[2],
 						    sym.name.length() - 2 + 1
 						);
 					} else if (sym.name.starts_with("s_")) {
-						patch.rpnExpression.resize(1 + sym.name.length() - 2 + 1);
-						patch.rpnExpression[0] = RPN_STARTOF_SECT;
+						rpnExpression.resize(1 + sym.name.length() - 2 + 1);
+						rpnExpression[0] = RPN_STARTOF_SECT;
 						memcpy(
-						    (char *)&patch.rpnExpression[1],
+						    (char *)&rpnExpression[1],
 						    &sym.name.c_str()[2],
 						    sym.name.length() - 2 + 1
 						);
 					} else {
-						patch.rpnExpression.resize(5);
-						patch.rpnExpression[0] = RPN_SYM;
-						patch.rpnExpression[1] = idx;
-						patch.rpnExpression[2] = idx >> 8;
-						patch.rpnExpression[3] = idx >> 16;
-						patch.rpnExpression[4] = idx >> 24;
+						rpnExpression.resize(5);
+						rpnExpression[0] = RPN_SYM;
+						rpnExpression[1] = idx;
+						rpnExpression[2] = idx >> 8;
+						rpnExpression[3] = idx >> 16;
+						rpnExpression[4] = idx >> 24;
 					}
 				} else {
 					if (idx >= fileSections.size())
@@ -676,7 +678,6 @@ void sdobj_ReadFile(FileStackNode const &where, FILE *file, std::vector<Symbol>
 					if (fileSections[idx].section->isAddressFixed)
 						baseValue -= fileSections[idx].section->org;
 					std::string const &name = fileSections[idx].section->name;
-					Section const *other = sect_GetSection(name);
 
 					// Unlike with `s_<AREA>`, referencing an area in this way
 					// wants the beginning of this fragment, so we must add the
@@ -685,21 +686,24 @@ void sdobj_ReadFile(FileStackNode const &where, FILE *file, std::vector<Symbol>
 					// section can only have one fragment per SDLD object file,
 					// so this fragment will be appended to the existing section
 					// *if any*, and thus its offset will be the section's
-					// current size.
-					if (other)
-						baseValue += other->size;
-					patch.rpnExpression.resize(1 + name.length() + 1);
-					patch.rpnExpression[0] = RPN_STARTOF_SECT;
+					// current size. That size is only known when merging.
+					object.areaRefs.push_back({
+					    .expression = &rpnExpression,
+					    .baseValueOfs = 1 + name.length() + 1 + 1,
+					    .areaName = name,
+					});
+					rpnExpression.resize(1 + name.length() + 1);
+					rpnExpression[0] = RPN_STARTOF_SECT;
 					// The cast is fine, it's just different signedness
-					memcpy((char *)&patch.rpnExpression[1], name.c_str(), name.length() + 1);
+					memcpy((char *)&rpnExpression[1], name.c_str(), name.length() + 1);
 				}
 
-				patch.rpnExpression.push_back(RPN_CONST);
-				patch.rpnExpression.push_back(baseValue);
-				patch.rpnExpression.push_back(baseValue >> 8);
-				patch.rpnExpression.push_back(baseValue >> 16);
-				patch.rpnExpression.push_back(baseValue >> 24);
-				patch.rpnExpression.push_back(RPN_ADD);
+				rpnExpression.push_back(RPN_CONST);
+				rpnExpression.push_back(baseValue);
+				rpnExpression.push_back(baseValue >> 8);
+				rpnExpression.push_back(baseValue >> 16);
+				rpnExpression.push_back(baseValue >> 24);
+				rpnExpression.push_back(RPN_ADD);
 
 				if (patch.type == PATCHTYPE_BYTE) {
 					// Despite the flag's name, as soon as it is set, 3 bytes
@@ -728,31 +732,31 @@ void sdobj_ReadFile(FileStackNode const &where, FILE *file, std::vector<Symbol>
 						patch.type = PATCHTYPE_JR;
 						// TODO: check the other flags?
 					} else if (flags & 1 << RELOC_EXPR24 && flags & 1 << RELOC_BANKBYTE) {
-						patch.rpnExpression.push_back(RPN_CONST);
-						patch.rpnExpression.push_back(16);
-						patch.rpnExpression.push_back(16 >> 8);
-						patch.rpnExpression.push_back(16 >> 16);
-						patch.rpnExpression.push_back(16 >> 24);
-						patch.rpnExpression.push_back(
+						rpnExpression.push_back(RPN_CONST);
+						rpnExpression.push_back(16);
+						rpnExpression.push_back(16 >> 8);
+						rpnExpression.push_back(16 >> 16);
+						rpnExpression.push_back(16 >> 24);
+						rpnExpression.push_back(
 						    (flags & 1 << RELOC_SIGNED) ? RPN_SHR : RPN_USHR
 						);
 					} else {
 						if (flags & 1 << RELOC_EXPR16 && flags & 1 << RELOC_WHICHBYTE) {
-							patch.rpnExpression.push_back(RPN_CONST);
-							patch.rpnExpression.push_back(8);
-							patch.rpnExpression.push_back(8 >> 8);
-							patch.rpnExpression.push_back(8 >> 16);
-							patch.rpnExpression.push_back(8 >> 24);
-							patch.rpnExpression.push_back(
+							rpnExpression.push_back(RPN_CONST);
+							rpnExpression.push_back(8);
+							rpnExpression.push_back(8 >> 8);
+							rpnExpression.push_back(8 >> 16);
+							rpnExpression.push_back(8 >> 24);
+							rpnExpression.push_back(
 							    (flags & 1 << RELOC_SIGNED) ? RPN_SHR : RPN_USHR
 							);
 						}
-						patch.rpnExpression.push_back(RPN_CONST);
-						patch.rpnExpression.push_back(0xFF);
-						patch.rpnExpression.push_back(0xFF >> 8);
-						patch.rpnExpression.push_back(0xFF >> 16);
-						patch.rpnExpression.push_back(0xFF >> 24);
-						patch.rpnExpression.push_back(RPN_AND);
+						rpnExpression.push_back(RPN_CONST);
+						rpnExpression.push_back(0xFF);
+						rpnExpression.push_back(0xFF >> 8);
+						rpnExpression.push_back(0xFF >> 16);
+						rpnExpression.push_back(0xFF >> 24);
+						rpnExpression.push_back(RPN_AND);
 					}
 				} else if (flags & 1 << RELOC_ISPCREL) {
 					assume(patch.type == PATCHTYPE_WORD);
@@ -765,6 +769,7 @@ void sdobj_ReadFile(FileStackNode const &where, FILE *file, std::vector<Symbol>
 					    flags & (1 << RELOC_EXPR16 | 1 << RELOC_EXPR24)
 					);
 				}
+				patch.rpnExpression = rpnExpression;
 			}
 
 			// If there is some data left to append, do so
@@ -789,7 +794,7 @@ void sdobj_ReadFile(FileStackNode const &where, FILE *file, std::vector<Symbol>
 
 		case 'P':
 		default:
-			warning(&where, lineNo, "Unknown/unsupported line type '%c', ignoring", lineType);
+			deferWarning(object, lineNo, "Unknown/unsupported line type '%c', ignoring", lineType);
 			break;
 		}
 	}
@@ -799,26 +804,24 @@ void sdobj_ReadFile(FileStackNode const &where, FILE *file, std::vector<Symbol>
 #undef getToken
 
 	if (!data.empty())
-		warning(&where, lineNo, "Last 'T' line had no 'R' line (ignored)");
+		deferWarning(object, lineNo, "Last 'T' line had no 'R' line (ignored)");
 	if (fileSections.size() < expectedNbAreas)
-		warning(
-		    &where,
+		deferWarning(
+		    object,
 		    lineNo,
 		    "Expected %" PRIu32 " 'A' lines, got only %zu",
 		    expectedNbAreas,
 		    fileSections.size()
 		);
 	if (fileSymbols.size() < expectedNbSymbols)
-		warning(
-		    &where,
+		deferWarning(
+		    object,
 		    lineNo,
 		    "Expected %" PRIu32 " 'S' lines, got only %zu",
 		    expectedNbSymbols,
 		    fileSymbols.size()
 		);
 
-	nbSectionsToAssign += fileSections.size();
-
 	for (FileSection &entry : fileSections) {
 		std::unique_ptr<Section> &section = entry.section;
 
@@ -833,13 +836,92 @@ void sdobj_ReadFile(FileStackNode const &where, FILE *file, std::vector<Symbol>
 			    section->size
 			);
 
+		object.sections.push_back(std::move(section));
+	}
+}
+
+// Keeps the expressions of all SDCC objects alive, since patches only refer to them
+static std::deque<std::vector<uint8_t>> generatedExpressions;
+
+void sdobj_MergeFile(
+    FileStackNode const &where, std::vector<Symbol> &fileSymbols, SdasObject &object
+) {
+	for (auto const &[lineNo, message] : object.warnings)
+		warning(&where, lineNo, "%s", message.c_str());
+
+	for (std::unique_ptr<Section> const &section : object.sections)
+		section->fileSymbols = &fileSymbols; // IDs are instead per-section
+
+	for (Symbol &symbol : fileSymbols) {
+		if (auto *label = std::get_if<Label>(&symbol.data); label)
+			label->section->symbols.push_back(&symbol);
+		if (symbol.type != SYMTYPE_EXPORT)
+			continue;
+
+		Symbol const *other = sym_GetSymbol(symbol.name);
+
+		if (other) {
+			// The same symbol can only be defined twice if neither
+			// definition is in a floating section
+			auto checkSymbol = [](Symbol const &sym) -> std::tuple<Section *, int32_t> {
+				if (auto *label = std::get_if<Label>(&sym.data); label)
+					return {label->section, label->offset};
+				assume(std::holds_alternative<int32_t>(sym.data));
+				return {nullptr, std::get<int32_t>(sym.data)};
+			};
+			auto [symbolSection, symbolValue] = checkSymbol(symbol);
+			auto [otherSection, otherValue] = checkSymbol(*other);
+
+			if ((otherSection && !otherSection->isAddressFixed)
+			    || (symbolSection && !symbolSection->isAddressFixed)) {
+				sym_AddSymbol(symbol); // This will error out
+			} else if (otherValue != symbolValue) {
+				error(
+				    &where,
+				    symbol.lineNo,
+				    "Definition of \"%s\" conflicts with definition in %s (%" PRId32 " != %" PRId32
+				    ")",
+				    symbol.name.c_str(),
+				    other->objFileName,
+				    symbolValue,
+				    otherValue
+				);
+			}
+		} else {
+			// Add a new definition
+			sym_AddSymbol(symbol);
+		}
+		// It's fine to keep modifying the symbol after `AddSymbol`, only
+		// the name must not be modified
+	}
+
+	// Now that previous files' fragments have been added, their sizes are known
+	for (SdasAreaRef const &ref : object.areaRefs) {
+		if (Section const *other = sect_GetSection(ref.areaName); other) {
+			uint8_t *bytes = &(*ref.expression)[ref.baseValueOfs];
+			uint32_t baseValue = bytes[0] | bytes[1] << 8 | bytes[2] << 16 | bytes[3] << 24;
+
+			baseValue += other->size;
+			bytes[0] = baseValue;
+			bytes[1] = baseValue >> 8;
+			bytes[2] = baseValue >> 16;
+			bytes[3] = baseValue >> 24;
+		}
+	}
+	// Moving the vectors keeps their buffers, which the patches point to
+	for (std::vector<uint8_t> &expression : object.expressions)
+		generatedExpressions.push_back(std::move(expression));
+
+	nbSectionsToAssign += object.sections.size();
+
+	for (std::unique_ptr<Section> &section : object.sections) {
 		if (section->modifier == SECTION_FRAGMENT) {
 			// Add the fragment's offset to all of its symbols
 			for (Symbol *symbol : section->symbols)
 				symbol->label().offset += section->offset;
 		}
 
-		// Calling `sect_AddSection` invalidates the contents of `fileSections`!
+		// Calling `sect_AddSection` invalidates the contents of `object.sections`!
 		sect_AddSection(std::move(section));
 	}
 }
@@ -2,13 +2,29 @@
 
 #include "link/section.hpp"
 
+#include <algorithm>
+#include <atomic>
 #include <inttypes.h>
+#include <optional>
+#include <span>
 #include <stdlib.h>
 #include <string.h>
+#include <string>
+#include <string_view>
+#include <thread>
 #include <unordered_map>
+#include <variant>
+#include <vector>
 
 #include "error.hpp"
 #include "helpers.hpp"
+#include "linkdefs.hpp"
+#include "util.hpp"
+
+#include "link/main.hpp"
+#include "link/object.hpp"
+#include "link/stats.hpp"
+#include "link/symbol.hpp"
 
 std::vector<std::unique_ptr<Section>> sectionList;
 std::unordered_map<std::string, size_t> sectionMap; // Indexes into `sectionList`
@@ -164,26 +180,26 @@ static void mergeSections(Section &target, std::unique_ptr<Section> &&other, Sec
 	switch (mod) {
 	case SECTION_UNION:
 		checkSectUnionCompat(target, *other);
+		stats_Count("merged_unions", 1);
 		if (other->size > target.size)
 			target.size = other->size;
 		break;
 
 	case SECTION_FRAGMENT:
 		checkFragmentCompat(target, *other);
-		// Append `other` to `target`
+		stats_Count("merged_fragments", 1);
+		// Append `other` to `target`; its data is only copied by `sect_MergeFragments`, once the
+		// whole section's size is known
 		// Note that the order in which fragments are stored in the `nextu` list does not
 		// really matter, only that offsets are properly computed
+		if (target.size + other->size > UINT16_MAX)
+			errx(
+			    "Section \"%s\" is too big, its fragments total over $%04x bytes",
+			    other->name.c_str(),
+			    UINT16_MAX
+			);
 		other->offset = target.size;
 		target.size += other->size;
-		// Normally we'd check that `sect_HasData`, but SDCC areas may be `_INVALID` here
-		if (!other->data.empty()) {
-			target.data.insert(target.data.end(), RANGE(other->data));
-			// Adjust patches' PC offsets
-			for (Patch &patch : other->patches)
-				patch.pcOffset += other->offset;
-		} else if (!target.data.empty()) {
-			assume(other->size == 0);
-		}
 		break;
 
 	case SECTION_NORMAL:
@@ -195,6 +211,8 @@ static void mergeSections(Section &target, std::unique_ptr<Section> &&other, Sec
 }
 
 void sect_AddSection(std::unique_ptr<Section> &&section) {
+	stats_Count("patches", section->patches.size());
+
 	// Check if the section already exists
 	if (Section *other = sect_GetSection(section->name); other) {
 		if (section->modifier != other->modifier)
@@ -216,11 +234,88 @@ void sect_AddSection(std::unique_ptr<Section> &&section) {
 		);
 	} else {
 		// If not, add it
+		stats_Count("sections", 1);
 		sectionMap.emplace(section->name, sectionList.size());
 		sectionList.push_back(std::move(section));
 	}
 }
 
+struct FragmentCopy {
+	Section *component;
+	uint8_t *dest; // Where its data goes in the whole section's, or `nullptr` to only adjust it
+};
+
+static void copyFragment(FragmentCopy const &copy) {
+	Section &component = *copy.component;
+
+	// Adjust patches' PC offsets
+	for (Patch &patch : component.patches)
+		patch.pcOffset += component.offset;
+	if (!copy.dest)
+		return;
+
+	// SDCC areas are read into their own data, RGBDS sections are decoded from their object file
+	if (!component.data.empty()) {
+		memcpy(copy.dest, component.data.data(), component.data.size());
+		component.data = {}; // Release the now-redundant copy
+	} else {
+		obj_DecodeData(component.encodedData, copy.dest);
+		component.encodedData = {};
+	}
+}
+
+void sect_MergeFragments() {
+	std::vector<FragmentCopy> copies;
+
+	for (std::unique_ptr<Section> &section : sectionList) {
+		if (section->modifier != SECTION_FRAGMENT)
+			continue;
+
+		// Normally we'd check that `sect_HasData`, but SDCC areas may be `_INVALID` here
+		bool hasData = false;
+		for (Section *component = section.get(); component; component = component->nextu.get())
+			hasData |= !component->data.empty() || !component->encodedData.empty();
+
+		if (lowMemory || !hasData) {
+			// With `--low-memory`, each fragment's data stays in its own object file instead
+			for (Section *component = section->nextu.get(); component;
+			     component = component->nextu.get())
+				copies.push_back({.component = component, .dest = nullptr});
+			continue;
+		}
+
+		// The whole section's data is allocated once; the first component is the section itself,
+		// whose own data must be copied before being replaced
+		std::vector<uint8_t> data(section->size);
+		copyFragment({.component = section.get(), .dest = data.data()});
+		section->data = std::move(data);
+		for (Section *component = section->nextu.get(); component;
+		     component = component->nextu.get()) {
+			uint8_t *dest = section->data.data() + component->offset;
+			copies.push_back({.component = component, .dest = dest});
+		}
+	}
+
+	if (nbJobs <= 1 || copies.size() <= 1) {
+		for (FragmentCopy const &copy : copies)
+			copyFragment(copy);
+		return;
+	}
+
+	// Each component's data goes to its own part of its section's
+	std::atomic_size_t nextCopy = 0;
+	std::vector<std::thread> workers;
+
+	for (unsigned int i = 0; i < nbJobs && i < copies.size(); i++) {
+		workers.emplace_back([&] {
+			for (size_t j; (j = nextCopy++) < copies.size();)
+				copyFragment(copies[j]);
+		});
+	}
+	for (std::thread &worker : workers)
+		worker.join();
+}
+
 Section *sect_GetSection(std::string const &name) {
 	auto search = sectionMap.find(name);
 	return search != sectionMap.end() ? sectionList[search->second].get() : nullptr;
@@ -351,3 +446,391 @@ static void doSanityChecks(Section &section) {
 void sect_DoSanityChecks() {
 	sect_ForEach(doSanityChecks);
 }
+
+// Sections which were removed for being unreferenced; they are kept alive, since symbols still
+// point to them
+static std::vector<std::unique_ptr<Section>> unreferencedSections;
+
+/*
+ * Calls a callback for each section that an RPN expression refers to.
+ * @param rpn The expression
+ * @param fileSymbols The symbols that the expression's symbol IDs refer to
+ * @param callback The function to call for each referenced section (without deduplicating)
+ */
+template<typename F>
+static void forEachReference(
+    std::span<uint8_t const> rpn, std::vector<Symbol> const &fileSymbols, F const &callback
+) {
+	auto getLong = [&](size_t &i) {
+		uint32_t value = 0;
+		for (unsigned shift = 0; shift < 32 && i < rpn.size(); shift += 8)
+			value |= rpn[i++] << shift;
+		return value;
+	};
+	auto getString = [&](size_t &i) {
+		size_t start = i;
+		while (i < rpn.size() && rpn[i] != '\0')
+			i++;
+		std::string name((char const *)&rpn[start], i - start);
+		i++; // Skip the terminator
+		return name;
+	};
+	auto referSymbol = [&](uint32_t id) {
+		if (id >= fileSymbols.size()) // PC, which is handled via `pcSection`
+			return;
+		Symbol const *symbol = &fileSymbols[id];
+		if (symbol->type == SYMTYPE_IMPORT)
+			symbol = symbol->definition;
+		if (!symbol)
+			return; // This will be reported when patching
+		if (auto *label = std::get_if<Label>(&symbol->data); label)
+			callback(label->section->name);
+	};
+
+	for (size_t i = 0; i < rpn.size();) {
+		switch (rpn[i++]) {
+		case RPN_BANK_SYM:
+		case RPN_SYM:
+			referSymbol(getLong(i));
+			break;
+		case RPN_BANK_SECT:
+		case RPN_SIZEOF_SECT:
+		case RPN_STARTOF_SECT:
+			callback(getString(i));
+			break;
+		case RPN_SIZEOF_SECTTYPE:
+		case RPN_STARTOF_SECTTYPE:
+			i++;
+			break;
+		case RPN_CONST:
+			i += 4;
+			break;
+		}
+	}
+}
+
+void sect_RemoveUnreferenced() {
+	std::unordered_map<Section const *, bool> isReferenced;
+	std::vector<Section const *> pending; // Sections referenced, but not yet walked through
+
+	auto refer = [&](std::string const &name) {
+		// Symbols in SDCC fragments point to the fragment, so always go through the name
+		if (Section const *section = sect_GetSection(name); section) {
+			if (bool &referenced = isReferenced[section]; !referenced) {
+				referenced = true;
+				pending.push_back(section);
+			}
+		}
+	};
+
+	// Sections at a fixed address are there on purpose, e.g. the header or interrupt handlers;
+	// so are those that the linker script places
+	for (std::unique_ptr<Section> const &section : sectionList) {
+		if (section->isAddressFixed || section->isPlacedByScript)
+			refer(section->name);
+	}
+	for (Assertion const &assertion : assertions) {
+		if (assertion.patch.pcSection)
+			refer(assertion.patch.pcSection->name);
+		forEachReference(assertion.patch.rpnExpression, *assertion.fileSymbols, refer);
+	}
+	while (!pending.empty()) {
+		Section const *section = pending.back();
+		pending.pop_back();
+		for (Section const *component = section; component; component = component->nextu.get()) {
+			for (Patch const &patch : component->patches)
+				forEachReference(patch.rpnExpression, *component->fileSymbols, refer);
+		}
+	}
+
+	std::vector<std::unique_ptr<Section>> kept;
+	for (std::unique_ptr<Section> &section : sectionList) {
+		if (isReferenced[section.get()]) {
+			kept.push_back(std::move(section));
+		} else {
+			verbosePrint("Removing unreferenced section \"%s\"\n", section->name.c_str());
+			unreferencedSections.push_back(std::move(section));
+		}
+	}
+	stats_Count("unreferenced_sections", sectionList.size() - kept.size());
+
+	sectionList = std::move(kept);
+	sectionMap.clear();
+	for (size_t i = 0; i < sectionList.size(); i++)
+		sectionMap.emplace(sectionList[i]->name, i);
+}
+
+// Sections which were folded into identical ones; they are kept alive, like unreferenced ones
+static std::vector<std::unique_ptr<Section>> foldedSections;
+
+/*
+ * Calls a callback for each command of an RPN expression, skipping over their operands.
+ * @param rpn The expression
+ * @param callback The function to call with each command, and the index of its operand
+ */
+template<typename F>
+static void forEachCommand(std::span<uint8_t const> rpn, F const &callback) {
+	for (size_t i = 0; i < rpn.size();) {
+		uint8_t command = rpn[i++];
+		callback(command, i);
+		switch (command) {
+		case RPN_BANK_SYM:
+		case RPN_SYM:
+		case RPN_CONST:
+			i += 4;
+			break;
+		case RPN_BANK_SECT:
+		case RPN_SIZEOF_SECT:
+		case RPN_STARTOF_SECT:
+			while (i < rpn.size() && rpn[i] != '\0')
+				i++;
+			i++; // Skip the terminator
+			break;
+		case RPN_SIZEOF_SECTTYPE:
+		case RPN_STARTOF_SECTTYPE:
+			i++;
+			break;
+		}
+	}
+}
+
+/*
+ * Returns whether a section may be folded into an identical one: it must be a single component
+ * placed by the linker, with its data read (which `--low-memory` does not do)
+ */
+static bool isFoldable(Section const &section) {
+	return sect_HasData(section.type) && section.modifier == SECTION_NORMAL && !section.nextu
+	       && !section.isAddressFixed && !section.isPlacedByScript
+	       && section.data.size() == section.size;
+}
+
+static uint32_t getRPNLong(std::span<uint8_t const> rpn, size_t i) {
+	uint32_t value = 0;
+	for (unsigned shift = 0; shift < 32 && i < rpn.size(); shift += 8)
+		value |= rpn[i++] << shift;
+	return value;
+}
+
+static bool refersToPC(std::span<uint8_t const> rpn) {
+	bool refers = false;
+	forEachCommand(rpn, [&](uint8_t command, size_t i) {
+		if (command == RPN_SYM && getRPNLong(rpn, i) == (uint32_t)-1)
+			refers = true;
+	});
+	return refers;
+}
+
+/*
+ * Returns whether a patch is only the target of a jump or call, which does not tell apart the
+ * sections that its label may be in; anything else may store or compare their addresses.
+ * @param patch The patch
+ */
+static bool isJumpTarget(Patch const &patch) {
+	if (patch.rpnExpression.size() != 5 || patch.rpnExpression[0] != RPN_SYM)
+		return false;
+	return patch.type == PATCHTYPE_JR || patch.isJumpTarget;
+}
+
+// What a symbol that an expression refers to resolves to, relative to the section if within it
+struct ResolvedSymbol {
+	enum { CONSTANT, PC, OWN_LABEL, LABEL } kind;
+	Section const *section; // Only for `LABEL`
+	int32_t value;          // The constant's value, or the label's offset
+
+	bool operator==(ResolvedSymbol const &) const = default;
+};
+
+static std::optional<ResolvedSymbol> resolveSymbol(uint32_t id, Section const &section) {
+	if (id == (uint32_t)-1)
+		return ResolvedSymbol{.kind = ResolvedSymbol::PC, .section = nullptr, .value = 0};
+	if (id >= section.fileSymbols->size())
+		return std::nullopt; // This will be reported when patching
+
+	Symbol const *symbol = &(*section.fileSymbols)[id];
+	if (symbol->type == SYMTYPE_IMPORT)
+		symbol = symbol->definition;
+	if (!symbol)
+		return std::nullopt;
+	if (auto *label = std::get_if<Label>(&symbol->data); !label)
+		return ResolvedSymbol{
+		    .kind = ResolvedSymbol::CONSTANT,
+		    .section = nullptr,
+		    .value = std::get<int32_t>(symbol->data),
+		};
+	else if (label->section == &section)
+		return ResolvedSymbol{
+		    .kind = ResolvedSymbol::OWN_LABEL, .section = nullptr, .value = label->offset
+		};
+	else
+		return ResolvedSymbol{
+		    .kind = ResolvedSymbol::LABEL, .section = label->section, .value = label->offset
+		};
+}
+
+/*
+ * Returns whether two patches compute the same value relative to their own sections
+ */
+static bool isSamePatch(
+    Patch const &lhs, Section const &lhsSect, Patch const &rhs, Section const &rhsSect
+) {
+	if (lhs.offset != rhs.offset || lhs.type != rhs.type || lhs.pcOffset != rhs.pcOffset
+	    || (lhs.pcSection == &lhsSect) != (rhs.pcSection == &rhsSect)
+	    || (lhs.pcSection != &lhsSect && lhs.pcSection != rhs.pcSection))
+		return false;
+
+	std::span<uint8_t const> lhsRPN = lhs.rpnExpression, rhsRPN = rhs.rpnExpression;
+	std::vector<std::pair<uint8_t, size_t>> lhsCommands, rhsCommands;
+	forEachCommand(lhsRPN, [&](uint8_t command, size_t i) {
+		lhsCommands.emplace_back(command, i);
+	});
+	forEachCommand(rhsRPN, [&](uint8_t command, size_t j) {
+		rhsCommands.emplace_back(command, j);
+	});
+	if (lhsCommands.size() != rhsCommands.size())
+		return false;
+
+	auto getName = [](std::span<uint8_t const> rpn, size_t i) {
+		size_t end = i;
+		while (end < rpn.size() && rpn[end] != '\0')
+			end++;
+		return std::string_view((char const *)&rpn[i], end - i);
+	};
+	for (size_t n = 0; n < lhsCommands.size(); n++) {
+		auto [command, i] = lhsCommands[n];
+		auto [rhsCommand, j] = rhsCommands[n];
+		if (command != rhsCommand)
+			return false;
+
+		switch (command) {
+		case RPN_BANK_SYM:
+		case RPN_SYM: {
+			std::optional<ResolvedSymbol> symbol = resolveSymbol(getRPNLong(lhsRPN, i), lhsSect);
+			if (!symbol || symbol != resolveSymbol(getRPNLong(rhsRPN, j), rhsSect))
+				return false;
+			break;
+		}
+		case RPN_CONST:
+			if (getRPNLong(lhsRPN, i) != getRPNLong(rhsRPN, j))
+				return false;
+			break;
+		case RPN_BANK_SECT:
+		case RPN_SIZEOF_SECT:
+		case RPN_STARTOF_SECT:
+			// Both sections may name themselves, which stays the same once they are folded
+			if (std::string_view name = getName(lhsRPN, i), rhsName = getName(rhsRPN, j);
+			    name != rhsName && (name != lhsSect.name || rhsName != rhsSect.name))
+				return false;
+			break;
+		case RPN_SIZEOF_SECTTYPE:
+		case RPN_STARTOF_SECTTYPE:
+			if (i >= lhsRPN.size() || j >= rhsRPN.size() || lhsRPN[i] != rhsRPN[j])
+				return false;
+			break;
+		}
+	}
+	return true;
+}
+
+static bool isSameSection(Section const &lhs, Section const &rhs) {
+	if (lhs.type != rhs.type || lhs.size != rhs.size || lhs.isBankFixed != rhs.isBankFixed
+	    || (lhs.isBankFixed && lhs.bank != rhs.bank) || lhs.isAlignFixed != rhs.isAlignFixed
+	    || (lhs.isAlignFixed && (lhs.alignMask != rhs.alignMask || lhs.alignOfs != rhs.alignOfs))
+	    || lhs.data != rhs.data || lhs.patches.size() != rhs.patches.size())
+		return false;
+	for (size_t i = 0; i < lhs.patches.size(); i++) {
+		if (!isSamePatch(lhs.patches[i], lhs, rhs.patches[i], rhs))
+			return false;
+	}
+	return true;
+}
+
+void sect_FoldIdentical() {
+	// Sections whose addresses an expression may store or compare must stay distinct
+	std::unordered_map<Section const *, bool> isAddressSignificant;
+	auto markSignificant = [&](std::string const &name) {
+		if (Section const *section = sect_GetSection(name); section)
+			isAddressSignificant[section] = true;
+	};
+	for (Assertion const &assertion : assertions) {
+		std::span<uint8_t const> rpn = assertion.patch.rpnExpression;
+		if (assertion.patch.pcSection && refersToPC(rpn))
+			markSignificant(assertion.patch.pcSection->name);
+		forEachReference(rpn, *assertion.fileSymbols, markSignificant);
+	}
+	for (std::unique_ptr<Section> const &section : sectionList) {
+		for (Section const *component = section.get(); component;
+		     component = component->nextu.get()) {
+			for (Patch const &patch : component->patches) {
+				if (isJumpTarget(patch))
+					continue;
+				if (patch.pcSection && refersToPC(patch.rpnExpression))
+					markSignificant(patch.pcSection->name);
+				forEachReference(patch.rpnExpression, *component->fileSymbols, markSignificant);
+			}
+		}
+	}
+
+	// Sections are grouped by a hash of their contents, then compared in full; the first of
+	// identical ones is kept
+	std::unordered_map<uint64_t, std::vector<Section *>> candidates;
+	std::vector<std::pair<Section *, Section *>> folds; // Folded sections, and where to
+	std::unordered_map<Section const *, Section *> foldedInto;
+	for (std::unique_ptr<Section> const &section : sectionList) {
+		if (!isFoldable(*section) || isAddressSignificant[section.get()])
+			continue;
+
+		uint64_t hash = hashFNV1a(section->data.data(), section->data.size());
+		uint8_t type = section->type;
+		hash = hashFNV1a(&type, sizeof(type), hash);
+		for (Patch const &patch : section->patches)
+			hash = hashFNV1a(&patch.offset, sizeof(patch.offset), hash);
+
+		std::vector<Section *> &sameHash = candidates[hash];
+		auto kept = std::find_if(RANGE(sameHash), [&section](Section const *other) {
+			return isSameSection(*other, *section);
+		});
+		if (kept != sameHash.end()) {
+			folds.emplace_back(section.get(), *kept);
+			foldedInto.emplace(section.get(), *kept);
+		} else {
+			sameHash.push_back(section.get());
+		}
+	}
+	stats_Count("folded_sections", folds.size());
+	if (folds.empty())
+		return;
+
+	// The folded sections' symbols now label the same bytes of the section that is kept
+	for (auto [folded, into] : folds) {
+		verbosePrint(
+		    "Folding section \"%s\" into \"%s\"\n", folded->name.c_str(), into->name.c_str()
+		);
+		for (Symbol *symbol : folded->symbols) {
+			symbol->label().section = into;
+			into->symbols.push_back(symbol);
+		}
+		std::stable_sort(RANGE(into->symbols), [](Symbol const *lhs, Symbol const *rhs) {
+			return lhs->label().offset < rhs->label().offset;
+		});
+	}
+	for (Assertion &assertion : assertions) {
+		if (auto search = foldedInto.find(assertion.patch.pcSection); search != foldedInto.end())
+			assertion.patch.pcSection = search->second;
+	}
+
+	std::vector<std::unique_ptr<Section>> kept;
+	for (std::unique_ptr<Section> &section : sectionList) {
+		if (foldedInto.contains(section.get()))
+			foldedSections.push_back(std::move(section));
+		else
+			kept.push_back(std::move(section));
+	}
+
+	sectionList = std::move(kept);
+	sectionMap.clear();
+	for (size_t i = 0; i < sectionList.size(); i++)
+		sectionMap.emplace(sectionList[i]->name, i);
+	// The folded sections' names refer to the sections that they were folded into
+	for (auto [folded, into] : folds)
+		sectionMap.emplace(folded->name, sectionMap[into->name]);
+}
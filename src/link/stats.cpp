@@ -0,0 +1,158 @@
+/* SPDX-License-Identifier: MIT */
+
+#include "link/stats.hpp"
+
+#include <chrono>
+#include <inttypes.h>
+#include <optional>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#ifndef _WIN32
+	#include <sys/resource.h>
+#endif
+
+#include "error.hpp"
+#include "helpers.hpp"
+#include "linkdefs.hpp"
+#include "trace.hpp"
+
+#include "link/assign.hpp"
+#include "link/main.hpp"
+
+using Clock = std::chrono::steady_clock;
+
+struct Phase {
+	char const *name;
+	Clock::duration time;
+};
+
+struct Counter {
+	char const *name;
+	uint64_t value;
+};
+
+static std::vector<Phase> phases;
+static std::optional<Clock::time_point> phaseStart; // Empty if no phase is being timed
+static std::vector<Counter> counters;
+static bool isTracingPhase = false; // Phases are traced even without a report
+
+static void endPhase() {
+	if (phaseStart) {
+		phases.back().time = Clock::now() - *phaseStart;
+		phaseStart.reset();
+	}
+}
+
+void stats_StartPhase(char const *name) {
+	if (isTracingPhase)
+		trace_End();
+	trace_Begin(name);
+	isTracingPhase = true;
+
+	if (!statsFileName)
+		return;
+
+	endPhase();
+	phases.push_back({.name = name, .time = {}});
+	phaseStart = Clock::now();
+}
+
+void stats_Count(char const *name, uint64_t amount) {
+	if (!statsFileName)
+		return;
+
+	// There are few enough counters that a linear search is fine
+	for (Counter &counter : counters) {
+		if (!strcmp(counter.name, name)) {
+			counter.value += amount;
+			return;
+		}
+	}
+	counters.push_back({.name = name, .value = amount});
+}
+
+void stats_Write() {
+	if (isTracingPhase) {
+		trace_End();
+		isTracingPhase = false;
+	}
+
+	if (!statsFileName)
+		return;
+
+	endPhase();
+
+	FILE *file = fopen(statsFileName, "w");
+	if (!file)
+		err("Failed to open stats file \"%s\"", statsFileName);
+	Defer closeFile{[&] { fclose(file); }};
+
+	fputs("{\n  \"phases\": [", file);
+	for (size_t i = 0; i < phases.size(); i++) {
+		auto microseconds = std::chrono::duration_cast<std::chrono::microseconds>(phases[i].time);
+
+		fprintf(
+		    file,
+		    "%s\n    {\"name\": \"%s\", \"microseconds\": %" PRIu64 "}",
+		    i == 0 ? "" : ",",
+		    phases[i].name,
+		    (uint64_t)microseconds.count()
+		);
+	}
+	fputs("\n  ],\n  \"counts\": {", file);
+	for (size_t i = 0; i < counters.size(); i++) {
+		fprintf(
+		    file,
+		    "%s\n    \"%s\": %" PRIu64,
+		    i == 0 ? "" : ",",
+		    counters[i].name,
+		    counters[i].value
+		);
+	}
+	fputs("\n  },\n  \"free_spaces\": {", file);
+	// Only the banks which sections were assigned to are listed
+	bool isFirstType = true;
+	for (uint8_t type = 0; type < SECTTYPE_INVALID; type++) {
+		SectionTypeInfo const &typeInfo = sectionTypeInfo[type];
+		bool isFirstBank = true;
+
+		for (uint32_t bank = typeInfo.firstBank; bank <= typeInfo.lastBank; bank++) {
+			ssize_t nbFreeSpaces = assign_GetNbFreeSpaces((SectionType)type, bank);
+			if (nbFreeSpaces == -1)
+				continue;
+
+			if (isFirstBank)
+				fprintf(
+				    file, "%s\n    \"%s\": {", isFirstType ? "" : ",", typeInfo.name.c_str()
+				);
+			fprintf(
+			    file, "%s\"%" PRIu32 "\": %zu", isFirstBank ? "" : ", ", bank, (size_t)nbFreeSpaces
+			);
+			isFirstBank = false;
+			isFirstType = false;
+		}
+		if (!isFirstBank)
+			putc('}', file);
+	}
+	fputs("\n  },\n  \"peak_rss_kib\": ", file);
+
+	long peakRSS = -1; // Reported as `null` where it cannot be measured
+#ifndef _WIN32
+	if (rusage usage; getrusage(RUSAGE_SELF, &usage) == 0) {
+		peakRSS = usage.ru_maxrss;
+	#ifdef __APPLE__
+		peakRSS /= 1024; // macOS reports it in bytes instead of kibibytes
+	#endif
+	}
+#endif
+	if (peakRSS < 0)
+		fputs("null", file);
+	else
+		fprintf(file, "%ld", peakRSS);
+	fputs("\n}\n", file);
+
+	if (ferror(file))
+		err("Failed to write stats file \"%s\"", statsFileName);
+}
@@ -29,11 +29,11 @@ void sym_AddSymbol(Symbol &symbol) {
 
 	// Check if the symbol already exists with a different value
 	if (other && !(symValue && otherValue && *symValue == *otherValue)) {
-		fprintf(stderr, "error: \"%s\" both in %s from ", symbol.name.c_str(), symbol.objFileName);
+		diag_Printf("error: \"%s\" both in %s from ", symbol.name.c_str(), symbol.objFileName);
 		symbol.src->dump(symbol.lineNo);
-		fprintf(stderr, " and in %s from ", other->objFileName);
+		diag_Printf(" and in %s from ", other->objFileName);
 		other->src->dump(other->lineNo);
-		fputc('\n', stderr);
+		diag_Putc('\n');
 		exit(1);
 	}
 
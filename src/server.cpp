@@ -0,0 +1,250 @@
+/* SPDX-License-Identifier: MIT */
+
+#include "server.hpp"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#ifndef _WIN32
+	#include <signal.h>
+	#include <sys/socket.h>
+	#include <sys/stat.h>
+	#include <sys/un.h>
+	#include <sys/wait.h>
+	#include <unistd.h>
+#endif
+
+#include "error.hpp"
+
+#ifdef _WIN32
+
+void server_Serve(std::string const &, char const *, int (*)(int, char *[])) {
+	errx("Option '--serve' is not supported on this platform");
+}
+
+void server_Connect(char const *, int, char *[]) {
+	errx("Option '--connect' is not supported on this platform");
+}
+
+#else
+
+#define NB_PASSED_FDS 3 // Standard input, output and error
+
+static sockaddr_un makeAddress(char const *socketPath) {
+	sockaddr_un addr{};
+
+	addr.sun_family = AF_UNIX;
+	if (strlen(socketPath) >= sizeof(addr.sun_path))
+		errx("Socket path \"%s\" is too long", socketPath);
+	strcpy(addr.sun_path, socketPath);
+	return addr;
+}
+
+static bool readAll(int fd, void *buf, size_t len) {
+	for (char *ptr = (char *)buf; len != 0;) {
+		ssize_t nbRead = read(fd, ptr, len);
+
+		if (nbRead == -1 && errno == EINTR)
+			continue;
+		if (nbRead <= 0)
+			return false;
+		ptr += nbRead;
+		len -= nbRead;
+	}
+	return true;
+}
+
+static bool writeAll(int fd, void const *buf, size_t len) {
+	for (char const *ptr = (char const *)buf; len != 0;) {
+		ssize_t nbWritten = write(fd, ptr, len);
+
+		if (nbWritten == -1 && errno == EINTR)
+			continue;
+		if (nbWritten <= 0)
+			return false;
+		ptr += nbWritten;
+		len -= nbWritten;
+	}
+	return true;
+}
+
+[[noreturn]] static void
+    handleConnection(int conn, char const *programName, int (*handler)(int, char *[])) {
+	// Receive the request's length, along with the client's standard streams
+	uint8_t header[4];
+	char control[CMSG_SPACE(sizeof(int) * NB_PASSED_FDS)] = {};
+	iovec iov = {.iov_base = header, .iov_len = sizeof(header)};
+	msghdr msg = {};
+
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+
+	ssize_t nbRead;
+	do {
+		nbRead = recvmsg(conn, &msg, 0);
+	} while (nbRead == -1 && errno == EINTR);
+
+	cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+	if (nbRead <= 0 || !cmsg || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS
+	    || cmsg->cmsg_len != CMSG_LEN(sizeof(int) * NB_PASSED_FDS)
+	    || !readAll(conn, &header[nbRead], sizeof(header) - nbRead)) {
+		warnx("Ignoring a malformed request");
+		_exit(1);
+	}
+	int fds[NB_PASSED_FDS];
+	memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+
+	uint32_t size = header[0] | header[1] << 8 | header[2] << 16 | (uint32_t)header[3] << 24;
+	std::vector<char> request(size);
+	if (!readAll(conn, request.data(), size) || size == 0 || request.back() != '\0') {
+		warnx("Ignoring a malformed request");
+		_exit(1);
+	}
+
+	// The first string is the working directory, the others are the arguments
+	// The handler does not modify its arguments, which are only non-const for `getopt`'s sake
+	std::vector<char *> argv{const_cast<char *>(programName)};
+	for (size_t i = strlen(request.data()) + 1; i < size; i += strlen(&request[i]) + 1)
+		argv.push_back(&request[i]);
+	argv.push_back(nullptr);
+
+	pid_t pid = fork();
+	if (pid == -1) {
+		warn("Failed to start handling a request");
+		_exit(1);
+	}
+	if (pid == 0) {
+		for (int fd = 0; fd < NB_PASSED_FDS; fd++) {
+			dup2(fds[fd], fd);
+			close(fds[fd]);
+		}
+		close(conn);
+		if (chdir(request.data()) != 0)
+			err("Failed to change directory to \"%s\"", request.data());
+		fastExit(handler(argv.size() - 1, argv.data()));
+	}
+	for (int fd : fds)
+		close(fd);
+
+	int status;
+	while (waitpid(pid, &status, 0) == -1) {
+		if (errno != EINTR) {
+			warn("Failed to wait for a request to be handled");
+			_exit(1);
+		}
+	}
+	// Like shells do, report being killed by a signal as exiting with 128 plus its number
+	uint8_t exitStatus = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+	writeAll(conn, &exitStatus, sizeof(exitStatus));
+	_exit(0);
+}
+
+void server_Serve(
+    std::string const &socketPath, char const *programName, int (*handler)(int, char *[])
+) {
+	sockaddr_un addr = makeAddress(socketPath.c_str());
+
+	// Replace the socket of a previous server, but nothing else
+	if (struct stat statBuf; lstat(addr.sun_path, &statBuf) == 0 && S_ISSOCK(statBuf.st_mode))
+		unlink(addr.sun_path);
+
+	int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listener == -1)
+		err("Failed to create socket");
+	if (bind(listener, (sockaddr const *)&addr, sizeof(addr)) != 0)
+		err("Failed to bind socket \"%s\"", addr.sun_path);
+	if (listen(listener, SOMAXCONN) != 0)
+		err("Failed to listen on socket \"%s\"", addr.sun_path);
+
+	// Connections are handled concurrently, and their processes never waited for
+	signal(SIGCHLD, SIG_IGN);
+	// A client hanging up must not kill the server
+	signal(SIGPIPE, SIG_IGN);
+
+	// Avoid the children also writing what was buffered so far
+	fflush(stdout);
+	fflush(stderr);
+
+	for (;;) {
+		int conn = accept(listener, nullptr, nullptr);
+
+		if (conn == -1) {
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			err("Failed to accept a connection on \"%s\"", addr.sun_path);
+		}
+
+		pid_t pid = fork();
+		if (pid == -1)
+			warn("Failed to start handling a connection");
+		if (pid == 0) {
+			close(listener);
+			signal(SIGCHLD, SIG_DFL);
+			signal(SIGPIPE, SIG_DFL);
+			handleConnection(conn, programName, handler);
+		}
+		close(conn);
+	}
+}
+
+void server_Connect(char const *socketPath, int argc, char *argv[]) {
+	sockaddr_un addr = makeAddress(socketPath);
+
+	int conn = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (conn == -1)
+		err("Failed to create socket");
+	if (connect(conn, (sockaddr const *)&addr, sizeof(addr)) != 0)
+		err("Failed to connect to \"%s\"", socketPath);
+
+	std::vector<char> request;
+	for (size_t size = 256;; size *= 2) {
+		request.resize(size);
+		if (getcwd(request.data(), size))
+			break;
+		if (errno != ERANGE)
+			err("Failed to get the working directory");
+	}
+	request.resize(strlen(request.data()) + 1);
+	for (int i = 0; i < argc; i++)
+		request.insert(request.end(), argv[i], argv[i] + strlen(argv[i]) + 1);
+
+	uint32_t size = request.size();
+	uint8_t header[4] = {
+	    (uint8_t)size, (uint8_t)(size >> 8), (uint8_t)(size >> 16), (uint8_t)(size >> 24)
+	};
+	int fds[NB_PASSED_FDS] = {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO};
+	char control[CMSG_SPACE(sizeof(fds))] = {};
+	iovec iov = {.iov_base = header, .iov_len = sizeof(header)};
+	msghdr msg = {};
+
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+
+	cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+	memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+	ssize_t nbSent;
+	do {
+		nbSent = sendmsg(conn, &msg, 0);
+	} while (nbSent == -1 && errno == EINTR);
+	if (nbSent <= 0 || !writeAll(conn, &header[nbSent], sizeof(header) - nbSent)
+	    || !writeAll(conn, request.data(), request.size()))
+		err("Failed to send request to \"%s\"", socketPath);
+
+	uint8_t exitStatus;
+	if (!readAll(conn, &exitStatus, sizeof(exitStatus)))
+		errx("The server at \"%s\" closed the connection", socketPath);
+	exit(exitStatus);
+}
+
+#endif
@@ -0,0 +1,200 @@
+/* SPDX-License-Identifier: MIT */
+
+#include "trace.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <inttypes.h>
+#include <mutex>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+#include "error.hpp"
+#include "helpers.hpp"
+#include "platform.hpp" // getpid
+
+struct TraceEvent {
+	std::string name;
+	std::string detail;
+	uint64_t start; // In microseconds
+	uint64_t duration;
+	uint32_t threadID;
+};
+
+struct OpenPhase {
+	std::string name;
+	std::string detail;
+	uint64_t start;
+};
+
+static bool tracing = false;
+static char const *tracedProgram;
+static std::string tracePath;
+static int startingPID; // The process that started tracing
+static int tracedPID;   // The process that the events were recorded by
+
+static std::mutex eventsMutex; // Guards these, which all threads record into
+static std::vector<TraceEvent> events;
+
+static std::atomic_uint32_t nextThreadID = 0;
+static thread_local uint32_t threadID = nextThreadID++;
+
+static uint64_t now() {
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+	           std::chrono::system_clock::now().time_since_epoch()
+	).count();
+}
+
+// Forked processes inherit the events recorded so far, which are their parent's to write
+static void forgetParentEvents() {
+	if (int pid = getpid(); pid != tracedPID) {
+		events.clear();
+		tracedPID = pid;
+	}
+}
+
+// Phases still open when their thread ends, e.g. because of a fatal error, end then; this includes
+// the main thread, whose thread-local variables are destroyed before the trace is written
+static thread_local struct OpenPhases {
+	std::vector<OpenPhase> phases;
+
+	void end() {
+		OpenPhase &phase = phases.back();
+		uint64_t end = now();
+
+		std::lock_guard lock(eventsMutex);
+		forgetParentEvents();
+		events.push_back({
+		    .name = std::move(phase.name),
+		    .detail = std::move(phase.detail),
+		    .start = phase.start,
+		    .duration = end - phase.start,
+		    .threadID = threadID,
+		});
+		phases.pop_back();
+	}
+
+	~OpenPhases() {
+		while (!phases.empty())
+			end();
+	}
+} openPhases;
+
+static void putJSONString(std::string const &str, FILE *file) {
+	putc('"', file);
+	for (char c : str) {
+		if (c == '"' || c == '\\')
+			fprintf(file, "\\%c", c);
+		else if ((uint8_t)c < ' ')
+			fprintf(file, "\\u%04x", c);
+		else
+			putc(c, file);
+	}
+	putc('"', file);
+}
+
+static void writeTrace() {
+	if (!tracing)
+		return;
+	tracing = false;
+
+	std::lock_guard lock(eventsMutex);
+	forgetParentEvents();
+
+	std::string path;
+	bool hasPID = false;
+	for (size_t i = 0; i < tracePath.size(); ++i) {
+		if (tracePath[i] == '%' && i + 1 < tracePath.size() && tracePath[i + 1] == 'p') {
+			path += std::to_string(tracedPID);
+			hasPID = true;
+			++i;
+		} else {
+			path += tracePath[i];
+		}
+	}
+	// Without a per-process path, forked processes would overwrite their parent's trace
+	if (!hasPID && tracedPID != startingPID)
+		return;
+
+	FILE *file = fopen(path.c_str(), "w");
+	if (!file) {
+		warn("Failed to open trace file '%s'", path.c_str());
+		return;
+	}
+	Defer closeFile{[&] { fclose(file); }};
+
+	fprintf(file, "{\"traceEvents\": [\n");
+	fprintf(
+	    file,
+	    "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": %d, \"tid\": 0, "
+	    "\"args\": {\"name\": ",
+	    tracedPID
+	);
+	putJSONString(tracedProgram, file);
+	fputs("}}", file);
+	for (TraceEvent const &event : events) {
+		fputs(",\n{\"name\": ", file);
+		putJSONString(event.name, file);
+		fprintf(
+		    file,
+		    ", \"cat\": \"%s\", \"ph\": \"X\", \"ts\": %" PRIu64 ", \"dur\": %" PRIu64
+		    ", \"pid\": %d, \"tid\": %" PRIu32,
+		    tracedProgram,
+		    event.start,
+		    event.duration,
+		    tracedPID,
+		    event.threadID
+		);
+		if (!event.detail.empty()) {
+			fputs(", \"args\": {\"detail\": ", file);
+			putJSONString(event.detail, file);
+			putc('}', file);
+		}
+		putc('}', file);
+	}
+	fputs("\n]}\n", file);
+
+	if (ferror(file))
+		warn("Failed to write trace file '%s'", path.c_str());
+}
+
+void trace_Start(char const *programName, char const *path) {
+	if (!path)
+		path = getenv("RGBDS_TRACE");
+	if (!path || !*path || tracing)
+		return;
+
+	tracing = true;
+	tracedProgram = programName;
+	tracePath = path;
+	startingPID = getpid();
+	tracedPID = startingPID;
+	atexit(writeTrace);
+}
+
+void trace_Write() {
+	if (!tracing)
+		return;
+
+	while (!openPhases.phases.empty())
+		openPhases.end();
+	writeTrace();
+}
+
+void trace_Begin(std::string const &name, std::string const &detail) {
+	if (!tracing)
+		return;
+
+	openPhases.phases.push_back({.name = name, .detail = detail, .start = now()});
+}
+
+void trace_End() {
+	if (!tracing)
+		return;
+
+	assume(!openPhases.phases.empty());
+	openPhases.end();
+}
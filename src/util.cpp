@@ -3,10 +3,14 @@
 #include "util.hpp"
 
 #include <ctype.h>
+#include <optional>
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 #include <vector>
 
+#include "helpers.hpp" // Defer
+
 #include "extern/utf8decoder.hpp"
 
 char const *printChar(int c) {
@@ -54,6 +58,13 @@ char const *printChar(int c) {
 }
 
 size_t readUTF8Char(std::vector<uint8_t> *dest, char const *src) {
+	// ASCII characters are their own single-byte encoding
+	if (uint8_t c = src[0]; c < 0x80) {
+		if (dest)
+			dest->push_back(c);
+		return 1;
+	}
+
 	uint32_t state = 0, codepoint;
 	size_t i = 0;
 
@@ -69,3 +80,39 @@ size_t readUTF8Char(std::vector<uint8_t> *dest, char const *src) {
 			return i;
 	}
 }
+
+size_t countASCIIPrefix(char const *str, size_t len) {
+	size_t i = 0;
+
+	// Check a word at a time, since most text is ASCII: subtracting 1 from each byte borrows into
+	// its high bit only if it was NUL, and the high bit is otherwise only set in non-ASCII bytes
+	for (uint64_t word; len - i >= sizeof(word); i += sizeof(word)) {
+		memcpy(&word, &str[i], sizeof(word));
+		if (((word - 0x0101010101010101) | word) & 0x8080808080808080)
+			break;
+	}
+	while (i < len && (uint8_t)(str[i] - 1) < 0x7F)
+		i++;
+	return i;
+}
+
+uint64_t hashFNV1a(void const *data, size_t size, uint64_t hash) {
+	for (size_t i = 0; i < size; i++)
+		hash = (hash ^ ((uint8_t const *)data)[i]) * 0x100000001B3;
+	return hash;
+}
+
+std::optional<uint64_t> hashFileFNV1a(char const *path) {
+	FILE *file = fopen(path, "rb");
+	if (!file)
+		return std::nullopt;
+	Defer closeFile{[&] { fclose(file); }};
+
+	uint64_t hash = hashFNV1a(nullptr, 0);
+	char buf[BUFSIZ];
+	for (size_t nbRead; (nbRead = fread(buf, 1, sizeof(buf), file)) != 0;)
+		hash = hashFNV1a(buf, nbRead, hash);
+	if (ferror(file))
+		return std::nullopt;
+	return hash;
+}
@@ -0,0 +1 @@
+INCLUDE "cache-includes-warning.inc"
@@ -0,0 +1,11 @@
+DEF BASE EQU 7
+INCLUDE "cache-includes.inc"
+INCLUDE "cache-includes.inc" ; Skipped by the include guard
+
+	twice {d:ANSWER}
+	DEF NEXT_VALUE EQU NEXT
+	PRINTLN "{d:NEXT_VALUE} {d:counter} {d:obj_tile} {d:sizeof_obj} {d:_RS}"
+
+SECTION "test", ROM0
+	SETCHARMAP upper
+	db "AB"
@@ -0,0 +1,21 @@
+; Macro and REPT bodies are lexed again on each use, but most of their tokens are cached;
+; check that what does change between uses is taken into account
+
+DEF value = 1
+FOR i, 3
+	DEF n = value + %10
+	PRINTLN n
+	IF i == 0
+		; From now on, `value` is a string expansion
+		PURGE value
+		DEF value EQUS "40"
+	ELIF i == 1
+		; From now on, `%10` means 1
+		OPT b10
+	ENDC
+ENDR
+
+SECTION "anonymous labels", ROM0
+REPT 2
+:	dw :-
+ENDR
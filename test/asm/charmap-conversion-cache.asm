@@ -0,0 +1,19 @@
+; Converting the same strings again must give the same results, and warnings,
+; even after the charmap changes
+SECTION "test", ROM0
+NEWCHARMAP derived, main
+SETCHARMAP main
+REPT 2
+	db "éa", CHARLEN("éa")
+ENDR
+SETCHARMAP derived
+REPT 2
+	db "éa", CHARLEN("éa")
+ENDR
+CHARMAP "a", 7
+REPT 2
+	db "éa", CHARLEN("éa")
+	dw "aa"
+ENDR
+SETCHARMAP main
+db "éa", CHARLEN("éa")
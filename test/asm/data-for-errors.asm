@@ -0,0 +1,15 @@
+SECTION "tables", ROM0
+	DB FOR i, 0, 4, 0, i
+	; Only the table's variable may be unknown in its fixed-point functions
+	DW FOR j, 2, SIN(Label) + j
+	DW SIN(Label * 1.0)
+	; The range must be constant
+	DB FOR k, Label, k
+DEF constant EQU 42
+	DB FOR constant, 2, constant
+Label:
+	DB FOR n, 2, HIGH(n) + 1
+	; The variable has no value yet while the expression is parsed
+	DB FOR i, 2, DEF(i)
+	DB FOR i, 2, ISCONST(i * 2)
+	DB FOR i, 2, ISCONST(@)
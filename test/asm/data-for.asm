@@ -0,0 +1,18 @@
+SECTION "tables", ROM0
+Start:
+	DB FOR i, 8, i * 3 + 1
+	DW FOR j, 2, 10, 3, (MUL(j * 1.0, 2.5) + SIN(j * 0.1)) >> 12
+	DL FOR k, 5, 0, -2, k << 20 | HIGH(k * 100)
+	; PC is the address of each entry
+	DW FOR p, 3, @ - Start
+	; Entries that are not constant become patches
+	DW FOR q, 3, Label + q
+	DB FOR r, 4, ATAN2(r * 1.0, 2.0, 8) >> 4
+	DB FOR s, 1, 6, 2, STRLEN("ab") + s
+	DB FOR t, 5, 1, 1
+Label:
+	; The variable is left as after a FOR loop
+	PRINTLN "{d:i} {d:j} {d:k} {d:s} {d:t}"
+
+DEF big EQU 300
+	DB FOR u, 2, big + u
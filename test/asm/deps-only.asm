@@ -0,0 +1,16 @@
+SECTION "Test", ROM0
+
+; Labels keep their values without any data being written, so the same files get included
+Start:
+	INCBIN "data.bin", 120
+	INCBIN "data.bin", 0, 2
+	ds 3, $2a
+	dw Start
+	db BANK(Start)
+End:
+
+	assert Start < $4000
+	DEF SIZE EQU End - Start
+	IF SIZE == 11
+		INCLUDE "deps-only.inc"
+	ENDC
@@ -0,0 +1,19 @@
+; Bodies captured from within an expansion, and ones that continue past its end
+
+def inner equs "REPT 2\nPRINTLN \"rept in expansion\"\nENDR\n"
+	inner
+
+def outer equs "MACRO from_equs\nPRINTLN \"macro in expansion, \\1\"\nENDM\n"
+MACRO mac
+	outer
+	from_equs \1
+ENDM
+	mac arg
+
+def partial equs "REPT 3\nPRINT \"partial \"\n"
+	partial
+	PRINTLN "rept"
+ENDR
+
+def nested equs "for n, 2\nrept 2\nprintln n\nendr\nendr"
+	nested
@@ -0,0 +1,8 @@
+SECTION "Test", ROM0
+
+; Including the same file several times must give the same results as re-reading it each time
+	INCBIN "data.bin", 120
+	INCBIN "data.bin", 0, 2
+	INCBIN "data.bin", 120, 3
+	INCBIN "data.bin", 61, 1
+	INCBIN "data.bin", 123
@@ -0,0 +1,7 @@
+	greet world
+DEF counter += ANSWER
+	PRINTLN "{d:counter} {d:obj_tile} {d:_RS}"
+
+SECTION "test", ROM0
+	SETCHARMAP upper
+	db "AB"
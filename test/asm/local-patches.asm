@@ -0,0 +1,27 @@
+; Patches that only depend on their own section are applied by rgbasm,
+; and must give the same results as if rgblink had applied them
+
+SECTION "floating", ROM0, ALIGN[8, 2]
+Start:
+	jr .forward
+	db .end - .forward, LOW(.forward), .forward & $F0
+	dw .end - Start - (.forward - Start)
+	ld [hl], .end - .forward
+	db Const * 2
+	jr @
+.forward
+	jr Start
+	ld hl, Fixed
+	db LOW(Fixed), HIGH(Fixed)
+	dw Start ; Not known before linking
+.end
+
+DEF Const EQU 21
+
+SECTION "fixed", ROM0[$0120]
+	jr Fixed
+	jr Start - Start + Fixed
+Fixed:
+	jr nz, .next
+.next
+	db HIGH(@), LOW(Start)
@@ -0,0 +1,35 @@
+MACRO print_args
+	PRINTLN "{d:_NARG} args"
+	REPT _NARG
+		PRINTLN "  <\1>"
+		SHIFT
+	ENDR
+ENDM
+
+MACRO forward
+	print_args \#
+	SHIFT
+	print_args \# ; this comment is not an arg
+	SHIFT -1
+	print_args \#
+ENDM
+
+	forward 1, (2, 3), "four, five", STRCAT("six", "seven"), 8
+DEF num EQU 7
+	forward a\,b, "c\"d", "n{d:num}", f
+	forward p, , q
+	forward  spaced ,"", g
+	forward lone
+	forward
+
+MACRO outer
+	REPT 3
+		inner \#
+		SHIFT
+	ENDR
+ENDM
+MACRO inner
+	print_args \#, last
+ENDM
+
+	outer x, y, z
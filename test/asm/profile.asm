@@ -0,0 +1,16 @@
+INCLUDE "profile.inc"
+
+SECTION "profile", ROM0
+
+MACRO nested
+	REPT 2
+		twice 3
+	ENDR
+ENDM
+
+	nested
+	nested
+
+FOR I, 4
+	db I
+ENDR
@@ -0,0 +1,29 @@
+DEF list EQUS "0"
+FOR i, 1, 6
+	REDEF list EQUS "{list}, {d:i}"
+ENDR
+	PRINTLN "{list}"
+
+DEF saved EQUS "{list}"
+	REDEF list EQUS "{list}{list}"
+	PRINTLN "{list}"
+	PRINTLN "{saved}"
+
+	REDEF list EQUS "{s:list}!"
+	PRINTLN "{list}"
+	REDEF list EQUS "<{list}>"
+	PRINTLN "{list}"
+
+; The value being appended to is still being expanded
+DEF self EQUS "REDEF self EQUS \"\{self\}+\""
+	self
+	PRINTLN "{self}"
+
+MACRO append
+	REDEF \1 EQUS "{\1}\2"
+ENDM
+DEF word EQUS ""
+	append word, a
+	append word, b
+	append word, c
+	PRINTLN "{word}"
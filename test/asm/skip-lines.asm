@@ -0,0 +1,37 @@
+SECTION "skipped", ROM0
+
+IF 0
+	db 1 \
+ENDC ; continued, so not a directive
+	db "\\" \
+	ELSE
+	WARN "not reached"
+\
+	ENDC
+ENDC
+	WARN "after IF"
+
+MACRO skipper
+	IF \1
+		WARN "taken"
+	ELSE
+		REPT 2
+			db 2
+		ENDR
+	ENDC
+	WARN "after macro IF"
+ENDM
+	skipper 0
+	skipper 0
+	skipper 1
+
+FOR n, 3
+	IF n == 1
+		BREAK
+		IF 1
+			db 3
+		ENDC
+	ENDC
+	WARN "n = {d:n}"
+ENDR
+	WARN "after FOR"
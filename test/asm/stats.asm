@@ -0,0 +1,15 @@
+INCLUDE "profile.inc"
+
+SECTION "stats", ROM0
+
+DEF greeting EQUS "hello"
+DEF n EQU 3
+
+Start::
+	twice 2
+	dw Start, Later
+	REPT n
+		db "{greeting}"
+	ENDR
+Later:
+	jr Start
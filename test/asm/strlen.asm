@@ -6,3 +6,5 @@ ENDM
 
 	xstrlen "ABC"
 	xstrlen "カタカナ"
+	xstrlen "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+	xstrlen "ABCDEFGHカタカナIJKLMNOPQRSTUVWXYZ"
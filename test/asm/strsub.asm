@@ -28,3 +28,6 @@ ENDM
 	xstrsub "カタカナ", 3, 10
 	xstrsub "g̈", 1, 1
 	xstrsub "g̈", 1, 2
+	xstrsub "ABCDEFGHIJKLMNOPQRSTUVWXYZ", 9, 10
+	xstrsub "ABCDEFGHカタカナIJKLMNOPQRSTUVWXYZ", 8, 10
+	xstrsub "ABCDEFGHカタカナIJKLMNOPQRSTUVWXYZ", 10, 20
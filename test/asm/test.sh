@@ -59,6 +59,9 @@ else
 	rm -f version.asm
 fi
 
+# Precompile the header used by `load-pch.asm`
+"$RGBASM" --save-pch load-pch.pch load-pch.inc
+
 for i in *.asm; do
 	flags=${i%.asm}.flags
 	RGBASMFLAGS=-Weverything
@@ -128,6 +131,228 @@ for i in *.asm; do
 	done
 done
 
+# Check that recording, then replaying, the include cache does not change the results
+cacheDir="$(mktemp -d)"
+i="cache-includes.asm"
+"$RGBASM" -Weverything -o "$input" "$i" >/dev/null 2>&1
+for variant in '.cache-record' '.cache-replay'; do
+	(( tests++ ))
+	echo "${bold}${green}${i%.asm}${variant}...${rescolors}${resbold}"
+	"$RGBASM" -Weverything --cache-includes "$cacheDir" -o "$o" "$i" >"$output" 2>"$errput"
+	tryDiff "${i%.asm}.out" "$output" out
+	our_rc=$?
+	tryDiff /dev/null "$errput" err
+	(( our_rc = our_rc || $? ))
+	tryCmp "$input" "$o" o
+	(( our_rc = our_rc || $? ))
+	(( rc = rc || our_rc ))
+	if [[ $our_rc -ne 0 ]]; then
+		(( failed++ ))
+	fi
+done
+rm -rf "$cacheDir"
+
+# Check that an include recorded while its warnings were disabled does not replay without them
+cacheDir="$(mktemp -d)"
+i="cache-includes-warning.asm"
+"$RGBASM" --cache-includes "$cacheDir" -o "$o" "$i" >/dev/null 2>&1
+(( tests++ ))
+echo "${bold}${green}${i%.asm}.cache-replay...${rescolors}${resbold}"
+"$RGBASM" -Weverything --cache-includes "$cacheDir" -o "$o" "$i" >"$output" 2>"$errput"
+tryDiff "${i%.asm}.err" "$errput" err
+our_rc=$?
+(( rc = rc || our_rc ))
+if [[ $our_rc -ne 0 ]]; then
+	(( failed++ ))
+fi
+rm -rf "$cacheDir"
+
+# Check that restoring an object from the cache gives the same files as assembling it
+cacheDir="$(mktemp -d)"
+for i in stats.asm incbin-repeated.asm; do
+	"$RGBASM" -Weverything -M "$cacheDir/ref.d" -MP -MT obj -o "$input" "$i" >/dev/null 2>&1
+	for variant in '.objcache-record' '.objcache-restore'; do
+		(( tests++ ))
+		echo "${bold}${green}${i%.asm}${variant}...${rescolors}${resbold}"
+		"$RGBASM" -Weverything -v --cache-dir "$cacheDir" -M "$cacheDir/out.d" -MP -MT obj \
+			-o "$o" "$i" >"$output" 2>"$errput"
+		tryDiff /dev/null "$errput" err
+		our_rc=$?
+		tryCmp "$input" "$o" o
+		(( our_rc = our_rc || $? ))
+		tryDiff "$cacheDir/ref.d" "$cacheDir/out.d" d
+		(( our_rc = our_rc || $? ))
+		# Only the second assembly may be restored from the cache
+		if [[ "$variant" = .objcache-restore ]]; then
+			grep -q '^Restoring .* from the object cache$' "$output"
+		else
+			! grep -q '^Restoring .* from the object cache$' "$output"
+		fi
+		(( our_rc = our_rc || $? ))
+		(( rc = rc || our_rc ))
+		if [[ $our_rc -ne 0 ]]; then
+			(( failed++ ))
+		fi
+	done
+done
+rm -rf "$cacheDir"
+
+# Check that only scanning for dependencies finds the same ones as assembling, without an object
+i="deps-only.asm"
+(( tests++ ))
+echo "${bold}${green}${i%.asm}.deps-only...${rescolors}${resbold}"
+rm -f "$o"
+"$RGBASM" -Weverything -M "$gb" -MP -MT obj "$i" >/dev/null 2>&1
+"$RGBASM" -Weverything --deps-only -M "$input" -MP -MT obj -o "$o" "$i" >"$output" 2>"$errput"
+tryDiff "${i%.asm}.out" "$output" out
+our_rc=$?
+tryDiff /dev/null "$errput" err
+(( our_rc = our_rc || $? ))
+tryDiff "$gb" "$input" d
+(( our_rc = our_rc || $? ))
+[[ ! -e "$o" ]]
+(( our_rc = our_rc || $? ))
+(( rc = rc || our_rc ))
+if [[ $our_rc -ne 0 ]]; then
+	(( failed++ ))
+fi
+
+# Check what the profiler attributes to each context, ignoring the (unpredictable) timings
+i="profile.asm"
+(( tests++ ))
+echo "${bold}${green}${i%.asm}.profile...${rescolors}${resbold}"
+"$RGBASM" -Weverything --profile "$input" -o "$o" "$i" >"$output" 2>"$errput"
+sed -E 's/"value": [0-9]+/"value": 0/' "$input" >"$gb"
+tryDiff "${i%.asm}.json" "$gb" json
+our_rc=$?
+tryDiff /dev/null "$errput" err
+(( our_rc = our_rc || $? ))
+(( rc = rc || our_rc ))
+if [[ $our_rc -ne 0 ]]; then
+	(( failed++ ))
+fi
+
+# Check which phases are traced, through the option and the environment variable alike
+variant=.trace
+(( tests++ ))
+echo "${bold}${green}${i%.asm}${variant}...${rescolors}${resbold}"
+cat >"$gb" <<EOF
+1 "FOR(14)"
+2 "REPT(6)"
+1 "parse"
+1 "profile.asm"
+2 "profile.asm::nested"
+1 "profile.inc"
+4 "profile.inc::twice"
+1 "write_object"
+EOF
+"$RGBASM" -Weverything --trace "$input" -o "$o" "$i" >/dev/null 2>"$errput"
+sed -nE 's/^\{"name": ("[^"]*"), "cat": "rgbasm".*/\1/p' "$input" \
+	| sort | uniq -c | sed 's/^ *//' >"$output"
+tryDiff "$gb" "$output" trace
+our_rc=$?
+tryDiff /dev/null "$errput" err
+(( our_rc = our_rc || $? ))
+rm -f "$input"
+RGBDS_TRACE="$input" "$RGBLINK" -o "$gb" "$o"
+grep -q '"name": "read_object", "cat": "rgblink"' "$input"
+(( our_rc = our_rc || $? ))
+(( rc = rc || our_rc ))
+if [[ $our_rc -ne 0 ]]; then
+	(( failed++ ))
+fi
+
+# The stats report's counts must be exact, but its timings and memory usage cannot be
+i="stats.asm"
+variant=.stats
+(( tests++ ))
+echo "${bold}${green}${i%.asm}${variant}...${rescolors}${resbold}"
+"$RGBASM" -Weverything --stats "$input" -o "$o" "$i" >/dev/null 2>"$errput"
+unstable='microseconds|section_data|rpn_buffers|capture_buffers|symbol_storage|peak_rss_kib'
+sed -E "s/\"($unstable)\": ([0-9]+|null)/\"\\1\": 0/" "$input" >"$gb"
+tryDiff "${i%.asm}.json" "$gb" json
+our_rc=$?
+tryDiff /dev/null "$errput" err
+(( our_rc = our_rc || $? ))
+(( rc = rc || our_rc ))
+if [[ $our_rc -ne 0 ]]; then
+	(( failed++ ))
+fi
+
+# Check that an identical object file is left untouched, but a different one is rewritten
+i="div-mod.asm"
+variant=.keep-unchanged
+(( tests++ ))
+echo "${bold}${green}${i%.asm}${variant}...${rescolors}${resbold}"
+"$RGBASM" -Weverything -o "$o" "$i" >/dev/null 2>&1
+cp "$o" "$gb"
+touch -t 200001010000 "$o"
+: >"$input" # Newer than the object file, unless it gets rewritten
+"$RGBASM" -Weverything --keep-unchanged -o "$o" "$i" >/dev/null 2>"$errput"
+tryDiff /dev/null "$errput" err
+our_rc=$?
+[[ "$o" -ot "$input" ]]
+(( our_rc = our_rc || $? ))
+"$RGBASM" -Weverything --keep-unchanged -o "$o" ccode.asm >/dev/null 2>&1
+[[ "$o" -ot "$input" ]]
+(( our_rc = our_rc || !$? ))
+"$RGBASM" -Weverything --keep-unchanged -o "$o" "$i" >/dev/null 2>&1
+tryCmp "$gb" "$o" o
+(( our_rc = our_rc || $? ))
+(( rc = rc || our_rc ))
+if [[ $our_rc -ne 0 ]]; then
+	(( failed++ ))
+fi
+
+# Check that assembling several files at once gives the same objects as one at a time
+batchDir="$(mktemp -d)"
+batchFiles=(anon-label.asm ccode.asm charlen-charsub.asm div-mod.asm ds-align.asm)
+(( tests++ ))
+echo "${bold}${green}batch...${rescolors}${resbold}"
+"$RGBASM" -Weverything -j3 -o "$batchDir/%.o" "${batchFiles[@]}" >/dev/null 2>"$errput"
+tryDiff /dev/null "$errput" err
+our_rc=$?
+for i in "${batchFiles[@]}"; do
+	"$RGBASM" -Weverything -o "$o" "$i" >/dev/null 2>&1
+	tryCmp "$o" "$batchDir/${i%.asm}.o" o
+	(( our_rc = our_rc || $? ))
+done
+(( rc = rc || our_rc ))
+if [[ $our_rc -ne 0 ]]; then
+	(( failed++ ))
+fi
+rm -rf "$batchDir"
+
+# Check that assembling through a server gives the same results as assembling directly
+serverDir="$(mktemp -d)"
+"$RGBASM" -Weverything --serve "$serverDir/socket" &
+serverPid=$!
+for (( tries = 0; tries < 100; tries++ )); do
+	[[ -S "$serverDir/socket" ]] && break
+	sleep 0.05
+done
+for i in anon-label.asm ccode.asm div-mod.asm ds-align.asm nested-macrodef.asm; do
+	(( tests++ ))
+	echo "${bold}${green}${i%.asm}.server...${rescolors}${resbold}"
+	"$RGBASM" --connect "$serverDir/socket" -o "$o" "$i" >"$output" 2>"$errput"
+	our_rc=$?
+	"$RGBASM" -Weverything -o "$gb" "$i" >"$input" 2>"$serverDir/errput"
+	(( our_rc = our_rc != $? ))
+	tryDiff "$input" "$output" out
+	(( our_rc = our_rc || $? ))
+	tryDiff "$serverDir/errput" "$errput" err
+	(( our_rc = our_rc || $? ))
+	tryCmp "$gb" "$o" o
+	(( our_rc = our_rc || $? ))
+	(( rc = rc || our_rc ))
+	if [[ $our_rc -ne 0 ]]; then
+		(( failed++ ))
+	fi
+done
+kill "$serverPid"
+wait "$serverPid" 2>/dev/null
+rm -rf "$serverDir"
+
 if [[ "$failed" -eq 0 ]]; then
 	echo "${bold}${green}All ${tests} tests passed!${rescolors}${resbold}"
 else
@@ -111,6 +111,28 @@ rc=$((rc || $? != 1))
 tryDiff "$src/noexist.err" out.err noexist.err
 rc=$((rc || $?))
 
+# Check that fixing several files concurrently gives the same results, and reports in order
+(( tests++ ))
+echo "${bold}${green}jobs...${rescolors}${resbold}"
+files=(color compatible noexist mbc padding-large sgb title-trunc)
+mkdir serial parallel
+for f in "${files[@]}"; do
+	[[ -e "$src/$f.bin" ]] && cp "$src/$f.bin" serial/ && cp "$src/$f.bin" parallel/
+done
+(cd serial && ../$RGBFIX -v -m MBC5 -t "A TITLE" "${files[@]/%/.bin}" 2>../serial.err)
+our_rc=$?
+(cd parallel && ../$RGBFIX --jobs 4 -v -m MBC5 -t "A TITLE" "${files[@]/%/.bin}" 2>../parallel.err)
+(( our_rc = our_rc != $? ))
+tryDiff serial.err parallel.err jobs.err
+(( our_rc = our_rc || $? ))
+for f in serial/*.bin; do
+	tryCmp "$f" "parallel/${f#serial/}" "jobs ${f#serial/}"
+	(( our_rc = our_rc || $? ))
+done
+(( rc = rc || our_rc ))
+if [[ $our_rc -ne 0 ]]; then
+	(( failed++ ))
+fi
 
 if [[ "$failed" -eq 0 ]]; then
 	echo "${bold}${green}All ${tests} tests passed!${rescolors}${resbold}"
@@ -42,6 +42,9 @@ for f in *.bin; do
 		new_test ./rgbgfx_test "$f" $flags
 		test || fail $?
 	done
+	# Processing tiles in several threads should not change anything either
+	new_test ./rgbgfx_test "$f" -j 3
+	test || fail $?
 done
 
 # Test round-tripping '-r' with '-c #none'
@@ -74,6 +77,87 @@ for f in *.png; do
 	fi
 done
 
+# Check that converting several images in one batch gives the same results as one at a time
+batchDir="$(mktemp -d)"
+batchFiles=(crop multiple_manual_pals)
+for f in "${batchFiles[@]}"; do
+	echo "$f.png @$f.flags -o $batchDir/$f.2bpp"
+done >"$batchDir/manifest"
+new_test "$RGBGFX" -j 2 -u -O -T -P --batch "$batchDir/manifest"
+test || fail $?
+for f in "${batchFiles[@]}"; do
+	new_test "$RGBGFX" -u @$f.flags -o "$batchDir/$f.1.2bpp" -t "$batchDir/$f.1.tilemap" -p "$batchDir/$f.1.pal" $f.png
+	test || fail $?
+	for ext in 2bpp tilemap pal; do
+		new_test cmp "$batchDir/$f.1.$ext" "$batchDir/$f.$ext"
+		test || fail $?
+	done
+done
+rm -rf "$batchDir"
+
+# Check that recording, then replaying, the output cache does not change the results
+cacheDir="$(mktemp -d)"
+f=multiple_manual_pals
+for flags in "" "-b 1"; do
+	new_test "$RGBGFX" -u $flags @$f.flags -o "$cacheDir/$f.2bpp" -t "$cacheDir/$f.tilemap" -p "$cacheDir/$f.pal" $f.png
+	test || fail $?
+	for variant in record replay; do
+		new_test "$RGBGFX" --cache-dir "$cacheDir" -u $flags @$f.flags -o "$cacheDir/$f.$variant.2bpp" -t "$cacheDir/$f.$variant.tilemap" -p "$cacheDir/$f.$variant.pal" $f.png
+		test || fail $?
+		for ext in 2bpp tilemap pal; do
+			new_test cmp "$cacheDir/$f.$ext" "$cacheDir/$f.$variant.$ext"
+			test || fail $?
+		done
+	done
+done
+new_test '[[ $(ls "$cacheDir"/*.rgbgfx | wc -l) -eq 2 ]]'
+test || fail $?
+rm -rf "$cacheDir"
+
+# Check that seeded palette packing keeps the seed's palettes, except for the tiles that changed
+seedDir="$(mktemp -d)"
+head -c 256 seed0.bin >"$seedDir/tiles.2bpp"
+printf '\377\177\37\0\340\3\0\0\0\174\20\102\10\41\30\143\347\34\55\45\112\51\61\106\234\163\132\153\326\132\224\122' >"$seedDir/pals.pal"
+for f in a b; do
+	printf '\0\1\2\3\0%b\2\3\0\1\2\3\0\1\2\3' "$([[ $f = a ]] && echo '\1' || echo '\3')" >"$seedDir/$f.attrmap"
+	"$RGBGFX" -r 4 -o "$seedDir/tiles.2bpp" -p "$seedDir/pals.pal" -a "$seedDir/$f.attrmap" "$seedDir/$f.png"
+done
+printf '\3\2\1\0\3\2\1\0\3\2\1\0\3\2\1\0' >"$seedDir/seed.palmap"
+printf '\3\2\1\0\3\0\1\0\3\2\1\0\3\2\1\0' >"$seedDir/b.expected.palmap"
+new_test "$RGBGFX" -u -q "$seedDir/a.palmap" --seed-palette-map "$seedDir/seed.palmap" "$seedDir/a.png"
+test || fail $?
+new_test cmp "$seedDir/seed.palmap" "$seedDir/a.palmap"
+test || fail $?
+new_test "$RGBGFX" -u -q "$seedDir/b.palmap" --seed-palette-map "$seedDir/seed.palmap" "$seedDir/b.png"
+test || fail $?
+new_test cmp "$seedDir/b.expected.palmap" "$seedDir/b.palmap"
+test || fail $?
+rm -rf "$seedDir"
+
+# Check that images sharing their tiles can each be reconstructed from the shared tile data
+sharedDir="$(mktemp -d)"
+head -c 256 seed0.bin >"$sharedDir/a.2bpp"
+{ head -c 128 seed0.bin; head -c 128 seed1.bin; } >"$sharedDir/b.2bpp"
+for f in a b; do
+	"$RGBGFX" -r 4 -o "$sharedDir/$f.2bpp" "$sharedDir/$f.png"
+done
+new_test "$RGBGFX" --shared-tiles -o "$sharedDir/shared.2bpp" -T "$sharedDir/a.png" "$sharedDir/b.png"
+test || fail $?
+# The second image's first 8 tiles are the first image's
+new_test '[[ $(wc -c <"$sharedDir/shared.2bpp") -eq 384 ]]'
+test || fail $?
+for f in a b; do
+	new_test "$RGBGFX" -r 4 -o "$sharedDir/shared.2bpp" -t "$sharedDir/$f.tilemap" "$sharedDir/$f.out.png"
+	test || fail $?
+	new_test "$RGBGFX" -o "$sharedDir/$f.out.2bpp" "$sharedDir/$f.out.png"
+	test || fail $?
+	new_test "$RGBGFX" -o "$sharedDir/$f.in.2bpp" "$sharedDir/$f.png"
+	test || fail $?
+	new_test cmp "$sharedDir/$f.in.2bpp" "$sharedDir/$f.out.2bpp"
+	test || fail $?
+done
+rm -rf "$sharedDir"
+
 if [[ "$failed" -eq 0 ]]; then
 	echo "${bold}${green}All ${tests} tests passed!${rescolors}${resbold}"
 else
@@ -0,0 +1,7 @@
+SECTION "entry", ROM0[$100]
+	nop
+	jp $150
+	ds $150 - @, 0
+SECTION "code", ROM0
+	ld a, 3
+	ld [$2000], a
@@ -0,0 +1,56 @@
+SECTION "main", ROM0[$100]
+	call TableA
+	call TableB
+	call CopyA
+	call CopyB
+	ld hl, OtherA
+	ld hl, OtherB
+	ld hl, ComparedA
+	ld hl, ComparedB
+	ld a, MaskedA & $FF
+	ld a, MaskedB & $FF
+	dw StoredA, StoredB
+	; Stored after bytes that happen to be `call` and `jp` opcodes
+	db $CD
+	dw PointedA
+	db $C3
+	dw PointedB
+
+SECTION "table a", ROMX
+TableA::
+	db 1, 2, 3, 4
+.end
+	jp .end
+
+SECTION "copy a", ROMX
+CopyA::
+	ld a, [hli]
+	call Helper
+	jr CopyA
+
+; Refers to another label than its copy
+SECTION "other a", ROMX
+OtherA::
+	dw Helper
+
+; Identical, but its address is compared
+SECTION "compared a", ROMX
+ComparedA::
+	db 42
+
+; Identical, but their addresses are stored, or masked, and may then be compared
+SECTION "stored a", ROMX
+StoredA::
+	db 69
+
+SECTION "masked a", ROMX
+MaskedA::
+	db 13
+
+SECTION "pointed a", ROMX
+PointedA::
+	db 7
+
+SECTION "helper", ROM0
+Helper::
+	ret
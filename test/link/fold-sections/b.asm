@@ -0,0 +1,32 @@
+SECTION "table b", ROMX
+TableB::
+	db 1, 2, 3, 4
+.end
+	jp .end
+
+SECTION "copy b", ROMX
+CopyB::
+	ld a, [hli]
+	call Helper
+	jr CopyB
+
+SECTION "other b", ROMX
+OtherB::
+	dw OtherB
+
+SECTION "compared b", ROMX
+ComparedB::
+	db 42
+	assert ComparedB != ComparedA
+
+SECTION "stored b", ROMX
+StoredB::
+	db 69
+
+SECTION "masked b", ROMX
+MaskedB::
+	db 13
+
+SECTION "pointed b", ROMX
+PointedB::
+	db 7
@@ -0,0 +1,2 @@
+SECTION FRAGMENT "big", ROMX
+	ds $4000, $42
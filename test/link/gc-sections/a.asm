@@ -0,0 +1,50 @@
+SECTION "entry", ROM0[$100]
+	call Main
+	ld a, BANK(Data)
+	ld hl, wCounter
+
+SECTION "main", ROM0
+Main::
+	ld hl, STARTOF("table")
+	; Only referred to by values that rgbasm could compute, if not for that
+	ld bc, SizedEnd - Sized
+	ld a, Aligned & $0F
+	ret
+
+SECTION "table", ROMX
+Table:
+	db 1, 2, 3
+
+SECTION "sized", ROMX
+Sized:
+	db 7, 8
+SizedEnd:
+
+SECTION "aligned", ROMX, ALIGN[4]
+Aligned:
+	db 9
+
+SECTION "unused", ROMX
+Unused::
+	call OnlyFromUnused
+	ret
+
+SECTION "only from unused", ROMX
+OnlyFromUnused:
+	ret
+
+SECTION "asserted", ROMX
+Asserted:
+	db 42
+	ASSERT Asserted != 0
+
+SECTION "pinned", ROMX, BANK[2]
+Pinned:
+	db 4
+
+SECTION "unused vars", WRAM0
+wUnused:: ds 16
+
+SECTION "placed", ROMX
+Placed:
+	db 6
@@ -0,0 +1,9 @@
+SECTION "data", ROMX
+Data::
+	db 5
+
+SECTION FRAGMENT "vars", WRAM0
+wCounter:: db
+
+SECTION FRAGMENT "vars", WRAM0
+wOther:: db
@@ -0,0 +1,2 @@
+SECTION "Small", ROM0
+	db "kept"
@@ -0,0 +1,6 @@
+SECTION "Small", ROM0
+	db "kept"
+
+; Without the previous placement, this would go first, since it is bigger
+SECTION "Big", ROM0
+	ds 16, $FF
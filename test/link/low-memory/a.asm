@@ -0,0 +1,11 @@
+SECTION FRAGMENT "code", ROM0
+Start::
+	jr Middle
+	ds 40, $AA
+	call Finish
+	db "literal bytes"
+
+SECTION "data", ROM0
+	dw Start, Middle, Finish
+	ds 300, $55
+	db BANK(Finish), LOW(Middle - Start)
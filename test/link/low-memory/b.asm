@@ -0,0 +1,11 @@
+SECTION FRAGMENT "code", ROM0
+Middle::
+	ld hl, Start
+	jr Start
+	ds 20
+	dl Finish * 3
+
+SECTION FRAGMENT "code", ROM0
+Finish::
+	jr Middle
+	db HIGH(Finish), 1, 2, 3
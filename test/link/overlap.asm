@@ -0,0 +1,7 @@
+SECTION "Low", ROM0[$100]
+	ds $40
+SECTION "High", ROM0[$140]
+	ds $40
+; Overlaps both of the above, but only the lowest one is reported
+SECTION "Overlapping", ROM0[$13f]
+	ds 2
@@ -0,0 +1,25 @@
+; These fit in 3 banks, but first-fit decreasing needs 4
+SECTION "s0", ROMX
+	ds 2169
+SECTION "s1", ROMX
+	ds 5424
+SECTION "s2", ROMX
+	ds 5924
+SECTION "s3", ROMX
+	ds 6321
+SECTION "s4", ROMX
+	ds 6137
+SECTION "s5", ROMX
+	ds 3503
+SECTION "s6", ROMX
+	ds 787
+SECTION "s7", ROMX
+	ds 5424
+SECTION "s8", ROMX
+	ds 5888
+SECTION "s9", ROMX
+	ds 3769
+SECTION "s10", ROMX
+	ds 407
+SECTION "s11", ROMX
+	ds 3351
@@ -0,0 +1,9 @@
+SECTION "Header", ROM0[$100]
+	nop
+
+SECTION "Code", ROMX
+	ld a, b
+
+; Without its hint, this would go first, at the start of bank 1
+SECTION "Data", ROMX
+	ds 32, $AA
@@ -0,0 +1,6 @@
+SECTION "Fixed", ROM0[$0000]
+	db 1
+SECTION "Aligned", ROM0, ALIGN[13]
+	ds $2000, 2
+SECTION "Floating", ROM0
+	ds $10, 3
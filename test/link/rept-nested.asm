@@ -0,0 +1,19 @@
+SECTION "test", ROM0
+
+MACRO check
+	REPT 2
+		assert WARN, Base, "\1 {d:i}"
+	ENDR
+ENDM
+
+Base:
+FOR i, 3
+	REPT 2
+		IF i != 1
+			assert WARN, Base, "{d:i}"
+		ENDC
+		REPT 1
+			check nested
+		ENDR
+	ENDR
+ENDR
@@ -0,0 +1,10 @@
+SECTION FRAGMENT "code", ROM0
+Start::
+	call Helper
+	jp Start
+
+SECTION UNION "vars", WRAM0
+wCounter: db
+
+SECTION "other", WRAM0[$C100]
+wBuffer: ds 16
@@ -0,0 +1,9 @@
+SECTION FRAGMENT "code", ROM0
+Helper::
+	ld hl, wScratch
+	ret
+
+SECTION UNION "vars", WRAM0
+wScratch: ds 4
+
+assert Helper - Start == 6
@@ -10,13 +10,14 @@ gbtemp="$(mktemp)"
 gbtemp2="$(mktemp)"
 outtemp="$(mktemp)"
 outtemp2="$(mktemp)"
+statetemp="$(mktemp)"
 tests=0
 failed=0
 rc=0
 
 # Immediate expansion is the desired behavior.
 # shellcheck disable=SC2064
-trap "rm -f ${otemp@Q} ${gbtemp@Q} ${gbtemp2@Q} ${outtemp@Q} ${outtemp2@Q}" EXIT
+trap "rm -f ${otemp@Q} ${gbtemp@Q} ${gbtemp2@Q} ${outtemp@Q} ${outtemp2@Q} ${statetemp@Q}" EXIT
 
 bold="$(tput bold)"
 resbold="$(tput sgr0)"
@@ -181,6 +182,43 @@ rgblinkQuiet -o "$gbtemp2" "$outtemp"
 tryCmp "$gbtemp" "$gbtemp2"
 evaluateTest
 
+test="incremental"
+startTest
+rm -f "$statetemp" # The first incremental link starts without any state
+"$RGBASM" -o "$otemp" "$test"/a.asm
+"$RGBASM" -o "$gbtemp2" "$test"/b.asm
+continueTest
+rgblinkQuiet -i "$statetemp" -o "$gbtemp" "$otemp" 2>"$outtemp"
+tryDiff /dev/null "$outtemp"
+# The section from the first link must stay where it was
+rgblinkQuiet -i "$statetemp" -o "$gbtemp" "$gbtemp2" 2>"$outtemp"
+tryDiff /dev/null "$outtemp"
+tryCmpRom "$test"/ref.out.bin
+evaluateTest
+
+test="placement-hints"
+startTest
+"$RGBASM" -o "$otemp" "$test"/a.asm
+continueTest
+cp "$test"/hints.txt "$statetemp"
+rgblinkQuiet --placement-hints "$statetemp" -o "$gbtemp" "$otemp" 2>"$outtemp"
+substPath "$statetemp" "$test"/hints.txt "$outtemp"
+tryDiff "$test"/out.err "$outtemp"
+tryDiff "$test"/ref.out.hints "$statetemp"
+# Relinking from the rewritten hints must not move anything
+rgblinkQuiet --placement-hints "$statetemp" -o "$gbtemp" "$otemp" 2>"$outtemp"
+tryDiff /dev/null "$outtemp"
+tryDiff "$test"/ref.out.hints "$statetemp"
+evaluateTest
+# Sections put back where they were must not keep more constrained ones from being placed
+"$RGBASM" -o "$otemp" "$test"/conflict.asm
+continueTest -conflict
+cp "$test"/conflict-hints.txt "$statetemp"
+rgblinkQuiet --placement-hints "$statetemp" -o "$gbtemp" "$otemp" 2>"$outtemp"
+tryDiff /dev/null "$outtemp"
+tryDiff "$test"/ref.conflict.hints "$statetemp"
+evaluateTest
+
 test="overlay/smaller"
 startTest
 "$RGBASM" -o "$otemp" "$test"/a.asm
@@ -297,6 +335,216 @@ tryDiff "$test"/out.err "$outtemp"
 tryDiff "$test"/ref.out.sym "$outtemp2"
 tryCmpRom "$test"/ref.out.bin
 evaluateTest
+# Reading the object files concurrently must not change anything
+"$RGBASM" -o "$otemp" "$test"/a.asm
+continueTest -j
+rgblinkQuiet -j 2 -o "$gbtemp" -n "$outtemp2" "$gbtemp2" "$otemp" 2>"$outtemp"
+tryDiff "$test"/out.err "$outtemp"
+tryDiff "$test"/ref.out.sym "$outtemp2"
+tryCmpRom "$test"/ref.out.bin
+evaluateTest
+
+# A file failing to be read must only be reported after the diagnostics of the files before it
+test="read-abort"
+startTest
+for jobs in 1 4; do
+	continueTest "-j$jobs"
+	rgblinkQuiet -j $jobs -o "$gbtemp" "$test"/a.rel "$test"/b.o 2>"$outtemp"
+	tryDiff "$test"/out.err "$outtemp"
+	evaluateTest
+done
+
+# Patching sections concurrently must report the same diagnostics, in the same order
+test="cascading-errors"
+startTest
+"$RGBASM" -o "$otemp" "$test".asm
+continueTest -j
+rgblinkQuiet -j 4 -o "$gbtemp" "$otemp" 2>"$outtemp"
+tryDiff "$test".out "$outtemp"
+evaluateTest
+
+# Reading the data back from the object files must give the same output, and diagnostics
+test="low-memory"
+startTest
+"$RGBASM" -o "$otemp" "$test"/a.asm
+"$RGBASM" -o "$gbtemp2" "$test"/b.asm
+for jobs in 1 4; do
+	continueTest "-j$jobs"
+	rgblinkQuiet -j $jobs --low-memory -o "$gbtemp" "$otemp" "$gbtemp2"
+	tryCmpRom "$test"/ref.out.bin
+	evaluateTest
+done
+
+# Fragments' data is also copied concurrently when it is not read back
+test="low-memory"
+startTest
+"$RGBASM" -o "$otemp" "$test"/a.asm
+"$RGBASM" -o "$gbtemp2" "$test"/b.asm
+for jobs in 1 4; do
+	continueTest "-j$jobs-copied"
+	rgblinkQuiet -j $jobs -o "$gbtemp" "$otemp" "$gbtemp2"
+	tryCmpRom "$test"/ref.out.bin
+	evaluateTest
+done
+
+# Fragments whose sizes add up past what a section can hold must not wrap around
+test="fragment-overflow"
+startTest
+"$RGBASM" -o "$otemp" "$test"/a.asm
+continueTest
+rgblinkQuiet -o "$gbtemp" "$otemp" "$otemp" "$otemp" "$otemp" "$otemp" 2>"$outtemp"
+tryDiff "$test"/out.err "$outtemp"
+evaluateTest
+
+test="cascading-errors"
+startTest
+"$RGBASM" -o "$otemp" "$test".asm
+continueTest --low-memory
+rgblinkQuiet --low-memory -o "$gbtemp" "$otemp" 2>"$outtemp"
+tryDiff "$test".out "$outtemp"
+evaluateTest
+
+# Fixing the header while linking must give the same result as rgbfix, even through a pipe
+test="fix-header"
+startTest
+"$RGBASM" -o "$outtemp2" "$test"/a.asm
+continueTest
+rgblinkQuiet -x --validate --title "FIXED TITLE" --mbc-type MBC5+RAM+BATTERY --ram-size 3 \
+	-o "$gbtemp" "$outtemp2"
+tryCmpRom "$test"/ref.out.bin
+evaluateTest
+continueTest -pipe
+"$RGBLINK" -x --validate --title "FIXED TITLE" --mbc-type MBC5+RAM+BATTERY --ram-size 3 \
+	-o - "$outtemp2" | cat >"$gbtemp"
+tryCmpRom "$test"/ref.out.bin
+evaluateTest
+continueTest -pad
+rgblinkQuiet -x --pad-value 0xFF -o "$gbtemp" "$outtemp2"
+tryCmpRomSize "$gbtemp" 32768
+evaluateTest
+
+# Only sections that something at a fixed location refers to, even indirectly, must be kept
+test="gc-sections"
+startTest
+"$RGBASM" -o "$otemp" "$test"/a.asm
+"$RGBASM" -o "$gbtemp2" "$test"/b.asm
+continueTest
+rgblinkQuiet --gc-sections -l "$test"/script.link -o "$gbtemp" -n "$outtemp2" "$otemp" "$gbtemp2" \
+	2>"$outtemp"
+tryDiff /dev/null "$outtemp"
+tryDiff "$test"/ref.out.sym "$outtemp2"
+evaluateTest
+
+# Identical sections must be folded, unless their patches differ or their addresses are compared
+test="fold-sections"
+startTest
+"$RGBASM" -o "$otemp" "$test"/a.asm
+"$RGBASM" -o "$gbtemp2" "$test"/b.asm
+continueTest
+rgblinkQuiet --fold-sections -o "$gbtemp" -n "$outtemp2" "$otemp" "$gbtemp2" 2>"$outtemp"
+tryDiff /dev/null "$outtemp"
+tryDiff "$test"/ref.out.sym "$outtemp2"
+evaluateTest
+
+# The optimizing packer must find the ROM size that first-fit misses, and stop once it has
+test="pack-time"
+startTest
+"$RGBASM" -o "$otemp" "$test"/a.asm
+continueTest
+rgblinkQuiet -o "$gbtemp" "$otemp"
+tryCmpRomSize "$gbtemp" 81920
+evaluateTest
+for jobs in 1 4; do
+	continueTest "-j$jobs"
+	rgblinkQuiet -j $jobs --pack-time 60000 -o "$gbtemp" "$otemp"
+	tryCmpRomSize "$gbtemp" 65536
+	evaluateTest
+done
+
+# SDCC objects are read concurrently too, and their fragments must be laid out in order
+test="sdas"
+startTest
+for jobs in 1 4; do
+	continueTest "-j$jobs"
+	rgblinkQuiet -j $jobs -l "$test"/script.link -o "$gbtemp" -n "$outtemp2" \
+		"$test"/a.rel "$test"/b.rel "$test"/c.rel 2>"$outtemp"
+	tryDiff "$test"/out.err "$outtemp"
+	tryCmpRom "$test"/ref.out.bin
+	tryDiff "$test"/ref.out.sym "$outtemp2"
+	evaluateTest
+done
+
+# Characters that cannot appear in sym files must be escaped, even if they are not valid UTF-8
+test="sym-escapes"
+startTest
+continueTest
+rgblinkQuiet -l "$test"/script.link -o "$gbtemp" -n "$outtemp2" "$test"/a.rel 2>"$outtemp"
+tryDiff /dev/null "$outtemp"
+tryDiff "$test"/ref.out.sym "$outtemp2"
+evaluateTest
+
+# Objects can go from an assembler server to a linker server without touching the disk
+test="fix-header"
+startTest
+serverDir="$(mktemp -d)"
+"$RGBASM" --serve "$serverDir/asm" &
+asmPid=$!
+"$RGBLINK" -x --serve "$serverDir/link" &
+linkPid=$!
+for (( tries = 0; tries < 100; tries++ )); do
+	[[ -S "$serverDir/asm" && -S "$serverDir/link" ]] && break
+	sleep 0.05
+done
+continueTest -server
+"$RGBASM" --connect "$serverDir/asm" -o - "$test"/a.asm \
+	| "$RGBLINK" --connect "$serverDir/link" --validate --title "FIXED TITLE" \
+		--mbc-type MBC5+RAM+BATTERY --ram-size 3 -o - - >"$gbtemp"
+tryCmpRom "$test"/ref.out.bin
+evaluateTest
+kill "$asmPid" "$linkPid"
+wait "$asmPid" "$linkPid" 2>/dev/null
+rm -rf "$serverDir"
+
+# Each variant must be linked as if the common objects had been passed along with its own
+test="variants"
+startTest
+variantsDir="$(mktemp -d)"
+for obj in a b c; do
+	"$RGBASM" -o "$variantsDir/$obj.o" "$test/$obj.asm"
+done
+cat >"$variantsDir/variants.txt" <<EOF
+# The common objects are only read once
+-p 0x42 -o $variantsDir/1.gb $variantsDir/b.o
+
+	-o $variantsDir/2.gb -n $variantsDir/2.sym $variantsDir/c.o
+-t -o $variantsDir/3.gb $variantsDir/b.o
+EOF
+for jobs in 1 4; do
+	continueTest "-j$jobs"
+	rgblinkQuiet -j $jobs --variants "$variantsDir/variants.txt" "$variantsDir/a.o" 2>"$outtemp"
+	tryDiff /dev/null "$outtemp"
+	rgblinkQuiet -p 0x42 -o "$gbtemp" "$variantsDir/a.o" "$variantsDir/b.o"
+	tryCmp "$gbtemp" "$variantsDir/1.gb"
+	rgblinkQuiet -o "$gbtemp" -n "$outtemp2" "$variantsDir/a.o" "$variantsDir/c.o"
+	tryCmp "$gbtemp" "$variantsDir/2.gb"
+	tryDiff "$outtemp2" "$variantsDir/2.sym"
+	rgblinkQuiet -t -o "$gbtemp" "$variantsDir/a.o" "$variantsDir/b.o"
+	tryCmp "$gbtemp" "$variantsDir/3.gb"
+	evaluateTest
+done
+rm -rf "$variantsDir"
+
+# The stats report's counts must be exact, but its timings and memory usage cannot be
+test="stats"
+startTest
+"$RGBASM" -o "$otemp" "$test"/a.asm
+"$RGBASM" -o "$gbtemp2" "$test"/b.asm
+continueTest
+rgblinkQuiet --stats "$outtemp2" -o "$gbtemp" "$otemp" "$gbtemp2" 2>"$outtemp"
+tryDiff /dev/null "$outtemp"
+sed -i'' -E 's/"(microseconds|peak_rss_kib)": ([0-9]+|null)/"\1": 0/' "$outtemp2"
+tryDiff "$test"/ref.json "$outtemp2"
+evaluateTest
 
 if [[ "$failed" -eq 0 ]]; then
 	echo "${bold}${green}All ${tests} tests passed!${rescolors}${resbold}"
@@ -0,0 +1,3 @@
+SECTION "common", ROM0
+	db 1, 2, 3
+	dw Extra
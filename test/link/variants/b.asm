@@ -0,0 +1,3 @@
+SECTION "extra", ROM0
+Extra::
+	db "B"
@@ -0,0 +1,3 @@
+SECTION "extra", ROMX
+Extra::
+	db "C"
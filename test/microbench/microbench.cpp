@@ -0,0 +1,71 @@
+/* SPDX-License-Identifier: MIT */
+
+#include "microbench.hpp"
+
+#include <new>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string_view>
+#include <vector>
+
+uint64_t microbench::nbAllocs = 0;
+
+// The kernels are single-threaded, so the count does not need to be atomic
+void *operator new(size_t size) {
+	microbench::nbAllocs++;
+	if (void *ptr = malloc(size ? size : 1); ptr)
+		return ptr;
+	// Exceptions are disabled, so `std::bad_alloc` cannot be thrown
+	fputs("FATAL: Out of memory\n", stderr);
+	abort();
+}
+
+void *operator new[](size_t size) {
+	return operator new(size);
+}
+
+void operator delete(void *ptr) noexcept {
+	free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept {
+	free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept {
+	free(ptr);
+}
+
+void operator delete[](void *ptr, size_t) noexcept {
+	free(ptr);
+}
+
+static std::vector<std::string_view> selectedNames;
+
+void microbench::init(int argc, char *argv[]) {
+	for (int i = 1; i < argc; i++) {
+		if (argv[i][0] == '-') {
+			fprintf(stderr, "Usage: %s [benchmark name...]\n", argv[0]);
+			exit(1);
+		}
+		selectedNames.push_back(argv[i]);
+	}
+}
+
+bool microbench::isSelected(char const *name) {
+	if (selectedNames.empty())
+		return true;
+	for (std::string_view selected : selectedNames) {
+		// Benchmark names start with their kernel's, so they can be selected by kernel
+		if (strncmp(name, selected.data(), selected.length()) == 0)
+			return true;
+	}
+	return false;
+}
+
+void microbench::report(char const *name, double nsPerOp, double allocsPerOp) {
+	printf("%-40s %12.1f ns/op %10.2f allocs/op\n", name, nsPerOp, allocsPerOp);
+	fflush(stdout);
+}
@@ -0,0 +1,98 @@
+/* SPDX-License-Identifier: MIT */
+
+// Times the programs' hot kernels in isolation, unlike `run-benchmarks.sh`, which times whole
+// runs. Each `rgb*-microbench` program is linked with one program's sources, and runs the
+// benchmarks of its kernels on fixed inputs, printing how long one operation takes and how many
+// allocations it makes.
+
+#ifndef RGBDS_TEST_MICROBENCH_HPP
+#define RGBDS_TEST_MICROBENCH_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <stdint.h>
+
+namespace microbench {
+
+// Counted by the replacement of the global `operator new`, so allocations made without it (e.g.
+// by libpng) are not
+extern uint64_t nbAllocs;
+
+// Reads the names of the benchmarks to run (all of them by default) from the command line
+void init(int argc, char *argv[]);
+bool isSelected(char const *name);
+void report(char const *name, double nsPerOp, double allocsPerOp);
+
+// Keeps the compiler from optimizing away the computation of `value`
+template<typename T>
+inline void keep(T const &value) {
+#ifdef _MSC_VER
+	static char const volatile *sink;
+	sink = reinterpret_cast<char const volatile *>(&value);
+#else
+	asm volatile("" : : "m"(value) : "memory");
+#endif
+}
+
+/*
+ * Times a benchmark, and reports its best time and allocation count out of several rounds.
+ * @param name The name of the benchmark
+ * @param opsPerCall How many operations each call to `op` performs
+ * @param op The function to benchmark, which must do the same amount of work on every call
+ */
+template<typename F>
+void run(char const *name, uint64_t opsPerCall, F &&op) {
+	using Clock = std::chrono::steady_clock;
+	constexpr auto minRoundTime = std::chrono::milliseconds(50);
+	constexpr unsigned int nbRounds = 5;
+
+	if (!isSelected(name))
+		return;
+
+	// Find how many calls make a round long enough to be timed precisely; this also warms up
+	// the caches and any memory that `op` keeps allocated between calls
+	uint64_t nbCalls = 1;
+	for (;; nbCalls *= 2) {
+		Clock::time_point start = Clock::now();
+		for (uint64_t i = 0; i < nbCalls; i++)
+			op();
+		if (Clock::now() - start >= minRoundTime)
+			break;
+	}
+
+	double bestNs = 0;
+	uint64_t fewestAllocs = UINT64_MAX;
+	for (unsigned int round = 0; round < nbRounds; round++) {
+		uint64_t startAllocs = nbAllocs;
+		Clock::time_point start = Clock::now();
+		for (uint64_t i = 0; i < nbCalls; i++)
+			op();
+		std::chrono::duration<double, std::nano> elapsed = Clock::now() - start;
+
+		if (round == 0 || elapsed.count() < bestNs)
+			bestNs = elapsed.count();
+		fewestAllocs = std::min(fewestAllocs, nbAllocs - startAllocs);
+	}
+
+	double nbOps = (double)nbCalls * opsPerCall;
+	report(name, bestNs / nbOps, fewestAllocs / nbOps);
+}
+
+// A fixed pseudo-random sequence, so that the generated inputs are the same on every run
+struct Random {
+	uint32_t state;
+
+	uint32_t next() {
+		// xorshift32
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		return state;
+	}
+
+	uint32_t below(uint32_t bound) { return next() % bound; }
+};
+
+} // namespace microbench
+
+#endif // RGBDS_TEST_MICROBENCH_HPP
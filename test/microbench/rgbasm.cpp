@@ -0,0 +1,191 @@
+/* SPDX-License-Identifier: MIT */
+
+// Benchmarks of rgbasm's kernels: lexing, keyword lookup, charmap conversion, and expression
+// building. The lexer is compiled as part of this file, so that its internals can be reached.
+
+#include <inttypes.h>
+#include <memory>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "asm/charmap.hpp"
+#include "asm/opt.hpp"
+#include "asm/rpn.hpp"
+#include "asm/symbol.hpp"
+
+#include "microbench.hpp"
+
+#include "../../src/asm/lexer.cpp"
+
+using namespace std::literals;
+
+// Source code using most kinds of tokens, but nothing that would report a diagnostic
+static std::string makeSource(uint32_t nbLines) {
+	microbench::Random rng{.state = 0x5EED};
+	std::string source;
+
+	for (uint32_t i = 0; i < nbLines; i++) {
+		char line[128];
+		uint32_t n = rng.below(256);
+
+		switch (rng.below(8)) {
+		case 0:
+			snprintf(line, sizeof(line), "Label%" PRIu32 ":\n", i);
+			break;
+		case 1:
+			snprintf(line, sizeof(line), "\tld a, [hl+]\n");
+			break;
+		case 2:
+			snprintf(line, sizeof(line), "\tld [wVariable%" PRIu32 "], a\n", n);
+			break;
+		case 3:
+			snprintf(line, sizeof(line), "\tadd a, $%02" PRIX32 "\n", n);
+			break;
+		case 4:
+			snprintf(line, sizeof(line), "\tjr nz, Label%" PRIu32 "\n", i);
+			break;
+		case 5:
+			snprintf(line, sizeof(line), "\tdb \"Hello, world!\", %" PRIu32 "\n", n);
+			break;
+		case 6:
+			snprintf(line, sizeof(line), "\tdw %" PRIu32 " * 2, %%0101, &17, `0123\n", n);
+			break;
+		case 7:
+			snprintf(line, sizeof(line), "\tcall Function%" PRIu32 " ; Call it\n", n);
+			break;
+		}
+		source += line;
+	}
+	return source;
+}
+
+// Lexes the whole source, and returns how many tokens it had
+static uint32_t lexSource() {
+	uint32_t nbTokens = 0;
+
+	lexer_RestartRept(0); // Go back to the start of the source
+	do {
+		microbench::keep(yylex());
+		nbTokens++;
+	} while (lexerState->lastToken != T_(EOB));
+	return nbTokens;
+}
+
+static void benchLexer() {
+	std::string source = makeSource(10000);
+	auto chars = std::make_shared<char[]>(source.length());
+	memcpy(chars.get(), source.data(), source.length());
+
+	// Files are lexed like this once they are mapped, and macro and REPT bodies always are
+	LexerState state;
+	state.path = "<source>";
+	state.content.emplace<ViewedContent>(chars, source.length());
+	state.setAsCurrentState();
+
+	for (bool cachesTokens : {false, true}) {
+		state.cachesTokens = cachesTokens;
+		uint32_t nbTokens = lexSource();
+		microbench::run(
+		    cachesTokens ? "yylex (macro body)" : "yylex (file)", nbTokens, lexSource
+		);
+	}
+	lexerState = nullptr;
+}
+
+static void benchFindKeyword() {
+	std::vector<std::string> names;
+
+	// As many keywords, in various cases, as other identifiers
+	for (Keyword const &keyword : keywords) {
+		names.emplace_back(keyword.name);
+		for (char &c : names.emplace_back(keyword.name))
+			c = c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c;
+	}
+	microbench::Random rng{.state = 0x5EED};
+	for (size_t i = 0, n = names.size(); i < n; i++) {
+		static char const *prefixes[] = {"Label", "wVariable", "Function", "ld_", "_"};
+		names.push_back(prefixes[rng.below(std::size(prefixes))] + std::to_string(rng.below(1000)));
+	}
+
+	microbench::run("findKeyword", names.size(), [&names] {
+		for (std::string const &name : names)
+			microbench::keep(findKeyword(name));
+	});
+}
+
+static void benchCharmap() {
+	// Every character of the input is mapped, so that no warnings are reported
+	static std::string_view const multiChars[] = {"<PLAYER>", "<RIVAL>", "'s", "'d", "é", "ß"};
+	charmap_New("microbench", nullptr);
+	for (char c = ' '; c <= '~'; c++)
+		charmap_Add(std::string(1, c), c);
+	for (size_t i = 0; i < std::size(multiChars); i++)
+		charmap_Add(std::string(multiChars[i]), 0x80 + i);
+
+	microbench::Random rng{.state = 0x5EED};
+	std::string input;
+	uint32_t nbChars = 0;
+	for (; input.length() < 4096; nbChars++) {
+		if (rng.below(8) == 0)
+			input += multiChars[rng.below(std::size(multiChars))];
+		else
+			input += (char)(' ' + rng.below('~' - ' ' + 1));
+	}
+
+	std::vector<uint8_t> output;
+	microbench::run("charmap_ConvertNext", nbChars, [&] {
+		std::string_view view = input;
+		output.clear();
+		while (charmap_ConvertNext(view, &output))
+			;
+		microbench::keep(output);
+	});
+}
+
+static void benchBinaryOps() {
+	static RPNCommand const ops[] = {RPN_ADD, RPN_SUB, RPN_XOR, RPN_OR, RPN_AND};
+	constexpr uint32_t chainLength = 32;
+
+	// Known values are folded, but unknown ones build an RPN expression for the linker
+	for (bool isKnown : {true, false}) {
+		microbench::run(
+		    isKnown ? "makeBinaryOp (known)" : "makeBinaryOp (unknown)",
+		    chainLength,
+		    [isKnown] {
+			    Expression expr;
+			    if (isKnown)
+				    expr.makeNumber(1);
+			    else
+				    expr.makeSymbol("wUnknown");
+			    for (uint32_t i = 0; i < chainLength; i++) {
+				    Expression operand, result;
+				    operand.makeNumber(i);
+				    result.makeBinaryOp(ops[i % std::size(ops)], std::move(expr), operand);
+				    expr = std::move(result);
+			    }
+			    microbench::keep(expr);
+		    }
+		);
+	}
+}
+
+int main(int argc, char *argv[]) {
+	microbench::init(argc, argv);
+
+	// Like rgbasm's defaults
+	sym_Init(0);
+	opt_B("01");
+	opt_G("0123");
+	opt_P(0);
+	opt_Q(16);
+
+	benchLexer();
+	benchFindKeyword();
+	benchCharmap();
+	benchBinaryOps();
+	return 0;
+}
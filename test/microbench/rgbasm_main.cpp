@@ -0,0 +1,5 @@
+/* SPDX-License-Identifier: MIT */
+
+// The benchmarks have their own `main`, but need the globals that rgbasm's defines
+#define main rgbasm_main
+#include "../../src/asm/main.cpp"
@@ -0,0 +1,28 @@
+/* SPDX-License-Identifier: MIT */
+
+// Benchmarks of rgbfix's kernels: adding up the ROM's bytes for the global checksum.
+
+#include <stdint.h>
+#include <vector>
+
+#include "fix/header.hpp"
+
+#include "microbench.hpp"
+
+static void benchSumBytes() {
+	microbench::Random rng{.state = 0x5EED};
+	std::vector<uint8_t> bank(0x4000);
+	for (uint8_t &byte : bank)
+		byte = rng.next();
+
+	microbench::run("sumBytes (16 KiB bank)", 1, [&bank] {
+		microbench::keep(sumBytes(bank.data(), bank.size()));
+	});
+}
+
+int main(int argc, char *argv[]) {
+	microbench::init(argc, argv);
+
+	benchSumBytes();
+	return 0;
+}
@@ -0,0 +1,5 @@
+/* SPDX-License-Identifier: MIT */
+
+// The benchmarks have their own `main`, but need the globals that rgbfix's defines
+#define main rgbfix_main
+#include "../../src/fix/main.cpp"
@@ -0,0 +1,111 @@
+/* SPDX-License-Identifier: MIT */
+
+// Benchmarks of rgbgfx's kernels: encoding tiles, and deduplicating them. The image processing is
+// compiled as part of this file, so that its internals can be reached.
+
+#include <array>
+#include <png.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "gfx/main.hpp"
+#include "gfx/rgba.hpp"
+
+#include "microbench.hpp"
+
+#include "../../src/gfx/process.cpp"
+
+// Four shades of gray, darkest last
+static constexpr std::array<uint16_t, 4> grays = {0x7FFF, 0x56B5, 0x294A, 0x0000};
+
+// A 256x256 image made of a few distinct tiles, most of which are repeated, some of them flipped
+static bool writeImage(char const *path) {
+	constexpr uint32_t size = 256, nbDistinctTiles = 64;
+	microbench::Random rng{.state = 0x5EED};
+
+	std::vector<std::array<uint8_t, 64>> distinctTiles(nbDistinctTiles);
+	for (std::array<uint8_t, 64> &tile : distinctTiles) {
+		for (uint8_t &index : tile)
+			index = rng.below(grays.size());
+	}
+
+	std::vector<Rgba> pixels(size * size);
+	for (uint32_t tileY = 0; tileY < size; tileY += 8) {
+		for (uint32_t tileX = 0; tileX < size; tileX += 8) {
+			std::array<uint8_t, 64> const &tile = distinctTiles[rng.below(nbDistinctTiles)];
+			uint32_t flips = rng.below(4);
+
+			for (uint32_t y = 0; y < 8; y++) {
+				for (uint32_t x = 0; x < 8; x++) {
+					uint32_t srcX = flips & 1 ? 7 - x : x, srcY = flips & 2 ? 7 - y : y;
+					pixels[(tileY + y) * size + tileX + x] =
+					    Rgba::fromCGBColor(grays[tile[srcY * 8 + srcX]]);
+				}
+			}
+		}
+	}
+
+	png_image image{};
+	image.version = PNG_IMAGE_VERSION;
+	image.width = size;
+	image.height = size;
+	image.format = PNG_FORMAT_RGBA;
+	return png_image_write_to_file(&image, path, 0, pixels.data(), 0, nullptr);
+}
+
+static void benchTiles(Png const &png) {
+	Palette palette;
+	for (uint16_t gray : grays)
+		palette.addColor(gray);
+
+	std::vector<Png::TilesVisitor::Tile> imageTiles;
+	for (Png::TilesVisitor::Tile tile : png.visitAsTiles())
+		imageTiles.push_back(tile);
+
+	for (bool allowMirroring : {false, true}) {
+		options.allowMirroring = allowMirroring;
+
+		// Mirroring also makes each tile's hash be that of its canonical orientation
+		microbench::run(
+		    allowMirroring ? "TileData (with mirroring)" : "TileData",
+		    imageTiles.size(),
+		    [&imageTiles, &palette] {
+			    for (Png::TilesVisitor::Tile const &tile : imageTiles)
+				    microbench::keep(TileData(tile, palette));
+		    }
+		);
+
+		std::vector<TileData> tileData;
+		for (Png::TilesVisitor::Tile const &tile : imageTiles)
+			tileData.emplace_back(tile, palette);
+
+		microbench::run(
+		    allowMirroring ? "UniqueTiles::addTile (with mirroring)" : "UniqueTiles::addTile",
+		    tileData.size(),
+		    [&tileData] {
+			    optimized::UniqueTiles tiles;
+			    for (TileData const &data : tileData)
+				    microbench::keep(tiles.addTile(data));
+		    }
+		);
+	}
+	options.allowMirroring = false;
+}
+
+int main(int argc, char *argv[]) {
+	microbench::init(argc, argv);
+
+	std::string path = "microbench.png";
+	if (!writeImage(path.c_str())) {
+		fprintf(stderr, "FATAL: Failed to write \"%s\"\n", path.c_str());
+		return 1;
+	}
+	{
+		Png png(path);
+		benchTiles(png);
+	}
+	remove(path.c_str());
+	return 0;
+}
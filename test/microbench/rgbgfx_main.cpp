@@ -0,0 +1,5 @@
+/* SPDX-License-Identifier: MIT */
+
+// The benchmarks have their own `main`, but need the globals that rgbgfx's defines
+#define main rgbgfx_main
+#include "../../src/gfx/main.cpp"
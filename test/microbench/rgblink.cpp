@@ -0,0 +1,126 @@
+/* SPDX-License-Identifier: MIT */
+
+// Benchmarks of rgblink's kernels: evaluating patches' RPN expressions, and finding where to place
+// a section. Both are compiled as part of this file, so that their internals can be reached.
+
+#include <deque>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "linkdefs.hpp"
+
+#include "link/section.hpp"
+#include "link/symbol.hpp"
+
+#include "microbench.hpp"
+
+#include "../../src/link/assign.cpp"
+#include "../../src/link/patch.cpp"
+
+static void pushRPNLong(std::vector<uint8_t> &rpn, RPNCommand command, uint32_t value) {
+	rpn.push_back(command);
+	for (unsigned int i = 0; i < 32; i += 8)
+		rpn.push_back(value >> i);
+}
+
+static void benchComputeRPNExpr() {
+	Section section{};
+	section.name = "Code";
+	section.type = SECTTYPE_ROMX;
+	section.org = 0x4000;
+	section.bank = 1;
+
+	std::vector<Symbol> fileSymbols(2);
+	fileSymbols[0].name = "Label";
+	fileSymbols[0].type = SYMTYPE_LOCAL;
+	fileSymbols[0].data = Label{.sectionID = 0, .offset = 0x123, .section = &section};
+	fileSymbols[1].name = "CONSTANT";
+	fileSymbols[1].type = SYMTYPE_LOCAL;
+	fileSymbols[1].data = 42;
+
+	// Most patches are a lone label, e.g. `call Label`; fewer are longer, e.g. `ld a, LOW(x + 1)`
+	std::vector<uint8_t> labelRPN, longRPN;
+	pushRPNLong(labelRPN, RPN_SYM, 0);
+
+	static RPNCommand const ops[] = {RPN_ADD, RPN_SUB, RPN_XOR, RPN_OR, RPN_AND, RPN_SHR};
+	pushRPNLong(longRPN, RPN_SYM, 0);
+	for (uint32_t i = 0; i < 32; i++) {
+		if (i % 3 == 0)
+			pushRPNLong(longRPN, RPN_SYM, 1);
+		else
+			pushRPNLong(longRPN, RPN_CONST, i);
+		longRPN.push_back(ops[i % std::size(ops)]);
+	}
+
+	for (std::vector<uint8_t> const *rpn : {&labelRPN, &longRPN}) {
+		Patch patch{
+		    .src = nullptr,
+		    .lineNo = 0,
+		    .offset = 0,
+		    .pcSection = &section,
+		    .pcSectionID = 0,
+		    .pcOffset = 0,
+		    .type = PATCHTYPE_WORD,
+		    .isJumpTarget = false,
+		    .firstSectionRef = 0,
+		    .rpnExpression = *rpn,
+		};
+
+		microbench::run(
+		    rpn == &labelRPN ? "computeRPNExpr (label)" : "computeRPNExpr (65 commands)",
+		    1,
+		    [&patch, &fileSymbols] { microbench::keep(computeRPNExpr(patch, fileSymbols)); }
+		);
+	}
+}
+
+static void benchGetPlacement() {
+	constexpr uint32_t nbFullBanks = 64;
+	std::deque<Section> sections;
+
+	// Fill ROMX banks with fixed sections, leaving 32-byte gaps between them; the last bank's
+	// final gap is larger, so only it has room for a 48-byte section
+	initFreeSpace();
+	for (uint32_t bank = 1; bank <= nbFullBanks; bank++) {
+		for (uint16_t addr = 0x4000; addr < 0x8000; addr += 0x40) {
+			Section &section = sections.emplace_back();
+			section.name = "Fixed " + std::to_string(sections.size());
+			section.size = bank == nbFullBanks && addr == 0x7FC0 ? 0x10 : 0x20;
+			section.type = SECTTYPE_ROMX;
+			section.isAddressFixed = true;
+			section.org = addr;
+			section.isBankFixed = true;
+			section.bank = bank;
+
+			MemoryLocation location;
+			ssize_t spaceIdx = getPlacement(section, location);
+			assume(spaceIdx != -1);
+			allocateSection(section, location, spaceIdx);
+		}
+	}
+
+	Section section{};
+	section.name = "Floating";
+	section.type = SECTTYPE_ROMX;
+
+	// Sections which fit in the first gap, and ones which only fit much further
+	for (uint16_t size : {0x20, 0x30}) {
+		section.size = size;
+		microbench::run(
+		    size == 0x20 ? "getPlacement (first gap)" : "getPlacement (last gap)", 1, [&section] {
+			    MemoryLocation location;
+			    microbench::keep(getPlacement(section, location));
+			    microbench::keep(location);
+		    }
+		);
+	}
+}
+
+int main(int argc, char *argv[]) {
+	microbench::init(argc, argv);
+
+	benchComputeRPNExpr();
+	benchGetPlacement();
+	return 0;
+}
@@ -0,0 +1,5 @@
+/* SPDX-License-Identifier: MIT */
+
+// The benchmarks have their own `main`, but need the globals that rgblink's defines
+#define main rgblink_main
+#include "../../src/link/main.cpp"
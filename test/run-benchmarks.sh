@@ -0,0 +1,179 @@
+#!/usr/bin/env bash
+set -e
+
+cd "$(dirname "$0")"
+
+usage() {
+	echo "Times RGBDS on synthetic workloads, to measure performance changes consistently."
+	echo "Options:"
+	echo "    -h, --help      show this help message"
+	echo "    -k, --keep      keep the generated workloads, and print where they are"
+	echo "    -n, --runs <n>  time each workload this many times, keeping the fastest (default: 3)"
+	echo "    -q, --quick     generate workloads ten times smaller"
+}
+
+# Parse options in pure Bash because macOS `getopt` is stuck
+# in what util-linux `getopt` calls `GETOPT_COMPATIBLE` mode
+keep=false
+runs=3
+scale=1
+while [[ $# -gt 0 ]]; do
+	case "$1" in
+		-h|--help)
+			usage
+			exit 0
+			;;
+		-k|--keep)
+			keep=true
+			;;
+		-n|--runs)
+			shift
+			runs="$1"
+			;;
+		-q|--quick)
+			scale=10
+			;;
+		--)
+			break
+			;;
+		*)
+			echo "$(basename "$0"): unknown option '$1'"
+			usage
+			exit 1
+			;;
+	esac
+	shift
+done
+
+# The programs can be overridden, e.g. to compare two builds
+RGBASM="$(realpath "${RGBASM:-../rgbasm}")"
+RGBLINK="$(realpath "${RGBLINK:-../rgblink}")"
+RGBFIX="$(realpath "${RGBFIX:-../rgbfix}")"
+RGBGFX="$(realpath "${RGBGFX:-../rgbgfx}")"
+
+# Refuse to run if RGBDS isn't present
+if [[ ! ( -x $RGBASM && -x $RGBLINK && -x $RGBFIX && -x $RGBGFX ) ]]; then
+	echo "Please build RGBDS before running the benchmarks"
+	false
+fi
+
+work="$(mktemp -d)"
+if $keep; then
+	echo "Workloads are kept in $work"
+else
+	# Immediate expansion is the desired behavior.
+	# shellcheck disable=SC2064
+	trap "rm -rf ${work@Q}" EXIT
+fi
+cd "$work"
+
+# Prints the fastest wall-clock time out of `$runs` runs of a command, discarding its output
+bench() { # name command...
+	local name="$1" best= t
+	shift
+	for (( i = 0; i < runs; i++ )); do
+		TIMEFORMAT=%R
+		t="$( { time "$@" >/dev/null 2>&1; } 2>&1 )" || {
+			echo "$name: '$*' failed!"
+			return 1
+		}
+		if [[ -z "$best" ]] || awk "BEGIN { exit !($t < $best) }"; then
+			best="$t"
+		fi
+	done
+	printf '%-24s %8ss\n' "$name" "$best"
+}
+
+echo "Generating workloads..."
+
+# A million lines of instructions, spread over as many banks as they need
+awk -v n=$(( 1000000 / scale )) 'BEGIN {
+	for (i = 0; i < n; i++) {
+		if (i % 8000 == 0)
+			printf "SECTION \"lines%d\", ROMX\n", i / 8000
+		printf "\tld a, [hl%s]\n", (i % 2 ? "+" : "-")
+	}
+}' >lines.asm
+
+# A hundred thousand exported labels, each referenced by a patch
+awk -v n=$(( 100000 / scale )) 'BEGIN {
+	for (i = 0; i < n; i++) {
+		if (i % 4000 == 0)
+			printf "SECTION \"labels%d\", ROMX\n", i / 4000
+		printf "Label%d::\n\tdw Label%d\n", i, (i * 7) % n
+	}
+}' >labels.asm
+
+# Recursive macros, expanded by REPT and FOR loops, and once very deeply
+cat >macros.asm <<EOF
+MACRO recurse
+	IF \\1 > 0
+		db LOW(\\1)
+		recurse \\1 - 1
+	ENDC
+ENDM
+FOR n, $(( 100 / scale + 1 ))
+	SECTION "macros{d:n}", ROMX
+	REPT 32
+		recurse 50
+	ENDR
+ENDR
+EOF
+cat >deep.asm <<EOF
+MACRO recurse
+	IF \\1 > 0
+		recurse \\1 - 1
+	ENDC
+ENDM
+	recurse $(( 3000 / scale ))
+EOF
+
+# Four megabytes of INCBIN, in slices filling each bank
+head -c $(( 4194304 / scale )) /dev/urandom >data.bin
+awk -v n=$(( 256 / scale )) 'BEGIN {
+	for (i = 0; i < n; i++)
+		printf "SECTION \"incbin%d\", ROMX\n\tINCBIN \"data.bin\", %d, $4000\n", i, i * 16384
+}' >incbin.asm
+
+# Thousands of floating sections, with various alignments, in several object files
+for (( obj = 0; obj < 8; obj++ )); do
+	awk -v obj=$obj -v n=$(( 600 / scale )) 'BEGIN {
+		for (i = 0; i < n; i++) {
+			printf "SECTION \"sect%d_%d\", ROMX, ALIGN[%d]\n", obj, i, i % 9
+			printf "\tds %d, %d\n", 16 + (i * 37 + obj * 11) % 600, i % 256
+		}
+	}' >sections$obj.asm
+done
+
+# A 512-bank ROM
+head -c $(( 8388608 / scale )) /dev/urandom >rom.gb
+
+# A large tilesheet made of unique tiles, and one made of a few tiles repeated many times
+head -c $(( 256 / scale * 128 * 16 )) /dev/urandom >unique.2bpp
+"$RGBGFX" -r 128 -o unique.2bpp unique.png
+head -c $(( 128 * 16 )) /dev/urandom >few.2bpp
+for (( i = 0; i < 256 / scale; i++ )); do
+	cat few.2bpp
+done >repeated.2bpp
+"$RGBGFX" -r 128 -o repeated.2bpp repeated.png
+
+echo "Timing the fastest of $runs runs..."
+
+for src in lines labels macros incbin; do
+	bench "rgbasm $src" "$RGBASM" -o $src.o $src.asm
+done
+bench "rgbasm deep macros" "$RGBASM" -r 3001 -o deep.o deep.asm
+for (( obj = 0; obj < 8; obj++ )); do
+	"$RGBASM" -o sections$obj.o sections$obj.asm
+done
+
+bench "rgblink sections" "$RGBLINK" -o sections.gb sections?.o
+bench "rgblink labels" "$RGBLINK" -o labels.gb -m labels.map -n labels.sym labels.o
+bench "rgblink incbin" "$RGBLINK" -o incbin.gb incbin.o
+
+# Fixing is done in place, but gives the same result every time
+bench "rgbfix 512 banks" "$RGBFIX" -v -m MBC5 -p 0xFF rom.gb
+
+bench "rgbgfx unique tiles" "$RGBGFX" -u -o unique.out.2bpp -t unique.tilemap unique.png
+bench "rgbgfx repeated tiles" "$RGBGFX" -m -o repeated.out.2bpp -t repeated.tilemap repeated.png
+bench "rgbgfx reverse" "$RGBGFX" -r 128 -o unique.2bpp reversed.png